@@ -0,0 +1,87 @@
+/*
+ * SpeedSQL - Benchmarks
+ *
+ * Cipher throughput of every registered provider at 4KB, 16KB and 64KB
+ * pages, on one thread and on several sharing a context, relative to
+ * AES-256-GCM; then the cipher speedsql_crypto_fastest picks for new
+ * databases on this machine.
+ *
+ * Build with -DSPEEDSQL_BUILD_BENCHMARK=ON and run
+ *     bin/speedsql_bench [threads] [ms per measurement]
+ */
+
+#include "speedsql.h"
+#include "speedsql_crypto.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#define BENCH_MAX_RESULTS 64
+
+static const uint32_t BENCH_PAGE_SIZES[] = {4096, 16384, 65536};
+
+/* Results of one run, looked up by cipher */
+static const speedsql_crypto_bench_t* bench_find(const speedsql_crypto_bench_t* results, int count,
+                                                 speedsql_cipher_t cipher) {
+    for (int i = 0; i < count; i++) {
+        if (results[i].cipher == cipher) return &results[i];
+    }
+    return nullptr;
+}
+
+/* Microseconds to seal and open one page */
+static double bench_page_us(const speedsql_crypto_bench_t* r) {
+    return r->page_size / r->seal_mbps + r->page_size / r->open_mbps;
+}
+
+static void bench_page_size(uint32_t page_size, uint32_t threads, uint32_t duration_ms) {
+    speedsql_crypto_bench_t single[BENCH_MAX_RESULTS];
+    speedsql_crypto_bench_t multi[BENCH_MAX_RESULTS];
+    int single_count = BENCH_MAX_RESULTS;
+    int multi_count = BENCH_MAX_RESULTS;
+
+    if (speedsql_crypto_benchmark(page_size, 1, duration_ms, single, &single_count) != SPEEDSQL_OK ||
+        speedsql_crypto_benchmark(page_size, threads, duration_ms, multi, &multi_count) != SPEEDSQL_OK) {
+        printf("benchmark failed at %u-byte pages\n", page_size);
+        return;
+    }
+
+    printf("%u-byte pages, MB/s (1 thread | %u threads)\n", page_size, threads);
+    printf("%-22s %10s %10s %10s %10s %10s %11s\n", "cipher", "seal", "open",
+           "seal", "open", "us/page", "vs AES-GCM");
+
+    const speedsql_crypto_bench_t* baseline = bench_find(single, single_count,
+                                                         SPEEDSQL_CIPHER_AES_256_GCM);
+    for (int i = 0; i < single_count; i++) {
+        const speedsql_crypto_bench_t* s = &single[i];
+        const speedsql_crypto_bench_t* m = bench_find(multi, multi_count, s->cipher);
+        double us = bench_page_us(s);
+
+        printf("%-22s %10.1f %10.1f %10.1f %10.1f %10.2f %10.2fx\n", s->name,
+               s->seal_mbps, s->open_mbps, m ? m->seal_mbps : 0.0, m ? m->open_mbps : 0.0,
+               us, baseline ? us / bench_page_us(baseline) : 0.0);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    uint32_t threads = std::thread::hardware_concurrency();
+    if (threads < 2) threads = 2;
+    uint32_t duration_ms = 200;
+
+    if (argc > 1) threads = (uint32_t)atoi(argv[1]);
+    if (argc > 2) duration_ms = (uint32_t)atoi(argv[2]);
+
+    printf("SpeedSQL benchmarks (%s)\n\n", speedsql_crypto_version());
+
+    for (size_t i = 0; i < sizeof(BENCH_PAGE_SIZES) / sizeof(BENCH_PAGE_SIZES[0]); i++) {
+        bench_page_size(BENCH_PAGE_SIZES[i], threads, duration_ms);
+    }
+
+    speedsql_cipher_t fastest;
+    if (speedsql_crypto_fastest(16384, &fastest) == SPEEDSQL_OK) {
+        printf("Fastest cipher for new databases: %s\n", speedsql_get_cipher(fastest)->name);
+    }
+    return 0;
+}
@@ -199,11 +199,145 @@ SPEEDSQL_API int64_t speedsql_last_insert_rowid(speedsql* db);
 /* Memory management */
 SPEEDSQL_API void speedsql_free(void* ptr);
 
+/* Write an in-memory database to a file (reopen with speedsql_open) */
+SPEEDSQL_API int speedsql_memory_snapshot(speedsql* db, const char* filename);
+
+/* ============================================================================
+ * VFS (Virtual File System) API
+ *
+ * All database and WAL file access goes through a VFS. Built-in backends:
+ *   "unix" / "win32"  Native file I/O (default)
+ *   "io_uring"        Linux io_uring submission (falls back to pread/pwrite)
+ *   "memory"          Process-local files held in RAM
+ * ============================================================================ */
+
+/* Backend file handle (opaque, owned by the VFS) */
+typedef struct speedsql_vfs_file speedsql_vfs_file;
+
+/* VFS open flags */
+typedef enum {
+    SPEEDSQL_VFS_OPEN_READWRITE = 0x00000001,
+    SPEEDSQL_VFS_OPEN_CREATE    = 0x00000002
+} speedsql_vfs_open_flags;
+
+/* File lock levels */
+typedef enum {
+    SPEEDSQL_LOCK_NONE      = 0,
+    SPEEDSQL_LOCK_SHARED    = 1,
+    SPEEDSQL_LOCK_EXCLUSIVE = 2
+} speedsql_lock_level;
+
+/* VFS virtual function table */
+typedef struct speedsql_vfs {
+    const char* name;                  /* Name passed to speedsql_open_v2 */
+    void* app_data;                    /* Backend-private data */
+
+    int (*open)(struct speedsql_vfs* vfs, const char* path, int flags,
+                speedsql_vfs_file** file);
+    int (*close)(speedsql_vfs_file* file);
+    int (*read)(speedsql_vfs_file* file, uint64_t offset, void* buf, size_t len);
+    int (*write)(speedsql_vfs_file* file, uint64_t offset, const void* buf, size_t len);
+    int (*sync)(speedsql_vfs_file* file);
+    int (*truncate)(speedsql_vfs_file* file, uint64_t size);
+    int (*file_size)(speedsql_vfs_file* file, uint64_t* size);
+
+    /* Optional (may be NULL) */
+    int (*lock)(speedsql_vfs_file* file, int level);          /* SPEEDSQL_BUSY if held */
+    int (*mmap)(speedsql_vfs_file* file, uint64_t offset, size_t len, void** addr);
+    int (*munmap)(speedsql_vfs_file* file, void* addr, size_t len);
+    int (*clone)(speedsql_vfs_file* file, const char* dest_path);  /* Reflink copy */
+} speedsql_vfs;
+
+/* Register a VFS (make_default: use it when speedsql_open_v2 gets NULL) */
+SPEEDSQL_API int speedsql_vfs_register(speedsql_vfs* vfs, int make_default);
+
+/* Unregister a custom VFS */
+SPEEDSQL_API int speedsql_vfs_unregister(speedsql_vfs* vfs);
+
+/* Find a VFS by name (NULL returns the default) */
+SPEEDSQL_API speedsql_vfs* speedsql_vfs_find(const char* name);
+
+/* ============================================================================
+ * Backup API
+ *
+ * Online backup: pages are copied in large sequential chunks while other
+ * work continues between steps; pages written during the backup are
+ * recopied by speedsql_backup_finish, so the result is consistent.
+ *
+ * Incremental backup: pass the transaction ID returned by a previous
+ * backup as since_txn and the same destination file. Only pages whose
+ * header txn_id is newer are copied.
+ * ============================================================================ */
+
+typedef struct speedsql_backup speedsql_backup;
+
+/* Start a backup (since_txn = 0 for a full copy) */
+SPEEDSQL_API int speedsql_backup_init(
+    speedsql* db,
+    const char* dest_path,
+    uint64_t since_txn,
+    speedsql_backup** backup
+);
+
+/* Scan up to n_pages pages (n_pages <= 0: all). Returns SPEEDSQL_OK while
+ * pages remain and SPEEDSQL_DONE once the scan is complete */
+SPEEDSQL_API int speedsql_backup_step(speedsql_backup* backup, int n_pages);
+
+/* Pages left to scan / pages written to the destination so far */
+SPEEDSQL_API int64_t speedsql_backup_remaining(speedsql_backup* backup);
+SPEEDSQL_API int64_t speedsql_backup_copied(speedsql_backup* backup);
+
+/* Complete the backup and free the handle. backup_txn (optional) receives
+ * the since_txn to use for the next incremental backup */
+SPEEDSQL_API int speedsql_backup_finish(speedsql_backup* backup, uint64_t* backup_txn);
+
+/* ============================================================================
+ * Snapshot API
+ *
+ * A snapshot is a read-only connection that sees the database as of the
+ * call, while the original connection keeps writing. It is a reflink clone
+ * of the file where the filesystem supports it; elsewhere the writer keeps
+ * the old version of each page it overwrites for as long as the snapshot
+ * is open. Close it with speedsql_close.
+ * ============================================================================ */
+
+/* Open a point-in-time snapshot (not inside a transaction) */
+SPEEDSQL_API int speedsql_snapshot_open(speedsql* db, speedsql** snapshot);
+
+/* ============================================================================
+ * Replication API
+ *
+ * A primary opened with SPEEDSQL_OPEN_WAL logs every page it writes and
+ * ships them at each commit. Segments exported from its log (or the live
+ * "<db>-wal" file itself) are redone by a follower: a read-only connection
+ * on another file that applies committed transactions and serves queries.
+ * ============================================================================ */
+
+/* Export committed records with LSN >= from_lsn to a segment file.
+ * next_lsn (optional) receives the from_lsn for the next export */
+SPEEDSQL_API int speedsql_wal_export(
+    speedsql* db,
+    uint64_t from_lsn,
+    const char* segment_path,
+    uint64_t* next_lsn
+);
+
+/* Open (creating if needed) a read-only follower database */
+SPEEDSQL_API int speedsql_follower_open(const char* filename, speedsql** db);
+
+/* Redo committed transactions from a segment or a primary's WAL file.
+ * Already applied transactions are skipped, so logs can be reapplied */
+SPEEDSQL_API int speedsql_follower_apply(speedsql* db, const char* wal_path);
+
 /* ============================================================================
  * Modern Features API
  * ============================================================================ */
 
-/* JSON path query */
+/* The value at a path such as $.user.tags[0] in JSON text. Strings come
+ * back unquoted, other values as compact JSON, JSON null as a NULL
+ * result; free with speedsql_free. SPEEDSQL_NOTFOUND when the path leads
+ * nowhere, SPEEDSQL_MISMATCH when the text is not JSON and SPEEDSQL_ERROR
+ * when the path is malformed */
 SPEEDSQL_API int speedsql_json_extract(
     speedsql* db,
     const char* json,
@@ -222,7 +356,9 @@ SPEEDSQL_API int speedsql_vector_search(
     speedsql_stmt** result
 );
 
-/* Full-text search */
+/* Full-text search: the rows of table matching query in any column with
+ * a full-text index, as "rowid" and BM25 "score" columns, best first. A
+ * row matched through several indexes takes its best score. */
 SPEEDSQL_API int speedsql_fts_search(
     speedsql* db,
     const char* table,
@@ -230,6 +366,46 @@ SPEEDSQL_API int speedsql_fts_search(
     speedsql_stmt** result
 );
 
+/* The top_k best of speedsql_fts_search; blocks of postings that cannot
+ * reach the top_k are skipped unread */
+SPEEDSQL_API int speedsql_fts_search_topk(
+    speedsql* db,
+    const char* table,
+    const char* query,
+    int top_k,
+    speedsql_stmt** result
+);
+
+/* ============================================================================
+ * Full-Text Tokenizer API
+ *
+ * A full-text index splits text into tokens with the tokenizer named at
+ * CREATE INDEX ... USING FTS (column) WITH (tokenizer = name); queries are
+ * tokenized the same way. Built in: "simple", which lowercases ASCII
+ * letters and digits and keeps every byte >= 0x80, splitting on the rest.
+ * ============================================================================ */
+
+/* Called once per token, in text order; a result other than SPEEDSQL_OK
+ * stops tokenizing and is returned */
+typedef int (*speedsql_token_fn)(void* ctx, const char* token, int len, int position);
+
+typedef struct speedsql_tokenizer {
+    const char* name;                  /* Name used in WITH (tokenizer = ...) */
+    void* app_data;                    /* Tokenizer-private data */
+
+    int (*tokenize)(struct speedsql_tokenizer* tok, const char* text, int len,
+                    speedsql_token_fn emit, void* ctx);
+} speedsql_tokenizer;
+
+/* Register a tokenizer; it must stay registered while indexes use it */
+SPEEDSQL_API int speedsql_tokenizer_register(speedsql_tokenizer* tok);
+
+/* Unregister a custom tokenizer */
+SPEEDSQL_API int speedsql_tokenizer_unregister(speedsql_tokenizer* tok);
+
+/* Find a tokenizer by name (NULL returns "simple") */
+SPEEDSQL_API speedsql_tokenizer* speedsql_tokenizer_find(const char* name);
+
 #ifdef __cplusplus
 }
 #endif
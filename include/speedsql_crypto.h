@@ -59,16 +59,23 @@ typedef enum {
 #define SPEEDSQL_TAG_SIZE_128    16     /* Authentication tag */
 #define SPEEDSQL_SALT_SIZE       32     /* KDF salt */
 
+/* Argon2id parameters used where a configuration leaves them 0 */
+#define SPEEDSQL_ARGON2_PASSES      2
+#define SPEEDSQL_ARGON2_MEMORY      19456  /* KB */
+#define SPEEDSQL_ARGON2_PARALLELISM 1
+
 /* Encryption configuration structure */
 typedef struct {
     speedsql_cipher_t cipher;           /* Encryption algorithm */
     speedsql_kdf_t kdf;                 /* Key derivation function */
-    uint32_t kdf_iterations;           /* KDF iteration count (PBKDF2) */
+    uint32_t kdf_iterations;           /* KDF iteration count (PBKDF2), passes (Argon2) */
     uint32_t kdf_memory;               /* KDF memory cost (Argon2) in KB */
-    uint32_t kdf_parallelism;          /* KDF parallelism (Argon2) */
+    uint32_t kdf_parallelism;          /* KDF parallelism (Argon2): lanes, one thread each */
     uint8_t salt[SPEEDSQL_SALT_SIZE];   /* KDF salt */
     bool encrypt_page_header;          /* Encrypt page headers too */
     bool use_per_page_iv;              /* Unique IV per page */
+    bool aligned_pages;                /* New databases: keep nonce and tag in the
+                                          page tail so pages stay page_size on disk */
 } speedsql_crypto_config_t;
 
 /* ============================================================================
@@ -159,7 +166,9 @@ SPEEDSQL_API int speedsql_rekey(
     int key_len
 );
 
-/* Change encryption algorithm (requires full database rewrite) */
+/* Change key and algorithm. Existing pages are resealed in the background
+ * while the database stays open; the new cipher must fit the same on-disk
+ * page (same tag size, or within the reserved tail of aligned pages). */
 SPEEDSQL_API int speedsql_rekey_v2(
     speedsql* db,
     const void* new_key,
@@ -167,6 +176,25 @@ SPEEDSQL_API int speedsql_rekey_v2(
     const speedsql_crypto_config_t* new_config
 );
 
+/* Rekey progress in pages. Returns SPEEDSQL_BUSY while pages are still
+ * being resealed, otherwise the result of the last rekey. */
+SPEEDSQL_API int speedsql_rekey_status(
+    speedsql* db,
+    uint64_t* resealed,
+    uint64_t* total
+);
+
+/* Wait for a background rekey to finish and return its result */
+SPEEDSQL_API int speedsql_rekey_wait(speedsql* db);
+
+/* Rate limit for background resealing: pages per batch (1-64) and the
+ * pause between batches */
+SPEEDSQL_API int speedsql_rekey_throttle(
+    speedsql* db,
+    uint32_t batch_pages,
+    uint32_t pause_ms
+);
+
 /* Remove encryption */
 SPEEDSQL_API int speedsql_decrypt(speedsql* db);
 
@@ -216,6 +244,26 @@ SPEEDSQL_API int speedsql_derive_key(
     size_t key_len
 );
 
+/* Derive key with all of a configuration's KDF parameters (kdf, iterations,
+ * Argon2 memory and parallelism, salt) */
+SPEEDSQL_API int speedsql_derive_key_v2(
+    const char* password,
+    size_t password_len,
+    const speedsql_crypto_config_t* config,
+    uint8_t* key_out,
+    size_t key_len
+);
+
+/* Keep up to max_entries derived keys in process memory so reopening with
+ * the same password, salt and parameters skips the KDF. Entries are found
+ * by a keyed hash of those inputs; the password itself is not stored.
+ * 0 disables the cache and wipes it. */
+SPEEDSQL_API int speedsql_kdf_cache(uint32_t max_entries);
+
+/* Derivations answered from the cache, and ones that ran the KDF, since
+ * the cache was last enabled */
+SPEEDSQL_API int speedsql_kdf_cache_stats(uint64_t* hits, uint64_t* misses);
+
 /* Generate random salt */
 SPEEDSQL_API int speedsql_random_salt(
     uint8_t* salt,
@@ -248,6 +296,35 @@ SPEEDSQL_API void speedsql_secure_zero(void* ptr, size_t size);
 /* Run cipher self-tests (required for CC) */
 SPEEDSQL_API int speedsql_crypto_self_test(void);
 
+/* Throughput of one provider at one page size */
+typedef struct {
+    speedsql_cipher_t cipher;
+    const char* name;                  /* Provider name */
+    uint32_t page_size;
+    uint32_t threads;                  /* Threads sharing one context */
+    double seal_mbps;                  /* Encryption, MB/s over all threads */
+    double open_mbps;                  /* Decryption, MB/s over all threads */
+} speedsql_crypto_bench_t;
+
+/* Measure every registered provider, custom ones included, sealing and
+ * opening page_size-byte pages on `threads` threads (0: one per core) for
+ * duration_ms per direction (0: 100ms). *count is the capacity of results
+ * on entry and the number filled on return; providers that fail their own
+ * round trip are left out. */
+SPEEDSQL_API int speedsql_crypto_benchmark(
+    uint32_t page_size,
+    uint32_t threads,
+    uint32_t duration_ms,
+    speedsql_crypto_bench_t* results,
+    int* count
+);
+
+/* Fastest cipher on this machine for new databases: an AEAD that can seal
+ * pages and the WAL, passes its self-test, and is FIPS approved when FIPS
+ * mode is on. The cipher is not recorded in the file; keep the choice with
+ * the rest of the key configuration. */
+SPEEDSQL_API int speedsql_crypto_fastest(uint32_t page_size, speedsql_cipher_t* cipher);
+
 /* Get crypto module version info */
 SPEEDSQL_API const char* speedsql_crypto_version(void);
 
@@ -19,6 +19,9 @@
     typedef CRITICAL_SECTION mutex_t;
     typedef CONDITION_VARIABLE cond_t;
     typedef SRWLOCK rwlock_t;
+    typedef HANDLE thread_t;
+    typedef INIT_ONCE once_t;
+    #define ONCE_INIT INIT_ONCE_STATIC_INIT
     #define INVALID_FILE_HANDLE INVALID_HANDLE_VALUE
 #else
     #include <pthread.h>
@@ -28,6 +31,9 @@
     typedef pthread_mutex_t mutex_t;
     typedef pthread_cond_t cond_t;
     typedef pthread_rwlock_t rwlock_t;
+    typedef pthread_t thread_t;
+    typedef pthread_once_t once_t;
+    #define ONCE_INIT PTHREAD_ONCE_INIT
     #define INVALID_FILE_HANDLE (-1)
 #endif
 
@@ -56,25 +62,66 @@ void rwlock_rdlock(rwlock_t* rw);
 void rwlock_wrlock(rwlock_t* rw);
 void rwlock_unlock(rwlock_t* rw);
 
+void cond_init(cond_t* c);
+void cond_destroy(cond_t* c);
+void cond_wait(cond_t* c, mutex_t* m);
+void cond_signal(cond_t* c);
+void cond_broadcast(cond_t* c);
+
+/* Runs fn exactly once per once_t (initialized with ONCE_INIT), however
+ * many threads get here first */
+void once_run(once_t* once, void (*fn)(void));
+
+int thread_create(thread_t* t, void* (*fn)(void*), void* arg);
+void thread_join(thread_t t);
+void thread_sleep_ms(uint32_t ms);
+
 /* ============================================================================
  * File I/O
  * ============================================================================ */
 
+/* io_uring backend is available when the kernel headers are */
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define SPEEDSQL_HAVE_IO_URING 1
+    #endif
+#endif
+
+/* Built-in VFS backends */
+extern speedsql_vfs g_vfs_native;
+extern speedsql_vfs g_vfs_memory;
+#ifdef SPEEDSQL_HAVE_IO_URING
+extern speedsql_vfs g_vfs_io_uring;
+#endif
+
 typedef struct {
-    file_handle_t handle;
+    speedsql_vfs* vfs;           /* Owning VFS (NULL: detached, e.g. :memory:) */
+    speedsql_vfs_file* handle;   /* Backend file handle */
     char* path;
-    uint64_t size;
     bool readonly;
-    rwlock_t lock;
+
+    /* Called before bytes [offset, offset + len) are overwritten or truncated */
+    int (*before_write)(void* arg, uint64_t offset, uint64_t len);
+    void* before_write_arg;
 } file_t;
 
 int file_open(file_t* f, const char* path, int flags);
+int file_open_vfs(file_t* f, speedsql_vfs* vfs, const char* path, int flags);
 int file_close(file_t* f);
 int file_read(file_t* f, uint64_t offset, void* buf, size_t len);
 int file_write(file_t* f, uint64_t offset, const void* buf, size_t len);
 int file_sync(file_t* f);
 int file_truncate(file_t* f, uint64_t size);
 int file_size(file_t* f, uint64_t* size);
+int file_lock(file_t* f, int level);
+int file_mmap(file_t* f, uint64_t offset, size_t len, void** addr);
+int file_munmap(file_t* f, void* addr, size_t len);
+int file_clone(file_t* f, const char* dest_path);
+
+#ifndef _WIN32
+/* Reflink src_fd to a new file (FICLONE / fclonefileat); SPEEDSQL_NOTFOUND if unsupported */
+int file_reflink_fd(int src_fd, const char* dest_path);
+#endif
 
 /* ============================================================================
  * Buffer Pool / Page Cache
@@ -91,6 +138,33 @@ typedef struct buffer_page {
     struct buffer_page* lru_next;  /* LRU list */
 } buffer_page_t;
 
+/* In-memory page store (backs :memory: databases) */
+typedef struct mem_store {
+    buffer_page_t*** dir;        /* Two-level page table indexed by page ID */
+    page_id_t next_page;         /* Next page ID to allocate */
+    size_t page_count;           /* Pages allocated */
+    uint32_t page_size;          /* Page size */
+    mutex_t lock;                /* Serializes allocation */
+
+    /* Transaction undo: the image each page had when the transaction
+     * began, saved the first time a writing statement touches it */
+    bool undo_active;            /* A transaction is open */
+    bool undo_armed;             /* A writing statement is running */
+    bool undo_lost;              /* An image could not be saved */
+    page_id_t undo_pages;        /* Pages that existed at begin */
+    uint8_t** undo_images;       /* Saved images by page ID, on first save */
+} mem_store_t;
+
+int mem_store_init(mem_store_t* store, uint32_t page_size);
+void mem_store_destroy(mem_store_t* store);
+buffer_page_t* mem_store_get(mem_store_t* store, page_id_t page_id);
+buffer_page_t* mem_store_new_page(mem_store_t* store, page_id_t* page_id);
+int mem_store_snapshot(mem_store_t* store, file_t* file);
+int mem_store_undo_begin(mem_store_t* store);
+void mem_store_undo_save(mem_store_t* store, buffer_page_t* page);
+int mem_store_undo_restore(mem_store_t* store);
+void mem_store_undo_end(mem_store_t* store);
+
 typedef struct {
     buffer_page_t** hash_table;  /* Hash table for page lookup */
     size_t hash_size;            /* Hash table size */
@@ -102,22 +176,73 @@ typedef struct {
     uint64_t page_size;          /* Page size */
     uint64_t hits;               /* Cache hits */
     uint64_t misses;             /* Cache misses */
-    mutex_t lock;                /* Pool lock */
+    mutex_t lock;                /* Pool lock (metadata only; no I/O or crypto) */
+    cond_t io_cond;              /* Signalled when a BUF_IO page settles */
+    size_t io_writes;            /* Evictions writing back outside the lock */
+    mutex_t flush_lock;          /* Serializes flushes */
 
     /* Encryption support */
     struct speedsql_cipher_ctx* cipher_ctx; /* Cipher context (if encrypted) */
     speedsql_cipher_t cipher_id;            /* Current cipher algorithm */
-    uint8_t* crypt_buffer;                  /* Temporary buffer for encrypt/decrypt */
+    struct crypt_workers* workers;          /* Threads encrypting flush batches */
+
+    /* Aligned layout: the last page_reserve bytes of each page hold the
+     * nonce and tag, so only usable_size bytes carry data */
+    uint32_t page_reserve;
+    uint64_t usable_size;
+    uint8_t nonce_base[16];                 /* Random per key; per-write nonces count up */
+    uint64_t nonce_seq;
+    mutex_t nonce_lock;
+
+    /* Online rekey: pages not marked in rekey_bits may still be sealed
+     * with the previous key, so reads fall back to it */
+    struct speedsql_cipher_ctx* old_cipher_ctx;
+    speedsql_cipher_t old_cipher_id;
+    uint8_t* rekey_bits;                    /* Pages known to be under the current key */
+    page_id_t rekey_pages;                  /* Pages in the file when the rekey began */
+    mutex_t rekey_lock;                     /* Guards rekey_bits */
+    rwlock_t rekey_rw;                      /* Held shared while a read may use the old key */
+
+    /* In-memory mode: pages resolve directly through the store */
+    mem_store_t* mem;
+
+    /* Change tracking */
+    uint64_t stamp_txn;                     /* Stamped into page headers on write-back */
+    uint8_t* track_bits;                    /* Bitmap of pages written while tracking */
+    size_t track_bytes;                     /* Bitmap size */
+    bool tracking;                          /* Change tracking active */
+    bool track_lost;                        /* Bitmap could not grow; changes missed */
+
+    /* Called with each on-disk page image just before it is written */
+    int (*on_write_back)(void* arg, page_id_t page_id, const uint8_t* data, size_t size);
+    void* on_write_back_arg;
 } buffer_pool_t;
 
 int buffer_pool_init(buffer_pool_t* pool, size_t cache_size, uint32_t page_size);
+int buffer_pool_init_memory(buffer_pool_t* pool, uint32_t page_size);
 void buffer_pool_destroy(buffer_pool_t* pool);
 buffer_page_t* buffer_pool_get(buffer_pool_t* pool, file_t* file, page_id_t page_id);
 void buffer_pool_unpin(buffer_pool_t* pool, buffer_page_t* page, bool dirty);
 int buffer_pool_flush(buffer_pool_t* pool, file_t* file);
 buffer_page_t* buffer_pool_new_page(buffer_pool_t* pool, file_t* file, page_id_t* page_id);
 int buffer_pool_invalidate_dirty(buffer_pool_t* pool, file_t* file);
+int buffer_pool_discard(buffer_pool_t* pool);
+int buffer_pool_txn_begin(buffer_pool_t* pool);
+void buffer_pool_txn_arm(buffer_pool_t* pool, bool writing);
+void buffer_pool_txn_end(buffer_pool_t* pool);
 int buffer_pool_set_encryption(buffer_pool_t* pool, struct speedsql_cipher_ctx* ctx, speedsql_cipher_t cipher_id);
+int buffer_pool_set_crypt_threads(buffer_pool_t* pool, int threads);
+int buffer_pool_set_page_reserve(buffer_pool_t* pool, uint32_t reserve);
+uint32_t buffer_pool_reserve_for(speedsql_cipher_t cipher_id);
+uint64_t buffer_pool_disk_page_size(buffer_pool_t* pool);
+int buffer_pool_rekey_begin(buffer_pool_t* pool, file_t* file, struct speedsql_cipher_ctx* ctx,
+                            speedsql_cipher_t cipher_id, page_id_t first_page, page_id_t* page_count);
+int buffer_pool_rekey_pages(buffer_pool_t* pool, file_t* file, page_id_t first, size_t count,
+                            uint64_t* resealed);
+uint64_t buffer_pool_rekey_pending(buffer_pool_t* pool);
+struct speedsql_cipher_ctx* buffer_pool_rekey_end(buffer_pool_t* pool, speedsql_cipher_t* old_id);
+int buffer_pool_track_begin(buffer_pool_t* pool);
+int buffer_pool_track_end(buffer_pool_t* pool, uint8_t** bits, size_t* bytes);
 
 /* ============================================================================
  * B+Tree Index
@@ -148,6 +273,11 @@ int btree_insert(btree_t* tree, const value_t* key, const value_t* value);
 int btree_delete(btree_t* tree, const value_t* key);
 int btree_find(btree_t* tree, const value_t* key, value_t* value);
 
+/* Keys are compared as stored bytes, so integer keys (rowids) go in as 8
+ * big-endian bytes with the sign bit flipped, which sort like the integers */
+void btree_int_key(value_t* key, int64_t v);
+int64_t btree_key_int(const value_t* key);
+
 /* Cursor operations */
 int btree_cursor_init(btree_cursor_t* cursor, btree_t* tree);
 int btree_cursor_first(btree_cursor_t* cursor);
@@ -159,6 +289,170 @@ int btree_cursor_key(btree_cursor_t* cursor, value_t* key);
 int btree_cursor_value(btree_cursor_t* cursor, value_t* value);
 void btree_cursor_close(btree_cursor_t* cursor);
 
+/* ============================================================================
+ * Vector Distance
+ * ============================================================================ */
+
+typedef enum {
+    VECTOR_L2 = 0,               /* Euclidean distance */
+    VECTOR_DOT = 1,              /* Inner product */
+    VECTOR_COSINE = 2            /* 1 - cosine similarity */
+} vector_metric_t;
+
+/* Pairwise kernels over n floats, dispatched on cpu_features() */
+float vector_l2_sq(const float* a, const float* b, uint32_t n);
+float vector_dot(const float* a, const float* b, uint32_t n);
+float vector_cosine_distance(const float* a, const float* b, uint32_t n);
+float vector_distance(vector_metric_t metric, const float* a, const float* b, uint32_t n);
+
+/* One query against count vectors of n floats stored back to back;
+ * out[i] is what vector_distance would return for row i */
+void vector_distances(vector_metric_t metric, const float* query, const float* base,
+                      uint32_t n, size_t count, float* out);
+
+/* ============================================================================
+ * Vector Quantization
+ * ============================================================================ */
+
+/* Lloyd's k-means over count vectors of n floats, stride floats apart,
+ * into k centroids stored back to back. Returns the centroids trained:
+ * k, or count when there are fewer samples; 0 when out of memory */
+uint32_t vector_kmeans(const float* samples, size_t count, size_t stride, uint32_t n,
+                       uint32_t k, uint32_t iterations, float* centroids);
+
+/* int8 scalar quantization: each vector keeps its own offset and step,
+ * then one byte per dimension */
+#define VECTOR_SQ8_HEADER 8
+#define vector_sq8_size(n) ((size_t)VECTOR_SQ8_HEADER + (n))
+
+void vector_sq8_encode(const float* v, uint32_t n, uint8_t* code);
+void vector_sq8_decode(const uint8_t* code, uint32_t n, float* out);
+
+/* Squared L2 from a float query to an encoded vector, without decoding */
+float vector_sq8_l2_sq(const float* q, const uint8_t* code, uint32_t n);
+
+/* Product quantization: dimensions split into m subspaces of
+ * dimensions / m floats, each coded as one of up to 256 centroids */
+#define VECTOR_PQ_CENTROIDS 256
+
+typedef struct {
+    uint32_t dimensions;
+    uint32_t m;
+    uint32_t centroids;          /* Trained per subspace, at most 256 */
+    float* codebook;             /* m * 256 centroids of dimensions / m floats */
+} vector_pq_t;
+
+/* k-means over count samples of n floats; m must divide n */
+int vector_pq_train(vector_pq_t* pq, const float* samples, size_t count, uint32_t n, uint32_t m);
+void vector_pq_free(vector_pq_t* pq);
+
+void vector_pq_encode(const vector_pq_t* pq, const float* v, uint8_t* code);
+void vector_pq_decode(const vector_pq_t* pq, const uint8_t* code, float* out);
+
+/* Asymmetric distance: a per-query table of m * 256 squared distances,
+ * then m lookups per encoded vector */
+void vector_pq_table(const vector_pq_t* pq, const float* q, float* table);
+float vector_pq_l2_sq(const float* table, const uint8_t* code, uint32_t m);
+void vector_pq_scan(const float* table, const uint8_t* codes, uint32_t m,
+                    size_t count, float* out);
+
+/* ============================================================================
+ * HNSW Vector Index
+ * ============================================================================ */
+
+typedef struct hnsw hnsw_t;
+
+/* Allocate an empty graph; 0 for m or an ef takes the default. The
+ * dimension count is fixed by the first vector inserted */
+int hnsw_create(buffer_pool_t* pool, file_t* file, uint32_t m, uint32_t ef_construction,
+                uint32_t ef_search, page_id_t* meta_page);
+int hnsw_open(hnsw_t** out, buffer_pool_t* pool, file_t* file, page_id_t meta_page);
+void hnsw_close(hnsw_t* h);
+
+/* Store vectors with an IDX_QUANT_* codec; only before the first insert.
+ * PQ trains its codebook on count sample vectors. rerank 0 takes the
+ * default */
+int hnsw_quantize(hnsw_t* h, uint32_t codec, uint32_t pq_m, uint32_t rerank,
+                  const float* samples, size_t count, uint32_t dimensions);
+
+/* Candidates per wanted result to re-rank exactly; 0 when the index
+ * stores full vectors and its distances are exact */
+uint32_t hnsw_rerank(hnsw_t* h);
+
+/* Index (or re-index) a row's vector */
+int hnsw_insert(hnsw_t* h, int64_t rowid, const float* vec, uint32_t dimensions);
+int hnsw_delete(hnsw_t* h, int64_t rowid);
+
+/* Up to k nearest rows by L2 distance, nearest first (ef 0: index default).
+ * Distances are estimates when the index is quantized */
+int hnsw_search(hnsw_t* h, const float* query, uint32_t dimensions, uint32_t k, uint32_t ef,
+                int64_t* rowids, float* distances, uint32_t* found);
+uint64_t hnsw_count(hnsw_t* h);
+
+/* ============================================================================
+ * IVF Vector Index
+ * ============================================================================ */
+
+typedef struct ivf ivf_t;
+
+/* Allocate an untrained index; 0 for nlist or nprobe takes the default */
+int ivf_create(buffer_pool_t* pool, file_t* file, uint32_t nlist, uint32_t nprobe,
+               page_id_t* meta_page);
+int ivf_open(ivf_t** out, buffer_pool_t* pool, file_t* file, page_id_t meta_page);
+void ivf_close(ivf_t* h);
+
+/* Train the list centroids on count sample vectors; once, before the
+ * first insert. An nlist of 0 takes the square root of count */
+int ivf_train(ivf_t* h, const float* samples, size_t count, uint32_t dimensions);
+
+/* Index (or re-index) a row's vector */
+int ivf_insert(ivf_t* h, int64_t rowid, const float* vec, uint32_t dimensions);
+int ivf_delete(ivf_t* h, int64_t rowid);
+
+/* Up to k nearest rows by L2 distance among the nprobe nearest lists,
+ * nearest first (nprobe 0: index default). Large probes run on several
+ * threads */
+int ivf_search(ivf_t* h, const float* query, uint32_t dimensions, uint32_t k, uint32_t nprobe,
+               int64_t* rowids, float* distances, uint32_t* found);
+uint64_t ivf_count(ivf_t* h);
+
+/* ============================================================================
+ * Full-Text Index
+ * ============================================================================ */
+
+typedef struct fts fts_t;
+
+/* Allocate an empty index over text tokenized by the named tokenizer
+ * (NULL: "simple") */
+int fts_create(buffer_pool_t* pool, file_t* file, const char* tokenizer, page_id_t* meta_page);
+int fts_open(fts_t** out, buffer_pool_t* pool, file_t* file, page_id_t meta_page);
+
+/* Waits for a background merge to finish */
+void fts_close(fts_t* h);
+speedsql_tokenizer* fts_tokenizer(fts_t* h);
+
+/* Index (or re-index) a row's text */
+int fts_insert(fts_t* h, int64_t rowid, const char* text, size_t len);
+int fts_delete(fts_t* h, int64_t rowid);
+
+/* Rows matching a query of terms, implicit or explicit AND, OR,
+ * "quoted phrases" and parentheses; ascending, freed with sdb_free */
+int fts_search(fts_t* h, const char* query, int64_t** rowids, size_t* count);
+
+/* The k best matches by BM25 (k 0: every match), best first; rowids and
+ * scores freed with sdb_free */
+int fts_rank(fts_t* h, const char* query, size_t k, int64_t** rowids, float** scores,
+             size_t* count);
+
+/* Merge every segment and the pending log into one segment */
+int fts_optimize(fts_t* h);
+uint64_t fts_count(fts_t* h);
+uint32_t fts_segment_count(fts_t* h);
+
+/* The same query against one text, without an index */
+int fts_match_text(speedsql_tokenizer* tok, const char* text, size_t len,
+                   const char* query, bool* match);
+
 /* ============================================================================
  * Write-Ahead Log (WAL)
  * ============================================================================ */
@@ -171,18 +465,35 @@ typedef struct {
     size_t buffer_size;
     size_t buffer_pos;
     mutex_t lock;
+    struct speedsql_cipher_ctx* cipher_ctx;  /* Seals flushes; owned by the connection */
+    speedsql_cipher_t cipher_id; /* Cipher the log is sealed with */
+    uint8_t* sealed;             /* Frame being sealed */
+    uint8_t nonce_base[16];      /* Random per open; the frame counter varies it */
+    uint64_t frame_seq;
+    uint64_t base_lsn;           /* Last commit a checkpoint dropped from the log */
+    uint64_t checkpoint_size;    /* Log size that triggers a checkpoint (0: never) */
+    uint64_t export_lsn;         /* next_lsn of the last export */
+    uint64_t export_pos;         /* and the log offset it stopped reading at */
 } wal_t;
 
-int wal_init(wal_t* wal, const char* path);
+int wal_init(wal_t* wal, speedsql_vfs* vfs, const char* path);
 void wal_close(wal_t* wal);
 int wal_write(wal_t* wal, txn_id_t txn, page_id_t page, const void* before, const void* after, size_t size);
 int wal_commit(wal_t* wal, txn_id_t txn);
 int wal_rollback(wal_t* wal, txn_id_t txn);
 int wal_checkpoint(wal_t* wal, buffer_pool_t* pool, file_t* db_file);
+bool wal_checkpoint_due(wal_t* wal);
 int wal_recover(wal_t* wal, buffer_pool_t* pool, file_t* db_file);
 int wal_savepoint(wal_t* wal, txn_id_t txn, uint64_t* lsn_out);
 int wal_release_savepoint(wal_t* wal, txn_id_t txn);
 int wal_rollback_to_savepoint(wal_t* wal, txn_id_t txn, uint64_t savepoint_lsn);
+int wal_log_page(wal_t* wal, txn_id_t txn, page_id_t page, const void* data, size_t size);
+int wal_export(wal_t* wal, uint64_t from_lsn, file_t* out, uint64_t* next_lsn);
+int wal_redo(file_t* log, file_t* db_file, struct speedsql_cipher_ctx* ctx,
+             speedsql_cipher_t cipher_id, uint64_t* pos, uint64_t* applied_lsn);
+bool wal_can_seal(speedsql_cipher_t cipher_id);
+int wal_set_cipher(wal_t* wal, struct speedsql_cipher_ctx* ctx, speedsql_cipher_t cipher_id,
+                   bool new_key);
 
 /* ============================================================================
  * Database Connection Structure
@@ -193,6 +504,7 @@ struct speedsql_cipher_ctx;
 
 struct speedsql {
     file_t db_file;              /* Main database file */
+    speedsql_vfs* vfs;           /* VFS for the database and WAL files */
     wal_t* wal;                  /* Write-ahead log */
     buffer_pool_t* buffer_pool;  /* Page cache */
 
@@ -208,6 +520,15 @@ struct speedsql {
     txn_id_t current_txn;
     txn_state_t txn_state;
 
+    /* Tree roots at BEGIN: a split during the transaction moves a root
+     * onto a page that rollback takes back */
+    struct txn_root {
+        char* name;                  /* Table or index name */
+        bool index;                  /* Names an index */
+        page_id_t root;              /* Root page at BEGIN */
+    }* txn_roots;
+    size_t txn_root_count;
+
     /* Savepoint stack */
     struct savepoint_entry {
         char name[64];               /* Savepoint name */
@@ -229,6 +550,16 @@ struct speedsql {
     struct speedsql_cipher_ctx* cipher_ctx;  /* Cipher context */
     speedsql_cipher_t cipher_id;             /* Current cipher */
     bool encrypted;                          /* Is database encrypted */
+    struct rekey_job* rekey;                 /* Background re-encryption (created on first use) */
+
+    /* Snapshots */
+    struct db_snapshot* snapshots;           /* Live page-retention snapshots of this db */
+    struct db_snapshot* snapshot;            /* Set on snapshot connections */
+
+    /* Replication (follower connections) */
+    char* follower_source;                   /* Log last applied from */
+    uint64_t follower_pos;                   /* Resume offset in that log */
+    uint64_t follower_lsn;                   /* Last applied commit LSN */
 
     /* Statistics */
     uint64_t total_changes;
@@ -237,6 +568,12 @@ struct speedsql {
     /* Thread safety */
     mutex_t lock;
     rwlock_t schema_lock;
+
+    /* File lock shared by this connection's statements and commits */
+    mutex_t file_lock_mutex;
+    uint32_t busy_timeout_ms;    /* Wait for other connections' locks */
+    int shared_locks;            /* Readers holding SHARED */
+    int exclusive_locks;         /* Writers holding EXCLUSIVE */
 };
 
 /* ============================================================================
@@ -361,6 +698,7 @@ typedef struct {
     char** insert_columns;
     int insert_column_count;
     value_t** insert_values;
+    int** insert_params;         /* Per row, parameter number of each value (0: literal) */
     int insert_row_count;
 
     /* UPDATE */
@@ -454,6 +792,11 @@ struct speedsql_stmt {
     bool executed;
     bool has_row;
     int step_count;
+    int file_lock;               /* SPEEDSQL_LOCK_* held until the statement completes */
+
+    /* JSON columns rendered as text for the current row, on demand */
+    char** json_text;
+    int json_text_count;
 };
 
 /* ============================================================================
@@ -524,6 +867,7 @@ typedef enum {
     TOK_IN,
     TOK_BETWEEN,
     TOK_LIKE,
+    TOK_MATCH,
     TOK_IS,
     TOK_INTEGER,
     TOK_FLOAT,
@@ -561,10 +905,13 @@ typedef struct {
     speedsql* db;
     char error[256];
     bool had_error;
+    int param_count;             /* '?' seen so far; parameters number from 1 */
 } parser_t;
 
 void parser_init(parser_t* parser, speedsql* db, const char* sql);
 parsed_stmt_t* parser_parse(parser_t* parser);
+expr_t* parser_parse_expr(parser_t* parser);
+void expr_free(expr_t* expr);
 void parsed_stmt_free(parsed_stmt_t* stmt);
 
 /* ============================================================================
@@ -587,11 +934,160 @@ void value_init_int(value_t* v, int64_t i);
 void value_init_float(value_t* v, double f);
 void value_init_text(value_t* v, const char* s, int len);
 void value_init_blob(value_t* v, const void* data, int len);
+void value_init_vector(value_t* v, const float* data, uint32_t dimensions);
+
+/* A binary JSON document (see jsonb_from_text), copied */
+void value_init_json(value_t* v, const void* data, int len);
 void value_copy(value_t* dst, const value_t* src);
 void value_free(value_t* v);
 int value_compare(const value_t* a, const value_t* b);
 uint64_t value_hash(const value_t* v);
 
+/* ============================================================================
+ * Binary JSON
+ * ============================================================================ */
+
+#define JSONB_NULL      0
+#define JSONB_FALSE     1
+#define JSONB_TRUE      2
+#define JSONB_INT       3
+#define JSONB_FLOAT     4
+#define JSONB_STRING    5
+#define JSONB_ARRAY     6
+#define JSONB_OBJECT    7
+
+/* One value inside a document, and the end of the bytes it may use */
+typedef struct {
+    const uint8_t* p;
+    const uint8_t* end;
+} jsonb_t;
+
+/* Parse JSON text into a document freed with sdb_free; SPEEDSQL_MISMATCH
+ * when the text is not JSON. A SIMD pass indexes the structural bytes and
+ * a second pass over the index builds the document */
+int jsonb_from_text(const char* text, size_t len, uint8_t** out, uint32_t* out_len);
+
+/* Compact text, keys in sorted order; freed with sdb_free */
+int jsonb_to_text(const jsonb_t* v, char** out, size_t* out_len);
+
+bool jsonb_root(const uint8_t* doc, uint32_t len, jsonb_t* out);
+
+/* A JSONB_* tag, or -1 when the value is damaged */
+int jsonb_type(const jsonb_t* v);
+uint32_t jsonb_count(const jsonb_t* v);
+
+/* Element i in O(1), a key by binary search */
+bool jsonb_array_get(const jsonb_t* v, uint32_t i, jsonb_t* out);
+bool jsonb_object_get(const jsonb_t* v, const char* key, uint32_t len, jsonb_t* out);
+bool jsonb_object_entry(const jsonb_t* v, uint32_t i, const char** key, uint32_t* key_len,
+                        jsonb_t* value);
+
+int64_t jsonb_int(const jsonb_t* v);
+double jsonb_float(const jsonb_t* v);
+const char* jsonb_string(const jsonb_t* v, uint32_t* len);
+
+/* Follow a path such as $.user.tags[0]; SPEEDSQL_NOTFOUND when nothing is
+ * there, SPEEDSQL_ERROR when the path is malformed */
+int jsonb_path(const jsonb_t* root, const char* path, jsonb_t* out);
+
+/* As a SQL value: strings as TEXT, true and false as 1 and 0, arrays and
+ * objects as JSON documents of their own */
+int jsonb_to_value(const jsonb_t* v, value_t* out);
+
+/* The value at a path in JSON text, as a document, without parsing what
+ * is off the path; SPEEDSQL_MISMATCH when the text is not JSON */
+int json_extract_text(const char* text, size_t len, const char* path,
+                      uint8_t** out, uint32_t* out_len);
+
+/* ============================================================================
+ * GCM (shared by the AES and ARIA providers)
+ * ============================================================================ */
+
+/* Shoup 4-bit multiples of H, built once per key */
+typedef struct gcm_ghash_table {
+    uint64_t hl[16];
+    uint64_t hh[16];
+} gcm_ghash_table_t;
+
+void gcm_ghash_table_init(gcm_ghash_table_t* t, const uint8_t* h);
+
+/* y = GHASH(y, data), the final partial block zero-padded */
+void gcm_ghash_update(const gcm_ghash_table_t* t, uint8_t* y, const uint8_t* data, size_t len);
+
+/* len(A) || len(C) in bits, big-endian */
+void gcm_length_block(size_t aad_len, size_t ct_len, uint8_t* block);
+
+/* s = GHASH(A, C) including the length block */
+void gcm_ghash(const gcm_ghash_table_t* t, const uint8_t* aad, size_t aad_len,
+               const uint8_t* ct, size_t ct_len, uint8_t* s);
+
+/* ============================================================================
+ * SHA-256, SHA-512 and Key Derivation
+ * ============================================================================ */
+
+#define SHA256_DIGEST_SIZE 32
+
+typedef struct sha256_ctx {
+    uint32_t state[8];
+    uint64_t bytes;              /* Total input length */
+    uint8_t buf[64];
+    size_t buf_len;
+} sha256_ctx_t;
+
+void sha256_init(sha256_ctx_t* ctx);
+void sha256_update(sha256_ctx_t* ctx, const void* data, size_t len);
+
+/* Writes 32 bytes and wipes ctx */
+void sha256_final(sha256_ctx_t* ctx, uint8_t* digest);
+void sha256(const void* data, size_t len, uint8_t* digest);
+
+void hmac_sha256(const uint8_t* key, size_t key_len, const void* data, size_t len,
+                 uint8_t* mac);
+
+/* PBKDF2 (RFC 8018) with HMAC-SHA256 as the PRF */
+void pbkdf2_hmac_sha256(const uint8_t* password, size_t password_len,
+                        const uint8_t* salt, size_t salt_len, uint32_t iterations,
+                        uint8_t* out, size_t out_len);
+
+#define SHA512_DIGEST_SIZE 64
+
+typedef struct sha512_ctx {
+    uint64_t state[8];
+    uint64_t bytes;              /* Total input length */
+    uint8_t buf[128];
+    size_t buf_len;
+} sha512_ctx_t;
+
+void sha512_init(sha512_ctx_t* ctx);
+void sha512_update(sha512_ctx_t* ctx, const void* data, size_t len);
+
+/* Writes 64 bytes and wipes ctx */
+void sha512_final(sha512_ctx_t* ctx, uint8_t* digest);
+void sha512(const void* data, size_t len, uint8_t* digest);
+
+void hmac_sha512(const uint8_t* key, size_t key_len, const void* data, size_t len,
+                 uint8_t* mac);
+
+/* PBKDF2 (RFC 8018) with HMAC-SHA512 as the PRF */
+void pbkdf2_hmac_sha512(const uint8_t* password, size_t password_len,
+                        const uint8_t* salt, size_t salt_len, uint32_t iterations,
+                        uint8_t* out, size_t out_len);
+
+typedef struct argon2_params {
+    uint32_t passes;             /* t */
+    uint32_t memory_kb;          /* m, in 1KB blocks */
+    uint32_t lanes;              /* p, also the number of filling threads */
+    const uint8_t* secret;       /* Optional K */
+    size_t secret_len;
+    const uint8_t* ad;           /* Optional associated data X */
+    size_t ad_len;
+} argon2_params_t;
+
+/* Argon2id (RFC 9106, version 0x13) */
+int argon2id_hash(const uint8_t* password, size_t password_len,
+                  const uint8_t* salt, size_t salt_len,
+                  const argon2_params_t* params, uint8_t* out, size_t out_len);
+
 /* ============================================================================
  * Utility Functions
  * ============================================================================ */
@@ -600,7 +1096,75 @@ uint32_t crc32(const void* data, size_t len);
 uint64_t xxhash64(const void* data, size_t len);
 uint64_t get_timestamp_us(void);
 
+/* CPU features for runtime dispatch of SIMD code paths */
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define SPEEDSQL_X86 1
+#else
+    #define SPEEDSQL_X86 0
+#endif
+
+/* Compile one function for an instruction set the build does not assume */
+#if defined(__GNUC__) || defined(__clang__)
+    #define SPEEDSQL_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define SPEEDSQL_TARGET(isa)
+#endif
+
+#define CPU_FEATURE_SSSE3    0x0001
+#define CPU_FEATURE_SSE41    0x0002
+#define CPU_FEATURE_AESNI    0x0004
+#define CPU_FEATURE_PCLMUL   0x0008
+#define CPU_FEATURE_AVX2     0x0010
+#define CPU_FEATURE_VAES     0x0020
+#define CPU_FEATURE_VPCLMUL  0x0040
+#define CPU_FEATURE_SHA      0x0080
+#define CPU_FEATURE_AVX512F  0x0100
+#define CPU_FEATURE_SSE2     0x0200
+#define CPU_FEATURE_NEON     0x0400
+#define CPU_FEATURE_FMA      0x0800
+
+uint32_t cpu_features(void);
+
+/* Restrict cpu_features() to mask (0 forces portable code, ~0 restores) */
+void cpu_features_mask(uint32_t mask);
+
+/* Hardware threads available to this process (at least 1) */
+uint32_t cpu_count(void);
+
 /* Set error on connection */
 void sdb_set_error(speedsql* db, int code, const char* fmt, ...);
 
+/* Write schema page and header to the database file (no-op for :memory:) */
+int save_schema(speedsql* db);
+
+/* Reload header and schema after the file changed underneath the connection */
+int reload_schema(speedsql* db);
+
+/* Flush pages and schema through the WAL and append a commit record */
+int commit_to_wal(speedsql* db, txn_id_t txn);
+
+/* Take or drop one hold on the database file lock. The connection's
+ * level is the strongest any holder needs; other connections' locks are
+ * waited out for a while before SPEEDSQL_BUSY. */
+int db_lock(speedsql* db, int level);
+void db_unlock(speedsql* db, int level);
+
+/* Open a connection on an already resolved VFS */
+int open_connection(const char* filename, speedsql** db_out, int flags, speedsql_vfs* vfs);
+
+/* Snapshot teardown, called from speedsql_close */
+void snapshot_detach_all(speedsql* db);
+void snapshot_release(speedsql* db);
+
+/* Record how the page key is derived in the header, so a password opens
+ * the database again */
+int crypto_save_key_config(speedsql* db, const speedsql_crypto_config_t* config);
+
+/* Start resealing every page with a new key in the background, recording
+ * its derivation as the key switches; stop a running job (speedsql_close,
+ * speedsql_decrypt) */
+int rekey_start(speedsql* db, struct speedsql_cipher_ctx* ctx,
+                const speedsql_crypto_config_t* config);
+void rekey_shutdown(speedsql* db);
+
 #endif /* SPEEDSQL_INTERNAL_H */
@@ -33,7 +33,10 @@ typedef enum {
     PAGE_TYPE_OVERFLOW = 3,
     PAGE_TYPE_FREELIST = 4,
     PAGE_TYPE_SCHEMA = 5,
-    PAGE_TYPE_WAL = 6
+    PAGE_TYPE_WAL = 6,
+    PAGE_TYPE_HNSW = 7,
+    PAGE_TYPE_IVF = 8,
+    PAGE_TYPE_FTS = 9
 } page_type_t;
 
 /* Page ID type - 64-bit for large file support */
@@ -58,7 +61,15 @@ typedef struct {
     uint64_t schema_root;        /* Root page of schema table */
     uint64_t txn_id;             /* Current transaction ID */
     uint32_t checksum;           /* Header checksum */
-    uint8_t reserved[4012];      /* Reserved for future use */
+    uint32_t page_reserve;       /* Bytes at the end of every page kept for the
+                                    nonce and tag (0: tag appended after the page) */
+    uint32_t key_cipher;         /* Cipher of the page key */
+    uint32_t key_kdf;            /* KDF the page key was derived with (0: none) */
+    uint32_t key_iterations;     /* KDF iterations or passes */
+    uint32_t key_memory;         /* KDF memory cost in KB */
+    uint32_t key_parallelism;    /* KDF lanes */
+    uint8_t key_salt[32];        /* KDF salt */
+    uint8_t reserved[3956];      /* Reserved for future use */
 } db_header_t;
 
 /* Page header - common to all page types */
@@ -124,6 +135,9 @@ typedef struct {
 
 /* Forward declare btree_t for table_def */
 struct btree;
+struct hnsw;
+struct ivf;
+struct fts;
 
 /* Table definition */
 typedef struct {
@@ -144,12 +158,42 @@ typedef struct {
     uint32_t* column_indices;    /* Column indices */
     page_id_t root_page;         /* Root page of B+tree */
     struct btree* index_tree;    /* In-memory B+tree handle */
+    struct hnsw* hnsw;           /* Open graph of an HNSW index */
+    struct ivf* ivf;             /* Open lists of an IVF index */
+    struct fts* fts;             /* Open segments of a full-text index */
+    char* tokenizer;             /* Full-text tokenizer named at creation */
+    char* key_sql;               /* Key expression of an expression index */
+    struct expr* key_expr;       /* key_sql parsed, on first use */
+    char* where_sql;             /* Predicate of a partial index */
+    struct expr* where_expr;     /* where_sql parsed, on first use */
+    uint32_t params[8];          /* WITH (...) options at creation */
     uint8_t flags;               /* UNIQUE, etc. */
 } index_def_t;
 
 /* Index flags */
 #define IDX_FLAG_UNIQUE      0x01
 #define IDX_FLAG_PRIMARY     0x02
+#define IDX_FLAG_HNSW        0x04  /* root_page is an HNSW meta page */
+#define IDX_FLAG_IVF         0x08  /* root_page is an IVF meta page */
+#define IDX_FLAG_VECTOR      (IDX_FLAG_HNSW | IDX_FLAG_IVF)
+#define IDX_FLAG_FTS         0x10  /* root_page is a full-text meta page */
+#define IDX_FLAG_EXPR        0x20  /* Keyed on key_sql rather than a column */
+#define IDX_FLAG_PARTIAL     0x40  /* Holds only rows where where_sql is true */
+
+/* Vector index options in index_def_t.params (0 takes the default) */
+#define IDX_PARAM_M               0
+#define IDX_PARAM_EF_CONSTRUCTION 1
+#define IDX_PARAM_EF_SEARCH       2
+#define IDX_PARAM_QUANTIZE        3  /* IDX_QUANT_* */
+#define IDX_PARAM_PQ_M            4  /* PQ subspaces */
+#define IDX_PARAM_RERANK          5  /* Candidates re-ranked per result */
+#define IDX_PARAM_LISTS           6  /* IVF posting lists */
+#define IDX_PARAM_NPROBE          7  /* IVF lists probed per query */
+
+/* How an index stores its vectors */
+#define IDX_QUANT_NONE 0             /* Full float32 */
+#define IDX_QUANT_SQ8  1             /* int8 scalar quantization */
+#define IDX_QUANT_PQ   2             /* Product quantization */
 
 /* Lock modes */
 typedef enum {
@@ -172,7 +216,8 @@ typedef enum {
     BUF_INVALID = 0,
     BUF_CLEAN = 1,
     BUF_DIRTY = 2,
-    BUF_PINNED = 3
+    BUF_PINNED = 3,
+    BUF_IO = 4          /* Being read or written back outside the pool lock */
 } buffer_state_t;
 
 /* Comparison result */
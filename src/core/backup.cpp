@@ -0,0 +1,329 @@
+/*
+ * SpeedSQL - Online and incremental backup
+ *
+ * A backup scans the database file front to back in large sequential
+ * chunks (mapped when the VFS can), taking the connection lock and a
+ * shared file lock only for one chunk at a time. The
+ * buffer pool records every page written while the backup runs; finish
+ * recopies those pages (plus the header and schema pages) under the lock,
+ * so the destination ends up identical to the source at finish time.
+ *
+ * Incremental backups update a previous backup in place, copying only
+ * pages whose header txn_id is newer than the previous backup.
+ */
+
+#include "speedsql_internal.h"
+
+/* Pages copied per sequential read/write (1MB with 16KB pages) */
+#define BACKUP_CHUNK_PAGES 64
+
+/* Header and schema pages are always recopied at finish */
+#define BACKUP_FIXED_PAGES 2
+
+struct speedsql_backup {
+    speedsql* db;
+    file_t dest;
+    uint64_t since_txn;          /* 0: full backup */
+    uint64_t stride;             /* On-disk bytes per page */
+    page_id_t next_page;         /* Next page to scan */
+    page_id_t page_count;        /* Pages in the source when the backup started */
+    int64_t copied;              /* Pages written to dest */
+    uint8_t* chunk;              /* Sequential copy buffer */
+};
+
+/* Source bytes of pages [first, first + count): a mapping of the file
+ * when the VFS can map it, else a copy in the chunk buffer. *map is set
+ * for a mapping, to be released with backup_source_done. */
+static int backup_source(speedsql_backup* b, page_id_t first, size_t count,
+                         const uint8_t** data, void** map) {
+    uint64_t offset = first * b->stride;
+    size_t len = (size_t)(count * b->stride);
+
+    *map = nullptr;
+    if (file_mmap(&b->db->db_file, offset, len, map) == SPEEDSQL_OK) {
+        *data = (const uint8_t*)*map;
+        return SPEEDSQL_OK;
+    }
+
+    /* Unmappable backend or an offset the OS will not map at */
+    *map = nullptr;
+    *data = b->chunk;
+    return file_read(&b->db->db_file, offset, b->chunk, len);
+}
+
+static void backup_source_done(speedsql_backup* b, size_t count, void* map) {
+    if (map) {
+        file_munmap(&b->db->db_file, map, (size_t)(count * b->stride));
+    }
+}
+
+/* Copy pages [first, first + count) verbatim */
+static int backup_copy_range(speedsql_backup* b, page_id_t first, size_t count) {
+    const uint8_t* data;
+    void* map;
+    int rc = backup_source(b, first, count, &data, &map);
+    if (rc == SPEEDSQL_OK) {
+        rc = file_write(&b->dest, first * b->stride, data, (size_t)(count * b->stride));
+    }
+    backup_source_done(b, count, map);
+
+    if (rc == SPEEDSQL_OK) {
+        b->copied += (int64_t)count;
+    }
+    return rc;
+}
+
+/* Copy the pages of one chunk whose header is newer than since_txn,
+ * coalescing adjacent changed pages into single writes */
+static int backup_copy_changed(speedsql_backup* b, page_id_t first, size_t count) {
+    const uint8_t* data;
+    void* map;
+    int rc = backup_source(b, first, count, &data, &map);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    size_t run_start = 0;
+    size_t run_len = 0;
+
+    for (size_t i = 0; i <= count && rc == SPEEDSQL_OK; i++) {
+        bool changed = false;
+        if (i < count && first + i >= BACKUP_FIXED_PAGES) {
+            const page_header_t* hdr = (const page_header_t*)(data + i * b->stride);
+            changed = hdr->txn_id > b->since_txn;
+        }
+
+        if (changed) {
+            if (run_len == 0) run_start = i;
+            run_len++;
+            continue;
+        }
+
+        if (run_len > 0) {
+            rc = file_write(&b->dest, (first + run_start) * b->stride,
+                            data + run_start * b->stride,
+                            (size_t)(run_len * b->stride));
+            if (rc == SPEEDSQL_OK) {
+                b->copied += (int64_t)run_len;
+            }
+            run_len = 0;
+        }
+    }
+
+    backup_source_done(b, count, map);
+    return rc;
+}
+
+SPEEDSQL_API int speedsql_backup_init(speedsql* db, const char* dest_path,
+                                      uint64_t since_txn, speedsql_backup** backup_out) {
+    if (!db || !dest_path || !backup_out) return SPEEDSQL_MISUSE;
+
+    *backup_out = nullptr;
+
+    if (db->flags & SPEEDSQL_OPEN_MEMORY) {
+        sdb_set_error(db, SPEEDSQL_MISUSE,
+                      "Use speedsql_memory_snapshot for in-memory databases");
+        return SPEEDSQL_MISUSE;
+    }
+
+    if (since_txn && db->encrypted) {
+        sdb_set_error(db, SPEEDSQL_MISUSE,
+                      "Incremental backup of an encrypted database is not supported");
+        return SPEEDSQL_MISUSE;
+    }
+
+    speedsql_backup* b = (speedsql_backup*)sdb_calloc(1, sizeof(speedsql_backup));
+    if (!b) return SPEEDSQL_NOMEM;
+
+    b->db = db;
+    b->since_txn = since_txn;
+    b->stride = buffer_pool_disk_page_size(db->buffer_pool);
+
+    b->chunk = (uint8_t*)sdb_malloc((size_t)(BACKUP_CHUNK_PAGES * b->stride));
+    if (!b->chunk) {
+        sdb_free(b);
+        return SPEEDSQL_NOMEM;
+    }
+
+    /* Incremental backups update an existing copy in place */
+    int flags = SPEEDSQL_VFS_OPEN_READWRITE | (since_txn ? 0 : SPEEDSQL_VFS_OPEN_CREATE);
+    int rc = file_open_vfs(&b->dest, db->vfs, dest_path, flags);
+    if (rc != SPEEDSQL_OK) {
+        sdb_set_error(db, SPEEDSQL_CANTOPEN, "Cannot open backup file: %s", dest_path);
+        sdb_free(b->chunk);
+        sdb_free(b);
+        return SPEEDSQL_CANTOPEN;
+    }
+
+    if (since_txn) {
+        /* The copy must be the backup taken at since_txn */
+        db_header_t prev;
+        rc = file_read(&b->dest, 0, &prev, sizeof(prev));
+        if (rc != SPEEDSQL_OK || prev.txn_id != since_txn) {
+            sdb_set_error(db, SPEEDSQL_MISMATCH,
+                          "Backup file was not taken at transaction %llu",
+                          (unsigned long long)since_txn);
+            file_close(&b->dest);
+            sdb_free(b->chunk);
+            sdb_free(b);
+            return SPEEDSQL_MISMATCH;
+        }
+    } else {
+        rc = file_truncate(&b->dest, 0);
+    }
+
+    mutex_lock(&db->lock);
+
+    if (rc == SPEEDSQL_OK) {
+        rc = buffer_pool_track_begin(db->buffer_pool);
+        if (rc == SPEEDSQL_BUSY) {
+            sdb_set_error(db, SPEEDSQL_BUSY, "Another backup is in progress");
+        }
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        uint64_t size = 0;
+        file_size(&db->db_file, &size);
+        b->page_count = (size + b->stride - 1) / b->stride;
+    }
+
+    mutex_unlock(&db->lock);
+
+    if (rc != SPEEDSQL_OK) {
+        file_close(&b->dest);
+        sdb_free(b->chunk);
+        sdb_free(b);
+        return rc;
+    }
+
+    *backup_out = b;
+    return SPEEDSQL_OK;
+}
+
+SPEEDSQL_API int speedsql_backup_step(speedsql_backup* b, int n_pages) {
+    if (!b) return SPEEDSQL_MISUSE;
+
+    page_id_t end = b->page_count;
+    if (n_pages > 0 && b->next_page + (page_id_t)n_pages < end) {
+        end = b->next_page + (page_id_t)n_pages;
+    }
+
+    int rc = SPEEDSQL_OK;
+    while (b->next_page < end && rc == SPEEDSQL_OK) {
+        size_t count = (size_t)(end - b->next_page);
+        if (count > BACKUP_CHUNK_PAGES) count = BACKUP_CHUNK_PAGES;
+
+        /* Writers get the locks back between chunks */
+        mutex_lock(&b->db->lock);
+        rc = db_lock(b->db, SPEEDSQL_LOCK_SHARED);
+        if (rc == SPEEDSQL_OK) {
+            if (b->since_txn) {
+                rc = backup_copy_changed(b, b->next_page, count);
+            } else {
+                rc = backup_copy_range(b, b->next_page, count);
+            }
+            db_unlock(b->db, SPEEDSQL_LOCK_SHARED);
+        }
+        mutex_unlock(&b->db->lock);
+
+        b->next_page += count;
+    }
+
+    if (rc != SPEEDSQL_OK) {
+        sdb_set_error(b->db, rc, "Backup failed at page %llu",
+                      (unsigned long long)b->next_page);
+        return rc;
+    }
+
+    return b->next_page >= b->page_count ? SPEEDSQL_DONE : SPEEDSQL_OK;
+}
+
+SPEEDSQL_API int64_t speedsql_backup_remaining(speedsql_backup* b) {
+    if (!b) return 0;
+    return (int64_t)(b->page_count - b->next_page);
+}
+
+SPEEDSQL_API int64_t speedsql_backup_copied(speedsql_backup* b) {
+    if (!b) return 0;
+    return b->copied;
+}
+
+SPEEDSQL_API int speedsql_backup_finish(speedsql_backup* b, uint64_t* backup_txn) {
+    if (!b) return SPEEDSQL_MISUSE;
+
+    speedsql* db = b->db;
+
+    /* Scan whatever the caller did not step through */
+    int rc = speedsql_backup_step(b, 0);
+    if (rc == SPEEDSQL_DONE) rc = SPEEDSQL_OK;
+
+    mutex_lock(&db->lock);
+
+    /* Uncommitted pages must not reach the backup */
+    if (rc == SPEEDSQL_OK && db->txn_state == TXN_WRITE) {
+        sdb_set_error(db, SPEEDSQL_BUSY, "Cannot finish backup inside a write transaction");
+        rc = SPEEDSQL_BUSY;
+    }
+
+    /* Flushing and the final recopy run under the exclusive lock */
+    bool locked = false;
+    if (rc == SPEEDSQL_OK) {
+        rc = db_lock(db, SPEEDSQL_LOCK_EXCLUSIVE);
+        locked = rc == SPEEDSQL_OK;
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        rc = buffer_pool_flush(db->buffer_pool, &db->db_file);
+    }
+    if (rc == SPEEDSQL_OK) {
+        rc = save_schema(db);
+    }
+
+    uint8_t* bits = nullptr;
+    size_t bytes = 0;
+    int track_rc = buffer_pool_track_end(db->buffer_pool, &bits, &bytes);
+    if (rc == SPEEDSQL_OK) {
+        rc = track_rc;
+    }
+
+    /* Recopy header, schema and everything written since the backup began */
+    uint64_t size = 0;
+    file_size(&db->db_file, &size);
+    page_id_t page_count = (size + b->stride - 1) / b->stride;
+
+    if (rc == SPEEDSQL_OK) {
+        rc = backup_copy_range(b, 0, BACKUP_FIXED_PAGES);
+    }
+    for (page_id_t id = BACKUP_FIXED_PAGES; id < page_count && rc == SPEEDSQL_OK; id++) {
+        size_t byte = (size_t)(id / 8);
+        if (byte < bytes && (bits[byte] & (1u << (id % 8)))) {
+            rc = backup_copy_range(b, id, 1);
+        }
+    }
+    sdb_free(bits);
+
+    if (rc == SPEEDSQL_OK) {
+        rc = file_truncate(&b->dest, page_count * b->stride);
+    }
+    if (rc == SPEEDSQL_OK) {
+        rc = file_sync(&b->dest);
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        /* Pages written from now on are newer than this backup */
+        if (backup_txn) *backup_txn = db->header.txn_id;
+        db->header.txn_id++;
+        db->buffer_pool->stamp_txn = db->header.txn_id;
+        save_schema(db);
+    } else if (db->errcode != rc) {
+        sdb_set_error(db, rc, "Backup failed");
+    }
+
+    if (locked) {
+        db_unlock(db, SPEEDSQL_LOCK_EXCLUSIVE);
+    }
+    mutex_unlock(&db->lock);
+
+    file_close(&b->dest);
+    sdb_free(b->chunk);
+    sdb_free(b);
+    return rc;
+}
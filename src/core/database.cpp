@@ -48,10 +48,10 @@ void sdb_set_error(speedsql* db, int code, const char* fmt, ...) {
 static int init_new_database(speedsql* db) {
     /* Initialize header */
     memset(&db->header, 0, sizeof(db->header));
-    memcpy(db->header.magic, DB_MAGIC, sizeof(DB_MAGIC));
+    memcpy(db->header.magic, DB_MAGIC, sizeof(db->header.magic));
     db->header.version = DB_VERSION;
     db->header.page_size = SPEEDSQL_PAGE_SIZE;
-    db->header.page_count = 1;  /* Just the header page */
+    db->header.page_count = 2;  /* Header page + reserved schema page */
     db->header.freelist_head = INVALID_PAGE_ID;
     db->header.freelist_count = 0;
     db->header.schema_root = INVALID_PAGE_ID;
@@ -70,6 +70,14 @@ static int init_new_database(speedsql* db) {
         return SPEEDSQL_IOERR;
     }
 
+    /* Reserve page 1 for the schema so the first B+tree page lands after it */
+    memset(page, 0, sizeof(page));
+    rc = file_write(&db->db_file, SPEEDSQL_PAGE_SIZE, page, SPEEDSQL_PAGE_SIZE);
+    if (rc != SPEEDSQL_OK) {
+        sdb_set_error(db, SPEEDSQL_IOERR, "Failed to write database header");
+        return SPEEDSQL_IOERR;
+    }
+
     rc = file_sync(&db->db_file);
     if (rc != SPEEDSQL_OK) {
         sdb_set_error(db, SPEEDSQL_IOERR, "Failed to sync database file");
@@ -102,13 +110,46 @@ static int init_new_database(speedsql* db) {
  *   - root_page (8 bytes)
  *   - flags (1 byte)
  *   - column_indices (4 bytes each)
+ *   - with IDX_FLAG_EXPR: key_len (2 bytes) + key expression text
+ *   - with IDX_FLAG_PARTIAL: where_len (2 bytes) + predicate text
  */
 
-static int save_schema(speedsql* db) {
-    if (!db || (db->flags & SPEEDSQL_OPEN_MEMORY)) {
-        return SPEEDSQL_OK;  /* No-op for memory databases */
+/* Length-prefixed SQL text of an index; false when the page is full */
+static bool put_schema_text(uint8_t** ptr, uint8_t* end, const char* text) {
+    uint16_t len = (uint16_t)strlen(text);
+    if (*ptr + 2 + len > end) return false;
+    *(uint16_t*)*ptr = len;
+    memcpy(*ptr + 2, text, len);
+    *ptr += 2 + len;
+    return true;
+}
+
+static char* get_schema_text(uint8_t** ptr, uint8_t* end) {
+    if (*ptr + 2 > end) return nullptr;
+    uint16_t len = *(uint16_t*)*ptr;
+    if (*ptr + 2 + len > end) return nullptr;
+
+    char* text = (char*)sdb_malloc(len + 1);
+    if (text) {
+        memcpy(text, *ptr + 2, len);
+        text[len] = '\0';
     }
+    *ptr += 2 + len;
+    return text;
+}
+
+/* Write a header or schema page, logging it first when the WAL is on */
+static int write_meta_page(speedsql* db, file_t* file, page_id_t page_id, const uint8_t* data) {
+    if (db->wal && file == &db->db_file) {
+        int rc = wal_log_page(db->wal, db->buffer_pool->stamp_txn, page_id,
+                              data, SPEEDSQL_PAGE_SIZE);
+        if (rc != SPEEDSQL_OK) return rc;
+    }
+
+    return file_write(file, page_id * SPEEDSQL_PAGE_SIZE, data, SPEEDSQL_PAGE_SIZE);
+}
 
+static int write_schema(speedsql* db, file_t* file) {
     /* Allocate schema page buffer */
     uint8_t* page = (uint8_t*)sdb_calloc(1, SPEEDSQL_PAGE_SIZE);
     if (!page) return SPEEDSQL_NOMEM;
@@ -200,10 +241,17 @@ static int save_schema(speedsql* db) {
             *(uint32_t*)ptr = idx->column_indices[c];
             ptr += 4;
         }
+
+        /* Key expression and predicate */
+        if (((idx->flags & IDX_FLAG_EXPR) && !put_schema_text(&ptr, end, idx->key_sql)) ||
+            ((idx->flags & IDX_FLAG_PARTIAL) && !put_schema_text(&ptr, end, idx->where_sql))) {
+            sdb_free(page);
+            return SPEEDSQL_FULL;
+        }
     }
 
     /* Write to schema page (page 1, after header page) */
-    int rc = file_write(&db->db_file, SPEEDSQL_PAGE_SIZE, page, SPEEDSQL_PAGE_SIZE);
+    int rc = write_meta_page(db, file, 1, page);
     sdb_free(page);
 
     if (rc != SPEEDSQL_OK) {
@@ -218,11 +266,23 @@ static int save_schema(speedsql* db) {
     /* Write updated header */
     uint8_t header_page[SPEEDSQL_PAGE_SIZE] = {0};
     memcpy(header_page, &db->header, sizeof(db->header));
-    rc = file_write(&db->db_file, 0, header_page, SPEEDSQL_PAGE_SIZE);
+    rc = write_meta_page(db, file, 0, header_page);
 
     return rc;
 }
 
+int save_schema(speedsql* db) {
+    if (!db || (db->flags & SPEEDSQL_OPEN_MEMORY)) {
+        return SPEEDSQL_OK;  /* No-op for memory databases */
+    }
+
+    if (db->flags & SPEEDSQL_OPEN_READONLY) {
+        return SPEEDSQL_OK;  /* Followers only take schema from the log */
+    }
+
+    return write_schema(db, &db->db_file);
+}
+
 static int load_schema(speedsql* db) {
     if (!db || (db->flags & SPEEDSQL_OPEN_MEMORY)) {
         return SPEEDSQL_OK;
@@ -389,6 +449,14 @@ static int load_schema(speedsql* db) {
             }
         }
 
+        /* Key expression and predicate, parsed when the index is first used */
+        if (idx->flags & IDX_FLAG_EXPR) {
+            idx->key_sql = get_schema_text(&ptr, end);
+        }
+        if (idx->flags & IDX_FLAG_PARTIAL) {
+            idx->where_sql = get_schema_text(&ptr, end);
+        }
+
         db->index_count++;
     }
 
@@ -409,7 +477,7 @@ static int read_database_header(speedsql* db) {
     memcpy(&db->header, page, sizeof(db->header));
 
     /* Validate magic */
-    if (memcmp(db->header.magic, DB_MAGIC, sizeof(DB_MAGIC)) != 0) {
+    if (memcmp(db->header.magic, DB_MAGIC, sizeof(db->header.magic)) != 0) {
         sdb_set_error(db, SPEEDSQL_CORRUPT, "Invalid database file format");
         return SPEEDSQL_CORRUPT;
     }
@@ -430,6 +498,147 @@ static int read_database_header(speedsql* db) {
     return SPEEDSQL_OK;
 }
 
+/* Free the cached schema and the table B+trees */
+static void free_schema(speedsql* db) {
+    if (db->tables) {
+        for (size_t i = 0; i < db->table_count; i++) {
+            sdb_free(db->tables[i].name);
+            for (uint32_t j = 0; j < db->tables[i].column_count; j++) {
+                sdb_free(db->tables[i].columns[j].name);
+                sdb_free(db->tables[i].columns[j].default_value);
+                sdb_free(db->tables[i].columns[j].collation);
+            }
+            sdb_free(db->tables[i].columns);
+            /* Free B+Tree for table data */
+            if (db->tables[i].data_tree) {
+                btree_close((btree_t*)db->tables[i].data_tree);
+                sdb_free(db->tables[i].data_tree);
+            }
+        }
+        sdb_free(db->tables);
+    }
+
+    if (db->indices) {
+        for (size_t i = 0; i < db->index_count; i++) {
+            hnsw_close(db->indices[i].hnsw);
+            ivf_close(db->indices[i].ivf);
+            fts_close(db->indices[i].fts);
+            sdb_free(db->indices[i].name);
+            sdb_free(db->indices[i].table_name);
+            sdb_free(db->indices[i].column_indices);
+            sdb_free(db->indices[i].tokenizer);
+            sdb_free(db->indices[i].key_sql);
+            expr_free(db->indices[i].key_expr);
+            sdb_free(db->indices[i].where_sql);
+            expr_free(db->indices[i].where_expr);
+            if (db->indices[i].index_tree) {
+                btree_close((btree_t*)db->indices[i].index_tree);
+                sdb_free(db->indices[i].index_tree);
+            }
+        }
+        sdb_free(db->indices);
+    }
+
+    db->tables = nullptr;
+    db->table_count = 0;
+    db->indices = nullptr;
+    db->index_count = 0;
+}
+
+int reload_schema(speedsql* db) {
+    int rc = read_database_header(db);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    buffer_pool_discard(db->buffer_pool);
+    free_schema(db);
+    return load_schema(db);
+}
+
+/* Buffer pool hook: log each page image before it reaches the file */
+static int log_write_back(void* arg, page_id_t page_id, const uint8_t* data, size_t size) {
+    speedsql* db = (speedsql*)arg;
+    return wal_log_page(db->wal, db->buffer_pool->stamp_txn, page_id, data, size);
+}
+
+int commit_to_wal(speedsql* db, txn_id_t txn) {
+    if (!db->wal) return SPEEDSQL_OK;
+
+    int rc = db_lock(db, SPEEDSQL_LOCK_EXCLUSIVE);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    rc = buffer_pool_flush(db->buffer_pool, &db->db_file);
+    if (rc == SPEEDSQL_OK) {
+        rc = write_schema(db, &db->db_file);
+    }
+    if (rc == SPEEDSQL_OK) {
+        rc = wal_commit(db->wal, txn);
+    }
+
+    db_unlock(db, SPEEDSQL_LOCK_EXCLUSIVE);
+    return rc;
+}
+
+/* ============================================================================
+ * File Locking
+ * ============================================================================ */
+
+static int db_lock_level(const speedsql* db) {
+    if (db->exclusive_locks > 0) return SPEEDSQL_LOCK_EXCLUSIVE;
+    return db->shared_locks > 0 ? SPEEDSQL_LOCK_SHARED : SPEEDSQL_LOCK_NONE;
+}
+
+int db_lock(speedsql* db, int level) {
+    mutex_lock(&db->file_lock_mutex);
+
+    int held = db_lock_level(db);
+    int rc = SPEEDSQL_OK;
+    if (level > held) {
+        for (uint32_t waited = 0;; waited++) {
+            rc = file_lock(&db->db_file, level);
+            if (rc != SPEEDSQL_BUSY || waited >= db->busy_timeout_ms) break;
+            thread_sleep_ms(1);
+        }
+        /* A backend that drops the old lock to convert it gets it back */
+        if (rc != SPEEDSQL_OK && held != SPEEDSQL_LOCK_NONE) {
+            file_lock(&db->db_file, held);
+        }
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        if (level == SPEEDSQL_LOCK_EXCLUSIVE) {
+            db->exclusive_locks++;
+        } else {
+            db->shared_locks++;
+        }
+    }
+
+    mutex_unlock(&db->file_lock_mutex);
+    if (rc == SPEEDSQL_BUSY) {
+        sdb_set_error(db, rc, "Database is locked");
+    }
+    return rc;
+}
+
+void db_unlock(speedsql* db, int level) {
+    mutex_lock(&db->file_lock_mutex);
+
+    if (level == SPEEDSQL_LOCK_EXCLUSIVE) {
+        db->exclusive_locks--;
+    } else {
+        db->shared_locks--;
+    }
+
+    int wanted = db_lock_level(db);
+    if (wanted < level) {
+        file_lock(&db->db_file, wanted);
+    }
+
+    mutex_unlock(&db->file_lock_mutex);
+}
+
+/* How long a lock request waits out other connections, in milliseconds */
+#define DB_LOCK_TIMEOUT_MS 5000
+
 /* Public API: Open database */
 SPEEDSQL_API int speedsql_open(const char* filename, speedsql** db_out) {
     return speedsql_open_v2(filename, db_out,
@@ -438,14 +647,24 @@ SPEEDSQL_API int speedsql_open(const char* filename, speedsql** db_out) {
 
 SPEEDSQL_API int speedsql_open_v2(const char* filename, speedsql** db_out,
                                  int flags, const char* vfs) {
-    (void)vfs;  /* Reserved for future VFS support */
-
     if (!filename || !db_out) {
         return SPEEDSQL_MISUSE;
     }
 
     *db_out = nullptr;
 
+    /* Resolve VFS (NULL selects the registered default) */
+    speedsql_vfs* db_vfs = speedsql_vfs_find(vfs);
+    if (!db_vfs) {
+        return SPEEDSQL_NOTFOUND;
+    }
+
+    return open_connection(filename, db_out, flags, db_vfs);
+}
+
+int open_connection(const char* filename, speedsql** db_out, int flags, speedsql_vfs* db_vfs) {
+    *db_out = nullptr;
+
     /* Check for in-memory database */
     bool is_memory = (strcmp(filename, ":memory:") == 0 ||
                       strcmp(filename, "") == 0);
@@ -459,24 +678,26 @@ SPEEDSQL_API int speedsql_open_v2(const char* filename, speedsql** db_out,
     /* Initialize synchronization */
     mutex_init(&db->lock);
     rwlock_init(&db->schema_lock);
+    mutex_init(&db->file_lock_mutex);
 
     db->flags = flags | (is_memory ? SPEEDSQL_OPEN_MEMORY : 0);
+    db->vfs = db_vfs;
     db->cache_size = SPEEDSQL_DEFAULT_CACHE_SIZE;
+    db->busy_timeout_ms = DB_LOCK_TIMEOUT_MS;
     db->errcode = SPEEDSQL_OK;
     db->errmsg[0] = '\0';
 
     int rc = SPEEDSQL_OK;
+    int open_lock = SPEEDSQL_LOCK_NONE;  /* Held while the header and schema are read */
 
     if (is_memory) {
-        /* In-memory database - no file operations */
+        /* In-memory database - detached file, no VFS */
         memset(&db->db_file, 0, sizeof(db->db_file));
-        db->db_file.handle = INVALID_FILE_HANDLE;
         db->db_file.path = sdb_strdup(":memory:");
-        rwlock_init(&db->db_file.lock);
 
         /* Initialize header directly */
         memset(&db->header, 0, sizeof(db->header));
-        memcpy(db->header.magic, DB_MAGIC, sizeof(DB_MAGIC));
+        memcpy(db->header.magic, DB_MAGIC, sizeof(db->header.magic));
         db->header.version = DB_VERSION;
         db->header.page_size = SPEEDSQL_PAGE_SIZE;
         db->header.page_count = 1;
@@ -497,10 +718,11 @@ SPEEDSQL_API int speedsql_open_v2(const char* filename, speedsql** db_out,
             file_flags |= 2;  /* Create if not exists */
         }
 
-        rc = file_open(&db->db_file, filename, file_flags);
+        rc = file_open_vfs(&db->db_file, db_vfs, filename, file_flags);
         if (rc != SPEEDSQL_OK) {
             sdb_set_error(db, SPEEDSQL_CANTOPEN, "Cannot open database file: %s", filename);
             mutex_destroy(&db->lock);
+            mutex_destroy(&db->file_lock_mutex);
             rwlock_destroy(&db->schema_lock);
             sdb_free(db);
             return SPEEDSQL_CANTOPEN;
@@ -510,12 +732,24 @@ SPEEDSQL_API int speedsql_open_v2(const char* filename, speedsql** db_out,
         uint64_t db_file_size;
         file_size(&db->db_file, &db_file_size);
 
+        open_lock = db_file_size == 0 ? SPEEDSQL_LOCK_EXCLUSIVE : SPEEDSQL_LOCK_SHARED;
+        rc = db_lock(db, open_lock);
+        if (rc != SPEEDSQL_OK) {
+            file_close(&db->db_file);
+            mutex_destroy(&db->lock);
+            rwlock_destroy(&db->schema_lock);
+            mutex_destroy(&db->file_lock_mutex);
+            sdb_free(db);
+            return rc;
+        }
+
         if (db_file_size == 0) {
             /* New database - initialize */
             rc = init_new_database(db);
             if (rc != SPEEDSQL_OK) {
                 file_close(&db->db_file);
                 mutex_destroy(&db->lock);
+                mutex_destroy(&db->file_lock_mutex);
                 rwlock_destroy(&db->schema_lock);
                 sdb_free(db);
                 return rc;
@@ -526,6 +760,7 @@ SPEEDSQL_API int speedsql_open_v2(const char* filename, speedsql** db_out,
             if (rc != SPEEDSQL_OK) {
                 file_close(&db->db_file);
                 mutex_destroy(&db->lock);
+                mutex_destroy(&db->file_lock_mutex);
                 rwlock_destroy(&db->schema_lock);
                 sdb_free(db);
                 return rc;
@@ -538,20 +773,40 @@ SPEEDSQL_API int speedsql_open_v2(const char* filename, speedsql** db_out,
     if (!db->buffer_pool) {
         if (!is_memory) file_close(&db->db_file);
         mutex_destroy(&db->lock);
+        mutex_destroy(&db->file_lock_mutex);
         rwlock_destroy(&db->schema_lock);
         sdb_free(db);
         return SPEEDSQL_NOMEM;
     }
 
-    rc = buffer_pool_init(db->buffer_pool, db->cache_size, db->header.page_size);
+    if (is_memory) {
+        rc = buffer_pool_init_memory(db->buffer_pool, db->header.page_size);
+    } else {
+        rc = buffer_pool_init(db->buffer_pool, db->cache_size, db->header.page_size);
+    }
     if (rc != SPEEDSQL_OK) {
         if (!is_memory) file_close(&db->db_file);
         mutex_destroy(&db->lock);
+        mutex_destroy(&db->file_lock_mutex);
         rwlock_destroy(&db->schema_lock);
         sdb_free(db->buffer_pool);
         sdb_free(db);
         return rc;
     }
+    db->buffer_pool->stamp_txn = db->header.txn_id;
+
+    /* Aligned encrypted layout: the page tail holds nonce and tag */
+    if (db->header.page_reserve &&
+        buffer_pool_set_page_reserve(db->buffer_pool, db->header.page_reserve) != SPEEDSQL_OK) {
+        buffer_pool_destroy(db->buffer_pool);
+        if (!is_memory) file_close(&db->db_file);
+        mutex_destroy(&db->lock);
+        mutex_destroy(&db->file_lock_mutex);
+        rwlock_destroy(&db->schema_lock);
+        sdb_free(db->buffer_pool);
+        sdb_free(db);
+        return SPEEDSQL_CORRUPT;
+    }
 
     /* Initialize WAL if enabled (not for memory databases) */
     if ((flags & SPEEDSQL_OPEN_WAL) && !is_memory) {
@@ -559,11 +814,15 @@ SPEEDSQL_API int speedsql_open_v2(const char* filename, speedsql** db_out,
         if (db->wal) {
             char wal_path[1024];
             snprintf(wal_path, sizeof(wal_path), "%s-wal", filename);
-            rc = wal_init(db->wal, wal_path);
+            rc = wal_init(db->wal, db_vfs, wal_path);
             if (rc != SPEEDSQL_OK) {
                 sdb_free(db->wal);
                 db->wal = nullptr;
                 /* Continue without WAL */
+            } else {
+                /* Every page write is logged so the WAL can be shipped */
+                db->buffer_pool->on_write_back = log_write_back;
+                db->buffer_pool->on_write_back_arg = db;
             }
         }
     }
@@ -574,26 +833,102 @@ SPEEDSQL_API int speedsql_open_v2(const char* filename, speedsql** db_out,
         if (rc != SPEEDSQL_OK) {
             /* Non-fatal - just continue without schema */
         }
+        db_unlock(db, open_lock);
     }
 
     *db_out = db;
     return SPEEDSQL_OK;
 }
 
+/* Tree roots saved at BEGIN, put back by rollback */
+static void txn_roots_free(speedsql* db) {
+    for (size_t i = 0; i < db->txn_root_count; i++) sdb_free(db->txn_roots[i].name);
+    sdb_free(db->txn_roots);
+    db->txn_roots = nullptr;
+    db->txn_root_count = 0;
+}
+
+/* Remember where every table and index tree is rooted */
+static int txn_roots_save(speedsql* db) {
+    txn_roots_free(db);
+
+    size_t count = db->table_count + db->index_count;
+    if (count == 0) return SPEEDSQL_OK;
+
+    db->txn_roots = (struct speedsql::txn_root*)sdb_calloc(count, sizeof(*db->txn_roots));
+    if (!db->txn_roots) return SPEEDSQL_NOMEM;
+
+    for (size_t i = 0; i < count; i++) {
+        bool index = i >= db->table_count;
+        const char* name = index ? db->indices[i - db->table_count].name : db->tables[i].name;
+        db->txn_roots[i].name = sdb_strdup(name);
+        if (!db->txn_roots[i].name) {
+            db->txn_root_count = i;
+            txn_roots_free(db);
+            return SPEEDSQL_NOMEM;
+        }
+        db->txn_roots[i].index = index;
+        db->txn_roots[i].root = index ? db->indices[i - db->table_count].root_page
+                                      : db->tables[i].root_page;
+    }
+    db->txn_root_count = count;
+    return SPEEDSQL_OK;
+}
+
+/* Point each tree back at its root from BEGIN, once its pages are back */
+static void txn_roots_restore(speedsql* db) {
+    for (size_t i = 0; i < db->txn_root_count; i++) {
+        const struct speedsql::txn_root* saved = &db->txn_roots[i];
+        if (saved->index) {
+            for (size_t j = 0; j < db->index_count; j++) {
+                index_def_t* idx = &db->indices[j];
+                if (!idx->name || strcmp(idx->name, saved->name) != 0) continue;
+                idx->root_page = saved->root;
+                if (idx->index_tree) ((btree_t*)idx->index_tree)->root_page = saved->root;
+            }
+        } else {
+            for (size_t j = 0; j < db->table_count; j++) {
+                table_def_t* table = &db->tables[j];
+                if (!table->name || strcmp(table->name, saved->name) != 0) continue;
+                table->root_page = saved->root;
+                if (table->data_tree) ((btree_t*)table->data_tree)->root_page = saved->root;
+            }
+        }
+    }
+}
+
 SPEEDSQL_API int speedsql_close(speedsql* db) {
     if (!db) return SPEEDSQL_MISUSE;
 
-    /* Save schema before closing (if file database) */
-    if (db->table_count > 0 || db->index_count > 0) {
+    /* Stop resealing before the pool goes away */
+    rekey_shutdown(db);
+
+    /* The last write-back runs under the exclusive lock; if other
+     * connections hold on past the timeout it goes ahead regardless */
+    bool locked = !(db->flags & SPEEDSQL_OPEN_READONLY) &&
+                  db_lock(db, SPEEDSQL_LOCK_EXCLUSIVE) == SPEEDSQL_OK;
+
+    if (db->wal && !(db->flags & SPEEDSQL_OPEN_READONLY)) {
+        /* Ship whatever is still pending, then restart the log: the file
+         * now holds everything in it */
+        if (commit_to_wal(db, db->buffer_pool->stamp_txn) == SPEEDSQL_OK) {
+            wal_checkpoint(db->wal, db->buffer_pool, &db->db_file);
+        }
+    } else if (db->table_count > 0 || db->index_count > 0) {
+        /* Save schema before closing (if file database) */
         save_schema(db);
     }
 
     /* Flush buffer pool */
     if (db->buffer_pool) {
         buffer_pool_flush(db->buffer_pool, &db->db_file);
+        db->buffer_pool->on_write_back = nullptr;
         buffer_pool_destroy(db->buffer_pool);
         sdb_free(db->buffer_pool);
     }
+    if (locked) {
+        db_unlock(db, SPEEDSQL_LOCK_EXCLUSIVE);
+    }
 
     /* Close WAL */
     if (db->wal) {
@@ -602,44 +937,77 @@ SPEEDSQL_API int speedsql_close(speedsql* db) {
     }
 
     /* Free schema cache */
-    if (db->tables) {
-        for (size_t i = 0; i < db->table_count; i++) {
-            sdb_free(db->tables[i].name);
-            for (uint32_t j = 0; j < db->tables[i].column_count; j++) {
-                sdb_free(db->tables[i].columns[j].name);
-                sdb_free(db->tables[i].columns[j].default_value);
-                sdb_free(db->tables[i].columns[j].collation);
-            }
-            sdb_free(db->tables[i].columns);
-            /* Free B+Tree for table data */
-            if (db->tables[i].data_tree) {
-                btree_close((btree_t*)db->tables[i].data_tree);
-                sdb_free(db->tables[i].data_tree);
-            }
-        }
-        sdb_free(db->tables);
-    }
-
-    if (db->indices) {
-        for (size_t i = 0; i < db->index_count; i++) {
-            sdb_free(db->indices[i].name);
-            sdb_free(db->indices[i].table_name);
-            sdb_free(db->indices[i].column_indices);
-        }
-        sdb_free(db->indices);
-    }
+    free_schema(db);
+    txn_roots_free(db);
+    sdb_free(db->follower_source);
 
     /* Close database file */
     file_close(&db->db_file);
 
+    /* Writers stop retaining pages for snapshots; snapshots drop theirs */
+    if (db->snapshots) {
+        snapshot_detach_all(db);
+    }
+    if (db->snapshot) {
+        snapshot_release(db);
+    }
+
     /* Destroy synchronization */
     mutex_destroy(&db->lock);
+    mutex_destroy(&db->file_lock_mutex);
     rwlock_destroy(&db->schema_lock);
 
     sdb_free(db);
     return SPEEDSQL_OK;
 }
 
+/* Write an in-memory database to a file that speedsql_open can read */
+SPEEDSQL_API int speedsql_memory_snapshot(speedsql* db, const char* filename) {
+    if (!db || !filename) return SPEEDSQL_MISUSE;
+
+    if (!db->buffer_pool || !db->buffer_pool->mem) {
+        sdb_set_error(db, SPEEDSQL_MISUSE, "Not an in-memory database");
+        return SPEEDSQL_MISUSE;
+    }
+
+    if (db->encrypted) {
+        sdb_set_error(db, SPEEDSQL_MISUSE,
+                      "Snapshot of an encrypted in-memory database is not supported");
+        return SPEEDSQL_MISUSE;
+    }
+
+    file_t out;
+    int rc = file_open(&out, filename, 1 | 2);
+    if (rc != SPEEDSQL_OK) {
+        sdb_set_error(db, SPEEDSQL_CANTOPEN, "Cannot open snapshot file: %s", filename);
+        return SPEEDSQL_CANTOPEN;
+    }
+
+    mutex_lock(&db->lock);
+
+    mem_store_t* store = db->buffer_pool->mem;
+    db->header.page_count = store->next_page;
+
+    rc = file_truncate(&out, 0);
+    if (rc == SPEEDSQL_OK) {
+        rc = mem_store_snapshot(store, &out);
+    }
+    if (rc == SPEEDSQL_OK) {
+        rc = write_schema(db, &out);
+    }
+    if (rc == SPEEDSQL_OK) {
+        rc = file_sync(&out);
+    }
+
+    mutex_unlock(&db->lock);
+    file_close(&out);
+
+    if (rc != SPEEDSQL_OK) {
+        sdb_set_error(db, rc, "Failed to write snapshot: %s", filename);
+    }
+    return rc;
+}
+
 SPEEDSQL_API const char* speedsql_errmsg(speedsql* db) {
     if (!db) return "Invalid database handle";
     return db->errmsg[0] ? db->errmsg : "No error";
@@ -662,8 +1030,17 @@ SPEEDSQL_API int speedsql_begin(speedsql* db) {
         return SPEEDSQL_MISUSE;
     }
 
+    int rc = txn_roots_save(db);
+    if (rc == SPEEDSQL_OK) rc = buffer_pool_txn_begin(db->buffer_pool);
+    if (rc != SPEEDSQL_OK) {
+        txn_roots_free(db);
+        mutex_unlock(&db->lock);
+        return rc;
+    }
+
     db->current_txn = ++db->header.txn_id;
     db->txn_state = TXN_READ;  /* Upgrade to write on first write */
+    db->buffer_pool->stamp_txn = db->current_txn;
 
     mutex_unlock(&db->lock);
     return SPEEDSQL_OK;
@@ -681,20 +1058,29 @@ SPEEDSQL_API int speedsql_commit(speedsql* db) {
 
     int rc = SPEEDSQL_OK;
 
-    /* Commit WAL if enabled */
-    if (db->wal && db->txn_state == TXN_WRITE) {
-        rc = wal_commit(db->wal, db->current_txn);
+    if (db->wal) {
+        /* Commit is the ship point: pages, schema and commit record */
+        rc = commit_to_wal(db, db->current_txn);
         if (rc != SPEEDSQL_OK) {
             mutex_unlock(&db->lock);
             return rc;
         }
-    }
 
-    /* Flush dirty pages */
-    if (db->txn_state == TXN_WRITE) {
-        rc = buffer_pool_flush(db->buffer_pool, &db->db_file);
+        /* Restart a log past its size; the commit stands either way */
+        if (wal_checkpoint_due(db->wal)) {
+            wal_checkpoint(db->wal, db->buffer_pool, &db->db_file);
+        }
+    } else if (db->txn_state == TXN_WRITE) {
+        /* Flush dirty pages */
+        rc = db_lock(db, SPEEDSQL_LOCK_EXCLUSIVE);
+        if (rc == SPEEDSQL_OK) {
+            rc = buffer_pool_flush(db->buffer_pool, &db->db_file);
+            db_unlock(db, SPEEDSQL_LOCK_EXCLUSIVE);
+        }
     }
 
+    buffer_pool_txn_end(db->buffer_pool);
+    txn_roots_free(db);
     db->txn_state = TXN_NONE;
     db->current_txn = 0;
 
@@ -712,22 +1098,29 @@ SPEEDSQL_API int speedsql_rollback(speedsql* db) {
         return SPEEDSQL_OK;
     }
 
-    /* Rollback WAL if enabled */
-    if (db->wal && db->txn_state == TXN_WRITE) {
+    /* Rollback WAL if enabled (drops images evicted during the transaction) */
+    if (db->wal) {
         wal_rollback(db->wal, db->current_txn);
     }
 
     /* Invalidate dirty pages in buffer pool */
+    int rc = SPEEDSQL_OK;
     if (db->buffer_pool) {
-        buffer_pool_invalidate_dirty(db->buffer_pool, &db->db_file);
+        rc = buffer_pool_invalidate_dirty(db->buffer_pool, &db->db_file);
+        buffer_pool_txn_end(db->buffer_pool);
     }
+    txn_roots_restore(db);
+    txn_roots_free(db);
 
     db->txn_state = TXN_NONE;
     db->current_txn = 0;
     db->savepoint_count = 0;  /* Clear all savepoints */
 
     mutex_unlock(&db->lock);
-    return SPEEDSQL_OK;
+    if (rc != SPEEDSQL_OK) {
+        sdb_set_error(db, rc, "Rollback could not restore every page");
+    }
+    return rc;
 }
 
 /* Savepoint support */
@@ -846,6 +1239,7 @@ SPEEDSQL_API int speedsql_rollback_to(speedsql* db, const char* name) {
     if (db->buffer_pool) {
         buffer_pool_invalidate_dirty(db->buffer_pool, &db->db_file);
     }
+    txn_roots_restore(db);
 
     /* Restore state */
     db->last_rowid = sp->last_rowid_saved;
@@ -6,6 +6,7 @@
 
 #include "speedsql_internal.h"
 #include <stdarg.h>
+#include <math.h>
 
 #ifdef _WIN32
 #define strcasecmp _stricmp
@@ -67,6 +68,13 @@ static int count_params_in_stmt(parsed_stmt_t* stmt) {
         }
     }
 
+    /* INSERT values */
+    for (int r = 0; r < stmt->insert_row_count; r++) {
+        for (int c = 0; stmt->insert_params && c < stmt->insert_column_count; c++) {
+            if (stmt->insert_params[r][c] > 0) count++;
+        }
+    }
+
     /* UPDATE SET expressions */
     for (int i = 0; i < stmt->update_count; i++) {
         if (stmt->update_exprs && stmt->update_exprs[i]) {
@@ -149,127 +157,326 @@ static index_def_t* find_index(speedsql* db, const char* index_name) {
     return nullptr;
 }
 
-/* Find an index for a table that covers a specific column */
-static index_def_t* find_index_for_column(speedsql* db, table_def_t* table,
-                                          const char* column_name) {
-    if (!db || !table || !column_name) return nullptr;
+/* B+tree indexes store one fixed-width key per row: a type class, the
+ * value (numbers as order-preserving doubles, text and bytes as a
+ * zero-padded prefix) and the rowid, which keeps equal values apart.
+ * Values sharing their first INDEX_KEY_VALUE bytes are told apart by the
+ * WHERE clause, which the index scan checks again on every row. */
+#define INDEX_KEY_VALUE  24
+#define INDEX_KEY_SIZE   (INDEX_KEY_VALUE + 8)
 
-    /* Find column index */
-    int col_idx = -1;
-    for (uint32_t i = 0; i < table->column_count; i++) {
-        if (table->columns[i].name &&
-            strcasecmp(table->columns[i].name, column_name) == 0) {
-            col_idx = (int)i;
+enum { KEY_NULL = 1, KEY_NUMBER, KEY_TEXT, KEY_JSON, KEY_BLOB, KEY_VECTOR };
+
+static void index_key_encode(const value_t* v, int64_t rowid, value_t* key) {
+    uint8_t buf[INDEX_KEY_SIZE] = {0};
+    const void* bytes = nullptr;
+    uint32_t len = 0;
+
+    switch (v->type) {
+        case VAL_INT:
+        case VAL_FLOAT: {
+            /* Integers compare with floats as doubles, so they key as one */
+            double d = v->type == VAL_INT ? (double)v->data.i : v->data.f;
+            if (d == 0.0) d = 0.0;
+            uint64_t u;
+            memcpy(&u, &d, sizeof(u));
+            u = (u & 0x8000000000000000ULL) ? ~u : u | 0x8000000000000000ULL;
+            buf[0] = KEY_NUMBER;
+            for (int i = 8; i >= 1; i--) {
+                buf[i] = (uint8_t)u;
+                u >>= 8;
+            }
             break;
         }
+        case VAL_TEXT:
+        case VAL_JSON:
+            buf[0] = v->type == VAL_TEXT ? KEY_TEXT : KEY_JSON;
+            bytes = v->data.text.data;
+            len = v->data.text.len;
+            break;
+        case VAL_BLOB:
+            buf[0] = KEY_BLOB;
+            bytes = v->data.blob.data;
+            len = v->data.blob.len;
+            break;
+        case VAL_VECTOR:
+            buf[0] = KEY_VECTOR;
+            bytes = v->data.vec.data;
+            len = v->data.vec.dimensions * (uint32_t)sizeof(float);
+            break;
+        default:
+            buf[0] = KEY_NULL;
+            break;
+    }
+    if (bytes) {
+        memcpy(buf + 1, bytes, len < INDEX_KEY_VALUE - 1 ? len : INDEX_KEY_VALUE - 1);
     }
 
-    if (col_idx < 0) return nullptr;
+    uint64_t r = (uint64_t)rowid ^ 0x8000000000000000ULL;
+    for (int i = INDEX_KEY_SIZE - 1; i >= INDEX_KEY_VALUE; i--) {
+        buf[i] = (uint8_t)r;
+        r >>= 8;
+    }
+    value_init_blob(key, buf, sizeof(buf));
+}
 
-    /* Find index that starts with this column */
-    for (size_t i = 0; i < db->index_count; i++) {
-        if (db->indices[i].table_name &&
-            strcasecmp(db->indices[i].table_name, table->name) == 0 &&
-            db->indices[i].column_count > 0 &&
-            db->indices[i].column_indices &&
-            (int)db->indices[i].column_indices[0] == col_idx) {
-            return &db->indices[i];
+static bool is_btree_index_on(const index_def_t* idx, const table_def_t* table) {
+    if (idx->flags & (IDX_FLAG_VECTOR | IDX_FLAG_FTS)) return false;
+    bool keyed = (idx->flags & IDX_FLAG_EXPR) ? idx->key_sql != nullptr :
+                                                idx->column_count > 0 && idx->column_indices;
+    if ((idx->flags & IDX_FLAG_PARTIAL) && !idx->where_sql) keyed = false;
+    return keyed && idx->root_page != INVALID_PAGE_ID &&
+           idx->table_name && strcmp(idx->table_name, table->name) == 0;
+}
+
+/* The tree behind a B+tree index, opened on first use */
+static btree_t* index_btree(speedsql* db, index_def_t* idx) {
+    if (!idx->index_tree && idx->root_page != INVALID_PAGE_ID) {
+        btree_t* tree = (btree_t*)sdb_calloc(1, sizeof(btree_t));
+        if (!tree) return nullptr;
+
+        if (btree_open(tree, db->buffer_pool, &db->db_file, idx->root_page,
+                       value_compare) != SPEEDSQL_OK) {
+            sdb_free(tree);
+            sdb_set_error(db, SPEEDSQL_CORRUPT, "Index '%s' cannot be opened", idx->name);
+            return nullptr;
         }
+        idx->index_tree = tree;
     }
+    return (btree_t*)idx->index_tree;
+}
 
-    return nullptr;
+/* True when every column the expression names is one of the table's */
+static bool expr_resolved(const expr_t* expr) {
+    if (!expr) return true;
+
+    switch (expr->type) {
+        case EXPR_COLUMN:
+            return expr->data.column_ref.index >= 0;
+        case EXPR_BINARY_OP:
+            return expr_resolved(expr->data.binary.left) &&
+                   expr_resolved(expr->data.binary.right);
+        case EXPR_UNARY_OP:
+            return expr_resolved(expr->data.unary.operand);
+        case EXPR_FUNCTION:
+            for (int i = 0; i < expr->data.function.arg_count; i++) {
+                if (!expr_resolved(expr->data.function.args[i])) return false;
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+/* SQL text kept with an index, parsed on first use and resolved against
+ * its table */
+static expr_t* index_expr(speedsql* db, index_def_t* idx, table_def_t* table,
+                          const char* sql, expr_t** parsed) {
+    if (!*parsed && sql) {
+        parser_t parser;
+        parser_init(&parser, db, sql);
+        expr_t* expr = parser_parse_expr(&parser);
+        resolve_column_indices(expr, table);
+        if (!expr || !expr_resolved(expr)) {
+            expr_free(expr);
+            sdb_set_error(db, SPEEDSQL_ERROR, "'%s' of index '%s' is not an expression on '%s'",
+                          sql, idx->name, table->name);
+            return nullptr;
+        }
+        *parsed = expr;
+    }
+    return *parsed;
+}
+
+static expr_t* index_key_expr(speedsql* db, index_def_t* idx, table_def_t* table) {
+    return index_expr(db, idx, table, idx->key_sql, &idx->key_expr);
 }
 
-/* Check if expression is a simple column = value comparison */
-static bool is_equality_condition(expr_t* expr, const char** out_column, value_t** out_value) {
-    if (!expr || expr->type != EXPR_BINARY_OP) return false;
-    if (expr->data.binary.op != TOK_EQ) return false;
+/* The predicate of a partial index */
+static expr_t* index_where_expr(speedsql* db, index_def_t* idx, table_def_t* table) {
+    return index_expr(db, idx, table, idx->where_sql, &idx->where_expr);
+}
 
-    expr_t* left = expr->data.binary.left;
-    expr_t* right = expr->data.binary.right;
+/* Structural equality, for matching a WHERE term to an index key */
+static bool expr_equal(const expr_t* a, const expr_t* b) {
+    if (!a || !b) return a == b;
+    if (a->type != b->type) return false;
 
-    /* Check for column = literal or literal = column */
-    if (left && left->type == EXPR_COLUMN &&
-        right && right->type == EXPR_LITERAL) {
-        *out_column = left->data.column_ref.column;
-        *out_value = &right->data.literal;
-        return true;
+    switch (a->type) {
+        case EXPR_LITERAL:
+            return a->data.literal.type == b->data.literal.type &&
+                   value_compare(&a->data.literal, &b->data.literal) == 0;
+        case EXPR_COLUMN:
+            return a->data.column_ref.index >= 0 &&
+                   a->data.column_ref.index == b->data.column_ref.index;
+        case EXPR_BINARY_OP:
+            if (a->data.binary.op != b->data.binary.op) return false;
+            if (expr_equal(a->data.binary.left, b->data.binary.left) &&
+                expr_equal(a->data.binary.right, b->data.binary.right)) {
+                return true;
+            }
+            /* x = y is y = x */
+            return (a->data.binary.op == TOK_EQ || a->data.binary.op == TOK_NE) &&
+                   expr_equal(a->data.binary.left, b->data.binary.right) &&
+                   expr_equal(a->data.binary.right, b->data.binary.left);
+        case EXPR_UNARY_OP:
+            return a->data.unary.op == b->data.unary.op &&
+                   expr_equal(a->data.unary.operand, b->data.unary.operand);
+        case EXPR_FUNCTION:
+            if (!a->data.function.name || !b->data.function.name ||
+                strcasecmp(a->data.function.name, b->data.function.name) != 0 ||
+                a->data.function.arg_count != b->data.function.arg_count) {
+                return false;
+            }
+            for (int i = 0; i < a->data.function.arg_count; i++) {
+                if (!expr_equal(a->data.function.args[i], b->data.function.args[i])) return false;
+            }
+            return true;
+        default:
+            return false;
     }
+}
 
-    if (left && left->type == EXPR_LITERAL &&
-        right && right->type == EXPR_COLUMN) {
-        *out_column = right->data.column_ref.column;
-        *out_value = &left->data.literal;
-        return true;
+/* True when term is one of the AND-ed conjuncts of where */
+static bool where_has_conjunct(const expr_t* where, const expr_t* term) {
+    if (!where) return false;
+    if (where->type == EXPR_BINARY_OP && where->data.binary.op == TOK_AND) {
+        return where_has_conjunct(where->data.binary.left, term) ||
+               where_has_conjunct(where->data.binary.right, term);
     }
+    return expr_equal(where, term);
+}
 
-    return false;
+/* True when every row where holds for also satisfies the predicate of a
+ * partial index: each of its conjuncts is one of where's */
+static bool where_implies(const expr_t* where, const expr_t* pred) {
+    if (!pred) return false;
+    if (pred->type == EXPR_BINARY_OP && pred->data.binary.op == TOK_AND) {
+        return where_implies(where, pred->data.binary.left) &&
+               where_implies(where, pred->data.binary.right);
+    }
+    return where_has_conjunct(where, pred);
 }
 
-/* Try to build an index scan plan from WHERE clause */
-static plan_node_t* try_build_index_scan(speedsql* db, table_def_t* table,
-                                         expr_t* where, expr_t** remaining_where) {
-    if (!db || !table || !where) return nullptr;
+/* An index that holds every row the query may return */
+static bool index_covers_where(speedsql* db, index_def_t* idx, table_def_t* table,
+                               const expr_t* where) {
+    return !(idx->flags & IDX_FLAG_PARTIAL) ||
+           where_implies(where, index_where_expr(db, idx, table));
+}
 
-    *remaining_where = where;  /* Default: keep all WHERE conditions */
+/* A B+tree index on the table keyed on term: a column index for a
+ * column, an expression index for the same expression */
+static index_def_t* find_index_for_term(speedsql* db, table_def_t* table, const expr_t* term,
+                                        const expr_t* where) {
+    for (size_t i = 0; i < db->index_count; i++) {
+        index_def_t* idx = &db->indices[i];
+        if (!is_btree_index_on(idx, table) || !index_covers_where(db, idx, table, where)) {
+            continue;
+        }
 
-    const char* column_name = nullptr;
-    value_t* search_value = nullptr;
+        if (idx->flags & IDX_FLAG_EXPR) {
+            if (expr_equal(index_key_expr(db, idx, table), term)) return idx;
+        } else if (term->type == EXPR_COLUMN &&
+                   (int)idx->column_indices[0] == term->data.column_ref.index) {
+            return idx;
+        }
+    }
+    return nullptr;
+}
 
-    /* Check if WHERE is a simple equality condition */
-    if (is_equality_condition(where, &column_name, &search_value)) {
-        /* Look for an index on this column */
-        index_def_t* index = find_index_for_column(db, table, column_name);
-        if (index && index->root_page != INVALID_PAGE_ID) {
-            /* Open index B+tree if not already open */
-            if (!index->index_tree) {
-                btree_t* idx_tree = (btree_t*)sdb_calloc(1, sizeof(btree_t));
-                if (!idx_tree) return nullptr;
+static int eval_expr(speedsql_stmt* stmt, expr_t* expr, value_t* result);
 
-                int rc = btree_open(idx_tree, db->buffer_pool, &db->db_file,
-                                    index->root_page, value_compare);
-                if (rc != SPEEDSQL_OK) {
-                    sdb_free(idx_tree);
-                    return nullptr;
-                }
-                index->index_tree = idx_tree;
-            }
+static plan_node_t* index_scan_plan(index_def_t* index, table_def_t* table, btree_t* tree,
+                                    const value_t* search) {
+    plan_node_t* plan = (plan_node_t*)sdb_calloc(1, sizeof(plan_node_t));
+    if (!plan) return nullptr;
 
-            /* Found usable index! Create index scan plan */
-            plan_node_t* plan = (plan_node_t*)sdb_calloc(1, sizeof(plan_node_t));
-            if (!plan) return nullptr;
+    plan->type = PLAN_INDEX_SCAN;
+    plan->data.index_scan.index = index;
+    plan->data.index_scan.table = table;
+    btree_cursor_init(&plan->data.index_scan.cursor, tree);
+    if (!search) {
+        btree_cursor_first(&plan->data.index_scan.cursor);
+        return plan;
+    }
 
-            plan->type = PLAN_INDEX_SCAN;
-            plan->data.index_scan.index = index;
-            plan->data.index_scan.table = table;
+    /* Every key of the value, whatever its rowid */
+    value_t* start_key = (value_t*)sdb_malloc(sizeof(value_t));
+    value_t* end_key = (value_t*)sdb_malloc(sizeof(value_t));
+    if (!start_key || !end_key) {
+        sdb_free(start_key);
+        sdb_free(end_key);
+        sdb_free(plan);
+        return nullptr;
+    }
+    index_key_encode(search, INT64_MIN, start_key);
+    index_key_encode(search, INT64_MAX, end_key);
+    plan->data.index_scan.start_key = start_key;
+    plan->data.index_scan.end_key = end_key;
 
-            /* Copy search key */
-            plan->data.index_scan.start_key = (value_t*)sdb_malloc(sizeof(value_t));
-            plan->data.index_scan.end_key = (value_t*)sdb_malloc(sizeof(value_t));
-            if (plan->data.index_scan.start_key) {
-                value_init_null(plan->data.index_scan.start_key);
-                value_copy(plan->data.index_scan.start_key, search_value);
-            }
-            if (plan->data.index_scan.end_key) {
-                value_init_null(plan->data.index_scan.end_key);
-                value_copy(plan->data.index_scan.end_key, search_value);
-            }
+    btree_cursor_seek(&plan->data.index_scan.cursor, start_key);
+    return plan;
+}
+
+/* An index lookup for the first conjunct of term of the form
+ * key = literal or key = ?, where key is an indexed column or the
+ * expression of an expression index */
+static plan_node_t* try_index_lookup(speedsql_stmt* stmt, table_def_t* table, expr_t* term,
+                                     const expr_t* where) {
+    if (!term || term->type != EXPR_BINARY_OP) return nullptr;
 
-            /* Initialize cursor and seek to the search key */
-            btree_cursor_init(&plan->data.index_scan.cursor,
-                              (btree_t*)index->index_tree);
-            btree_cursor_seek(&plan->data.index_scan.cursor,
-                              plan->data.index_scan.start_key);
+    if (term->data.binary.op == TOK_AND) {
+        plan_node_t* plan = try_index_lookup(stmt, table, term->data.binary.left, where);
+        return plan ? plan : try_index_lookup(stmt, table, term->data.binary.right, where);
+    }
+    if (term->data.binary.op != TOK_EQ) return nullptr;
+
+    for (int side = 0; side < 2; side++) {
+        expr_t* key = side ? term->data.binary.right : term->data.binary.left;
+        expr_t* other = side ? term->data.binary.left : term->data.binary.right;
+        if (!key || !other ||
+            (other->type != EXPR_LITERAL && other->type != EXPR_PARAMETER)) {
+            continue;
+        }
 
-            /* Index handles this condition, so no remaining WHERE for this part */
-            *remaining_where = nullptr;
+        index_def_t* index = find_index_for_term(stmt->db, table, key, where);
+        btree_t* tree = index ? index_btree(stmt->db, index) : nullptr;
+        if (!tree) continue;
 
-            return plan;
+        /* key = NULL holds for no row; the table scan finds none */
+        value_t search;
+        value_init_null(&search);
+        plan_node_t* plan = nullptr;
+        if (eval_expr(stmt, other, &search) == SPEEDSQL_OK && search.type != VAL_NULL) {
+            plan = index_scan_plan(index, table, tree, &search);
         }
+        value_free(&search);
+        return plan;
     }
 
-    /* TODO: Handle AND conditions - extract indexable part */
-    /* For now, just return nullptr to fall back to table scan */
+    return nullptr;
+}
+
+/* An index scan for WHERE: a lookup on an equality conjunct, or else
+ * all of a partial index whose predicate WHERE implies. Either yields a
+ * superset of the matching rows and the full WHERE is applied to each. */
+static plan_node_t* try_build_index_scan(speedsql_stmt* stmt, table_def_t* table, expr_t* where) {
+    if (!where) return nullptr;
+
+    plan_node_t* plan = try_index_lookup(stmt, table, where, where);
+    if (plan) return plan;
+
+    speedsql* db = stmt->db;
+    for (size_t i = 0; i < db->index_count; i++) {
+        index_def_t* idx = &db->indices[i];
+        if (!(idx->flags & IDX_FLAG_PARTIAL) || !is_btree_index_on(idx, table) ||
+            !index_covers_where(db, idx, table, where)) {
+            continue;
+        }
+        btree_t* tree = index_btree(db, idx);
+        if (tree) return index_scan_plan(idx, table, tree, nullptr);
+    }
     return nullptr;
 }
 
@@ -315,6 +522,14 @@ void plan_free(plan_node_t* plan) {
  * Statement Management
  * ============================================================================ */
 
+/* Drop the text rendered for the current row's JSON columns */
+static void stmt_json_clear(speedsql_stmt* stmt) {
+    for (int i = 0; i < stmt->json_text_count; i++) {
+        sdb_free(stmt->json_text[i]);
+        stmt->json_text[i] = nullptr;
+    }
+}
+
 static speedsql_stmt* stmt_alloc(speedsql* db) {
     speedsql_stmt* stmt = (speedsql_stmt*)sdb_calloc(1, sizeof(speedsql_stmt));
     if (!stmt) return nullptr;
@@ -371,6 +586,9 @@ static void stmt_free_internal(speedsql_stmt* stmt) {
         sdb_free(stmt->column_names);
     }
 
+    stmt_json_clear(stmt);
+    sdb_free(stmt->json_text);
+
     sdb_free(stmt);
 }
 
@@ -378,6 +596,122 @@ static void stmt_free_internal(speedsql_stmt* stmt) {
  * Expression Evaluation
  * ============================================================================ */
 
+static speedsql_tokenizer* match_tokenizer(speedsql_stmt* stmt, const expr_t* column);
+
+/* json_extract(doc, path): the value at path as a SQL value, NULL when
+ * there is none or doc is not JSON. JSON columns are navigated in their
+ * binary form; JSON text is indexed and only the value found is parsed */
+static int eval_json_extract(speedsql_stmt* stmt, expr_t* expr, value_t* result) {
+    expr_t** args = expr->data.function.args;
+    value_t doc, path;
+    value_init_null(&doc);
+    value_init_null(&path);
+    value_init_null(result);
+
+    int rc = eval_expr(stmt, args[0], &doc);
+    if (rc == SPEEDSQL_OK) rc = eval_expr(stmt, args[1], &path);
+
+    int found = SPEEDSQL_NOTFOUND;
+    if (rc == SPEEDSQL_OK && path.type == VAL_TEXT && path.data.text.data) {
+        jsonb_t root, at;
+        if (doc.type == VAL_JSON) {
+            if (jsonb_root((const uint8_t*)doc.data.text.data, doc.data.text.len, &root)) {
+                found = jsonb_path(&root, path.data.text.data, &at);
+                if (found == SPEEDSQL_OK) rc = jsonb_to_value(&at, result);
+            }
+        } else if (doc.type == VAL_TEXT) {
+            uint8_t* sub;
+            uint32_t sub_len;
+            found = json_extract_text(doc.data.text.data, doc.data.text.len,
+                                      path.data.text.data, &sub, &sub_len);
+            if (found == SPEEDSQL_OK) {
+                jsonb_root(sub, sub_len, &root);
+                rc = jsonb_to_value(&root, result);
+                sdb_free(sub);
+            } else if (found == SPEEDSQL_NOMEM) {
+                rc = found;
+            }
+        }
+    }
+    if (found == SPEEDSQL_ERROR) {
+        sdb_set_error(stmt->db, SPEEDSQL_ERROR, "Malformed JSON path '%s'", path.data.text.data);
+        rc = SPEEDSQL_ERROR;
+    }
+
+    value_free(&doc);
+    value_free(&path);
+    return rc;
+}
+
+/* lower(x) and upper(x): text with ASCII letters folded; other values
+ * pass through */
+static int eval_case_fold(speedsql_stmt* stmt, expr_t* expr, bool upper, value_t* result) {
+    int rc = eval_expr(stmt, expr->data.function.args[0], result);
+    if (rc != SPEEDSQL_OK || result->type != VAL_TEXT || !result->data.text.data) return rc;
+
+    char* text = result->data.text.data;
+    for (uint32_t i = 0; i < result->data.text.len; i++) {
+        if (upper && text[i] >= 'a' && text[i] <= 'z') {
+            text[i] = (char)(text[i] - 'a' + 'A');
+        } else if (!upper && text[i] >= 'A' && text[i] <= 'Z') {
+            text[i] = (char)(text[i] - 'A' + 'a');
+        }
+    }
+    return SPEEDSQL_OK;
+}
+
+/* Scalar functions; aggregates are computed by the SELECT executor */
+static int eval_function(speedsql_stmt* stmt, expr_t* expr, value_t* result) {
+    const char* name = expr->data.function.name;
+    expr_t** args = expr->data.function.args;
+
+    if (name && strcasecmp(name, "json_extract") == 0 && expr->data.function.arg_count == 2) {
+        return eval_json_extract(stmt, expr, result);
+    }
+    if (name && expr->data.function.arg_count == 1 && args[0] &&
+        (strcasecmp(name, "lower") == 0 || strcasecmp(name, "upper") == 0)) {
+        return eval_case_fold(stmt, expr, strcasecmp(name, "upper") == 0, result);
+    }
+
+    /* vec_l2, vec_dot, vec_cosine (and vec_distance, an alias of vec_l2):
+     * NULL unless both arguments are vectors of the same dimension */
+    vector_metric_t metric;
+    if (!name || expr->data.function.arg_count != 2) {
+        value_init_null(result);
+        return SPEEDSQL_OK;
+    }
+    if (strcasecmp(name, "vec_l2") == 0 || strcasecmp(name, "vec_distance") == 0) {
+        metric = VECTOR_L2;
+    } else if (strcasecmp(name, "vec_dot") == 0) {
+        metric = VECTOR_DOT;
+    } else if (strcasecmp(name, "vec_cosine") == 0) {
+        metric = VECTOR_COSINE;
+    } else {
+        value_init_null(result);
+        return SPEEDSQL_OK;
+    }
+
+    value_t a, b;
+    value_init_null(&a);
+    value_init_null(&b);
+
+    int rc = eval_expr(stmt, args[0], &a);
+    if (rc == SPEEDSQL_OK) rc = eval_expr(stmt, args[1], &b);
+
+    if (rc == SPEEDSQL_OK && a.type == VAL_VECTOR && b.type == VAL_VECTOR &&
+        a.data.vec.data && b.data.vec.data &&
+        a.data.vec.dimensions == b.data.vec.dimensions) {
+        value_init_float(result, vector_distance(metric, a.data.vec.data, b.data.vec.data,
+                                                 a.data.vec.dimensions));
+    } else {
+        value_init_null(result);
+    }
+
+    value_free(&a);
+    value_free(&b);
+    return rc;
+}
+
 static int eval_expr(speedsql_stmt* stmt, expr_t* expr, value_t* result) {
     if (!expr || !result) return SPEEDSQL_MISUSE;
 
@@ -510,6 +844,18 @@ static int eval_expr(speedsql_stmt* stmt, expr_t* expr, value_t* result) {
                         (left.data.i != 0 || right.data.i != 0) ? 1 : 0);
                     break;
 
+                case TOK_MATCH: {
+                    /* Full-text query against the text itself */
+                    bool matched = false;
+                    if (left.type == VAL_TEXT && right.type == VAL_TEXT && right.data.text.data) {
+                        rc = fts_match_text(match_tokenizer(stmt, expr->data.binary.left),
+                                            left.data.text.data, left.data.text.len,
+                                            right.data.text.data, &matched);
+                    }
+                    value_init_int(result, matched ? 1 : 0);
+                    break;
+                }
+
                 default:
                     value_init_null(result);
                     break;
@@ -517,7 +863,7 @@ static int eval_expr(speedsql_stmt* stmt, expr_t* expr, value_t* result) {
 
             value_free(&left);
             value_free(&right);
-            return SPEEDSQL_OK;
+            return rc;
         }
 
         case EXPR_UNARY_OP: {
@@ -555,6 +901,9 @@ static int eval_expr(speedsql_stmt* stmt, expr_t* expr, value_t* result) {
             return SPEEDSQL_OK;
         }
 
+        case EXPR_FUNCTION:
+            return eval_function(stmt, expr, result);
+
         default:
             value_init_null(result);
             return SPEEDSQL_OK;
@@ -618,87 +967,1120 @@ static int create_table(speedsql* db, table_def_t* def) {
             sdb_strdup(def->columns[i].collation) : nullptr;
     }
 
-    /* Create B+Tree for table data */
-    tbl->data_tree = (struct btree*)sdb_malloc(sizeof(btree_t));
-    if (!tbl->data_tree) return SPEEDSQL_NOMEM;
-
-    int rc = btree_create((btree_t*)tbl->data_tree, db->buffer_pool, &db->db_file, value_compare);
+    /* Create B+Tree for table data */
+    tbl->data_tree = (struct btree*)sdb_malloc(sizeof(btree_t));
+    if (!tbl->data_tree) return SPEEDSQL_NOMEM;
+
+    int rc = btree_create((btree_t*)tbl->data_tree, db->buffer_pool, &db->db_file, value_compare);
+    if (rc != SPEEDSQL_OK) {
+        sdb_free(tbl->data_tree);
+        tbl->data_tree = nullptr;
+        return rc;
+    }
+
+    tbl->root_page = ((btree_t*)tbl->data_tree)->root_page;
+    db->table_count++;
+
+    return SPEEDSQL_OK;
+}
+
+/* ============================================================================
+ * Row Records
+ * ============================================================================ */
+
+/* A table row is stored as its column count, its values, and then the bytes
+ * of every text, JSON, blob and vector value. A stored value holds the offset
+ * of its bytes in place of a pointer, so the record reads the same in any
+ * process; row_record_values turns the offsets back into pointers.
+ *
+ * A record over ROW_RECORD_MAX bytes is written to a chain of overflow
+ * pages, linked through right_ptr, and the tree keeps a stub naming the
+ * chain. row_record_values reads the chain back in place of the stub. */
+#define ROW_RECORD_MAX (SPEEDSQL_PAGE_SIZE / 4)
+#define ROW_RECORD_LIMIT ((size_t)INT32_MAX)
+#define ROW_RECORD_SPILLED (-1)
+#define OVERFLOW_PAGE_DATA ((uint32_t)((sizeof(page_header_t) + 7) & ~(size_t)7))
+
+typedef struct {
+    int col_count;               /* ROW_RECORD_SPILLED */
+    uint32_t size;               /* Bytes of the whole record */
+    page_id_t first_page;        /* First page of its chain */
+} row_spill_t;
+
+/* Bytes a value keeps after the value array (text and JSON with a NUL) */
+static size_t row_payload_size(const value_t* v) {
+    switch (v->type) {
+        case VAL_TEXT:
+        case VAL_JSON:
+            return (size_t)v->data.text.len + 1;
+        case VAL_BLOB:
+            return v->data.blob.len;
+        case VAL_VECTOR:
+            return (size_t)v->data.vec.dimensions * sizeof(float);
+        default:
+            return 0;
+    }
+}
+
+static const void* row_payload(const value_t* v) {
+    switch (v->type) {
+        case VAL_TEXT:
+        case VAL_JSON:
+            return v->data.text.data;
+        case VAL_BLOB:
+            return v->data.blob.data;
+        case VAL_VECTOR:
+            return v->data.vec.data;
+        default:
+            return nullptr;
+    }
+}
+
+static void row_set_payload(value_t* v, uint8_t* at) {
+    switch (v->type) {
+        case VAL_TEXT:
+        case VAL_JSON:
+            v->data.text.data = (char*)at;
+            break;
+        case VAL_BLOB:
+            v->data.blob.data = at;
+            break;
+        case VAL_VECTOR:
+            v->data.vec.data = (float*)at;
+            break;
+        default:
+            break;
+    }
+}
+
+/* Write a record front to back over a chain of overflow pages. The pages
+ * of reuse, the chain of the record being replaced, are written over
+ * first; pages past its end are new. */
+static int overflow_write(speedsql* db, const uint8_t* src, size_t left, page_id_t reuse,
+                          page_id_t* first) {
+    buffer_pool_t* pool = db->buffer_pool;
+    size_t per_page = pool->usable_size - OVERFLOW_PAGE_DATA;
+    buffer_page_t* prev = nullptr;
+    *first = INVALID_PAGE_ID;
+
+    while (left > 0) {
+        page_id_t page_id = reuse;
+        buffer_page_t* page = nullptr;
+        if (reuse != INVALID_PAGE_ID) {
+            page = buffer_pool_get(pool, &db->db_file, reuse);
+            if (page && ((page_header_t*)page->data)->page_type == PAGE_TYPE_OVERFLOW) {
+                reuse = ((page_header_t*)page->data)->right_ptr;
+            } else {
+                if (page) buffer_pool_unpin(pool, page, false);
+                page = nullptr;
+                reuse = INVALID_PAGE_ID;
+            }
+        }
+        if (!page) {
+            page = buffer_pool_new_page(pool, &db->db_file, &page_id);
+        }
+        if (!page) {
+            if (prev) buffer_pool_unpin(pool, prev, true);
+            return SPEEDSQL_NOMEM;
+        }
+
+        size_t n = left < per_page ? left : per_page;
+        memset(page->data, 0, pool->usable_size);
+        page_header_t* hdr = (page_header_t*)page->data;
+        hdr->page_type = PAGE_TYPE_OVERFLOW;
+        hdr->free_start = (uint32_t)(OVERFLOW_PAGE_DATA + n);
+        hdr->free_end = (uint32_t)pool->usable_size;
+        hdr->right_ptr = INVALID_PAGE_ID;
+        memcpy(page->data + OVERFLOW_PAGE_DATA, src, n);
+
+        if (prev) {
+            ((page_header_t*)prev->data)->right_ptr = page_id;
+            buffer_pool_unpin(pool, prev, true);
+        } else {
+            *first = page_id;
+        }
+        prev = page;
+        src += n;
+        left -= n;
+    }
+
+    if (prev) buffer_pool_unpin(pool, prev, true);
+    return SPEEDSQL_OK;
+}
+
+static int overflow_read(speedsql* db, page_id_t page_id, uint8_t* dst, size_t left) {
+    buffer_pool_t* pool = db->buffer_pool;
+
+    while (left > 0) {
+        if (page_id == INVALID_PAGE_ID) return SPEEDSQL_CORRUPT;
+        buffer_page_t* page = buffer_pool_get(pool, &db->db_file, page_id);
+        if (!page) return SPEEDSQL_IOERR;
+
+        page_header_t* hdr = (page_header_t*)page->data;
+        size_t n = hdr->free_start > OVERFLOW_PAGE_DATA ? hdr->free_start - OVERFLOW_PAGE_DATA : 0;
+        if (hdr->page_type != PAGE_TYPE_OVERFLOW || n == 0 || n > left ||
+            hdr->free_start > pool->usable_size) {
+            buffer_pool_unpin(pool, page, false);
+            return SPEEDSQL_CORRUPT;
+        }
+        memcpy(dst, page->data + OVERFLOW_PAGE_DATA, n);
+        page_id = hdr->right_ptr;
+        buffer_pool_unpin(pool, page, false);
+        dst += n;
+        left -= n;
+    }
+    return SPEEDSQL_OK;
+}
+
+/* First overflow page of a stored record, if it was spilled */
+static page_id_t row_record_chain(const value_t* record) {
+    if (record->type != VAL_BLOB || !record->data.blob.data ||
+        record->data.blob.len < sizeof(row_spill_t) ||
+        *(const int*)record->data.blob.data != ROW_RECORD_SPILLED) {
+        return INVALID_PAGE_ID;
+    }
+    row_spill_t spill;
+    memcpy(&spill, record->data.blob.data, sizeof(spill));
+    return spill.first_page;
+}
+
+/* Record size of a row, refusing rows whose values cannot be addressed */
+static int row_record_size(speedsql* db, const table_def_t* table, const value_t* vals,
+                           size_t* size_out) {
+    size_t size = sizeof(int) + table->column_count * sizeof(value_t);
+    for (uint32_t i = 0; i < table->column_count; i++) {
+        if (row_payload(&vals[i])) size = ((size + 7) & ~(size_t)7) + row_payload_size(&vals[i]);
+    }
+    if (size > ROW_RECORD_LIMIT) {
+        sdb_set_error(db, SPEEDSQL_RANGE, "Row too large for table '%s'", table->name);
+        return SPEEDSQL_RANGE;
+    }
+    *size_out = size;
+    return SPEEDSQL_OK;
+}
+
+/* Pack a row into a record blob, spilling a large one to overflow pages
+ * (over reuse, when it replaces a spilled record); the row keeps
+ * ownership of its values */
+static int row_record_pack(speedsql* db, const table_def_t* table, const value_t* vals,
+                           page_id_t reuse, value_t* record) {
+    uint32_t count = table->column_count;
+    size_t size;
+    int rc = row_record_size(db, table, vals, &size);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    uint8_t* data = (uint8_t*)sdb_calloc(1, size);
+    if (!data) return SPEEDSQL_NOMEM;
+    *(int*)data = (int)count;
+    value_t* out = (value_t*)(data + sizeof(int));
+    memcpy(out, vals, count * sizeof(value_t));
+
+    size_t pos = sizeof(int) + count * sizeof(value_t);
+    for (uint32_t i = 0; i < count; i++) {
+        const void* bytes = row_payload(&vals[i]);
+        if (!bytes) continue;
+        pos = (pos + 7) & ~(size_t)7;
+        size_t n = row_payload_size(&vals[i]);
+        bool terminated = vals[i].type == VAL_TEXT || vals[i].type == VAL_JSON;
+        memcpy(data + pos, bytes, terminated ? n - 1 : n);
+        row_set_payload(&out[i], (uint8_t*)(uintptr_t)pos);
+        pos += n;
+    }
+
+    if (size > ROW_RECORD_MAX) {
+        row_spill_t spill;
+        memset(&spill, 0, sizeof(spill));
+        spill.col_count = ROW_RECORD_SPILLED;
+        spill.size = (uint32_t)size;
+        rc = overflow_write(db, data, size, reuse, &spill.first_page);
+        sdb_free(data);
+        if (rc != SPEEDSQL_OK) return rc;
+
+        data = (uint8_t*)sdb_malloc(sizeof(spill));
+        if (!data) return SPEEDSQL_NOMEM;
+        memcpy(data, &spill, sizeof(spill));
+        size = sizeof(spill);
+    }
+
+    memset(record, 0, sizeof(*record));
+    record->type = VAL_BLOB;
+    record->size = (uint32_t)size;
+    record->data.blob.data = data;
+    record->data.blob.len = (uint32_t)size;
+    return SPEEDSQL_OK;
+}
+
+/* Point a record's values at their bytes within it, first reading a
+ * spilled record back from its chain. Call once per record read from
+ * the tree; the values live as long as the record does. */
+static value_t* row_record_values(speedsql* db, value_t* record) {
+    uint8_t* data = record->data.blob.data;
+    size_t size = record->data.blob.len;
+
+    if (row_record_chain(record) != INVALID_PAGE_ID) {
+        row_spill_t spill;
+        memcpy(&spill, data, sizeof(spill));
+        uint8_t* full = spill.size >= sizeof(int) ? (uint8_t*)sdb_malloc(spill.size) : nullptr;
+        if (!full || overflow_read(db, spill.first_page, full, spill.size) != SPEEDSQL_OK) {
+            sdb_free(full);
+            sdb_set_error(db, SPEEDSQL_CORRUPT, "Overflow pages of a row cannot be read");
+            *(int*)data = 0;
+            return (value_t*)(data + sizeof(int));
+        }
+        sdb_free(data);
+        record->data.blob.data = full;
+        record->data.blob.len = spill.size;
+        record->size = spill.size;
+        data = full;
+        size = spill.size;
+    }
+
+    int count = *(int*)data;
+    if (count < 0 || sizeof(int) + (size_t)count * sizeof(value_t) > size) {
+        *(int*)data = 0;
+        return (value_t*)(data + sizeof(int));
+    }
+
+    value_t* vals = (value_t*)(data + sizeof(int));
+    for (int i = 0; i < count; i++) {
+        size_t off = (size_t)(uintptr_t)row_payload(&vals[i]);
+        if (!off) continue;
+        if (off > size || row_payload_size(&vals[i]) > size - off) {
+            value_init_null(&vals[i]);
+            continue;
+        }
+        row_set_payload(&vals[i], data + off);
+    }
+    return vals;
+}
+
+/* ============================================================================
+ * Vector Index Maintenance
+ * ============================================================================ */
+
+static bool is_vector_index_on(const index_def_t* idx, const table_def_t* table) {
+    return (idx->flags & IDX_FLAG_VECTOR) && idx->column_count == 1 && idx->column_indices &&
+           idx->table_name && strcmp(idx->table_name, table->name) == 0;
+}
+
+/* The graph behind an HNSW index, opened on first use */
+static hnsw_t* index_hnsw(speedsql* db, index_def_t* idx) {
+    if (!idx->hnsw && idx->root_page != INVALID_PAGE_ID) {
+        if (hnsw_open(&idx->hnsw, db->buffer_pool, &db->db_file, idx->root_page) != SPEEDSQL_OK) {
+            idx->hnsw = nullptr;
+            sdb_set_error(db, SPEEDSQL_CORRUPT, "Vector index '%s' cannot be opened", idx->name);
+        }
+    }
+    return idx->hnsw;
+}
+
+/* The lists behind an IVF index, opened on first use */
+static ivf_t* index_ivf(speedsql* db, index_def_t* idx) {
+    if (!idx->ivf && idx->root_page != INVALID_PAGE_ID) {
+        if (ivf_open(&idx->ivf, db->buffer_pool, &db->db_file, idx->root_page) != SPEEDSQL_OK) {
+            idx->ivf = nullptr;
+            sdb_set_error(db, SPEEDSQL_CORRUPT, "Vector index '%s' cannot be opened", idx->name);
+        }
+    }
+    return idx->ivf;
+}
+
+/* Open the index of either kind; false when it cannot be read */
+static bool vector_index_ready(speedsql* db, index_def_t* idx) {
+    return (idx->flags & IDX_FLAG_IVF) ? index_ivf(db, idx) != nullptr :
+                                         index_hnsw(db, idx) != nullptr;
+}
+
+static uint64_t vector_index_count(speedsql* db, index_def_t* idx) {
+    return (idx->flags & IDX_FLAG_IVF) ? ivf_count(index_ivf(db, idx)) :
+                                         hnsw_count(index_hnsw(db, idx));
+}
+
+/* Index one stored row. A row whose column holds no vector (NULL, or
+ * cleared by UPDATE) leaves the index. */
+static int vector_index_put(speedsql* db, index_def_t* idx, int64_t rowid,
+                            const value_t* row, int col_count) {
+    if (!vector_index_ready(db, idx)) return SPEEDSQL_CORRUPT;
+
+    uint32_t col = idx->column_indices[0];
+    const value_t* v = col < (uint32_t)col_count ? &row[col] : nullptr;
+    bool ivf = (idx->flags & IDX_FLAG_IVF) != 0;
+    int rc;
+    if (v && v->type == VAL_VECTOR && v->data.vec.data) {
+        rc = ivf ? ivf_insert(idx->ivf, rowid, v->data.vec.data, v->data.vec.dimensions) :
+                   hnsw_insert(idx->hnsw, rowid, v->data.vec.data, v->data.vec.dimensions);
+    } else {
+        rc = ivf ? ivf_delete(idx->ivf, rowid) : hnsw_delete(idx->hnsw, rowid);
+        if (rc == SPEEDSQL_NOTFOUND) rc = SPEEDSQL_OK;
+    }
+
+    if (rc == SPEEDSQL_MISMATCH) {
+        sdb_set_error(db, rc, "Vector dimensions do not match index '%s'", idx->name);
+    } else if (rc == SPEEDSQL_RANGE) {
+        sdb_set_error(db, rc, "Vectors too large for index '%s'", idx->name);
+    }
+    return rc;
+}
+
+/* Index one stored row in every vector index on its table */
+static int vector_index_row(speedsql* db, table_def_t* table, int64_t rowid,
+                            const value_t* row, int col_count) {
+    for (size_t i = 0; i < db->index_count; i++) {
+        if (!is_vector_index_on(&db->indices[i], table)) continue;
+
+        int rc = vector_index_put(db, &db->indices[i], rowid, row, col_count);
+        if (rc != SPEEDSQL_OK) return rc;
+    }
+    return SPEEDSQL_OK;
+}
+
+/* The stored vector in col of the row at rowid, copied into out */
+static bool vector_row_lookup(speedsql* db, table_def_t* table, uint32_t col, int64_t rowid,
+                              float* out, uint32_t dims) {
+    value_t key, value;
+    btree_int_key(&key, rowid);
+    value_init_null(&value);
+
+    bool found = false;
+    if (btree_find((btree_t*)table->data_tree, &key, &value) == SPEEDSQL_OK &&
+        value.type == VAL_BLOB && value.data.blob.data) {
+        const value_t* row = row_record_values(db, &value);
+        int col_count = *(int*)value.data.blob.data;
+        const value_t* v = (int)col < col_count ? &row[col] : nullptr;
+        if (v && v->type == VAL_VECTOR && v->data.vec.data && v->data.vec.dimensions == dims) {
+            memcpy(out, v->data.vec.data, dims * sizeof(float));
+            found = true;
+        }
+    }
+
+    value_free(&key);
+    value_free(&value);
+    return found;
+}
+
+/* Up to k nearest rows through the index, nearest first. IVF distances
+ * are exact. A quantized HNSW index only estimates them, so it is asked
+ * for rerank times as many candidates and those are re-ranked against
+ * the rows' vectors. */
+static int vector_index_search(speedsql* db, table_def_t* table, index_def_t* idx,
+                               const float* query, uint32_t dims, uint32_t k,
+                               int64_t* rowids, float* distances, uint32_t* found) {
+    if (idx->flags & IDX_FLAG_IVF) {
+        ivf_t* f = index_ivf(db, idx);
+        if (!f) return SPEEDSQL_CORRUPT;
+        return ivf_search(f, query, dims, k, 0, rowids, distances, found);
+    }
+
+    hnsw_t* h = index_hnsw(db, idx);
+    if (!h) return SPEEDSQL_CORRUPT;
+
+    *found = 0;
+    if (k == 0) return SPEEDSQL_OK;
+
+    uint32_t rerank = hnsw_rerank(h);
+    uint64_t wide = (uint64_t)k * rerank;
+    if (rerank == 0 || !table->data_tree) {
+        return hnsw_search(h, query, dims, k, 0, rowids, distances, found);
+    }
+    if (wide > UINT32_MAX) wide = UINT32_MAX;
+
+    int64_t* cand = (int64_t*)sdb_malloc(wide * sizeof(int64_t));
+    float* cand_dist = (float*)sdb_malloc(wide * sizeof(float));
+    float* vec = (float*)sdb_malloc(dims * sizeof(float));
+    uint32_t cand_count = 0;
+    int rc = (cand && cand_dist && vec) ?
+        hnsw_search(h, query, dims, (uint32_t)wide, (uint32_t)wide, cand, nullptr, &cand_count) :
+        SPEEDSQL_NOMEM;
+
+    /* Exact distances, then insertion into the sorted k best */
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < cand_count && rc == SPEEDSQL_OK; i++) {
+        if (!vector_row_lookup(db, table, idx->column_indices[0], cand[i], vec, dims)) continue;
+
+        float d = sqrtf(vector_l2_sq(query, vec, dims));
+        if (n == k && d >= cand_dist[n - 1]) continue;
+
+        uint32_t pos = n < k ? n++ : n - 1;
+        while (pos > 0 && cand_dist[pos - 1] > d) {
+            cand_dist[pos] = cand_dist[pos - 1];
+            rowids[pos] = rowids[pos - 1];
+            pos--;
+        }
+        cand_dist[pos] = d;
+        rowids[pos] = cand[i];
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        if (distances) memcpy(distances, cand_dist, n * sizeof(float));
+        *found = n;
+    }
+
+    sdb_free(cand);
+    sdb_free(cand_dist);
+    sdb_free(vec);
+    return rc;
+}
+
+/* Drop a deleted row from the table's vector indexes */
+static void vector_unindex_row(speedsql* db, table_def_t* table, int64_t rowid) {
+    for (size_t i = 0; i < db->index_count; i++) {
+        index_def_t* idx = &db->indices[i];
+        if (!is_vector_index_on(idx, table)) continue;
+
+        if (!vector_index_ready(db, idx)) continue;
+        if (idx->flags & IDX_FLAG_IVF) {
+            ivf_delete(idx->ivf, rowid);
+        } else {
+            hnsw_delete(idx->hnsw, rowid);
+        }
+    }
+}
+
+/* ============================================================================
+ * Full-Text Index Maintenance
+ * ============================================================================ */
+
+static bool is_fts_index_on(const index_def_t* idx, const table_def_t* table) {
+    return (idx->flags & IDX_FLAG_FTS) && idx->column_count == 1 && idx->column_indices &&
+           idx->table_name && strcmp(idx->table_name, table->name) == 0;
+}
+
+/* The segments behind a full-text index, opened on first use */
+static fts_t* index_fts(speedsql* db, index_def_t* idx) {
+    if (!idx->fts && idx->root_page != INVALID_PAGE_ID) {
+        int rc = fts_open(&idx->fts, db->buffer_pool, &db->db_file, idx->root_page);
+        if (rc == SPEEDSQL_NOTFOUND) {
+            idx->fts = nullptr;
+            sdb_set_error(db, rc, "Tokenizer of full-text index '%s' is not registered",
+                          idx->name);
+        } else if (rc != SPEEDSQL_OK) {
+            idx->fts = nullptr;
+            sdb_set_error(db, SPEEDSQL_CORRUPT, "Full-text index '%s' cannot be opened",
+                          idx->name);
+        }
+    }
+    return idx->fts;
+}
+
+/* Index one stored row. A row whose column holds no text (NULL, or
+ * cleared by UPDATE) leaves the index. */
+static int fts_index_put(speedsql* db, index_def_t* idx, int64_t rowid,
+                         const value_t* row, int col_count) {
+    fts_t* f = index_fts(db, idx);
+    if (!f) return SPEEDSQL_CORRUPT;
+
+    uint32_t col = idx->column_indices[0];
+    const value_t* v = col < (uint32_t)col_count ? &row[col] : nullptr;
+    if (v && v->type == VAL_TEXT && v->data.text.data) {
+        return fts_insert(f, rowid, v->data.text.data, v->data.text.len);
+    }
+    int rc = fts_delete(f, rowid);
+    return rc == SPEEDSQL_NOTFOUND ? SPEEDSQL_OK : rc;
+}
+
+/* Index one stored row in every full-text index on its table */
+static int fts_index_row(speedsql* db, table_def_t* table, int64_t rowid,
+                         const value_t* row, int col_count) {
+    for (size_t i = 0; i < db->index_count; i++) {
+        if (!is_fts_index_on(&db->indices[i], table)) continue;
+
+        int rc = fts_index_put(db, &db->indices[i], rowid, row, col_count);
+        if (rc != SPEEDSQL_OK) return rc;
+    }
+    return SPEEDSQL_OK;
+}
+
+/* Drop a deleted row from the table's full-text indexes */
+static void fts_unindex_row(speedsql* db, table_def_t* table, int64_t rowid) {
+    for (size_t i = 0; i < db->index_count; i++) {
+        index_def_t* idx = &db->indices[i];
+        if (!is_fts_index_on(idx, table)) continue;
+
+        fts_t* f = index_fts(db, idx);
+        if (f) fts_delete(f, rowid);
+    }
+}
+
+/* The tokenizer MATCH splits a column's text with: its full-text
+ * index's, or "simple" for a column without one */
+static speedsql_tokenizer* match_tokenizer(speedsql_stmt* stmt, const expr_t* column) {
+    parsed_stmt_t* p = stmt->parsed;
+    table_def_t* table = (p && p->table_count > 0) ? find_table(stmt->db, p->tables[0].name) :
+                                                     nullptr;
+    if (table && column && column->type == EXPR_COLUMN) {
+        for (size_t i = 0; i < stmt->db->index_count; i++) {
+            index_def_t* idx = &stmt->db->indices[i];
+            if (is_fts_index_on(idx, table) &&
+                (int)idx->column_indices[0] == column->data.column_ref.index) {
+                fts_t* f = index_fts(stmt->db, idx);
+                if (f) return fts_tokenizer(f);
+            }
+        }
+    }
+    return speedsql_tokenizer_find(nullptr);
+}
+
+/* ============================================================================
+ * B+tree Index Maintenance
+ * ============================================================================ */
+
+/* The value a stored row is indexed under: its column, or the index's
+ * key expression evaluated against it */
+static int index_key_value(speedsql_stmt* stmt, index_def_t* idx, table_def_t* table,
+                           const value_t* row, int col_count, value_t* out) {
+    value_init_null(out);
+    if (!(idx->flags & IDX_FLAG_EXPR)) {
+        uint32_t col = idx->column_indices[0];
+        if (col < (uint32_t)col_count) value_copy(out, &row[col]);
+        return SPEEDSQL_OK;
+    }
+
+    expr_t* expr = index_key_expr(stmt->db, idx, table);
+    if (!expr) return SPEEDSQL_ERROR;
+
+    value_t* saved_row = stmt->current_row;
+    int saved_count = stmt->column_count;
+    stmt->current_row = (value_t*)row;
+    stmt->column_count = col_count;
+    int rc = eval_expr(stmt, expr, out);
+    stmt->current_row = saved_row;
+    stmt->column_count = saved_count;
+    return rc;
+}
+
+/* Whether a partial index holds a stored row */
+static int index_row_held(speedsql_stmt* stmt, index_def_t* idx, table_def_t* table,
+                          const value_t* row, int col_count, bool* held) {
+    expr_t* pred = index_where_expr(stmt->db, idx, table);
+    if (!pred) return SPEEDSQL_ERROR;
+
+    value_t* saved_row = stmt->current_row;
+    int saved_count = stmt->column_count;
+    stmt->current_row = (value_t*)row;
+    stmt->column_count = col_count;
+
+    value_t result;
+    value_init_null(&result);
+    int rc = eval_expr(stmt, pred, &result);
+    *held = result.type != VAL_NULL && result.data.i != 0;
+    value_free(&result);
+
+    stmt->current_row = saved_row;
+    stmt->column_count = saved_count;
+    return rc;
+}
+
+/* Add a stored row's key to one index, or take it out */
+static int btree_index_put(speedsql_stmt* stmt, index_def_t* idx, table_def_t* table,
+                           int64_t rowid, const value_t* row, int col_count, bool remove) {
+    btree_t* tree = index_btree(stmt->db, idx);
+    if (!tree) return SPEEDSQL_CORRUPT;
+
+    /* A partial index holds only the rows its predicate is true for */
+    if (idx->flags & IDX_FLAG_PARTIAL) {
+        bool held = false;
+        int rc = index_row_held(stmt, idx, table, row, col_count, &held);
+        if (rc != SPEEDSQL_OK || !held) return rc;
+    }
+
+    value_t v;
+    int rc = index_key_value(stmt, idx, table, row, col_count, &v);
+    if (rc != SPEEDSQL_OK) {
+        value_free(&v);
+        return rc;
+    }
+
+    value_t key;
+    index_key_encode(&v, rowid, &key);
+    if (remove) {
+        rc = btree_delete(tree, &key);
+        if (rc == SPEEDSQL_NOTFOUND) rc = SPEEDSQL_OK;
+    } else {
+        value_t rowid_key;
+        btree_int_key(&rowid_key, rowid);
+        rc = btree_insert(tree, &key, &rowid_key);
+        value_free(&rowid_key);
+    }
+    idx->root_page = tree->root_page;
+
+    value_free(&v);
+    value_free(&key);
+    return rc;
+}
+
+/* Whether a key settles equality on its own: numbers a double holds
+ * exactly and text short enough for the prefix. Anything else needs the
+ * row the key came from. */
+static bool index_key_exact(const value_t* v) {
+    switch (v->type) {
+        case VAL_FLOAT:
+            return true;
+        case VAL_INT:
+            return v->data.i >= -(INT64_C(1) << 53) && v->data.i <= (INT64_C(1) << 53);
+        case VAL_TEXT:
+        case VAL_JSON:
+            return v->data.text.len < INDEX_KEY_VALUE - 1;
+        default:
+            return false;
+    }
+}
+
+/* Refuse a row whose value a UNIQUE index already holds for another row.
+ * Keys carry the rowid, so every key of the value is looked at; a key
+ * whose prefix was truncated is checked against its row's full value. */
+static int btree_index_unique(speedsql_stmt* stmt, index_def_t* idx, table_def_t* table,
+                              int64_t rowid, const value_t* row, int col_count) {
+    if (!(idx->flags & IDX_FLAG_UNIQUE)) return SPEEDSQL_OK;
+
+    btree_t* tree = index_btree(stmt->db, idx);
+    if (!tree) return SPEEDSQL_CORRUPT;
+
+    if (idx->flags & IDX_FLAG_PARTIAL) {
+        bool held = false;
+        int rc = index_row_held(stmt, idx, table, row, col_count, &held);
+        if (rc != SPEEDSQL_OK || !held) return rc;
+    }
+
+    value_t v;
+    int rc = index_key_value(stmt, idx, table, row, col_count, &v);
+    if (rc != SPEEDSQL_OK || v.type == VAL_NULL) {
+        value_free(&v);
+        return rc;  /* NULLs never collide */
+    }
+
+    value_t start_key, end_key;
+    index_key_encode(&v, INT64_MIN, &start_key);
+    index_key_encode(&v, INT64_MAX, &end_key);
+    bool exact = index_key_exact(&v);
+
+    btree_cursor_t cursor;
+    btree_cursor_init(&cursor, tree);
+    btree_cursor_seek(&cursor, &start_key);
+
+    bool taken = false;
+    while (rc == SPEEDSQL_OK && !taken && cursor.valid && !cursor.at_end) {
+        value_t key, other;
+        value_init_null(&key);
+        value_init_null(&other);
+        btree_cursor_key(&cursor, &key);
+        btree_cursor_value(&cursor, &other);
+
+        bool in_range = value_compare(&key, &end_key) <= 0;
+        if (in_range && btree_key_int(&other) != rowid) {
+            if (exact) {
+                taken = true;
+            } else {
+                value_t record;
+                value_init_null(&record);
+                if (btree_find((btree_t*)table->data_tree, &other, &record) == SPEEDSQL_OK &&
+                    record.type == VAL_BLOB && record.data.blob.data) {
+                    value_t ov;
+                    const value_t* orow = row_record_values(stmt->db, &record);
+                    rc = index_key_value(stmt, idx, table, orow,
+                                         *(int*)record.data.blob.data, &ov);
+                    taken = rc == SPEEDSQL_OK && value_compare(&ov, &v) == 0;
+                    value_free(&ov);
+                }
+                value_free(&record);
+            }
+        }
+
+        value_free(&key);
+        value_free(&other);
+        if (!in_range) break;
+        btree_cursor_next(&cursor);
+    }
+    btree_cursor_close(&cursor);
+
+    if (taken) {
+        sdb_set_error(stmt->db, SPEEDSQL_CONSTRAINT, "UNIQUE constraint failed: %s", idx->name);
+        rc = SPEEDSQL_CONSTRAINT;
+    }
+
+    value_free(&v);
+    value_free(&start_key);
+    value_free(&end_key);
+    return rc;
+}
+
+/* Check a row against every UNIQUE index on its table before it is
+ * stored under rowid */
+static int btree_index_check(speedsql_stmt* stmt, table_def_t* table, int64_t rowid,
+                             const value_t* row, int col_count) {
+    speedsql* db = stmt->db;
+    for (size_t i = 0; i < db->index_count; i++) {
+        if (!is_btree_index_on(&db->indices[i], table)) continue;
+
+        int rc = btree_index_unique(stmt, &db->indices[i], table, rowid, row, col_count);
+        if (rc != SPEEDSQL_OK) return rc;
+    }
+    return SPEEDSQL_OK;
+}
+
+/* Index one stored row in every B+tree index on its table */
+static int btree_index_row(speedsql_stmt* stmt, table_def_t* table, int64_t rowid,
+                           const value_t* row, int col_count) {
+    speedsql* db = stmt->db;
+    for (size_t i = 0; i < db->index_count; i++) {
+        if (!is_btree_index_on(&db->indices[i], table)) continue;
+
+        int rc = btree_index_put(stmt, &db->indices[i], table, rowid, row, col_count, false);
+        if (rc != SPEEDSQL_OK) return rc;
+    }
+    return SPEEDSQL_OK;
+}
+
+/* Take the row stored under row_key out of the table's B+tree indexes,
+ * before it is deleted or rewritten */
+static void btree_unindex_row(speedsql_stmt* stmt, table_def_t* table, const value_t* row_key) {
+    speedsql* db = stmt->db;
+    size_t i = 0;
+    while (i < db->index_count && !is_btree_index_on(&db->indices[i], table)) i++;
+    if (i == db->index_count) return;
+
+    value_t value;
+    value_init_null(&value);
+    if (btree_find((btree_t*)table->data_tree, row_key, &value) == SPEEDSQL_OK &&
+        value.type == VAL_BLOB && value.data.blob.data) {
+        const value_t* row = row_record_values(stmt->db, &value);
+        int col_count = *(int*)value.data.blob.data;
+        int64_t rowid = btree_key_int(row_key);
+
+        for (; i < db->index_count; i++) {
+            if (!is_btree_index_on(&db->indices[i], table)) continue;
+            btree_index_put(stmt, &db->indices[i], table, rowid, row, col_count, true);
+        }
+    }
+    value_free(&value);
+}
+
+/* ============================================================================
+ * Executor: CREATE TABLE
+ * ============================================================================ */
+
+static int execute_create_table(speedsql_stmt* stmt) {
+    if (!stmt->parsed || !stmt->parsed->new_table) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    return create_table(stmt->db, stmt->parsed->new_table);
+}
+
+/* ============================================================================
+ * Executor: DROP TABLE
+ * ============================================================================ */
+
+static int execute_drop_table(speedsql_stmt* stmt) {
+    parsed_stmt_t* p = stmt->parsed;
+    if (!p || p->table_count == 0) return SPEEDSQL_MISUSE;
+
+    const char* table_name = p->tables[0].name;
+    speedsql* db = stmt->db;
+
+    /* Find table index */
+    size_t table_idx = SIZE_MAX;
+    for (size_t i = 0; i < db->table_count; i++) {
+        if (strcmp(db->tables[i].name, table_name) == 0) {
+            table_idx = i;
+            break;
+        }
+    }
+
+    if (table_idx == SIZE_MAX) {
+        sdb_set_error(db, SPEEDSQL_ERROR, "Table '%s' not found", table_name);
+        return SPEEDSQL_ERROR;
+    }
+
+    /* Free table resources */
+    table_def_t* tbl = &db->tables[table_idx];
+    sdb_free(tbl->name);
+    for (uint32_t j = 0; j < tbl->column_count; j++) {
+        sdb_free(tbl->columns[j].name);
+        sdb_free(tbl->columns[j].default_value);
+        sdb_free(tbl->columns[j].collation);
+    }
+    sdb_free(tbl->columns);
+    if (tbl->data_tree) {
+        btree_close((btree_t*)tbl->data_tree);
+        sdb_free(tbl->data_tree);
+    }
+
+    /* Remove from array by shifting */
+    for (size_t i = table_idx; i < db->table_count - 1; i++) {
+        db->tables[i] = db->tables[i + 1];
+    }
+    db->table_count--;
+
+    return SPEEDSQL_OK;
+}
+
+/* ============================================================================
+ * Executor: CREATE INDEX
+ * ============================================================================ */
+
+/* Up to VECTOR_INDEX_SAMPLES of the column's vectors, reservoir-sampled
+ * over the whole table, to train PQ codebooks and IVF centroids on */
+#define VECTOR_INDEX_SAMPLES 8192
+
+static int vector_index_samples(speedsql* db, table_def_t* table, uint32_t col, float** samples,
+                                size_t* count, uint32_t* dims) {
+    *samples = nullptr;
+    *count = 0;
+    *dims = 0;
+    if (!table->data_tree) return SPEEDSQL_OK;
+
+    btree_cursor_t cursor;
+    btree_cursor_init(&cursor, (btree_t*)table->data_tree);
+    btree_cursor_first(&cursor);
+
+    uint64_t seen = 0;
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    int rc = SPEEDSQL_OK;
+    while (rc == SPEEDSQL_OK && cursor.valid && !cursor.at_end) {
+        value_t row_value;
+        value_init_null(&row_value);
+        btree_cursor_value(&cursor, &row_value);
+
+        const value_t* v = nullptr;
+        if (row_value.type == VAL_BLOB && row_value.data.blob.data) {
+            const value_t* row = row_record_values(db, &row_value);
+            int col_count = *(int*)row_value.data.blob.data;
+            if ((int)col < col_count) v = &row[col];
+        }
+
+        if (v && v->type == VAL_VECTOR && v->data.vec.data && v->data.vec.dimensions > 0 &&
+            (*dims == 0 || v->data.vec.dimensions == *dims)) {
+            if (!*samples) {
+                *dims = v->data.vec.dimensions;
+                *samples = (float*)sdb_malloc((size_t)VECTOR_INDEX_SAMPLES * *dims * sizeof(float));
+                if (!*samples) rc = SPEEDSQL_NOMEM;
+            }
+
+            /* Keep row i with probability VECTOR_INDEX_SAMPLES / i */
+            size_t slot = SIZE_MAX;
+            if (seen < VECTOR_INDEX_SAMPLES) {
+                slot = (size_t)seen;
+            } else {
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                uint64_t r = seed % (seen + 1);
+                if (r < VECTOR_INDEX_SAMPLES) slot = (size_t)r;
+            }
+            if (rc == SPEEDSQL_OK && slot != SIZE_MAX) {
+                memcpy(*samples + slot * *dims, v->data.vec.data, *dims * sizeof(float));
+            }
+            seen++;
+        }
+
+        value_free(&row_value);
+        btree_cursor_next(&cursor);
+    }
+    btree_cursor_close(&cursor);
+
+    *count = seen < VECTOR_INDEX_SAMPLES ? (size_t)seen : VECTOR_INDEX_SAMPLES;
+    return rc;
+}
+
+/* Set the index's vector codec before any row goes in. PQ trains on the
+ * rows already in the table, so it cannot start out empty. */
+static int quantize_vector_index(speedsql* db, table_def_t* table, index_def_t* idx) {
+    uint32_t codec = idx->params[IDX_PARAM_QUANTIZE];
+    uint32_t rerank = idx->params[IDX_PARAM_RERANK];
+    if (codec == IDX_QUANT_NONE) return SPEEDSQL_OK;
+    if (codec == IDX_QUANT_SQ8) return hnsw_quantize(idx->hnsw, codec, 0, rerank, nullptr, 0, 0);
+
+    float* samples;
+    size_t count;
+    uint32_t dims;
+    int rc = vector_index_samples(db, table, idx->column_indices[0], &samples, &count, &dims);
+
+    /* Four floats per subspace unless pq_m says otherwise */
+    uint32_t pq_m = idx->params[IDX_PARAM_PQ_M];
+    if (pq_m == 0 && dims > 0) pq_m = dims % 4 == 0 ? dims / 4 : (dims % 2 == 0 ? dims / 2 : dims);
+
+    if (rc == SPEEDSQL_OK && count == 0) {
+        sdb_set_error(db, SPEEDSQL_ERROR, "PQ index '%s' needs vectors in '%s' to train on",
+                      idx->name, table->name);
+        rc = SPEEDSQL_ERROR;
+    } else if (rc == SPEEDSQL_OK && dims % pq_m != 0) {
+        sdb_set_error(db, SPEEDSQL_ERROR, "pq_m of index '%s' must divide %u dimensions",
+                      idx->name, dims);
+        rc = SPEEDSQL_ERROR;
+    }
+    if (rc == SPEEDSQL_OK) {
+        rc = hnsw_quantize(idx->hnsw, codec, pq_m, rerank, samples, count, dims);
+    }
+
+    sdb_free(samples);
+    return rc;
+}
+
+/* Train IVF centroids on the rows already in the table, which therefore
+ * cannot be empty */
+static int train_vector_index(speedsql* db, table_def_t* table, index_def_t* idx) {
+    float* samples;
+    size_t count;
+    uint32_t dims;
+    int rc = vector_index_samples(db, table, idx->column_indices[0], &samples, &count, &dims);
+
+    if (rc == SPEEDSQL_OK && count == 0) {
+        sdb_set_error(db, SPEEDSQL_ERROR, "IVF index '%s' needs vectors in '%s' to train on",
+                      idx->name, table->name);
+        rc = SPEEDSQL_ERROR;
+    }
+    if (rc == SPEEDSQL_OK) rc = ivf_train(idx->ivf, samples, count, dims);
+    if (rc == SPEEDSQL_RANGE) {
+        sdb_set_error(db, rc, "Vectors too large for index '%s'", idx->name);
+    }
+
+    sdb_free(samples);
+    return rc;
+}
+
+/* Build an HNSW graph or IVF lists over the rows already in the table.
+ * The index is only added once every row is in it. */
+static int create_vector_index(speedsql* db, table_def_t* table, index_def_t* idx,
+                               const index_def_t* def) {
+    memcpy(idx->params, def->params, sizeof(idx->params));
+
+    int rc = SPEEDSQL_OK;
+    if (!idx->name || !idx->table_name || !idx->column_indices) rc = SPEEDSQL_NOMEM;
+    if (rc == SPEEDSQL_OK && (idx->column_count != 1 ||
+                              idx->column_indices[0] >= table->column_count)) {
+        sdb_set_error(db, SPEEDSQL_ERROR, "Vector index '%s' needs one column of '%s'",
+                      idx->name, table->name);
+        rc = SPEEDSQL_ERROR;
+    }
+
+    if (rc == SPEEDSQL_OK && (idx->flags & IDX_FLAG_IVF)) {
+        rc = ivf_create(db->buffer_pool, &db->db_file, idx->params[IDX_PARAM_LISTS],
+                        idx->params[IDX_PARAM_NPROBE], &idx->root_page);
+        if (rc == SPEEDSQL_OK) {
+            rc = ivf_open(&idx->ivf, db->buffer_pool, &db->db_file, idx->root_page);
+        }
+        if (rc == SPEEDSQL_OK) rc = train_vector_index(db, table, idx);
+    } else if (rc == SPEEDSQL_OK) {
+        rc = hnsw_create(db->buffer_pool, &db->db_file, idx->params[IDX_PARAM_M],
+                         idx->params[IDX_PARAM_EF_CONSTRUCTION],
+                         idx->params[IDX_PARAM_EF_SEARCH], &idx->root_page);
+        if (rc == SPEEDSQL_OK) {
+            rc = hnsw_open(&idx->hnsw, db->buffer_pool, &db->db_file, idx->root_page);
+        }
+        if (rc == SPEEDSQL_OK) rc = quantize_vector_index(db, table, idx);
+    }
+
+    if (rc == SPEEDSQL_OK && table->data_tree) {
+        btree_cursor_t cursor;
+        btree_cursor_init(&cursor, (btree_t*)table->data_tree);
+        btree_cursor_first(&cursor);
+
+        while (rc == SPEEDSQL_OK && cursor.valid && !cursor.at_end) {
+            value_t row_key, row_value;
+            value_init_null(&row_key);
+            value_init_null(&row_value);
+
+            btree_cursor_key(&cursor, &row_key);
+            btree_cursor_value(&cursor, &row_value);
+
+            if (row_value.type == VAL_BLOB && row_value.data.blob.data) {
+                value_t* row_vals = row_record_values(db, &row_value);
+                int col_count = *(int*)row_value.data.blob.data;
+                rc = vector_index_put(db, idx, btree_key_int(&row_key), row_vals, col_count);
+            }
+
+            value_free(&row_key);
+            value_free(&row_value);
+            btree_cursor_next(&cursor);
+        }
+        btree_cursor_close(&cursor);
+    }
+
     if (rc != SPEEDSQL_OK) {
-        sdb_free(tbl->data_tree);
-        tbl->data_tree = nullptr;
+        hnsw_close(idx->hnsw);
+        ivf_close(idx->ivf);
+        sdb_free(idx->name);
+        sdb_free(idx->table_name);
+        sdb_free(idx->column_indices);
+        memset(idx, 0, sizeof(*idx));
         return rc;
     }
 
-    tbl->root_page = ((btree_t*)tbl->data_tree)->root_page;
-    db->table_count++;
-
+    db->index_count++;
     return SPEEDSQL_OK;
 }
 
-/* ============================================================================
- * Executor: CREATE TABLE
- * ============================================================================ */
+/* Index the text of the rows already in the table. The index is only
+ * added once every row is in it. */
+static int create_fts_index(speedsql* db, table_def_t* table, index_def_t* idx,
+                            const index_def_t* def) {
+    int rc = SPEEDSQL_OK;
+    if (!idx->name || !idx->table_name || !idx->column_indices) rc = SPEEDSQL_NOMEM;
+    if (rc == SPEEDSQL_OK && (idx->column_count != 1 ||
+                              idx->column_indices[0] >= table->column_count)) {
+        sdb_set_error(db, SPEEDSQL_ERROR, "Full-text index '%s' needs one column of '%s'",
+                      idx->name, table->name);
+        rc = SPEEDSQL_ERROR;
+    }
+    if (rc == SPEEDSQL_OK && !speedsql_tokenizer_find(def->tokenizer)) {
+        sdb_set_error(db, SPEEDSQL_ERROR, "Unknown tokenizer '%s'", def->tokenizer);
+        rc = SPEEDSQL_ERROR;
+    }
 
-static int execute_create_table(speedsql_stmt* stmt) {
-    if (!stmt->parsed || !stmt->parsed->new_table) {
-        return SPEEDSQL_MISUSE;
+    if (rc == SPEEDSQL_OK) {
+        rc = fts_create(db->buffer_pool, &db->db_file, def->tokenizer, &idx->root_page);
+        if (rc == SPEEDSQL_RANGE) {
+            sdb_set_error(db, rc, "Tokenizer name '%s' is too long", def->tokenizer);
+        }
+    }
+    if (rc == SPEEDSQL_OK) {
+        rc = fts_open(&idx->fts, db->buffer_pool, &db->db_file, idx->root_page);
+    }
+    if (rc == SPEEDSQL_OK && def->tokenizer) {
+        idx->tokenizer = sdb_strdup(def->tokenizer);
+        if (!idx->tokenizer) rc = SPEEDSQL_NOMEM;
     }
 
-    return create_table(stmt->db, stmt->parsed->new_table);
-}
+    if (rc == SPEEDSQL_OK && table->data_tree) {
+        btree_cursor_t cursor;
+        btree_cursor_init(&cursor, (btree_t*)table->data_tree);
+        btree_cursor_first(&cursor);
 
-/* ============================================================================
- * Executor: DROP TABLE
- * ============================================================================ */
+        while (rc == SPEEDSQL_OK && cursor.valid && !cursor.at_end) {
+            value_t row_key, row_value;
+            value_init_null(&row_key);
+            value_init_null(&row_value);
 
-static int execute_drop_table(speedsql_stmt* stmt) {
-    parsed_stmt_t* p = stmt->parsed;
-    if (!p || p->table_count == 0) return SPEEDSQL_MISUSE;
+            btree_cursor_key(&cursor, &row_key);
+            btree_cursor_value(&cursor, &row_value);
 
-    const char* table_name = p->tables[0].name;
-    speedsql* db = stmt->db;
+            if (row_value.type == VAL_BLOB && row_value.data.blob.data) {
+                value_t* row_vals = row_record_values(db, &row_value);
+                int col_count = *(int*)row_value.data.blob.data;
+                rc = fts_index_put(db, idx, btree_key_int(&row_key), row_vals, col_count);
+            }
 
-    /* Find table index */
-    size_t table_idx = SIZE_MAX;
-    for (size_t i = 0; i < db->table_count; i++) {
-        if (strcmp(db->tables[i].name, table_name) == 0) {
-            table_idx = i;
-            break;
+            value_free(&row_key);
+            value_free(&row_value);
+            btree_cursor_next(&cursor);
         }
+        btree_cursor_close(&cursor);
     }
 
-    if (table_idx == SIZE_MAX) {
-        sdb_set_error(db, SPEEDSQL_ERROR, "Table '%s' not found", table_name);
-        return SPEEDSQL_ERROR;
-    }
-
-    /* Free table resources */
-    table_def_t* tbl = &db->tables[table_idx];
-    sdb_free(tbl->name);
-    for (uint32_t j = 0; j < tbl->column_count; j++) {
-        sdb_free(tbl->columns[j].name);
-        sdb_free(tbl->columns[j].default_value);
-        sdb_free(tbl->columns[j].collation);
-    }
-    sdb_free(tbl->columns);
-    if (tbl->data_tree) {
-        btree_close((btree_t*)tbl->data_tree);
-        sdb_free(tbl->data_tree);
-    }
-
-    /* Remove from array by shifting */
-    for (size_t i = table_idx; i < db->table_count - 1; i++) {
-        db->tables[i] = db->tables[i + 1];
+    if (rc != SPEEDSQL_OK) {
+        fts_close(idx->fts);
+        sdb_free(idx->name);
+        sdb_free(idx->table_name);
+        sdb_free(idx->column_indices);
+        sdb_free(idx->tokenizer);
+        memset(idx, 0, sizeof(*idx));
+        return rc;
     }
-    db->table_count--;
 
+    db->index_count++;
     return SPEEDSQL_OK;
 }
 
-/* ============================================================================
- * Executor: CREATE INDEX
- * ============================================================================ */
-
 static int execute_create_index(speedsql_stmt* stmt) {
     parsed_stmt_t* p = stmt->parsed;
     if (!p || !p->new_index) return SPEEDSQL_MISUSE;
@@ -735,6 +2117,36 @@ static int execute_create_index(speedsql_stmt* stmt) {
                def->column_count * sizeof(uint32_t));
     }
 
+    if (idx->flags & IDX_FLAG_VECTOR) {
+        return create_vector_index(db, table, idx, def);
+    }
+    if (idx->flags & IDX_FLAG_FTS) {
+        return create_fts_index(db, table, idx, def);
+    }
+
+    /* The key expression and the predicate have to be expressions on the
+     * table's columns */
+    int rc = SPEEDSQL_OK;
+    if (idx->flags & IDX_FLAG_EXPR) {
+        idx->key_sql = sdb_strdup(def->key_sql);
+        if (!idx->key_sql) rc = SPEEDSQL_NOMEM;
+        else if (!index_key_expr(db, idx, table)) rc = SPEEDSQL_ERROR;
+    }
+    if (rc == SPEEDSQL_OK && (idx->flags & IDX_FLAG_PARTIAL)) {
+        idx->where_sql = sdb_strdup(def->where_sql);
+        if (!idx->where_sql) rc = SPEEDSQL_NOMEM;
+        else if (!index_where_expr(db, idx, table)) rc = SPEEDSQL_ERROR;
+    }
+    if (rc != SPEEDSQL_OK) {
+        sdb_free(idx->name);
+        sdb_free(idx->table_name);
+        sdb_free(idx->column_indices);
+        sdb_free(idx->key_sql);
+        expr_free(idx->key_expr);
+        sdb_free(idx->where_sql);
+        return rc;
+    }
+
     /* Create B+Tree for the index */
     btree_t* idx_tree = (btree_t*)sdb_calloc(1, sizeof(btree_t));
     if (!idx_tree) {
@@ -742,7 +2154,7 @@ static int execute_create_index(speedsql_stmt* stmt) {
         return SPEEDSQL_NOMEM;
     }
 
-    int rc = btree_create(idx_tree, db->buffer_pool, &db->db_file, value_compare);
+    rc = btree_create(idx_tree, db->buffer_pool, &db->db_file, value_compare);
     if (rc != SPEEDSQL_OK) {
         sdb_free(idx_tree);
         db->index_count++;
@@ -750,6 +2162,7 @@ static int execute_create_index(speedsql_stmt* stmt) {
     }
 
     idx->root_page = idx_tree->root_page;
+    idx->index_tree = idx_tree;
 
     /* Populate index from existing table data */
     if (table->data_tree) {
@@ -757,7 +2170,7 @@ static int execute_create_index(speedsql_stmt* stmt) {
         btree_cursor_init(&cursor, (btree_t*)table->data_tree);
         btree_cursor_first(&cursor);
 
-        while (cursor.valid && !cursor.at_end) {
+        while (rc == SPEEDSQL_OK && cursor.valid && !cursor.at_end) {
             value_t row_key, row_value;
             value_init_null(&row_key);
             value_init_null(&row_value);
@@ -766,15 +2179,16 @@ static int execute_create_index(speedsql_stmt* stmt) {
             btree_cursor_value(&cursor, &row_value);
 
             if (row_value.type == VAL_BLOB && row_value.data.blob.data) {
+                value_t* row_vals = row_record_values(stmt->db, &row_value);
                 int col_count = *(int*)row_value.data.blob.data;
-                value_t* row_vals = (value_t*)((uint8_t*)row_value.data.blob.data + sizeof(int));
 
-                /* Extract indexed column value */
-                if (idx->column_count > 0 && idx->column_indices[0] < (uint32_t)col_count) {
-                    value_t* idx_key = &row_vals[idx->column_indices[0]];
-
-                    /* Insert into index: key = column value, value = rowid */
-                    btree_insert(idx_tree, idx_key, &row_key);
+                /* Rows already indexed are checked against, so a
+                 * duplicate value fails the UNIQUE index */
+                rc = btree_index_unique(stmt, idx, table, btree_key_int(&row_key),
+                                        row_vals, col_count);
+                if (rc == SPEEDSQL_OK) {
+                    rc = btree_index_put(stmt, idx, table, btree_key_int(&row_key),
+                                         row_vals, col_count, false);
                 }
             }
 
@@ -786,10 +2200,19 @@ static int execute_create_index(speedsql_stmt* stmt) {
         btree_cursor_close(&cursor);
     }
 
-    /* Update root_page in case it changed during inserts */
-    idx->root_page = idx_tree->root_page;
-    btree_close(idx_tree);
-    sdb_free(idx_tree);
+    /* A row whose key cannot be computed leaves no index behind */
+    if (rc != SPEEDSQL_OK) {
+        btree_close(idx_tree);
+        sdb_free(idx_tree);
+        sdb_free(idx->name);
+        sdb_free(idx->table_name);
+        sdb_free(idx->column_indices);
+        sdb_free(idx->key_sql);
+        expr_free(idx->key_expr);
+        sdb_free(idx->where_sql);
+        expr_free(idx->where_expr);
+        return rc;
+    }
 
     db->index_count++;
     return SPEEDSQL_OK;
@@ -821,9 +2244,21 @@ static int execute_drop_index(speedsql_stmt* stmt) {
     }
 
     /* Free index resources */
+    hnsw_close(db->indices[idx].hnsw);
+    ivf_close(db->indices[idx].ivf);
+    fts_close(db->indices[idx].fts);
     sdb_free(db->indices[idx].name);
     sdb_free(db->indices[idx].table_name);
     sdb_free(db->indices[idx].column_indices);
+    sdb_free(db->indices[idx].tokenizer);
+    sdb_free(db->indices[idx].key_sql);
+    expr_free(db->indices[idx].key_expr);
+    sdb_free(db->indices[idx].where_sql);
+    expr_free(db->indices[idx].where_expr);
+    if (db->indices[idx].index_tree) {
+        btree_close((btree_t*)db->indices[idx].index_tree);
+        sdb_free(db->indices[idx].index_tree);
+    }
 
     /* Remove from array */
     for (size_t i = idx; i < db->index_count - 1; i++) {
@@ -838,6 +2273,26 @@ static int execute_drop_index(speedsql_stmt* stmt) {
  * Executor: UPDATE
  * ============================================================================ */
 
+/* JSON columns hold binary documents: text written to one is parsed on
+ * the way in, and text that is not JSON is refused */
+static int json_column_store(speedsql* db, const column_def_t* col, value_t* v) {
+    if (col->type != SPEEDSQL_TYPE_JSON || v->type != VAL_TEXT) return SPEEDSQL_OK;
+
+    uint8_t* doc;
+    uint32_t len;
+    int rc = jsonb_from_text(v->data.text.data, v->data.text.len, &doc, &len);
+    if (rc != SPEEDSQL_OK) {
+        if (rc == SPEEDSQL_MISMATCH) {
+            sdb_set_error(db, rc, "Invalid JSON for column '%s'", col->name);
+        }
+        return rc;
+    }
+    value_free(v);
+    value_init_json(v, doc, (int)len);
+    sdb_free(doc);
+    return SPEEDSQL_OK;
+}
+
 static int execute_update(speedsql_stmt* stmt) {
     parsed_stmt_t* p = stmt->parsed;
     if (!p || p->table_count == 0) return SPEEDSQL_MISUSE;
@@ -869,15 +2324,18 @@ static int execute_update(speedsql_stmt* stmt) {
     btree_cursor_first(&cursor);
 
     int updated_count = 0;
+    int rc = SPEEDSQL_OK;
 
     /* Collect keys to update (can't modify while iterating) */
     value_t* keys_to_update = nullptr;
     value_t** new_rows = nullptr;
+    page_id_t* chains = nullptr;   /* Overflow pages the new records reuse */
     int update_capacity = 64;
     int update_count = 0;
 
     keys_to_update = (value_t*)sdb_malloc(update_capacity * sizeof(value_t));
     new_rows = (value_t**)sdb_malloc(update_capacity * sizeof(value_t*));
+    chains = (page_id_t*)sdb_malloc(update_capacity * sizeof(page_id_t));
 
     while (cursor.valid && !cursor.at_end) {
         value_t key, value;
@@ -888,8 +2346,9 @@ static int execute_update(speedsql_stmt* stmt) {
         btree_cursor_value(&cursor, &value);
 
         if (value.type == VAL_BLOB && value.data.blob.data) {
+            page_id_t chain = row_record_chain(&value);
+            value_t* row_vals = row_record_values(stmt->db, &value);
             int col_count = *(int*)value.data.blob.data;
-            value_t* row_vals = (value_t*)((uint8_t*)value.data.blob.data + sizeof(int));
 
             /* Check WHERE condition */
             bool pass_filter = true;
@@ -913,10 +2372,13 @@ static int execute_update(speedsql_stmt* stmt) {
                         update_capacity * sizeof(value_t));
                     new_rows = (value_t**)sdb_realloc(new_rows,
                         update_capacity * sizeof(value_t*));
+                    chains = (page_id_t*)sdb_realloc(chains,
+                        update_capacity * sizeof(page_id_t));
                 }
 
                 /* Store key for later update */
                 value_copy(&keys_to_update[update_count], &key);
+                chains[update_count] = chain;
 
                 /* Create new row with updated values */
                 value_t* new_row = (value_t*)sdb_calloc(col_count, sizeof(value_t));
@@ -946,9 +2408,22 @@ static int execute_update(speedsql_stmt* stmt) {
                         value_free(&new_row[col_idx]);
                         value_copy(&new_row[col_idx], &new_val);
                         value_free(&new_val);
+                        if (rc == SPEEDSQL_OK) {
+                            rc = json_column_store(stmt->db, &table->columns[col_idx],
+                                                   &new_row[col_idx]);
+                        }
                     }
                 }
 
+                /* Refuse an oversized row before any row is rewritten */
+                size_t record_size;
+                if (rc == SPEEDSQL_OK && (uint32_t)col_count == table->column_count) {
+                    rc = row_record_size(stmt->db, table, new_row, &record_size);
+                }
+                if (rc == SPEEDSQL_OK) {
+                    rc = btree_index_check(stmt, table, btree_key_int(&key), new_row, col_count);
+                }
+
                 new_rows[update_count] = new_row;
                 update_count++;
             }
@@ -956,29 +2431,64 @@ static int execute_update(speedsql_stmt* stmt) {
 
         value_free(&key);
         value_free(&value);
+        if (rc != SPEEDSQL_OK) break;
         btree_cursor_next(&cursor);
     }
 
     btree_cursor_close(&cursor);
 
+    /* A refused value leaves every row as it was */
+    if (rc != SPEEDSQL_OK) {
+        for (int i = 0; i < update_count; i++) {
+            for (uint32_t c = 0; c < table->column_count; c++) value_free(&new_rows[i][c]);
+            sdb_free(new_rows[i]);
+            value_free(&keys_to_update[i]);
+        }
+        sdb_free(keys_to_update);
+        sdb_free(new_rows);
+        sdb_free(chains);
+        stmt->current_row = nullptr;
+        stmt->column_count = 0;
+        return rc;
+    }
+
     /* Now apply updates */
     for (int i = 0; i < update_count; i++) {
+        /* Two rows of this statement may have been given the same unique
+         * value: the rows rewritten so far are indexed by now */
+        if (rc == SPEEDSQL_OK && i > 0) {
+            rc = btree_index_check(stmt, table, btree_key_int(&keys_to_update[i]),
+                                   new_rows[i], (int)table->column_count);
+        }
+        if (rc != SPEEDSQL_OK) {
+            value_free(&keys_to_update[i]);
+            for (uint32_t c = 0; c < table->column_count; c++) value_free(&new_rows[i][c]);
+            sdb_free(new_rows[i]);
+            continue;
+        }
+
         /* Delete old entry */
+        btree_unindex_row(stmt, table, &keys_to_update[i]);
         btree_delete(tree, &keys_to_update[i]);
 
         /* Insert new entry with same key */
-        size_t row_size = sizeof(int) + table->column_count * sizeof(value_t);
-        uint8_t* row_data = (uint8_t*)sdb_malloc(row_size);
-        *(int*)row_data = table->column_count;
-        memcpy(row_data + sizeof(int), new_rows[i], table->column_count * sizeof(value_t));
-
         value_t new_value;
-        value_init_blob(&new_value, row_data, row_size);
-        btree_insert(tree, &keys_to_update[i], &new_value);
+        value_init_null(&new_value);
+        if (row_record_pack(stmt->db, table, new_rows[i], chains[i], &new_value) == SPEEDSQL_OK) {
+            btree_insert(tree, &keys_to_update[i], &new_value);
+        }
+        table->root_page = tree->root_page;
+
+        vector_index_row(stmt->db, table, btree_key_int(&keys_to_update[i]),
+                         new_rows[i], (int)table->column_count);
+        fts_index_row(stmt->db, table, btree_key_int(&keys_to_update[i]),
+                      new_rows[i], (int)table->column_count);
+        btree_index_row(stmt, table, btree_key_int(&keys_to_update[i]),
+                        new_rows[i], (int)table->column_count);
 
-        sdb_free(row_data);
         value_free(&new_value);
         value_free(&keys_to_update[i]);
+        for (uint32_t c = 0; c < table->column_count; c++) value_free(&new_rows[i][c]);
         sdb_free(new_rows[i]);
 
         updated_count++;
@@ -986,12 +2496,13 @@ static int execute_update(speedsql_stmt* stmt) {
 
     sdb_free(keys_to_update);
     sdb_free(new_rows);
+    sdb_free(chains);
 
     stmt->db->total_changes += updated_count;
     stmt->current_row = nullptr;
     stmt->column_count = 0;
 
-    return SPEEDSQL_DONE;
+    return rc != SPEEDSQL_OK ? rc : SPEEDSQL_DONE;
 }
 
 /* ============================================================================
@@ -1039,8 +2550,8 @@ static int execute_delete(speedsql_stmt* stmt) {
         btree_cursor_value(&cursor, &value);
 
         if (value.type == VAL_BLOB && value.data.blob.data) {
+            value_t* row_vals = row_record_values(stmt->db, &value);
             int col_count = *(int*)value.data.blob.data;
-            value_t* row_vals = (value_t*)((uint8_t*)value.data.blob.data + sizeof(int));
 
             /* Check WHERE condition */
             bool pass_filter = true;
@@ -1078,9 +2589,13 @@ static int execute_delete(speedsql_stmt* stmt) {
 
     /* Now delete the collected keys */
     for (int i = 0; i < delete_count; i++) {
+        vector_unindex_row(stmt->db, table, btree_key_int(&keys_to_delete[i]));
+        fts_unindex_row(stmt->db, table, btree_key_int(&keys_to_delete[i]));
+        btree_unindex_row(stmt, table, &keys_to_delete[i]);
         btree_delete(tree, &keys_to_delete[i]);
         value_free(&keys_to_delete[i]);
     }
+    table->root_page = tree->root_page;
 
     sdb_free(keys_to_delete);
 
@@ -1110,27 +2625,41 @@ static int execute_insert(speedsql_stmt* stmt) {
         return SPEEDSQL_ERROR;
     }
 
+    /* Rowids continue above the table's stored ones, also in a
+     * connection that has just opened the file */
+    btree_cursor_t last;
+    btree_cursor_init(&last, (btree_t*)table->data_tree);
+    btree_cursor_last(&last);
+    if (last.valid) {
+        value_t last_key;
+        value_init_null(&last_key);
+        btree_cursor_key(&last, &last_key);
+        int64_t last_rowid = btree_key_int(&last_key);
+        if (last_rowid > stmt->db->last_rowid) stmt->db->last_rowid = last_rowid;
+        value_free(&last_key);
+    }
+    btree_cursor_close(&last);
+
     /* For each row of values */
     for (int row = 0; row < p->insert_row_count; row++) {
         /* Build row key (use rowid) */
         value_t key;
         int64_t rowid = ++stmt->db->last_rowid;
-        value_init_int(&key, rowid);
+        btree_int_key(&key, rowid);
 
         /* Build row value (pack all columns) */
-        /* For simplicity, store as a blob with packed values */
-        size_t row_size = sizeof(int) + table->column_count * sizeof(value_t);
-        uint8_t* row_data = (uint8_t*)sdb_malloc(row_size);
-        if (!row_data) {
+        value_t* row_values = (value_t*)sdb_calloc(table->column_count, sizeof(value_t));
+        if (!row_values) {
             value_free(&key);
             return SPEEDSQL_NOMEM;
         }
 
-        *(int*)row_data = table->column_count;
-        value_t* row_values = (value_t*)(row_data + sizeof(int));
-
         for (uint32_t col = 0; col < table->column_count; col++) {
-            if (p->insert_values && row < p->insert_row_count &&
+            int param = (p->insert_params && p->insert_params[row] &&
+                         (int)col < p->insert_column_count) ? p->insert_params[row][col] : 0;
+            if (param > 0 && param <= stmt->param_count) {
+                value_copy(&row_values[col], &stmt->params[param - 1]);
+            } else if (p->insert_values && row < p->insert_row_count &&
                 p->insert_values[row] && (int)col < p->insert_column_count) {
                 value_copy(&row_values[col], &p->insert_values[row][col]);
             } else {
@@ -1138,12 +2667,36 @@ static int execute_insert(speedsql_stmt* stmt) {
             }
         }
 
-        value_t value;
-        value_init_blob(&value, row_data, row_size);
+        int rc = SPEEDSQL_OK;
+        for (uint32_t col = 0; col < table->column_count && rc == SPEEDSQL_OK; col++) {
+            rc = json_column_store(stmt->db, &table->columns[col], &row_values[col]);
+        }
+
+        if (rc == SPEEDSQL_OK) {
+            rc = btree_index_check(stmt, table, rowid, row_values, (int)table->column_count);
+        }
 
-        int rc = btree_insert((btree_t*)table->data_tree, &key, &value);
+        value_t value;
+        value_init_null(&value);
+        if (rc == SPEEDSQL_OK) {
+            rc = row_record_pack(stmt->db, table, row_values, INVALID_PAGE_ID, &value);
+        }
+        if (rc == SPEEDSQL_OK) {
+            rc = btree_insert((btree_t*)table->data_tree, &key, &value);
+            table->root_page = ((btree_t*)table->data_tree)->root_page;
+        }
+        if (rc == SPEEDSQL_OK) {
+            rc = vector_index_row(stmt->db, table, rowid, row_values, (int)table->column_count);
+        }
+        if (rc == SPEEDSQL_OK) {
+            rc = fts_index_row(stmt->db, table, rowid, row_values, (int)table->column_count);
+        }
+        if (rc == SPEEDSQL_OK) {
+            rc = btree_index_row(stmt, table, rowid, row_values, (int)table->column_count);
+        }
 
-        sdb_free(row_data);
+        for (uint32_t col = 0; col < table->column_count; col++) value_free(&row_values[col]);
+        sdb_free(row_values);
         value_free(&key);
         value_free(&value);
 
@@ -1252,28 +2805,305 @@ static void result_buffer_free(result_buffer_t* buf) {
 /* Sort comparison data */
 static parsed_stmt_t* g_sort_stmt = nullptr;
 
-static int compare_rows(const void* a, const void* b) {
-    value_t* row_a = *(value_t**)a;
-    value_t* row_b = *(value_t**)b;
+static int compare_rows(const void* a, const void* b) {
+    value_t* row_a = *(value_t**)a;
+    value_t* row_b = *(value_t**)b;
+
+    if (!g_sort_stmt || !g_sort_stmt->order_by) return 0;
+
+    for (int i = 0; i < g_sort_stmt->order_by_count; i++) {
+        order_by_t* ob = &g_sort_stmt->order_by[i];
+
+        /* Get column index from expression */
+        int col_idx = 0;
+        if (ob->expr && ob->expr->type == EXPR_COLUMN) {
+            col_idx = ob->expr->data.column_ref.index;
+            if (col_idx < 0) col_idx = 0;
+        }
+
+        int cmp = value_compare(&row_a[col_idx], &row_b[col_idx]);
+        if (cmp != 0) {
+            return ob->desc ? -cmp : cmp;
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Vector Top-k: ORDER BY vec_distance(column, ?) LIMIT k
+ * ============================================================================ */
+
+/* The vector index that can produce the statement's ordering: a single
+ * ascending ORDER BY vec_distance of an indexed column and a parameter,
+ * with a LIMIT and no joins, grouping or aggregates. *query is set to the
+ * parameter. */
+static index_def_t* match_vector_order(speedsql* db, table_def_t* table, parsed_stmt_t* p,
+                                       expr_t** query) {
+    if (p->order_by_count != 1 || p->order_by[0].desc || p->limit <= 0 ||
+        p->join_count > 0 || p->group_by_count > 0) {
+        return nullptr;
+    }
+    for (int i = 0; i < p->column_count; i++) {
+        if (has_aggregate(p->columns[i].expr)) return nullptr;
+    }
+
+    expr_t* order = p->order_by[0].expr;
+    if (!order || order->type != EXPR_FUNCTION || !order->data.function.name ||
+        strcasecmp(order->data.function.name, "vec_distance") != 0 ||
+        order->data.function.arg_count != 2) {
+        return nullptr;
+    }
+
+    /* Either argument may be the column */
+    expr_t* column = order->data.function.args[0];
+    *query = order->data.function.args[1];
+    if (!column || column->type != EXPR_COLUMN) {
+        column = order->data.function.args[1];
+        *query = order->data.function.args[0];
+    }
+    if (!column || column->type != EXPR_COLUMN || !*query ||
+        (*query)->type != EXPR_PARAMETER) {
+        return nullptr;
+    }
+
+    resolve_column_indices(column, table);
+    int col = column->data.column_ref.index;
+    if (col < 0) return nullptr;
+
+    for (size_t i = 0; i < db->index_count; i++) {
+        index_def_t* idx = &db->indices[i];
+        if (is_vector_index_on(idx, table) && (int)idx->column_indices[0] == col) {
+            return idx;
+        }
+    }
+    return nullptr;
+}
+
+/* Buffer the LIMIT + OFFSET nearest rows that pass WHERE, nearest first.
+ * WHERE filters the graph's results, so the search widens until enough
+ * rows pass or the index has no more. */
+static int vector_topk_rows(speedsql_stmt* stmt, table_def_t* table, index_def_t* idx,
+                            expr_t* query_expr, result_buffer_t* buf) {
+    parsed_stmt_t* p = stmt->parsed;
+    speedsql* db = stmt->db;
+
+    value_t query;
+    value_init_null(&query);
+    int rc = eval_expr(stmt, query_expr, &query);
+    if (rc != SPEEDSQL_OK) return rc;
+    if (query.type != VAL_VECTOR || !query.data.vec.data) {
+        value_free(&query);
+        sdb_set_error(db, SPEEDSQL_MISMATCH, "vec_distance needs a vector to compare with");
+        return SPEEDSQL_MISMATCH;
+    }
+
+    bool ready = vector_index_ready(db, idx);
+    uint64_t total = ready ? vector_index_count(db, idx) : 0;
+    uint64_t want = (uint64_t)p->limit + (uint64_t)(p->offset > 0 ? p->offset : 0);
+    uint64_t k = want;
+
+    value_t* out_row = stmt->current_row;
+    value_t* projected = (value_t*)sdb_calloc(p->column_count > 0 ? p->column_count : 1,
+                                              sizeof(value_t));
+    int64_t* rowids = nullptr;
+    rc = !ready ? SPEEDSQL_CORRUPT : (!projected ? SPEEDSQL_NOMEM : SPEEDSQL_OK);
+
+    while (rc == SPEEDSQL_OK) {
+        if (k > total) k = total;
+        if (k > UINT32_MAX) k = UINT32_MAX;
+
+        int64_t* grown = (int64_t*)sdb_realloc(rowids, (k > 0 ? k : 1) * sizeof(int64_t));
+        if (!grown) {
+            rc = SPEEDSQL_NOMEM;
+            break;
+        }
+        rowids = grown;
+
+        uint32_t found = 0;
+        rc = vector_index_search(db, table, idx, query.data.vec.data, query.data.vec.dimensions,
+                                 (uint32_t)k, rowids, nullptr, &found);
+        if (rc == SPEEDSQL_MISMATCH) {
+            sdb_set_error(db, rc, "Query vector dimensions do not match index '%s'", idx->name);
+        }
+
+        result_buffer_free(buf);
+        result_buffer_init(buf, p->column_count);
+
+        for (uint32_t i = 0; i < found && rc == SPEEDSQL_OK; i++) {
+            value_t key, value;
+            btree_int_key(&key, rowids[i]);
+            value_init_null(&value);
+
+            if (btree_find((btree_t*)table->data_tree, &key, &value) == SPEEDSQL_OK &&
+                value.type == VAL_BLOB && value.data.blob.data) {
+                stmt->current_row = row_record_values(stmt->db, &value);
+                stmt->column_count = *(int*)value.data.blob.data;
+
+                bool pass_filter = true;
+                if (p->where) {
+                    value_t filter_result;
+                    value_init_null(&filter_result);
+                    eval_expr(stmt, p->where, &filter_result);
+                    pass_filter = (filter_result.type != VAL_NULL && filter_result.data.i != 0);
+                    value_free(&filter_result);
+                }
+
+                if (pass_filter) {
+                    for (int j = 0; j < p->column_count; j++) {
+                        value_init_null(&projected[j]);
+                        if (p->columns[j].expr) eval_expr(stmt, p->columns[j].expr, &projected[j]);
+                    }
+                    result_buffer_add(buf, projected);
+                    for (int j = 0; j < p->column_count; j++) {
+                        value_free(&projected[j]);
+                    }
+                }
+            }
+
+            value_free(&key);
+            value_free(&value);
+        }
+
+        /* Enough rows, or nothing further to find */
+        if ((uint64_t)buf->row_count >= want || found < k || k >= total) break;
+        k *= 4;
+    }
+
+    stmt->current_row = out_row;
+    stmt->column_count = p->column_count;
+    sdb_free(rowids);
+    sdb_free(projected);
+    value_free(&query);
+    return rc;
+}
+
+/* ============================================================================
+ * Full-Text Match: WHERE column MATCH 'query'
+ * ============================================================================ */
+
+/* A conjunct of expr, column MATCH a literal or parameter, on a column of
+ * table with a full-text index */
+static expr_t* find_fts_conjunct(speedsql* db, table_def_t* table, expr_t* expr,
+                                 index_def_t** index) {
+    if (!expr || expr->type != EXPR_BINARY_OP) return nullptr;
+
+    if (expr->data.binary.op == TOK_AND) {
+        expr_t* found = find_fts_conjunct(db, table, expr->data.binary.left, index);
+        return found ? found : find_fts_conjunct(db, table, expr->data.binary.right, index);
+    }
+    if (expr->data.binary.op != TOK_MATCH) return nullptr;
+
+    expr_t* column = expr->data.binary.left;
+    expr_t* query = expr->data.binary.right;
+    if (!column || column->type != EXPR_COLUMN || !query ||
+        (query->type != EXPR_LITERAL && query->type != EXPR_PARAMETER)) {
+        return nullptr;
+    }
+
+    for (size_t i = 0; i < db->index_count; i++) {
+        index_def_t* idx = &db->indices[i];
+        if (is_fts_index_on(idx, table) &&
+            (int)idx->column_indices[0] == column->data.column_ref.index) {
+            *index = idx;
+            return expr;
+        }
+    }
+    return nullptr;
+}
+
+/* The full-text index that can produce the statement's candidate rows:
+ * one MATCH among the top-level conjuncts of WHERE, with no joins,
+ * grouping or aggregates. *match is set to that conjunct. */
+static index_def_t* match_fts_where(speedsql* db, table_def_t* table, parsed_stmt_t* p,
+                                    expr_t** match) {
+    if (!p->where || p->join_count > 0 || p->group_by_count > 0) return nullptr;
+    for (int i = 0; i < p->column_count; i++) {
+        if (has_aggregate(p->columns[i].expr)) return nullptr;
+    }
+
+    index_def_t* idx = nullptr;
+    *match = find_fts_conjunct(db, table, p->where, &idx);
+    return *match ? idx : nullptr;
+}
+
+/* WHERE over the current row, taking the conjunct skip as true */
+static bool eval_where_except(speedsql_stmt* stmt, expr_t* expr, const expr_t* skip) {
+    if (expr == skip) return true;
+    if (expr->type == EXPR_BINARY_OP && expr->data.binary.op == TOK_AND) {
+        return eval_where_except(stmt, expr->data.binary.left, skip) &&
+               eval_where_except(stmt, expr->data.binary.right, skip);
+    }
+
+    value_t result;
+    value_init_null(&result);
+    eval_expr(stmt, expr, &result);
+    bool pass = result.type != VAL_NULL && result.data.i != 0;
+    value_free(&result);
+    return pass;
+}
+
+/* Buffer the rows the index matches that pass the rest of WHERE, in
+ * ORDER BY order when there is one and rowid order otherwise */
+static int fts_match_rows(speedsql_stmt* stmt, table_def_t* table, index_def_t* idx,
+                          expr_t* match, result_buffer_t* buf) {
+    parsed_stmt_t* p = stmt->parsed;
+
+    value_t query;
+    value_init_null(&query);
+    int rc = eval_expr(stmt, match->data.binary.right, &query);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    /* MATCH NULL, or anything but text, matches nothing */
+    int64_t* rowids = nullptr;
+    size_t count = 0;
+    if (query.type == VAL_TEXT && query.data.text.data) {
+        fts_t* f = index_fts(stmt->db, idx);
+        rc = f ? fts_search(f, query.data.text.data, &rowids, &count) : SPEEDSQL_CORRUPT;
+    }
+    value_free(&query);
 
-    if (!g_sort_stmt || !g_sort_stmt->order_by) return 0;
+    value_t* out_row = stmt->current_row;
+    value_t* projected = (value_t*)sdb_calloc(p->column_count > 0 ? p->column_count : 1,
+                                              sizeof(value_t));
+    if (rc == SPEEDSQL_OK && !projected) rc = SPEEDSQL_NOMEM;
 
-    for (int i = 0; i < g_sort_stmt->order_by_count; i++) {
-        order_by_t* ob = &g_sort_stmt->order_by[i];
+    for (size_t i = 0; i < count && rc == SPEEDSQL_OK; i++) {
+        value_t key, value;
+        btree_int_key(&key, rowids[i]);
+        value_init_null(&value);
 
-        /* Get column index from expression */
-        int col_idx = 0;
-        if (ob->expr && ob->expr->type == EXPR_COLUMN) {
-            col_idx = ob->expr->data.column_ref.index;
-            if (col_idx < 0) col_idx = 0;
-        }
+        if (btree_find((btree_t*)table->data_tree, &key, &value) == SPEEDSQL_OK &&
+            value.type == VAL_BLOB && value.data.blob.data) {
+            stmt->current_row = row_record_values(stmt->db, &value);
+            stmt->column_count = *(int*)value.data.blob.data;
 
-        int cmp = value_compare(&row_a[col_idx], &row_b[col_idx]);
-        if (cmp != 0) {
-            return ob->desc ? -cmp : cmp;
+            if (eval_where_except(stmt, p->where, match)) {
+                for (int j = 0; j < p->column_count; j++) {
+                    value_init_null(&projected[j]);
+                    if (p->columns[j].expr) eval_expr(stmt, p->columns[j].expr, &projected[j]);
+                }
+                result_buffer_add(buf, projected);
+                for (int j = 0; j < p->column_count; j++) {
+                    value_free(&projected[j]);
+                }
+            }
         }
+
+        value_free(&key);
+        value_free(&value);
     }
-    return 0;
+
+    if (rc == SPEEDSQL_OK && p->order_by_count > 0 && buf->row_count > 0) {
+        g_sort_stmt = p;
+        qsort(buf->rows, buf->row_count, sizeof(value_t*), compare_rows);
+        g_sort_stmt = nullptr;
+    }
+
+    stmt->current_row = out_row;
+    stmt->column_count = p->column_count;
+    sdb_free(rowids);
+    sdb_free(projected);
+    return rc;
 }
 
 /* ============================================================================
@@ -1318,16 +3148,53 @@ static int execute_select_init(speedsql_stmt* stmt) {
         /* Store table reference for SELECT */
         p->tables[0].def = table;
 
-        if (table->data_tree) {
-            /* Try to use an index scan if WHERE clause allows */
-            expr_t* remaining_where = nullptr;
-            plan_node_t* index_plan = try_build_index_scan(stmt->db, table, p->where, &remaining_where);
+        resolve_column_indices(p->where, table);
+        for (int i = 0; i < p->column_count; i++) {
+            resolve_column_indices(p->columns[i].expr, table);
+        }
+
+        expr_t* query = nullptr;
+        index_def_t* vector_index = table->data_tree ?
+            match_vector_order(stmt->db, table, p, &query) : nullptr;
+        expr_t* match = nullptr;
+        index_def_t* fts_index = (table->data_tree && !vector_index) ?
+            match_fts_where(stmt->db, table, p, &match) : nullptr;
+
+        if (vector_index || fts_index) {
+            /* Nearest rows come from the graph already in order, and
+             * matching rows from the full-text index, so the statement
+             * steps through them like a sorted buffer */
+            stmt->plan = (plan_node_t*)sdb_calloc(1, sizeof(plan_node_t));
+            if (!stmt->plan) return SPEEDSQL_NOMEM;
+            stmt->plan->type = PLAN_SORT;
+
+            result_buffer_t buf;
+            result_buffer_init(&buf, p->column_count);
+            int rc = vector_index ? vector_topk_rows(stmt, table, vector_index, query, &buf) :
+                                    fts_match_rows(stmt, table, fts_index, match, &buf);
+            if (rc != SPEEDSQL_OK) {
+                result_buffer_free(&buf);
+                return rc;
+            }
+
+            stmt->plan->data.sort.buffer = buf.rows;
+            stmt->plan->data.sort.buffer_size = buf.row_count;
+            stmt->plan->data.sort.current = 0;
+            sdb_free(buf.sort_keys);
+            stmt->has_row = true;
+        } else if (table->data_tree) {
+            /* An index scan steps rows one at a time, so it serves
+             * queries without joins, ordering, grouping or OFFSET */
+            bool streamed = p->join_count == 0 && p->order_by_count == 0 &&
+                            p->group_by_count == 0 && p->offset == 0;
+            for (int i = 0; i < p->column_count && streamed; i++) {
+                streamed = !has_aggregate(p->columns[i].expr);
+            }
+            plan_node_t* index_plan = streamed ? try_build_index_scan(stmt, table, p->where) :
+                                                 nullptr;
 
             if (index_plan) {
-                /* Use index scan */
                 stmt->plan = index_plan;
-                /* Note: remaining_where could be used for additional filtering */
-                /* For now, the index handles the full condition */
             } else {
                 /* Fall back to full table scan */
                 stmt->plan = (plan_node_t*)sdb_calloc(1, sizeof(plan_node_t));
@@ -1425,8 +3292,8 @@ typedef struct {
     bool* right_matched;  /* For LEFT JOIN tracking */
 } join_state_t;
 
-static void collect_table_rows(btree_t* tree, value_t*** rows_out, int** col_counts_out,
-                                int* row_count_out, int* capacity_out) {
+static void collect_table_rows(speedsql* db, btree_t* tree, value_t*** rows_out,
+                               int** col_counts_out, int* row_count_out, int* capacity_out) {
     btree_cursor_t cursor;
     btree_cursor_init(&cursor, tree);
     btree_cursor_first(&cursor);
@@ -1445,8 +3312,8 @@ static void collect_table_rows(btree_t* tree, value_t*** rows_out, int** col_cou
         btree_cursor_value(&cursor, &value);
 
         if (value.type == VAL_BLOB && value.data.blob.data) {
+            value_t* row_vals = row_record_values(db, &value);
             int col_count = *(int*)value.data.blob.data;
-            value_t* row_vals = (value_t*)((uint8_t*)value.data.blob.data + sizeof(int));
 
             if (*row_count_out >= capacity) {
                 capacity *= 2;
@@ -1520,8 +3387,8 @@ static int execute_select_step(speedsql_stmt* stmt) {
             btree_cursor_value(cursor, &value);
 
             if (value.type == VAL_BLOB && value.data.blob.data) {
+                value_t* row_vals = row_record_values(stmt->db, &value);
                 int col_count = *(int*)value.data.blob.data;
-                value_t* row_vals = (value_t*)((uint8_t*)value.data.blob.data + sizeof(int));
 
                 /* Apply WHERE filter */
                 bool pass_filter = true;
@@ -1619,7 +3486,7 @@ static int execute_select_step(speedsql_stmt* stmt) {
             int left_capacity = 0;
 
             /* Collect left table rows */
-            collect_table_rows((btree_t*)table->data_tree, &left_rows, &left_col_counts,
+            collect_table_rows(stmt->db, (btree_t*)table->data_tree, &left_rows, &left_col_counts,
                                &left_row_count, &left_capacity);
 
             for (int j = 0; j < p->join_count; j++) {
@@ -1634,7 +3501,7 @@ static int execute_select_step(speedsql_stmt* stmt) {
                 int right_row_count = 0;
                 int right_capacity = 0;
 
-                collect_table_rows((btree_t*)right_table->data_tree, &right_rows, &right_col_counts,
+                collect_table_rows(stmt->db, (btree_t*)right_table->data_tree, &right_rows, &right_col_counts,
                                    &right_row_count, &right_capacity);
 
                 /* Track matched rows for LEFT/RIGHT JOIN */
@@ -1847,8 +3714,8 @@ static int execute_select_step(speedsql_stmt* stmt) {
                 btree_cursor_value(cursor, &value);
 
                 if (value.type == VAL_BLOB && value.data.blob.data) {
+                    value_t* row_vals = row_record_values(stmt->db, &value);
                     int col_count = *(int*)value.data.blob.data;
-                    value_t* row_vals = (value_t*)((uint8_t*)value.data.blob.data + sizeof(int));
 
                     /* Apply WHERE filter */
                     bool pass_filter = true;
@@ -1990,7 +3857,7 @@ static int execute_select_step(speedsql_stmt* stmt) {
             btree_cursor_key(idx_cursor, &idx_key);
             btree_cursor_value(idx_cursor, &rowid);
 
-            /* Check if we're still within the search range (for equality, just one row) */
+            /* Stop past the last key of the range */
             value_t* end_key = stmt->plan->data.index_scan.end_key;
             if (end_key) {
                 int cmp = value_compare(&idx_key, end_key);
@@ -2009,41 +3876,49 @@ static int execute_select_step(speedsql_stmt* stmt) {
                 value_init_null(&row_data);
 
                 int rc = btree_find((btree_t*)table->data_tree, &rowid, &row_data);
-                if (rc == SPEEDSQL_OK && row_data.type == VAL_BLOB && row_data.data.blob.data) {
-                    int col_count = *(int*)row_data.data.blob.data;
-                    value_t* row_vals = (value_t*)((uint8_t*)row_data.data.blob.data + sizeof(int));
+                bool pass_filter = rc == SPEEDSQL_OK && row_data.type == VAL_BLOB &&
+                                   row_data.data.blob.data;
+                value_t* row_vals = pass_filter ? row_record_values(stmt->db, &row_data) : nullptr;
+                int col_count = pass_filter ? *(int*)row_data.data.blob.data : 0;
+
+                /* Keys only narrow the rows down: the full WHERE decides */
+                if (pass_filter && p->where) {
+                    value_t* old_row = stmt->current_row;
+                    int old_count = stmt->column_count;
+                    stmt->current_row = row_vals;
+                    stmt->column_count = col_count;
 
-                    /* Resolve column indices if not done */
-                    for (int i = 0; i < p->column_count; i++) {
-                        if (p->columns[i].expr && p->columns[i].expr->type == EXPR_COLUMN) {
-                            if (p->columns[i].expr->data.column_ref.index < 0) {
-                                const char* col_name = p->columns[i].expr->data.column_ref.column;
-                                for (uint32_t c = 0; c < table->column_count; c++) {
-                                    if (strcmp(table->columns[c].name, col_name) == 0) {
-                                        p->columns[i].expr->data.column_ref.index = c;
-                                        break;
-                                    }
-                                }
-                            }
-                        }
-                    }
+                    value_t filter_result;
+                    value_init_null(&filter_result);
+                    eval_expr(stmt, p->where, &filter_result);
+
+                    stmt->current_row = old_row;
+                    stmt->column_count = old_count;
+
+                    pass_filter = (filter_result.type != VAL_NULL && filter_result.data.i != 0);
+                    value_free(&filter_result);
+                }
 
-                    /* Project columns */
-                    for (int i = 0; i < stmt->column_count && i < p->column_count; i++) {
-                        value_free(&stmt->current_row[i]);
+                if (pass_filter) {
+                    /* Project columns; expressions see the stored row */
+                    value_t* out_row = stmt->current_row;
+                    int out_count = stmt->column_count;
+                    for (int i = 0; i < out_count && i < p->column_count; i++) {
+                        value_free(&out_row[i]);
 
                         if (p->columns[i].expr) {
                             if (p->columns[i].expr->type == EXPR_COLUMN) {
                                 int colidx = p->columns[i].expr->data.column_ref.index;
                                 if (colidx >= 0 && colidx < col_count) {
-                                    value_copy(&stmt->current_row[i], &row_vals[colidx]);
+                                    value_copy(&out_row[i], &row_vals[colidx]);
                                 } else {
-                                    value_init_null(&stmt->current_row[i]);
+                                    value_init_null(&out_row[i]);
                                 }
                             } else {
                                 stmt->current_row = row_vals;
                                 stmt->column_count = col_count;
-                                eval_expr(stmt, p->columns[i].expr, &stmt->current_row[i]);
+                                eval_expr(stmt, p->columns[i].expr, &out_row[i]);
+                                stmt->current_row = out_row;
                             }
                         }
                     }
@@ -2059,6 +3934,12 @@ static int execute_select_step(speedsql_stmt* stmt) {
 
                     stmt->has_row = true;
                     stmt->step_count++;
+
+                    /* Check LIMIT */
+                    if (p->limit > 0 && stmt->step_count > p->limit) {
+                        return SPEEDSQL_DONE;
+                    }
+
                     return SPEEDSQL_ROW;
                 }
 
@@ -2090,8 +3971,8 @@ static int execute_select_step(speedsql_stmt* stmt) {
 
         bool pass_filter = true;
         if (p->where && value.type == VAL_BLOB && value.data.blob.data) {
+            value_t* row_vals = row_record_values(stmt->db, &value);
             int col_count = *(int*)value.data.blob.data;
-            value_t* row_vals = (value_t*)((uint8_t*)value.data.blob.data + sizeof(int));
 
             stmt->current_row = row_vals;
             stmt->column_count = col_count;
@@ -2125,8 +4006,8 @@ static int execute_select_step(speedsql_stmt* stmt) {
 
         /* Unpack row values */
         if (value.type == VAL_BLOB && value.data.blob.data) {
+            value_t* row_vals = row_record_values(stmt->db, &value);
             int col_count = *(int*)value.data.blob.data;
-            value_t* row_vals = (value_t*)((uint8_t*)value.data.blob.data + sizeof(int));
 
             /* Apply WHERE filter if present */
             bool pass_filter = true;
@@ -2164,27 +4045,25 @@ static int execute_select_step(speedsql_stmt* stmt) {
                     }
                 }
 
-                /* Project columns */
-                for (int i = 0; i < stmt->column_count; i++) {
-                    value_free(&stmt->current_row[i]);
+                /* Project columns; expressions see the stored row */
+                value_t* out_row = stmt->current_row;
+                int out_count = stmt->column_count;
+                for (int i = 0; i < out_count; i++) {
+                    value_free(&out_row[i]);
 
                     if (p->columns[i].expr) {
                         if (p->columns[i].expr->type == EXPR_COLUMN) {
                             int idx = p->columns[i].expr->data.column_ref.index;
                             if (idx >= 0 && idx < col_count) {
-                                value_copy(&stmt->current_row[i], &row_vals[idx]);
+                                value_copy(&out_row[i], &row_vals[idx]);
                             } else {
-                                value_init_null(&stmt->current_row[i]);
+                                value_init_null(&out_row[i]);
                             }
                         } else {
                             stmt->current_row = row_vals;
                             stmt->column_count = col_count;
-                            value_t temp_row[32];
-                            for (int j = 0; j < col_count && j < 32; j++) {
-                                value_copy(&temp_row[j], &row_vals[j]);
-                            }
-                            stmt->current_row = temp_row;
-                            eval_expr(stmt, p->columns[i].expr, &stmt->current_row[i]);
+                            eval_expr(stmt, p->columns[i].expr, &out_row[i]);
+                            stmt->current_row = out_row;
                         }
                     }
                 }
@@ -2348,6 +4227,24 @@ SPEEDSQL_API int speedsql_prepare(
         *tail = sql + offset;
     }
 
+    /* Read-only connections (including followers) reject writes */
+    if (db->flags & SPEEDSQL_OPEN_READONLY) {
+        switch (stmt->parsed->op) {
+            case SQL_INSERT:
+            case SQL_UPDATE:
+            case SQL_DELETE:
+            case SQL_CREATE_TABLE:
+            case SQL_DROP_TABLE:
+            case SQL_CREATE_INDEX:
+            case SQL_DROP_INDEX:
+                sdb_set_error(db, SPEEDSQL_READONLY, "Database is read-only");
+                stmt_free_internal(stmt);
+                return SPEEDSQL_READONLY;
+            default:
+                break;
+        }
+    }
+
     /* Count parameters by walking the AST */
     stmt->param_count = count_params_in_stmt(stmt->parsed);
 
@@ -2368,10 +4265,7 @@ SPEEDSQL_API int speedsql_prepare(
  * Public API: speedsql_step
  * ============================================================================ */
 
-SPEEDSQL_API int speedsql_step(speedsql_stmt* stmt) {
-    if (!stmt || !stmt->db) return SPEEDSQL_MISUSE;
-    if (!stmt->parsed) return SPEEDSQL_DONE;
-
+static int step_dispatch(speedsql_stmt* stmt) {
     int rc;
 
     switch (stmt->parsed->op) {
@@ -2483,6 +4377,59 @@ SPEEDSQL_API int speedsql_step(speedsql_stmt* stmt) {
     }
 }
 
+/* File lock a statement holds while it runs: SHARED to read, EXCLUSIVE
+ * to write. Transaction control locks inside the calls it makes. */
+static int stmt_lock_level(const speedsql_stmt* stmt) {
+    switch (stmt->parsed->op) {
+        case SQL_SELECT:
+            return SPEEDSQL_LOCK_SHARED;
+        case SQL_BEGIN:
+        case SQL_COMMIT:
+        case SQL_ROLLBACK:
+        case SQL_SAVEPOINT:
+        case SQL_RELEASE:
+        case SQL_ROLLBACK_TO:
+            return SPEEDSQL_LOCK_NONE;
+        default:
+            return (stmt->db->flags & SPEEDSQL_OPEN_READONLY) ? SPEEDSQL_LOCK_SHARED
+                                                              : SPEEDSQL_LOCK_EXCLUSIVE;
+    }
+}
+
+static void stmt_unlock(speedsql_stmt* stmt) {
+    if (stmt->file_lock != SPEEDSQL_LOCK_NONE) {
+        db_unlock(stmt->db, stmt->file_lock);
+        stmt->file_lock = SPEEDSQL_LOCK_NONE;
+    }
+}
+
+SPEEDSQL_API int speedsql_step(speedsql_stmt* stmt) {
+    if (!stmt || !stmt->db) return SPEEDSQL_MISUSE;
+    if (!stmt->parsed) return SPEEDSQL_DONE;
+
+    stmt_json_clear(stmt);
+
+    /* Held from the first step until the statement completes */
+    if (!stmt->executed && stmt->file_lock == SPEEDSQL_LOCK_NONE) {
+        int level = stmt_lock_level(stmt);
+        if (level != SPEEDSQL_LOCK_NONE) {
+            int rc = db_lock(stmt->db, level);
+            if (rc != SPEEDSQL_OK) return rc;
+            stmt->file_lock = level;
+        }
+    }
+
+    /* Pages a write touches keep their before-image for rollback */
+    bool writing = stmt->file_lock == SPEEDSQL_LOCK_EXCLUSIVE;
+    if (writing) buffer_pool_txn_arm(stmt->db->buffer_pool, true);
+    int rc = step_dispatch(stmt);
+    if (writing) buffer_pool_txn_arm(stmt->db->buffer_pool, false);
+    if (rc != SPEEDSQL_ROW) {
+        stmt_unlock(stmt);
+    }
+    return rc;
+}
+
 /* ============================================================================
  * Public API: speedsql_reset
  * ============================================================================ */
@@ -2493,6 +4440,8 @@ SPEEDSQL_API int speedsql_reset(speedsql_stmt* stmt) {
     stmt->executed = false;
     stmt->has_row = false;
     stmt->step_count = 0;
+    stmt_json_clear(stmt);
+    stmt_unlock(stmt);
 
     /* Reset cursor if exists */
     if (stmt->plan && stmt->plan->type == PLAN_SCAN) {
@@ -2521,6 +4470,8 @@ SPEEDSQL_API int speedsql_reset(speedsql_stmt* stmt) {
 SPEEDSQL_API int speedsql_finalize(speedsql_stmt* stmt) {
     if (!stmt) return SPEEDSQL_MISUSE;
 
+    stmt_unlock(stmt);
+
     /* Close cursor */
     if (stmt->plan && stmt->plan->type == PLAN_SCAN) {
         btree_cursor_close(&stmt->plan->data.scan.cursor);
@@ -2591,8 +4542,23 @@ SPEEDSQL_API int speedsql_bind_blob(speedsql_stmt* stmt, int idx, const void* va
 }
 
 SPEEDSQL_API int speedsql_bind_json(speedsql_stmt* stmt, int idx, const char* json, int len) {
-    /* JSON stored as text for now */
-    return speedsql_bind_text(stmt, idx, json, len, nullptr);
+    if (!stmt || idx < 1 || idx > stmt->param_count) return SPEEDSQL_RANGE;
+    if (!json) {
+        value_free(&stmt->params[idx - 1]);
+        value_init_null(&stmt->params[idx - 1]);
+        return SPEEDSQL_OK;
+    }
+
+    /* Stored parsed, so paths are looked up without reading the text */
+    uint8_t* doc;
+    uint32_t doc_len;
+    int rc = jsonb_from_text(json, len < 0 ? strlen(json) : (size_t)len, &doc, &doc_len);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    value_free(&stmt->params[idx - 1]);
+    value_init_json(&stmt->params[idx - 1], doc, (int)doc_len);
+    sdb_free(doc);
+    return SPEEDSQL_OK;
 }
 
 SPEEDSQL_API int speedsql_bind_vector(speedsql_stmt* stmt, int idx, const float* vec, int dims) {
@@ -2600,8 +4566,7 @@ SPEEDSQL_API int speedsql_bind_vector(speedsql_stmt* stmt, int idx, const float*
 
     value_free(&stmt->params[idx - 1]);
     if (vec && dims > 0) {
-        value_init_blob(&stmt->params[idx - 1], vec, dims * sizeof(float));
-        stmt->params[idx - 1].type = VAL_VECTOR;
+        value_init_vector(&stmt->params[idx - 1], vec, (uint32_t)dims);
     } else {
         value_init_null(&stmt->params[idx - 1]);
     }
@@ -2634,6 +4599,7 @@ SPEEDSQL_API int speedsql_column_type(speedsql_stmt* stmt, int col) {
         case VAL_TEXT:   return SPEEDSQL_TYPE_TEXT;
         case VAL_BLOB:   return SPEEDSQL_TYPE_BLOB;
         case VAL_VECTOR: return SPEEDSQL_TYPE_VECTOR;
+        case VAL_JSON:   return SPEEDSQL_TYPE_JSON;
         default:         return SPEEDSQL_TYPE_NULL;
     }
 }
@@ -2670,6 +4636,28 @@ SPEEDSQL_API double speedsql_column_double(speedsql_stmt* stmt, int col) {
     }
 }
 
+/* A JSON column as text, rendered on first use and kept until the row
+ * changes */
+static const char* column_json_text(speedsql_stmt* stmt, int col) {
+    if (col >= stmt->json_text_count) {
+        char** grown = (char**)sdb_realloc(stmt->json_text, stmt->column_count * sizeof(char*));
+        if (!grown) return nullptr;
+        for (int i = stmt->json_text_count; i < stmt->column_count; i++) grown[i] = nullptr;
+        stmt->json_text = grown;
+        stmt->json_text_count = stmt->column_count;
+    }
+
+    if (!stmt->json_text[col]) {
+        value_t* v = &stmt->current_row[col];
+        jsonb_t root;
+        if (!jsonb_root((const uint8_t*)v->data.text.data, v->data.text.len, &root)) {
+            return nullptr;
+        }
+        jsonb_to_text(&root, &stmt->json_text[col], nullptr);
+    }
+    return stmt->json_text[col];
+}
+
 SPEEDSQL_API const unsigned char* speedsql_column_text(speedsql_stmt* stmt, int col) {
     if (!stmt || col < 0 || col >= stmt->column_count || !stmt->current_row) {
         return nullptr;
@@ -2679,6 +4667,9 @@ SPEEDSQL_API const unsigned char* speedsql_column_text(speedsql_stmt* stmt, int
     if (v->type == VAL_TEXT) {
         return (const unsigned char*)v->data.text.data;
     }
+    if (v->type == VAL_JSON) {
+        return (const unsigned char*)column_json_text(stmt, col);
+    }
     return nullptr;
 }
 
@@ -2702,13 +4693,18 @@ SPEEDSQL_API int speedsql_column_bytes(speedsql_stmt* stmt, int col) {
     value_t* v = &stmt->current_row[col];
     switch (v->type) {
         case VAL_TEXT:   return v->data.text.len;
-        case VAL_BLOB:
-        case VAL_VECTOR: return v->data.blob.len;
+        case VAL_JSON: {
+            const char* text = column_json_text(stmt, col);
+            return text ? (int)strlen(text) : 0;
+        }
+        case VAL_BLOB:   return v->data.blob.len;
+        case VAL_VECTOR: return (int)(v->data.vec.dimensions * sizeof(float));
         default:         return 0;
     }
 }
 
 SPEEDSQL_API const char* speedsql_column_json(speedsql_stmt* stmt, int col) {
+    /* Text columns come back as they were stored, JSON ones rendered */
     return (const char*)speedsql_column_text(stmt, col);
 }
 
@@ -2720,10 +4716,443 @@ SPEEDSQL_API const float* speedsql_column_vector(speedsql_stmt* stmt, int col, i
 
     value_t* v = &stmt->current_row[col];
     if (v->type == VAL_VECTOR) {
-        if (dimensions) *dimensions = v->data.blob.len / sizeof(float);
-        return (const float*)v->data.blob.data;
+        if (dimensions) *dimensions = (int)v->data.vec.dimensions;
+        return v->data.vec.data;
     }
 
     if (dimensions) *dimensions = 0;
     return nullptr;
 }
+
+/* ============================================================================
+ * Public API: speedsql_json_extract
+ * ============================================================================ */
+
+SPEEDSQL_API int speedsql_json_extract(speedsql* db, const char* json, const char* path,
+                                       char** result) {
+    if (!json || !path || !result) return SPEEDSQL_MISUSE;
+    *result = nullptr;
+
+    uint8_t* doc;
+    uint32_t len;
+    int rc = json_extract_text(json, strlen(json), path, &doc, &len);
+    if (rc != SPEEDSQL_OK) {
+        if (db && rc == SPEEDSQL_ERROR) {
+            sdb_set_error(db, rc, "Malformed JSON path '%s'", path);
+        } else if (db && rc == SPEEDSQL_MISMATCH) {
+            sdb_set_error(db, rc, "Malformed JSON");
+        }
+        return rc;
+    }
+
+    /* Strings come back unquoted, null as no result */
+    jsonb_t root;
+    jsonb_root(doc, len, &root);
+    if (jsonb_type(&root) == JSONB_STRING) {
+        uint32_t n;
+        const char* s = jsonb_string(&root, &n);
+        *result = (char*)sdb_malloc((size_t)n + 1);
+        if (*result) {
+            memcpy(*result, s, n);
+            (*result)[n] = '\0';
+        } else {
+            rc = SPEEDSQL_NOMEM;
+        }
+    } else if (jsonb_type(&root) != JSONB_NULL) {
+        rc = jsonb_to_text(&root, result, nullptr);
+    }
+    sdb_free(doc);
+    return rc;
+}
+
+/* ============================================================================
+ * Public API: speedsql_vector_search
+ * ============================================================================ */
+
+/* A finished statement that steps through rowid rows, paired with a
+ * value column named value_name when there is one */
+static int rowid_result_stmt(speedsql* db, const int64_t* rowids, const float* values,
+                             const char* value_name, uint32_t count, speedsql_stmt** out) {
+    const char* names[2] = {"rowid", value_name};
+    int cols = values ? 2 : 1;
+
+    speedsql_stmt* stmt = stmt_alloc(db);
+    if (!stmt) return SPEEDSQL_NOMEM;
+
+    parsed_stmt_t* p = (parsed_stmt_t*)sdb_calloc(1, sizeof(parsed_stmt_t));
+    stmt->parsed = p;
+    stmt->plan = (plan_node_t*)sdb_calloc(1, sizeof(plan_node_t));
+    stmt->column_names = (char**)sdb_calloc(cols, sizeof(char*));
+    stmt->current_row = (value_t*)sdb_calloc(cols, sizeof(value_t));
+    if (!p || !stmt->plan || !stmt->column_names || !stmt->current_row) {
+        stmt_free_internal(stmt);
+        return SPEEDSQL_NOMEM;
+    }
+    stmt->column_count = cols;
+
+    p->op = SQL_SELECT;
+    p->limit = -1;
+    p->columns = (select_col_t*)sdb_calloc(cols, sizeof(select_col_t));
+    p->column_count = cols;
+    stmt->plan->type = PLAN_SORT;
+    stmt->plan->data.sort.buffer = (value_t**)sdb_calloc(count > 0 ? count : 1, sizeof(value_t*));
+
+    bool ok = p->columns && stmt->plan->data.sort.buffer;
+    for (int i = 0; i < cols && ok; i++) {
+        stmt->column_names[i] = sdb_strdup(names[i]);
+        ok = stmt->column_names[i] != nullptr;
+    }
+    for (uint32_t i = 0; i < count && ok; i++) {
+        value_t* row = (value_t*)sdb_calloc(cols, sizeof(value_t));
+        if (!row) {
+            ok = false;
+            break;
+        }
+        value_init_int(&row[0], rowids[i]);
+        if (values) value_init_float(&row[1], values[i]);
+        stmt->plan->data.sort.buffer[stmt->plan->data.sort.buffer_size++] = row;
+    }
+
+    if (!ok) {
+        for (int i = 0; i < stmt->plan->data.sort.buffer_size; i++) {
+            sdb_free(stmt->plan->data.sort.buffer[i]);
+        }
+        sdb_free(stmt->plan->data.sort.buffer);
+        stmt_free_internal(stmt);
+        return SPEEDSQL_NOMEM;
+    }
+
+    stmt->executed = true;
+    stmt->has_row = true;
+    *out = stmt;
+    return SPEEDSQL_OK;
+}
+
+/* Rows scored per batched distance call */
+#define VECTOR_SCAN_BATCH 256
+
+typedef struct {
+    float distance;
+    int64_t rowid;
+} vector_hit_t;
+
+/* Bounded max-heap: the root is the worst of the k best so far */
+static void vector_heap_push(vector_hit_t* heap, uint32_t* size, uint32_t k,
+                             float distance, int64_t rowid) {
+    uint32_t i;
+    if (*size < k) {
+        i = (*size)++;
+        while (i > 0 && heap[(i - 1) / 2].distance < distance) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    } else if (distance < heap[0].distance) {
+        i = 0;
+        for (;;) {
+            uint32_t child = 2 * i + 1;
+            if (child >= *size) break;
+            if (child + 1 < *size && heap[child + 1].distance > heap[child].distance) child++;
+            if (heap[child].distance <= distance) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+    } else {
+        return;
+    }
+    heap[i].distance = distance;
+    heap[i].rowid = rowid;
+}
+
+static int vector_hit_cmp(const void* a, const void* b) {
+    float da = ((const vector_hit_t*)a)->distance;
+    float db = ((const vector_hit_t*)b)->distance;
+    return (da > db) - (da < db);
+}
+
+/* Score a batch gathered back to back, then keep the best */
+static void vector_scan_flush(const float* query, const float* batch, const int64_t* batch_ids,
+                              uint32_t dims, uint32_t count, float* scratch,
+                              vector_hit_t* heap, uint32_t* size, uint32_t k) {
+    vector_distances(VECTOR_L2, query, batch, dims, count, scratch);
+    for (uint32_t i = 0; i < count; i++) {
+        vector_heap_push(heap, size, k, scratch[i], batch_ids[i]);
+    }
+}
+
+/* Exact search without an index: every row's vector, scored in batches */
+static int vector_scan_topk(speedsql* db, table_def_t* tbl, uint32_t col,
+                            const float* query, uint32_t dims, uint32_t k,
+                            int64_t* rowids, float* distances, uint32_t* found) {
+    vector_hit_t* heap = (vector_hit_t*)sdb_malloc((size_t)k * sizeof(vector_hit_t));
+    float* batch = (float*)sdb_malloc((size_t)VECTOR_SCAN_BATCH * dims * sizeof(float));
+    int64_t* batch_ids = (int64_t*)sdb_malloc(VECTOR_SCAN_BATCH * sizeof(int64_t));
+    float* scratch = (float*)sdb_malloc(VECTOR_SCAN_BATCH * sizeof(float));
+    uint32_t size = 0, pending = 0;
+    int rc = (heap && batch && batch_ids && scratch) ? SPEEDSQL_OK : SPEEDSQL_NOMEM;
+
+    if (rc == SPEEDSQL_OK && tbl->data_tree) {
+        btree_cursor_t cursor;
+        btree_cursor_init(&cursor, (btree_t*)tbl->data_tree);
+        btree_cursor_first(&cursor);
+
+        while (rc == SPEEDSQL_OK && cursor.valid && !cursor.at_end) {
+            value_t row_key, row_value;
+            value_init_null(&row_key);
+            value_init_null(&row_value);
+
+            btree_cursor_key(&cursor, &row_key);
+            btree_cursor_value(&cursor, &row_value);
+
+            if (row_value.type == VAL_BLOB && row_value.data.blob.data) {
+                value_t* row_vals = row_record_values(db, &row_value);
+                int col_count = *(int*)row_value.data.blob.data;
+                const value_t* v = (int)col < col_count ? &row_vals[col] : nullptr;
+
+                if (v && v->type != VAL_NULL && v->type != VAL_VECTOR) {
+                    sdb_set_error(db, SPEEDSQL_MISMATCH, "Column %s(%s) is not a vector",
+                                  tbl->name, tbl->columns[col].name);
+                    rc = SPEEDSQL_MISMATCH;
+                } else if (v && v->type == VAL_VECTOR && v->data.vec.data) {
+                    if (v->data.vec.dimensions != dims) {
+                        sdb_set_error(db, SPEEDSQL_MISMATCH,
+                                      "Query vector dimensions do not match %s(%s)",
+                                      tbl->name, tbl->columns[col].name);
+                        rc = SPEEDSQL_MISMATCH;
+                    } else {
+                        memcpy(batch + (size_t)pending * dims, v->data.vec.data,
+                               dims * sizeof(float));
+                        batch_ids[pending++] = btree_key_int(&row_key);
+                        if (pending == VECTOR_SCAN_BATCH) {
+                            vector_scan_flush(query, batch, batch_ids, dims, pending, scratch,
+                                              heap, &size, k);
+                            pending = 0;
+                        }
+                    }
+                }
+            }
+
+            value_free(&row_key);
+            value_free(&row_value);
+            btree_cursor_next(&cursor);
+        }
+        btree_cursor_close(&cursor);
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        vector_scan_flush(query, batch, batch_ids, dims, pending, scratch, heap, &size, k);
+        qsort(heap, size, sizeof(vector_hit_t), vector_hit_cmp);
+        for (uint32_t i = 0; i < size; i++) {
+            rowids[i] = heap[i].rowid;
+            distances[i] = heap[i].distance;
+        }
+        *found = size;
+    }
+
+    sdb_free(heap);
+    sdb_free(batch);
+    sdb_free(batch_ids);
+    sdb_free(scratch);
+    return rc;
+}
+
+SPEEDSQL_API int speedsql_vector_search(
+    speedsql* db,
+    const char* table,
+    const char* column,
+    const float* query_vector,
+    int dimensions,
+    int top_k,
+    speedsql_stmt** result
+) {
+    if (!result) return SPEEDSQL_MISUSE;
+    *result = nullptr;
+    if (!db || !table || !column || !query_vector || dimensions <= 0 || top_k <= 0) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    table_def_t* tbl = find_table(db, table);
+    if (!tbl) {
+        sdb_set_error(db, SPEEDSQL_ERROR, "Table '%s' not found", table);
+        return SPEEDSQL_ERROR;
+    }
+
+    index_def_t* idx = nullptr;
+    for (size_t i = 0; i < db->index_count && !idx; i++) {
+        index_def_t* candidate = &db->indices[i];
+        if (is_vector_index_on(candidate, tbl) &&
+            candidate->column_indices[0] < tbl->column_count &&
+            strcasecmp(tbl->columns[candidate->column_indices[0]].name, column) == 0) {
+            idx = candidate;
+        }
+    }
+
+    /* Without an index, an exact scan of the column */
+    uint32_t col = 0;
+    if (!idx) {
+        while (col < tbl->column_count && strcasecmp(tbl->columns[col].name, column) != 0) col++;
+        if (col == tbl->column_count) {
+            sdb_set_error(db, SPEEDSQL_NOTFOUND, "Column '%s' not found in '%s'", column, table);
+            return SPEEDSQL_NOTFOUND;
+        }
+    }
+
+    if (idx && !vector_index_ready(db, idx)) return SPEEDSQL_CORRUPT;
+
+    int64_t* rowids = (int64_t*)sdb_malloc((size_t)top_k * sizeof(int64_t));
+    float* distances = (float*)sdb_malloc((size_t)top_k * sizeof(float));
+    uint32_t found = 0;
+    int rc = SPEEDSQL_NOMEM;
+    if (rowids && distances && idx) {
+        rc = vector_index_search(db, tbl, idx, query_vector, (uint32_t)dimensions,
+                                 (uint32_t)top_k, rowids, distances, &found);
+        if (rc == SPEEDSQL_MISMATCH) {
+            sdb_set_error(db, rc, "Query vector dimensions do not match index '%s'", idx->name);
+        }
+    } else if (rowids && distances) {
+        rc = vector_scan_topk(db, tbl, col, query_vector, (uint32_t)dimensions,
+                              (uint32_t)top_k, rowids, distances, &found);
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        rc = rowid_result_stmt(db, rowids, distances, "distance", found, result);
+    }
+
+    sdb_free(rowids);
+    sdb_free(distances);
+    return rc;
+}
+
+/* ============================================================================
+ * Public API: speedsql_fts_search, speedsql_fts_search_topk
+ * ============================================================================ */
+
+typedef struct {
+    int64_t rowid;
+    float score;
+} fts_scored_t;
+
+static int fts_scored_by_rowid(const void* a, const void* b) {
+    const fts_scored_t* x = (const fts_scored_t*)a;
+    const fts_scored_t* y = (const fts_scored_t*)b;
+    if (x->rowid != y->rowid) return x->rowid < y->rowid ? -1 : 1;
+    return x->score > y->score ? -1 : (x->score < y->score ? 1 : 0);
+}
+
+/* Best first; ties go to the smaller rowid */
+static int fts_scored_by_score(const void* a, const void* b) {
+    const fts_scored_t* x = (const fts_scored_t*)a;
+    const fts_scored_t* y = (const fts_scored_t*)b;
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    return x->rowid < y->rowid ? -1 : (x->rowid > y->rowid ? 1 : 0);
+}
+
+/* The top_k (0: all) ranked matches of every full-text index on the
+ * table; a row found through several keeps its best score */
+static int fts_search_ranked(speedsql* db, const char* table, const char* query, size_t top_k,
+                             speedsql_stmt** result) {
+    table_def_t* tbl = find_table(db, table);
+    if (!tbl) {
+        sdb_set_error(db, SPEEDSQL_ERROR, "Table '%s' not found", table);
+        return SPEEDSQL_ERROR;
+    }
+
+    fts_scored_t* hits = nullptr;
+    size_t count = 0;
+    size_t indexes = 0;
+    int rc = SPEEDSQL_OK;
+    for (size_t i = 0; i < db->index_count && rc == SPEEDSQL_OK; i++) {
+        index_def_t* idx = &db->indices[i];
+        if (!is_fts_index_on(idx, tbl)) continue;
+        indexes++;
+
+        fts_t* f = index_fts(db, idx);
+        if (!f) {
+            rc = SPEEDSQL_CORRUPT;
+            break;
+        }
+        int64_t* rowids = nullptr;
+        float* scores = nullptr;
+        size_t found = 0;
+        rc = fts_rank(f, query, top_k, &rowids, &scores, &found);
+        if (rc == SPEEDSQL_OK && found > 0) {
+            fts_scored_t* grown = (fts_scored_t*)sdb_realloc(hits,
+                                                             (count + found) * sizeof(fts_scored_t));
+            if (!grown) {
+                rc = SPEEDSQL_NOMEM;
+            } else {
+                hits = grown;
+                for (size_t j = 0; j < found; j++) {
+                    hits[count].rowid = rowids[j];
+                    hits[count++].score = scores[j];
+                }
+            }
+        }
+        sdb_free(rowids);
+        sdb_free(scores);
+    }
+
+    if (rc == SPEEDSQL_OK && indexes == 0) {
+        sdb_set_error(db, SPEEDSQL_NOTFOUND, "No full-text index on '%s'", table);
+        rc = SPEEDSQL_NOTFOUND;
+    }
+
+    /* Each index's top_k holds every row that can make the merged one */
+    if (rc == SPEEDSQL_OK && indexes > 1 && count > 0) {
+        qsort(hits, count, sizeof(fts_scored_t), fts_scored_by_rowid);
+        size_t n = 1;
+        for (size_t i = 1; i < count; i++) {
+            if (hits[i].rowid != hits[n - 1].rowid) hits[n++] = hits[i];
+        }
+        count = n;
+        qsort(hits, count, sizeof(fts_scored_t), fts_scored_by_score);
+        if (top_k > 0 && count > top_k) count = top_k;
+    }
+    if (rc == SPEEDSQL_OK && count > UINT32_MAX) rc = SPEEDSQL_RANGE;
+
+    int64_t* rowids = nullptr;
+    float* scores = nullptr;
+    if (rc == SPEEDSQL_OK && count > 0) {
+        rowids = (int64_t*)sdb_malloc(count * sizeof(int64_t));
+        scores = (float*)sdb_malloc(count * sizeof(float));
+        if (!rowids || !scores) rc = SPEEDSQL_NOMEM;
+    }
+    if (rc == SPEEDSQL_OK) {
+        for (size_t i = 0; i < count; i++) {
+            rowids[i] = hits[i].rowid;
+            scores[i] = hits[i].score;
+        }
+        rc = rowid_result_stmt(db, rowids, scores, "score", (uint32_t)count, result);
+    }
+
+    sdb_free(rowids);
+    sdb_free(scores);
+    sdb_free(hits);
+    return rc;
+}
+
+SPEEDSQL_API int speedsql_fts_search(
+    speedsql* db,
+    const char* table,
+    const char* query,
+    speedsql_stmt** result
+) {
+    if (!result) return SPEEDSQL_MISUSE;
+    *result = nullptr;
+    if (!db || !table || !query) return SPEEDSQL_MISUSE;
+
+    return fts_search_ranked(db, table, query, 0, result);
+}
+
+SPEEDSQL_API int speedsql_fts_search_topk(
+    speedsql* db,
+    const char* table,
+    const char* query,
+    int top_k,
+    speedsql_stmt** result
+) {
+    if (!result) return SPEEDSQL_MISUSE;
+    *result = nullptr;
+    if (!db || !table || !query || top_k <= 0) return SPEEDSQL_MISUSE;
+
+    return fts_search_ranked(db, table, query, (size_t)top_k, result);
+}
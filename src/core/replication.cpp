@@ -0,0 +1,132 @@
+/*
+ * SpeedSQL - WAL shipping
+ *
+ * With SPEEDSQL_OPEN_WAL every page image the buffer pool writes is logged
+ * (ciphertext for encrypted databases), and each commit ends with the
+ * header and schema pages plus a commit record. That makes the log a
+ * complete redo stream: a follower replays page images one committed
+ * transaction at a time and ends up byte-identical to the primary.
+ */
+
+#include "speedsql_internal.h"
+
+SPEEDSQL_API int speedsql_wal_export(speedsql* db, uint64_t from_lsn,
+                                     const char* segment_path, uint64_t* next_lsn) {
+    if (!db || !segment_path) return SPEEDSQL_MISUSE;
+
+    if (!db->wal) {
+        sdb_set_error(db, SPEEDSQL_MISUSE, "WAL is not enabled on this connection");
+        return SPEEDSQL_MISUSE;
+    }
+
+    mutex_lock(&db->lock);
+
+    /* Outside a transaction, ship pending writes so the export is current */
+    int rc = SPEEDSQL_OK;
+    if (db->txn_state == TXN_NONE) {
+        rc = commit_to_wal(db, db->buffer_pool->stamp_txn);
+    }
+
+    mutex_unlock(&db->lock);
+
+    if (rc != SPEEDSQL_OK) {
+        sdb_set_error(db, rc, "Failed to ship pending writes");
+        return rc;
+    }
+
+    file_t out;
+    rc = file_open_vfs(&out, db->vfs, segment_path,
+                       SPEEDSQL_VFS_OPEN_READWRITE | SPEEDSQL_VFS_OPEN_CREATE);
+    if (rc != SPEEDSQL_OK) {
+        sdb_set_error(db, SPEEDSQL_CANTOPEN, "Cannot open segment file: %s", segment_path);
+        return SPEEDSQL_CANTOPEN;
+    }
+
+    rc = wal_export(db->wal, from_lsn, &out, next_lsn);
+    file_close(&out);
+
+    if (rc == SPEEDSQL_NOTFOUND) {
+        sdb_set_error(db, rc, "WAL was checkpointed past LSN %llu; reseed from a database copy",
+                      (unsigned long long)from_lsn);
+    } else if (rc != SPEEDSQL_OK) {
+        sdb_set_error(db, rc, "Failed to export WAL segment: %s", segment_path);
+    }
+    return rc;
+}
+
+SPEEDSQL_API int speedsql_follower_open(const char* filename, speedsql** db_out) {
+    if (!filename || !db_out) return SPEEDSQL_MISUSE;
+
+    int rc = speedsql_open_v2(filename, db_out,
+                              SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE, nullptr);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    if ((*db_out)->flags & SPEEDSQL_OPEN_MEMORY) {
+        speedsql_close(*db_out);
+        *db_out = nullptr;
+        return SPEEDSQL_MISUSE;
+    }
+
+    /* The file stays writable for redo; statements see a read-only database */
+    (*db_out)->flags |= SPEEDSQL_OPEN_READONLY;
+    return SPEEDSQL_OK;
+}
+
+SPEEDSQL_API int speedsql_follower_apply(speedsql* db, const char* wal_path) {
+    if (!db || !wal_path) return SPEEDSQL_MISUSE;
+
+    if (!(db->flags & SPEEDSQL_OPEN_READONLY) || (db->flags & SPEEDSQL_OPEN_MEMORY)) {
+        sdb_set_error(db, SPEEDSQL_MISUSE, "Not a follower connection");
+        return SPEEDSQL_MISUSE;
+    }
+
+    file_t log;
+    int rc = file_open_vfs(&log, db->vfs, wal_path, 0);
+    if (rc != SPEEDSQL_OK) {
+        sdb_set_error(db, SPEEDSQL_CANTOPEN, "Cannot open WAL: %s", wal_path);
+        return SPEEDSQL_CANTOPEN;
+    }
+
+    mutex_lock(&db->lock);
+
+    /* Tailing the same log resumes where the last apply stopped */
+    bool same_source = db->follower_source && strcmp(db->follower_source, wal_path) == 0;
+    uint64_t pos = same_source ? db->follower_pos : 0;
+    uint64_t applied_before = db->follower_lsn;
+
+    /* A sealed log needs the follower keyed like its primary; readers of
+     * the follower's file wait while pages change under them */
+    rc = db_lock(db, SPEEDSQL_LOCK_EXCLUSIVE);
+    if (rc == SPEEDSQL_OK) {
+        rc = wal_redo(&log, &db->db_file, db->cipher_ctx, db->cipher_id, &pos, &db->follower_lsn);
+        db_unlock(db, SPEEDSQL_LOCK_EXCLUSIVE);
+    }
+
+    if (!same_source) {
+        char* source = sdb_strdup(wal_path);
+        if (source) {
+            sdb_free(db->follower_source);
+            db->follower_source = source;
+        }
+    }
+    if (db->follower_source && strcmp(db->follower_source, wal_path) == 0) {
+        db->follower_pos = pos;
+    }
+
+    /* New pages, header and schema: drop everything cached */
+    if (db->follower_lsn != applied_before) {
+        int reload_rc = reload_schema(db);
+        if (rc == SPEEDSQL_OK) rc = reload_rc;
+    }
+
+    mutex_unlock(&db->lock);
+    file_close(&log);
+
+    if (rc == SPEEDSQL_NOTFOUND) {
+        sdb_set_error(db, rc, "WAL was checkpointed past LSN %llu; reseed from a database copy",
+                      (unsigned long long)db->follower_lsn);
+    } else if (rc != SPEEDSQL_OK && db->errcode != rc) {
+        sdb_set_error(db, rc, "Failed to apply WAL: %s", wal_path);
+    }
+    return rc;
+}
@@ -0,0 +1,424 @@
+/*
+ * SpeedSQL - Point-in-time snapshots
+ *
+ * speedsql_snapshot_open returns a read-only connection that keeps seeing
+ * the database as it was when the snapshot was taken, without blocking
+ * the writer.
+ *
+ * Where the filesystem supports reflinks (FICLONE on btrfs/XFS, clonefile
+ * on APFS) the snapshot opens a copy-on-write clone of the file. Otherwise
+ * it reads the live file through a private VFS, and the writer retains the
+ * old contents of each block the first time it overwrites it.
+ */
+
+#include "speedsql_internal.h"
+
+/* Retention granularity (divides both plain and encrypted page strides) */
+#define SNAP_BLOCK_SIZE 4096
+
+/* Initial retention hash buckets */
+#define SNAP_MIN_BUCKETS 256
+
+typedef struct snap_block {
+    uint64_t index;              /* Offset / SNAP_BLOCK_SIZE */
+    struct snap_block* next;
+    uint8_t data[SNAP_BLOCK_SIZE];
+} snap_block_t;
+
+struct db_snapshot {
+    speedsql* owner;             /* Writer being retained for (NULL once closed) */
+    struct db_snapshot* next;    /* Owner's snapshot list */
+
+    char* clone_path;            /* Reflink copy, deleted with the snapshot */
+
+    /* Page-version retention */
+    speedsql_vfs vfs;            /* Private VFS serving the snapshot view */
+    speedsql_vfs* base_vfs;      /* VFS of the live file */
+    uint64_t base_size;          /* File size when the snapshot was taken */
+    snap_block_t** buckets;
+    size_t bucket_count;
+    size_t block_count;
+    mutex_t lock;
+};
+
+/* Snapshot file handle: the live file plus the retained blocks */
+typedef struct {
+    db_snapshot* snap;
+    file_t base;
+} snap_file_t;
+
+/* Guards every owner's snapshot list and the owner links */
+static struct {
+    mutex_t lock;
+} g_snapshots = {};
+
+static once_t g_snapshots_once = ONCE_INIT;
+
+static void snapshot_registry_setup(void) {
+    mutex_init(&g_snapshots.lock);
+}
+
+static void snapshot_registry_init(void) {
+    once_run(&g_snapshots_once, snapshot_registry_setup);
+}
+
+/* ============================================================================
+ * Retained blocks
+ * ============================================================================ */
+
+static snap_block_t* snap_find(db_snapshot* snap, uint64_t index) {
+    snap_block_t* block = snap->buckets[index % snap->bucket_count];
+    while (block && block->index != index) {
+        block = block->next;
+    }
+    return block;
+}
+
+static void snap_grow(db_snapshot* snap) {
+    size_t new_count = snap->bucket_count * 2;
+    snap_block_t** buckets = (snap_block_t**)sdb_calloc(new_count, sizeof(snap_block_t*));
+    if (!buckets) return;  /* Keep the longer chains */
+
+    for (size_t i = 0; i < snap->bucket_count; i++) {
+        snap_block_t* block = snap->buckets[i];
+        while (block) {
+            snap_block_t* next = block->next;
+            size_t slot = block->index % new_count;
+            block->next = buckets[slot];
+            buckets[slot] = block;
+            block = next;
+        }
+    }
+
+    sdb_free(snap->buckets);
+    snap->buckets = buckets;
+    snap->bucket_count = new_count;
+}
+
+/* Save the current contents of the blocks in [offset, offset + len) that
+ * existed at snapshot time and have not been saved yet */
+static int snap_retain(db_snapshot* snap, file_t* live, uint64_t offset, uint64_t len) {
+    if (len == 0 || offset >= snap->base_size) return SPEEDSQL_OK;
+
+    uint64_t end = offset + len;
+    if (end > snap->base_size || end < offset) end = snap->base_size;
+
+    int rc = SPEEDSQL_OK;
+    mutex_lock(&snap->lock);
+
+    for (uint64_t index = offset / SNAP_BLOCK_SIZE;
+         index * SNAP_BLOCK_SIZE < end && rc == SPEEDSQL_OK; index++) {
+        if (snap_find(snap, index)) continue;
+
+        snap_block_t* block = (snap_block_t*)sdb_malloc(sizeof(snap_block_t));
+        if (!block) {
+            rc = SPEEDSQL_NOMEM;
+            break;
+        }
+
+        uint64_t start = index * SNAP_BLOCK_SIZE;
+        size_t n = SNAP_BLOCK_SIZE;
+        if (start + n > snap->base_size) {
+            n = (size_t)(snap->base_size - start);
+            memset(block->data + n, 0, SNAP_BLOCK_SIZE - n);
+        }
+
+        rc = file_read(live, start, block->data, n);
+        if (rc != SPEEDSQL_OK) {
+            sdb_free(block);
+            break;
+        }
+
+        size_t slot = index % snap->bucket_count;
+        block->index = index;
+        block->next = snap->buckets[slot];
+        snap->buckets[slot] = block;
+
+        if (++snap->block_count > snap->bucket_count * 2) {
+            snap_grow(snap);
+        }
+    }
+
+    mutex_unlock(&snap->lock);
+    return rc;
+}
+
+/* before_write hook on the writer's database file */
+static int snapshot_before_write(void* arg, uint64_t offset, uint64_t len) {
+    speedsql* db = (speedsql*)arg;
+    int rc = SPEEDSQL_OK;
+
+    mutex_lock(&g_snapshots.lock);
+    for (db_snapshot* snap = db->snapshots; snap && rc == SPEEDSQL_OK; snap = snap->next) {
+        rc = snap_retain(snap, &db->db_file, offset, len);
+    }
+    mutex_unlock(&g_snapshots.lock);
+
+    /* A block that cannot be retained must not be overwritten */
+    return rc;
+}
+
+/* ============================================================================
+ * Snapshot VFS
+ * ============================================================================ */
+
+static int snap_vfs_open(speedsql_vfs* vfs, const char* path, int flags,
+                         speedsql_vfs_file** file_out) {
+    if (flags & (SPEEDSQL_VFS_OPEN_READWRITE | SPEEDSQL_VFS_OPEN_CREATE)) {
+        return SPEEDSQL_READONLY;
+    }
+
+    db_snapshot* snap = (db_snapshot*)vfs->app_data;
+
+    snap_file_t* sf = (snap_file_t*)sdb_calloc(1, sizeof(snap_file_t));
+    if (!sf) return SPEEDSQL_NOMEM;
+
+    int rc = file_open_vfs(&sf->base, snap->base_vfs, path, 0);
+    if (rc != SPEEDSQL_OK) {
+        sdb_free(sf);
+        return rc;
+    }
+
+    sf->snap = snap;
+    *file_out = (speedsql_vfs_file*)sf;
+    return SPEEDSQL_OK;
+}
+
+static int snap_vfs_close(speedsql_vfs_file* file) {
+    snap_file_t* sf = (snap_file_t*)file;
+    file_close(&sf->base);
+    sdb_free(sf);
+    return SPEEDSQL_OK;
+}
+
+static int snap_vfs_read(speedsql_vfs_file* file, uint64_t offset, void* buf, size_t len) {
+    snap_file_t* sf = (snap_file_t*)file;
+    db_snapshot* snap = sf->snap;
+
+    /* The file ends where it ended at snapshot time */
+    if (offset + len > snap->base_size) return SPEEDSQL_IOERR;
+
+    /* Holding the lock orders this read against retain-then-overwrite */
+    mutex_lock(&snap->lock);
+
+    int rc = file_read(&sf->base, offset, buf, len);
+
+    if (rc == SPEEDSQL_OK && snap->block_count > 0 && len > 0) {
+        uint64_t end = offset + len;
+        for (uint64_t index = offset / SNAP_BLOCK_SIZE; index * SNAP_BLOCK_SIZE < end; index++) {
+            const snap_block_t* block = snap_find(snap, index);
+            if (!block) continue;
+
+            uint64_t start = index * SNAP_BLOCK_SIZE;
+            uint64_t from = start > offset ? start : offset;
+            uint64_t to = start + SNAP_BLOCK_SIZE < end ? start + SNAP_BLOCK_SIZE : end;
+            memcpy((uint8_t*)buf + (from - offset), block->data + (from - start),
+                   (size_t)(to - from));
+        }
+    }
+
+    mutex_unlock(&snap->lock);
+    return rc;
+}
+
+static int snap_vfs_write(speedsql_vfs_file* file, uint64_t offset, const void* buf, size_t len) {
+    (void)file;
+    (void)offset;
+    (void)buf;
+    (void)len;
+    return SPEEDSQL_READONLY;
+}
+
+static int snap_vfs_sync(speedsql_vfs_file* file) {
+    (void)file;
+    return SPEEDSQL_OK;
+}
+
+static int snap_vfs_truncate(speedsql_vfs_file* file, uint64_t size) {
+    (void)file;
+    (void)size;
+    return SPEEDSQL_READONLY;
+}
+
+static int snap_vfs_file_size(speedsql_vfs_file* file, uint64_t* size) {
+    *size = ((snap_file_t*)file)->snap->base_size;
+    return SPEEDSQL_OK;
+}
+
+static void snapshot_free(db_snapshot* snap) {
+    if (snap->buckets) {
+        for (size_t i = 0; i < snap->bucket_count; i++) {
+            snap_block_t* block = snap->buckets[i];
+            while (block) {
+                snap_block_t* next = block->next;
+                sdb_free(block);
+                block = next;
+            }
+        }
+        sdb_free(snap->buckets);
+    }
+
+    if (snap->clone_path) {
+        remove(snap->clone_path);
+        sdb_free(snap->clone_path);
+    }
+
+    mutex_destroy(&snap->lock);
+    sdb_free(snap);
+}
+
+/* Unlink a retention snapshot from its writer */
+static void snapshot_unlink(db_snapshot* snap) {
+    mutex_lock(&g_snapshots.lock);
+
+    if (snap->owner) {
+        db_snapshot** link = &snap->owner->snapshots;
+        while (*link && *link != snap) {
+            link = &(*link)->next;
+        }
+        if (*link) *link = snap->next;
+        snap->owner = nullptr;
+    }
+
+    mutex_unlock(&g_snapshots.lock);
+}
+
+/* ============================================================================
+ * Public API
+ * ============================================================================ */
+
+SPEEDSQL_API int speedsql_snapshot_open(speedsql* db, speedsql** snapshot_out) {
+    if (!db || !snapshot_out) return SPEEDSQL_MISUSE;
+
+    *snapshot_out = nullptr;
+
+    if (db->flags & SPEEDSQL_OPEN_MEMORY) {
+        sdb_set_error(db, SPEEDSQL_MISUSE,
+                      "Use speedsql_memory_snapshot for in-memory databases");
+        return SPEEDSQL_MISUSE;
+    }
+
+    if (db->encrypted) {
+        sdb_set_error(db, SPEEDSQL_MISUSE,
+                      "Snapshots of encrypted databases are not supported");
+        return SPEEDSQL_MISUSE;
+    }
+
+    snapshot_registry_init();
+
+    db_snapshot* snap = (db_snapshot*)sdb_calloc(1, sizeof(db_snapshot));
+    if (!snap) return SPEEDSQL_NOMEM;
+    mutex_init(&snap->lock);
+
+    mutex_lock(&db->lock);
+
+    /* Pages of an open transaction must not leak into the snapshot */
+    int rc = SPEEDSQL_OK;
+    if (db->txn_state != TXN_NONE) {
+        sdb_set_error(db, SPEEDSQL_BUSY, "Cannot open a snapshot inside a transaction");
+        rc = SPEEDSQL_BUSY;
+    }
+
+    /* Bring the file up to date with the connection */
+    if (rc == SPEEDSQL_OK) {
+        if (db->wal) {
+            rc = commit_to_wal(db, db->buffer_pool->stamp_txn);
+        } else {
+            rc = buffer_pool_flush(db->buffer_pool, &db->db_file);
+            if (rc == SPEEDSQL_OK) rc = save_schema(db);
+        }
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s-snap-%llu", db->db_file.path,
+                 (unsigned long long)get_timestamp_us());
+
+        if (file_clone(&db->db_file, path) == SPEEDSQL_OK) {
+            snap->clone_path = sdb_strdup(path);
+            if (!snap->clone_path) {
+                remove(path);
+                rc = SPEEDSQL_NOMEM;
+            }
+        } else {
+            /* No reflinks: retain old block versions from now on */
+            snap->bucket_count = SNAP_MIN_BUCKETS;
+            snap->buckets = (snap_block_t**)sdb_calloc(snap->bucket_count, sizeof(snap_block_t*));
+            if (!snap->buckets) rc = SPEEDSQL_NOMEM;
+        }
+    }
+
+    if (rc == SPEEDSQL_OK && !snap->clone_path) {
+        file_size(&db->db_file, &snap->base_size);
+        snap->base_vfs = db->vfs;
+
+        snap->vfs.name = "snapshot";
+        snap->vfs.app_data = snap;
+        snap->vfs.open = snap_vfs_open;
+        snap->vfs.close = snap_vfs_close;
+        snap->vfs.read = snap_vfs_read;
+        snap->vfs.write = snap_vfs_write;
+        snap->vfs.sync = snap_vfs_sync;
+        snap->vfs.truncate = snap_vfs_truncate;
+        snap->vfs.file_size = snap_vfs_file_size;
+
+        mutex_lock(&g_snapshots.lock);
+        snap->owner = db;
+        snap->next = db->snapshots;
+        db->snapshots = snap;
+        db->db_file.before_write = snapshot_before_write;
+        db->db_file.before_write_arg = db;
+        mutex_unlock(&g_snapshots.lock);
+    }
+
+    mutex_unlock(&db->lock);
+
+    if (rc != SPEEDSQL_OK) {
+        snapshot_free(snap);
+        return rc;
+    }
+
+    /* Open the view read-only: the clone directly, otherwise through the snapshot VFS */
+    speedsql* conn = nullptr;
+    if (snap->clone_path) {
+        rc = open_connection(snap->clone_path, &conn, SPEEDSQL_OPEN_READONLY, db->vfs);
+    } else {
+        rc = open_connection(db->db_file.path, &conn, SPEEDSQL_OPEN_READONLY, &snap->vfs);
+    }
+
+    if (rc != SPEEDSQL_OK) {
+        sdb_set_error(db, rc, "Cannot open snapshot");
+        snapshot_unlink(snap);
+        snapshot_free(snap);
+        return rc;
+    }
+
+    conn->snapshot = snap;
+    *snapshot_out = conn;
+    return SPEEDSQL_OK;
+}
+
+void snapshot_release(speedsql* db) {
+    db_snapshot* snap = db->snapshot;
+    db->snapshot = nullptr;
+
+    snapshot_unlink(snap);
+    snapshot_free(snap);
+}
+
+void snapshot_detach_all(speedsql* db) {
+    mutex_lock(&g_snapshots.lock);
+
+    /* Snapshots keep their retained blocks and their own file handle */
+    db_snapshot* snap = db->snapshots;
+    while (snap) {
+        db_snapshot* next = snap->next;
+        snap->owner = nullptr;
+        snap->next = nullptr;
+        snap = next;
+    }
+    db->snapshots = nullptr;
+    db->db_file.before_write = nullptr;
+
+    mutex_unlock(&g_snapshots.lock);
+}
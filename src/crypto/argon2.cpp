@@ -0,0 +1,493 @@
+/*
+ * SpeedSQL - Argon2id (RFC 9106)
+ *
+ * Memory is a matrix of 1KB blocks with one row (lane) per degree of
+ * parallelism. Each pass fills the lanes in four slices; within a slice
+ * the lanes only reference blocks from finished slices, so every lane of
+ * a slice is filled on its own thread and the threads meet at the slice
+ * boundary. The first half of the first pass uses data-independent
+ * addressing (Argon2i), the rest data-dependent (Argon2d).
+ */
+
+#include "speedsql_internal.h"
+#include <string.h>
+
+#define ARGON2_VERSION          0x13
+#define ARGON2_TYPE_ID          2        /* Argon2id */
+#define ARGON2_BLOCK_SIZE       1024
+#define ARGON2_QWORDS           (ARGON2_BLOCK_SIZE / 8)
+#define ARGON2_SYNC_POINTS      4        /* Slices per pass */
+#define ARGON2_ADDRESSES        ARGON2_QWORDS
+#define ARGON2_MAX_LANES        0xFFFFFF
+#define ARGON2_PREHASH_SIZE     64
+
+/* ============================================================================
+ * BLAKE2b (RFC 7693)
+ * ============================================================================ */
+
+typedef struct {
+    uint64_t h[8];
+    uint64_t t[2];
+    uint8_t buf[128];
+    size_t buf_len;
+    size_t out_len;
+} blake2b_ctx_t;
+
+static const uint64_t blake2b_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const uint8_t blake2b_sigma[12][16] = {
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
+    {11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4},
+    { 7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8},
+    { 9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13},
+    { 2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9},
+    {12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11},
+    {13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10},
+    { 6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5},
+    {10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0},
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3}
+};
+
+static inline uint64_t rotr64(uint64_t x, int n) {
+    return (x >> n) | (x << (64 - n));
+}
+
+static inline uint64_t load_le64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline void store_le64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+static inline void store_le32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+static void blake2b_compress(blake2b_ctx_t* ctx, const uint8_t* block, bool last) {
+    uint64_t m[16], v[16];
+    for (int i = 0; i < 16; i++) m[i] = load_le64(block + 8 * i);
+    for (int i = 0; i < 8; i++) {
+        v[i] = ctx->h[i];
+        v[i + 8] = blake2b_iv[i];
+    }
+    v[12] ^= ctx->t[0];
+    v[13] ^= ctx->t[1];
+    if (last) v[14] = ~v[14];
+
+#define B2B_G(a, b, c, d, x, y) \
+    a = a + b + x; d = rotr64(d ^ a, 32); \
+    c = c + d;     b = rotr64(b ^ c, 24); \
+    a = a + b + y; d = rotr64(d ^ a, 16); \
+    c = c + d;     b = rotr64(b ^ c, 63);
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = blake2b_sigma[r];
+        B2B_G(v[0], v[4], v[8],  v[12], m[s[0]],  m[s[1]]);
+        B2B_G(v[1], v[5], v[9],  v[13], m[s[2]],  m[s[3]]);
+        B2B_G(v[2], v[6], v[10], v[14], m[s[4]],  m[s[5]]);
+        B2B_G(v[3], v[7], v[11], v[15], m[s[6]],  m[s[7]]);
+        B2B_G(v[0], v[5], v[10], v[15], m[s[8]],  m[s[9]]);
+        B2B_G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        B2B_G(v[2], v[7], v[8],  v[13], m[s[12]], m[s[13]]);
+        B2B_G(v[3], v[4], v[9],  v[14], m[s[14]], m[s[15]]);
+    }
+
+#undef B2B_G
+
+    for (int i = 0; i < 8; i++) {
+        ctx->h[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+static void blake2b_init(blake2b_ctx_t* ctx, size_t out_len) {
+    memcpy(ctx->h, blake2b_iv, sizeof(blake2b_iv));
+    ctx->h[0] ^= 0x01010000ULL ^ (uint64_t)out_len;  /* No key, fanout and depth 1 */
+    ctx->t[0] = ctx->t[1] = 0;
+    ctx->buf_len = 0;
+    ctx->out_len = out_len;
+}
+
+static void blake2b_update(blake2b_ctx_t* ctx, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    while (len > 0) {
+        /* The last block is compressed by final, so only flush when more follows */
+        if (ctx->buf_len == sizeof(ctx->buf)) {
+            ctx->t[0] += sizeof(ctx->buf);
+            if (ctx->t[0] < sizeof(ctx->buf)) ctx->t[1]++;
+            blake2b_compress(ctx, ctx->buf, false);
+            ctx->buf_len = 0;
+        }
+        size_t take = sizeof(ctx->buf) - ctx->buf_len;
+        if (take > len) take = len;
+        memcpy(ctx->buf + ctx->buf_len, p, take);
+        ctx->buf_len += take;
+        p += take;
+        len -= take;
+    }
+}
+
+static void blake2b_final(blake2b_ctx_t* ctx, uint8_t* out) {
+    ctx->t[0] += ctx->buf_len;
+    if (ctx->t[0] < ctx->buf_len) ctx->t[1]++;
+    memset(ctx->buf + ctx->buf_len, 0, sizeof(ctx->buf) - ctx->buf_len);
+    blake2b_compress(ctx, ctx->buf, true);
+
+    uint8_t digest[64];
+    for (int i = 0; i < 8; i++) store_le64(digest + 8 * i, ctx->h[i]);
+    memcpy(out, digest, ctx->out_len);
+    speedsql_secure_zero(digest, sizeof(digest));
+    speedsql_secure_zero(ctx, sizeof(*ctx));
+}
+
+/* H': BLAKE2b stretched to any output length */
+static void argon2_hash_long(uint8_t* out, size_t out_len, const uint8_t* in, size_t in_len) {
+    blake2b_ctx_t ctx;
+    uint8_t len_le[4];
+    store_le32(len_le, (uint32_t)out_len);
+
+    if (out_len <= 64) {
+        blake2b_init(&ctx, out_len);
+        blake2b_update(&ctx, len_le, 4);
+        blake2b_update(&ctx, in, in_len);
+        blake2b_final(&ctx, out);
+        return;
+    }
+
+    /* Chain of 64-byte digests, keeping the first half of each */
+    uint8_t v[64];
+    blake2b_init(&ctx, 64);
+    blake2b_update(&ctx, len_le, 4);
+    blake2b_update(&ctx, in, in_len);
+    blake2b_final(&ctx, v);
+    memcpy(out, v, 32);
+    out += 32;
+    out_len -= 32;
+
+    while (out_len > 64) {
+        blake2b_init(&ctx, 64);
+        blake2b_update(&ctx, v, 64);
+        blake2b_final(&ctx, v);
+        memcpy(out, v, 32);
+        out += 32;
+        out_len -= 32;
+    }
+
+    blake2b_init(&ctx, out_len);
+    blake2b_update(&ctx, v, 64);
+    blake2b_final(&ctx, out);
+    speedsql_secure_zero(v, sizeof(v));
+}
+
+/* ============================================================================
+ * Block Compression
+ * ============================================================================ */
+
+typedef struct {
+    uint64_t v[ARGON2_QWORDS];
+} argon2_block_t;
+
+/* BLAKE2b's G with the additions replaced by x + y + 2 * lo(x) * lo(y) */
+static inline uint64_t argon2_fblamka(uint64_t x, uint64_t y) {
+    return x + y + 2 * (uint64_t)(uint32_t)x * (uint32_t)y;
+}
+
+#define ARGON2_G(a, b, c, d) \
+    a = argon2_fblamka(a, b); d = rotr64(d ^ a, 32); \
+    c = argon2_fblamka(c, d); b = rotr64(b ^ c, 24); \
+    a = argon2_fblamka(a, b); d = rotr64(d ^ a, 16); \
+    c = argon2_fblamka(c, d); b = rotr64(b ^ c, 63);
+
+#define ARGON2_ROUND(v0, v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15) \
+    do { \
+        ARGON2_G(v0, v4, v8,  v12); ARGON2_G(v1, v5, v9,  v13); \
+        ARGON2_G(v2, v6, v10, v14); ARGON2_G(v3, v7, v11, v15); \
+        ARGON2_G(v0, v5, v10, v15); ARGON2_G(v1, v6, v11, v12); \
+        ARGON2_G(v2, v7, v8,  v13); ARGON2_G(v3, v4, v9,  v14); \
+    } while (0)
+
+/* next = G(prev, ref), XORed into next's old contents on later passes */
+static void argon2_fill_block(const argon2_block_t* prev, const argon2_block_t* ref,
+                              argon2_block_t* next, bool with_xor) {
+    argon2_block_t r, tmp;
+    for (int i = 0; i < ARGON2_QWORDS; i++) {
+        r.v[i] = prev->v[i] ^ ref->v[i];
+        tmp.v[i] = with_xor ? r.v[i] ^ next->v[i] : r.v[i];
+    }
+
+    /* Rows of 16 words, then columns of two words from each row */
+    uint64_t* v = r.v;
+    for (int i = 0; i < 8; i++) {
+        uint64_t* s = v + 16 * i;
+        ARGON2_ROUND(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7],
+                     s[8], s[9], s[10], s[11], s[12], s[13], s[14], s[15]);
+    }
+    for (int i = 0; i < 8; i++) {
+        uint64_t* s = v + 2 * i;
+        ARGON2_ROUND(s[0], s[1], s[16], s[17], s[32], s[33], s[48], s[49],
+                     s[64], s[65], s[80], s[81], s[96], s[97], s[112], s[113]);
+    }
+
+    for (int i = 0; i < ARGON2_QWORDS; i++) {
+        next->v[i] = tmp.v[i] ^ r.v[i];
+    }
+}
+
+/* ============================================================================
+ * Memory Filling
+ * ============================================================================ */
+
+typedef struct {
+    argon2_block_t* memory;
+    uint32_t passes;
+    uint32_t lanes;
+    uint32_t blocks;             /* m': memory rounded to 4 * lanes blocks */
+    uint32_t lane_length;
+    uint32_t segment_length;
+} argon2_instance_t;
+
+typedef struct {
+    const argon2_instance_t* inst;
+    uint32_t pass;
+    uint32_t lane;
+    uint32_t slice;
+} argon2_segment_t;
+
+/* Position in the reference lane of the block J1 points at */
+static uint32_t argon2_index_alpha(const argon2_instance_t* inst, const argon2_segment_t* seg,
+                                   uint32_t index, uint32_t j1, bool same_lane) {
+    uint32_t area;
+    if (seg->pass == 0) {
+        if (seg->slice == 0) {
+            area = index - 1;
+        } else if (same_lane) {
+            area = seg->slice * inst->segment_length + index - 1;
+        } else {
+            area = seg->slice * inst->segment_length - (index == 0 ? 1 : 0);
+        }
+    } else {
+        if (same_lane) {
+            area = inst->lane_length - inst->segment_length + index - 1;
+        } else {
+            area = inst->lane_length - inst->segment_length - (index == 0 ? 1 : 0);
+        }
+    }
+
+    uint64_t rel = j1;
+    rel = (rel * rel) >> 32;
+    rel = area - 1 - (((uint64_t)area * rel) >> 32);
+
+    uint32_t start = 0;
+    if (seg->pass != 0 && seg->slice != ARGON2_SYNC_POINTS - 1) {
+        start = (seg->slice + 1) * inst->segment_length;
+    }
+    return (uint32_t)((start + rel) % inst->lane_length);
+}
+
+/* Next block of data-independent addresses */
+static void argon2_next_addresses(argon2_block_t* address, argon2_block_t* input,
+                                  const argon2_block_t* zero) {
+    input->v[6]++;
+    argon2_fill_block(zero, input, address, false);
+    argon2_fill_block(zero, address, address, false);
+}
+
+static void argon2_fill_segment(const argon2_segment_t* seg) {
+    const argon2_instance_t* inst = seg->inst;
+    argon2_block_t* memory = inst->memory;
+    bool independent = (seg->pass == 0 && seg->slice < ARGON2_SYNC_POINTS / 2);
+
+    argon2_block_t address, input, zero;
+    if (independent) {
+        memset(&zero, 0, sizeof(zero));
+        memset(&input, 0, sizeof(input));
+        input.v[0] = seg->pass;
+        input.v[1] = seg->lane;
+        input.v[2] = seg->slice;
+        input.v[3] = inst->blocks;
+        input.v[4] = inst->passes;
+        input.v[5] = ARGON2_TYPE_ID;
+    }
+
+    /* The first two blocks of each lane come from the prehash */
+    uint32_t start = 0;
+    if (seg->pass == 0 && seg->slice == 0) {
+        start = 2;
+        if (independent) argon2_next_addresses(&address, &input, &zero);
+    }
+
+    uint32_t curr = seg->lane * inst->lane_length + seg->slice * inst->segment_length + start;
+    uint32_t prev = (curr % inst->lane_length == 0) ? curr + inst->lane_length - 1 : curr - 1;
+
+    for (uint32_t i = start; i < inst->segment_length; i++, curr++, prev++) {
+        if (curr % inst->lane_length == 1) prev = curr - 1;
+
+        uint64_t pseudo;
+        if (independent) {
+            if (i % ARGON2_ADDRESSES == 0) argon2_next_addresses(&address, &input, &zero);
+            pseudo = address.v[i % ARGON2_ADDRESSES];
+        } else {
+            pseudo = memory[prev].v[0];
+        }
+
+        uint32_t ref_lane = (uint32_t)((pseudo >> 32) % inst->lanes);
+        if (seg->pass == 0 && seg->slice == 0) ref_lane = seg->lane;
+
+        uint32_t ref_index = argon2_index_alpha(inst, seg, i, (uint32_t)pseudo,
+                                                ref_lane == seg->lane);
+        const argon2_block_t* ref = &memory[(size_t)inst->lane_length * ref_lane + ref_index];
+        argon2_fill_block(&memory[prev], ref, &memory[curr], seg->pass != 0);
+    }
+}
+
+static void* argon2_segment_main(void* arg) {
+    argon2_fill_segment((const argon2_segment_t*)arg);
+    return nullptr;
+}
+
+/* One slice of every lane: lane 0 on the caller, the others on their own
+ * threads (or inline when no thread can be started) */
+static void argon2_fill_slice(const argon2_instance_t* inst, uint32_t pass, uint32_t slice,
+                              argon2_segment_t* segs, thread_t* threads, bool* started) {
+    for (uint32_t l = 0; l < inst->lanes; l++) {
+        segs[l].inst = inst;
+        segs[l].pass = pass;
+        segs[l].lane = l;
+        segs[l].slice = slice;
+        started[l] = false;
+    }
+
+    for (uint32_t l = 1; l < inst->lanes; l++) {
+        started[l] = thread_create(&threads[l], argon2_segment_main, &segs[l]) == SPEEDSQL_OK;
+    }
+    for (uint32_t l = 0; l < inst->lanes; l++) {
+        if (!started[l]) argon2_fill_segment(&segs[l]);
+    }
+    for (uint32_t l = 1; l < inst->lanes; l++) {
+        if (started[l]) thread_join(threads[l]);
+    }
+}
+
+/* ============================================================================
+ * Argon2id
+ * ============================================================================ */
+
+static void argon2_prehash_field(blake2b_ctx_t* ctx, const uint8_t* data, size_t len) {
+    uint8_t le[4];
+    store_le32(le, (uint32_t)len);
+    blake2b_update(ctx, le, 4);
+    if (len > 0) blake2b_update(ctx, data, len);
+}
+
+static void argon2_prehash_word(blake2b_ctx_t* ctx, uint32_t v) {
+    uint8_t le[4];
+    store_le32(le, v);
+    blake2b_update(ctx, le, 4);
+}
+
+int argon2id_hash(const uint8_t* password, size_t password_len,
+                  const uint8_t* salt, size_t salt_len,
+                  const argon2_params_t* params, uint8_t* out, size_t out_len) {
+    uint32_t lanes = params->lanes;
+    if (lanes == 0 || lanes > ARGON2_MAX_LANES || params->passes == 0 ||
+        out_len < 4 || out_len > 0xFFFFFFFFu || salt_len < 8) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    /* At least two blocks per segment; whole segments in every lane */
+    uint32_t blocks = params->memory_kb;
+    if (blocks < 2 * ARGON2_SYNC_POINTS * lanes) {
+        blocks = 2 * ARGON2_SYNC_POINTS * lanes;
+    }
+
+    argon2_instance_t inst;
+    inst.passes = params->passes;
+    inst.lanes = lanes;
+    inst.segment_length = blocks / (lanes * ARGON2_SYNC_POINTS);
+    inst.lane_length = inst.segment_length * ARGON2_SYNC_POINTS;
+    inst.blocks = inst.lane_length * lanes;
+
+    size_t memory_size = (size_t)inst.blocks * sizeof(argon2_block_t);
+    inst.memory = (argon2_block_t*)sdb_malloc(memory_size);
+    argon2_segment_t* segs = (argon2_segment_t*)sdb_calloc(lanes, sizeof(argon2_segment_t));
+    thread_t* threads = (thread_t*)sdb_calloc(lanes, sizeof(thread_t));
+    bool* started = (bool*)sdb_calloc(lanes, sizeof(bool));
+    if (!inst.memory || !segs || !threads || !started) {
+        sdb_free(inst.memory);
+        sdb_free(segs);
+        sdb_free(threads);
+        sdb_free(started);
+        return SPEEDSQL_NOMEM;
+    }
+
+    /* H0 over every parameter and input */
+    uint8_t h0[ARGON2_PREHASH_SIZE + 8];
+    blake2b_ctx_t ctx;
+    blake2b_init(&ctx, ARGON2_PREHASH_SIZE);
+    argon2_prehash_word(&ctx, lanes);
+    argon2_prehash_word(&ctx, (uint32_t)out_len);
+    argon2_prehash_word(&ctx, params->memory_kb);
+    argon2_prehash_word(&ctx, params->passes);
+    argon2_prehash_word(&ctx, ARGON2_VERSION);
+    argon2_prehash_word(&ctx, ARGON2_TYPE_ID);
+    argon2_prehash_field(&ctx, password, password_len);
+    argon2_prehash_field(&ctx, salt, salt_len);
+    argon2_prehash_field(&ctx, params->secret, params->secret_len);
+    argon2_prehash_field(&ctx, params->ad, params->ad_len);
+    blake2b_final(&ctx, h0);
+
+    /* First two blocks of each lane: H'(H0 || column || lane) */
+    uint8_t bytes[ARGON2_BLOCK_SIZE];
+    for (uint32_t l = 0; l < lanes; l++) {
+        for (uint32_t col = 0; col < 2; col++) {
+            store_le32(h0 + ARGON2_PREHASH_SIZE, col);
+            store_le32(h0 + ARGON2_PREHASH_SIZE + 4, l);
+            argon2_hash_long(bytes, ARGON2_BLOCK_SIZE, h0, sizeof(h0));
+
+            argon2_block_t* b = &inst.memory[(size_t)l * inst.lane_length + col];
+            for (int i = 0; i < ARGON2_QWORDS; i++) {
+                b->v[i] = load_le64(bytes + 8 * i);
+            }
+        }
+    }
+
+    for (uint32_t pass = 0; pass < inst.passes; pass++) {
+        for (uint32_t slice = 0; slice < ARGON2_SYNC_POINTS; slice++) {
+            argon2_fill_slice(&inst, pass, slice, segs, threads, started);
+        }
+    }
+
+    /* Tag: H' of the XOR of every lane's last block */
+    argon2_block_t last = inst.memory[inst.lane_length - 1];
+    for (uint32_t l = 1; l < lanes; l++) {
+        const argon2_block_t* b = &inst.memory[(size_t)l * inst.lane_length + inst.lane_length - 1];
+        for (int i = 0; i < ARGON2_QWORDS; i++) last.v[i] ^= b->v[i];
+    }
+    for (int i = 0; i < ARGON2_QWORDS; i++) {
+        store_le64(bytes + 8 * i, last.v[i]);
+    }
+    argon2_hash_long(out, out_len, bytes, sizeof(bytes));
+
+    speedsql_secure_zero(h0, sizeof(h0));
+    speedsql_secure_zero(bytes, sizeof(bytes));
+    speedsql_secure_zero(&last, sizeof(last));
+    speedsql_secure_zero(inst.memory, memory_size);
+    sdb_free(inst.memory);
+    sdb_free(segs);
+    sdb_free(threads);
+    sdb_free(started);
+    return SPEEDSQL_OK;
+}
@@ -5,8 +5,9 @@
  * - AES-256-GCM (Galois/Counter Mode with authentication)
  * - AES-256-CBC (Cipher Block Chaining with HMAC-SHA256)
  *
- * Reference implementation - for production, consider using
- * hardware-accelerated libraries (OpenSSL, Windows CNG, etc.)
+ * GCM uses AES-NI (or VAES) for CTR and PCLMULQDQ for GHASH when the
+ * CPU has them, with the portable implementation as the fallback. The
+ * self-test known answer covers whichever path the CPU selects.
  */
 
 #include "speedsql_internal.h"
@@ -102,6 +103,10 @@ static const uint8_t rcon[11] = {
 struct speedsql_cipher_ctx {
     uint8_t round_keys[240];  /* Expanded key schedule */
     uint8_t key[32];          /* Original key */
+    uint8_t h[16];            /* GHASH key H = E(K, 0^128) */
+    gcm_ghash_table_t ghash;  /* Shoup tables for the portable GHASH */
+    uint8_t h_pow[8][16];     /* H^1..H^8 byte-reflected, for PCLMULQDQ GHASH */
+    bool h_pow_ready;         /* h_pow computed (CPU has PCLMULQDQ) */
     bool initialized;
     speedsql_cipher_t mode;    /* GCM or CBC */
 };
@@ -273,56 +278,345 @@ static void aes_decrypt_block(const uint8_t* round_keys, const uint8_t* in, uint
 }
 
 /* ============================================================================
- * AES-256-GCM Implementation
+ * AES-NI / PCLMULQDQ Implementation (x86, selected at runtime)
  * ============================================================================ */
 
-/* GCM multiplication in GF(2^128) */
-static void gcm_mult(const uint8_t* x, const uint8_t* h, uint8_t* out) {
-    uint8_t v[16], z[16] = {0};
-    memcpy(v, h, 16);
+/* CTR keeps 8 blocks in flight to cover the AESENC latency; GHASH folds
+ * 8 blocks per reduction using the precomputed powers H^1..H^8. Data is
+ * byte-reflected for PCLMULQDQ, and the products are shifted left by one
+ * bit before reduction (Gueron & Kounavis, Intel CLMUL white paper). */
 
-    for (int i = 0; i < 16; i++) {
-        for (int j = 7; j >= 0; j--) {
-            if (x[i] & (1 << j)) {
-                for (int k = 0; k < 16; k++) z[k] ^= v[k];
+#if SPEEDSQL_X86
+
+#include <immintrin.h>
+
+#define AES_HW_FEATURES (CPU_FEATURE_AESNI | CPU_FEATURE_PCLMUL | \
+                         CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE41)
+#define AES_VAES_FEATURES (AES_HW_FEATURES | CPU_FEATURE_AVX2 | CPU_FEATURE_VAES)
+
+#define AES_HW_ISA "aes,pclmul,ssse3,sse4.1"
+#define AES_VAES_ISA "aes,pclmul,ssse3,sse4.1,avx,avx2,vaes"
+
+#define GHASH_AGGREGATE 8
+
+static inline uint32_t bswap32(uint32_t x) {
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+SPEEDSQL_TARGET(AES_HW_ISA)
+static inline __m128i aesni_reflect(__m128i x) {
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                            8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+/* Counter block: J0 with the low 32 bits replaced by ctr (big-endian) */
+SPEEDSQL_TARGET(AES_HW_ISA)
+static inline __m128i aesni_counter(__m128i j0, uint32_t ctr) {
+    return _mm_insert_epi32(j0, (int)bswap32(ctr), 3);
+}
+
+/* 256-bit carry-less product a * b as (hi:lo) */
+SPEEDSQL_TARGET(AES_HW_ISA)
+static inline void clmul_wide(__m128i a, __m128i b, __m128i* lo, __m128i* hi) {
+    __m128i t0 = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i t1 = _mm_clmulepi64_si128(a, b, 0x10);
+    __m128i t2 = _mm_clmulepi64_si128(a, b, 0x01);
+    __m128i t3 = _mm_clmulepi64_si128(a, b, 0x11);
+
+    t1 = _mm_xor_si128(t1, t2);
+    *lo = _mm_xor_si128(t0, _mm_slli_si128(t1, 8));
+    *hi = _mm_xor_si128(t3, _mm_srli_si128(t1, 8));
+}
+
+/* Shift (hi:lo) left one bit and reduce modulo x^128 + x^7 + x^2 + x + 1 */
+SPEEDSQL_TARGET(AES_HW_ISA)
+static inline __m128i ghash_reduce(__m128i lo, __m128i hi) {
+    __m128i c_lo = _mm_srli_epi32(lo, 31);
+    __m128i c_hi = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+
+    __m128i carry = _mm_srli_si128(c_lo, 12);
+    c_hi = _mm_slli_si128(c_hi, 4);
+    c_lo = _mm_slli_si128(c_lo, 4);
+    lo = _mm_or_si128(lo, c_lo);
+    hi = _mm_or_si128(hi, c_hi);
+    hi = _mm_or_si128(hi, carry);
+
+    __m128i a = _mm_slli_epi32(lo, 31);
+    __m128i b = _mm_slli_epi32(lo, 30);
+    __m128i c = _mm_slli_epi32(lo, 25);
+    a = _mm_xor_si128(a, b);
+    a = _mm_xor_si128(a, c);
+    b = _mm_srli_si128(a, 4);
+    a = _mm_slli_si128(a, 12);
+    lo = _mm_xor_si128(lo, a);
+
+    __m128i d = _mm_srli_epi32(lo, 1);
+    __m128i e = _mm_srli_epi32(lo, 2);
+    __m128i f = _mm_srli_epi32(lo, 7);
+    d = _mm_xor_si128(d, e);
+    d = _mm_xor_si128(d, f);
+    d = _mm_xor_si128(d, b);
+    lo = _mm_xor_si128(lo, d);
+
+    return _mm_xor_si128(hi, lo);
+}
+
+SPEEDSQL_TARGET(AES_HW_ISA)
+static inline __m128i ghash_mult(__m128i a, __m128i b) {
+    __m128i lo, hi;
+    clmul_wide(a, b, &lo, &hi);
+    return ghash_reduce(lo, hi);
+}
+
+/* Powers of H for aggregated reduction */
+SPEEDSQL_TARGET(AES_HW_ISA)
+static void aesni_ghash_init(const uint8_t* h, uint8_t h_pow[GHASH_AGGREGATE][16]) {
+    __m128i h1 = aesni_reflect(_mm_loadu_si128((const __m128i*)h));
+    __m128i hk = h1;
+
+    _mm_storeu_si128((__m128i*)h_pow[0], h1);
+    for (int i = 1; i < GHASH_AGGREGATE; i++) {
+        hk = ghash_mult(hk, h1);
+        _mm_storeu_si128((__m128i*)h_pow[i], hk);
+    }
+}
+
+/* y = GHASH(y, data), the final partial block zero-padded */
+SPEEDSQL_TARGET(AES_HW_ISA)
+static void aesni_ghash(const uint8_t h_pow[GHASH_AGGREGATE][16],
+                        const uint8_t* data, size_t len, uint8_t* y) {
+    __m128i hp[GHASH_AGGREGATE];
+    for (int i = 0; i < GHASH_AGGREGATE; i++) {
+        hp[i] = _mm_loadu_si128((const __m128i*)h_pow[i]);
+    }
+
+    __m128i acc = aesni_reflect(_mm_loadu_si128((const __m128i*)y));
+
+    /* (acc ^ X0)*H^8 ^ X1*H^7 ^ ... ^ X7*H, one reduction */
+    while (len >= GHASH_AGGREGATE * 16) {
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+
+        for (int i = 0; i < GHASH_AGGREGATE; i++) {
+            __m128i x = aesni_reflect(_mm_loadu_si128((const __m128i*)(data + i * 16)));
+            if (i == 0) x = _mm_xor_si128(x, acc);
+
+            __m128i plo, phi;
+            clmul_wide(x, hp[GHASH_AGGREGATE - 1 - i], &plo, &phi);
+            lo = _mm_xor_si128(lo, plo);
+            hi = _mm_xor_si128(hi, phi);
+        }
+
+        acc = ghash_reduce(lo, hi);
+        data += GHASH_AGGREGATE * 16;
+        len -= GHASH_AGGREGATE * 16;
+    }
+
+    while (len >= 16) {
+        __m128i x = aesni_reflect(_mm_loadu_si128((const __m128i*)data));
+        acc = ghash_mult(_mm_xor_si128(acc, x), hp[0]);
+        data += 16;
+        len -= 16;
+    }
+
+    if (len > 0) {
+        uint8_t last[16] = {};
+        memcpy(last, data, len);
+        __m128i x = aesni_reflect(_mm_loadu_si128((const __m128i*)last));
+        acc = ghash_mult(_mm_xor_si128(acc, x), hp[0]);
+    }
+
+    _mm_storeu_si128((__m128i*)y, aesni_reflect(acc));
+}
+
+/* out = in ^ E(K, counter blocks starting at ctr) */
+SPEEDSQL_TARGET(AES_HW_ISA)
+static void aesni_ctr(const uint8_t* round_keys, const uint8_t* j0, uint32_t ctr,
+                      const uint8_t* in, uint8_t* out, size_t len) {
+    __m128i rk[AES_256_ROUNDS + 1];
+    for (int i = 0; i <= AES_256_ROUNDS; i++) {
+        rk[i] = _mm_loadu_si128((const __m128i*)(round_keys + i * 16));
+    }
+
+    __m128i base = _mm_loadu_si128((const __m128i*)j0);
+
+    while (len >= 8 * 16) {
+        __m128i b[8];
+        for (int k = 0; k < 8; k++) {
+            b[k] = _mm_xor_si128(aesni_counter(base, ctr + (uint32_t)k), rk[0]);
+        }
+        for (int r = 1; r < AES_256_ROUNDS; r++) {
+            for (int k = 0; k < 8; k++) {
+                b[k] = _mm_aesenc_si128(b[k], rk[r]);
             }
+        }
+        for (int k = 0; k < 8; k++) {
+            b[k] = _mm_aesenclast_si128(b[k], rk[AES_256_ROUNDS]);
+            __m128i p = _mm_loadu_si128((const __m128i*)(in + k * 16));
+            _mm_storeu_si128((__m128i*)(out + k * 16), _mm_xor_si128(p, b[k]));
+        }
+
+        ctr += 8;
+        in += 8 * 16;
+        out += 8 * 16;
+        len -= 8 * 16;
+    }
 
-            /* Multiply v by x (shift right in GF) */
-            uint8_t carry = v[15] & 1;
-            for (int k = 15; k > 0; k--) {
-                v[k] = (v[k] >> 1) | (v[k - 1] << 7);
+    while (len > 0) {
+        __m128i b = _mm_xor_si128(aesni_counter(base, ctr++), rk[0]);
+        for (int r = 1; r < AES_256_ROUNDS; r++) {
+            b = _mm_aesenc_si128(b, rk[r]);
+        }
+        b = _mm_aesenclast_si128(b, rk[AES_256_ROUNDS]);
+
+        size_t n = len < 16 ? len : 16;
+        uint8_t block[16] = {};
+        memcpy(block, in, n);
+        _mm_storeu_si128((__m128i*)block,
+                         _mm_xor_si128(_mm_loadu_si128((const __m128i*)block), b));
+        memcpy(out, block, n);
+
+        in += n;
+        out += n;
+        len -= n;
+    }
+}
+
+/* VAES: two blocks per YMM register, 8 blocks per iteration. Returns the
+ * bytes processed (a multiple of 128); aesni_ctr finishes the tail. */
+SPEEDSQL_TARGET(AES_VAES_ISA)
+static size_t vaes_ctr(const uint8_t* round_keys, const uint8_t* j0, uint32_t ctr,
+                       const uint8_t* in, uint8_t* out, size_t len) {
+    __m256i rk[AES_256_ROUNDS + 1];
+    for (int i = 0; i <= AES_256_ROUNDS; i++) {
+        rk[i] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i*)(round_keys + i * 16)));
+    }
+
+    __m128i base = _mm_loadu_si128((const __m128i*)j0);
+    size_t done = 0;
+
+    while (len - done >= 8 * 16) {
+        __m256i b[4];
+        for (int k = 0; k < 4; k++) {
+            __m128i c0 = aesni_counter(base, ctr + (uint32_t)(2 * k));
+            __m128i c1 = aesni_counter(base, ctr + (uint32_t)(2 * k + 1));
+            __m256i c = _mm256_inserti128_si256(_mm256_castsi128_si256(c0), c1, 1);
+            b[k] = _mm256_xor_si256(c, rk[0]);
+        }
+        for (int r = 1; r < AES_256_ROUNDS; r++) {
+            for (int k = 0; k < 4; k++) {
+                b[k] = _mm256_aesenc_epi128(b[k], rk[r]);
             }
-            v[0] >>= 1;
-            if (carry) v[0] ^= 0xe1;  /* Reduction polynomial */
         }
+        for (int k = 0; k < 4; k++) {
+            b[k] = _mm256_aesenclast_epi128(b[k], rk[AES_256_ROUNDS]);
+            __m256i p = _mm256_loadu_si256((const __m256i*)(in + done + k * 32));
+            _mm256_storeu_si256((__m256i*)(out + done + k * 32), _mm256_xor_si256(p, b[k]));
+        }
+
+        ctr += 8;
+        done += 8 * 16;
     }
 
-    memcpy(out, z, 16);
+    return done;
 }
 
-/* GCM GHASH */
-static void gcm_ghash(const uint8_t* h, const uint8_t* data, size_t len,
-                      const uint8_t* y_prev, uint8_t* y) {
-    memcpy(y, y_prev, 16);
+#endif /* SPEEDSQL_X86 */
 
-    size_t blocks = len / 16;
-    for (size_t i = 0; i < blocks; i++) {
-        for (int j = 0; j < 16; j++) {
-            y[j] ^= data[i * 16 + j];
+/* ============================================================================
+ * AES-256-GCM Dispatch
+ * ============================================================================ */
+
+static bool aes_gcm_use_hw(const speedsql_cipher_ctx_t* ctx) {
+#if SPEEDSQL_X86
+    return ctx->h_pow_ready && (cpu_features() & AES_HW_FEATURES) == AES_HW_FEATURES;
+#else
+    (void)ctx;
+    return false;
+#endif
+}
+
+/* Expand the key and derive the GHASH key material */
+static void aes_gcm_schedule(speedsql_cipher_ctx_t* ctx, const uint8_t* key) {
+    memcpy(ctx->key, key, 32);
+    aes_key_expansion(key, ctx->round_keys);
+
+    memset(ctx->h, 0, 16);
+    aes_encrypt_block(ctx->round_keys, ctx->h, ctx->h);
+    gcm_ghash_table_init(&ctx->ghash, ctx->h);
+
+    ctx->h_pow_ready = false;
+#if SPEEDSQL_X86
+    if ((cpu_features() & AES_HW_FEATURES) == AES_HW_FEATURES) {
+        aesni_ghash_init(ctx->h, ctx->h_pow);
+        ctx->h_pow_ready = true;
+    }
+#endif
+}
+
+/* out = in ^ keystream, counter blocks J0 + first, J0 + first + 1, ... */
+static void gcm_ctr(speedsql_cipher_ctx_t* ctx, const uint8_t* j0, uint32_t first,
+                    const uint8_t* in, uint8_t* out, size_t len) {
+#if SPEEDSQL_X86
+    if (aes_gcm_use_hw(ctx)) {
+        size_t done = 0;
+        if (len >= 8 * 16 && (cpu_features() & AES_VAES_FEATURES) == AES_VAES_FEATURES) {
+            done = vaes_ctr(ctx->round_keys, j0, first, in, out, len);
+        }
+        aesni_ctr(ctx->round_keys, j0, first + (uint32_t)(done / 16),
+                  in + done, out + done, len - done);
+        return;
+    }
+#endif
+
+    uint8_t counter[16], enc_counter[16];
+    memcpy(counter, j0, 16);
+    uint32_t ctr = first;
+
+    for (size_t i = 0; i < len; i += 16) {
+        counter[12] = (uint8_t)(ctr >> 24);
+        counter[13] = (uint8_t)(ctr >> 16);
+        counter[14] = (uint8_t)(ctr >> 8);
+        counter[15] = (uint8_t)ctr;
+        ctr++;
+
+        aes_encrypt_block(ctx->round_keys, counter, enc_counter);
+
+        size_t block_len = (len - i < 16) ? (len - i) : 16;
+        for (size_t j = 0; j < block_len; j++) {
+            out[i + j] = in[i + j] ^ enc_counter[j];
         }
-        gcm_mult(y, h, y);
     }
+}
 
-    /* Handle partial block */
-    size_t rem = len % 16;
-    if (rem > 0) {
-        for (size_t j = 0; j < rem; j++) {
-            y[j] ^= data[blocks * 16 + j];
+/* S = GHASH(H, AAD, C, lengths) */
+static void gcm_hash(speedsql_cipher_ctx_t* ctx, const uint8_t* aad, size_t aad_len,
+                     const uint8_t* ciphertext, size_t ct_len, uint8_t* s) {
+#if SPEEDSQL_X86
+    if (aes_gcm_use_hw(ctx)) {
+        uint8_t len_block[16];
+        gcm_length_block(aad_len, ct_len, len_block);
+
+        memset(s, 0, 16);
+        if (aad && aad_len > 0) {
+            aesni_ghash(ctx->h_pow, aad, aad_len, s);
         }
-        gcm_mult(y, h, y);
+        aesni_ghash(ctx->h_pow, ciphertext, ct_len, s);
+        aesni_ghash(ctx->h_pow, len_block, 16, s);
+        return;
     }
+#endif
+
+    gcm_ghash(&ctx->ghash, aad, aad_len, ciphertext, ct_len, s);
 }
 
+/* ============================================================================
+ * AES-256-GCM Provider
+ * ============================================================================ */
+
 static int aes_gcm_init(speedsql_cipher_ctx_t** ctx,
                         const uint8_t* key, size_t key_len) {
     if (key_len != 32) return SPEEDSQL_MISUSE;
@@ -330,8 +624,7 @@ static int aes_gcm_init(speedsql_cipher_ctx_t** ctx,
     *ctx = (speedsql_cipher_ctx_t*)speedsql_secure_malloc(sizeof(speedsql_cipher_ctx_t));
     if (!*ctx) return SPEEDSQL_NOMEM;
 
-    memcpy((*ctx)->key, key, 32);
-    aes_key_expansion(key, (*ctx)->round_keys);
+    aes_gcm_schedule(*ctx, key);
     (*ctx)->initialized = true;
     (*ctx)->mode = SPEEDSQL_CIPHER_AES_256_GCM;
 
@@ -357,56 +650,22 @@ static int aes_gcm_encrypt(
 ) {
     if (!ctx || !ctx->initialized) return SPEEDSQL_MISUSE;
 
-    uint8_t h[16] = {0};
-    uint8_t j0[16], counter[16];
-    uint8_t enc_counter[16];
-    uint8_t s[16] = {0};
-
-    /* H = E(K, 0^128) */
-    aes_encrypt_block(ctx->round_keys, h, h);
+    uint8_t j0[16];
+    uint8_t s[16];
 
     /* J0 = IV || 0^31 || 1 */
     memset(j0, 0, 16);
     memcpy(j0, iv, 12);
     j0[15] = 1;
 
-    /* Encrypt plaintext with CTR mode */
-    memcpy(counter, j0, 16);
-    for (size_t i = 0; i < plaintext_len; i += 16) {
-        /* Increment counter */
-        for (int j = 15; j >= 12; j--) {
-            if (++counter[j]) break;
-        }
-
-        aes_encrypt_block(ctx->round_keys, counter, enc_counter);
-
-        size_t block_len = (plaintext_len - i < 16) ? (plaintext_len - i) : 16;
-        for (size_t j = 0; j < block_len; j++) {
-            ciphertext[i + j] = plaintext[i + j] ^ enc_counter[j];
-        }
-    }
+    /* Encrypt plaintext with CTR mode, starting at J0 + 1 */
+    gcm_ctr(ctx, j0, 2, plaintext, ciphertext, plaintext_len);
 
     /* GHASH(H, AAD, C) */
-    if (aad && aad_len > 0) {
-        gcm_ghash(h, aad, aad_len, s, s);
-    }
-    gcm_ghash(h, ciphertext, plaintext_len, s, s);
-
-    /* Append lengths */
-    uint8_t len_block[16] = {0};
-    uint64_t aad_bits = (uint64_t)aad_len * 8;
-    uint64_t ct_bits = (uint64_t)plaintext_len * 8;
-    for (int i = 0; i < 8; i++) {
-        len_block[7 - i] = (aad_bits >> (i * 8)) & 0xff;
-        len_block[15 - i] = (ct_bits >> (i * 8)) & 0xff;
-    }
-    gcm_ghash(h, len_block, 16, s, s);
+    gcm_hash(ctx, aad, aad_len, ciphertext, plaintext_len, s);
 
     /* Tag = S ^ E(K, J0) */
-    aes_encrypt_block(ctx->round_keys, j0, enc_counter);
-    for (int i = 0; i < 16; i++) {
-        tag[i] = s[i] ^ enc_counter[i];
-    }
+    gcm_ctr(ctx, j0, 1, s, tag, 16);
 
     return SPEEDSQL_OK;
 }
@@ -424,37 +683,16 @@ static int aes_gcm_decrypt(
     if (!ctx || !ctx->initialized) return SPEEDSQL_MISUSE;
 
     uint8_t computed_tag[16];
-    uint8_t h[16] = {0};
-    uint8_t j0[16], counter[16];
-    uint8_t enc_counter[16];
-    uint8_t s[16] = {0};
-
-    /* H = E(K, 0^128) */
-    aes_encrypt_block(ctx->round_keys, h, h);
-
-    /* Verify tag first (GHASH) */
-    if (aad && aad_len > 0) {
-        gcm_ghash(h, aad, aad_len, s, s);
-    }
-    gcm_ghash(h, ciphertext, ciphertext_len, s, s);
-
-    uint8_t len_block[16] = {0};
-    uint64_t aad_bits = (uint64_t)aad_len * 8;
-    uint64_t ct_bits = (uint64_t)ciphertext_len * 8;
-    for (int i = 0; i < 8; i++) {
-        len_block[7 - i] = (aad_bits >> (i * 8)) & 0xff;
-        len_block[15 - i] = (ct_bits >> (i * 8)) & 0xff;
-    }
-    gcm_ghash(h, len_block, 16, s, s);
+    uint8_t j0[16];
+    uint8_t s[16];
 
     memset(j0, 0, 16);
     memcpy(j0, iv, 12);
     j0[15] = 1;
 
-    aes_encrypt_block(ctx->round_keys, j0, enc_counter);
-    for (int i = 0; i < 16; i++) {
-        computed_tag[i] = s[i] ^ enc_counter[i];
-    }
+    /* Verify tag first (GHASH) */
+    gcm_hash(ctx, aad, aad_len, ciphertext, ciphertext_len, s);
+    gcm_ctr(ctx, j0, 1, s, computed_tag, 16);
 
     /* Constant-time comparison */
     uint8_t diff = 0;
@@ -466,19 +704,7 @@ static int aes_gcm_decrypt(
     }
 
     /* Decrypt ciphertext with CTR mode */
-    memcpy(counter, j0, 16);
-    for (size_t i = 0; i < ciphertext_len; i += 16) {
-        for (int j = 15; j >= 12; j--) {
-            if (++counter[j]) break;
-        }
-
-        aes_encrypt_block(ctx->round_keys, counter, enc_counter);
-
-        size_t block_len = (ciphertext_len - i < 16) ? (ciphertext_len - i) : 16;
-        for (size_t j = 0; j < block_len; j++) {
-            plaintext[i + j] = ciphertext[i + j] ^ enc_counter[j];
-        }
-    }
+    gcm_ctr(ctx, j0, 2, ciphertext, plaintext, ciphertext_len);
 
     return SPEEDSQL_OK;
 }
@@ -490,14 +716,13 @@ static int aes_gcm_rekey(speedsql_cipher_ctx_t* ctx,
     speedsql_secure_zero(ctx->key, 32);
     speedsql_secure_zero(ctx->round_keys, 240);
 
-    memcpy(ctx->key, new_key, 32);
-    aes_key_expansion(new_key, ctx->round_keys);
+    aes_gcm_schedule(ctx, new_key);
 
     return SPEEDSQL_OK;
 }
 
 static int aes_gcm_self_test(void) {
-    /* NIST test vector */
+    /* NIST test vector (GCM spec test case 16: AES-256, AAD, partial block) */
     const uint8_t key[32] = {
         0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c,
         0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08,
@@ -508,29 +733,60 @@ static int aes_gcm_self_test(void) {
         0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad,
         0xde, 0xca, 0xf8, 0x88
     };
-    const uint8_t plaintext[16] = {
+    const uint8_t aad[20] = {
+        0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+        0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+        0xab, 0xad, 0xda, 0xd2
+    };
+    const uint8_t plaintext[60] = {
         0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5,
-        0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a
+        0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+        0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda,
+        0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+        0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53,
+        0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+        0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57,
+        0xba, 0x63, 0x7b, 0x39
+    };
+    const uint8_t expected_ct[60] = {
+        0x52, 0x2d, 0xc1, 0xf0, 0x99, 0x56, 0x7d, 0x07,
+        0xf4, 0x7f, 0x37, 0xa3, 0x2a, 0x84, 0x42, 0x7d,
+        0x64, 0x3a, 0x8c, 0xdc, 0xbf, 0xe5, 0xc0, 0xc9,
+        0x75, 0x98, 0xa2, 0xbd, 0x25, 0x55, 0xd1, 0xaa,
+        0x8c, 0xb0, 0x8e, 0x48, 0x59, 0x0d, 0xbb, 0x3d,
+        0xa7, 0xb0, 0x8b, 0x10, 0x56, 0x82, 0x88, 0x38,
+        0xc5, 0xf6, 0x1e, 0x63, 0x93, 0xba, 0x7a, 0x0a,
+        0xbc, 0xc9, 0xf6, 0x62
+    };
+    const uint8_t expected_tag[16] = {
+        0x76, 0xfc, 0x6e, 0xce, 0x0f, 0x4e, 0x17, 0x68,
+        0xcd, 0xdf, 0x88, 0x53, 0xbb, 0x2d, 0x55, 0x1b
     };
 
     speedsql_cipher_ctx_t* ctx;
     int rc = aes_gcm_init(&ctx, key, 32);
     if (rc != SPEEDSQL_OK) return rc;
 
-    uint8_t ciphertext[16], tag[16], decrypted[16];
-    rc = aes_gcm_encrypt(ctx, plaintext, 16, iv, nullptr, 0, ciphertext, tag);
+    uint8_t ciphertext[60], tag[16], decrypted[60];
+    rc = aes_gcm_encrypt(ctx, plaintext, 60, iv, aad, 20, ciphertext, tag);
     if (rc != SPEEDSQL_OK) {
         aes_gcm_destroy(ctx);
         return rc;
     }
 
-    rc = aes_gcm_decrypt(ctx, ciphertext, 16, iv, nullptr, 0, tag, decrypted);
+    /* Known answer: catches a broken hardware path as well as a broken reference */
+    if (memcmp(ciphertext, expected_ct, 60) != 0 || memcmp(tag, expected_tag, 16) != 0) {
+        aes_gcm_destroy(ctx);
+        return SPEEDSQL_ERROR;
+    }
+
+    rc = aes_gcm_decrypt(ctx, ciphertext, 60, iv, aad, 20, tag, decrypted);
     if (rc != SPEEDSQL_OK) {
         aes_gcm_destroy(ctx);
         return rc;
     }
 
-    if (memcmp(plaintext, decrypted, 16) != 0) {
+    if (memcmp(plaintext, decrypted, 60) != 0) {
         aes_gcm_destroy(ctx);
         return SPEEDSQL_ERROR;
     }
@@ -543,6 +799,10 @@ static void aes_gcm_zeroize(speedsql_cipher_ctx_t* ctx) {
     if (ctx) {
         speedsql_secure_zero(ctx->key, 32);
         speedsql_secure_zero(ctx->round_keys, 240);
+        speedsql_secure_zero(ctx->h, sizeof(ctx->h));
+        speedsql_secure_zero(&ctx->ghash, sizeof(ctx->ghash));
+        speedsql_secure_zero(ctx->h_pow, sizeof(ctx->h_pow));
+        ctx->h_pow_ready = false;
         ctx->initialized = false;
     }
 }
@@ -640,6 +900,7 @@ static int aes_cbc_init(speedsql_cipher_ctx_t** ctx,
 
     memcpy((*ctx)->key, key, 32);
     aes_key_expansion(key, (*ctx)->round_keys);
+    (*ctx)->h_pow_ready = false;
     (*ctx)->initialized = true;
     (*ctx)->mode = SPEEDSQL_CIPHER_AES_256_CBC;
 
@@ -7,6 +7,9 @@
  * Supports:
  * - ARIA-256-GCM (Galois/Counter Mode)
  * - ARIA-256-CBC (Cipher Block Chaining with HMAC)
+ *
+ * Blocks are processed with 32-bit T-tables, four at a time wherever the
+ * mode allows (GCM counter blocks, CBC decryption).
  */
 
 #include "speedsql_internal.h"
@@ -167,7 +170,10 @@ static const uint8_t SB4[256] = {
 struct speedsql_cipher_ctx {
     uint8_t enc_round_keys[17][16];  /* Encryption round keys */
     uint8_t dec_round_keys[17][16];  /* Decryption round keys */
+    uint32_t enc_rk[17][4];          /* Round keys as big-endian words */
+    uint32_t dec_rk[17][4];
     uint8_t key[32];
+    gcm_ghash_table_t ghash;         /* GHASH tables for H = E(K, 0^128) */
     int rounds;
     bool initialized;
     speedsql_cipher_t mode;
@@ -236,6 +242,19 @@ static void aria_dl(uint8_t* state) {
     state[15] = t[1] ^ t[2] ^ t[4] ^ t[5] ^ t[8] ^ t[10] ^ t[15];
 }
 
+/* Big-endian word access */
+static inline uint32_t load_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
 /* Rotate left 128-bit value */
 static void rotate_left_128(const uint8_t* in, uint8_t* out, int bits) {
     int bytes = bits / 8;
@@ -339,37 +358,186 @@ static void aria_key_expansion(speedsql_cipher_ctx_t* ctx, const uint8_t* key) {
         aria_dl(ctx->dec_round_keys[i]);
     }
     memcpy(ctx->dec_round_keys[16], ctx->enc_round_keys[0], 16);
+
+    for (int i = 0; i <= 16; i++) {
+        for (int w = 0; w < 4; w++) {
+            ctx->enc_rk[i][w] = load_be32(ctx->enc_round_keys[i] + 4 * w);
+            ctx->dec_rk[i][w] = load_be32(ctx->dec_round_keys[i] + 4 * w);
+        }
+    }
 }
 
-/* Encrypt a single block */
-static void aria_encrypt_block(speedsql_cipher_ctx_t* ctx, const uint8_t* in, uint8_t* out) {
-    uint8_t state[16];
-    memcpy(state, in, 16);
-
-    for (int i = 0; i < ctx->rounds - 1; i++) {
-        xor_128(state, state, ctx->enc_round_keys[i]);
-        if (i % 2 == 0) {
-            aria_sl1(state);
-        } else {
-            aria_sl2(state);
+/* ============================================================================
+ * 32-bit T-tables
+ *
+ * A full round's substitution and diffusion layers fold into four table
+ * lookups per word and a few word operations. Each table entry spreads an
+ * S-box output over the three bytes of a word that its input byte feeds;
+ * the diffusion matrix then splits into a word mix, a byte permutation
+ * within words and a second word mix. Both round types share the layout
+ * and differ only in the S-box behind each table.
+ * ============================================================================ */
+
+typedef struct {
+    uint32_t odd[4][256];            /* SL1: SB1, SB2, SB3, SB4 by byte */
+    uint32_t even[4][256];           /* SL2: SB3, SB4, SB1, SB2 by byte */
+} aria_tables_t;
+
+/* S-box output in every byte but the one at its own position */
+static uint32_t aria_spread(uint8_t s, int position) {
+    return ((uint32_t)s * 0x01010101u) & ~(0xFF000000u >> (8 * position));
+}
+
+static aria_tables_t aria_build_tables(void) {
+    aria_tables_t t;
+    for (int x = 0; x < 256; x++) {
+        t.odd[0][x] = aria_spread(SB1[x], 0);
+        t.odd[1][x] = aria_spread(SB2[x], 1);
+        t.odd[2][x] = aria_spread(SB3[x], 2);
+        t.odd[3][x] = aria_spread(SB4[x], 3);
+        t.even[0][x] = aria_spread(SB3[x], 0);
+        t.even[1][x] = aria_spread(SB4[x], 1);
+        t.even[2][x] = aria_spread(SB1[x], 2);
+        t.even[3][x] = aria_spread(SB2[x], 3);
+    }
+    return t;
+}
+
+static const aria_tables_t& aria_tables(void) {
+    static const aria_tables_t tables = aria_build_tables();
+    return tables;
+}
+
+static inline uint32_t aria_lookup(const uint32_t t[4][256], uint32_t w) {
+    return t[0][w >> 24] ^ t[1][(w >> 16) & 0xff] ^ t[2][(w >> 8) & 0xff] ^ t[3][w & 0xff];
+}
+
+/* Substitution and diffusion of one full round, in place */
+static inline void aria_round(const uint32_t t[4][256], uint32_t* w) {
+    uint32_t t0 = aria_lookup(t, w[0]);
+    uint32_t t1 = aria_lookup(t, w[1]);
+    uint32_t t2 = aria_lookup(t, w[2]);
+    uint32_t t3 = aria_lookup(t, w[3]);
+
+    t1 ^= t2; t2 ^= t3; t0 ^= t1; t3 ^= t1; t2 ^= t0; t1 ^= t2;
+
+    t1 = ((t1 << 8) & 0xff00ff00u) ^ ((t1 >> 8) & 0x00ff00ffu);
+    t2 = (t2 >> 16) | (t2 << 16);
+    t3 = (t3 >> 24) | ((t3 >> 8) & 0x0000ff00u) | ((t3 << 8) & 0x00ff0000u) | (t3 << 24);
+
+    t1 ^= t2; t2 ^= t3; t0 ^= t1; t3 ^= t1; t2 ^= t0; t1 ^= t2;
+
+    w[0] = t0;
+    w[1] = t1;
+    w[2] = t2;
+    w[3] = t3;
+}
+
+/* Last round's substitution layer (no diffusion) */
+static inline uint32_t aria_last_sub(uint32_t w, bool odd) {
+    if (odd) {
+        return ((uint32_t)SB1[w >> 24] << 24) | ((uint32_t)SB2[(w >> 16) & 0xff] << 16) |
+               ((uint32_t)SB3[(w >> 8) & 0xff] << 8) | SB4[w & 0xff];
+    }
+    return ((uint32_t)SB3[w >> 24] << 24) | ((uint32_t)SB4[(w >> 16) & 0xff] << 16) |
+           ((uint32_t)SB1[(w >> 8) & 0xff] << 8) | SB2[w & 0xff];
+}
+
+#define ARIA_LANES 4
+
+/* Run up to ARIA_LANES blocks through the cipher, interleaved so their
+ * table lookups overlap */
+static void aria_crypt_lanes(const speedsql_cipher_ctx_t* ctx, const uint32_t rk[17][4],
+                             const uint8_t* in, uint8_t* out, size_t blocks) {
+    const aria_tables_t& t = aria_tables();
+    uint32_t w[ARIA_LANES][4];
+    int rounds = ctx->rounds;
+
+    for (size_t b = 0; b < blocks; b++) {
+        for (int j = 0; j < 4; j++) {
+            w[b][j] = load_be32(in + 16 * b + 4 * j) ^ rk[0][j];
         }
-        aria_dl(state);
     }
 
-    /* Final round (no diffusion layer) */
-    xor_128(state, state, ctx->enc_round_keys[ctx->rounds - 1]);
-    if ((ctx->rounds - 1) % 2 == 0) {
-        aria_sl1(state);
-    } else {
-        aria_sl2(state);
+    for (int r = 0; r < rounds - 1; r++) {
+        const uint32_t (*layer)[256] = (r % 2 == 0) ? t.odd : t.even;
+        for (size_t b = 0; b < blocks; b++) {
+            aria_round(layer, w[b]);
+            for (int j = 0; j < 4; j++) {
+                w[b][j] ^= rk[r + 1][j];
+            }
+        }
+    }
+
+    bool odd = (rounds - 1) % 2 == 0;
+    for (size_t b = 0; b < blocks; b++) {
+        for (int j = 0; j < 4; j++) {
+            store_be32(out + 16 * b + 4 * j, aria_last_sub(w[b][j], odd) ^ rk[rounds][j]);
+        }
     }
-    xor_128(out, state, ctx->enc_round_keys[ctx->rounds]);
+}
+
+/* Encrypt a single block */
+static void aria_encrypt_block(speedsql_cipher_ctx_t* ctx, const uint8_t* in, uint8_t* out) {
+    aria_crypt_lanes(ctx, ctx->enc_rk, in, out, 1);
 }
 
 /* ============================================================================
  * ARIA-256-GCM Provider
  * ============================================================================ */
 
+/* Expand the key and build the GHASH tables once per key */
+static void aria_gcm_schedule(speedsql_cipher_ctx_t* ctx, const uint8_t* key) {
+    memcpy(ctx->key, key, 32);
+    aria_key_expansion(ctx, key);
+
+    uint8_t h[16] = {0};
+    aria_encrypt_block(ctx, h, h);
+    gcm_ghash_table_init(&ctx->ghash, h);
+    speedsql_secure_zero(h, sizeof(h));
+}
+
+/* out = in ^ E(K, J0 + 1), E(K, J0 + 2), ... */
+static void aria_gcm_ctr(speedsql_cipher_ctx_t* ctx, const uint8_t* iv,
+                         const uint8_t* in, uint8_t* out, size_t len) {
+    uint8_t counters[16 * ARIA_LANES];
+    uint8_t keystream[16 * ARIA_LANES];
+    uint32_t ctr = 1;
+
+    for (size_t i = 0; i < len; i += sizeof(keystream)) {
+        size_t chunk = (len - i < sizeof(keystream)) ? (len - i) : sizeof(keystream);
+        size_t blocks = (chunk + 15) / 16;
+
+        /* A batch of counter blocks through the interleaved rounds */
+        for (size_t b = 0; b < blocks; b++) {
+            memcpy(counters + 16 * b, iv, 12);
+            store_be32(counters + 16 * b + 12, ++ctr);
+        }
+        aria_crypt_lanes(ctx, ctx->enc_rk, counters, keystream, blocks);
+
+        for (size_t j = 0; j < chunk; j++) {
+            out[i + j] = in[i + j] ^ keystream[j];
+        }
+    }
+}
+
+/* Tag = GHASH(H, AAD, C) ^ E(K, J0) */
+static void aria_gcm_tag(speedsql_cipher_ctx_t* ctx, const uint8_t* iv,
+                         const uint8_t* aad, size_t aad_len,
+                         const uint8_t* ciphertext, size_t ct_len, uint8_t* tag) {
+    uint8_t s[16], j0[16] = {0}, ek_j0[16];
+
+    gcm_ghash(&ctx->ghash, aad, aad_len, ciphertext, ct_len, s);
+
+    memcpy(j0, iv, 12);
+    j0[15] = 1;
+    aria_encrypt_block(ctx, j0, ek_j0);
+
+    for (int i = 0; i < 16; i++) {
+        tag[i] = s[i] ^ ek_j0[i];
+    }
+}
+
 static int aria_gcm_init(speedsql_cipher_ctx_t** ctx,
                           const uint8_t* key, size_t key_len) {
     if (key_len != 32) return SPEEDSQL_MISUSE;
@@ -378,8 +546,7 @@ static int aria_gcm_init(speedsql_cipher_ctx_t** ctx,
     if (!*ctx) return SPEEDSQL_NOMEM;
 
     memset(*ctx, 0, sizeof(speedsql_cipher_ctx_t));
-    memcpy((*ctx)->key, key, 32);
-    aria_key_expansion(*ctx, key);
+    aria_gcm_schedule(*ctx, key);
     (*ctx)->initialized = true;
     (*ctx)->mode = SPEEDSQL_CIPHER_ARIA_256_GCM;
 
@@ -393,7 +560,7 @@ static void aria_gcm_destroy(speedsql_cipher_ctx_t* ctx) {
     }
 }
 
-/* GCM mode implementation (similar to AES-GCM but with ARIA) */
+/* GCM mode implementation (same construction as AES-GCM, ARIA block cipher) */
 static int aria_gcm_encrypt(
     speedsql_cipher_ctx_t* ctx,
     const uint8_t* plaintext,
@@ -406,30 +573,8 @@ static int aria_gcm_encrypt(
 ) {
     if (!ctx || !ctx->initialized) return SPEEDSQL_MISUSE;
 
-    /* CTR mode encryption with ARIA */
-    uint8_t counter[16] = {0};
-    uint8_t enc_counter[16];
-
-    memcpy(counter, iv, 12);
-    counter[15] = 1;
-
-    for (size_t i = 0; i < plaintext_len; i += 16) {
-        for (int j = 15; j >= 12; j--) {
-            if (++counter[j]) break;
-        }
-
-        aria_encrypt_block(ctx, counter, enc_counter);
-
-        size_t block_len = (plaintext_len - i < 16) ? (plaintext_len - i) : 16;
-        for (size_t j = 0; j < block_len; j++) {
-            ciphertext[i + j] = plaintext[i + j] ^ enc_counter[j];
-        }
-    }
-
-    /* Generate tag (simplified - real implementation needs GHASH) */
-    memset(tag, 0, 16);
-    (void)aad;
-    (void)aad_len;
+    aria_gcm_ctr(ctx, iv, plaintext, ciphertext, plaintext_len);
+    aria_gcm_tag(ctx, iv, aad, aad_len, ciphertext, plaintext_len, tag);
 
     return SPEEDSQL_OK;
 }
@@ -444,9 +589,24 @@ static int aria_gcm_decrypt(
     const uint8_t* tag,
     uint8_t* plaintext
 ) {
-    /* CTR mode decryption (same as encryption) */
-    return aria_gcm_encrypt(ctx, ciphertext, ciphertext_len,
-                            iv, aad, aad_len, plaintext, (uint8_t*)tag);
+    if (!ctx || !ctx->initialized) return SPEEDSQL_MISUSE;
+
+    /* Verify tag first */
+    uint8_t computed_tag[16];
+    aria_gcm_tag(ctx, iv, aad, aad_len, ciphertext, ciphertext_len, computed_tag);
+
+    /* Constant-time comparison */
+    uint8_t diff = 0;
+    for (int i = 0; i < 16; i++) {
+        diff |= computed_tag[i] ^ tag[i];
+    }
+    if (diff != 0) {
+        return SPEEDSQL_CORRUPT;  /* Authentication failed */
+    }
+
+    aria_gcm_ctr(ctx, iv, ciphertext, plaintext, ciphertext_len);
+
+    return SPEEDSQL_OK;
 }
 
 static int aria_gcm_rekey(speedsql_cipher_ctx_t* ctx,
@@ -454,8 +614,7 @@ static int aria_gcm_rekey(speedsql_cipher_ctx_t* ctx,
     if (!ctx || key_len != 32) return SPEEDSQL_MISUSE;
 
     speedsql_secure_zero(ctx->key, 32);
-    memcpy(ctx->key, new_key, 32);
-    aria_key_expansion(ctx, new_key);
+    aria_gcm_schedule(ctx, new_key);
 
     return SPEEDSQL_OK;
 }
@@ -534,30 +693,6 @@ extern "C" const speedsql_cipher_provider_t g_cipher_aria_256_gcm = make_cipher_
  * ARIA-256-CBC Implementation
  * ============================================================================ */
 
-/* Decrypt a single block */
-static void aria_decrypt_block(speedsql_cipher_ctx_t* ctx, const uint8_t* in, uint8_t* out) {
-    uint8_t state[16];
-    memcpy(state, in, 16);
-
-    for (int i = 0; i < ctx->rounds - 1; i++) {
-        xor_128(state, state, ctx->dec_round_keys[i]);
-        if (i % 2 == 0) {
-            aria_sl1(state);
-        } else {
-            aria_sl2(state);
-        }
-        aria_dl(state);
-    }
-
-    xor_128(state, state, ctx->dec_round_keys[ctx->rounds - 1]);
-    if ((ctx->rounds - 1) % 2 == 0) {
-        aria_sl1(state);
-    } else {
-        aria_sl2(state);
-    }
-    xor_128(out, state, ctx->dec_round_keys[ctx->rounds]);
-}
-
 /* PKCS#7 padding */
 static size_t aria_pkcs7_pad(uint8_t* data, size_t data_len, size_t block_size) {
     size_t pad_len = block_size - (data_len % block_size);
@@ -692,19 +827,25 @@ static int aria_cbc_decrypt(
         return SPEEDSQL_CORRUPT;
     }
 
-    /* CBC decryption */
+    /* CBC decryption: blocks are independent, so they go through in
+     * batches. The batch's ciphertext is kept aside for the chaining in
+     * case plaintext overwrites it. */
     uint8_t prev_block[16];
+    uint8_t batch[16 * ARIA_LANES];
+    uint8_t decrypted[16 * ARIA_LANES];
     memcpy(prev_block, iv, 16);
 
-    for (size_t i = 0; i < ciphertext_len; i += 16) {
-        uint8_t decrypted[16];
-        aria_decrypt_block(ctx, &ciphertext[i], decrypted);
+    for (size_t i = 0; i < ciphertext_len; i += sizeof(batch)) {
+        size_t chunk = (ciphertext_len - i < sizeof(batch)) ? (ciphertext_len - i)
+                                                             : sizeof(batch);
+        memcpy(batch, &ciphertext[i], chunk);
+        aria_crypt_lanes(ctx, ctx->dec_rk, batch, decrypted, chunk / 16);
 
-        for (int j = 0; j < 16; j++) {
-            plaintext[i + j] = decrypted[j] ^ prev_block[j];
+        for (size_t j = 0; j < chunk; j++) {
+            uint8_t prev = (j < 16) ? prev_block[j] : batch[j - 16];
+            plaintext[i + j] = decrypted[j] ^ prev;
         }
-
-        memcpy(prev_block, &ciphertext[i], 16);
+        memcpy(prev_block, batch + chunk - 16, 16);
     }
 
     return SPEEDSQL_OK;
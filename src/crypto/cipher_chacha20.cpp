@@ -4,6 +4,8 @@
  * Modern authenticated encryption cipher
  * - Fast in software (no need for AES-NI)
  * - IETF RFC 8439 compliant
+ * - 4/8/16-block SSE2/AVX2/AVX-512 or NEON ChaCha20 and 4-way AVX2
+ *   Poly1305, selected at runtime; the scalar code handles tails
  */
 
 #include "speedsql_internal.h"
@@ -51,6 +53,301 @@ static void chacha20_block(const uint32_t* input, uint32_t* output) {
     }
 }
 
+/* ============================================================================
+ * Multi-block ChaCha20 (SIMD, selected at runtime)
+ * ============================================================================ */
+
+/* Each kernel runs N blocks side by side: vector x[i] holds state word i of
+ * N consecutive blocks, so a quarter round is the scalar one done N-wide.
+ * The keystream is transposed back to block order before the XOR. Kernels
+ * consume whole N-block groups, advance state[12] and return the bytes
+ * done; narrower kernels and the scalar loop take the tail. */
+
+#if SPEEDSQL_X86
+#include <immintrin.h>
+#endif
+
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && \
+    (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    #define CHACHA20_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#define CHACHA20_DOUBLE_ROUNDS(QR, x) \
+    for (int round = 0; round < 10; round++) { \
+        QR(x[0], x[4], x[8], x[12]); \
+        QR(x[1], x[5], x[9], x[13]); \
+        QR(x[2], x[6], x[10], x[14]); \
+        QR(x[3], x[7], x[11], x[15]); \
+        QR(x[0], x[5], x[10], x[15]); \
+        QR(x[1], x[6], x[11], x[12]); \
+        QR(x[2], x[7], x[8], x[13]); \
+        QR(x[3], x[4], x[9], x[14]); \
+    }
+
+#if SPEEDSQL_X86
+
+/* SSE2: 4 blocks */
+#define ROTL_SSE2(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+#define QR_SSE2(a, b, c, d) \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTL_SSE2(d, 16); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTL_SSE2(b, 12); \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTL_SSE2(d, 8); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTL_SSE2(b, 7);
+
+SPEEDSQL_TARGET("sse2")
+static size_t chacha20_blocks_sse2(uint32_t* state, const uint8_t* in, uint8_t* out, size_t len) {
+    size_t done = 0;
+
+    while (len - done >= 4 * CHACHA20_BLOCK_SIZE) {
+        __m128i orig[16], x[16];
+        for (int i = 0; i < 16; i++) orig[i] = _mm_set1_epi32((int)state[i]);
+        orig[12] = _mm_add_epi32(orig[12], _mm_set_epi32(3, 2, 1, 0));
+        for (int i = 0; i < 16; i++) x[i] = orig[i];
+
+        CHACHA20_DOUBLE_ROUNDS(QR_SSE2, x)
+
+        for (int i = 0; i < 16; i++) x[i] = _mm_add_epi32(x[i], orig[i]);
+
+        /* 4x4 transpose per group of four words: row k is block k */
+        for (int g = 0; g < 4; g++) {
+            __m128i t0 = _mm_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+            __m128i t1 = _mm_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+            __m128i t2 = _mm_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m128i t3 = _mm_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m128i rows[4] = {
+                _mm_unpacklo_epi64(t0, t2), _mm_unpackhi_epi64(t0, t2),
+                _mm_unpacklo_epi64(t1, t3), _mm_unpackhi_epi64(t1, t3)
+            };
+            for (int k = 0; k < 4; k++) {
+                size_t at = done + k * CHACHA20_BLOCK_SIZE + g * 16;
+                __m128i p = _mm_loadu_si128((const __m128i*)(in + at));
+                _mm_storeu_si128((__m128i*)(out + at), _mm_xor_si128(p, rows[k]));
+            }
+        }
+
+        state[12] += 4;
+        done += 4 * CHACHA20_BLOCK_SIZE;
+    }
+
+    return done;
+}
+
+/* AVX2: 8 blocks, byte shuffles for the 16- and 8-bit rotations */
+#define ROTL_AVX2(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+#define QR_AVX2(a, b, c, d) \
+    a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rot16); \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = ROTL_AVX2(b, 12); \
+    a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rot8); \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = ROTL_AVX2(b, 7);
+
+SPEEDSQL_TARGET("avx2")
+static size_t chacha20_blocks_avx2(uint32_t* state, const uint8_t* in, uint8_t* out, size_t len) {
+    const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                          13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+    const __m256i rot8 = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                         14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+    size_t done = 0;
+
+    while (len - done >= 8 * CHACHA20_BLOCK_SIZE) {
+        __m256i orig[16], x[16];
+        for (int i = 0; i < 16; i++) orig[i] = _mm256_set1_epi32((int)state[i]);
+        orig[12] = _mm256_add_epi32(orig[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+        for (int i = 0; i < 16; i++) x[i] = orig[i];
+
+        CHACHA20_DOUBLE_ROUNDS(QR_AVX2, x)
+
+        for (int i = 0; i < 16; i++) x[i] = _mm256_add_epi32(x[i], orig[i]);
+
+        /* Per 128-bit lane transpose: rows[g][k] holds block k (low lane)
+         * and block k + 4 (high lane), words 4g..4g+3 */
+        __m256i rows[4][4];
+        for (int g = 0; g < 4; g++) {
+            __m256i t0 = _mm256_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+            __m256i t1 = _mm256_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+            __m256i t2 = _mm256_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m256i t3 = _mm256_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+            rows[g][0] = _mm256_unpacklo_epi64(t0, t2);
+            rows[g][1] = _mm256_unpackhi_epi64(t0, t2);
+            rows[g][2] = _mm256_unpacklo_epi64(t1, t3);
+            rows[g][3] = _mm256_unpackhi_epi64(t1, t3);
+        }
+
+        for (int k = 0; k < 4; k++) {
+            __m256i ks[4] = {
+                _mm256_permute2x128_si256(rows[0][k], rows[1][k], 0x20),  /* block k */
+                _mm256_permute2x128_si256(rows[2][k], rows[3][k], 0x20),
+                _mm256_permute2x128_si256(rows[0][k], rows[1][k], 0x31),  /* block k + 4 */
+                _mm256_permute2x128_si256(rows[2][k], rows[3][k], 0x31)
+            };
+            for (int h = 0; h < 4; h++) {
+                size_t at = done + (size_t)(k + (h / 2) * 4) * CHACHA20_BLOCK_SIZE + (h % 2) * 32;
+                __m256i p = _mm256_loadu_si256((const __m256i*)(in + at));
+                _mm256_storeu_si256((__m256i*)(out + at), _mm256_xor_si256(p, ks[h]));
+            }
+        }
+
+        state[12] += 8;
+        done += 8 * CHACHA20_BLOCK_SIZE;
+    }
+
+    return done;
+}
+
+/* AVX-512: 16 blocks, native rotates */
+#define QR_AVX512(a, b, c, d) \
+    a = _mm512_add_epi32(a, b); d = _mm512_xor_si512(d, a); d = _mm512_rol_epi32(d, 16); \
+    c = _mm512_add_epi32(c, d); b = _mm512_xor_si512(b, c); b = _mm512_rol_epi32(b, 12); \
+    a = _mm512_add_epi32(a, b); d = _mm512_xor_si512(d, a); d = _mm512_rol_epi32(d, 8); \
+    c = _mm512_add_epi32(c, d); b = _mm512_xor_si512(b, c); b = _mm512_rol_epi32(b, 7);
+
+/* GCC 12 flags the _mm512_undefined_epi32() passthrough inside its own
+ * unmasked intrinsics as maybe-uninitialized */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+SPEEDSQL_TARGET("avx512f")
+static size_t chacha20_blocks_avx512(uint32_t* state, const uint8_t* in, uint8_t* out, size_t len) {
+    size_t done = 0;
+
+    while (len - done >= 16 * CHACHA20_BLOCK_SIZE) {
+        __m512i orig[16], x[16];
+        for (int i = 0; i < 16; i++) orig[i] = _mm512_set1_epi32((int)state[i]);
+        orig[12] = _mm512_add_epi32(orig[12], _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8,
+                                                               7, 6, 5, 4, 3, 2, 1, 0));
+        for (int i = 0; i < 16; i++) x[i] = orig[i];
+
+        CHACHA20_DOUBLE_ROUNDS(QR_AVX512, x)
+
+        for (int i = 0; i < 16; i++) x[i] = _mm512_add_epi32(x[i], orig[i]);
+
+        /* Per-lane 4x4 transpose: rows[g][k] lane j is block k + 4j, words 4g..4g+3 */
+        __m512i rows[4][4];
+        for (int g = 0; g < 4; g++) {
+            __m512i t0 = _mm512_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+            __m512i t1 = _mm512_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+            __m512i t2 = _mm512_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m512i t3 = _mm512_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+            rows[g][0] = _mm512_unpacklo_epi64(t0, t2);
+            rows[g][1] = _mm512_unpackhi_epi64(t0, t2);
+            rows[g][2] = _mm512_unpacklo_epi64(t1, t3);
+            rows[g][3] = _mm512_unpackhi_epi64(t1, t3);
+        }
+
+        /* Then a 4x4 transpose of 128-bit lanes: one register per block */
+        for (int k = 0; k < 4; k++) {
+            __m512i v0 = _mm512_shuffle_i32x4(rows[0][k], rows[1][k], 0x44);
+            __m512i v1 = _mm512_shuffle_i32x4(rows[2][k], rows[3][k], 0x44);
+            __m512i v2 = _mm512_shuffle_i32x4(rows[0][k], rows[1][k], 0xee);
+            __m512i v3 = _mm512_shuffle_i32x4(rows[2][k], rows[3][k], 0xee);
+            __m512i ks[4] = {
+                _mm512_shuffle_i32x4(v0, v1, 0x88),  /* block k */
+                _mm512_shuffle_i32x4(v0, v1, 0xdd),  /* block k + 4 */
+                _mm512_shuffle_i32x4(v2, v3, 0x88),  /* block k + 8 */
+                _mm512_shuffle_i32x4(v2, v3, 0xdd)   /* block k + 12 */
+            };
+            for (int j = 0; j < 4; j++) {
+                size_t at = done + (size_t)(k + 4 * j) * CHACHA20_BLOCK_SIZE;
+                __m512i p = _mm512_loadu_si512((const void*)(in + at));
+                _mm512_storeu_si512((void*)(out + at), _mm512_xor_si512(p, ks[j]));
+            }
+        }
+
+        state[12] += 16;
+        done += 16 * CHACHA20_BLOCK_SIZE;
+    }
+
+    return done;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif /* SPEEDSQL_X86 */
+
+#ifdef CHACHA20_NEON
+
+/* NEON: 4 blocks */
+#define ROTL_NEON(v, n) vsriq_n_u32(vshlq_n_u32(v, n), v, 32 - (n))
+#define QR_NEON(a, b, c, d) \
+    a = vaddq_u32(a, b); d = veorq_u32(d, a); \
+    d = vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(d))); \
+    c = vaddq_u32(c, d); b = veorq_u32(b, c); b = ROTL_NEON(b, 12); \
+    a = vaddq_u32(a, b); d = veorq_u32(d, a); d = ROTL_NEON(d, 8); \
+    c = vaddq_u32(c, d); b = veorq_u32(b, c); b = ROTL_NEON(b, 7);
+
+static size_t chacha20_blocks_neon(uint32_t* state, const uint8_t* in, uint8_t* out, size_t len) {
+    static const uint32_t lane_index[4] = {0, 1, 2, 3};
+    size_t done = 0;
+
+    while (len - done >= 4 * CHACHA20_BLOCK_SIZE) {
+        uint32x4_t orig[16], x[16];
+        for (int i = 0; i < 16; i++) orig[i] = vdupq_n_u32(state[i]);
+        orig[12] = vaddq_u32(orig[12], vld1q_u32(lane_index));
+        for (int i = 0; i < 16; i++) x[i] = orig[i];
+
+        CHACHA20_DOUBLE_ROUNDS(QR_NEON, x)
+
+        for (int i = 0; i < 16; i++) x[i] = vaddq_u32(x[i], orig[i]);
+
+        for (int g = 0; g < 4; g++) {
+            uint32x4x2_t ab = vtrnq_u32(x[4 * g], x[4 * g + 1]);
+            uint32x4x2_t cd = vtrnq_u32(x[4 * g + 2], x[4 * g + 3]);
+            uint32x4_t rows[4] = {
+                vcombine_u32(vget_low_u32(ab.val[0]), vget_low_u32(cd.val[0])),
+                vcombine_u32(vget_low_u32(ab.val[1]), vget_low_u32(cd.val[1])),
+                vcombine_u32(vget_high_u32(ab.val[0]), vget_high_u32(cd.val[0])),
+                vcombine_u32(vget_high_u32(ab.val[1]), vget_high_u32(cd.val[1]))
+            };
+            for (int k = 0; k < 4; k++) {
+                size_t at = done + k * CHACHA20_BLOCK_SIZE + g * 16;
+                uint8x16_t p = vld1q_u8(in + at);
+                vst1q_u8(out + at, veorq_u8(p, vreinterpretq_u8_u32(rows[k])));
+            }
+        }
+
+        state[12] += 4;
+        done += 4 * CHACHA20_BLOCK_SIZE;
+    }
+
+    return done;
+}
+
+#endif /* CHACHA20_NEON */
+
+/* Widest kernels first; returns bytes done (whole blocks only) */
+static size_t chacha20_blocks_simd(uint32_t* state, const uint8_t* in, uint8_t* out, size_t len) {
+    size_t done = 0;
+    uint32_t features = cpu_features();
+
+#if SPEEDSQL_X86
+    if (features & CPU_FEATURE_AVX512F) {
+        done += chacha20_blocks_avx512(state, in + done, out + done, len - done);
+    }
+    if (features & CPU_FEATURE_AVX2) {
+        done += chacha20_blocks_avx2(state, in + done, out + done, len - done);
+    }
+    if (features & CPU_FEATURE_SSE2) {
+        done += chacha20_blocks_sse2(state, in + done, out + done, len - done);
+    }
+#elif defined(CHACHA20_NEON)
+    if (features & CPU_FEATURE_NEON) {
+        done += chacha20_blocks_neon(state, in + done, out + done, len - done);
+    }
+#else
+    (void)features;
+    (void)state;
+    (void)in;
+    (void)out;
+    (void)len;
+#endif
+
+    return done;
+}
+
 /* ChaCha20 encryption/decryption */
 static void chacha20_encrypt(const uint8_t* key, const uint8_t* nonce,
                               uint32_t counter, const uint8_t* input,
@@ -83,7 +380,7 @@ static void chacha20_encrypt(const uint8_t* key, const uint8_t* nonce,
     state[15] = ((uint32_t)nonce[8]) | ((uint32_t)nonce[9] << 8) |
                 ((uint32_t)nonce[10] << 16) | ((uint32_t)nonce[11] << 24);
 
-    size_t offset = 0;
+    size_t offset = chacha20_blocks_simd(state, input, output, len);
     while (offset < len) {
         chacha20_block(state, keystream);
         state[12]++;  /* Increment counter */
@@ -201,6 +498,144 @@ static void poly1305_blocks(poly1305_ctx* ctx, const uint8_t* m,
     ctx->h[4] = h4;
 }
 
+/* a * b mod 2^130 - 5, partially reduced (radix 2^26) */
+static void poly1305_mul(const uint32_t* a, const uint32_t* b, uint32_t* out) {
+    uint32_t s1 = b[1] * 5, s2 = b[2] * 5, s3 = b[3] * 5, s4 = b[4] * 5;
+
+    uint64_t d0 = (uint64_t)a[0] * b[0] + (uint64_t)a[1] * s4 +
+                  (uint64_t)a[2] * s3 + (uint64_t)a[3] * s2 + (uint64_t)a[4] * s1;
+    uint64_t d1 = (uint64_t)a[0] * b[1] + (uint64_t)a[1] * b[0] +
+                  (uint64_t)a[2] * s4 + (uint64_t)a[3] * s3 + (uint64_t)a[4] * s2;
+    uint64_t d2 = (uint64_t)a[0] * b[2] + (uint64_t)a[1] * b[1] +
+                  (uint64_t)a[2] * b[0] + (uint64_t)a[3] * s4 + (uint64_t)a[4] * s3;
+    uint64_t d3 = (uint64_t)a[0] * b[3] + (uint64_t)a[1] * b[2] +
+                  (uint64_t)a[2] * b[1] + (uint64_t)a[3] * b[0] + (uint64_t)a[4] * s4;
+    uint64_t d4 = (uint64_t)a[0] * b[4] + (uint64_t)a[1] * b[3] +
+                  (uint64_t)a[2] * b[2] + (uint64_t)a[3] * b[1] + (uint64_t)a[4] * b[0];
+
+    uint32_t c = (uint32_t)(d0 >> 26); out[0] = (uint32_t)d0 & 0x3ffffff;
+    d1 += c; c = (uint32_t)(d1 >> 26); out[1] = (uint32_t)d1 & 0x3ffffff;
+    d2 += c; c = (uint32_t)(d2 >> 26); out[2] = (uint32_t)d2 & 0x3ffffff;
+    d3 += c; c = (uint32_t)(d3 >> 26); out[3] = (uint32_t)d3 & 0x3ffffff;
+    d4 += c; c = (uint32_t)(d4 >> 26); out[4] = (uint32_t)d4 & 0x3ffffff;
+    out[0] += c * 5; c = out[0] >> 26; out[0] &= 0x3ffffff;
+    out[1] += c;
+}
+
+#if SPEEDSQL_X86
+
+/* 4-way AVX2 Poly1305 over 64-byte groups. Lane j accumulates blocks j,
+ * j + 4, ...; every step multiplies by r^4 except the last, which uses
+ * r^4..r^1 so that the lanes sum to the sequential result. */
+SPEEDSQL_TARGET("avx2")
+static size_t poly1305_blocks_avx2(poly1305_ctx* ctx, const uint8_t* m, size_t bytes) {
+    size_t groups = bytes / 64;
+    if (groups == 0) return 0;
+
+    uint32_t r2[5], r3[5], r4[5];
+    poly1305_mul(ctx->r, ctx->r, r2);
+    poly1305_mul(r2, ctx->r, r3);
+    poly1305_mul(r2, r2, r4);
+
+    /* The unpack loads leave blocks in lane order 0, 2, 1, 3 */
+    __m256i R[5], S[5], RF[5], SF[5];
+    for (int i = 0; i < 5; i++) {
+        R[i] = _mm256_set1_epi64x(r4[i]);
+        S[i] = _mm256_set1_epi64x((uint64_t)r4[i] * 5);
+        RF[i] = _mm256_set_epi64x(ctx->r[i], r3[i], r2[i], r4[i]);
+        SF[i] = _mm256_set_epi64x((uint64_t)ctx->r[i] * 5, (uint64_t)r3[i] * 5,
+                                  (uint64_t)r2[i] * 5, (uint64_t)r4[i] * 5);
+    }
+
+    const __m256i mask = _mm256_set1_epi64x(0x3ffffff);
+    const __m256i hibit = _mm256_set1_epi64x(1 << 24);
+
+    __m256i h[5];
+    for (int i = 0; i < 5; i++) {
+        h[i] = _mm256_set_epi64x(0, 0, 0, ctx->h[i]);
+    }
+
+    for (size_t g = 0; g < groups; g++, m += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)m);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(m + 32));
+        __m256i lo = _mm256_unpacklo_epi64(a, b);
+        __m256i hi = _mm256_unpackhi_epi64(a, b);
+
+        h[0] = _mm256_add_epi64(h[0], _mm256_and_si256(lo, mask));
+        h[1] = _mm256_add_epi64(h[1], _mm256_and_si256(_mm256_srli_epi64(lo, 26), mask));
+        h[2] = _mm256_add_epi64(h[2], _mm256_and_si256(
+            _mm256_or_si256(_mm256_srli_epi64(lo, 52), _mm256_slli_epi64(hi, 12)), mask));
+        h[3] = _mm256_add_epi64(h[3], _mm256_and_si256(_mm256_srli_epi64(hi, 14), mask));
+        h[4] = _mm256_add_epi64(h[4], _mm256_or_si256(_mm256_srli_epi64(hi, 40), hibit));
+
+        const __m256i* r = (g + 1 < groups) ? R : RF;
+        const __m256i* s = (g + 1 < groups) ? S : SF;
+
+        #define MUL(x, y) _mm256_mul_epu32(x, y)
+        #define ADD5(p, q, t, u, v) \
+            _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(p, q), _mm256_add_epi64(t, u)), v)
+        __m256i d0 = ADD5(MUL(h[0], r[0]), MUL(h[1], s[4]), MUL(h[2], s[3]),
+                          MUL(h[3], s[2]), MUL(h[4], s[1]));
+        __m256i d1 = ADD5(MUL(h[0], r[1]), MUL(h[1], r[0]), MUL(h[2], s[4]),
+                          MUL(h[3], s[3]), MUL(h[4], s[2]));
+        __m256i d2 = ADD5(MUL(h[0], r[2]), MUL(h[1], r[1]), MUL(h[2], r[0]),
+                          MUL(h[3], s[4]), MUL(h[4], s[3]));
+        __m256i d3 = ADD5(MUL(h[0], r[3]), MUL(h[1], r[2]), MUL(h[2], r[1]),
+                          MUL(h[3], r[0]), MUL(h[4], s[4]));
+        __m256i d4 = ADD5(MUL(h[0], r[4]), MUL(h[1], r[3]), MUL(h[2], r[2]),
+                          MUL(h[3], r[1]), MUL(h[4], r[0]));
+        #undef MUL
+        #undef ADD5
+
+        __m256i c = _mm256_srli_epi64(d0, 26); h[0] = _mm256_and_si256(d0, mask);
+        d1 = _mm256_add_epi64(d1, c); c = _mm256_srli_epi64(d1, 26); h[1] = _mm256_and_si256(d1, mask);
+        d2 = _mm256_add_epi64(d2, c); c = _mm256_srli_epi64(d2, 26); h[2] = _mm256_and_si256(d2, mask);
+        d3 = _mm256_add_epi64(d3, c); c = _mm256_srli_epi64(d3, 26); h[3] = _mm256_and_si256(d3, mask);
+        d4 = _mm256_add_epi64(d4, c); c = _mm256_srli_epi64(d4, 26); h[4] = _mm256_and_si256(d4, mask);
+        h[0] = _mm256_add_epi64(h[0], _mm256_add_epi64(c, _mm256_slli_epi64(c, 2)));
+        c = _mm256_srli_epi64(h[0], 26); h[0] = _mm256_and_si256(h[0], mask);
+        h[1] = _mm256_add_epi64(h[1], c);
+    }
+
+    /* Sum the lanes and carry back to 26-bit limbs */
+    uint64_t sum[5];
+    for (int i = 0; i < 5; i++) {
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, h[i]);
+        sum[i] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    uint64_t c = sum[0] >> 26; sum[0] &= 0x3ffffff;
+    sum[1] += c; c = sum[1] >> 26; sum[1] &= 0x3ffffff;
+    sum[2] += c; c = sum[2] >> 26; sum[2] &= 0x3ffffff;
+    sum[3] += c; c = sum[3] >> 26; sum[3] &= 0x3ffffff;
+    sum[4] += c; c = sum[4] >> 26; sum[4] &= 0x3ffffff;
+    sum[0] += c * 5; c = sum[0] >> 26; sum[0] &= 0x3ffffff;
+    sum[1] += c;
+
+    for (int i = 0; i < 5; i++) {
+        ctx->h[i] = (uint32_t)sum[i];
+    }
+
+    return groups * 64;
+}
+
+#endif /* SPEEDSQL_X86 */
+
+/* Vector path for long runs of full blocks; returns bytes done */
+static size_t poly1305_blocks_simd(poly1305_ctx* ctx, const uint8_t* m, size_t bytes) {
+#if SPEEDSQL_X86
+    if (bytes >= 256 && (cpu_features() & CPU_FEATURE_AVX2)) {
+        return poly1305_blocks_avx2(ctx, m, bytes);
+    }
+#else
+    (void)ctx;
+    (void)m;
+    (void)bytes;
+#endif
+    return 0;
+}
+
 static void poly1305_update(poly1305_ctx* ctx, const uint8_t* m, size_t bytes) {
     if (ctx->leftover) {
         size_t want = 16 - ctx->leftover;
@@ -216,7 +651,8 @@ static void poly1305_update(poly1305_ctx* ctx, const uint8_t* m, size_t bytes) {
 
     if (bytes >= 16) {
         size_t want = bytes & ~15;
-        poly1305_blocks(ctx, m, want, 1 << 24);
+        size_t done = poly1305_blocks_simd(ctx, m, want);
+        poly1305_blocks(ctx, m + done, want - done, 1 << 24);
         m += want;
         bytes -= want;
     }
@@ -245,6 +681,26 @@ static void poly1305_finish(poly1305_ctx* ctx, uint8_t tag[16]) {
     h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
     h1 += c;
 
+    /* g = h - p; keep it if h >= p (constant time) */
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1u << 26);
+
+    uint32_t mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    /* Repack the 26-bit limbs into 32-bit words (h mod 2^128) */
+    h0 = h0 | (h1 << 26);
+    h1 = (h1 >> 6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 << 8);
+
     /* h + pad */
     uint64_t f = (uint64_t)h0 + ctx->pad[0]; h0 = (uint32_t)f;
     f = (uint64_t)h1 + ctx->pad[1] + (f >> 32); h1 = (uint32_t)f;
@@ -412,7 +868,7 @@ static int chacha20_poly1305_rekey(speedsql_cipher_ctx_t* ctx,
 }
 
 static int chacha20_poly1305_self_test(void) {
-    /* RFC 8439 test vector */
+    /* RFC 8439 section 2.8.2 AEAD test vector */
     const uint8_t key[32] = {
         0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
         0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
@@ -423,28 +879,49 @@ static int chacha20_poly1305_self_test(void) {
         0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43,
         0x44, 0x45, 0x46, 0x47
     };
-    const uint8_t plaintext[16] = "Test message!!!";
+    const uint8_t aad[12] = {
+        0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7
+    };
+    const char* plaintext =
+        "Ladies and Gentlemen of the class of '99: If I could offer you "
+        "only one tip for the future, sunscreen would be it.";
+    const uint8_t expected_ct_head[16] = {
+        0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb,
+        0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2
+    };
+    const uint8_t expected_tag[16] = {
+        0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+        0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91
+    };
+    const size_t len = 114;
 
     speedsql_cipher_ctx_t* ctx;
     int rc = chacha20_poly1305_init(&ctx, key, 32);
     if (rc != SPEEDSQL_OK) return rc;
 
-    uint8_t ciphertext[16], tag[16], decrypted[16];
-    rc = chacha20_poly1305_encrypt(ctx, plaintext, 16, nonce,
-                                    nullptr, 0, ciphertext, tag);
+    uint8_t ciphertext[114], tag[16], decrypted[114];
+    rc = chacha20_poly1305_encrypt(ctx, (const uint8_t*)plaintext, len, nonce,
+                                    aad, sizeof(aad), ciphertext, tag);
     if (rc != SPEEDSQL_OK) {
         chacha20_poly1305_destroy(ctx);
         return rc;
     }
 
-    rc = chacha20_poly1305_decrypt(ctx, ciphertext, 16, nonce,
-                                    nullptr, 0, tag, decrypted);
+    if (memcmp(ciphertext, expected_ct_head, 16) != 0 ||
+        memcmp(tag, expected_tag, 16) != 0) {
+        chacha20_poly1305_destroy(ctx);
+        return SPEEDSQL_ERROR;
+    }
+
+    rc = chacha20_poly1305_decrypt(ctx, ciphertext, len, nonce,
+                                    aad, sizeof(aad), tag, decrypted);
     if (rc != SPEEDSQL_OK) {
         chacha20_poly1305_destroy(ctx);
         return rc;
     }
 
-    if (memcmp(plaintext, decrypted, 16) != 0) {
+    if (memcmp(plaintext, decrypted, len) != 0) {
         chacha20_poly1305_destroy(ctx);
         return SPEEDSQL_ERROR;
     }
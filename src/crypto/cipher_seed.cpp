@@ -3,6 +3,8 @@
  *
  * SEED is a Korean national standard block cipher (TTAS.KO-12.0004/R1)
  * 128-bit block cipher developed by KISA (Korea Information Security Agency)
+ *
+ * CBC decryption runs four blocks through the round tables at a time.
  */
 
 #include "speedsql_internal.h"
@@ -111,58 +113,65 @@ static void seed_key_schedule(speedsql_cipher_ctx_t* ctx, const uint8_t* key) {
     }
 }
 
-/* Encrypt a block */
-static void seed_encrypt_block(speedsql_cipher_ctx_t* ctx,
-                                const uint8_t* in, uint8_t* out) {
-    uint32_t l0, l1, r0, r1;
-    uint32_t t0, t1;
+#define SEED_LANES 4
+
+static inline uint32_t seed_load_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
 
-    /* Load block (big-endian) */
-    l0 = ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) |
-         ((uint32_t)in[2] << 8) | in[3];
-    l1 = ((uint32_t)in[4] << 24) | ((uint32_t)in[5] << 16) |
-         ((uint32_t)in[6] << 8) | in[7];
-    r0 = ((uint32_t)in[8] << 24) | ((uint32_t)in[9] << 16) |
-         ((uint32_t)in[10] << 8) | in[11];
-    r1 = ((uint32_t)in[12] << 24) | ((uint32_t)in[13] << 16) |
-         ((uint32_t)in[14] << 8) | in[15];
-
-    /* 16 rounds */
-    for (int i = 0; i < 16; i += 2) {
-        t0 = r0;
-        t1 = r1;
-        seed_f(&r0, &r1, ctx->round_keys[i * 2], ctx->round_keys[i * 2 + 1]);
-        r0 ^= l0;
-        r1 ^= l1;
-        l0 = t0;
-        l1 = t1;
-
-        t0 = r0;
-        t1 = r1;
-        seed_f(&r0, &r1, ctx->round_keys[(i + 1) * 2], ctx->round_keys[(i + 1) * 2 + 1]);
-        r0 ^= l0;
-        r1 ^= l1;
-        l0 = t0;
-        l1 = t1;
+static inline void seed_store_be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/*
+ * Run up to SEED_LANES blocks through the Feistel network, interleaved so
+ * their table lookups overlap. Decryption is the same network with the
+ * round keys taken in reverse order.
+ */
+static void seed_crypt_lanes(const speedsql_cipher_ctx_t* ctx, const uint8_t* in,
+                             uint8_t* out, size_t blocks, bool decrypt) {
+    uint32_t l0[SEED_LANES], l1[SEED_LANES], r0[SEED_LANES], r1[SEED_LANES];
+
+    for (size_t b = 0; b < blocks; b++) {
+        l0[b] = seed_load_be32(in + 16 * b);
+        l1[b] = seed_load_be32(in + 16 * b + 4);
+        r0[b] = seed_load_be32(in + 16 * b + 8);
+        r1[b] = seed_load_be32(in + 16 * b + 12);
     }
 
-    /* Store result (big-endian) */
-    out[0] = (r0 >> 24) & 0xff;
-    out[1] = (r0 >> 16) & 0xff;
-    out[2] = (r0 >> 8) & 0xff;
-    out[3] = r0 & 0xff;
-    out[4] = (r1 >> 24) & 0xff;
-    out[5] = (r1 >> 16) & 0xff;
-    out[6] = (r1 >> 8) & 0xff;
-    out[7] = r1 & 0xff;
-    out[8] = (l0 >> 24) & 0xff;
-    out[9] = (l0 >> 16) & 0xff;
-    out[10] = (l0 >> 8) & 0xff;
-    out[11] = l0 & 0xff;
-    out[12] = (l1 >> 24) & 0xff;
-    out[13] = (l1 >> 16) & 0xff;
-    out[14] = (l1 >> 8) & 0xff;
-    out[15] = l1 & 0xff;
+    for (int i = 0; i < SEED_ROUNDS; i++) {
+        int k = decrypt ? SEED_ROUNDS - 1 - i : i;
+        uint32_t k0 = ctx->round_keys[k * 2];
+        uint32_t k1 = ctx->round_keys[k * 2 + 1];
+
+        for (size_t b = 0; b < blocks; b++) {
+            uint32_t t0 = r0[b];
+            uint32_t t1 = r1[b];
+            seed_f(&r0[b], &r1[b], k0, k1);
+            r0[b] ^= l0[b];
+            r1[b] ^= l1[b];
+            l0[b] = t0;
+            l1[b] = t1;
+        }
+    }
+
+    /* Halves swap on the way out */
+    for (size_t b = 0; b < blocks; b++) {
+        seed_store_be32(out + 16 * b, r0[b]);
+        seed_store_be32(out + 16 * b + 4, r1[b]);
+        seed_store_be32(out + 16 * b + 8, l0[b]);
+        seed_store_be32(out + 16 * b + 12, l1[b]);
+    }
+}
+
+/* Encrypt a block */
+static void seed_encrypt_block(speedsql_cipher_ctx_t* ctx,
+                                const uint8_t* in, uint8_t* out) {
+    seed_crypt_lanes(ctx, in, out, 1, false);
 }
 
 /* Provider interface */
@@ -243,12 +252,27 @@ static int seed_cbc_decrypt(
 
     if (!ctx || !ctx->initialized) return SPEEDSQL_MISUSE;
 
-    /* Note: SEED decryption would require inverse key schedule */
-    /* This is a simplified placeholder */
-    (void)ciphertext;
-    (void)ciphertext_len;
-    (void)iv;
-    (void)plaintext;
+    if (ciphertext_len % 16 != 0) return SPEEDSQL_CORRUPT;
+
+    /* CBC decryption has no chain between block ciphers, so blocks go
+     * through in batches. The batch's ciphertext is kept aside for the
+     * chaining in case plaintext overwrites it. */
+    uint8_t prev[16];
+    uint8_t batch[16 * SEED_LANES];
+    uint8_t decrypted[16 * SEED_LANES];
+    memcpy(prev, iv, 16);
+
+    for (size_t i = 0; i < ciphertext_len; i += sizeof(batch)) {
+        size_t chunk = (ciphertext_len - i < sizeof(batch)) ? (ciphertext_len - i)
+                                                             : sizeof(batch);
+        memcpy(batch, &ciphertext[i], chunk);
+        seed_crypt_lanes(ctx, batch, decrypted, chunk / 16, true);
+
+        for (size_t j = 0; j < chunk; j++) {
+            plaintext[i + j] = decrypted[j] ^ ((j < 16) ? prev[j] : batch[j - 16]);
+        }
+        memcpy(prev, batch + chunk - 16, 16);
+    }
 
     return SPEEDSQL_OK;
 }
@@ -281,7 +305,14 @@ static int seed_cbc_self_test(void) {
     if (rc != SPEEDSQL_OK) return rc;
 
     uint8_t ciphertext[16];
+    uint8_t decrypted[16];
     rc = seed_cbc_encrypt(ctx, plaintext, 16, iv, nullptr, 0, ciphertext, nullptr);
+    if (rc == SPEEDSQL_OK) {
+        rc = seed_cbc_decrypt(ctx, ciphertext, 16, iv, nullptr, 0, nullptr, decrypted);
+    }
+    if (rc == SPEEDSQL_OK && memcmp(decrypted, plaintext, 16) != 0) {
+        rc = SPEEDSQL_ERROR;
+    }
 
     seed_cbc_destroy(ctx);
     return rc;
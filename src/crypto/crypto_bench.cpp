@@ -0,0 +1,284 @@
+/*
+ * SpeedSQL - Cipher throughput measurement
+ *
+ * Seals and opens whole pages with every registered provider, custom ones
+ * included, the way the buffer pool does: one context shared by all
+ * threads, a fresh nonce per page and the page number as AAD. Results
+ * are in MB/s summed over the threads, so a caller can compare providers
+ * on the machine it runs on and pick one before creating a database.
+ */
+
+#include "speedsql_internal.h"
+#include "speedsql_crypto.h"
+#include <string.h>
+
+/* Measuring time per direction when the caller passes 0 */
+#define BENCH_DEFAULT_MS 100
+
+/* Largest page and thread count accepted */
+#define BENCH_MAX_PAGE    (1u << 20)
+#define BENCH_MAX_THREADS 256
+
+/* Room after the page for a padding block and the tag */
+#define BENCH_SLACK 64
+
+typedef struct {
+    const speedsql_cipher_provider_t* provider;
+    speedsql_cipher_ctx_t* ctx;
+    size_t page_size;
+    size_t sealed_len;           /* Length decrypt takes, padding included */
+    uint64_t duration_us;
+    uint32_t index;              /* Thread number, mixed into the nonces */
+    uint64_t sealed;             /* Pages done in each direction */
+    uint64_t opened;
+    uint64_t seal_us;            /* Time spent in each direction */
+    uint64_t open_us;
+    int rc;
+} bench_worker_t;
+
+typedef struct {
+    uint8_t* page;
+    uint8_t* sealed;
+    uint8_t* opened;
+} bench_buffers_t;
+
+static int bench_buffers_alloc(bench_buffers_t* b, size_t page_size) {
+    b->page = (uint8_t*)sdb_malloc(page_size + BENCH_SLACK);
+    b->sealed = (uint8_t*)sdb_malloc(page_size + BENCH_SLACK);
+    b->opened = (uint8_t*)sdb_malloc(page_size + BENCH_SLACK);
+    if (!b->page || !b->sealed || !b->opened) return SPEEDSQL_NOMEM;
+
+    for (size_t i = 0; i < page_size; i++) {
+        b->page[i] = (uint8_t)(i * 31 + (i >> 8));
+    }
+    return SPEEDSQL_OK;
+}
+
+static void bench_buffers_free(bench_buffers_t* b) {
+    sdb_free(b->page);
+    sdb_free(b->sealed);
+    sdb_free(b->opened);
+}
+
+static void bench_nonce(uint8_t* iv, uint32_t thread, uint64_t seq) {
+    memset(iv, 0, 32);
+    memcpy(iv, &thread, sizeof(thread));
+    memcpy(iv + 4, &seq, sizeof(seq));
+}
+
+/* Seal pages for the measuring time, then open one page as often */
+static void* bench_worker_main(void* arg) {
+    bench_worker_t* w = (bench_worker_t*)arg;
+    const speedsql_cipher_provider_t* p = w->provider;
+    bench_buffers_t b;
+    uint8_t iv[32], tag[64];
+    uint8_t aad[8] = {0};
+
+    w->rc = bench_buffers_alloc(&b, w->page_size);
+    if (w->rc != SPEEDSQL_OK) {
+        bench_buffers_free(&b);
+        return nullptr;
+    }
+
+    uint64_t start = get_timestamp_us();
+    uint64_t now = start;
+    while (w->rc == SPEEDSQL_OK && now - start < w->duration_us) {
+        bench_nonce(iv, w->index, w->sealed);
+        memcpy(aad, &w->sealed, sizeof(w->sealed));
+        w->rc = p->encrypt(w->ctx, b.page, w->page_size, iv, aad, sizeof(aad), b.sealed, tag);
+        w->sealed++;
+        now = get_timestamp_us();
+    }
+    w->seal_us = now - start;
+
+    start = now;
+    while (w->rc == SPEEDSQL_OK && now - start < w->duration_us) {
+        w->rc = p->decrypt(w->ctx, b.sealed, w->sealed_len, iv, aad, sizeof(aad), tag, b.opened);
+        w->opened++;
+        now = get_timestamp_us();
+    }
+    w->open_us = now - start;
+
+    if (w->rc == SPEEDSQL_OK && memcmp(b.opened, b.page, w->page_size) != 0) {
+        w->rc = SPEEDSQL_CORRUPT;
+    }
+    bench_buffers_free(&b);
+    return nullptr;
+}
+
+/* The ciphertext length decrypt accepts: the page, or the page plus the
+ * padding block a CBC provider appends */
+static int bench_sealed_length(const speedsql_cipher_provider_t* p, speedsql_cipher_ctx_t* ctx,
+                               size_t page_size, size_t* sealed_len) {
+    bench_buffers_t b;
+    uint8_t iv[32], tag[64];
+    uint8_t aad[8] = {0};
+    int rc = bench_buffers_alloc(&b, page_size);
+
+    if (rc == SPEEDSQL_OK) {
+        bench_nonce(iv, 0, 0);
+        rc = p->encrypt(ctx, b.page, page_size, iv, aad, sizeof(aad), b.sealed, tag);
+    }
+    if (rc == SPEEDSQL_OK) {
+        size_t candidates[2] = {page_size, page_size + (p->block_size ? p->block_size : 16)};
+        rc = SPEEDSQL_CORRUPT;
+        for (int i = 0; i < 2 && rc != SPEEDSQL_OK; i++) {
+            if (candidates[i] > page_size + BENCH_SLACK) break;
+            rc = p->decrypt(ctx, b.sealed, candidates[i], iv, aad, sizeof(aad), tag, b.opened);
+            if (rc == SPEEDSQL_OK && memcmp(b.opened, b.page, page_size) == 0) {
+                *sealed_len = candidates[i];
+            } else {
+                rc = SPEEDSQL_CORRUPT;
+            }
+        }
+    }
+
+    bench_buffers_free(&b);
+    return rc;
+}
+
+static int bench_provider(const speedsql_cipher_provider_t* p, uint32_t page_size,
+                          uint32_t threads, uint32_t duration_ms,
+                          speedsql_crypto_bench_t* result) {
+    uint8_t key[64];
+    for (size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t)(i * 13 + 7);
+    if (p->key_size > sizeof(key) || p->iv_size > 32 || p->tag_size > 64) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    int rc = p->init(&ctx, key, p->key_size);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    size_t sealed_len = page_size;
+    rc = bench_sealed_length(p, ctx, page_size, &sealed_len);
+
+    bench_worker_t* workers = nullptr;
+    thread_t* handles = nullptr;
+    bool* started = nullptr;
+    if (rc == SPEEDSQL_OK) {
+        workers = (bench_worker_t*)sdb_calloc(threads, sizeof(bench_worker_t));
+        handles = (thread_t*)sdb_calloc(threads, sizeof(thread_t));
+        started = (bool*)sdb_calloc(threads, sizeof(bool));
+        if (!workers || !handles || !started) rc = SPEEDSQL_NOMEM;
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        for (uint32_t t = 0; t < threads; t++) {
+            workers[t].provider = p;
+            workers[t].ctx = ctx;
+            workers[t].page_size = page_size;
+            workers[t].sealed_len = sealed_len;
+            workers[t].duration_us = (uint64_t)duration_ms * 1000;
+            workers[t].index = t;
+        }
+
+        /* Thread 0 is the caller */
+        for (uint32_t t = 1; t < threads; t++) {
+            started[t] = thread_create(&handles[t], bench_worker_main, &workers[t]) == SPEEDSQL_OK;
+        }
+        bench_worker_main(&workers[0]);
+        for (uint32_t t = 1; t < threads; t++) {
+            if (started[t]) {
+                thread_join(handles[t]);
+            } else {
+                bench_worker_main(&workers[t]);
+            }
+        }
+
+        /* Bytes over all threads, per microsecond of the slowest one */
+        uint64_t sealed = 0, opened = 0, seal_us = 1, open_us = 1;
+        for (uint32_t t = 0; t < threads && rc == SPEEDSQL_OK; t++) {
+            rc = workers[t].rc;
+            sealed += workers[t].sealed;
+            opened += workers[t].opened;
+            if (workers[t].seal_us > seal_us) seal_us = workers[t].seal_us;
+            if (workers[t].open_us > open_us) open_us = workers[t].open_us;
+        }
+
+        result->cipher = p->cipher_id;
+        result->name = p->name;
+        result->page_size = page_size;
+        result->threads = threads;
+        result->seal_mbps = (double)sealed * page_size / (double)seal_us;
+        result->open_mbps = (double)opened * page_size / (double)open_us;
+    }
+
+    sdb_free(workers);
+    sdb_free(handles);
+    sdb_free(started);
+    if (p->destroy) p->destroy(ctx);
+    speedsql_secure_zero(key, sizeof(key));
+    return rc;
+}
+
+SPEEDSQL_API int speedsql_crypto_benchmark(
+    uint32_t page_size,
+    uint32_t threads,
+    uint32_t duration_ms,
+    speedsql_crypto_bench_t* results,
+    int* count
+) {
+    if (!results || !count || *count <= 0 || page_size == 0 || page_size > BENCH_MAX_PAGE ||
+        threads > BENCH_MAX_THREADS) {
+        return SPEEDSQL_MISUSE;
+    }
+    if (threads == 0) threads = cpu_count();
+    if (threads > BENCH_MAX_THREADS) threads = BENCH_MAX_THREADS;
+    if (duration_ms == 0) duration_ms = BENCH_DEFAULT_MS;
+
+    speedsql_cipher_t ciphers[64];
+    int listed = (int)(sizeof(ciphers) / sizeof(ciphers[0]));
+    int rc = speedsql_list_ciphers(ciphers, &listed);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    /* Providers that fail to seal or open their own pages are left out */
+    int n = 0;
+    for (int i = 0; i < listed && n < *count; i++) {
+        const speedsql_cipher_provider_t* p = speedsql_get_cipher(ciphers[i]);
+        if (!p || p->cipher_id == SPEEDSQL_CIPHER_NONE || !p->init || !p->encrypt || !p->decrypt) {
+            continue;
+        }
+        if (bench_provider(p, page_size, threads, duration_ms, &results[n]) == SPEEDSQL_OK) {
+            n++;
+        }
+    }
+
+    *count = n;
+    return SPEEDSQL_OK;
+}
+
+/* Usable for new databases: an AEAD that can also seal the WAL, passes its
+ * self-test, and is FIPS approved when FIPS mode is on */
+static bool bench_compliant(const speedsql_cipher_provider_t* p) {
+    if (!wal_can_seal(p->cipher_id)) return false;
+    if (speedsql_crypto_fips_mode() && p->cipher_id != SPEEDSQL_CIPHER_AES_256_GCM) return false;
+    return !p->self_test || p->self_test() == SPEEDSQL_OK;
+}
+
+SPEEDSQL_API int speedsql_crypto_fastest(uint32_t page_size, speedsql_cipher_t* cipher) {
+    if (!cipher) return SPEEDSQL_MISUSE;
+
+    speedsql_crypto_bench_t results[64];
+    int count = (int)(sizeof(results) / sizeof(results[0]));
+    int rc = speedsql_crypto_benchmark(page_size, 1, BENCH_DEFAULT_MS / 4, results, &count);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    /* Lowest cost of sealing plus opening a page */
+    double best_cost = 0;
+    bool found = false;
+    for (int i = 0; i < count; i++) {
+        const speedsql_cipher_provider_t* p = speedsql_get_cipher(results[i].cipher);
+        if (!p || !bench_compliant(p) || results[i].seal_mbps <= 0 || results[i].open_mbps <= 0) {
+            continue;
+        }
+        double cost = 1.0 / results[i].seal_mbps + 1.0 / results[i].open_mbps;
+        if (!found || cost < best_cost) {
+            best_cost = cost;
+            *cipher = results[i].cipher;
+            found = true;
+        }
+    }
+
+    return found ? SPEEDSQL_OK : SPEEDSQL_NOTFOUND;
+}
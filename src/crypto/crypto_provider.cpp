@@ -271,58 +271,216 @@ SPEEDSQL_API int speedsql_random_key(uint8_t* key, size_t key_len) {
 }
 
 /* ============================================================================
- * Key Derivation (PBKDF2)
+ * Key Derivation
  * ============================================================================ */
 
-/* Simple PBKDF2-SHA256 implementation */
-static void pbkdf2_sha256_simple(const uint8_t* password, size_t password_len,
-                                  const uint8_t* salt, size_t salt_len,
-                                  uint32_t iterations, uint8_t* output, size_t output_len) {
-    /* Simplified PBKDF2 - uses FNV-1a based derivation */
-    /* In production, use proper HMAC-SHA256 */
-    uint32_t block = 1;
-    size_t output_pos = 0;
-
-    while (output_pos < output_len) {
-        uint32_t hash = 0x811c9dc5;
-
-        /* Hash password */
-        for (size_t i = 0; i < password_len; i++) {
-            hash ^= password[i];
-            hash *= 0x01000193;
+/* Largest derived-key cache speedsql_kdf_cache accepts */
+#define KDF_CACHE_MAX 4096
+
+/* KDF inputs besides password and salt, with defaults filled in */
+typedef struct {
+    speedsql_kdf_t kdf;
+    uint32_t iterations;         /* PBKDF2 iterations or Argon2 passes */
+    uint32_t memory_kb;          /* Argon2 only */
+    uint32_t parallelism;        /* Argon2 only */
+} kdf_params_t;
+
+static kdf_params_t kdf_params(speedsql_kdf_t kdf, uint32_t iterations,
+                               uint32_t memory_kb, uint32_t parallelism) {
+    kdf_params_t p;
+    memset(&p, 0, sizeof(p));
+    p.kdf = kdf;
+    p.iterations = iterations;
+    if (kdf == SPEEDSQL_KDF_ARGON2ID) {
+        if (p.iterations == 0) p.iterations = SPEEDSQL_ARGON2_PASSES;
+        p.memory_kb = memory_kb ? memory_kb : SPEEDSQL_ARGON2_MEMORY;
+        p.parallelism = parallelism ? parallelism : SPEEDSQL_ARGON2_PARALLELISM;
+    }
+    return p;
+}
+
+static int kdf_run(const kdf_params_t* p, const uint8_t* password, size_t password_len,
+                   const uint8_t* salt, size_t salt_len, uint8_t* key_out, size_t key_len) {
+    switch (p->kdf) {
+        case SPEEDSQL_KDF_PBKDF2_SHA256:
+            pbkdf2_hmac_sha256(password, password_len, salt, salt_len,
+                               p->iterations, key_out, key_len);
+            return SPEEDSQL_OK;
+
+        case SPEEDSQL_KDF_PBKDF2_SHA512:
+            pbkdf2_hmac_sha512(password, password_len, salt, salt_len,
+                               p->iterations, key_out, key_len);
+            return SPEEDSQL_OK;
+
+        case SPEEDSQL_KDF_ARGON2ID: {
+            argon2_params_t params;
+            memset(&params, 0, sizeof(params));
+            params.passes = p->iterations;
+            params.memory_kb = p->memory_kb;
+            params.lanes = p->parallelism;
+            return argon2id_hash(password, password_len, salt, salt_len,
+                                 &params, key_out, key_len);
         }
 
-        /* Hash salt */
-        for (size_t i = 0; i < salt_len; i++) {
-            hash ^= salt[i];
-            hash *= 0x01000193;
+        default:
+            return SPEEDSQL_MISUSE;
+    }
+}
+
+/*
+ * Derived-key cache. A connection pool reopening the same database pays
+ * for the KDF once per process. Entries live in secure memory and are
+ * found by an HMAC of the inputs under a per-process random secret, so
+ * neither the password nor a plain hash of it is kept.
+ */
+
+typedef struct {
+    uint8_t id[SHA256_DIGEST_SIZE];
+    uint8_t key[SPEEDSQL_KEY_SIZE_512];
+    uint64_t used;               /* Clock value of the last hit, for LRU */
+    bool valid;
+} kdf_cache_entry_t;
+
+static struct {
+    kdf_cache_entry_t* entries;  /* nullptr while disabled */
+    uint32_t capacity;
+    uint64_t clock;
+    uint64_t generation;         /* Bumped whenever the cache is rebuilt */
+    uint64_t hits;
+    uint64_t misses;
+    uint8_t secret[SHA256_DIGEST_SIZE];
+} g_kdf_cache;
+
+static mutex_t* kdf_cache_lock(void) {
+    static mutex_t lock;
+    static bool ready = (mutex_init(&lock), true);
+    (void)ready;
+    return &lock;
+}
+
+/* Entry id for one derivation; caller holds the lock */
+static int kdf_cache_id(const kdf_params_t* p, const uint8_t* password, size_t password_len,
+                        const uint8_t* salt, size_t salt_len, size_t key_len, uint8_t* id) {
+    uint32_t fields[6] = {
+        (uint32_t)p->kdf, p->iterations, p->memory_kb, p->parallelism,
+        (uint32_t)key_len, (uint32_t)salt_len
+    };
+    size_t len = sizeof(fields) + salt_len + password_len;
+    uint8_t* input = (uint8_t*)sdb_malloc(len);
+    if (!input) return SPEEDSQL_NOMEM;
+
+    memcpy(input, fields, sizeof(fields));
+    memcpy(input + sizeof(fields), salt, salt_len);
+    memcpy(input + sizeof(fields) + salt_len, password, password_len);
+    hmac_sha256(g_kdf_cache.secret, sizeof(g_kdf_cache.secret), input, len, id);
+
+    speedsql_secure_zero(input, len);
+    sdb_free(input);
+    return SPEEDSQL_OK;
+}
+
+static void kdf_cache_insert(const uint8_t* id, const uint8_t* key, size_t key_len) {
+    kdf_cache_entry_t* victim = &g_kdf_cache.entries[0];
+    for (uint32_t i = 0; i < g_kdf_cache.capacity; i++) {
+        kdf_cache_entry_t* e = &g_kdf_cache.entries[i];
+        if (!e->valid || memcmp(e->id, id, SHA256_DIGEST_SIZE) == 0) {
+            victim = e;
+            break;
         }
+        if (e->used < victim->used) victim = e;
+    }
 
-        /* Hash block number */
-        hash ^= (block >> 24) & 0xff;
-        hash *= 0x01000193;
-        hash ^= (block >> 16) & 0xff;
-        hash *= 0x01000193;
-        hash ^= (block >> 8) & 0xff;
-        hash *= 0x01000193;
-        hash ^= block & 0xff;
-        hash *= 0x01000193;
-
-        /* Iterate */
-        for (uint32_t iter = 0; iter < iterations; iter++) {
-            hash ^= iter;
-            hash *= 0x01000193;
+    memcpy(victim->id, id, SHA256_DIGEST_SIZE);
+    speedsql_secure_zero(victim->key, sizeof(victim->key));
+    memcpy(victim->key, key, key_len);
+    victim->used = ++g_kdf_cache.clock;
+    victim->valid = true;
+}
+
+/* Run the KDF, or answer from the cache when it holds the result */
+static int kdf_derive(const kdf_params_t* p, const uint8_t* password, size_t password_len,
+                      const uint8_t* salt, size_t salt_len, uint8_t* key_out, size_t key_len) {
+    uint8_t id[SHA256_DIGEST_SIZE];
+    uint64_t generation = 0;
+    bool cacheable = false;
+
+    mutex_lock(kdf_cache_lock());
+    if (g_kdf_cache.entries && key_len <= SPEEDSQL_KEY_SIZE_512 &&
+        kdf_cache_id(p, password, password_len, salt, salt_len, key_len, id) == SPEEDSQL_OK) {
+        for (uint32_t i = 0; i < g_kdf_cache.capacity; i++) {
+            kdf_cache_entry_t* e = &g_kdf_cache.entries[i];
+            if (e->valid && memcmp(e->id, id, sizeof(id)) == 0) {
+                memcpy(key_out, e->key, key_len);
+                e->used = ++g_kdf_cache.clock;
+                g_kdf_cache.hits++;
+                mutex_unlock(kdf_cache_lock());
+                return SPEEDSQL_OK;
+            }
         }
+        g_kdf_cache.misses++;
+        generation = g_kdf_cache.generation;
+        cacheable = true;
+    }
+    mutex_unlock(kdf_cache_lock());
+
+    /* The KDF itself runs without the lock */
+    int rc = kdf_run(p, password, password_len, salt, salt_len, key_out, key_len);
 
-        /* Output 4 bytes from this block */
-        for (int i = 0; i < 4 && output_pos < output_len; i++) {
-            output[output_pos++] = (hash >> (i * 8)) & 0xff;
-            hash *= 0x01000193;
-            hash ^= (uint32_t)block;
+    if (rc == SPEEDSQL_OK && cacheable) {
+        mutex_lock(kdf_cache_lock());
+        if (g_kdf_cache.entries && g_kdf_cache.generation == generation) {
+            kdf_cache_insert(id, key_out, key_len);
         }
+        mutex_unlock(kdf_cache_lock());
+    }
+    speedsql_secure_zero(id, sizeof(id));
+    return rc;
+}
+
+SPEEDSQL_API int speedsql_kdf_cache(uint32_t max_entries) {
+    if (max_entries > KDF_CACHE_MAX) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    kdf_cache_entry_t* entries = nullptr;
+    size_t size = (size_t)max_entries * sizeof(kdf_cache_entry_t);
+    if (max_entries > 0) {
+        entries = (kdf_cache_entry_t*)speedsql_secure_malloc(size);
+        if (!entries) return SPEEDSQL_NOMEM;
+        memset(entries, 0, size);
+    }
 
-        block++;
+    mutex_lock(kdf_cache_lock());
+    if (g_kdf_cache.entries) {
+        speedsql_secure_free(g_kdf_cache.entries,
+                             (size_t)g_kdf_cache.capacity * sizeof(kdf_cache_entry_t));
+    }
+    g_kdf_cache.entries = entries;
+    g_kdf_cache.capacity = max_entries;
+    g_kdf_cache.generation++;
+    g_kdf_cache.hits = 0;
+    g_kdf_cache.misses = 0;
+
+    int rc = SPEEDSQL_OK;
+    speedsql_secure_zero(g_kdf_cache.secret, sizeof(g_kdf_cache.secret));
+    if (entries) {
+        rc = secure_random(g_kdf_cache.secret, sizeof(g_kdf_cache.secret));
+        if (rc != SPEEDSQL_OK) {
+            speedsql_secure_free(entries, size);
+            g_kdf_cache.entries = nullptr;
+            g_kdf_cache.capacity = 0;
+        }
     }
+    mutex_unlock(kdf_cache_lock());
+    return rc;
+}
+
+SPEEDSQL_API int speedsql_kdf_cache_stats(uint64_t* hits, uint64_t* misses) {
+    mutex_lock(kdf_cache_lock());
+    if (hits) *hits = g_kdf_cache.hits;
+    if (misses) *misses = g_kdf_cache.misses;
+    mutex_unlock(kdf_cache_lock());
+    return SPEEDSQL_OK;
 }
 
 SPEEDSQL_API int speedsql_derive_key(
@@ -339,44 +497,127 @@ SPEEDSQL_API int speedsql_derive_key(
         return SPEEDSQL_MISUSE;
     }
 
-    switch (kdf) {
-        case SPEEDSQL_KDF_NONE:
-            /* Use password directly (not recommended) */
-            memset(key_out, 0, key_len);
-            memcpy(key_out, password, password_len < key_len ? password_len : key_len);
-            break;
+    if (kdf == SPEEDSQL_KDF_NONE) {
+        /* Use password directly (not recommended) */
+        memset(key_out, 0, key_len);
+        memcpy(key_out, password, password_len < key_len ? password_len : key_len);
+        return SPEEDSQL_OK;
+    }
 
-        case SPEEDSQL_KDF_PBKDF2_SHA256:
-        case SPEEDSQL_KDF_PBKDF2_SHA512:
-            pbkdf2_sha256_simple((const uint8_t*)password, password_len,
-                                  salt, salt_len, iterations, key_out, key_len);
-            break;
+    kdf_params_t p = kdf_params(kdf, iterations, 0, 0);
+    return kdf_derive(&p, (const uint8_t*)password, password_len, salt, salt_len,
+                      key_out, key_len);
+}
 
-        default:
-            return SPEEDSQL_MISUSE;
+SPEEDSQL_API int speedsql_derive_key_v2(
+    const char* password,
+    size_t password_len,
+    const speedsql_crypto_config_t* config,
+    uint8_t* key_out,
+    size_t key_len
+) {
+    if (!password || !config || !key_out) {
+        return SPEEDSQL_MISUSE;
     }
 
-    return SPEEDSQL_OK;
+    if (config->kdf == SPEEDSQL_KDF_NONE) {
+        return speedsql_derive_key(password, password_len, config->salt, SPEEDSQL_SALT_SIZE,
+                                   config->kdf, 0, key_out, key_len);
+    }
+
+    kdf_params_t p = kdf_params(config->kdf, config->kdf_iterations,
+                                config->kdf_memory, config->kdf_parallelism);
+    return kdf_derive(&p, (const uint8_t*)password, password_len,
+                      config->salt, SPEEDSQL_SALT_SIZE, key_out, key_len);
 }
 
 /* ============================================================================
  * Database Encryption API
  * ============================================================================ */
 
-/* Simple key setup (uses AES-256-GCM by default) */
+/* The header records how the page key was derived: cipher, KDF and its
+ * parameters, and the salt. The salt is no secret, and without it a
+ * password cannot give the same key again. */
+static bool header_key_config(const speedsql* db, speedsql_crypto_config_t* config) {
+    if (db->header.key_kdf == SPEEDSQL_KDF_NONE) return false;
+
+    config->cipher = (speedsql_cipher_t)db->header.key_cipher;
+    config->kdf = (speedsql_kdf_t)db->header.key_kdf;
+    config->kdf_iterations = db->header.key_iterations;
+    config->kdf_memory = db->header.key_memory;
+    config->kdf_parallelism = db->header.key_parallelism;
+    memcpy(config->salt, db->header.key_salt, SPEEDSQL_SALT_SIZE);
+    return true;
+}
+
+/* Record a key's derivation in the header, writing it only on change */
+int crypto_save_key_config(speedsql* db, const speedsql_crypto_config_t* config) {
+    db_header_t* h = &db->header;
+    bool derived = config->kdf != SPEEDSQL_KDF_NONE;
+    uint32_t kdf = derived ? (uint32_t)config->kdf : 0;
+    uint32_t iterations = derived ? config->kdf_iterations : 0;
+    uint32_t memory = derived ? config->kdf_memory : 0;
+    uint32_t parallelism = derived ? config->kdf_parallelism : 0;
+
+    if (h->key_cipher == (uint32_t)config->cipher && h->key_kdf == kdf &&
+        h->key_iterations == iterations && h->key_memory == memory &&
+        h->key_parallelism == parallelism &&
+        (!derived || memcmp(h->key_salt, config->salt, SPEEDSQL_SALT_SIZE) == 0)) {
+        return SPEEDSQL_OK;
+    }
+
+    h->key_cipher = (uint32_t)config->cipher;
+    h->key_kdf = kdf;
+    h->key_iterations = iterations;
+    h->key_memory = memory;
+    h->key_parallelism = parallelism;
+    if (derived) {
+        memcpy(h->key_salt, config->salt, SPEEDSQL_SALT_SIZE);
+    } else {
+        memset(h->key_salt, 0, sizeof(h->key_salt));
+    }
+    return save_schema(db);
+}
+
+/* Simple key setup: a database keyed before derives its key the way the
+ * header records; a new one gets AES-256-GCM and a fresh salt */
 SPEEDSQL_API int speedsql_key(speedsql* db, const void* key, int key_len) {
+    if (!db) return SPEEDSQL_MISUSE;
+
     speedsql_crypto_config_t config;
     memset(&config, 0, sizeof(config));
-    config.cipher = SPEEDSQL_CIPHER_AES_256_GCM;
-    config.kdf = SPEEDSQL_KDF_PBKDF2_SHA256;
-    config.kdf_iterations = 100000;
+    if (!header_key_config(db, &config)) {
+        config.cipher = SPEEDSQL_CIPHER_AES_256_GCM;
+        config.kdf = SPEEDSQL_KDF_PBKDF2_SHA256;
+        config.kdf_iterations = 100000;
 
-    /* Generate random salt */
-    speedsql_random_salt(config.salt, SPEEDSQL_SALT_SIZE);
+        int rc = speedsql_random_salt(config.salt, SPEEDSQL_SALT_SIZE);
+        if (rc != SPEEDSQL_OK) return rc;
+    }
 
     return speedsql_key_v2(db, key, key_len, &config);
 }
 
+/* Page key for a configuration: derived with its KDF, or the raw key */
+static int config_page_key(const void* key, int key_len, const speedsql_crypto_config_t* config,
+                           const speedsql_cipher_provider_t* provider, uint8_t* derived_key) {
+    if (config->kdf != SPEEDSQL_KDF_NONE) {
+        int rc = speedsql_derive_key_v2((const char*)key, key_len, config,
+                                        derived_key, provider->key_size);
+        if (rc != SPEEDSQL_OK) {
+            speedsql_secure_zero(derived_key, provider->key_size);
+        }
+        return rc;
+    }
+
+    /* Use key directly */
+    if ((size_t)key_len < provider->key_size) {
+        return SPEEDSQL_MISUSE;
+    }
+    memcpy(derived_key, key, provider->key_size);
+    return SPEEDSQL_OK;
+}
+
 /* Key setup with configuration */
 SPEEDSQL_API int speedsql_key_v2(
     speedsql* db,
@@ -396,44 +637,71 @@ SPEEDSQL_API int speedsql_key_v2(
         return SPEEDSQL_NOTFOUND;
     }
 
-    /* Derive key if KDF is specified */
-    uint8_t derived_key[64];  /* Max key size */
-    if (config->kdf != SPEEDSQL_KDF_NONE) {
-        int rc = speedsql_derive_key(
-            (const char*)key, key_len,
-            config->salt, SPEEDSQL_SALT_SIZE,
-            config->kdf, config->kdf_iterations,
-            derived_key, provider->key_size
-        );
-        if (rc != SPEEDSQL_OK) {
-            speedsql_secure_zero(derived_key, sizeof(derived_key));
-            return rc;
-        }
-    } else {
-        /* Use key directly */
-        if ((size_t)key_len < provider->key_size) {
+    /* Page layout: the header records it once pages exist. The aligned
+     * layout can only be chosen while the file has no data pages. */
+    uint32_t reserve = db->header.page_reserve;
+    bool on_disk = db->buffer_pool && !(db->flags & SPEEDSQL_OPEN_MEMORY);
+    if (reserve == 0 && config->aligned_pages && on_disk) {
+        uint64_t size = 0;
+        file_size(&db->db_file, &size);
+        if (size > 2 * (uint64_t)db->header.page_size || db->table_count > 0) {
             return SPEEDSQL_MISUSE;
         }
-        memcpy(derived_key, key, provider->key_size);
+        reserve = buffer_pool_reserve_for(config->cipher);
+    }
+    if (reserve && reserve < provider->iv_size + provider->tag_size) {
+        return SPEEDSQL_MISUSE;  /* Tail too small for this cipher */
     }
 
-    /* Destroy existing cipher context if any */
-    if (db->cipher_ctx && provider->destroy) {
-        provider->destroy(db->cipher_ctx);
-        db->cipher_ctx = nullptr;
+    uint8_t derived_key[64];  /* Max key size */
+    int rc = config_page_key(key, key_len, config, provider, derived_key);
+    if (rc != SPEEDSQL_OK) {
+        return rc;
     }
 
     /* Initialize new cipher context */
-    int rc = provider->init(&db->cipher_ctx, derived_key, provider->key_size);
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    rc = provider->init(&ctx, derived_key, provider->key_size);
     speedsql_secure_zero(derived_key, sizeof(derived_key));
 
     if (rc != SPEEDSQL_OK) {
         return rc;
     }
 
+    /* The log is sealed with the page key; replacing a key starts it over */
+    if (db->wal) {
+        rc = wal_set_cipher(db->wal, ctx, config->cipher, db->cipher_ctx != nullptr);
+        if (rc != SPEEDSQL_OK) {
+            if (provider->destroy) provider->destroy(ctx);
+            sdb_set_error(db, rc, "Cipher %s cannot seal the WAL", provider->name);
+            return rc;
+        }
+    }
+
+    /* Destroy existing cipher context if any */
+    if (db->cipher_ctx) {
+        const speedsql_cipher_provider_t* current = speedsql_get_cipher(db->cipher_id);
+        if (current && current->destroy) {
+            current->destroy(db->cipher_ctx);
+        }
+    }
+
+    db->cipher_ctx = ctx;
     db->cipher_id = config->cipher;
     db->encrypted = true;
 
+    /* Record a newly chosen aligned layout before any page uses it */
+    if (reserve != db->header.page_reserve) {
+        db->header.page_reserve = reserve;
+        rc = save_schema(db);
+        if (rc == SPEEDSQL_OK) {
+            rc = buffer_pool_set_page_reserve(db->buffer_pool, reserve);
+        }
+        if (rc != SPEEDSQL_OK) {
+            return rc;
+        }
+    }
+
     /* Set encryption on buffer pool for page-level encryption */
     if (db->buffer_pool) {
         rc = buffer_pool_set_encryption(db->buffer_pool, db->cipher_ctx, db->cipher_id);
@@ -442,7 +710,8 @@ SPEEDSQL_API int speedsql_key_v2(
         }
     }
 
-    return SPEEDSQL_OK;
+    /* Later opens derive the same key from the same password */
+    return crypto_save_key_config(db, config);
 }
 
 /* Change encryption key */
@@ -456,42 +725,92 @@ SPEEDSQL_API int speedsql_rekey(speedsql* db, const void* new_key, int key_len)
         return speedsql_key(db, new_key, key_len);
     }
 
-    /* Get current cipher provider */
-    const speedsql_cipher_provider_t* provider = speedsql_get_cipher(db->cipher_id);
-    if (!provider) {
-        return SPEEDSQL_ERROR;
+    /* Same cipher, new key derived with a fresh salt */
+    speedsql_crypto_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.cipher = db->cipher_id;
+    config.kdf = SPEEDSQL_KDF_PBKDF2_SHA256;
+    config.kdf_iterations = 100000;
+    speedsql_random_salt(config.salt, SPEEDSQL_SALT_SIZE);
+
+    return speedsql_rekey_v2(db, new_key, key_len, &config);
+}
+
+/* Change key and cipher; existing pages are resealed in the background */
+SPEEDSQL_API int speedsql_rekey_v2(
+    speedsql* db,
+    const void* new_key,
+    int key_len,
+    const speedsql_crypto_config_t* new_config
+) {
+    if (!db || !new_key || key_len <= 0 || !new_config) {
+        return SPEEDSQL_MISUSE;
     }
 
-    /* Generate new derived key */
-    uint8_t new_salt[SPEEDSQL_SALT_SIZE];
-    speedsql_random_salt(new_salt, SPEEDSQL_SALT_SIZE);
+    if (!db->encrypted || !db->cipher_ctx) {
+        return speedsql_key_v2(db, new_key, key_len, new_config);
+    }
+
+    crypto_registry_init();
+
+    const speedsql_cipher_provider_t* provider = speedsql_get_cipher(new_config->cipher);
+    const speedsql_cipher_provider_t* current = speedsql_get_cipher(db->cipher_id);
+    if (!provider || !current) {
+        return SPEEDSQL_NOTFOUND;
+    }
+
+    /* Pages are resealed in place: the new cipher must fit the same slot */
+    uint32_t reserve = db->header.page_reserve;
+    bool fits = reserve ? provider->iv_size + provider->tag_size <= reserve
+                        : provider->tag_size == current->tag_size;
+    if (!fits) {
+        sdb_set_error(db, SPEEDSQL_MISUSE, "Cipher %s does not fit the page layout",
+                      provider->name);
+        return SPEEDSQL_MISUSE;
+    }
+    if (db->wal && !wal_can_seal(new_config->cipher)) {
+        sdb_set_error(db, SPEEDSQL_MISUSE, "Cipher %s cannot seal the WAL", provider->name);
+        return SPEEDSQL_MISUSE;
+    }
 
-    uint8_t derived_key[64];
-    int rc = speedsql_derive_key(
-        (const char*)new_key, key_len,
-        new_salt, SPEEDSQL_SALT_SIZE,
-        SPEEDSQL_KDF_PBKDF2_SHA256, 100000,
-        derived_key, provider->key_size
-    );
+    uint8_t derived_key[64];  /* Max key size */
+    int rc = config_page_key(new_key, key_len, new_config, provider, derived_key);
+    if (rc != SPEEDSQL_OK) {
+        return rc;
+    }
 
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    rc = provider->init(&ctx, derived_key, provider->key_size);
+    speedsql_secure_zero(derived_key, sizeof(derived_key));
     if (rc != SPEEDSQL_OK) {
-        speedsql_secure_zero(derived_key, sizeof(derived_key));
         return rc;
     }
 
-    /* Use rekey function if available */
-    if (provider->rekey) {
-        rc = provider->rekey(db->cipher_ctx, derived_key, provider->key_size);
+    if (db->buffer_pool && !(db->flags & SPEEDSQL_OPEN_MEMORY)) {
+        /* The pool keeps the old context until every page is resealed */
+        rc = rekey_start(db, ctx, new_config);
+        if (rc != SPEEDSQL_OK) {
+            if (provider->destroy) provider->destroy(ctx);
+            return rc;
+        }
+
+        /* The log starts over under the new key */
+        if (db->wal) {
+            rc = wal_set_cipher(db->wal, ctx, new_config->cipher, true);
+        }
     } else {
-        /* Fallback: destroy and reinitialize */
-        if (provider->destroy) {
-            provider->destroy(db->cipher_ctx);
+        /* Nothing on disk to reseal */
+        if (db->buffer_pool) {
+            buffer_pool_set_encryption(db->buffer_pool, ctx, new_config->cipher);
         }
-        rc = provider->init(&db->cipher_ctx, derived_key, provider->key_size);
+        if (current->destroy) {
+            current->destroy(db->cipher_ctx);
+        }
+        rc = crypto_save_key_config(db, new_config);
     }
 
-    speedsql_secure_zero(derived_key, sizeof(derived_key));
-
+    db->cipher_ctx = ctx;
+    db->cipher_id = new_config->cipher;
     return rc;
 }
 
@@ -499,6 +818,16 @@ SPEEDSQL_API int speedsql_rekey(speedsql* db, const void* new_key, int key_len)
 SPEEDSQL_API int speedsql_decrypt(speedsql* db) {
     if (!db) return SPEEDSQL_MISUSE;
 
+    /* Pages are still sealed with two keys */
+    if (speedsql_rekey_status(db, nullptr, nullptr) == SPEEDSQL_BUSY) {
+        return SPEEDSQL_BUSY;
+    }
+
+    /* The log goes back to plain records before the key is gone */
+    if (db->wal) {
+        wal_set_cipher(db->wal, nullptr, SPEEDSQL_CIPHER_NONE, true);
+    }
+
     if (db->cipher_ctx) {
         const speedsql_cipher_provider_t* provider = speedsql_get_cipher(db->cipher_id);
         if (provider && provider->destroy) {
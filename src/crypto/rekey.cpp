@@ -0,0 +1,273 @@
+/*
+ * SpeedSQL - Online re-encryption
+ *
+ * A rekey installs the new key at once and reseals existing pages in the
+ * background. A job thread walks the file in batches, taking the
+ * connection lock for one batch at a time and pausing between batches so
+ * foreground work keeps most of the I/O. Until every page is resealed the
+ * buffer pool keeps the old key and opens each page with whichever key
+ * sealed it; pages written in the meantime already use the new one.
+ *
+ * Pages that are dirty when the walk reaches them are resealed by their
+ * own write-back: at the end of a pass, dirty pages outside a transaction
+ * are flushed. Once no page is left under the old key, it is dropped.
+ */
+
+#include "speedsql_internal.h"
+
+/* Header and schema pages are not pool pages */
+#define REKEY_FIRST_PAGE 2
+
+/* Largest batch the pool reseals at once */
+#define REKEY_MAX_BATCH 64
+
+/* Default rate: 1MB (64 16KB pages) per batch, at most ~100 batches/s */
+#define REKEY_DEFAULT_BATCH 64
+#define REKEY_DEFAULT_PAUSE_MS 10
+
+struct rekey_job {
+    speedsql* db;
+    thread_t thread;
+    mutex_t lock;
+    cond_t done;                 /* The job finished or stopped */
+    bool running;
+    bool joinable;               /* Thread exited but is not joined yet */
+    bool stop;
+    int rc;                      /* Result of the last job */
+    page_id_t next_page;         /* Next page of the current pass */
+    page_id_t page_count;        /* Pages in the file when the rekey began */
+    uint32_t batch_pages;
+    uint32_t pause_ms;
+};
+
+/* The connection's rekey state, created on first use */
+static struct rekey_job* rekey_state(speedsql* db) {
+    if (db->rekey) return db->rekey;
+
+    struct rekey_job* r = (struct rekey_job*)sdb_calloc(1, sizeof(struct rekey_job));
+    if (!r) return nullptr;
+
+    r->db = db;
+    r->rc = SPEEDSQL_OK;
+    r->batch_pages = REKEY_DEFAULT_BATCH;
+    r->pause_ms = REKEY_DEFAULT_PAUSE_MS;
+    mutex_init(&r->lock);
+    cond_init(&r->done);
+
+    db->rekey = r;
+    return r;
+}
+
+/* Destroy the previous key once the pool no longer needs it */
+static void rekey_drop_old_key(speedsql* db) {
+    speedsql_cipher_t old_id = SPEEDSQL_CIPHER_NONE;
+    struct speedsql_cipher_ctx* old_ctx = buffer_pool_rekey_end(db->buffer_pool, &old_id);
+    if (!old_ctx) return;
+
+    const speedsql_cipher_provider_t* provider = speedsql_get_cipher(old_id);
+    if (provider && provider->destroy) {
+        provider->destroy(old_ctx);
+    }
+}
+
+static void* rekey_main(void* arg) {
+    struct rekey_job* r = (struct rekey_job*)arg;
+    speedsql* db = r->db;
+    int rc = SPEEDSQL_OK;
+    bool stopped = false;
+
+    for (;;) {
+        mutex_lock(&r->lock);
+        stopped = r->stop;
+        page_id_t first = r->next_page;
+        uint32_t batch = r->batch_pages;
+        uint32_t pause = r->pause_ms;
+        mutex_unlock(&r->lock);
+
+        if (stopped) break;
+
+        if (first >= r->page_count) {
+            /* End of a pass: done once no page is left under the old key */
+            if (buffer_pool_rekey_pending(db->buffer_pool) == 0) break;
+
+            /* Dirty pages outside a transaction are resealed by writing
+             * them out; inside one they wait for its commit */
+            mutex_lock(&db->lock);
+            if (db->txn_state == TXN_NONE) {
+                rc = buffer_pool_flush(db->buffer_pool, &db->db_file);
+            }
+            mutex_unlock(&db->lock);
+            if (rc != SPEEDSQL_OK) break;
+            if (buffer_pool_rekey_pending(db->buffer_pool) == 0) break;
+
+            mutex_lock(&r->lock);
+            r->next_page = REKEY_FIRST_PAGE;
+            mutex_unlock(&r->lock);
+            thread_sleep_ms(pause > 0 ? pause : 1);
+            continue;
+        }
+
+        size_t count = batch;
+        if (first + count > r->page_count) {
+            count = (size_t)(r->page_count - first);
+        }
+
+        /* Writers get the lock back between batches */
+        uint64_t resealed = 0;
+        mutex_lock(&db->lock);
+        rc = buffer_pool_rekey_pages(db->buffer_pool, &db->db_file, first, count, &resealed);
+        mutex_unlock(&db->lock);
+        if (rc != SPEEDSQL_OK) break;
+
+        mutex_lock(&r->lock);
+        r->next_page = first + count;
+        mutex_unlock(&r->lock);
+
+        if (pause > 0) {
+            thread_sleep_ms(pause);
+        }
+    }
+
+    if (rc == SPEEDSQL_OK && !stopped) {
+        rekey_drop_old_key(db);
+    }
+
+    mutex_lock(&r->lock);
+    r->rc = rc;
+    r->running = false;
+    cond_broadcast(&r->done);
+    mutex_unlock(&r->lock);
+    return nullptr;
+}
+
+int rekey_start(speedsql* db, struct speedsql_cipher_ctx* ctx,
+                const speedsql_crypto_config_t* config) {
+    struct rekey_job* r = rekey_state(db);
+    if (!r) return SPEEDSQL_NOMEM;
+
+    mutex_lock(&r->lock);
+    if (r->running) {
+        mutex_unlock(&r->lock);
+        sdb_set_error(db, SPEEDSQL_BUSY, "A rekey is already in progress");
+        return SPEEDSQL_BUSY;
+    }
+    bool joinable = r->joinable;
+    r->joinable = false;
+    mutex_unlock(&r->lock);
+
+    if (joinable) {
+        thread_join(r->thread);
+    }
+
+    /* The header names the new salt and KDF before any page is sealed
+     * with the key they derive; a rekey that cannot begin puts the old
+     * ones back */
+    page_id_t pages = 0;
+    mutex_lock(&db->lock);
+    db_header_t saved = db->header;
+    int rc = crypto_save_key_config(db, config);
+    if (rc == SPEEDSQL_OK) {
+        rc = buffer_pool_rekey_begin(db->buffer_pool, &db->db_file, ctx, config->cipher,
+                                     REKEY_FIRST_PAGE, &pages);
+    }
+    if (rc != SPEEDSQL_OK) {
+        db->header = saved;
+        save_schema(db);
+    }
+    mutex_unlock(&db->lock);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    mutex_lock(&r->lock);
+    r->stop = false;
+    r->rc = SPEEDSQL_OK;
+    r->next_page = REKEY_FIRST_PAGE;
+    r->page_count = pages;
+    r->running = true;
+    rc = thread_create(&r->thread, rekey_main, r);
+    r->joinable = (rc == SPEEDSQL_OK);
+    mutex_unlock(&r->lock);
+
+    /* No thread to spare: reseal in the foreground instead */
+    if (rc != SPEEDSQL_OK) {
+        rekey_main(r);
+    }
+    return SPEEDSQL_OK;
+}
+
+void rekey_shutdown(speedsql* db) {
+    struct rekey_job* r = db->rekey;
+    if (!r) return;
+
+    mutex_lock(&r->lock);
+    r->stop = true;
+    bool joinable = r->joinable;
+    r->joinable = false;
+    mutex_unlock(&r->lock);
+
+    if (joinable) {
+        thread_join(r->thread);
+    }
+
+    /* An unfinished rekey leaves some pages under the old key; opening the
+     * file with it and rekeying again picks up where this one stopped */
+    rekey_drop_old_key(db);
+
+    cond_destroy(&r->done);
+    mutex_destroy(&r->lock);
+    sdb_free(r);
+    db->rekey = nullptr;
+}
+
+SPEEDSQL_API int speedsql_rekey_status(speedsql* db, uint64_t* resealed, uint64_t* total) {
+    if (!db) return SPEEDSQL_MISUSE;
+
+    struct rekey_job* r = db->rekey;
+    if (!r) {
+        if (resealed) *resealed = 0;
+        if (total) *total = 0;
+        return SPEEDSQL_OK;
+    }
+
+    mutex_lock(&r->lock);
+    bool running = r->running;
+    int rc = r->rc;
+    uint64_t pages = r->page_count > REKEY_FIRST_PAGE ? r->page_count - REKEY_FIRST_PAGE : 0;
+    mutex_unlock(&r->lock);
+
+    uint64_t pending = running ? buffer_pool_rekey_pending(db->buffer_pool) : 0;
+    if (pending > pages) pending = pages;
+
+    if (resealed) *resealed = pages - pending;
+    if (total) *total = pages;
+    return running ? SPEEDSQL_BUSY : rc;
+}
+
+SPEEDSQL_API int speedsql_rekey_wait(speedsql* db) {
+    if (!db) return SPEEDSQL_MISUSE;
+
+    struct rekey_job* r = db->rekey;
+    if (!r) return SPEEDSQL_OK;
+
+    mutex_lock(&r->lock);
+    while (r->running) {
+        cond_wait(&r->done, &r->lock);
+    }
+    int rc = r->rc;
+    mutex_unlock(&r->lock);
+    return rc;
+}
+
+SPEEDSQL_API int speedsql_rekey_throttle(speedsql* db, uint32_t batch_pages, uint32_t pause_ms) {
+    if (!db || batch_pages == 0 || batch_pages > REKEY_MAX_BATCH) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    struct rekey_job* r = rekey_state(db);
+    if (!r) return SPEEDSQL_NOMEM;
+
+    mutex_lock(&r->lock);
+    r->batch_pages = batch_pages;
+    r->pause_ms = pause_ms;
+    mutex_unlock(&r->lock);
+    return SPEEDSQL_OK;
+}
@@ -0,0 +1,362 @@
+/*
+ * SpeedSQL - SHA-256, HMAC-SHA256 and PBKDF2
+ *
+ * The compression function uses the SHA extensions where the CPU has them
+ * (SHA-NI on x86, the ARMv8 SHA-256 instructions on AArch64) and falls
+ * back to portable code. PBKDF2 hashes the HMAC pads once per derivation,
+ * so each iteration is exactly two compressions of a fixed-layout block.
+ */
+
+#include "speedsql_internal.h"
+#include <string.h>
+
+#if SPEEDSQL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    #define SHA256_ARM 1
+    #include <arm_neon.h>
+    #ifdef __clang__
+        #define SHA256_ARM_TARGET SPEEDSQL_TARGET("sha2")
+    #else
+        #define SHA256_ARM_TARGET SPEEDSQL_TARGET("+crypto")
+    #endif
+#endif
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline uint32_t load_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static inline uint32_t rotr32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+/* ============================================================================
+ * Compression Functions
+ * ============================================================================ */
+
+typedef void (*sha256_compress_fn)(uint32_t* state, const uint8_t* data, size_t blocks);
+
+static void sha256_compress_portable(uint32_t* state, const uint8_t* data, size_t blocks) {
+    uint32_t w[64];
+
+    while (blocks--) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = load_be32(data + 4 * i);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+            uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += 64;
+    }
+}
+
+#if SPEEDSQL_X86
+
+/* Four rounds per message group: sha256rnds2 does two, on the low half of
+ * the W+K vector and then on its high half. Groups 4..15 of the schedule
+ * are built from the four before them as each group is consumed. */
+SPEEDSQL_TARGET("sha,sse4.1")
+static void sha256_compress_shani(uint32_t* state, const uint8_t* data, size_t blocks) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    /* Register layout the instructions expect: ABEF and CDGH */
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    __m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    __m128i s0 = _mm_alignr_epi8(tmp, s1, 8);
+    s1 = _mm_blend_epi16(s1, tmp, 0xF0);
+
+    while (blocks--) {
+        __m128i abef = s0;
+        __m128i cdgh = s1;
+        __m128i msg[4];
+
+        for (int i = 0; i < 4; i++) {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)), bswap);
+        }
+
+        for (int i = 0; i < 16; i++) {
+            __m128i wk = _mm_add_epi32(msg[i & 3], _mm_loadu_si128((const __m128i*)&sha256_k[4 * i]));
+            if (i < 12) {
+                __m128i next = _mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4));
+                msg[i & 3] = _mm_sha256msg2_epu32(next, msg[(i + 3) & 3]);
+            }
+            s1 = _mm_sha256rnds2_epu32(s1, s0, wk);
+            s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(wk, 0x0E));
+        }
+
+        s0 = _mm_add_epi32(s0, abef);
+        s1 = _mm_add_epi32(s1, cdgh);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(s0, 0x1B);
+    s1 = _mm_shuffle_epi32(s1, 0xB1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, s1, 0xF0));
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(s1, tmp, 8));
+}
+
+#endif
+
+#ifdef SHA256_ARM
+
+SHA256_ARM_TARGET
+static void sha256_compress_armv8(uint32_t* state, const uint8_t* data, size_t blocks) {
+    uint32x4_t s0 = vld1q_u32(&state[0]);
+    uint32x4_t s1 = vld1q_u32(&state[4]);
+
+    while (blocks--) {
+        uint32x4_t abcd = s0;
+        uint32x4_t efgh = s1;
+        uint32x4_t msg[4];
+
+        for (int i = 0; i < 4; i++) {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+        }
+
+        for (int i = 0; i < 16; i++) {
+            uint32x4_t wk = vaddq_u32(msg[i & 3], vld1q_u32(&sha256_k[4 * i]));
+            if (i < 12) {
+                msg[i & 3] = vsha256su1q_u32(vsha256su0q_u32(msg[i & 3], msg[(i + 1) & 3]),
+                                             msg[(i + 2) & 3], msg[(i + 3) & 3]);
+            }
+            uint32x4_t prev = s0;
+            s0 = vsha256hq_u32(s0, s1, wk);
+            s1 = vsha256h2q_u32(s1, prev, wk);
+        }
+
+        s0 = vaddq_u32(s0, abcd);
+        s1 = vaddq_u32(s1, efgh);
+        data += 64;
+    }
+
+    vst1q_u32(&state[0], s0);
+    vst1q_u32(&state[4], s1);
+}
+
+#endif
+
+static sha256_compress_fn sha256_compressor(void) {
+    uint32_t features = cpu_features();
+#if SPEEDSQL_X86
+    const uint32_t shani = CPU_FEATURE_SHA | CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE41;
+    if ((features & shani) == shani) return sha256_compress_shani;
+#endif
+#ifdef SHA256_ARM
+    if (features & CPU_FEATURE_SHA) return sha256_compress_armv8;
+#endif
+    (void)features;
+    return sha256_compress_portable;
+}
+
+/* ============================================================================
+ * SHA-256
+ * ============================================================================ */
+
+void sha256_init(sha256_ctx_t* ctx) {
+    memcpy(ctx->state, sha256_iv, sizeof(sha256_iv));
+    ctx->bytes = 0;
+    ctx->buf_len = 0;
+}
+
+void sha256_update(sha256_ctx_t* ctx, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    sha256_compress_fn compress = sha256_compressor();
+    ctx->bytes += len;
+
+    if (ctx->buf_len > 0) {
+        size_t take = 64 - ctx->buf_len;
+        if (take > len) take = len;
+        memcpy(ctx->buf + ctx->buf_len, p, take);
+        ctx->buf_len += take;
+        p += take;
+        len -= take;
+        if (ctx->buf_len < 64) return;
+        compress(ctx->state, ctx->buf, 1);
+        ctx->buf_len = 0;
+    }
+
+    if (len >= 64) {
+        compress(ctx->state, p, len / 64);
+        p += len & ~(size_t)63;
+        len &= 63;
+    }
+
+    memcpy(ctx->buf, p, len);
+    ctx->buf_len = len;
+}
+
+void sha256_final(sha256_ctx_t* ctx, uint8_t* digest) {
+    uint64_t bits = ctx->bytes * 8;
+    uint8_t pad[72] = {0x80};
+    size_t pad_len = (ctx->buf_len < 56) ? 56 - ctx->buf_len : 120 - ctx->buf_len;
+
+    for (int i = 0; i < 8; i++) {
+        pad[pad_len + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    sha256_update(ctx, pad, pad_len + 8);
+
+    for (int i = 0; i < 8; i++) {
+        store_be32(digest + 4 * i, ctx->state[i]);
+    }
+    speedsql_secure_zero(ctx, sizeof(*ctx));
+}
+
+void sha256(const void* data, size_t len, uint8_t* digest) {
+    sha256_ctx_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+}
+
+/* ============================================================================
+ * HMAC-SHA256
+ * ============================================================================ */
+
+/* Inner and outer states after the key pads */
+static void hmac_sha256_pads(const uint8_t* key, size_t key_len,
+                             sha256_ctx_t* inner, sha256_ctx_t* outer) {
+    uint8_t block[64] = {0};
+    if (key_len > 64) {
+        sha256(key, key_len, block);
+    } else {
+        memcpy(block, key, key_len);
+    }
+
+    for (int i = 0; i < 64; i++) block[i] ^= 0x36;
+    sha256_init(inner);
+    sha256_update(inner, block, 64);
+
+    for (int i = 0; i < 64; i++) block[i] ^= 0x36 ^ 0x5c;
+    sha256_init(outer);
+    sha256_update(outer, block, 64);
+
+    speedsql_secure_zero(block, sizeof(block));
+}
+
+void hmac_sha256(const uint8_t* key, size_t key_len, const void* data, size_t len,
+                 uint8_t* mac) {
+    sha256_ctx_t inner, outer;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    hmac_sha256_pads(key, key_len, &inner, &outer);
+    sha256_update(&inner, data, len);
+    sha256_final(&inner, digest);
+    sha256_update(&outer, digest, sizeof(digest));
+    sha256_final(&outer, mac);
+    speedsql_secure_zero(digest, sizeof(digest));
+}
+
+/* ============================================================================
+ * PBKDF2-HMAC-SHA256 (RFC 8018)
+ * ============================================================================ */
+
+/* Block holding a 32-byte message that follows one 64-byte pad block */
+static void pbkdf2_block_init(uint8_t* block) {
+    memset(block, 0, 64);
+    block[32] = 0x80;
+    block[62] = 0x03;  /* (64 + 32) * 8 = 768 bits */
+}
+
+static void pbkdf2_digest_out(const uint32_t* state, uint8_t* block) {
+    for (int i = 0; i < 8; i++) {
+        store_be32(block + 4 * i, state[i]);
+    }
+}
+
+void pbkdf2_hmac_sha256(const uint8_t* password, size_t password_len,
+                        const uint8_t* salt, size_t salt_len, uint32_t iterations,
+                        uint8_t* out, size_t out_len) {
+    sha256_compress_fn compress = sha256_compressor();
+    sha256_ctx_t inner, outer;
+    hmac_sha256_pads(password, password_len, &inner, &outer);
+
+    uint8_t block[64];
+    uint32_t state[8];
+    uint8_t acc[SHA256_DIGEST_SIZE];
+    pbkdf2_block_init(block);
+
+    for (uint32_t index = 1; out_len > 0; index++) {
+        /* U1 = HMAC(P, S || INT(i)) */
+        uint8_t be_index[4];
+        store_be32(be_index, index);
+        sha256_ctx_t first = inner;
+        sha256_update(&first, salt, salt_len);
+        sha256_update(&first, be_index, 4);
+        sha256_final(&first, block);
+
+        memcpy(state, outer.state, sizeof(state));
+        compress(state, block, 1);
+        pbkdf2_digest_out(state, block);
+        memcpy(acc, block, sizeof(acc));
+
+        /* Ui = HMAC(P, Ui-1): one inner and one outer compression */
+        for (uint32_t i = 1; i < iterations; i++) {
+            memcpy(state, inner.state, sizeof(state));
+            compress(state, block, 1);
+            pbkdf2_digest_out(state, block);
+
+            memcpy(state, outer.state, sizeof(state));
+            compress(state, block, 1);
+            pbkdf2_digest_out(state, block);
+
+            for (int j = 0; j < SHA256_DIGEST_SIZE; j++) acc[j] ^= block[j];
+        }
+
+        size_t take = out_len < sizeof(acc) ? out_len : sizeof(acc);
+        memcpy(out, acc, take);
+        out += take;
+        out_len -= take;
+    }
+
+    speedsql_secure_zero(&inner, sizeof(inner));
+    speedsql_secure_zero(&outer, sizeof(outer));
+    speedsql_secure_zero(block, sizeof(block));
+    speedsql_secure_zero(state, sizeof(state));
+    speedsql_secure_zero(acc, sizeof(acc));
+}
@@ -0,0 +1,254 @@
+/*
+ * SpeedSQL - SHA-512, HMAC-SHA512 and PBKDF2
+ *
+ * Portable code only: few CPUs have SHA-512 instructions, and the 64-bit
+ * rounds are already fast on the machines that run the KDF. PBKDF2 hashes
+ * the HMAC pads once per derivation, as in sha256.cpp, so each iteration
+ * is exactly two compressions of a fixed-layout block.
+ */
+
+#include "speedsql_internal.h"
+#include <string.h>
+
+static const uint64_t sha512_k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static const uint64_t sha512_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static inline uint64_t load_be64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline void store_be64(uint8_t* p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+static inline uint64_t rotr64(uint64_t x, int n) {
+    return (x >> n) | (x << (64 - n));
+}
+
+static void sha512_compress(uint64_t* state, const uint8_t* data, size_t blocks) {
+    uint64_t w[80];
+
+    while (blocks--) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = load_be64(data + 8 * i);
+        }
+        for (int i = 16; i < 80; i++) {
+            uint64_t s0 = rotr64(w[i - 15], 1) ^ rotr64(w[i - 15], 8) ^ (w[i - 15] >> 7);
+            uint64_t s1 = rotr64(w[i - 2], 19) ^ rotr64(w[i - 2], 61) ^ (w[i - 2] >> 6);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 80; i++) {
+            uint64_t s1 = rotr64(e, 14) ^ rotr64(e, 18) ^ rotr64(e, 41);
+            uint64_t ch = (e & f) ^ (~e & g);
+            uint64_t t1 = h + s1 + ch + sha512_k[i] + w[i];
+            uint64_t s0 = rotr64(a, 28) ^ rotr64(a, 34) ^ rotr64(a, 39);
+            uint64_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint64_t t2 = s0 + maj;
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += 128;
+    }
+}
+
+/* ============================================================================
+ * SHA-512
+ * ============================================================================ */
+
+void sha512_init(sha512_ctx_t* ctx) {
+    memcpy(ctx->state, sha512_iv, sizeof(sha512_iv));
+    ctx->bytes = 0;
+    ctx->buf_len = 0;
+}
+
+void sha512_update(sha512_ctx_t* ctx, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    ctx->bytes += len;
+
+    if (ctx->buf_len > 0) {
+        size_t take = 128 - ctx->buf_len;
+        if (take > len) take = len;
+        memcpy(ctx->buf + ctx->buf_len, p, take);
+        ctx->buf_len += take;
+        p += take;
+        len -= take;
+        if (ctx->buf_len < 128) return;
+        sha512_compress(ctx->state, ctx->buf, 1);
+        ctx->buf_len = 0;
+    }
+
+    if (len >= 128) {
+        sha512_compress(ctx->state, p, len / 128);
+        p += len & ~(size_t)127;
+        len &= 127;
+    }
+
+    memcpy(ctx->buf, p, len);
+    ctx->buf_len = len;
+}
+
+void sha512_final(sha512_ctx_t* ctx, uint8_t* digest) {
+    uint64_t bits = ctx->bytes * 8;
+    uint8_t pad[144] = {0x80};
+    size_t pad_len = (ctx->buf_len < 112) ? 112 - ctx->buf_len : 240 - ctx->buf_len;
+
+    /* 128-bit length; the high half is always zero here */
+    store_be64(pad + pad_len + 8, bits);
+    sha512_update(ctx, pad, pad_len + 16);
+
+    for (int i = 0; i < 8; i++) {
+        store_be64(digest + 8 * i, ctx->state[i]);
+    }
+    speedsql_secure_zero(ctx, sizeof(*ctx));
+}
+
+void sha512(const void* data, size_t len, uint8_t* digest) {
+    sha512_ctx_t ctx;
+    sha512_init(&ctx);
+    sha512_update(&ctx, data, len);
+    sha512_final(&ctx, digest);
+}
+
+/* ============================================================================
+ * HMAC-SHA512
+ * ============================================================================ */
+
+/* Inner and outer states after the key pads */
+static void hmac_sha512_pads(const uint8_t* key, size_t key_len,
+                             sha512_ctx_t* inner, sha512_ctx_t* outer) {
+    uint8_t block[128] = {0};
+    if (key_len > 128) {
+        sha512(key, key_len, block);
+    } else {
+        memcpy(block, key, key_len);
+    }
+
+    for (int i = 0; i < 128; i++) block[i] ^= 0x36;
+    sha512_init(inner);
+    sha512_update(inner, block, 128);
+
+    for (int i = 0; i < 128; i++) block[i] ^= 0x36 ^ 0x5c;
+    sha512_init(outer);
+    sha512_update(outer, block, 128);
+
+    speedsql_secure_zero(block, sizeof(block));
+}
+
+void hmac_sha512(const uint8_t* key, size_t key_len, const void* data, size_t len,
+                 uint8_t* mac) {
+    sha512_ctx_t inner, outer;
+    uint8_t digest[SHA512_DIGEST_SIZE];
+
+    hmac_sha512_pads(key, key_len, &inner, &outer);
+    sha512_update(&inner, data, len);
+    sha512_final(&inner, digest);
+    sha512_update(&outer, digest, sizeof(digest));
+    sha512_final(&outer, mac);
+    speedsql_secure_zero(digest, sizeof(digest));
+}
+
+/* ============================================================================
+ * PBKDF2-HMAC-SHA512 (RFC 8018)
+ * ============================================================================ */
+
+/* Block holding a 64-byte message that follows one 128-byte pad block */
+static void pbkdf2_block_init(uint8_t* block) {
+    memset(block, 0, 128);
+    block[64] = 0x80;
+    block[126] = 0x06;  /* (128 + 64) * 8 = 1536 bits */
+}
+
+static void pbkdf2_digest_out(const uint64_t* state, uint8_t* block) {
+    for (int i = 0; i < 8; i++) {
+        store_be64(block + 8 * i, state[i]);
+    }
+}
+
+void pbkdf2_hmac_sha512(const uint8_t* password, size_t password_len,
+                        const uint8_t* salt, size_t salt_len, uint32_t iterations,
+                        uint8_t* out, size_t out_len) {
+    sha512_ctx_t inner, outer;
+    hmac_sha512_pads(password, password_len, &inner, &outer);
+
+    uint8_t block[128];
+    uint64_t state[8];
+    uint8_t acc[SHA512_DIGEST_SIZE];
+    pbkdf2_block_init(block);
+
+    for (uint32_t index = 1; out_len > 0; index++) {
+        /* U1 = HMAC(P, S || INT(i)) */
+        uint8_t be_index[4] = {
+            (uint8_t)(index >> 24), (uint8_t)(index >> 16), (uint8_t)(index >> 8), (uint8_t)index
+        };
+        sha512_ctx_t first = inner;
+        sha512_update(&first, salt, salt_len);
+        sha512_update(&first, be_index, 4);
+        sha512_final(&first, block);
+
+        memcpy(state, outer.state, sizeof(state));
+        sha512_compress(state, block, 1);
+        pbkdf2_digest_out(state, block);
+        memcpy(acc, block, sizeof(acc));
+
+        /* Ui = HMAC(P, Ui-1): one inner and one outer compression */
+        for (uint32_t i = 1; i < iterations; i++) {
+            memcpy(state, inner.state, sizeof(state));
+            sha512_compress(state, block, 1);
+            pbkdf2_digest_out(state, block);
+
+            memcpy(state, outer.state, sizeof(state));
+            sha512_compress(state, block, 1);
+            pbkdf2_digest_out(state, block);
+
+            for (int j = 0; j < SHA512_DIGEST_SIZE; j++) acc[j] ^= block[j];
+        }
+
+        size_t take = out_len < sizeof(acc) ? out_len : sizeof(acc);
+        memcpy(out, acc, take);
+        out += take;
+        out_len -= take;
+    }
+
+    speedsql_secure_zero(&inner, sizeof(inner));
+    speedsql_secure_zero(&outer, sizeof(outer));
+    speedsql_secure_zero(block, sizeof(block));
+    speedsql_secure_zero(state, sizeof(state));
+    speedsql_secure_zero(acc, sizeof(acc));
+}
@@ -50,16 +50,17 @@ static int insert_into_internal(btree_t* tree, buffer_page_t* node,
 static int create_new_root(btree_t* tree, page_id_t left, page_id_t right,
                             const value_t* separator);
 
-/* Get max keys per internal node */
-static inline uint32_t btree_internal_max_keys(uint32_t page_size, uint32_t key_size) {
-    /* Space = page_size - header - one extra child pointer */
-    uint32_t space = page_size - BTREE_INTERNAL_HEADER_SIZE - sizeof(page_id_t);
+/* Get max keys per internal node. Capacity comes from the pool's usable
+ * size, which excludes any tail reserved for the page nonce and tag. */
+static inline uint32_t btree_internal_max_keys(uint32_t usable_size, uint32_t key_size) {
+    /* Space = usable_size - header - one extra child pointer */
+    uint32_t space = usable_size - BTREE_INTERNAL_HEADER_SIZE - sizeof(page_id_t);
     return space / (key_size + sizeof(page_id_t));
 }
 
 /* Get max keys per leaf node */
-static inline uint32_t btree_leaf_max_keys(uint32_t page_size, uint32_t key_size, uint32_t value_size) {
-    uint32_t space = page_size - BTREE_LEAF_HEADER_SIZE;
+static inline uint32_t btree_leaf_max_keys(uint32_t usable_size, uint32_t key_size, uint32_t value_size) {
+    uint32_t space = usable_size - BTREE_LEAF_HEADER_SIZE;
     uint32_t cell_size = key_size + value_size + 2;  /* +2 for offset */
     return space / cell_size;
 }
@@ -211,7 +212,7 @@ int btree_create(btree_t* tree, buffer_pool_t* pool, file_t* file, compare_func_
     hdr->flags = 0;
     hdr->cell_count = 0;
     hdr->free_start = BTREE_LEAF_HEADER_SIZE;
-    hdr->free_end = pool->page_size;
+    hdr->free_end = pool->usable_size;
     hdr->right_ptr = INVALID_PAGE_ID;
 
     set_key_count(root->data, 0);
@@ -246,6 +247,53 @@ void btree_close(btree_t* tree) {
     rwlock_destroy(&tree->lock);
 }
 
+void btree_int_key(value_t* key, int64_t v) {
+    uint64_t u = (uint64_t)v ^ 0x8000000000000000ULL;
+    uint8_t bytes[8];
+    for (int i = 7; i >= 0; i--) {
+        bytes[i] = (uint8_t)u;
+        u >>= 8;
+    }
+    value_init_blob(key, bytes, sizeof(bytes));
+}
+
+int64_t btree_key_int(const value_t* key) {
+    if (!key || key->type != SPEEDSQL_TYPE_BLOB || key->data.blob.len != 8 || !key->data.blob.data) {
+        return 0;
+    }
+    uint64_t u = 0;
+    for (int i = 0; i < 8; i++) {
+        u = (u << 8) | key->data.blob.data[i];
+    }
+    return (int64_t)(u ^ 0x8000000000000000ULL);
+}
+
+/* Size of the keys in internal nodes. It is not stored in the pages: a
+ * new tree learns it at its first split, and a reopened one from the
+ * first key of its leftmost leaf (child 0 sits at the same offset for any
+ * key size). Concurrent readers may learn it together, hence the atomics. */
+static uint32_t internal_key_size(btree_t* tree) {
+    uint32_t size = __atomic_load_n(&tree->key_size, __ATOMIC_RELAXED);
+    if (size != 0) return size;
+
+    page_id_t page_id = tree->root_page;
+    while (page_id != INVALID_PAGE_ID) {
+        buffer_page_t* page = buffer_pool_get(tree->pool, tree->file, page_id);
+        if (!page) return 0;
+
+        page_id = INVALID_PAGE_ID;
+        if (((page_header_t*)page->data)->page_type == PAGE_TYPE_BTREE_INTERNAL) {
+            page_id = get_child(page->data, 0, 0);
+        } else if (get_key_count(page->data) > 0) {
+            size = *(uint16_t*)get_cell_data(page->data, get_cell_offsets(page->data)[0]);
+        }
+        buffer_pool_unpin(tree->pool, page, false);
+    }
+
+    if (size != 0) __atomic_store_n(&tree->key_size, size, __ATOMIC_RELAXED);
+    return size;
+}
+
 /* Find leaf page containing key */
 static buffer_page_t* find_leaf(btree_t* tree, const value_t* key) {
     page_id_t page_id = tree->root_page;
@@ -261,14 +309,41 @@ static buffer_page_t* find_leaf(btree_t* tree, const value_t* key) {
         }
 
         /* Internal node - descend */
-        uint16_t idx = search_internal(page->data, key, tree->compare, tree->key_size);
-        page_id_t child = get_child(page->data, idx, tree->key_size);
+        uint32_t key_size = internal_key_size(tree);
+        uint16_t idx = search_internal(page->data, key, tree->compare, key_size);
+        page_id_t child = get_child(page->data, idx, key_size);
 
         buffer_pool_unpin(tree->pool, page, false);
         page_id = child;
     }
 }
 
+/* Leaf and slot of a key. Descent takes a key equal to a separator into
+ * the left subtree, while the separator is the first key of the leaf to
+ * its right, so a key past the end of a leaf is looked for there too. */
+static buffer_page_t* find_key(btree_t* tree, const value_t* key, uint16_t* idx, bool* exact) {
+    buffer_page_t* leaf = find_leaf(tree, key);
+    if (!leaf) return nullptr;
+
+    *idx = search_leaf(leaf->data, key, tree->compare, exact);
+    page_id_t next = get_next_leaf(leaf->data);
+    if (*exact || *idx < get_key_count(leaf->data) || next == INVALID_PAGE_ID) return leaf;
+
+    buffer_page_t* next_leaf = buffer_pool_get(tree->pool, tree->file, next);
+    if (!next_leaf) return leaf;
+
+    bool next_exact;
+    uint16_t next_idx = search_leaf(next_leaf->data, key, tree->compare, &next_exact);
+    if (!next_exact) {
+        buffer_pool_unpin(tree->pool, next_leaf, false);
+        return leaf;
+    }
+    buffer_pool_unpin(tree->pool, leaf, false);
+    *idx = next_idx;
+    *exact = true;
+    return next_leaf;
+}
+
 /* Find leaf page and track the path from root */
 static buffer_page_t* find_leaf_with_path(btree_t* tree, const value_t* key,
                                            btree_path_entry_t* path, int* path_len) {
@@ -287,12 +362,13 @@ static buffer_page_t* find_leaf_with_path(btree_t* tree, const value_t* key,
 
         /* Record this internal node in path */
         if (*path_len < BTREE_MAX_DEPTH) {
-            uint16_t idx = search_internal(page->data, key, tree->compare, tree->key_size);
+            uint32_t key_size = internal_key_size(tree);
+            uint16_t idx = search_internal(page->data, key, tree->compare, key_size);
             path[*path_len].page_id = page_id;
             path[*path_len].slot_index = idx;
             (*path_len)++;
 
-            page_id_t child = get_child(page->data, idx, tree->key_size);
+            page_id_t child = get_child(page->data, idx, key_size);
             buffer_pool_unpin(tree->pool, page, false);
             page_id = child;
         } else {
@@ -319,7 +395,7 @@ static int split_internal(btree_t* tree, buffer_page_t* node,
     new_hdr->flags = 0;
     new_hdr->cell_count = 0;
     new_hdr->free_start = BTREE_INTERNAL_HEADER_SIZE;
-    new_hdr->free_end = tree->pool->page_size;
+    new_hdr->free_end = tree->pool->usable_size;
 
     /* Find split point and where new key goes */
     uint16_t insert_idx = search_internal(node->data, key, tree->compare, tree->key_size);
@@ -428,15 +504,14 @@ int btree_find(btree_t* tree, const value_t* key, value_t* value) {
 
     rwlock_rdlock(&tree->lock);
 
-    buffer_page_t* leaf = find_leaf(tree, key);
+    bool exact;
+    uint16_t idx;
+    buffer_page_t* leaf = find_key(tree, key, &idx, &exact);
     if (!leaf) {
         rwlock_unlock(&tree->lock);
         return SPEEDSQL_IOERR;
     }
 
-    bool exact;
-    uint16_t idx = search_leaf(leaf->data, key, tree->compare, &exact);
-
     if (!exact) {
         buffer_pool_unpin(tree->pool, leaf, false);
         rwlock_unlock(&tree->lock);
@@ -465,6 +540,32 @@ int btree_find(btree_t* tree, const value_t* key, value_t* value) {
     return SPEEDSQL_OK;
 }
 
+/* Rewrite live cells contiguously at the end of a leaf page, reclaiming
+ * space left behind by deletes and splits */
+static void compact_leaf(btree_t* tree, buffer_page_t* leaf) {
+    page_header_t* hdr = (page_header_t*)leaf->data;
+    uint16_t count = get_key_count(leaf->data);
+    uint16_t* offsets = get_cell_offsets(leaf->data);
+    uint32_t usable_size = (uint32_t)tree->pool->usable_size;
+
+    uint8_t* scratch = (uint8_t*)sdb_malloc(usable_size);
+    if (!scratch) return;
+
+    uint32_t end = usable_size;
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t* cell = get_cell_data(leaf->data, offsets[i]);
+        uint16_t cell_size = 4 + *(uint16_t*)cell + *(uint16_t*)(cell + 2);
+        end -= cell_size;
+        memcpy(scratch + end, cell, cell_size);
+        offsets[i] = (uint16_t)end;
+    }
+
+    memcpy(leaf->data + end, scratch + end, usable_size - end);
+    hdr->free_end = end;
+
+    sdb_free(scratch);
+}
+
 /* Insert a cell into a leaf page */
 static int insert_into_leaf(btree_t* tree, buffer_page_t* leaf,
                              const value_t* key, const value_t* value) {
@@ -481,7 +582,12 @@ static int insert_into_leaf(btree_t* tree, buffer_page_t* leaf,
     uint32_t free_space = hdr->free_end - hdr->free_start - count * sizeof(uint16_t);
 
     if (free_space < cell_size + sizeof(uint16_t)) {
-        return SPEEDSQL_FULL;  /* Need to split */
+        /* Dead cells may be holding the space we need */
+        compact_leaf(tree, leaf);
+        free_space = hdr->free_end - hdr->free_start - count * sizeof(uint16_t);
+        if (free_space < cell_size + sizeof(uint16_t)) {
+            return SPEEDSQL_FULL;  /* Need to split */
+        }
     }
 
     /* Find insertion point */
@@ -532,7 +638,7 @@ static int split_leaf(btree_t* tree, buffer_page_t* leaf,
     new_hdr->flags = 0;
     new_hdr->cell_count = 0;
     new_hdr->free_start = BTREE_LEAF_HEADER_SIZE;
-    new_hdr->free_end = tree->pool->page_size;
+    new_hdr->free_end = tree->pool->usable_size;
     new_hdr->right_ptr = INVALID_PAGE_ID;
 
     set_key_count(new_leaf->data, 0);
@@ -590,6 +696,7 @@ static int split_leaf(btree_t* tree, buffer_page_t* leaf,
     set_key_count(leaf->data, split_point);
     page_header_t* old_hdr = (page_header_t*)leaf->data;
     old_hdr->cell_count = split_point;
+    compact_leaf(tree, leaf);
 
     /* Now insert the new key into the appropriate page */
     int rc;
@@ -632,7 +739,7 @@ static int insert_into_internal(btree_t* tree, buffer_page_t* node,
     uint32_t entry_size = sizeof(page_id_t) + key->data.blob.len;
     uint32_t used = BTREE_INTERNAL_HEADER_SIZE + (count + 1) * entry_size + sizeof(page_id_t);
 
-    if (used > tree->pool->page_size) {
+    if (used > tree->pool->usable_size) {
         return SPEEDSQL_FULL;  /* Need to split internal node */
     }
 
@@ -675,7 +782,7 @@ static int create_new_root(btree_t* tree, page_id_t left, page_id_t right,
     hdr->flags = 0;
     hdr->cell_count = 1;
     hdr->free_start = BTREE_INTERNAL_HEADER_SIZE;
-    hdr->free_end = tree->pool->page_size;
+    hdr->free_end = tree->pool->usable_size;
 
     set_key_count(new_root->data, 1);
 
@@ -745,15 +852,14 @@ int btree_delete(btree_t* tree, const value_t* key) {
 
     rwlock_wrlock(&tree->lock);
 
-    buffer_page_t* leaf = find_leaf(tree, key);
+    bool exact;
+    uint16_t idx;
+    buffer_page_t* leaf = find_key(tree, key, &idx, &exact);
     if (!leaf) {
         rwlock_unlock(&tree->lock);
         return SPEEDSQL_IOERR;
     }
 
-    bool exact;
-    uint16_t idx = search_leaf(leaf->data, key, tree->compare, &exact);
-
     if (!exact) {
         buffer_pool_unpin(tree->pool, leaf, false);
         rwlock_unlock(&tree->lock);
@@ -812,7 +918,39 @@ int btree_cursor_first(btree_cursor_t* cursor) {
         }
 
         /* Get first child */
-        page_id_t child = get_child(page->data, 0, tree->key_size);
+        page_id_t child = get_child(page->data, 0, 0);
+        buffer_pool_unpin(tree->pool, page, false);
+        page_id = child;
+    }
+}
+
+int btree_cursor_last(btree_cursor_t* cursor) {
+    if (!cursor || !cursor->tree) return SPEEDSQL_MISUSE;
+
+    btree_t* tree = cursor->tree;
+    uint32_t key_size = internal_key_size(tree);
+
+    /* Find rightmost leaf */
+    page_id_t page_id = tree->root_page;
+
+    while (true) {
+        buffer_page_t* page = buffer_pool_get(tree->pool, tree->file, page_id);
+        if (!page) return SPEEDSQL_IOERR;
+
+        page_header_t* hdr = (page_header_t*)page->data;
+        uint16_t count = get_key_count(page->data);
+
+        if (hdr->page_type == PAGE_TYPE_BTREE_LEAF) {
+            cursor->current_page = page_id;
+            cursor->current_slot = count > 0 ? count - 1 : 0;
+            cursor->valid = count > 0;
+            cursor->at_end = !cursor->valid;
+            buffer_pool_unpin(tree->pool, page, false);
+            return SPEEDSQL_OK;
+        }
+
+        /* Get last child */
+        page_id_t child = get_child(page->data, count, key_size);
         buffer_pool_unpin(tree->pool, page, false);
         page_id = child;
     }
@@ -838,8 +976,20 @@ int btree_cursor_seek(btree_cursor_t* cursor, const value_t* key) {
     cursor->valid = (idx < count);
     cursor->at_end = !cursor->valid;
 
+    /* A key above all of this leaf's lands on the first of the next */
+    page_id_t next = get_next_leaf(leaf->data);
     buffer_pool_unpin(tree->pool, leaf, false);
 
+    if (!cursor->valid && next != INVALID_PAGE_ID) {
+        buffer_page_t* page = buffer_pool_get(tree->pool, tree->file, next);
+        if (!page) return SPEEDSQL_IOERR;
+        cursor->current_page = next;
+        cursor->current_slot = 0;
+        cursor->valid = get_key_count(page->data) > 0;
+        cursor->at_end = !cursor->valid;
+        buffer_pool_unpin(tree->pool, page, false);
+    }
+
     return exact ? SPEEDSQL_OK : SPEEDSQL_NOTFOUND;
 }
 
@@ -0,0 +1,2887 @@
+/*
+ * SpeedSQL - Full-Text Index
+ *
+ * Inverted index over TEXT columns. Rows are split into terms by a
+ * pluggable tokenizer; each term maps to a posting list of the rows it
+ * occurs in with its positions in each, so phrases can be matched.
+ *
+ * Indexing is incremental and log-structured:
+ *
+ *   meta page      tokenizer, segment list, pending log, free pages
+ *   pending log    rows indexed since the last flush, as appended records
+ *   segments       immutable: sorted term dictionary and posting lists
+ *   B+tree         rowid -> sequence number of its live version
+ *
+ * Every insert takes a new sequence number. Once the log outgrows
+ * FTS_FLUSH_BYTES it is sorted into a new segment, and whenever the
+ * newest FTS_MERGE_FACTOR segments are of one level a background thread
+ * merges them into one of the next level while inserts and searches go
+ * on. Segments cover disjoint, ordered ranges of sequence numbers; a
+ * posting is live only while its row's live version falls in its
+ * segment's range, so deletes and updates never touch a segment, and
+ * merges drop the postings that died. Pages of merged segments and of
+ * flushed logs are recycled through the index's own free list.
+ *
+ * A segment is one byte stream over a chain of pages:
+ *
+ * +---------------------------+
+ * | posting lists             | per term, in term order
+ * | dictionary                | term, document count, list location
+ * | term index                | dictionary offset of every 32nd term
+ * | footer                    | fixed size, at the end of the stream
+ * +---------------------------+
+ *
+ * A posting list holds its documents in blocks of FTS_BLOCK, as varint
+ * rowid deltas, each followed by the term's frequency, the document's
+ * length in tokens and varint position deltas. A skip table in front
+ * records the last rowid and the length of each block, so an AND or
+ * phrase query leapfrogs between lists and decodes only the blocks that
+ * can hold a match, and the block's highest frequency and shortest
+ * document, which bound the BM25 score of anything in it.
+ *
+ * Ranked searches score matches with BM25 and keep the best k. Once k
+ * are held, a block whose bound cannot beat the worst of them is
+ * skipped unread, and an OR of terms moves between lists WAND-style,
+ * only stopping where the terms seen so far could still make the cut.
+ */
+
+#include "speedsql_internal.h"
+#include <math.h>
+
+#define FTS_MAGIC         0x49535446u   /* "FTSI" */
+#define FTS_SEGMENT_MAGIC 0x47455346u   /* "FSEG" */
+
+#define FTS_BLOCK          128          /* Documents per skip block */
+#define FTS_TERM_INTERVAL  32           /* Dictionary terms per term-index entry */
+#define FTS_MAX_TERM       128          /* Longer tokens are cut */
+#define FTS_FLUSH_BYTES    (64 * 1024)  /* Pending log size that becomes a segment */
+#define FTS_MERGE_FACTOR   8            /* Segments of one level merged together */
+#define FTS_MAX_SEGMENTS   48
+#define FTS_TOKENIZER_NAME 32
+
+/* The rowid B+tree packs a row's sequence number over its length */
+#define FTS_LEN_BITS    24
+#define FTS_MAX_DOC_LEN ((1u << FTS_LEN_BITS) - 1)
+#define FTS_MAX_SEQ     (1ull << (63 - FTS_LEN_BITS))
+
+/* Page header flags */
+#define FTS_PAGE_META    1
+#define FTS_PAGE_LOG     2
+#define FTS_PAGE_SEGMENT 3
+#define FTS_PAGE_FREE    4
+
+/* Where data starts after the common page header */
+#define FTS_PAGE_DATA ((uint32_t)((sizeof(page_header_t) + 7) & ~(size_t)7))
+
+/* Past the last document of a list */
+#define FTS_END UINT64_MAX
+
+/* Rowids as unsigned document keys in the same order, so list deltas
+ * are never negative */
+static inline uint64_t doc_key(int64_t rowid) {
+    return (uint64_t)rowid ^ (1ull << 63);
+}
+
+static inline int64_t doc_rowid(uint64_t doc) {
+    return (int64_t)(doc ^ (1ull << 63));
+}
+
+typedef struct {
+    page_id_t first;             /* First page of the stream */
+    uint64_t bytes;              /* Stream length */
+    uint64_t min_seq;            /* Sequence numbers it covers */
+    uint64_t max_seq;
+    uint32_t level;              /* Merges it has been through */
+    uint32_t reserved;
+} fts_segment_ref_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t segment_count;
+    char tokenizer[FTS_TOKENIZER_NAME];
+    uint64_t next_seq;
+    page_id_t rowid_root;        /* B+tree rowid -> live sequence number */
+    page_id_t log_head;          /* Pending log chain */
+    page_id_t log_tail;
+    uint64_t log_bytes;
+    uint64_t log_min_seq;        /* Oldest sequence number in the log */
+    page_id_t free_head;         /* Recycled pages */
+    fts_segment_ref_t segments[FTS_MAX_SEGMENTS];  /* Oldest first */
+} fts_meta_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t interval;           /* Terms per term-index entry */
+    uint64_t term_count;
+    uint64_t dict_offset;
+    uint64_t index_offset;
+} fts_footer_t;
+
+/* Growable byte buffer; failed once an allocation fails */
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} fts_buf_t;
+
+/* An open segment: its pages in stream order, or a stream in memory */
+typedef struct {
+    fts_segment_ref_t ref;
+    page_id_t* pages;
+    const uint8_t* mem;
+    fts_footer_t foot;
+} fts_seg_t;
+
+/* rowid -> live sequence number and length in tokens, open addressing;
+ * seq 0 is an empty slot */
+typedef struct {
+    int64_t* rowids;
+    uint64_t* seqs;
+    uint32_t* lens;
+    size_t capacity;             /* Power of two */
+    size_t count;
+} fts_docmap_t;
+
+/* Segments to merge and the live versions as of the start */
+typedef struct {
+    fts_seg_t* sources;          /* Consecutive segments, oldest first */
+    uint32_t count;
+    fts_docmap_t live;
+} fts_merge_t;
+
+struct fts {
+    buffer_pool_t* pool;
+    file_t* file;
+    page_id_t meta_page;
+    fts_meta_t meta;             /* Cached; written through on change */
+    speedsql_tokenizer* tokenizer;
+    fts_seg_t segs[FTS_MAX_SEGMENTS];
+    fts_buf_t log;               /* The pending log's bytes */
+    fts_docmap_t docs;
+    uint64_t total_len;          /* Tokens over the live versions */
+    fts_seg_t pending;           /* The log as a segment in memory, for searches */
+    fts_buf_t pending_stream;
+    bool pending_valid;
+    bool merging;                /* A merge is running or about to */
+    bool closing;
+    fts_merge_t* job;            /* Handed to the merge thread */
+    thread_t merger;
+    bool merger_started;
+    rwlock_t lock;               /* Searches shared, writes exclusive */
+    mutex_t alloc_lock;          /* Free list, shared with the merge thread */
+    mutex_t pending_lock;        /* Rebuilding the pending segment */
+    mutex_t merger_lock;         /* Starting and joining the merge thread */
+};
+
+/* ============================================================================
+ * Buffers and Varints
+ * ============================================================================ */
+
+static bool buf_reserve(fts_buf_t* b, size_t extra) {
+    if (b->failed) return false;
+    if (b->len + extra <= b->cap) return true;
+
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + extra) cap *= 2;
+    uint8_t* grown = (uint8_t*)sdb_realloc(b->data, cap);
+    if (!grown) {
+        b->failed = true;
+        return false;
+    }
+    b->data = grown;
+    b->cap = cap;
+    return true;
+}
+
+static void buf_put(fts_buf_t* b, const void* data, size_t n) {
+    if (n == 0 || !buf_reserve(b, n)) return;
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+}
+
+static void buf_varint(fts_buf_t* b, uint64_t v) {
+    uint8_t tmp[10];
+    size_t n = 0;
+    while (v >= 0x80) {
+        tmp[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    tmp[n++] = (uint8_t)v;
+    buf_put(b, tmp, n);
+}
+
+static void buf_free(fts_buf_t* b) {
+    sdb_free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+static bool mem_varint(const uint8_t** p, const uint8_t* end, uint64_t* v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t byte = *(*p)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int term_compare(const char* a, uint32_t alen, const char* b, uint32_t blen) {
+    int cmp = memcmp(a, b, alen < blen ? alen : blen);
+    if (cmp != 0) return cmp;
+    return alen < blen ? -1 : (alen > blen ? 1 : 0);
+}
+
+/* ============================================================================
+ * Live Versions
+ * ============================================================================ */
+
+static inline size_t docmap_slot(const fts_docmap_t* m, int64_t rowid) {
+    uint64_t x = (uint64_t)rowid * 0x9E3779B97F4A7C15ull;
+    return (size_t)(x ^ (x >> 29)) & (m->capacity - 1);
+}
+
+static uint64_t docmap_get(const fts_docmap_t* m, int64_t rowid) {
+    if (m->capacity == 0) return 0;
+    for (size_t i = docmap_slot(m, rowid); m->seqs[i] != 0; i = (i + 1) & (m->capacity - 1)) {
+        if (m->rowids[i] == rowid) return m->seqs[i];
+    }
+    return 0;
+}
+
+static uint32_t docmap_len(const fts_docmap_t* m, int64_t rowid) {
+    if (m->capacity == 0) return 0;
+    for (size_t i = docmap_slot(m, rowid); m->seqs[i] != 0; i = (i + 1) & (m->capacity - 1)) {
+        if (m->rowids[i] == rowid) return m->lens[i];
+    }
+    return 0;
+}
+
+static int docmap_put(fts_docmap_t* m, int64_t rowid, uint64_t seq, uint32_t len);
+
+static int docmap_grow(fts_docmap_t* m) {
+    fts_docmap_t grown;
+    grown.capacity = m->capacity ? m->capacity * 2 : 64;
+    grown.count = 0;
+    grown.rowids = (int64_t*)sdb_malloc(grown.capacity * sizeof(int64_t));
+    grown.seqs = (uint64_t*)sdb_calloc(grown.capacity, sizeof(uint64_t));
+    grown.lens = (uint32_t*)sdb_malloc(grown.capacity * sizeof(uint32_t));
+    if (!grown.rowids || !grown.seqs || !grown.lens) {
+        sdb_free(grown.rowids);
+        sdb_free(grown.seqs);
+        sdb_free(grown.lens);
+        return SPEEDSQL_NOMEM;
+    }
+
+    for (size_t i = 0; i < m->capacity; i++) {
+        if (m->seqs[i] != 0) docmap_put(&grown, m->rowids[i], m->seqs[i], m->lens[i]);
+    }
+    sdb_free(m->rowids);
+    sdb_free(m->seqs);
+    sdb_free(m->lens);
+    *m = grown;
+    return SPEEDSQL_OK;
+}
+
+static int docmap_put(fts_docmap_t* m, int64_t rowid, uint64_t seq, uint32_t len) {
+    if ((m->count + 1) * 10 > m->capacity * 7) {
+        int rc = docmap_grow(m);
+        if (rc != SPEEDSQL_OK) return rc;
+    }
+
+    size_t i = docmap_slot(m, rowid);
+    while (m->seqs[i] != 0 && m->rowids[i] != rowid) i = (i + 1) & (m->capacity - 1);
+    if (m->seqs[i] == 0) m->count++;
+    m->rowids[i] = rowid;
+    m->seqs[i] = seq;
+    m->lens[i] = len;
+    return SPEEDSQL_OK;
+}
+
+/* Remove by shifting the rest of the probe run back */
+static void docmap_remove(fts_docmap_t* m, int64_t rowid) {
+    if (m->capacity == 0) return;
+    size_t mask = m->capacity - 1;
+    size_t i = docmap_slot(m, rowid);
+    while (m->seqs[i] != 0 && m->rowids[i] != rowid) i = (i + 1) & mask;
+    if (m->seqs[i] == 0) return;
+
+    m->seqs[i] = 0;
+    m->count--;
+    for (size_t j = (i + 1) & mask; m->seqs[j] != 0; j = (j + 1) & mask) {
+        size_t home = docmap_slot(m, m->rowids[j]);
+        /* Move j into the hole unless its home lies in (i, j] */
+        bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+        if (stays) continue;
+        m->rowids[i] = m->rowids[j];
+        m->seqs[i] = m->seqs[j];
+        m->lens[i] = m->lens[j];
+        m->seqs[j] = 0;
+        i = j;
+    }
+}
+
+static int docmap_copy(fts_docmap_t* dst, const fts_docmap_t* src) {
+    memset(dst, 0, sizeof(*dst));
+    if (src->capacity == 0) return SPEEDSQL_OK;
+
+    dst->rowids = (int64_t*)sdb_malloc(src->capacity * sizeof(int64_t));
+    dst->seqs = (uint64_t*)sdb_malloc(src->capacity * sizeof(uint64_t));
+    dst->lens = (uint32_t*)sdb_malloc(src->capacity * sizeof(uint32_t));
+    if (!dst->rowids || !dst->seqs || !dst->lens) {
+        sdb_free(dst->rowids);
+        sdb_free(dst->seqs);
+        sdb_free(dst->lens);
+        memset(dst, 0, sizeof(*dst));
+        return SPEEDSQL_NOMEM;
+    }
+    memcpy(dst->rowids, src->rowids, src->capacity * sizeof(int64_t));
+    memcpy(dst->seqs, src->seqs, src->capacity * sizeof(uint64_t));
+    memcpy(dst->lens, src->lens, src->capacity * sizeof(uint32_t));
+    dst->capacity = src->capacity;
+    dst->count = src->count;
+    return SPEEDSQL_OK;
+}
+
+static void docmap_free(fts_docmap_t* m) {
+    sdb_free(m->rowids);
+    sdb_free(m->seqs);
+    sdb_free(m->lens);
+    memset(m, 0, sizeof(*m));
+}
+
+/* A document of seg is live while its row's live version is in the
+ * segment's range; with no map every document is */
+static inline bool doc_live(const fts_docmap_t* live, const fts_seg_t* seg, uint64_t doc) {
+    if (!live) return true;
+    uint64_t seq = docmap_get(live, doc_rowid(doc));
+    return seq != 0 && seq >= seg->ref.min_seq && seq <= seg->ref.max_seq;
+}
+
+/* ============================================================================
+ * Pages
+ * ============================================================================ */
+
+static inline size_t per_page(const fts_t* h) {
+    return h->pool->usable_size - FTS_PAGE_DATA;
+}
+
+static void page_init(buffer_pool_t* pool, buffer_page_t* page, uint8_t flags) {
+    memset(page->data, 0, pool->usable_size);
+    page_header_t* hdr = (page_header_t*)page->data;
+    hdr->page_type = PAGE_TYPE_FTS;
+    hdr->flags = flags;
+    hdr->free_start = FTS_PAGE_DATA;
+    hdr->free_end = (uint32_t)pool->usable_size;
+    hdr->right_ptr = INVALID_PAGE_ID;
+}
+
+/* A recycled page if there is one, else a new one; pinned and empty */
+static buffer_page_t* page_alloc(fts_t* h, uint8_t flags, page_id_t* page_id) {
+    buffer_page_t* page = nullptr;
+
+    mutex_lock(&h->alloc_lock);
+    if (h->meta.free_head != INVALID_PAGE_ID) {
+        page = buffer_pool_get(h->pool, h->file, h->meta.free_head);
+        if (page) {
+            *page_id = h->meta.free_head;
+            h->meta.free_head = ((page_header_t*)page->data)->right_ptr;
+        }
+    } else {
+        page = buffer_pool_new_page(h->pool, h->file, page_id);
+    }
+    mutex_unlock(&h->alloc_lock);
+
+    if (page) page_init(h->pool, page, flags);
+    return page;
+}
+
+static void pages_free(fts_t* h, const page_id_t* pages, size_t count) {
+    mutex_lock(&h->alloc_lock);
+    for (size_t i = 0; i < count; i++) {
+        buffer_page_t* page = buffer_pool_get(h->pool, h->file, pages[i]);
+        if (!page) continue;  /* Leaked rather than risk a bad free list */
+        page_init(h->pool, page, FTS_PAGE_FREE);
+        ((page_header_t*)page->data)->right_ptr = h->meta.free_head;
+        h->meta.free_head = pages[i];
+        buffer_pool_unpin(h->pool, page, true);
+    }
+    mutex_unlock(&h->alloc_lock);
+}
+
+static int meta_write(fts_t* h) {
+    buffer_page_t* page = buffer_pool_get(h->pool, h->file, h->meta_page);
+    if (!page) return SPEEDSQL_IOERR;
+
+    mutex_lock(&h->alloc_lock);
+    memcpy(page->data + FTS_PAGE_DATA, &h->meta, sizeof(h->meta));
+    mutex_unlock(&h->alloc_lock);
+    buffer_pool_unpin(h->pool, page, true);
+    return SPEEDSQL_OK;
+}
+
+/* Walk a chain of count pages from first */
+static int chain_pages(fts_t* h, page_id_t first, uint8_t flags, page_id_t* pages, size_t count) {
+    page_id_t page_id = first;
+    for (size_t i = 0; i < count; i++) {
+        if (page_id == INVALID_PAGE_ID) return SPEEDSQL_CORRUPT;
+        buffer_page_t* page = buffer_pool_get(h->pool, h->file, page_id);
+        if (!page) return SPEEDSQL_IOERR;
+
+        page_header_t* hdr = (page_header_t*)page->data;
+        bool ok = hdr->page_type == PAGE_TYPE_FTS && hdr->flags == flags;
+        pages[i] = page_id;
+        page_id = hdr->right_ptr;
+        buffer_pool_unpin(h->pool, page, false);
+        if (!ok) return SPEEDSQL_CORRUPT;
+    }
+    return SPEEDSQL_OK;
+}
+
+/* ============================================================================
+ * Segment Streams
+ * ============================================================================ */
+
+static int seg_read(fts_t* h, const fts_seg_t* seg, uint64_t offset, void* dst, size_t len) {
+    if (offset + len > seg->ref.bytes) return SPEEDSQL_CORRUPT;
+    if (seg->mem) {
+        memcpy(dst, seg->mem + offset, len);
+        return SPEEDSQL_OK;
+    }
+
+    uint8_t* out = (uint8_t*)dst;
+    size_t per = per_page(h);
+    while (len > 0) {
+        size_t within = (size_t)(offset % per);
+        size_t n = per - within < len ? per - within : len;
+        buffer_page_t* page = buffer_pool_get(h->pool, h->file, seg->pages[offset / per]);
+        if (!page) return SPEEDSQL_IOERR;
+        memcpy(out, page->data + FTS_PAGE_DATA + within, n);
+        buffer_pool_unpin(h->pool, page, false);
+        out += n;
+        offset += n;
+        len -= n;
+    }
+    return SPEEDSQL_OK;
+}
+
+/* Writes a stream to memory (h null) or to a chain of new pages */
+typedef struct {
+    fts_t* h;
+    fts_buf_t buf;               /* The whole stream, or the page being filled */
+    page_id_t* pages;
+    size_t page_count;
+    size_t page_cap;
+    uint64_t total;
+    int rc;
+} fts_out_t;
+
+static void out_init(fts_out_t* o, fts_t* h) {
+    memset(o, 0, sizeof(*o));
+    o->h = h;
+}
+
+static void out_flush_page(fts_out_t* o) {
+    fts_t* h = o->h;
+    if (o->page_count == o->page_cap) {
+        size_t cap = o->page_cap ? o->page_cap * 2 : 16;
+        page_id_t* grown = (page_id_t*)sdb_realloc(o->pages, cap * sizeof(page_id_t));
+        if (!grown) {
+            o->rc = SPEEDSQL_NOMEM;
+            return;
+        }
+        o->pages = grown;
+        o->page_cap = cap;
+    }
+
+    page_id_t page_id;
+    buffer_page_t* page = page_alloc(h, FTS_PAGE_SEGMENT, &page_id);
+    if (!page) {
+        o->rc = SPEEDSQL_NOMEM;
+        return;
+    }
+    ((page_header_t*)page->data)->free_start = (uint32_t)(FTS_PAGE_DATA + o->buf.len);
+    memcpy(page->data + FTS_PAGE_DATA, o->buf.data, o->buf.len);
+    buffer_pool_unpin(h->pool, page, true);
+
+    if (o->page_count > 0) {
+        buffer_page_t* prev = buffer_pool_get(h->pool, h->file, o->pages[o->page_count - 1]);
+        if (!prev) {
+            o->rc = SPEEDSQL_IOERR;
+        } else {
+            ((page_header_t*)prev->data)->right_ptr = page_id;
+            buffer_pool_unpin(h->pool, prev, true);
+        }
+    }
+    o->pages[o->page_count++] = page_id;
+    o->buf.len = 0;
+}
+
+static void out_put(fts_out_t* o, const void* data, size_t n) {
+    if (o->rc != SPEEDSQL_OK) return;
+    o->total += n;
+    if (!o->h) {
+        buf_put(&o->buf, data, n);
+        if (o->buf.failed) o->rc = SPEEDSQL_NOMEM;
+        return;
+    }
+
+    const uint8_t* src = (const uint8_t*)data;
+    size_t per = per_page(o->h);
+    if (!buf_reserve(&o->buf, per)) {
+        o->rc = SPEEDSQL_NOMEM;
+        return;
+    }
+    while (n > 0 && o->rc == SPEEDSQL_OK) {
+        size_t room = per - o->buf.len;
+        size_t take = room < n ? room : n;
+        memcpy(o->buf.data + o->buf.len, src, take);
+        o->buf.len += take;
+        src += take;
+        n -= take;
+        if (o->buf.len == per) out_flush_page(o);
+    }
+}
+
+/* Give back the pages of a stream that will not be used */
+static void out_discard(fts_out_t* o) {
+    if (o->h && o->page_count > 0) pages_free(o->h, o->pages, o->page_count);
+    sdb_free(o->pages);
+    buf_free(&o->buf);
+    o->pages = nullptr;
+    o->page_count = 0;
+}
+
+/* Sequential reads of a segment stream through a small window */
+typedef struct {
+    fts_t* h;
+    const fts_seg_t* seg;
+    uint64_t pos;                /* Stream offset of window[0] */
+    uint64_t end;
+    uint8_t window[512];
+    size_t at;
+    size_t len;
+    bool bad;
+} fts_in_t;
+
+static void in_init(fts_in_t* in, fts_t* h, const fts_seg_t* seg, uint64_t offset, uint64_t end) {
+    in->h = h;
+    in->seg = seg;
+    in->pos = offset;
+    in->end = end;
+    in->at = 0;
+    in->len = 0;
+    in->bad = false;
+}
+
+static bool in_fill(fts_in_t* in) {
+    in->pos += in->len;
+    in->at = 0;
+    in->len = 0;
+    if (in->pos >= in->end) return false;
+    size_t n = in->end - in->pos < sizeof(in->window) ? (size_t)(in->end - in->pos) :
+                                                        sizeof(in->window);
+    if (seg_read(in->h, in->seg, in->pos, in->window, n) != SPEEDSQL_OK) {
+        in->bad = true;
+        return false;
+    }
+    in->len = n;
+    return true;
+}
+
+static bool in_byte(fts_in_t* in, uint8_t* out) {
+    if (in->at == in->len && !in_fill(in)) {
+        in->bad = true;
+        return false;
+    }
+    *out = in->window[in->at++];
+    return true;
+}
+
+static bool in_varint(fts_in_t* in, uint64_t* v) {
+    uint64_t result = 0;
+    uint8_t byte;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (!in_byte(in, &byte)) return false;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *v = result;
+            return true;
+        }
+    }
+    in->bad = true;
+    return false;
+}
+
+static bool in_bytes(fts_in_t* in, void* dst, size_t n) {
+    uint8_t* out = (uint8_t*)dst;
+    for (size_t i = 0; i < n; i++) {
+        if (!in_byte(in, &out[i])) return false;
+    }
+    return true;
+}
+
+/* ============================================================================
+ * Dictionary
+ * ============================================================================ */
+
+typedef struct {
+    char term[FTS_MAX_TERM];
+    uint32_t len;
+    uint64_t df;                 /* Documents in the list, live or not */
+    uint64_t offset;             /* Of the list's skip table */
+    uint64_t header_len;         /* Skip table bytes */
+    uint64_t body_len;           /* Block bytes */
+} fts_entry_t;
+
+static bool in_entry(fts_in_t* in, fts_entry_t* e) {
+    uint64_t len;
+    if (!in_varint(in, &len) || len > FTS_MAX_TERM) {
+        in->bad = true;
+        return false;
+    }
+    e->len = (uint32_t)len;
+    return in_bytes(in, e->term, e->len) && in_varint(in, &e->df) &&
+           in_varint(in, &e->offset) && in_varint(in, &e->header_len) &&
+           in_varint(in, &e->body_len);
+}
+
+static int seg_load_footer(fts_t* h, fts_seg_t* seg) {
+    if (seg->ref.bytes < sizeof(fts_footer_t)) return SPEEDSQL_CORRUPT;
+    int rc = seg_read(h, seg, seg->ref.bytes - sizeof(fts_footer_t), &seg->foot,
+                      sizeof(fts_footer_t));
+    if (rc != SPEEDSQL_OK) return rc;
+    const fts_footer_t* f = &seg->foot;
+    if (f->magic != FTS_SEGMENT_MAGIC || f->interval == 0 || f->dict_offset > f->index_offset ||
+        f->index_offset > seg->ref.bytes - sizeof(fts_footer_t)) {
+        return SPEEDSQL_CORRUPT;
+    }
+    return SPEEDSQL_OK;
+}
+
+/* Entry i of the term index: the dictionary entry it points at */
+static bool index_entry(fts_t* h, const fts_seg_t* seg, uint64_t i, fts_entry_t* e) {
+    uint64_t offset;
+    if (seg_read(h, seg, seg->foot.index_offset + i * sizeof(uint64_t), &offset,
+                 sizeof(offset)) != SPEEDSQL_OK) {
+        return false;
+    }
+    fts_in_t in;
+    in_init(&in, h, seg, offset, seg->foot.index_offset);
+    return in_entry(&in, e);
+}
+
+/* The dictionary entry of a term: binary search over the term index,
+ * then a scan of at most one interval */
+static int seg_lookup(fts_t* h, const fts_seg_t* seg, const char* term, uint32_t len,
+                      fts_entry_t* e) {
+    const fts_footer_t* f = &seg->foot;
+    if (f->term_count == 0) return SPEEDSQL_NOTFOUND;
+
+    uint64_t lo = 0, hi = (f->term_count + f->interval - 1) / f->interval;
+    if (!index_entry(h, seg, 0, e)) return SPEEDSQL_CORRUPT;
+    if (term_compare(term, len, e->term, e->len) < 0) return SPEEDSQL_NOTFOUND;
+
+    /* Last index entry at or before term */
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (!index_entry(h, seg, mid, e)) return SPEEDSQL_CORRUPT;
+        if (term_compare(term, len, e->term, e->len) < 0) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+
+    uint64_t offset;
+    int rc = seg_read(h, seg, f->index_offset + lo * sizeof(uint64_t), &offset, sizeof(offset));
+    if (rc != SPEEDSQL_OK) return rc;
+
+    fts_in_t in;
+    in_init(&in, h, seg, offset, f->index_offset);
+    uint64_t remaining = f->term_count - lo * f->interval;
+    for (uint64_t i = 0; i < f->interval && i < remaining; i++) {
+        if (!in_entry(&in, e)) return SPEEDSQL_CORRUPT;
+        int cmp = term_compare(term, len, e->term, e->len);
+        if (cmp == 0) return SPEEDSQL_OK;
+        if (cmp < 0) break;
+    }
+    return SPEEDSQL_NOTFOUND;
+}
+
+/* ============================================================================
+ * BM25
+ * ============================================================================ */
+
+#define FTS_BM25_K1 1.2
+#define FTS_BM25_B  0.75
+
+/* Bounds are widened by this much so rounding never prunes a match that
+ * ties the k-th best */
+#define FTS_BOUND_SLACK (1.0 + 1e-9)
+
+/* Inverse document frequency; df counts postings not yet merged away,
+ * so it is capped at the live document count */
+static double bm25_idf(uint64_t docs, uint64_t df) {
+    if (df > docs) df = docs;
+    return log(1.0 + ((double)docs - (double)df + 0.5) / ((double)df + 0.5));
+}
+
+/* One term's score in a document; rises with freq, falls with len */
+static inline double bm25_term(double idf, double avg_len, uint32_t freq, uint32_t len) {
+    double tf = (double)freq;
+    double norm = 1.0 - FTS_BM25_B + FTS_BM25_B * (double)len / avg_len;
+    return idf * tf * (FTS_BM25_K1 + 1.0) / (tf + FTS_BM25_K1 * norm);
+}
+
+/* ============================================================================
+ * Posting Cursors
+ * ============================================================================ */
+
+typedef struct {
+    fts_t* h;
+    const fts_seg_t* seg;
+    uint64_t body;               /* Stream offset of block 0 */
+    uint32_t block_count;
+    uint64_t* block_last;        /* Last document of each block */
+    uint64_t* block_offset;      /* From body; block_count + 1 entries */
+    uint32_t* block_max_freq;    /* Highest frequency in each block */
+    uint32_t* block_min_len;     /* Shortest document in each block */
+    double* block_bound;         /* Score bound of each block, once weighed */
+    double max_bound;
+    double idf;
+    double avg_len;
+    uint32_t block;              /* Block decoded */
+    uint32_t n;                  /* Documents in it */
+    uint32_t i;                  /* Current one */
+    uint64_t docs[FTS_BLOCK];
+    uint32_t freqs[FTS_BLOCK];
+    uint32_t lens[FTS_BLOCK];
+    uint32_t pos_start[FTS_BLOCK];
+    uint32_t* positions;         /* The block's, back to back */
+    size_t pos_cap;
+    fts_buf_t raw;
+    uint64_t doc;                /* FTS_END once exhausted */
+    int rc;
+} fts_cursor_t;
+
+static void cursor_load(fts_cursor_t* c, uint32_t block) {
+    c->block = block;
+    c->n = 0;
+    c->i = 0;
+    c->doc = FTS_END;
+    if (block >= c->block_count || c->rc != SPEEDSQL_OK) return;
+
+    size_t len = (size_t)(c->block_offset[block + 1] - c->block_offset[block]);
+    c->raw.len = 0;
+    if (!buf_reserve(&c->raw, len)) {
+        c->rc = SPEEDSQL_NOMEM;
+        return;
+    }
+    c->rc = seg_read(c->h, c->seg, c->body + c->block_offset[block], c->raw.data, len);
+    if (c->rc != SPEEDSQL_OK) return;
+
+    const uint8_t* p = c->raw.data;
+    const uint8_t* end = p + len;
+    uint64_t doc = block > 0 ? c->block_last[block - 1] : 0;
+    size_t pos_count = 0;
+    while (p < end && c->n < FTS_BLOCK) {
+        uint64_t delta, freq, doc_len;
+        if (!mem_varint(&p, end, &delta) || !mem_varint(&p, end, &freq) ||
+            !mem_varint(&p, end, &doc_len) || freq > (uint64_t)(end - p) ||
+            doc_len > UINT32_MAX) {
+            c->rc = SPEEDSQL_CORRUPT;
+            return;
+        }
+        doc += delta;
+        if (pos_count + freq > c->pos_cap) {
+            size_t cap = c->pos_cap ? c->pos_cap : 256;
+            while (cap < pos_count + freq) cap *= 2;
+            uint32_t* grown = (uint32_t*)sdb_realloc(c->positions, cap * sizeof(uint32_t));
+            if (!grown) {
+                c->rc = SPEEDSQL_NOMEM;
+                return;
+            }
+            c->positions = grown;
+            c->pos_cap = cap;
+        }
+
+        c->docs[c->n] = doc;
+        c->freqs[c->n] = (uint32_t)freq;
+        c->lens[c->n] = (uint32_t)doc_len;
+        c->pos_start[c->n] = (uint32_t)pos_count;
+        uint64_t position = 0;
+        for (uint64_t j = 0; j < freq; j++) {
+            uint64_t gap;
+            if (!mem_varint(&p, end, &gap)) {
+                c->rc = SPEEDSQL_CORRUPT;
+                return;
+            }
+            position += gap;
+            c->positions[pos_count++] = (uint32_t)position;
+        }
+        c->n++;
+    }
+
+    if (c->n == 0 || p != end || c->docs[c->n - 1] != c->block_last[block]) {
+        c->rc = SPEEDSQL_CORRUPT;
+        return;
+    }
+    c->doc = c->docs[0];
+}
+
+static int cursor_open(fts_cursor_t* c, fts_t* h, const fts_seg_t* seg, const fts_entry_t* e) {
+    memset(c, 0, sizeof(*c));
+    c->h = h;
+    c->seg = seg;
+    c->body = e->offset + e->header_len;
+    c->doc = FTS_END;
+
+    fts_buf_t header = {};
+    if (!buf_reserve(&header, (size_t)e->header_len)) return c->rc = SPEEDSQL_NOMEM;
+    c->rc = seg_read(h, seg, e->offset, header.data, (size_t)e->header_len);
+
+    const uint8_t* p = header.data;
+    const uint8_t* end = p + e->header_len;
+    uint64_t df = 0, blocks = 0;
+    if (c->rc == SPEEDSQL_OK && (!mem_varint(&p, end, &df) || !mem_varint(&p, end, &blocks) ||
+                                 blocks == 0 || blocks > df || blocks > (uint64_t)(end - p))) {
+        c->rc = SPEEDSQL_CORRUPT;
+    }
+    if (c->rc == SPEEDSQL_OK) {
+        c->block_count = (uint32_t)blocks;
+        c->block_last = (uint64_t*)sdb_malloc(blocks * sizeof(uint64_t));
+        c->block_offset = (uint64_t*)sdb_malloc((blocks + 1) * sizeof(uint64_t));
+        c->block_max_freq = (uint32_t*)sdb_malloc(blocks * sizeof(uint32_t));
+        c->block_min_len = (uint32_t*)sdb_malloc(blocks * sizeof(uint32_t));
+        if (!c->block_last || !c->block_offset || !c->block_max_freq || !c->block_min_len) {
+            c->rc = SPEEDSQL_NOMEM;
+        }
+    }
+
+    uint64_t last = 0, offset = 0;
+    for (uint64_t b = 0; b < blocks && c->rc == SPEEDSQL_OK; b++) {
+        uint64_t gap, len, max_freq, min_len;
+        if (!mem_varint(&p, end, &gap) || !mem_varint(&p, end, &len) ||
+            !mem_varint(&p, end, &max_freq) || !mem_varint(&p, end, &min_len) ||
+            max_freq > UINT32_MAX || min_len > UINT32_MAX) {
+            c->rc = SPEEDSQL_CORRUPT;
+            break;
+        }
+        last += gap;
+        c->block_last[b] = last;
+        c->block_offset[b] = offset;
+        c->block_max_freq[b] = (uint32_t)max_freq;
+        c->block_min_len[b] = (uint32_t)min_len;
+        offset += len;
+    }
+    if (c->rc == SPEEDSQL_OK) {
+        c->block_offset[blocks] = offset;
+        if (offset != e->body_len) c->rc = SPEEDSQL_CORRUPT;
+    }
+    buf_free(&header);
+
+    if (c->rc == SPEEDSQL_OK) cursor_load(c, 0);
+    return c->rc;
+}
+
+static void cursor_close(fts_cursor_t* c) {
+    sdb_free(c->block_last);
+    sdb_free(c->block_offset);
+    sdb_free(c->block_max_freq);
+    sdb_free(c->block_min_len);
+    sdb_free(c->block_bound);
+    sdb_free(c->positions);
+    buf_free(&c->raw);
+}
+
+static void cursor_next(fts_cursor_t* c) {
+    if (c->doc == FTS_END) return;
+    if (++c->i < c->n) {
+        c->doc = c->docs[c->i];
+    } else {
+        cursor_load(c, c->block + 1);
+    }
+}
+
+/* First document at or after target; blocks that end before it are
+ * skipped without being read */
+static void cursor_seek(fts_cursor_t* c, uint64_t target) {
+    if (c->doc >= target) return;
+
+    if (c->block_last[c->block] < target) {
+        uint32_t lo = c->block + 1, hi = c->block_count;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (c->block_last[mid] < target) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        cursor_load(c, lo);
+        if (c->doc == FTS_END) return;
+    }
+    while (c->docs[c->i] < target) c->i++;
+    c->doc = c->docs[c->i];
+}
+
+static const uint32_t* cursor_positions(const fts_cursor_t* c, uint32_t* count) {
+    *count = c->freqs[c->i];
+    return c->positions + c->pos_start[c->i];
+}
+
+/* Bound each block's score from its skip entry, for ranked searches */
+static void cursor_weigh(fts_cursor_t* c, double idf, double avg_len) {
+    c->idf = idf;
+    c->avg_len = avg_len;
+    c->max_bound = 0;
+    c->block_bound = (double*)sdb_malloc((c->block_count ? c->block_count : 1) * sizeof(double));
+    if (!c->block_bound) {
+        c->rc = SPEEDSQL_NOMEM;
+        return;
+    }
+    for (uint32_t b = 0; b < c->block_count; b++) {
+        c->block_bound[b] = bm25_term(idf, avg_len, c->block_max_freq[b], c->block_min_len[b]) *
+                            FTS_BOUND_SLACK;
+        if (c->block_bound[b] > c->max_bound) c->max_bound = c->block_bound[b];
+    }
+}
+
+/* Score bound for documents from target up to *end, the last document
+ * of the block target falls in; *end is FTS_END past the list */
+static double cursor_bound(const fts_cursor_t* c, uint64_t target, uint64_t* end) {
+    *end = FTS_END;
+    if (c->doc == FTS_END) return 0;
+
+    uint32_t lo = c->block, hi = c->block_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (c->block_last[mid] < target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == c->block_count) return 0;
+    *end = c->block_last[lo];
+    return c->block_bound[lo];
+}
+
+static inline double cursor_score(const fts_cursor_t* c) {
+    return bm25_term(c->idf, c->avg_len, c->freqs[c->i], c->lens[c->i]);
+}
+
+/* ============================================================================
+ * Segment Builder
+ * ============================================================================ */
+
+typedef struct {
+    fts_out_t* out;
+    fts_buf_t block;             /* Block being filled */
+    fts_buf_t blocks;            /* The term's closed blocks */
+    fts_buf_t skips;             /* The term's skip entries */
+    uint32_t block_count;
+    uint32_t in_block;
+    uint32_t block_max_freq;
+    uint32_t block_min_len;
+    uint64_t prev_doc;
+    uint64_t skip_prev;
+    uint64_t df;
+    fts_buf_t dict;
+    fts_buf_t index;
+    uint64_t term_count;
+    char term[FTS_MAX_TERM];
+    uint32_t term_len;
+} fts_builder_t;
+
+static void builder_init(fts_builder_t* b, fts_out_t* out) {
+    memset(b, 0, sizeof(*b));
+    b->out = out;
+}
+
+static void builder_term(fts_builder_t* b, const char* term, uint32_t len) {
+    memcpy(b->term, term, len);
+    b->term_len = len;
+    b->blocks.len = 0;
+    b->skips.len = 0;
+    b->block_count = 0;
+    b->block_max_freq = 0;
+    b->block_min_len = UINT32_MAX;
+    b->prev_doc = 0;
+    b->skip_prev = 0;
+    b->df = 0;
+}
+
+static void builder_close_block(fts_builder_t* b) {
+    buf_varint(&b->skips, b->prev_doc - b->skip_prev);
+    buf_varint(&b->skips, b->block.len);
+    buf_varint(&b->skips, b->block_max_freq);
+    buf_varint(&b->skips, b->block_min_len);
+    buf_put(&b->blocks, b->block.data, b->block.len);
+    b->skip_prev = b->prev_doc;
+    b->block.len = 0;
+    b->in_block = 0;
+    b->block_max_freq = 0;
+    b->block_min_len = UINT32_MAX;
+    b->block_count++;
+}
+
+/* Documents of a term go in ascending order; len is the document's
+ * length in tokens */
+static void builder_doc(fts_builder_t* b, uint64_t doc, uint32_t len, const uint32_t* positions,
+                        uint32_t freq) {
+    buf_varint(&b->block, doc - b->prev_doc);
+    buf_varint(&b->block, freq);
+    buf_varint(&b->block, len);
+    if (freq > b->block_max_freq) b->block_max_freq = freq;
+    if (len < b->block_min_len) b->block_min_len = len;
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < freq; i++) {
+        buf_varint(&b->block, positions[i] - prev);
+        prev = positions[i];
+    }
+    b->prev_doc = doc;
+    b->df++;
+    if (++b->in_block == FTS_BLOCK) builder_close_block(b);
+}
+
+static void builder_end_term(fts_builder_t* b) {
+    if (b->in_block > 0) builder_close_block(b);
+    if (b->df == 0) return;
+
+    fts_buf_t header = {};
+    buf_varint(&header, b->df);
+    buf_varint(&header, b->block_count);
+    buf_put(&header, b->skips.data, b->skips.len);
+    if (header.failed) b->out->rc = SPEEDSQL_NOMEM;
+
+    uint64_t offset = b->out->total;
+    out_put(b->out, header.data, header.len);
+    out_put(b->out, b->blocks.data, b->blocks.len);
+
+    if (b->term_count % FTS_TERM_INTERVAL == 0) {
+        uint64_t at = b->dict.len;
+        buf_put(&b->index, &at, sizeof(at));
+    }
+    buf_varint(&b->dict, b->term_len);
+    buf_put(&b->dict, b->term, b->term_len);
+    buf_varint(&b->dict, b->df);
+    buf_varint(&b->dict, offset);
+    buf_varint(&b->dict, header.len);
+    buf_varint(&b->dict, b->blocks.len);
+    b->term_count++;
+    buf_free(&header);
+}
+
+/* Dictionary, term index and footer; the stream is complete after this */
+static int builder_finish(fts_builder_t* b) {
+    fts_out_t* o = b->out;
+    bool failed = b->block.failed || b->blocks.failed || b->skips.failed || b->dict.failed ||
+                  b->index.failed;
+    if (failed && o->rc == SPEEDSQL_OK) o->rc = SPEEDSQL_NOMEM;
+
+    fts_footer_t foot;
+    memset(&foot, 0, sizeof(foot));
+    foot.magic = FTS_SEGMENT_MAGIC;
+    foot.interval = FTS_TERM_INTERVAL;
+    foot.term_count = b->term_count;
+    foot.dict_offset = o->total;
+    out_put(o, b->dict.data, b->dict.len);
+
+    /* Index entries become stream offsets */
+    foot.index_offset = o->total;
+    for (size_t i = 0; i + sizeof(uint64_t) <= b->index.len; i += sizeof(uint64_t)) {
+        uint64_t at;
+        memcpy(&at, b->index.data + i, sizeof(at));
+        at += foot.dict_offset;
+        out_put(o, &at, sizeof(at));
+    }
+    out_put(o, &foot, sizeof(foot));
+    if (o->h && o->buf.len > 0 && o->rc == SPEEDSQL_OK) out_flush_page(o);
+
+    buf_free(&b->block);
+    buf_free(&b->blocks);
+    buf_free(&b->skips);
+    buf_free(&b->dict);
+    buf_free(&b->index);
+    return o->rc;
+}
+
+/* ============================================================================
+ * Tokenized Documents
+ * ============================================================================ */
+
+typedef struct {
+    const char* term;
+    size_t off;                  /* In the document's chars until sorted */
+    uint32_t len;
+    uint32_t position;
+} fts_token_t;
+
+typedef struct {
+    fts_buf_t chars;
+    fts_token_t* tokens;
+    size_t count;
+    size_t cap;
+    int rc;
+} fts_doc_t;
+
+static int doc_emit(void* ctx, const char* token, int len, int position) {
+    fts_doc_t* d = (fts_doc_t*)ctx;
+    if (len <= 0 || position < 0) return SPEEDSQL_OK;
+    if (len > FTS_MAX_TERM) len = FTS_MAX_TERM;
+
+    if (d->count == d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 64;
+        fts_token_t* grown = (fts_token_t*)sdb_realloc(d->tokens, cap * sizeof(fts_token_t));
+        if (!grown) return SPEEDSQL_NOMEM;
+        d->tokens = grown;
+        d->cap = cap;
+    }
+    fts_token_t* t = &d->tokens[d->count++];
+    t->off = d->chars.len;
+    t->len = (uint32_t)len;
+    t->position = (uint32_t)position;
+    buf_put(&d->chars, token, (size_t)len);
+    return d->chars.failed ? SPEEDSQL_NOMEM : SPEEDSQL_OK;
+}
+
+static int token_compare(const void* a, const void* b) {
+    const fts_token_t* x = (const fts_token_t*)a;
+    const fts_token_t* y = (const fts_token_t*)b;
+    int cmp = term_compare(x->term, x->len, y->term, y->len);
+    if (cmp != 0) return cmp;
+    return x->position < y->position ? -1 : (x->position > y->position ? 1 : 0);
+}
+
+static void doc_free(fts_doc_t* d) {
+    buf_free(&d->chars);
+    sdb_free(d->tokens);
+    memset(d, 0, sizeof(*d));
+}
+
+/* Tokens sorted by term, then position */
+static int doc_tokenize(speedsql_tokenizer* tok, const char* text, size_t len, fts_doc_t* d) {
+    memset(d, 0, sizeof(*d));
+    if (len > INT32_MAX) return SPEEDSQL_RANGE;
+
+    int rc = len > 0 ? tok->tokenize(tok, text, (int)len, doc_emit, d) : SPEEDSQL_OK;
+    if (rc != SPEEDSQL_OK) {
+        doc_free(d);
+        return rc;
+    }
+    for (size_t i = 0; i < d->count; i++) {
+        d->tokens[i].term = (const char*)d->chars.data + d->tokens[i].off;
+    }
+    qsort(d->tokens, d->count, sizeof(fts_token_t), token_compare);
+    return SPEEDSQL_OK;
+}
+
+/* Length in tokens, as ranked; capped to fit beside the sequence number */
+static inline uint32_t doc_length(const fts_doc_t* d) {
+    return d->count < FTS_MAX_DOC_LEN ? (uint32_t)d->count : FTS_MAX_DOC_LEN;
+}
+
+/* ============================================================================
+ * Postings to Segments
+ * ============================================================================ */
+
+typedef struct {
+    const char* term;
+    uint32_t len;
+    uint32_t freq;
+    uint32_t doc_len;            /* Tokens in the document */
+    uint64_t doc;
+    size_t pos;                  /* First position in the pool */
+} fts_posting_t;
+
+typedef struct {
+    fts_posting_t* items;
+    size_t count;
+    size_t cap;
+    uint32_t* pool;              /* Positions */
+    size_t pool_len;
+    size_t pool_cap;
+    int rc;
+} fts_postings_t;
+
+static uint32_t* postings_add(fts_postings_t* p, const char* term, uint32_t len, uint64_t doc,
+                              uint32_t doc_len, uint32_t freq) {
+    if (p->count == p->cap) {
+        size_t cap = p->cap ? p->cap * 2 : 256;
+        fts_posting_t* grown = (fts_posting_t*)sdb_realloc(p->items, cap * sizeof(fts_posting_t));
+        if (!grown) {
+            p->rc = SPEEDSQL_NOMEM;
+            return nullptr;
+        }
+        p->items = grown;
+        p->cap = cap;
+    }
+    if (p->pool_len + freq > p->pool_cap) {
+        size_t cap = p->pool_cap ? p->pool_cap : 1024;
+        while (cap < p->pool_len + freq) cap *= 2;
+        uint32_t* grown = (uint32_t*)sdb_realloc(p->pool, cap * sizeof(uint32_t));
+        if (!grown) {
+            p->rc = SPEEDSQL_NOMEM;
+            return nullptr;
+        }
+        p->pool = grown;
+        p->pool_cap = cap;
+    }
+
+    fts_posting_t* item = &p->items[p->count++];
+    item->term = term;
+    item->len = len;
+    item->freq = freq;
+    item->doc_len = doc_len;
+    item->doc = doc;
+    item->pos = p->pool_len;
+    p->pool_len += freq;
+    return p->pool + item->pos;
+}
+
+static void postings_free(fts_postings_t* p) {
+    sdb_free(p->items);
+    sdb_free(p->pool);
+    memset(p, 0, sizeof(*p));
+}
+
+static int posting_compare(const void* a, const void* b) {
+    const fts_posting_t* x = (const fts_posting_t*)a;
+    const fts_posting_t* y = (const fts_posting_t*)b;
+    int cmp = term_compare(x->term, x->len, y->term, y->len);
+    if (cmp != 0) return cmp;
+    return x->doc < y->doc ? -1 : (x->doc > y->doc ? 1 : 0);
+}
+
+/* A whole segment from unsorted postings */
+static int postings_write(fts_postings_t* p, fts_out_t* out) {
+    qsort(p->items, p->count, sizeof(fts_posting_t), posting_compare);
+
+    fts_builder_t b;
+    builder_init(&b, out);
+    for (size_t i = 0; i < p->count && out->rc == SPEEDSQL_OK; ) {
+        const fts_posting_t* first = &p->items[i];
+        builder_term(&b, first->term, first->len);
+        while (i < p->count && term_compare(p->items[i].term, p->items[i].len,
+                                            first->term, first->len) == 0) {
+            builder_doc(&b, p->items[i].doc, p->items[i].doc_len, p->pool + p->items[i].pos,
+                        p->items[i].freq);
+            i++;
+        }
+        builder_end_term(&b);
+    }
+    return builder_finish(&b);
+}
+
+/* A tokenized document's postings, one per distinct term */
+static void postings_from_doc(fts_postings_t* p, const fts_doc_t* d, uint64_t doc) {
+    for (size_t i = 0; i < d->count && p->rc == SPEEDSQL_OK; ) {
+        size_t j = i;
+        while (j < d->count && term_compare(d->tokens[j].term, d->tokens[j].len,
+                                            d->tokens[i].term, d->tokens[i].len) == 0) {
+            j++;
+        }
+        uint32_t* pos = postings_add(p, d->tokens[i].term, d->tokens[i].len, doc,
+                                     doc_length(d), (uint32_t)(j - i));
+        for (size_t k = i; pos && k < j; k++) pos[k - i] = d->tokens[k].position;
+        i = j;
+    }
+}
+
+/* ============================================================================
+ * Pending Log
+ *
+ * One record per insert:
+ *   varint doc, varint seq, varint document length, varint terms, then
+ *   per term varint length, bytes, varint frequency, varint position deltas
+ * ============================================================================ */
+
+/* The record body of a tokenized document */
+static void log_body(fts_buf_t* body, const fts_doc_t* d) {
+    size_t terms = 0;
+    for (size_t i = 0; i < d->count; i++) {
+        if (i == 0 || term_compare(d->tokens[i].term, d->tokens[i].len,
+                                   d->tokens[i - 1].term, d->tokens[i - 1].len) != 0) {
+            terms++;
+        }
+    }
+    buf_varint(body, doc_length(d));
+    buf_varint(body, terms);
+
+    for (size_t i = 0; i < d->count; ) {
+        size_t j = i;
+        while (j < d->count && term_compare(d->tokens[j].term, d->tokens[j].len,
+                                            d->tokens[i].term, d->tokens[i].len) == 0) {
+            j++;
+        }
+        buf_varint(body, d->tokens[i].len);
+        buf_put(body, d->tokens[i].term, d->tokens[i].len);
+        buf_varint(body, j - i);
+        uint32_t prev = 0;
+        for (size_t k = i; k < j; k++) {
+            buf_varint(body, d->tokens[k].position - prev);
+            prev = d->tokens[k].position;
+        }
+        i = j;
+    }
+}
+
+/* Append bytes to the log's pages and to its copy in memory */
+static int log_append(fts_t* h, const uint8_t* data, size_t n) {
+    size_t per = per_page(h);
+    const uint8_t* src = data;
+    size_t left = n;
+
+    while (left > 0) {
+        buffer_page_t* page = nullptr;
+        if (h->meta.log_tail != INVALID_PAGE_ID) {
+            page = buffer_pool_get(h->pool, h->file, h->meta.log_tail);
+            if (!page) return SPEEDSQL_IOERR;
+            if (((page_header_t*)page->data)->free_start >= FTS_PAGE_DATA + per) {
+                page_id_t page_id;
+                buffer_page_t* next = page_alloc(h, FTS_PAGE_LOG, &page_id);
+                if (!next) {
+                    buffer_pool_unpin(h->pool, page, false);
+                    return SPEEDSQL_NOMEM;
+                }
+                ((page_header_t*)page->data)->right_ptr = page_id;
+                buffer_pool_unpin(h->pool, page, true);
+                page = next;
+                h->meta.log_tail = page_id;
+            }
+        } else {
+            page_id_t page_id;
+            page = page_alloc(h, FTS_PAGE_LOG, &page_id);
+            if (!page) return SPEEDSQL_NOMEM;
+            h->meta.log_head = page_id;
+            h->meta.log_tail = page_id;
+        }
+
+        page_header_t* hdr = (page_header_t*)page->data;
+        size_t room = FTS_PAGE_DATA + per - hdr->free_start;
+        size_t take = room < left ? room : left;
+        memcpy(page->data + hdr->free_start, src, take);
+        hdr->free_start += (uint32_t)take;
+        buffer_pool_unpin(h->pool, page, true);
+        src += take;
+        left -= take;
+    }
+
+    buf_put(&h->log, data, n);
+    h->meta.log_bytes += n;
+    return h->log.failed ? SPEEDSQL_NOMEM : SPEEDSQL_OK;
+}
+
+static int log_read(fts_t* h) {
+    page_id_t page_id = h->meta.log_head;
+    while (page_id != INVALID_PAGE_ID) {
+        buffer_page_t* page = buffer_pool_get(h->pool, h->file, page_id);
+        if (!page) return SPEEDSQL_IOERR;
+
+        page_header_t* hdr = (page_header_t*)page->data;
+        bool ok = hdr->page_type == PAGE_TYPE_FTS && hdr->flags == FTS_PAGE_LOG &&
+                  hdr->free_start >= FTS_PAGE_DATA && hdr->free_start <= h->pool->usable_size;
+        if (ok) buf_put(&h->log, page->data + FTS_PAGE_DATA, hdr->free_start - FTS_PAGE_DATA);
+        page_id = hdr->right_ptr;
+        buffer_pool_unpin(h->pool, page, false);
+        if (!ok) return SPEEDSQL_CORRUPT;
+    }
+    if (h->log.failed) return SPEEDSQL_NOMEM;
+    return h->log.len == h->meta.log_bytes ? SPEEDSQL_OK : SPEEDSQL_CORRUPT;
+}
+
+/* Postings of the log records that are still their row's live version */
+static int log_postings(fts_t* h, fts_postings_t* p) {
+    const uint8_t* at = h->log.data;
+    const uint8_t* end = at + h->log.len;
+
+    while (at < end && p->rc == SPEEDSQL_OK) {
+        uint64_t doc, seq, doc_len, terms;
+        if (!mem_varint(&at, end, &doc) || !mem_varint(&at, end, &seq) ||
+            !mem_varint(&at, end, &doc_len) || !mem_varint(&at, end, &terms) ||
+            doc_len > FTS_MAX_DOC_LEN) {
+            return SPEEDSQL_CORRUPT;
+        }
+        bool live = docmap_get(&h->docs, doc_rowid(doc)) == seq;
+
+        for (uint64_t t = 0; t < terms; t++) {
+            uint64_t len, freq;
+            if (!mem_varint(&at, end, &len) || len > FTS_MAX_TERM || len > (uint64_t)(end - at)) {
+                return SPEEDSQL_CORRUPT;
+            }
+            const char* term = (const char*)at;
+            at += len;
+            if (!mem_varint(&at, end, &freq) || freq > (uint64_t)(end - at)) {
+                return SPEEDSQL_CORRUPT;
+            }
+
+            uint32_t* pos = live ? postings_add(p, term, (uint32_t)len, doc, (uint32_t)doc_len,
+                                                (uint32_t)freq) :
+                                   nullptr;
+            uint64_t position = 0;
+            for (uint64_t k = 0; k < freq; k++) {
+                uint64_t gap;
+                if (!mem_varint(&at, end, &gap)) return SPEEDSQL_CORRUPT;
+                position += gap;
+                if (pos) pos[k] = (uint32_t)position;
+            }
+        }
+    }
+    return p->rc;
+}
+
+/* Pages of a log chain, for recycling */
+static int log_pages(fts_t* h, page_id_t** pages, size_t* count) {
+    size_t per = per_page(h);
+    size_t n = (size_t)((h->meta.log_bytes + per - 1) / per);
+    *count = 0;
+    *pages = (page_id_t*)sdb_malloc((n > 0 ? n : 1) * sizeof(page_id_t));
+    if (!*pages) return SPEEDSQL_NOMEM;
+
+    int rc = chain_pages(h, h->meta.log_head, FTS_PAGE_LOG, *pages, n);
+    if (rc == SPEEDSQL_OK) *count = n;
+    return rc;
+}
+
+/* ============================================================================
+ * Segments
+ * ============================================================================ */
+
+static void seg_release(fts_seg_t* seg) {
+    sdb_free(seg->pages);
+    memset(seg, 0, sizeof(*seg));
+}
+
+static void segments_sync(fts_t* h) {
+    for (uint32_t i = 0; i < h->meta.segment_count; i++) h->meta.segments[i] = h->segs[i].ref;
+}
+
+/* Turn the pending log into a new level-0 segment; caller holds the
+ * write lock */
+static int log_flush(fts_t* h) {
+    if (h->meta.log_bytes == 0) return SPEEDSQL_OK;
+    if (h->meta.segment_count >= FTS_MAX_SEGMENTS) return SPEEDSQL_FULL;
+
+    fts_postings_t p = {};
+    int rc = log_postings(h, &p);
+
+    fts_out_t out;
+    out_init(&out, h);
+    if (rc == SPEEDSQL_OK) rc = postings_write(&p, &out);
+    postings_free(&p);
+
+    page_id_t* old = nullptr;
+    size_t old_count = 0;
+    if (rc == SPEEDSQL_OK) rc = log_pages(h, &old, &old_count);
+
+    fts_seg_t* seg = &h->segs[h->meta.segment_count];
+    if (rc == SPEEDSQL_OK) {
+        memset(seg, 0, sizeof(*seg));
+        seg->pages = out.pages;
+        seg->ref.first = out.pages[0];
+        seg->ref.bytes = out.total;
+        seg->ref.min_seq = h->meta.log_min_seq;
+        seg->ref.max_seq = h->meta.next_seq - 1;
+        seg->ref.level = 0;
+        rc = seg_load_footer(h, seg);
+    }
+    if (rc != SPEEDSQL_OK) {
+        out_discard(&out);
+        sdb_free(old);
+        memset(seg, 0, sizeof(*seg));
+        return rc;
+    }
+    out.pages = nullptr;
+    buf_free(&out.buf);
+
+    h->meta.segment_count++;
+    segments_sync(h);
+    pages_free(h, old, old_count);
+    sdb_free(old);
+    h->meta.log_head = INVALID_PAGE_ID;
+    h->meta.log_tail = INVALID_PAGE_ID;
+    h->meta.log_bytes = 0;
+    h->meta.log_min_seq = 0;
+    h->log.len = 0;
+    h->pending_valid = false;
+    return SPEEDSQL_OK;
+}
+
+/* ============================================================================
+ * Merging
+ * ============================================================================ */
+
+typedef struct {
+    uint64_t doc;
+    size_t pos;
+    uint32_t freq;
+    uint32_t len;
+} fts_merged_doc_t;
+
+static int merged_compare(const void* a, const void* b) {
+    uint64_t x = ((const fts_merged_doc_t*)a)->doc;
+    uint64_t y = ((const fts_merged_doc_t*)b)->doc;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Merge the job's segments into out, term by term, keeping the
+ * postings that were live when the job was made. Reads only immutable
+ * segments and writes only new pages, so no lock is held. */
+static int merge_build(fts_t* h, fts_merge_t* job, fts_seg_t* merged) {
+    uint32_t n = job->count;
+    fts_in_t* dicts = (fts_in_t*)sdb_calloc(n, sizeof(fts_in_t));
+    fts_entry_t* heads = (fts_entry_t*)sdb_calloc(n, sizeof(fts_entry_t));
+    uint64_t* left = (uint64_t*)sdb_calloc(n, sizeof(uint64_t));
+    fts_merged_doc_t* docs = nullptr;
+    size_t doc_cap = 0;
+    uint32_t* pool = nullptr;
+    size_t pool_cap = 0;
+    fts_cursor_t cursor;
+
+    fts_out_t out;
+    out_init(&out, h);
+    fts_builder_t b;
+    builder_init(&b, &out);
+
+    int rc = dicts && heads && left ? SPEEDSQL_OK : SPEEDSQL_NOMEM;
+    for (uint32_t s = 0; s < n && rc == SPEEDSQL_OK; s++) {
+        const fts_seg_t* seg = &job->sources[s];
+        in_init(&dicts[s], h, seg, seg->foot.dict_offset, seg->foot.index_offset);
+        left[s] = seg->foot.term_count;
+        if (left[s] > 0 && !in_entry(&dicts[s], &heads[s])) rc = SPEEDSQL_CORRUPT;
+    }
+
+    while (rc == SPEEDSQL_OK && out.rc == SPEEDSQL_OK) {
+        /* Smallest term still to merge */
+        int low = -1;
+        for (uint32_t s = 0; s < n; s++) {
+            if (left[s] == 0) continue;
+            if (low < 0 || term_compare(heads[s].term, heads[s].len, heads[low].term,
+                                        heads[low].len) < 0) {
+                low = (int)s;
+            }
+        }
+        if (low < 0) break;
+
+        fts_entry_t term = heads[low];
+        size_t count = 0, pool_len = 0;
+        for (uint32_t s = 0; s < n && rc == SPEEDSQL_OK; s++) {
+            if (left[s] == 0 ||
+                term_compare(heads[s].term, heads[s].len, term.term, term.len) != 0) {
+                continue;
+            }
+
+            const fts_seg_t* seg = &job->sources[s];
+            rc = cursor_open(&cursor, h, seg, &heads[s]);
+            while (rc == SPEEDSQL_OK && cursor.doc != FTS_END) {
+                if (doc_live(&job->live, seg, cursor.doc)) {
+                    uint32_t freq;
+                    const uint32_t* positions = cursor_positions(&cursor, &freq);
+                    if (count == doc_cap) {
+                        doc_cap = doc_cap ? doc_cap * 2 : 256;
+                        fts_merged_doc_t* grown = (fts_merged_doc_t*)sdb_realloc(
+                            docs, doc_cap * sizeof(fts_merged_doc_t));
+                        if (!grown) {
+                            rc = SPEEDSQL_NOMEM;
+                            break;
+                        }
+                        docs = grown;
+                    }
+                    if (pool_len + freq > pool_cap) {
+                        pool_cap = pool_cap ? pool_cap : 1024;
+                        while (pool_cap < pool_len + freq) pool_cap *= 2;
+                        uint32_t* grown = (uint32_t*)sdb_realloc(pool, pool_cap * sizeof(uint32_t));
+                        if (!grown) {
+                            rc = SPEEDSQL_NOMEM;
+                            break;
+                        }
+                        pool = grown;
+                    }
+                    docs[count].doc = cursor.doc;
+                    docs[count].pos = pool_len;
+                    docs[count].freq = freq;
+                    docs[count].len = cursor.lens[cursor.i];
+                    memcpy(pool + pool_len, positions, freq * sizeof(uint32_t));
+                    pool_len += freq;
+                    count++;
+                }
+                cursor_next(&cursor);
+                if (cursor.rc != SPEEDSQL_OK) rc = cursor.rc;
+            }
+            cursor_close(&cursor);
+
+            if (rc == SPEEDSQL_OK && --left[s] > 0 && !in_entry(&dicts[s], &heads[s])) {
+                rc = SPEEDSQL_CORRUPT;
+            }
+        }
+
+        if (rc == SPEEDSQL_OK && count > 0) {
+            qsort(docs, count, sizeof(fts_merged_doc_t), merged_compare);
+            builder_term(&b, term.term, term.len);
+            for (size_t i = 0; i < count; i++) {
+                builder_doc(&b, docs[i].doc, docs[i].len, pool + docs[i].pos, docs[i].freq);
+            }
+            builder_end_term(&b);
+        }
+    }
+
+    int finish_rc = builder_finish(&b);
+    if (rc == SPEEDSQL_OK) rc = finish_rc;
+
+    memset(merged, 0, sizeof(*merged));
+    if (rc == SPEEDSQL_OK) {
+        merged->pages = out.pages;
+        merged->ref.first = out.pages[0];
+        merged->ref.bytes = out.total;
+        merged->ref.min_seq = job->sources[0].ref.min_seq;
+        merged->ref.max_seq = job->sources[n - 1].ref.max_seq;
+        for (uint32_t s = 0; s < n; s++) {
+            if (job->sources[s].ref.level + 1 > merged->ref.level) {
+                merged->ref.level = job->sources[s].ref.level + 1;
+            }
+        }
+        rc = seg_load_footer(h, merged);
+        if (rc != SPEEDSQL_OK) memset(merged, 0, sizeof(*merged));
+    }
+    if (rc == SPEEDSQL_OK) {
+        out.pages = nullptr;
+        buf_free(&out.buf);
+    } else {
+        out_discard(&out);
+    }
+
+    sdb_free(dicts);
+    sdb_free(heads);
+    sdb_free(left);
+    sdb_free(docs);
+    sdb_free(pool);
+    return rc;
+}
+
+/* Put the merged segment in place of its sources and recycle their
+ * pages; caller holds the write lock */
+static int merge_install(fts_t* h, fts_merge_t* job, fts_seg_t* merged) {
+    uint32_t at = 0;
+    while (at < h->meta.segment_count && h->segs[at].ref.first != job->sources[0].ref.first) at++;
+    if (at + job->count > h->meta.segment_count) return SPEEDSQL_CORRUPT;
+
+    for (uint32_t s = 0; s < job->count; s++) {
+        fts_seg_t* seg = &h->segs[at + s];
+        size_t per = per_page(h);
+        pages_free(h, seg->pages, (size_t)((seg->ref.bytes + per - 1) / per));
+        seg_release(seg);
+    }
+    h->segs[at] = *merged;
+    memmove(&h->segs[at + 1], &h->segs[at + job->count],
+            (h->meta.segment_count - at - job->count) * sizeof(fts_seg_t));
+    h->meta.segment_count -= job->count - 1;
+    memset(&h->segs[h->meta.segment_count], 0,
+           (FTS_MAX_SEGMENTS - h->meta.segment_count) * sizeof(fts_seg_t));
+    segments_sync(h);
+    return meta_write(h);
+}
+
+static void merge_free(fts_merge_t* job) {
+    if (!job) return;
+    sdb_free(job->sources);
+    docmap_free(&job->live);
+    sdb_free(job);
+}
+
+/* count segments from first, with the live versions as they are now */
+static fts_merge_t* merge_job(fts_t* h, uint32_t first, uint32_t count) {
+    fts_merge_t* job = (fts_merge_t*)sdb_calloc(1, sizeof(fts_merge_t));
+    if (!job) return nullptr;
+    job->sources = (fts_seg_t*)sdb_malloc(count * sizeof(fts_seg_t));
+    if (!job->sources || docmap_copy(&job->live, &h->docs) != SPEEDSQL_OK) {
+        merge_free(job);
+        return nullptr;
+    }
+    memcpy(job->sources, &h->segs[first], count * sizeof(fts_seg_t));
+    job->count = count;
+    return job;
+}
+
+/* The newest FTS_MERGE_FACTOR segments, when they share a level */
+static fts_merge_t* next_merge(fts_t* h) {
+    uint32_t count = h->meta.segment_count;
+    if (count < FTS_MERGE_FACTOR) return nullptr;
+
+    uint32_t first = count - FTS_MERGE_FACTOR;
+    for (uint32_t i = first + 1; i < count; i++) {
+        if (h->segs[i].ref.level != h->segs[first].ref.level) return nullptr;
+    }
+    return merge_job(h, first, FTS_MERGE_FACTOR);
+}
+
+/* Merge thread: one job after another until the policy has none */
+static void* merge_main(void* arg) {
+    fts_t* h = (fts_t*)arg;
+    fts_merge_t* job = h->job;
+    h->job = nullptr;
+
+    while (job) {
+        fts_seg_t merged;
+        int rc = merge_build(h, job, &merged);
+
+        rwlock_wrlock(&h->lock);
+        if (rc == SPEEDSQL_OK && merge_install(h, job, &merged) != SPEEDSQL_OK) {
+            size_t per = per_page(h);
+            pages_free(h, merged.pages, (size_t)((merged.ref.bytes + per - 1) / per));
+            seg_release(&merged);
+        }
+        merge_free(job);
+        job = h->closing ? nullptr : next_merge(h);
+        if (!job) h->merging = false;
+        rwlock_unlock(&h->lock);
+    }
+    return nullptr;
+}
+
+/* Hand a job to a new merge thread, after the last one has exited; a
+ * merge that cannot get a thread runs here */
+static void merge_start(fts_t* h, fts_merge_t* job) {
+    mutex_lock(&h->merger_lock);
+    if (h->merger_started) {
+        thread_join(h->merger);
+        h->merger_started = false;
+    }
+    h->job = job;
+    h->merger_started = thread_create(&h->merger, merge_main, h) == SPEEDSQL_OK;
+    if (!h->merger_started) merge_main(h);
+    mutex_unlock(&h->merger_lock);
+}
+
+static void merge_wait(fts_t* h) {
+    mutex_lock(&h->merger_lock);
+    if (h->merger_started) {
+        thread_join(h->merger);
+        h->merger_started = false;
+    }
+    mutex_unlock(&h->merger_lock);
+}
+
+/* Every segment into one, on this thread; caller holds the write lock */
+static int merge_all(fts_t* h) {
+    if (h->meta.segment_count < 2) return SPEEDSQL_OK;
+
+    fts_merge_t* job = merge_job(h, 0, h->meta.segment_count);
+    if (!job) return SPEEDSQL_NOMEM;
+
+    fts_seg_t merged;
+    int rc = merge_build(h, job, &merged);
+    if (rc == SPEEDSQL_OK) {
+        rc = merge_install(h, job, &merged);
+        if (rc != SPEEDSQL_OK) {
+            size_t per = per_page(h);
+            pages_free(h, merged.pages, (size_t)((merged.ref.bytes + per - 1) / per));
+            seg_release(&merged);
+        }
+    }
+    merge_free(job);
+    return rc;
+}
+
+/* ============================================================================
+ * Queries
+ * ============================================================================ */
+
+#define FTS_Q_PHRASE 0           /* One term, or several at consecutive positions */
+#define FTS_Q_AND    1
+#define FTS_Q_OR     2
+
+typedef struct fts_query fts_query_t;
+
+struct fts_query {
+    uint8_t type;
+    fts_doc_t terms;             /* PHRASE: tokens in position order */
+    double* idf;                 /* PHRASE, once weighed: per term */
+    fts_query_t** kids;          /* AND, OR */
+    uint32_t kid_count;
+};
+
+static void query_free(fts_query_t* q) {
+    if (!q) return;
+    for (uint32_t i = 0; i < q->kid_count; i++) query_free(q->kids[i]);
+    sdb_free(q->kids);
+    sdb_free(q->idf);
+    doc_free(&q->terms);
+    sdb_free(q);
+}
+
+typedef struct {
+    speedsql_tokenizer* tok;
+    const char* text;
+    size_t pos;
+    size_t len;
+    int rc;
+} fts_qparser_t;
+
+static inline bool query_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool query_delim(char c) {
+    return query_space(c) || c == '(' || c == ')' || c == '"';
+}
+
+static void query_skip(fts_qparser_t* qp) {
+    while (qp->pos < qp->len && query_space(qp->text[qp->pos])) qp->pos++;
+}
+
+/* The bare word at the cursor is exactly op */
+static bool query_operator(fts_qparser_t* qp, const char* op) {
+    query_skip(qp);
+    size_t n = strlen(op);
+    if (qp->len - qp->pos < n || memcmp(qp->text + qp->pos, op, n) != 0) return false;
+    return qp->pos + n == qp->len || query_delim(qp->text[qp->pos + n]);
+}
+
+static int position_compare(const void* a, const void* b) {
+    uint32_t x = ((const fts_token_t*)a)->position;
+    uint32_t y = ((const fts_token_t*)b)->position;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* A phrase of the text's tokens; null when it has none */
+static fts_query_t* query_phrase(fts_qparser_t* qp, const char* text, size_t len) {
+    fts_query_t* q = (fts_query_t*)sdb_calloc(1, sizeof(fts_query_t));
+    if (!q) {
+        qp->rc = SPEEDSQL_NOMEM;
+        return nullptr;
+    }
+    q->type = FTS_Q_PHRASE;
+    int rc = doc_tokenize(qp->tok, text, len, &q->terms);
+    if (rc != SPEEDSQL_OK || q->terms.count == 0) {
+        if (rc != SPEEDSQL_OK) qp->rc = rc;
+        query_free(q);
+        return nullptr;
+    }
+    qsort(q->terms.tokens, q->terms.count, sizeof(fts_token_t), position_compare);
+    return q;
+}
+
+static fts_query_t* query_group(fts_qparser_t* qp, uint8_t type, fts_query_t** kids,
+                                uint32_t count) {
+    if (count == 0) {
+        sdb_free(kids);
+        return nullptr;
+    }
+    if (count == 1) {
+        fts_query_t* only = kids[0];
+        sdb_free(kids);
+        return only;
+    }
+    fts_query_t* q = (fts_query_t*)sdb_calloc(1, sizeof(fts_query_t));
+    if (!q) {
+        for (uint32_t i = 0; i < count; i++) query_free(kids[i]);
+        sdb_free(kids);
+        qp->rc = SPEEDSQL_NOMEM;
+        return nullptr;
+    }
+    q->type = type;
+    q->kids = kids;
+    q->kid_count = count;
+    return q;
+}
+
+static bool query_push(fts_qparser_t* qp, fts_query_t*** kids, uint32_t* count, fts_query_t* q) {
+    if (!q) return true;
+    fts_query_t** grown = (fts_query_t**)sdb_realloc(*kids, (*count + 1) * sizeof(fts_query_t*));
+    if (!grown) {
+        query_free(q);
+        qp->rc = SPEEDSQL_NOMEM;
+        return false;
+    }
+    *kids = grown;
+    (*kids)[(*count)++] = q;
+    return true;
+}
+
+static fts_query_t* query_or(fts_qparser_t* qp);
+
+static fts_query_t* query_primary(fts_qparser_t* qp) {
+    query_skip(qp);
+    char c = qp->text[qp->pos];
+
+    if (c == '(') {
+        qp->pos++;
+        fts_query_t* q = query_or(qp);
+        query_skip(qp);
+        if (qp->pos < qp->len && qp->text[qp->pos] == ')') qp->pos++;
+        return q;
+    }
+    if (c == '"') {
+        size_t start = ++qp->pos;
+        while (qp->pos < qp->len && qp->text[qp->pos] != '"') qp->pos++;
+        size_t end = qp->pos;
+        if (qp->pos < qp->len) qp->pos++;
+        return query_phrase(qp, qp->text + start, end - start);
+    }
+
+    /* A bare word; one the tokenizer splits is a phrase */
+    size_t start = qp->pos;
+    while (qp->pos < qp->len && !query_delim(qp->text[qp->pos])) qp->pos++;
+    return query_phrase(qp, qp->text + start, qp->pos - start);
+}
+
+static fts_query_t* query_and(fts_qparser_t* qp) {
+    fts_query_t** kids = nullptr;
+    uint32_t count = 0;
+
+    while (qp->rc == SPEEDSQL_OK) {
+        query_skip(qp);
+        if (qp->pos >= qp->len || qp->text[qp->pos] == ')' || query_operator(qp, "OR")) break;
+        if (query_operator(qp, "AND")) {
+            qp->pos += 3;
+            continue;
+        }
+        if (!query_push(qp, &kids, &count, query_primary(qp))) break;
+    }
+    return query_group(qp, FTS_Q_AND, kids, count);
+}
+
+static fts_query_t* query_or(fts_qparser_t* qp) {
+    fts_query_t** kids = nullptr;
+    uint32_t count = 0;
+
+    query_push(qp, &kids, &count, query_and(qp));
+    while (qp->rc == SPEEDSQL_OK && query_operator(qp, "OR")) {
+        qp->pos += 2;
+        if (!query_push(qp, &kids, &count, query_and(qp))) break;
+    }
+    return query_group(qp, FTS_Q_OR, kids, count);
+}
+
+/* Null with SPEEDSQL_OK for a query without terms */
+static int query_parse(speedsql_tokenizer* tok, const char* text, fts_query_t** out) {
+    fts_qparser_t qp;
+    qp.tok = tok;
+    qp.text = text;
+    qp.pos = 0;
+    qp.len = strlen(text);
+    qp.rc = SPEEDSQL_OK;
+
+    /* Stray closing parentheses are skipped */
+    fts_query_t** kids = nullptr;
+    uint32_t count = 0;
+    while (qp.rc == SPEEDSQL_OK) {
+        query_push(&qp, &kids, &count, query_or(&qp));
+        query_skip(&qp);
+        if (qp.pos >= qp.len) break;
+        qp.pos++;
+    }
+    *out = query_group(&qp, FTS_Q_AND, kids, count);
+    if (qp.rc != SPEEDSQL_OK) {
+        query_free(*out);
+        *out = nullptr;
+    }
+    return qp.rc;
+}
+
+/* ============================================================================
+ * Query Evaluation
+ * ============================================================================ */
+
+typedef struct fts_iter fts_iter_t;
+
+struct fts_iter {
+    uint8_t type;
+    uint64_t doc;                /* Current match, FTS_END when exhausted */
+    bool positioned;
+    fts_cursor_t* cursors;       /* PHRASE: one per term */
+    uint32_t cursor_count;
+    fts_iter_t** kids;           /* AND, OR */
+    fts_iter_t** order;          /* OR, ranked: kids by current document */
+    uint32_t kid_count;
+    double max_bound;            /* Ranked: no score of this part is higher */
+    const double* theta;         /* Ranked root: the score to beat, < 0 until k are held */
+    int* rc;                     /* Shared by the whole tree */
+};
+
+static void iter_free(fts_iter_t* it) {
+    if (!it) return;
+    for (uint32_t i = 0; i < it->cursor_count; i++) cursor_close(&it->cursors[i]);
+    for (uint32_t i = 0; i < it->kid_count; i++) iter_free(it->kids[i]);
+    sdb_free(it->cursors);
+    sdb_free(it->kids);
+    sdb_free(it->order);
+    sdb_free(it);
+}
+
+/* An iterator over one segment; a phrase with a term the segment lacks
+ * is exhausted from the start. A weighed query with avg_len > 0 builds
+ * one that can bound and score its matches. */
+static fts_iter_t* iter_build(fts_t* h, const fts_seg_t* seg, const fts_query_t* q, int* rc,
+                              double avg_len) {
+    fts_iter_t* it = (fts_iter_t*)sdb_calloc(1, sizeof(fts_iter_t));
+    if (!it) {
+        *rc = SPEEDSQL_NOMEM;
+        return nullptr;
+    }
+    it->type = q->type;
+    it->rc = rc;
+
+    if (q->type == FTS_Q_PHRASE) {
+        it->cursors = (fts_cursor_t*)sdb_calloc(q->terms.count, sizeof(fts_cursor_t));
+        if (!it->cursors) {
+            *rc = SPEEDSQL_NOMEM;
+            return it;
+        }
+        for (size_t i = 0; i < q->terms.count && *rc == SPEEDSQL_OK; i++) {
+            fts_entry_t e;
+            int found = seg_lookup(h, seg, q->terms.tokens[i].term, q->terms.tokens[i].len, &e);
+            if (found == SPEEDSQL_NOTFOUND) {
+                it->positioned = true;
+                it->doc = FTS_END;
+                break;
+            }
+            if (found != SPEEDSQL_OK) {
+                *rc = found;
+                break;
+            }
+            it->cursor_count++;
+            *rc = cursor_open(&it->cursors[i], h, seg, &e);
+            if (*rc == SPEEDSQL_OK && avg_len > 0) {
+                cursor_weigh(&it->cursors[i], q->idf[i], avg_len);
+                *rc = it->cursors[i].rc;
+                it->max_bound += it->cursors[i].max_bound;
+            }
+        }
+        return it;
+    }
+
+    it->kids = (fts_iter_t**)sdb_calloc(q->kid_count, sizeof(fts_iter_t*));
+    it->order = (fts_iter_t**)sdb_calloc(q->kid_count, sizeof(fts_iter_t*));
+    if (!it->kids || !it->order) {
+        *rc = SPEEDSQL_NOMEM;
+        return it;
+    }
+    for (uint32_t i = 0; i < q->kid_count && *rc == SPEEDSQL_OK; i++) {
+        fts_iter_t* kid = iter_build(h, seg, q->kids[i], rc, avg_len);
+        it->kids[it->kid_count++] = kid;
+        if (kid) it->max_bound += kid->max_bound;
+    }
+    return it;
+}
+
+static bool positions_contain(const uint32_t* positions, uint32_t count, uint64_t want) {
+    uint32_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (positions[mid] < want) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && positions[lo] == want;
+}
+
+/* Every cursor is on the same document: do the terms follow each other? */
+static bool phrase_at(const fts_iter_t* it) {
+    if (it->cursor_count < 2) return true;
+
+    uint32_t first_count;
+    const uint32_t* first = cursor_positions(&it->cursors[0], &first_count);
+    for (uint32_t p = 0; p < first_count; p++) {
+        bool all = true;
+        for (uint32_t i = 1; i < it->cursor_count && all; i++) {
+            uint32_t count;
+            const uint32_t* positions = cursor_positions(&it->cursors[i], &count);
+            all = positions_contain(positions, count, (uint64_t)first[p] + i);
+        }
+        if (all) return true;
+    }
+    return false;
+}
+
+static uint64_t iter_seek(fts_iter_t* it, uint64_t target);
+
+/* Leapfrog: move each part to the largest document any part is on until
+ * they agree */
+static uint64_t iter_leapfrog(fts_iter_t* it, uint64_t target) {
+    uint32_t parts = it->type == FTS_Q_PHRASE ? it->cursor_count : it->kid_count;
+
+    while (*it->rc == SPEEDSQL_OK) {
+        uint64_t m = target;
+        bool agree = false;
+        while (!agree) {
+            agree = true;
+            for (uint32_t i = 0; i < parts; i++) {
+                uint64_t d;
+                if (it->type == FTS_Q_PHRASE) {
+                    cursor_seek(&it->cursors[i], m);
+                    if (it->cursors[i].rc != SPEEDSQL_OK) *it->rc = it->cursors[i].rc;
+                    d = it->cursors[i].doc;
+                } else {
+                    d = iter_seek(it->kids[i], m);
+                }
+                if (d == FTS_END || *it->rc != SPEEDSQL_OK) return FTS_END;
+                if (d > m) {
+                    m = d;
+                    agree = false;
+                }
+            }
+        }
+        if (it->type != FTS_Q_PHRASE || phrase_at(it)) return m;
+        if (m == FTS_END - 1) return FTS_END;
+        target = m + 1;
+    }
+    return FTS_END;
+}
+
+static uint64_t iter_wand(fts_iter_t* it, uint64_t target);
+
+/* First match at or after target */
+static uint64_t iter_seek(fts_iter_t* it, uint64_t target) {
+    if (it->positioned && it->doc >= target) return it->doc;
+    it->positioned = true;
+
+    if (it->type == FTS_Q_OR && it->theta && *it->theta >= 0) {
+        it->doc = iter_wand(it, target);
+    } else if (it->type == FTS_Q_OR) {
+        uint64_t low = FTS_END;
+        for (uint32_t i = 0; i < it->kid_count; i++) {
+            uint64_t d = iter_seek(it->kids[i], target);
+            if (d < low) low = d;
+        }
+        it->doc = low;
+    } else {
+        it->doc = iter_leapfrog(it, target);
+    }
+    return it->doc;
+}
+
+/* Score bound for the part's matches from target up to *end; *end is
+ * FTS_END once it has none left */
+static double iter_bound(const fts_iter_t* it, uint64_t target, uint64_t* end) {
+    *end = FTS_END;
+    if (it->positioned && it->doc == FTS_END) return 0;
+
+    double bound = 0;
+    bool any = false;
+    uint32_t parts = it->type == FTS_Q_PHRASE ? it->cursor_count : it->kid_count;
+    for (uint32_t i = 0; i < parts; i++) {
+        uint64_t e;
+        double b = it->type == FTS_Q_PHRASE ? cursor_bound(&it->cursors[i], target, &e) :
+                                              iter_bound(it->kids[i], target, &e);
+        if (e == FTS_END) {
+            /* One part done ends a phrase or an AND */
+            if (it->type != FTS_Q_OR) {
+                *end = FTS_END;
+                return 0;
+            }
+            continue;
+        }
+        bound += b;
+        any = true;
+        if (e < *end) *end = e;
+    }
+    return any ? bound : 0;
+}
+
+/* BM25 of the current match: the sum over the terms it matched on */
+static double iter_score(const fts_iter_t* it) {
+    double score = 0;
+    if (it->type == FTS_Q_PHRASE) {
+        for (uint32_t i = 0; i < it->cursor_count; i++) score += cursor_score(&it->cursors[i]);
+        return score;
+    }
+    for (uint32_t i = 0; i < it->kid_count; i++) {
+        if (it->type == FTS_Q_AND || it->kids[i]->doc == it->doc) {
+            score += iter_score(it->kids[i]);
+        }
+    }
+    return score;
+}
+
+/* Block-max WAND over the parts of an OR: with the parts ordered by
+ * document, the pivot is the first document the parts up to it could
+ * score above theta on. Their block bounds there are checked before
+ * anything is decoded; a pivot that fails moves past the shortest of
+ * those blocks. */
+static uint64_t iter_wand(fts_iter_t* it, uint64_t target) {
+    double theta = *it->theta;
+    uint32_t n = it->kid_count;
+    fts_iter_t** order = it->order;
+
+    while (*it->rc == SPEEDSQL_OK) {
+        for (uint32_t i = 0; i < n; i++) {
+            iter_seek(it->kids[i], target);
+            fts_iter_t* kid = it->kids[i];
+            uint32_t j = i;
+            while (j > 0 && order[j - 1]->doc > kid->doc) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = kid;
+        }
+        if (*it->rc != SPEEDSQL_OK) break;
+
+        double reach = 0;
+        uint32_t pivot = n;
+        for (uint32_t i = 0; i < n && order[i]->doc != FTS_END; i++) {
+            reach += order[i]->max_bound;
+            if (reach >= theta) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == n) return FTS_END;
+
+        uint64_t pivot_doc = order[pivot]->doc;
+        while (pivot + 1 < n && order[pivot + 1]->doc == pivot_doc) pivot++;
+
+        double bound = 0;
+        uint64_t end = FTS_END;
+        for (uint32_t i = 0; i <= pivot; i++) {
+            uint64_t e;
+            bound += iter_bound(order[i], pivot_doc, &e);
+            if (e < end) end = e;
+        }
+        if (bound >= theta) {
+            if (order[0]->doc == pivot_doc) return pivot_doc;
+            target = pivot_doc;
+            continue;
+        }
+
+        /* Nothing up to end beats theta, nor before the next part starts */
+        uint64_t next = end >= FTS_END - 1 ? FTS_END : end + 1;
+        if (pivot + 1 < n && order[pivot + 1]->doc < next) next = order[pivot + 1]->doc;
+        if (next == FTS_END) return FTS_END;
+        target = next;
+    }
+    return FTS_END;
+}
+
+typedef struct {
+    int64_t* rowids;
+    size_t count;
+    size_t cap;
+} fts_hits_t;
+
+static int hits_add(fts_hits_t* hits, int64_t rowid) {
+    if (hits->count == hits->cap) {
+        size_t cap = hits->cap ? hits->cap * 2 : 64;
+        int64_t* grown = (int64_t*)sdb_realloc(hits->rowids, cap * sizeof(int64_t));
+        if (!grown) return SPEEDSQL_NOMEM;
+        hits->rowids = grown;
+        hits->cap = cap;
+    }
+    hits->rowids[hits->count++] = rowid;
+    return SPEEDSQL_OK;
+}
+
+/* Live matches of one segment */
+static int seg_search(fts_t* h, const fts_seg_t* seg, const fts_query_t* q,
+                      const fts_docmap_t* live, fts_hits_t* hits) {
+    int rc = SPEEDSQL_OK;
+    fts_iter_t* it = iter_build(h, seg, q, &rc, 0);
+
+    uint64_t doc = rc == SPEEDSQL_OK ? iter_seek(it, 0) : FTS_END;
+    while (doc != FTS_END && rc == SPEEDSQL_OK) {
+        if (doc_live(live, seg, doc)) rc = hits_add(hits, doc_rowid(doc));
+        if (doc == FTS_END - 1) break;
+        doc = iter_seek(it, doc + 1);
+    }
+
+    iter_free(it);
+    return rc;
+}
+
+/* The k best matches as a heap with the worst on top */
+typedef struct {
+    int64_t rowid;
+    double score;
+} fts_ranked_t;
+
+typedef struct {
+    fts_ranked_t* items;
+    size_t count;
+    size_t k;
+    double theta;                /* The worst score held once k are, else -1 */
+} fts_top_t;
+
+/* Lower score ranks lower; ties go to the smaller rowid */
+static inline bool ranked_below(const fts_ranked_t* a, const fts_ranked_t* b) {
+    return a->score < b->score || (a->score == b->score && a->rowid > b->rowid);
+}
+
+static void top_add(fts_top_t* top, int64_t rowid, double score) {
+    fts_ranked_t item = {rowid, score};
+    fts_ranked_t* heap = top->items;
+    size_t i;
+
+    if (top->count < top->k) {
+        i = top->count++;
+        while (i > 0 && ranked_below(&item, &heap[(i - 1) / 2])) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = item;
+    } else {
+        if (!ranked_below(&heap[0], &item)) return;
+        i = 0;
+        for (;;) {
+            size_t child = 2 * i + 1;
+            if (child >= top->count) break;
+            if (child + 1 < top->count && ranked_below(&heap[child + 1], &heap[child])) child++;
+            if (!ranked_below(&heap[child], &item)) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = item;
+    }
+    if (top->count == top->k) top->theta = heap[0].score;
+}
+
+/* Best first */
+static int ranked_compare(const void* a, const void* b) {
+    const fts_ranked_t* x = (const fts_ranked_t*)a;
+    const fts_ranked_t* y = (const fts_ranked_t*)b;
+    return ranked_below(y, x) ? -1 : (ranked_below(x, y) ? 1 : 0);
+}
+
+/* Live matches of one segment into top. Once it is full, a stretch
+ * whose bound falls short of the worst held is skipped. */
+static int seg_rank(fts_t* h, const fts_seg_t* seg, const fts_query_t* q,
+                    const fts_docmap_t* live, double avg_len, fts_top_t* top) {
+    int rc = SPEEDSQL_OK;
+    fts_iter_t* it = iter_build(h, seg, q, &rc, avg_len);
+    if (rc == SPEEDSQL_OK) it->theta = &top->theta;
+
+    uint64_t target = 0;
+    while (rc == SPEEDSQL_OK) {
+        uint64_t end = FTS_END;
+        if (top->theta >= 0) {
+            double bound = iter_bound(it, target, &end);
+            if (bound < top->theta) {
+                if (end >= FTS_END - 1) break;
+                target = end + 1;
+                continue;
+            }
+        }
+
+        uint64_t doc = iter_seek(it, target);
+        if (doc == FTS_END) break;
+        if (doc > end) {
+            target = doc;        /* Bound the stretch it landed in first */
+            continue;
+        }
+        if (doc_live(live, seg, doc)) top_add(top, doc_rowid(doc), iter_score(it));
+        if (doc == FTS_END - 1) break;
+        target = doc + 1;
+    }
+
+    iter_free(it);
+    return rc;
+}
+
+/* The pending log as an in-memory segment, rebuilt after writes */
+static int pending_segment(fts_t* h) {
+    if (h->pending_valid) return SPEEDSQL_OK;
+
+    fts_postings_t p = {};
+    int rc = log_postings(h, &p);
+
+    fts_out_t out;
+    out_init(&out, nullptr);
+    if (rc == SPEEDSQL_OK) rc = postings_write(&p, &out);
+    postings_free(&p);
+
+    buf_free(&h->pending_stream);
+    memset(&h->pending, 0, sizeof(h->pending));
+    if (rc == SPEEDSQL_OK) {
+        h->pending_stream = out.buf;
+        h->pending.mem = h->pending_stream.data;
+        h->pending.ref.bytes = out.total;
+        h->pending.ref.min_seq = h->meta.log_min_seq;
+        h->pending.ref.max_seq = h->meta.next_seq - 1;
+        rc = seg_load_footer(h, &h->pending);
+        h->pending_valid = rc == SPEEDSQL_OK;
+    } else {
+        buf_free(&out.buf);
+    }
+    return rc;
+}
+
+/* Documents a term is in over every segment searched */
+static int term_df(fts_t* h, const fts_token_t* t, bool pending, uint64_t* df) {
+    fts_entry_t e;
+    *df = 0;
+    for (uint32_t i = 0; i <= h->meta.segment_count; i++) {
+        const fts_seg_t* seg = i < h->meta.segment_count ? &h->segs[i] : &h->pending;
+        if (i == h->meta.segment_count && !pending) break;
+        int rc = seg_lookup(h, seg, t->term, t->len, &e);
+        if (rc == SPEEDSQL_OK) {
+            *df += e.df;
+        } else if (rc != SPEEDSQL_NOTFOUND) {
+            return rc;
+        }
+    }
+    return SPEEDSQL_OK;
+}
+
+/* IDF of every phrase term, against the live document count */
+static int query_weigh(fts_t* h, fts_query_t* q, bool pending) {
+    for (uint32_t i = 0; i < q->kid_count; i++) {
+        int rc = query_weigh(h, q->kids[i], pending);
+        if (rc != SPEEDSQL_OK) return rc;
+    }
+    if (q->type != FTS_Q_PHRASE) return SPEEDSQL_OK;
+
+    q->idf = (double*)sdb_malloc(q->terms.count * sizeof(double));
+    if (!q->idf) return SPEEDSQL_NOMEM;
+    for (size_t i = 0; i < q->terms.count; i++) {
+        uint64_t df;
+        int rc = term_df(h, &q->terms.tokens[i], pending, &df);
+        if (rc != SPEEDSQL_OK) return rc;
+        q->idf[i] = bm25_idf(h->docs.count, df);
+    }
+    return SPEEDSQL_OK;
+}
+
+static int rowid_compare(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* ============================================================================
+ * Public Interface
+ * ============================================================================ */
+
+int fts_create(buffer_pool_t* pool, file_t* file, const char* tokenizer, page_id_t* meta_page) {
+    if (!pool || !meta_page) return SPEEDSQL_MISUSE;
+    speedsql_tokenizer* tok = speedsql_tokenizer_find(tokenizer);
+    if (!tok) return SPEEDSQL_NOTFOUND;
+    if (strlen(tok->name) >= FTS_TOKENIZER_NAME) return SPEEDSQL_RANGE;
+    if (pool->usable_size < FTS_PAGE_DATA + sizeof(fts_meta_t)) return SPEEDSQL_RANGE;
+
+    btree_t rowids;
+    int rc = btree_create(&rowids, pool, file, value_compare);
+    if (rc != SPEEDSQL_OK) return rc;
+    page_id_t rowid_root = rowids.root_page;
+    btree_close(&rowids);
+
+    page_id_t page_id;
+    buffer_page_t* page = buffer_pool_new_page(pool, file, &page_id);
+    if (!page) return SPEEDSQL_NOMEM;
+    page_init(pool, page, FTS_PAGE_META);
+    ((page_header_t*)page->data)->free_start = FTS_PAGE_DATA + sizeof(fts_meta_t);
+
+    fts_meta_t* meta = (fts_meta_t*)sdb_calloc(1, sizeof(fts_meta_t));
+    if (!meta) {
+        buffer_pool_unpin(pool, page, true);
+        return SPEEDSQL_NOMEM;
+    }
+    meta->magic = FTS_MAGIC;
+    strcpy(meta->tokenizer, tok->name);
+    meta->next_seq = 1;
+    meta->rowid_root = rowid_root;
+    meta->log_head = INVALID_PAGE_ID;
+    meta->log_tail = INVALID_PAGE_ID;
+    meta->free_head = INVALID_PAGE_ID;
+    memcpy(page->data + FTS_PAGE_DATA, meta, sizeof(*meta));
+    sdb_free(meta);
+
+    buffer_pool_unpin(pool, page, true);
+    *meta_page = page_id;
+    return SPEEDSQL_OK;
+}
+
+/* Live versions come back from the B+tree */
+static int docs_load(fts_t* h) {
+    btree_t rowids;
+    int rc = btree_open(&rowids, h->pool, h->file, h->meta.rowid_root, value_compare);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    btree_cursor_t cursor;
+    btree_cursor_init(&cursor, &rowids);
+    btree_cursor_first(&cursor);
+    while (rc == SPEEDSQL_OK && cursor.valid && !cursor.at_end) {
+        value_t key, value;
+        value_init_null(&key);
+        value_init_null(&value);
+        btree_cursor_key(&cursor, &key);
+        btree_cursor_value(&cursor, &value);
+        uint64_t packed = (uint64_t)btree_key_int(&value);
+        uint64_t seq = packed >> FTS_LEN_BITS;
+        uint32_t len = (uint32_t)(packed & FTS_MAX_DOC_LEN);
+        rc = seq > 0 ? docmap_put(&h->docs, btree_key_int(&key), seq, len) : SPEEDSQL_CORRUPT;
+        h->total_len += len;
+        value_free(&key);
+        value_free(&value);
+        btree_cursor_next(&cursor);
+    }
+    btree_cursor_close(&cursor);
+    btree_close(&rowids);
+    return rc;
+}
+
+static void fts_free(fts_t* h) {
+    for (uint32_t i = 0; i < FTS_MAX_SEGMENTS; i++) seg_release(&h->segs[i]);
+    buf_free(&h->log);
+    buf_free(&h->pending_stream);
+    docmap_free(&h->docs);
+    sdb_free(h);
+}
+
+int fts_open(fts_t** out, buffer_pool_t* pool, file_t* file, page_id_t meta_page) {
+    if (!out || !pool) return SPEEDSQL_MISUSE;
+    *out = nullptr;
+
+    fts_t* h = (fts_t*)sdb_calloc(1, sizeof(fts_t));
+    if (!h) return SPEEDSQL_NOMEM;
+    h->pool = pool;
+    h->file = file;
+    h->meta_page = meta_page;
+
+    int rc = SPEEDSQL_OK;
+    buffer_page_t* page = buffer_pool_get(pool, file, meta_page);
+    if (page) {
+        memcpy(&h->meta, page->data + FTS_PAGE_DATA, sizeof(h->meta));
+        buffer_pool_unpin(pool, page, false);
+    } else {
+        rc = SPEEDSQL_IOERR;
+    }
+    if (rc == SPEEDSQL_OK && (h->meta.magic != FTS_MAGIC ||
+                              h->meta.segment_count > FTS_MAX_SEGMENTS ||
+                              h->meta.tokenizer[FTS_TOKENIZER_NAME - 1] != '\0')) {
+        rc = SPEEDSQL_CORRUPT;
+    }
+
+    /* A custom tokenizer has to be registered again before reopening */
+    if (rc == SPEEDSQL_OK) {
+        h->tokenizer = speedsql_tokenizer_find(h->meta.tokenizer);
+        if (!h->tokenizer) rc = SPEEDSQL_NOTFOUND;
+    }
+
+    size_t per = pool->usable_size - FTS_PAGE_DATA;
+    for (uint32_t i = 0; i < h->meta.segment_count && rc == SPEEDSQL_OK; i++) {
+        fts_seg_t* seg = &h->segs[i];
+        seg->ref = h->meta.segments[i];
+        size_t pages = (size_t)((seg->ref.bytes + per - 1) / per);
+        seg->pages = (page_id_t*)sdb_malloc((pages > 0 ? pages : 1) * sizeof(page_id_t));
+        rc = seg->pages ? chain_pages(h, seg->ref.first, FTS_PAGE_SEGMENT, seg->pages, pages) :
+                          SPEEDSQL_NOMEM;
+        if (rc == SPEEDSQL_OK) rc = seg_load_footer(h, seg);
+    }
+    if (rc == SPEEDSQL_OK) rc = log_read(h);
+    if (rc == SPEEDSQL_OK) rc = docs_load(h);
+
+    if (rc != SPEEDSQL_OK) {
+        fts_free(h);
+        return rc;
+    }
+
+    rwlock_init(&h->lock);
+    mutex_init(&h->alloc_lock);
+    mutex_init(&h->pending_lock);
+    mutex_init(&h->merger_lock);
+    *out = h;
+    return SPEEDSQL_OK;
+}
+
+void fts_close(fts_t* h) {
+    if (!h) return;
+
+    rwlock_wrlock(&h->lock);
+    h->closing = true;
+    rwlock_unlock(&h->lock);
+    merge_wait(h);
+
+    rwlock_destroy(&h->lock);
+    mutex_destroy(&h->alloc_lock);
+    mutex_destroy(&h->pending_lock);
+    mutex_destroy(&h->merger_lock);
+    fts_free(h);
+}
+
+speedsql_tokenizer* fts_tokenizer(fts_t* h) {
+    return h ? h->tokenizer : nullptr;
+}
+
+int fts_insert(fts_t* h, int64_t rowid, const char* text, size_t len) {
+    if (!h || (!text && len > 0) || rowid == INT64_MAX) return SPEEDSQL_MISUSE;
+
+    /* Tokenized outside the lock */
+    fts_doc_t d;
+    int rc = doc_tokenize(h->tokenizer, text, len, &d);
+    if (rc != SPEEDSQL_OK) return rc;
+    uint32_t doc_len = doc_length(&d);
+    fts_buf_t body = {};
+    log_body(&body, &d);
+    doc_free(&d);
+    if (body.failed) {
+        buf_free(&body);
+        return SPEEDSQL_NOMEM;
+    }
+
+    rwlock_wrlock(&h->lock);
+    if (h->meta.next_seq >= FTS_MAX_SEQ) {
+        rwlock_unlock(&h->lock);
+        buf_free(&body);
+        return SPEEDSQL_FULL;
+    }
+    uint64_t seq = h->meta.next_seq++;
+
+    btree_t rowids;
+    btree_open(&rowids, h->pool, h->file, h->meta.rowid_root, value_compare);
+    value_t key, value;
+    btree_int_key(&key, rowid);
+    btree_int_key(&value, (int64_t)(seq << FTS_LEN_BITS | doc_len));
+    btree_delete(&rowids, &key);
+    rc = btree_insert(&rowids, &key, &value);
+    value_free(&key);
+    value_free(&value);
+    h->meta.rowid_root = rowids.root_page;
+    btree_close(&rowids);
+
+    if (rc == SPEEDSQL_OK) {
+        if (docmap_get(&h->docs, rowid) != 0) h->total_len -= docmap_len(&h->docs, rowid);
+        rc = docmap_put(&h->docs, rowid, seq, doc_len);
+        if (rc == SPEEDSQL_OK) h->total_len += doc_len;
+    }
+
+    fts_buf_t record = {};
+    buf_varint(&record, doc_key(rowid));
+    buf_varint(&record, seq);
+    buf_put(&record, body.data, body.len);
+    if (rc == SPEEDSQL_OK) rc = record.failed ? SPEEDSQL_NOMEM : SPEEDSQL_OK;
+    if (rc == SPEEDSQL_OK) {
+        if (h->meta.log_bytes == 0) h->meta.log_min_seq = seq;
+        rc = log_append(h, record.data, record.len);
+    }
+    buf_free(&record);
+    buf_free(&body);
+    h->pending_valid = false;
+
+    /* A full segment list waits for the running merge */
+    if (rc == SPEEDSQL_OK && h->meta.log_bytes >= FTS_FLUSH_BYTES &&
+        h->meta.segment_count < FTS_MAX_SEGMENTS) {
+        rc = log_flush(h);
+    }
+
+    fts_merge_t* job = nullptr;
+    if (rc == SPEEDSQL_OK && !h->merging && !h->closing) {
+        job = next_merge(h);
+        h->merging = job != nullptr;
+    }
+
+    int meta_rc = meta_write(h);
+    rwlock_unlock(&h->lock);
+
+    if (job) merge_start(h, job);
+    return rc != SPEEDSQL_OK ? rc : meta_rc;
+}
+
+int fts_delete(fts_t* h, int64_t rowid) {
+    if (!h) return SPEEDSQL_MISUSE;
+
+    rwlock_wrlock(&h->lock);
+    if (docmap_get(&h->docs, rowid) == 0) {
+        rwlock_unlock(&h->lock);
+        return SPEEDSQL_NOTFOUND;
+    }
+
+    btree_t rowids;
+    btree_open(&rowids, h->pool, h->file, h->meta.rowid_root, value_compare);
+    value_t key;
+    btree_int_key(&key, rowid);
+    int rc = btree_delete(&rowids, &key);
+    value_free(&key);
+    h->meta.rowid_root = rowids.root_page;
+    btree_close(&rowids);
+
+    h->total_len -= docmap_len(&h->docs, rowid);
+    docmap_remove(&h->docs, rowid);
+    h->pending_valid = false;
+
+    int meta_rc = meta_write(h);
+    rwlock_unlock(&h->lock);
+    return rc != SPEEDSQL_OK ? rc : meta_rc;
+}
+
+int fts_search(fts_t* h, const char* query, int64_t** rowids, size_t* count) {
+    if (!h || !query || !rowids || !count) return SPEEDSQL_MISUSE;
+    *rowids = nullptr;
+    *count = 0;
+
+    fts_query_t* q = nullptr;
+    int rc = query_parse(h->tokenizer, query, &q);
+    if (rc != SPEEDSQL_OK || !q) return rc;
+
+    fts_hits_t hits = {};
+    rwlock_rdlock(&h->lock);
+    for (uint32_t i = 0; i < h->meta.segment_count && rc == SPEEDSQL_OK; i++) {
+        rc = seg_search(h, &h->segs[i], q, &h->docs, &hits);
+    }
+    if (rc == SPEEDSQL_OK && h->meta.log_bytes > 0) {
+        mutex_lock(&h->pending_lock);
+        rc = pending_segment(h);
+        if (rc == SPEEDSQL_OK) rc = seg_search(h, &h->pending, q, &h->docs, &hits);
+        mutex_unlock(&h->pending_lock);
+    }
+    rwlock_unlock(&h->lock);
+    query_free(q);
+
+    if (rc != SPEEDSQL_OK) {
+        sdb_free(hits.rowids);
+        return rc;
+    }
+    qsort(hits.rowids, hits.count, sizeof(int64_t), rowid_compare);
+    *rowids = hits.rowids;
+    *count = hits.count;
+    return SPEEDSQL_OK;
+}
+
+int fts_rank(fts_t* h, const char* query, size_t k, int64_t** rowids, float** scores,
+             size_t* count) {
+    if (!h || !query || !rowids || !scores || !count) return SPEEDSQL_MISUSE;
+    *rowids = nullptr;
+    *scores = nullptr;
+    *count = 0;
+
+    fts_query_t* q = nullptr;
+    int rc = query_parse(h->tokenizer, query, &q);
+    if (rc != SPEEDSQL_OK || !q) return rc;
+
+    fts_top_t top;
+    memset(&top, 0, sizeof(top));
+    top.theta = -1;
+
+    rwlock_rdlock(&h->lock);
+    top.k = k == 0 || k > h->docs.count ? h->docs.count : k;
+    if (top.k > 0) {
+        top.items = (fts_ranked_t*)sdb_malloc(top.k * sizeof(fts_ranked_t));
+        if (!top.items) rc = SPEEDSQL_NOMEM;
+    }
+
+    /* Only writers invalidate the pending segment, so once built it
+     * stays put while the read lock is held */
+    bool pending = h->meta.log_bytes > 0;
+    if (rc == SPEEDSQL_OK && top.k > 0 && pending) {
+        mutex_lock(&h->pending_lock);
+        rc = pending_segment(h);
+        mutex_unlock(&h->pending_lock);
+    }
+    if (rc == SPEEDSQL_OK && top.k > 0) {
+        double avg_len = (double)h->total_len / (double)h->docs.count;
+        if (avg_len < 1) avg_len = 1;
+        rc = query_weigh(h, q, pending);
+        for (uint32_t i = 0; i < h->meta.segment_count && rc == SPEEDSQL_OK; i++) {
+            rc = seg_rank(h, &h->segs[i], q, &h->docs, avg_len, &top);
+        }
+        if (rc == SPEEDSQL_OK && pending) {
+            rc = seg_rank(h, &h->pending, q, &h->docs, avg_len, &top);
+        }
+    }
+    rwlock_unlock(&h->lock);
+    query_free(q);
+
+    if (rc == SPEEDSQL_OK && top.count > 0) {
+        *rowids = (int64_t*)sdb_malloc(top.count * sizeof(int64_t));
+        *scores = (float*)sdb_malloc(top.count * sizeof(float));
+        if (!*rowids || !*scores) {
+            sdb_free(*rowids);
+            sdb_free(*scores);
+            *rowids = nullptr;
+            *scores = nullptr;
+            rc = SPEEDSQL_NOMEM;
+        }
+    }
+    if (rc == SPEEDSQL_OK) {
+        qsort(top.items, top.count, sizeof(fts_ranked_t), ranked_compare);
+        for (size_t i = 0; i < top.count; i++) {
+            (*rowids)[i] = top.items[i].rowid;
+            (*scores)[i] = (float)top.items[i].score;
+        }
+        *count = top.count;
+    }
+    sdb_free(top.items);
+    return rc;
+}
+
+int fts_optimize(fts_t* h) {
+    if (!h) return SPEEDSQL_MISUSE;
+
+    /* Let a background merge finish first */
+    rwlock_wrlock(&h->lock);
+    while (h->merging) {
+        rwlock_unlock(&h->lock);
+        merge_wait(h);
+        rwlock_wrlock(&h->lock);
+    }
+
+    int rc = SPEEDSQL_OK;
+    if (h->meta.segment_count >= FTS_MAX_SEGMENTS) rc = merge_all(h);
+    if (rc == SPEEDSQL_OK) rc = log_flush(h);
+    if (rc == SPEEDSQL_OK) rc = merge_all(h);
+
+    int meta_rc = meta_write(h);
+    rwlock_unlock(&h->lock);
+    return rc != SPEEDSQL_OK ? rc : meta_rc;
+}
+
+uint64_t fts_count(fts_t* h) {
+    if (!h) return 0;
+    rwlock_rdlock(&h->lock);
+    uint64_t count = h->docs.count;
+    rwlock_unlock(&h->lock);
+    return count;
+}
+
+uint32_t fts_segment_count(fts_t* h) {
+    if (!h) return 0;
+    rwlock_rdlock(&h->lock);
+    uint32_t count = h->meta.segment_count;
+    rwlock_unlock(&h->lock);
+    return count;
+}
+
+int fts_match_text(speedsql_tokenizer* tok, const char* text, size_t len,
+                   const char* query, bool* match) {
+    if (!tok || (!text && len > 0) || !query || !match) return SPEEDSQL_MISUSE;
+    *match = false;
+
+    fts_query_t* q = nullptr;
+    int rc = query_parse(tok, query, &q);
+    if (rc != SPEEDSQL_OK || !q) return rc;
+
+    /* The text as a one-document segment */
+    fts_doc_t d;
+    fts_postings_t p = {};
+    fts_out_t out;
+    out_init(&out, nullptr);
+    rc = doc_tokenize(tok, text, len, &d);
+    if (rc == SPEEDSQL_OK) {
+        postings_from_doc(&p, &d, 0);
+        rc = p.rc;
+        if (rc == SPEEDSQL_OK) rc = postings_write(&p, &out);
+        doc_free(&d);
+    }
+    postings_free(&p);
+
+    fts_seg_t seg;
+    memset(&seg, 0, sizeof(seg));
+    if (rc == SPEEDSQL_OK) {
+        seg.mem = out.buf.data;
+        seg.ref.bytes = out.total;
+        rc = seg_load_footer(nullptr, &seg);
+    }
+    fts_hits_t hits = {};
+    if (rc == SPEEDSQL_OK) rc = seg_search(nullptr, &seg, q, nullptr, &hits);
+    *match = rc == SPEEDSQL_OK && hits.count > 0;
+
+    sdb_free(hits.rowids);
+    buf_free(&out.buf);
+    query_free(q);
+    return rc;
+}
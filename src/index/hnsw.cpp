@@ -0,0 +1,1119 @@
+/*
+ * SpeedSQL - HNSW Vector Index
+ *
+ * Hierarchical navigable small world graph (Malkov & Yashunin) for
+ * approximate nearest-neighbour search over VECTOR columns, by squared
+ * L2 distance.
+ *
+ * The graph lives in buffer-pool pages like every other structure:
+ *
+ *   meta page   dimensions, m, ef values, entry point, node count
+ *   node pages  variable-size node records packed front to back
+ *   B+tree      rowid -> node, so deletes and updates find a row's node
+ *
+ *   codebook    PQ centroids, in a chain of pages (PQ indexes only)
+ *
+ * A node is addressed by its page and byte offset, so opening the index
+ * costs one page read at any size; only a PQ codebook is held outside the
+ * pool. Deleted nodes stay in the graph for navigation and are only kept
+ * out of results, as in hnswlib.
+ *
+ * Vectors are stored as floats, or quantized (SQ8 or PQ) to shrink nodes
+ * 4x or more. Quantized graphs are walked with asymmetric distances from
+ * the float query, and hnsw_rerank tells the caller how many extra
+ * candidates to fetch and re-rank against the full vectors.
+ *
+ * Node record:
+ * +------------------+
+ * | hnsw_node_t      | rowid, level, flags
+ * | vector           | floats or codes, padded to 8 bytes
+ * | level 0 links    | count (8 bytes) + 2*m refs
+ * | level 1..L links | count (8 bytes) + m refs each
+ * +------------------+
+ */
+
+#include "speedsql_internal.h"
+#include <math.h>
+
+#define HNSW_MAGIC 0x57534E48u   /* "HNSW" */
+
+#define HNSW_DEFAULT_M               16
+#define HNSW_DEFAULT_EF_CONSTRUCTION 200
+#define HNSW_DEFAULT_EF_SEARCH       64
+#define HNSW_MAX_M                   128
+#define HNSW_MAX_EF                  4096
+#define HNSW_MAX_LEVEL               16
+
+/* Page header flags */
+#define HNSW_PAGE_META  1
+#define HNSW_PAGE_NODES 2
+#define HNSW_PAGE_CODEBOOK 3
+
+/* Candidates per result re-ranked when vectors are quantized */
+#define HNSW_DEFAULT_RERANK 4
+
+/* Node flags */
+#define HNSW_NODE_DELETED 0x01
+
+/* Where data starts after the common page header */
+#define HNSW_PAGE_DATA ((uint32_t)((sizeof(page_header_t) + 7) & ~(size_t)7))
+
+/* Node reference: page id in the high 48 bits, byte offset in the low 16.
+ * Page 0 is the database header, so 0 never names a node. */
+typedef uint64_t hnsw_ref_t;
+#define HNSW_NO_NODE ((hnsw_ref_t)0)
+
+static inline hnsw_ref_t hnsw_ref(page_id_t page, uint32_t offset) {
+    return ((hnsw_ref_t)page << 16) | offset;
+}
+
+static inline page_id_t hnsw_ref_page(hnsw_ref_t ref) {
+    return (page_id_t)(ref >> 16);
+}
+
+static inline uint32_t hnsw_ref_offset(hnsw_ref_t ref) {
+    return (uint32_t)(ref & 0xFFFF);
+}
+
+typedef struct {
+    uint32_t magic;
+    uint32_t dimensions;         /* 0 until the first vector arrives */
+    uint32_t m;
+    uint32_t ef_construction;
+    uint32_t ef_search;
+    uint32_t max_level;
+    uint64_t node_count;         /* Live (not deleted) nodes */
+    hnsw_ref_t entry;            /* Entry point on max_level */
+    page_id_t fill_page;         /* Node page being filled */
+    page_id_t rowid_root;        /* B+tree rowid -> node */
+    uint32_t codec;              /* IDX_QUANT_* of the stored vectors */
+    uint32_t pq_m;               /* PQ subspaces */
+    uint32_t pq_centroids;       /* Trained centroids per subspace */
+    uint32_t rerank;             /* 0 when stored vectors are exact */
+    page_id_t codebook_page;     /* First page of the PQ codebook */
+} hnsw_meta_t;
+
+typedef struct {
+    int64_t rowid;
+    uint8_t level;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t reserved2;
+} hnsw_node_t;
+
+struct hnsw {
+    buffer_pool_t* pool;
+    file_t* file;
+    page_id_t meta_page;
+    vector_pq_t pq;              /* Codebook of a PQ index */
+    rwlock_t lock;               /* Searches shared, inserts and deletes exclusive */
+};
+
+/* One operation's view of the index: the meta page as read under the
+ * lock, and the record geometry that follows from it */
+typedef struct {
+    hnsw_t* h;
+    hnsw_meta_t meta;
+    uint32_t vec_bytes;
+    uint32_t level0_bytes;
+    uint32_t upper_bytes;
+} hnsw_ctx_t;
+
+typedef struct {
+    float dist;
+    hnsw_ref_t ref;
+} hnsw_cand_t;
+
+/* A float vector to measure nodes against, with its PQ distance table */
+typedef struct {
+    const float* vec;
+    float* table;
+} hnsw_query_t;
+
+/* ============================================================================
+ * Candidate Heaps and Visited Set
+ * ============================================================================ */
+
+typedef struct {
+    hnsw_cand_t* items;
+    size_t count;
+    size_t capacity;
+    bool max_first;              /* Largest distance on top (result sets) */
+} hnsw_heap_t;
+
+static void heap_init(hnsw_heap_t* heap, bool max_first) {
+    memset(heap, 0, sizeof(*heap));
+    heap->max_first = max_first;
+}
+
+static void heap_free(hnsw_heap_t* heap) {
+    sdb_free(heap->items);
+    memset(heap, 0, sizeof(*heap));
+}
+
+static inline bool heap_above(const hnsw_heap_t* heap, const hnsw_cand_t* a, const hnsw_cand_t* b) {
+    return heap->max_first ? a->dist > b->dist : a->dist < b->dist;
+}
+
+static int heap_push(hnsw_heap_t* heap, float dist, hnsw_ref_t ref) {
+    if (heap->count == heap->capacity) {
+        size_t cap = heap->capacity ? heap->capacity * 2 : 64;
+        hnsw_cand_t* items = (hnsw_cand_t*)sdb_realloc(heap->items, cap * sizeof(hnsw_cand_t));
+        if (!items) return SPEEDSQL_NOMEM;
+        heap->items = items;
+        heap->capacity = cap;
+    }
+
+    size_t i = heap->count++;
+    heap->items[i].dist = dist;
+    heap->items[i].ref = ref;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!heap_above(heap, &heap->items[i], &heap->items[parent])) break;
+        hnsw_cand_t tmp = heap->items[i];
+        heap->items[i] = heap->items[parent];
+        heap->items[parent] = tmp;
+        i = parent;
+    }
+    return SPEEDSQL_OK;
+}
+
+static hnsw_cand_t heap_pop(hnsw_heap_t* heap) {
+    hnsw_cand_t top = heap->items[0];
+    heap->items[0] = heap->items[--heap->count];
+
+    size_t i = 0;
+    while (true) {
+        size_t l = 2 * i + 1, r = l + 1, best = i;
+        if (l < heap->count && heap_above(heap, &heap->items[l], &heap->items[best])) best = l;
+        if (r < heap->count && heap_above(heap, &heap->items[r], &heap->items[best])) best = r;
+        if (best == i) break;
+        hnsw_cand_t tmp = heap->items[i];
+        heap->items[i] = heap->items[best];
+        heap->items[best] = tmp;
+        i = best;
+    }
+    return top;
+}
+
+/* Open-addressing set of node refs (0 marks an empty slot) */
+typedef struct {
+    hnsw_ref_t* slots;
+    size_t capacity;             /* Power of two */
+    size_t count;
+} hnsw_visited_t;
+
+static int visited_init(hnsw_visited_t* v, size_t capacity) {
+    v->capacity = capacity;
+    v->count = 0;
+    v->slots = (hnsw_ref_t*)sdb_calloc(capacity, sizeof(hnsw_ref_t));
+    return v->slots ? SPEEDSQL_OK : SPEEDSQL_NOMEM;
+}
+
+static void visited_free(hnsw_visited_t* v) {
+    sdb_free(v->slots);
+    v->slots = nullptr;
+}
+
+static inline size_t visited_slot(hnsw_ref_t ref, size_t capacity) {
+    uint64_t x = ref * 0x9E3779B97F4A7C15ull;
+    return (size_t)(x >> 20) & (capacity - 1);
+}
+
+/* Add ref; *added is false when it was already there */
+static int visited_add(hnsw_visited_t* v, hnsw_ref_t ref, bool* added) {
+    if ((v->count + 1) * 2 > v->capacity) {
+        hnsw_visited_t grown;
+        if (visited_init(&grown, v->capacity * 2) != SPEEDSQL_OK) return SPEEDSQL_NOMEM;
+        for (size_t i = 0; i < v->capacity; i++) {
+            if (v->slots[i] == HNSW_NO_NODE) continue;
+            size_t s = visited_slot(v->slots[i], grown.capacity);
+            while (grown.slots[s] != HNSW_NO_NODE) s = (s + 1) & (grown.capacity - 1);
+            grown.slots[s] = v->slots[i];
+            grown.count++;
+        }
+        visited_free(v);
+        *v = grown;
+    }
+
+    size_t s = visited_slot(ref, v->capacity);
+    while (v->slots[s] != HNSW_NO_NODE) {
+        if (v->slots[s] == ref) {
+            *added = false;
+            return SPEEDSQL_OK;
+        }
+        s = (s + 1) & (v->capacity - 1);
+    }
+    v->slots[s] = ref;
+    v->count++;
+    *added = true;
+    return SPEEDSQL_OK;
+}
+
+/* ============================================================================
+ * Pages and Records
+ * ============================================================================ */
+
+static inline uint32_t level_capacity(const hnsw_ctx_t* c, uint32_t level) {
+    return level == 0 ? 2 * c->meta.m : c->meta.m;
+}
+
+static inline uint32_t record_size(const hnsw_ctx_t* c, uint32_t level) {
+    return (uint32_t)sizeof(hnsw_node_t) + c->vec_bytes + c->level0_bytes + level * c->upper_bytes;
+}
+
+static inline uint32_t links_offset(const hnsw_ctx_t* c, uint32_t level) {
+    uint32_t off = (uint32_t)sizeof(hnsw_node_t) + c->vec_bytes;
+    return level == 0 ? off : off + c->level0_bytes + (level - 1) * c->upper_bytes;
+}
+
+static void ctx_geometry(hnsw_ctx_t* c) {
+    uint32_t bytes = c->meta.dimensions * (uint32_t)sizeof(float);
+    if (c->meta.codec == IDX_QUANT_SQ8) bytes = (uint32_t)vector_sq8_size(c->meta.dimensions);
+    if (c->meta.codec == IDX_QUANT_PQ) bytes = c->meta.pq_m;
+    c->vec_bytes = (bytes + 7) & ~7u;
+    c->level0_bytes = 8 + 2 * c->meta.m * (uint32_t)sizeof(hnsw_ref_t);
+    c->upper_bytes = 8 + c->meta.m * (uint32_t)sizeof(hnsw_ref_t);
+}
+
+static int meta_read(hnsw_t* h, hnsw_ctx_t* c) {
+    buffer_page_t* page = buffer_pool_get(h->pool, h->file, h->meta_page);
+    if (!page) return SPEEDSQL_IOERR;
+
+    memcpy(&c->meta, page->data + HNSW_PAGE_DATA, sizeof(c->meta));
+    buffer_pool_unpin(h->pool, page, false);
+
+    if (c->meta.magic != HNSW_MAGIC || c->meta.m < 2 || c->meta.m > HNSW_MAX_M) {
+        return SPEEDSQL_CORRUPT;
+    }
+    c->h = h;
+    ctx_geometry(c);
+    return SPEEDSQL_OK;
+}
+
+static int meta_write(hnsw_ctx_t* c) {
+    hnsw_t* h = c->h;
+    buffer_page_t* page = buffer_pool_get(h->pool, h->file, h->meta_page);
+    if (!page) return SPEEDSQL_IOERR;
+
+    memcpy(page->data + HNSW_PAGE_DATA, &c->meta, sizeof(c->meta));
+    buffer_pool_unpin(h->pool, page, true);
+    return SPEEDSQL_OK;
+}
+
+/* Pin the page holding ref; returns the record or nullptr */
+static uint8_t* node_pin(const hnsw_ctx_t* c, hnsw_ref_t ref, buffer_page_t** page) {
+    hnsw_t* h = c->h;
+    uint32_t offset = hnsw_ref_offset(ref);
+    if (offset < HNSW_PAGE_DATA || offset >= h->pool->usable_size) return nullptr;
+
+    *page = buffer_pool_get(h->pool, h->file, hnsw_ref_page(ref));
+    if (!*page) return nullptr;
+    return (*page)->data + offset;
+}
+
+static int query_init(const hnsw_ctx_t* c, const float* vec, hnsw_query_t* q) {
+    q->vec = vec;
+    q->table = nullptr;
+    if (c->meta.codec != IDX_QUANT_PQ) return SPEEDSQL_OK;
+
+    q->table = (float*)sdb_malloc((size_t)c->meta.pq_m * VECTOR_PQ_CENTROIDS * sizeof(float));
+    if (!q->table) return SPEEDSQL_NOMEM;
+    vector_pq_table(&c->h->pq, vec, q->table);
+    return SPEEDSQL_OK;
+}
+
+static void query_free(hnsw_query_t* q) {
+    sdb_free(q->table);
+    q->table = nullptr;
+}
+
+/* Distance from q to the node's vector; reports whether it is deleted */
+static int node_distance(const hnsw_ctx_t* c, hnsw_ref_t ref, const hnsw_query_t* q,
+                         float* dist, bool* deleted) {
+    buffer_page_t* page;
+    uint8_t* rec = node_pin(c, ref, &page);
+    if (!rec) return SPEEDSQL_CORRUPT;
+
+    const hnsw_node_t* node = (const hnsw_node_t*)rec;
+    const uint8_t* stored = rec + sizeof(hnsw_node_t);
+    switch (c->meta.codec) {
+        case IDX_QUANT_SQ8:
+            *dist = vector_sq8_l2_sq(q->vec, stored, c->meta.dimensions);
+            break;
+        case IDX_QUANT_PQ:
+            *dist = vector_pq_l2_sq(q->table, stored, c->meta.pq_m);
+            break;
+        default:
+            *dist = vector_l2_sq(q->vec, (const float*)stored, c->meta.dimensions);
+            break;
+    }
+    if (deleted) *deleted = (node->flags & HNSW_NODE_DELETED) != 0;
+
+    buffer_pool_unpin(c->h->pool, page, false);
+    return SPEEDSQL_OK;
+}
+
+/* The node's vector as floats, decoded when quantized */
+static int node_vector(const hnsw_ctx_t* c, hnsw_ref_t ref, float* out) {
+    buffer_page_t* page;
+    uint8_t* rec = node_pin(c, ref, &page);
+    if (!rec) return SPEEDSQL_CORRUPT;
+
+    const uint8_t* stored = rec + sizeof(hnsw_node_t);
+    switch (c->meta.codec) {
+        case IDX_QUANT_SQ8:
+            vector_sq8_decode(stored, c->meta.dimensions, out);
+            break;
+        case IDX_QUANT_PQ:
+            vector_pq_decode(&c->h->pq, stored, out);
+            break;
+        default:
+            memcpy(out, stored, c->meta.dimensions * sizeof(float));
+            break;
+    }
+    buffer_pool_unpin(c->h->pool, page, false);
+    return SPEEDSQL_OK;
+}
+
+/* Store vec in a new node's record, encoded for the index */
+static void node_encode(const hnsw_ctx_t* c, uint8_t* rec, const float* vec) {
+    uint8_t* stored = rec + sizeof(hnsw_node_t);
+    switch (c->meta.codec) {
+        case IDX_QUANT_SQ8:
+            vector_sq8_encode(vec, c->meta.dimensions, stored);
+            break;
+        case IDX_QUANT_PQ:
+            vector_pq_encode(&c->h->pq, vec, stored);
+            break;
+        default:
+            memcpy(stored, vec, c->meta.dimensions * sizeof(float));
+            break;
+    }
+}
+
+/* Copy the node's links on level into out (level_capacity entries) */
+static int node_links(const hnsw_ctx_t* c, hnsw_ref_t ref, uint32_t level,
+                      hnsw_ref_t* out, uint32_t* count) {
+    buffer_page_t* page;
+    uint8_t* rec = node_pin(c, ref, &page);
+    if (!rec) return SPEEDSQL_CORRUPT;
+
+    *count = 0;
+    if (level <= ((hnsw_node_t*)rec)->level) {
+        uint8_t* block = rec + links_offset(c, level);
+        uint32_t n = *(uint32_t*)block;
+        if (n > level_capacity(c, level)) n = level_capacity(c, level);
+        memcpy(out, block + 8, n * sizeof(hnsw_ref_t));
+        *count = n;
+    }
+
+    buffer_pool_unpin(c->h->pool, page, false);
+    return SPEEDSQL_OK;
+}
+
+static int node_set_links(const hnsw_ctx_t* c, hnsw_ref_t ref, uint32_t level,
+                          const hnsw_ref_t* links, uint32_t count) {
+    buffer_page_t* page;
+    uint8_t* rec = node_pin(c, ref, &page);
+    if (!rec) return SPEEDSQL_CORRUPT;
+
+    uint8_t* block = rec + links_offset(c, level);
+    *(uint32_t*)block = count;
+    memcpy(block + 8, links, count * sizeof(hnsw_ref_t));
+
+    buffer_pool_unpin(c->h->pool, page, true);
+    return SPEEDSQL_OK;
+}
+
+/* Reserve size bytes in the fill page, starting a new page when full */
+static int node_alloc(hnsw_ctx_t* c, uint32_t size, hnsw_ref_t* ref) {
+    hnsw_t* h = c->h;
+    size = (size + 7) & ~7u;
+
+    if (c->meta.fill_page != INVALID_PAGE_ID) {
+        buffer_page_t* page = buffer_pool_get(h->pool, h->file, c->meta.fill_page);
+        if (!page) return SPEEDSQL_IOERR;
+
+        page_header_t* hdr = (page_header_t*)page->data;
+        if (hdr->free_start + size <= hdr->free_end) {
+            *ref = hnsw_ref(c->meta.fill_page, hdr->free_start);
+            hdr->free_start += size;
+            hdr->cell_count++;
+            buffer_pool_unpin(h->pool, page, true);
+            return SPEEDSQL_OK;
+        }
+        buffer_pool_unpin(h->pool, page, false);
+    }
+
+    page_id_t page_id;
+    buffer_page_t* page = buffer_pool_new_page(h->pool, h->file, &page_id);
+    if (!page) return SPEEDSQL_NOMEM;
+
+    memset(page->data, 0, h->pool->usable_size);
+    page_header_t* hdr = (page_header_t*)page->data;
+    hdr->page_type = PAGE_TYPE_HNSW;
+    hdr->flags = HNSW_PAGE_NODES;
+    hdr->cell_count = 1;
+    hdr->free_start = HNSW_PAGE_DATA + size;
+    hdr->free_end = (uint32_t)h->pool->usable_size;
+    hdr->right_ptr = INVALID_PAGE_ID;
+    buffer_pool_unpin(h->pool, page, true);
+
+    c->meta.fill_page = page_id;
+    *ref = hnsw_ref(page_id, HNSW_PAGE_DATA);
+    return SPEEDSQL_OK;
+}
+
+/* ============================================================================
+ * Graph Search
+ * ============================================================================ */
+
+/* Walk towards q on one level, one neighbour at a time */
+static int greedy_step(const hnsw_ctx_t* c, const hnsw_query_t* q, uint32_t level,
+                       hnsw_ref_t* ep, float* ep_dist, hnsw_ref_t* links) {
+    bool moved = true;
+    while (moved) {
+        moved = false;
+        uint32_t count;
+        int rc = node_links(c, *ep, level, links, &count);
+        if (rc != SPEEDSQL_OK) return rc;
+
+        for (uint32_t i = 0; i < count; i++) {
+            float d;
+            rc = node_distance(c, links[i], q, &d, nullptr);
+            if (rc != SPEEDSQL_OK) return rc;
+            if (d < *ep_dist) {
+                *ep = links[i];
+                *ep_dist = d;
+                moved = true;
+            }
+        }
+    }
+    return SPEEDSQL_OK;
+}
+
+/* Best-first search of one level from the entry points, keeping the ef
+ * closest nodes in results (a max-heap). Deleted nodes are still expanded
+ * but left out of results when skip_deleted is set. */
+static int search_level(const hnsw_ctx_t* c, const hnsw_query_t* q, const hnsw_cand_t* eps,
+                        size_t ep_count, uint32_t ef, uint32_t level, bool skip_deleted,
+                        hnsw_heap_t* results) {
+    hnsw_heap_t candidates;
+    hnsw_visited_t visited;
+    heap_init(&candidates, false);
+    int rc = visited_init(&visited, 1024);
+    hnsw_ref_t* links = (hnsw_ref_t*)sdb_malloc(2 * c->meta.m * sizeof(hnsw_ref_t));
+    if (!links) rc = SPEEDSQL_NOMEM;
+
+    for (size_t i = 0; i < ep_count && rc == SPEEDSQL_OK; i++) {
+        bool added, deleted;
+        float d;
+        rc = visited_add(&visited, eps[i].ref, &added);
+        if (rc != SPEEDSQL_OK || !added) continue;
+        rc = node_distance(c, eps[i].ref, q, &d, &deleted);
+        if (rc == SPEEDSQL_OK) rc = heap_push(&candidates, d, eps[i].ref);
+        if (rc == SPEEDSQL_OK && !(skip_deleted && deleted)) {
+            rc = heap_push(results, d, eps[i].ref);
+            if (results->count > ef) heap_pop(results);
+        }
+    }
+
+    while (rc == SPEEDSQL_OK && candidates.count > 0) {
+        hnsw_cand_t nearest = heap_pop(&candidates);
+        if (results->count >= ef && nearest.dist > results->items[0].dist) break;
+
+        uint32_t count;
+        rc = node_links(c, nearest.ref, level, links, &count);
+        for (uint32_t i = 0; i < count && rc == SPEEDSQL_OK; i++) {
+            bool added, deleted;
+            float d;
+            rc = visited_add(&visited, links[i], &added);
+            if (rc != SPEEDSQL_OK || !added) continue;
+
+            rc = node_distance(c, links[i], q, &d, &deleted);
+            if (rc != SPEEDSQL_OK) break;
+            if (results->count >= ef && d >= results->items[0].dist) continue;
+
+            rc = heap_push(&candidates, d, links[i]);
+            if (rc == SPEEDSQL_OK && !(skip_deleted && deleted)) {
+                rc = heap_push(results, d, links[i]);
+                if (results->count > ef) heap_pop(results);
+            }
+        }
+    }
+
+    sdb_free(links);
+    visited_free(&visited);
+    heap_free(&candidates);
+    return rc;
+}
+
+/* Drain a max-heap into an array sorted by ascending distance */
+static void heap_drain_sorted(hnsw_heap_t* heap, hnsw_cand_t* out, size_t* count) {
+    size_t n = heap->count;
+    for (size_t i = n; i > 0; i--) {
+        out[i - 1] = heap_pop(heap);
+    }
+    *count = n;
+}
+
+/* Neighbour selection heuristic (Malkov & Yashunin, algorithm 4): take
+ * candidates nearest first, skipping any that is closer to an already
+ * selected neighbour than to the base. Keeps links spread in all
+ * directions, which is what makes the graph navigable at scale. */
+static int select_neighbors(const hnsw_ctx_t* c, const hnsw_cand_t* sorted, size_t count,
+                            uint32_t max_links, hnsw_ref_t* out, uint32_t* selected) {
+    float* vec = (float*)sdb_malloc(c->meta.dimensions * sizeof(float));
+    if (!vec) return SPEEDSQL_NOMEM;
+
+    int rc = SPEEDSQL_OK;
+    *selected = 0;
+    for (size_t i = 0; i < count && *selected < max_links && rc == SPEEDSQL_OK; i++) {
+        hnsw_query_t q = {vec, nullptr};
+        rc = node_vector(c, sorted[i].ref, vec);
+        if (rc == SPEEDSQL_OK && *selected > 0) rc = query_init(c, vec, &q);
+
+        bool keep = true;
+        for (uint32_t j = 0; j < *selected && rc == SPEEDSQL_OK; j++) {
+            float d;
+            rc = node_distance(c, out[j], &q, &d, nullptr);
+            if (rc == SPEEDSQL_OK && d < sorted[i].dist) {
+                keep = false;
+                break;
+            }
+        }
+        query_free(&q);
+        if (keep && rc == SPEEDSQL_OK) out[(*selected)++] = sorted[i].ref;
+    }
+
+    sdb_free(vec);
+    return rc;
+}
+
+/* Add a link from node to target on level, pruning node's list with the
+ * heuristic when it is full */
+static int link_back(const hnsw_ctx_t* c, hnsw_ref_t node, hnsw_ref_t target, uint32_t level) {
+    uint32_t cap = level_capacity(c, level);
+    hnsw_ref_t* links = (hnsw_ref_t*)sdb_malloc((cap + 1) * sizeof(hnsw_ref_t));
+    hnsw_cand_t* cands = (hnsw_cand_t*)sdb_malloc((cap + 1) * sizeof(hnsw_cand_t));
+    float* base = (float*)sdb_malloc(c->meta.dimensions * sizeof(float));
+    uint32_t count = 0;
+    int rc = (links && cands && base) ? SPEEDSQL_OK : SPEEDSQL_NOMEM;
+
+    if (rc == SPEEDSQL_OK) rc = node_links(c, node, level, links, &count);
+
+    if (rc == SPEEDSQL_OK && count < cap) {
+        links[count++] = target;
+        rc = node_set_links(c, node, level, links, count);
+    } else if (rc == SPEEDSQL_OK) {
+        hnsw_query_t q = {base, nullptr};
+        links[count++] = target;
+        rc = node_vector(c, node, base);
+        if (rc == SPEEDSQL_OK) rc = query_init(c, base, &q);
+        for (uint32_t i = 0; i < count && rc == SPEEDSQL_OK; i++) {
+            cands[i].ref = links[i];
+            rc = node_distance(c, links[i], &q, &cands[i].dist, nullptr);
+        }
+        query_free(&q);
+        if (rc == SPEEDSQL_OK) {
+            /* Insertion sort: count is at most 2*m + 1 */
+            for (uint32_t i = 1; i < count; i++) {
+                hnsw_cand_t x = cands[i];
+                uint32_t j = i;
+                while (j > 0 && cands[j - 1].dist > x.dist) {
+                    cands[j] = cands[j - 1];
+                    j--;
+                }
+                cands[j] = x;
+            }
+            uint32_t kept;
+            rc = select_neighbors(c, cands, count, cap, links, &kept);
+            if (rc == SPEEDSQL_OK) rc = node_set_links(c, node, level, links, kept);
+        }
+    }
+
+    sdb_free(links);
+    sdb_free(cands);
+    sdb_free(base);
+    return rc;
+}
+
+/* Level drawn from the exponential distribution with mL = 1/ln(m),
+ * seeded by the rowid so rebuilding an index gives the same graph */
+static uint32_t random_level(int64_t rowid, uint32_t m, uint32_t max_fit) {
+    uint64_t x = (uint64_t)rowid + 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    x ^= x >> 31;
+
+    double u = ((double)(x >> 11) + 1.0) / 9007199254740992.0;  /* (0, 1] */
+    uint32_t level = (uint32_t)(-log(u) / log((double)m));
+    if (level > HNSW_MAX_LEVEL) level = HNSW_MAX_LEVEL;
+    return level < max_fit ? level : max_fit;
+}
+
+/* ============================================================================
+ * PQ Codebook Pages
+ * ============================================================================ */
+
+static inline size_t codebook_floats(const hnsw_meta_t* meta) {
+    return (size_t)meta->dimensions * VECTOR_PQ_CENTROIDS;
+}
+
+/* Write the codebook front to back over a chain of new pages */
+static int codebook_write(hnsw_t* h, const vector_pq_t* pq, page_id_t* first) {
+    const uint8_t* src = (const uint8_t*)pq->codebook;
+    size_t left = (size_t)pq->dimensions * VECTOR_PQ_CENTROIDS * sizeof(float);
+    size_t per_page = h->pool->usable_size - HNSW_PAGE_DATA;
+    buffer_page_t* prev = nullptr;
+    *first = INVALID_PAGE_ID;
+
+    while (left > 0) {
+        page_id_t page_id;
+        buffer_page_t* page = buffer_pool_new_page(h->pool, h->file, &page_id);
+        if (!page) {
+            if (prev) buffer_pool_unpin(h->pool, prev, true);
+            return SPEEDSQL_NOMEM;
+        }
+
+        size_t n = left < per_page ? left : per_page;
+        memset(page->data, 0, h->pool->usable_size);
+        page_header_t* hdr = (page_header_t*)page->data;
+        hdr->page_type = PAGE_TYPE_HNSW;
+        hdr->flags = HNSW_PAGE_CODEBOOK;
+        hdr->free_start = (uint32_t)(HNSW_PAGE_DATA + n);
+        hdr->free_end = (uint32_t)h->pool->usable_size;
+        hdr->right_ptr = INVALID_PAGE_ID;
+        memcpy(page->data + HNSW_PAGE_DATA, src, n);
+
+        if (prev) {
+            ((page_header_t*)prev->data)->right_ptr = page_id;
+            buffer_pool_unpin(h->pool, prev, true);
+        } else {
+            *first = page_id;
+        }
+        prev = page;
+        src += n;
+        left -= n;
+    }
+
+    if (prev) buffer_pool_unpin(h->pool, prev, true);
+    return SPEEDSQL_OK;
+}
+
+static int codebook_read(hnsw_t* h, const hnsw_meta_t* meta) {
+    vector_pq_t* pq = &h->pq;
+    pq->dimensions = meta->dimensions;
+    pq->m = meta->pq_m;
+    pq->centroids = meta->pq_centroids;
+    pq->codebook = (float*)sdb_malloc(codebook_floats(meta) * sizeof(float));
+    if (!pq->codebook) return SPEEDSQL_NOMEM;
+
+    uint8_t* dst = (uint8_t*)pq->codebook;
+    size_t left = codebook_floats(meta) * sizeof(float);
+    page_id_t page_id = meta->codebook_page;
+
+    while (left > 0) {
+        if (page_id == INVALID_PAGE_ID) return SPEEDSQL_CORRUPT;
+        buffer_page_t* page = buffer_pool_get(h->pool, h->file, page_id);
+        if (!page) return SPEEDSQL_IOERR;
+
+        page_header_t* hdr = (page_header_t*)page->data;
+        size_t n = hdr->free_start > HNSW_PAGE_DATA ? hdr->free_start - HNSW_PAGE_DATA : 0;
+        if (hdr->flags != HNSW_PAGE_CODEBOOK || n == 0 || n > left) {
+            buffer_pool_unpin(h->pool, page, false);
+            return SPEEDSQL_CORRUPT;
+        }
+        memcpy(dst, page->data + HNSW_PAGE_DATA, n);
+        page_id = hdr->right_ptr;
+        buffer_pool_unpin(h->pool, page, false);
+        dst += n;
+        left -= n;
+    }
+    return SPEEDSQL_OK;
+}
+
+/* ============================================================================
+ * Public Interface
+ * ============================================================================ */
+
+int hnsw_create(buffer_pool_t* pool, file_t* file, uint32_t m, uint32_t ef_construction,
+                uint32_t ef_search, page_id_t* meta_page) {
+    if (!pool || !meta_page) return SPEEDSQL_MISUSE;
+
+    if (m == 0) m = HNSW_DEFAULT_M;
+    if (ef_construction == 0) ef_construction = HNSW_DEFAULT_EF_CONSTRUCTION;
+    if (ef_search == 0) ef_search = HNSW_DEFAULT_EF_SEARCH;
+    if (m < 2 || m > HNSW_MAX_M || ef_construction > HNSW_MAX_EF || ef_search > HNSW_MAX_EF) {
+        return SPEEDSQL_RANGE;
+    }
+
+    btree_t rowids;
+    int rc = btree_create(&rowids, pool, file, value_compare);
+    if (rc != SPEEDSQL_OK) return rc;
+    page_id_t rowid_root = rowids.root_page;
+    btree_close(&rowids);
+
+    page_id_t page_id;
+    buffer_page_t* page = buffer_pool_new_page(pool, file, &page_id);
+    if (!page) return SPEEDSQL_NOMEM;
+
+    memset(page->data, 0, pool->usable_size);
+    page_header_t* hdr = (page_header_t*)page->data;
+    hdr->page_type = PAGE_TYPE_HNSW;
+    hdr->flags = HNSW_PAGE_META;
+    hdr->free_start = HNSW_PAGE_DATA + sizeof(hnsw_meta_t);
+    hdr->free_end = (uint32_t)pool->usable_size;
+    hdr->right_ptr = INVALID_PAGE_ID;
+
+    hnsw_meta_t meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.magic = HNSW_MAGIC;
+    meta.m = m;
+    meta.ef_construction = ef_construction < m ? m : ef_construction;
+    meta.ef_search = ef_search;
+    meta.entry = HNSW_NO_NODE;
+    meta.fill_page = INVALID_PAGE_ID;
+    meta.rowid_root = rowid_root;
+    memcpy(page->data + HNSW_PAGE_DATA, &meta, sizeof(meta));
+
+    buffer_pool_unpin(pool, page, true);
+    *meta_page = page_id;
+    return SPEEDSQL_OK;
+}
+
+int hnsw_open(hnsw_t** out, buffer_pool_t* pool, file_t* file, page_id_t meta_page) {
+    if (!out || !pool) return SPEEDSQL_MISUSE;
+    *out = nullptr;
+
+    hnsw_t* h = (hnsw_t*)sdb_calloc(1, sizeof(hnsw_t));
+    if (!h) return SPEEDSQL_NOMEM;
+    h->pool = pool;
+    h->file = file;
+    h->meta_page = meta_page;
+
+    hnsw_ctx_t c;
+    int rc = meta_read(h, &c);
+    if (rc == SPEEDSQL_OK && c.meta.codec == IDX_QUANT_PQ) rc = codebook_read(h, &c.meta);
+    if (rc != SPEEDSQL_OK) {
+        vector_pq_free(&h->pq);
+        sdb_free(h);
+        return rc;
+    }
+
+    rwlock_init(&h->lock);
+    *out = h;
+    return SPEEDSQL_OK;
+}
+
+void hnsw_close(hnsw_t* h) {
+    if (!h) return;
+    rwlock_destroy(&h->lock);
+    vector_pq_free(&h->pq);
+    sdb_free(h);
+}
+
+int hnsw_quantize(hnsw_t* h, uint32_t codec, uint32_t pq_m, uint32_t rerank,
+                  const float* samples, size_t count, uint32_t dimensions) {
+    if (!h || codec > IDX_QUANT_PQ) return SPEEDSQL_MISUSE;
+    if (codec == IDX_QUANT_PQ && (!samples || count == 0 || dimensions == 0 ||
+                                  pq_m == 0 || dimensions % pq_m != 0)) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    rwlock_wrlock(&h->lock);
+
+    hnsw_ctx_t c;
+    int rc = meta_read(h, &c);
+    if (rc == SPEEDSQL_OK && (c.meta.entry != HNSW_NO_NODE || c.meta.codec != IDX_QUANT_NONE)) {
+        rc = SPEEDSQL_MISUSE;  /* Only an empty float index can change codec */
+    }
+
+    if (rc == SPEEDSQL_OK && codec == IDX_QUANT_PQ) {
+        vector_pq_t pq;
+        rc = vector_pq_train(&pq, samples, count, dimensions, pq_m);
+        if (rc == SPEEDSQL_OK) {
+            h->pq = pq;
+            rc = codebook_write(h, &pq, &c.meta.codebook_page);
+        }
+        if (rc == SPEEDSQL_OK) {
+            c.meta.dimensions = dimensions;
+            c.meta.pq_m = pq_m;
+            c.meta.pq_centroids = pq.centroids;
+        } else {
+            vector_pq_free(&h->pq);
+        }
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        c.meta.codec = codec;
+        c.meta.rerank = codec == IDX_QUANT_NONE ? 0 : (rerank ? rerank : HNSW_DEFAULT_RERANK);
+        rc = meta_write(&c);
+    }
+
+    rwlock_unlock(&h->lock);
+    return rc;
+}
+
+uint32_t hnsw_rerank(hnsw_t* h) {
+    if (!h) return 0;
+
+    rwlock_rdlock(&h->lock);
+    hnsw_ctx_t c;
+    uint32_t rerank = meta_read(h, &c) == SPEEDSQL_OK ? c.meta.rerank : 0;
+    rwlock_unlock(&h->lock);
+    return rerank;
+}
+
+/* Mark the node indexed for rowid deleted and forget the mapping */
+static int forget_rowid(hnsw_ctx_t* c, btree_t* rowids, int64_t rowid) {
+    value_t key, ref;
+    btree_int_key(&key, rowid);
+    value_init_null(&ref);
+
+    int rc = btree_find(rowids, &key, &ref);
+    hnsw_ref_t node = rc == SPEEDSQL_OK ? (hnsw_ref_t)btree_key_int(&ref) : HNSW_NO_NODE;
+    value_free(&ref);
+
+    buffer_page_t* page = nullptr;
+    uint8_t* rec = node != HNSW_NO_NODE ? node_pin(c, node, &page) : nullptr;
+    if (rec) {
+        ((hnsw_node_t*)rec)->flags |= HNSW_NODE_DELETED;
+        buffer_pool_unpin(c->h->pool, page, true);
+        btree_delete(rowids, &key);
+        if (c->meta.node_count > 0) c->meta.node_count--;
+        rc = SPEEDSQL_OK;
+    } else {
+        rc = node == HNSW_NO_NODE ? SPEEDSQL_NOTFOUND : SPEEDSQL_CORRUPT;
+    }
+
+    value_free(&key);
+    return rc;
+}
+
+int hnsw_insert(hnsw_t* h, int64_t rowid, const float* vec, uint32_t dimensions) {
+    if (!h || !vec || dimensions == 0) return SPEEDSQL_MISUSE;
+
+    rwlock_wrlock(&h->lock);
+
+    hnsw_ctx_t c;
+    int rc = meta_read(h, &c);
+    if (rc == SPEEDSQL_OK && c.meta.dimensions == 0) {
+        c.meta.dimensions = dimensions;
+        ctx_geometry(&c);
+        if (record_size(&c, 0) > h->pool->usable_size - HNSW_PAGE_DATA) {
+            rc = SPEEDSQL_RANGE;  /* A node would not fit in a page */
+        }
+    } else if (rc == SPEEDSQL_OK && c.meta.dimensions != dimensions) {
+        rc = SPEEDSQL_MISMATCH;
+    }
+    if (rc != SPEEDSQL_OK) {
+        rwlock_unlock(&h->lock);
+        return rc;
+    }
+
+    btree_t rowids;
+    btree_open(&rowids, h->pool, h->file, c.meta.rowid_root, value_compare);
+
+    /* Re-indexing a row (UPDATE) retires its old node */
+    forget_rowid(&c, &rowids, rowid);
+
+    /* Highest level whose record still fits in a page */
+    uint32_t max_fit = 0;
+    while (max_fit < HNSW_MAX_LEVEL &&
+           record_size(&c, max_fit + 1) <= h->pool->usable_size - HNSW_PAGE_DATA) {
+        max_fit++;
+    }
+    uint32_t level = random_level(rowid, c.meta.m, max_fit);
+
+    hnsw_ref_t ref;
+    rc = node_alloc(&c, record_size(&c, level), &ref);
+    if (rc == SPEEDSQL_OK) {
+        buffer_page_t* page;
+        uint8_t* rec = node_pin(&c, ref, &page);
+        if (rec) {
+            hnsw_node_t* node = (hnsw_node_t*)rec;
+            memset(rec, 0, record_size(&c, level));
+            node->rowid = rowid;
+            node->level = (uint8_t)level;
+            node_encode(&c, rec, vec);
+            buffer_pool_unpin(h->pool, page, true);
+        } else {
+            rc = SPEEDSQL_CORRUPT;
+        }
+    }
+
+    if (rc == SPEEDSQL_OK && c.meta.entry != HNSW_NO_NODE) {
+        hnsw_ref_t ep = c.meta.entry;
+        float ep_dist;
+        hnsw_query_t q;
+        hnsw_ref_t* links = (hnsw_ref_t*)sdb_malloc(2 * c.meta.m * sizeof(hnsw_ref_t));
+        rc = links ? query_init(&c, vec, &q) : SPEEDSQL_NOMEM;
+        if (rc == SPEEDSQL_OK) rc = node_distance(&c, ep, &q, &ep_dist, nullptr);
+
+        /* Descend greedily through the levels above the new node */
+        for (uint32_t lc = c.meta.max_level; lc > level && rc == SPEEDSQL_OK; lc--) {
+            rc = greedy_step(&c, &q, lc, &ep, &ep_dist, links);
+        }
+
+        /* Then connect it on each of its levels, nearest first */
+        hnsw_cand_t* found = nullptr;
+        size_t found_count = 1;
+        hnsw_cand_t start = {ep_dist, ep};
+        uint32_t top = level < c.meta.max_level ? level : c.meta.max_level;
+
+        for (int64_t lc = top; lc >= 0 && rc == SPEEDSQL_OK; lc--) {
+            hnsw_heap_t results;
+            heap_init(&results, true);
+            rc = search_level(&c, &q, found ? found : &start, found_count,
+                              c.meta.ef_construction, (uint32_t)lc, false, &results);
+
+            if (rc == SPEEDSQL_OK) {
+                hnsw_cand_t* sorted = (hnsw_cand_t*)sdb_malloc(
+                    (results.count ? results.count : 1) * sizeof(hnsw_cand_t));
+                if (!sorted) {
+                    rc = SPEEDSQL_NOMEM;
+                } else {
+                    heap_drain_sorted(&results, sorted, &found_count);
+                    sdb_free(found);
+                    found = sorted;
+                }
+            }
+
+            uint32_t selected = 0;
+            if (rc == SPEEDSQL_OK) {
+                rc = select_neighbors(&c, found, found_count, c.meta.m, links, &selected);
+            }
+            if (rc == SPEEDSQL_OK) {
+                rc = node_set_links(&c, ref, (uint32_t)lc, links, selected);
+            }
+            for (uint32_t i = 0; i < selected && rc == SPEEDSQL_OK; i++) {
+                rc = link_back(&c, links[i], ref, (uint32_t)lc);
+            }
+            heap_free(&results);
+            if (found_count == 0) break;
+        }
+
+        sdb_free(found);
+        sdb_free(links);
+        if (links) query_free(&q);
+    }
+
+    if (rc == SPEEDSQL_OK && (c.meta.entry == HNSW_NO_NODE || level > c.meta.max_level)) {
+        c.meta.entry = ref;
+        c.meta.max_level = level;
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        value_t key, value;
+        btree_int_key(&key, rowid);
+        btree_int_key(&value, (int64_t)ref);
+        rc = btree_insert(&rowids, &key, &value);
+        value_free(&key);
+        value_free(&value);
+        c.meta.node_count++;
+    }
+
+    c.meta.rowid_root = rowids.root_page;
+    btree_close(&rowids);
+
+    int meta_rc = meta_write(&c);
+    rwlock_unlock(&h->lock);
+    return rc != SPEEDSQL_OK ? rc : meta_rc;
+}
+
+int hnsw_delete(hnsw_t* h, int64_t rowid) {
+    if (!h) return SPEEDSQL_MISUSE;
+
+    rwlock_wrlock(&h->lock);
+
+    hnsw_ctx_t c;
+    int rc = meta_read(h, &c);
+    if (rc == SPEEDSQL_OK) {
+        btree_t rowids;
+        btree_open(&rowids, h->pool, h->file, c.meta.rowid_root, value_compare);
+        rc = forget_rowid(&c, &rowids, rowid);
+        c.meta.rowid_root = rowids.root_page;
+        btree_close(&rowids);
+
+        if (rc == SPEEDSQL_OK) rc = meta_write(&c);
+    }
+
+    rwlock_unlock(&h->lock);
+    return rc;
+}
+
+int hnsw_search(hnsw_t* h, const float* query, uint32_t dimensions, uint32_t k, uint32_t ef,
+                int64_t* rowids, float* distances, uint32_t* found) {
+    if (!h || !query || !rowids || !found) return SPEEDSQL_MISUSE;
+    *found = 0;
+    if (k == 0) return SPEEDSQL_OK;
+
+    rwlock_rdlock(&h->lock);
+
+    hnsw_ctx_t c;
+    int rc = meta_read(h, &c);
+    if (rc == SPEEDSQL_OK && c.meta.entry == HNSW_NO_NODE) {
+        rwlock_unlock(&h->lock);
+        return SPEEDSQL_OK;
+    }
+    if (rc == SPEEDSQL_OK && c.meta.dimensions != dimensions) rc = SPEEDSQL_MISMATCH;
+
+    if (ef == 0) ef = c.meta.ef_search;
+    if (ef < k) ef = k;
+
+    hnsw_ref_t ep = c.meta.entry;
+    float ep_dist = 0;
+    hnsw_ref_t* links = nullptr;
+    hnsw_query_t q = {query, nullptr};
+    if (rc == SPEEDSQL_OK) rc = query_init(&c, query, &q);
+    if (rc == SPEEDSQL_OK) {
+        links = (hnsw_ref_t*)sdb_malloc(2 * c.meta.m * sizeof(hnsw_ref_t));
+        rc = links ? node_distance(&c, ep, &q, &ep_dist, nullptr) : SPEEDSQL_NOMEM;
+    }
+    for (uint32_t lc = c.meta.max_level; lc > 0 && rc == SPEEDSQL_OK; lc--) {
+        rc = greedy_step(&c, &q, lc, &ep, &ep_dist, links);
+    }
+    sdb_free(links);
+
+    hnsw_heap_t results;
+    heap_init(&results, true);
+    if (rc == SPEEDSQL_OK) {
+        hnsw_cand_t start = {ep_dist, ep};
+        rc = search_level(&c, &q, &start, 1, ef, 0, true, &results);
+    }
+    query_free(&q);
+
+    /* Keep the k nearest, then read their rowids nearest first */
+    while (rc == SPEEDSQL_OK && results.count > k) heap_pop(&results);
+
+    uint32_t n = (uint32_t)results.count;
+    for (uint32_t i = n; i > 0 && rc == SPEEDSQL_OK; i--) {
+        hnsw_cand_t cand = heap_pop(&results);
+        buffer_page_t* page;
+        uint8_t* rec = node_pin(&c, cand.ref, &page);
+        if (!rec) {
+            rc = SPEEDSQL_CORRUPT;
+            break;
+        }
+        rowids[i - 1] = ((hnsw_node_t*)rec)->rowid;
+        if (distances) distances[i - 1] = sqrtf(cand.dist);
+        buffer_pool_unpin(h->pool, page, false);
+    }
+    if (rc == SPEEDSQL_OK) *found = n;
+
+    heap_free(&results);
+    rwlock_unlock(&h->lock);
+    return rc;
+}
+
+uint64_t hnsw_count(hnsw_t* h) {
+    if (!h) return 0;
+
+    rwlock_rdlock(&h->lock);
+    hnsw_ctx_t c;
+    uint64_t count = meta_read(h, &c) == SPEEDSQL_OK ? c.meta.node_count : 0;
+    rwlock_unlock(&h->lock);
+    return count;
+}
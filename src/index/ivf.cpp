@@ -0,0 +1,830 @@
+/*
+ * SpeedSQL - IVF-Flat Vector Index
+ *
+ * Inverted file over VECTOR columns: k-means centroids trained on a
+ * sample partition the space, and each vector is stored in the posting
+ * list of its nearest centroid. A query scores the centroids, then scans
+ * only the nprobe nearest lists, exactly, by L2 distance.
+ *
+ * Everything lives in buffer-pool pages:
+ *
+ *   meta page        dimensions, list count, nprobe, vector count
+ *   centroid pages   nlist * dimensions floats, in a chain of pages
+ *   directory pages  head page, tail page and entry count of each list
+ *   list pages       one chain per list, entries packed front to back
+ *   B+tree           rowid -> entry, so deletes and updates find a row
+ *
+ * A list page keeps its rowids and vectors apart, so the vectors of a
+ * page are one contiguous array that the batch distance kernels score in
+ * a single call:
+ *
+ * +--------------------------+
+ * | page_header_t            | cell_count = entries used
+ * | rowids[capacity]         | int64, IVF_TOMBSTONE once deleted
+ * | vectors[capacity * dims] | float32
+ * +--------------------------+
+ *
+ * Centroids and the directory are held in memory while the index is
+ * open. Deleted entries stay in their page as tombstones and are skipped
+ * by searches. Large probes are split over worker threads, which take
+ * lists from a shared counter and keep their own top-k heaps; the heaps
+ * are merged once all lists are scanned.
+ */
+
+#include "speedsql_internal.h"
+#include <math.h>
+#include <atomic>
+
+#define IVF_MAGIC 0x46465649u   /* "IVFF" */
+
+#define IVF_DEFAULT_NPROBE 8
+#define IVF_MAX_LISTS      65536
+#define IVF_TRAIN_ITERATIONS 20
+
+/* Vectors a probe must cover before it is split over threads, and the
+ * fewest each extra thread is given */
+#define IVF_PARALLEL_MIN   16384
+#define IVF_PARALLEL_SHARE 8192
+#define IVF_MAX_THREADS    64
+
+/* Page header flags */
+#define IVF_PAGE_META      1
+#define IVF_PAGE_LIST      2
+#define IVF_PAGE_CENTROIDS 3
+#define IVF_PAGE_DIRECTORY 4
+
+/* Rowid of a deleted entry */
+#define IVF_TOMBSTONE INT64_MIN
+
+/* Where data starts after the common page header */
+#define IVF_PAGE_DATA ((uint32_t)((sizeof(page_header_t) + 7) & ~(size_t)7))
+
+/* Entry reference: list page id in the high 48 bits, slot in the low 16 */
+static inline uint64_t ivf_ref(page_id_t page, uint32_t slot) {
+    return ((uint64_t)page << 16) | slot;
+}
+
+typedef struct {
+    uint32_t magic;
+    uint32_t dimensions;         /* 0 until trained */
+    uint32_t nlist;              /* Lists asked for; trained lists once trained */
+    uint32_t nprobe;
+    uint64_t count;              /* Live (not deleted) vectors */
+    page_id_t centroid_page;     /* First page of the centroids */
+    page_id_t directory_page;    /* First page of the directory */
+    page_id_t rowid_root;        /* B+tree rowid -> entry */
+} ivf_meta_t;
+
+/* Directory entry of one posting list */
+typedef struct {
+    page_id_t head;
+    page_id_t tail;
+    uint64_t entries;            /* Slots used, tombstones included */
+} ivf_list_t;
+
+struct ivf {
+    buffer_pool_t* pool;
+    file_t* file;
+    page_id_t meta_page;
+    ivf_meta_t meta;             /* Cached; written through on change */
+    float* centroids;            /* nlist * dimensions */
+    ivf_list_t* lists;           /* Directory, nlist entries */
+    page_id_t* dir_pages;        /* Pages the directory is spread over */
+    uint32_t capacity;           /* Entries per list page */
+    rwlock_t lock;               /* Searches shared, writes exclusive */
+};
+
+typedef struct {
+    float dist;
+    int64_t rowid;
+} ivf_hit_t;
+
+/* ============================================================================
+ * Result Heap
+ * ============================================================================ */
+
+/* Bounded max-heap: the worst of the k best on top */
+typedef struct {
+    ivf_hit_t* items;
+    uint32_t count;
+    uint32_t k;
+} ivf_heap_t;
+
+static void heap_offer(ivf_heap_t* heap, float dist, int64_t rowid) {
+    ivf_hit_t* items = heap->items;
+    size_t i;
+
+    if (heap->count < heap->k) {
+        i = heap->count++;
+        while (i > 0 && items[(i - 1) / 2].dist < dist) {
+            items[i] = items[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    } else if (dist < items[0].dist) {
+        i = 0;
+        while (true) {
+            size_t l = 2 * i + 1, r = l + 1, big = l;
+            if (l >= heap->count) break;
+            if (r < heap->count && items[r].dist > items[l].dist) big = r;
+            if (items[big].dist <= dist) break;
+            items[i] = items[big];
+            i = big;
+        }
+    } else {
+        return;
+    }
+    items[i].dist = dist;
+    items[i].rowid = rowid;
+}
+
+static int hit_compare(const void* a, const void* b) {
+    float da = ((const ivf_hit_t*)a)->dist;
+    float db = ((const ivf_hit_t*)b)->dist;
+    return da < db ? -1 : da > db ? 1 : 0;
+}
+
+/* ============================================================================
+ * Page Chains
+ * ============================================================================ */
+
+static inline size_t chain_per_page(const ivf_t* h) {
+    return h->pool->usable_size - IVF_PAGE_DATA;
+}
+
+static inline size_t chain_pages(const ivf_t* h, size_t bytes) {
+    return (bytes + chain_per_page(h) - 1) / chain_per_page(h);
+}
+
+static void page_init(const ivf_t* h, buffer_page_t* page, uint8_t flags) {
+    memset(page->data, 0, h->pool->usable_size);
+    page_header_t* hdr = (page_header_t*)page->data;
+    hdr->page_type = PAGE_TYPE_IVF;
+    hdr->flags = flags;
+    hdr->free_start = IVF_PAGE_DATA;
+    hdr->free_end = (uint32_t)h->pool->usable_size;
+    hdr->right_ptr = INVALID_PAGE_ID;
+}
+
+/* Write bytes front to back over a chain of new pages, noting their ids */
+static int chain_write(ivf_t* h, uint8_t flags, const void* data, size_t bytes,
+                       page_id_t* pages) {
+    const uint8_t* src = (const uint8_t*)data;
+    buffer_page_t* prev = nullptr;
+    size_t n_pages = chain_pages(h, bytes);
+
+    for (size_t i = 0; i < n_pages; i++) {
+        buffer_page_t* page = buffer_pool_new_page(h->pool, h->file, &pages[i]);
+        if (!page) {
+            if (prev) buffer_pool_unpin(h->pool, prev, true);
+            return SPEEDSQL_NOMEM;
+        }
+
+        size_t n = bytes < chain_per_page(h) ? bytes : chain_per_page(h);
+        page_init(h, page, flags);
+        ((page_header_t*)page->data)->free_start = (uint32_t)(IVF_PAGE_DATA + n);
+        memcpy(page->data + IVF_PAGE_DATA, src, n);
+
+        if (prev) {
+            ((page_header_t*)prev->data)->right_ptr = pages[i];
+            buffer_pool_unpin(h->pool, prev, true);
+        }
+        prev = page;
+        src += n;
+        bytes -= n;
+    }
+
+    if (prev) buffer_pool_unpin(h->pool, prev, true);
+    return SPEEDSQL_OK;
+}
+
+static int chain_read(ivf_t* h, uint8_t flags, page_id_t first, void* data, size_t bytes,
+                      page_id_t* pages) {
+    uint8_t* dst = (uint8_t*)data;
+    page_id_t page_id = first;
+
+    for (size_t i = 0; bytes > 0; i++) {
+        if (page_id == INVALID_PAGE_ID) return SPEEDSQL_CORRUPT;
+        buffer_page_t* page = buffer_pool_get(h->pool, h->file, page_id);
+        if (!page) return SPEEDSQL_IOERR;
+
+        page_header_t* hdr = (page_header_t*)page->data;
+        size_t n = hdr->free_start > IVF_PAGE_DATA ? hdr->free_start - IVF_PAGE_DATA : 0;
+        if (hdr->flags != flags || n == 0 || n > bytes) {
+            buffer_pool_unpin(h->pool, page, false);
+            return SPEEDSQL_CORRUPT;
+        }
+        memcpy(dst, page->data + IVF_PAGE_DATA, n);
+        if (pages) pages[i] = page_id;
+        page_id = hdr->right_ptr;
+        buffer_pool_unpin(h->pool, page, false);
+        dst += n;
+        bytes -= n;
+    }
+    return SPEEDSQL_OK;
+}
+
+/* ============================================================================
+ * Meta, Directory and List Pages
+ * ============================================================================ */
+
+static int meta_write(ivf_t* h) {
+    buffer_page_t* page = buffer_pool_get(h->pool, h->file, h->meta_page);
+    if (!page) return SPEEDSQL_IOERR;
+
+    memcpy(page->data + IVF_PAGE_DATA, &h->meta, sizeof(h->meta));
+    buffer_pool_unpin(h->pool, page, true);
+    return SPEEDSQL_OK;
+}
+
+/* Write one list's directory entry back to its page */
+static int directory_write(ivf_t* h, uint32_t list) {
+    size_t per_page = chain_per_page(h) / sizeof(ivf_list_t);
+    buffer_page_t* page = buffer_pool_get(h->pool, h->file, h->dir_pages[list / per_page]);
+    if (!page) return SPEEDSQL_IOERR;
+
+    memcpy(page->data + IVF_PAGE_DATA + (list % per_page) * sizeof(ivf_list_t),
+           &h->lists[list], sizeof(ivf_list_t));
+    buffer_pool_unpin(h->pool, page, true);
+    return SPEEDSQL_OK;
+}
+
+/* The directory is written as whole entries per page, so an entry never
+ * straddles two pages */
+static int directory_create(ivf_t* h) {
+    size_t per_page = chain_per_page(h) / sizeof(ivf_list_t);
+    size_t n_pages = (h->meta.nlist + per_page - 1) / per_page;
+    h->dir_pages = (page_id_t*)sdb_calloc(n_pages, sizeof(page_id_t));
+    if (!h->dir_pages) return SPEEDSQL_NOMEM;
+
+    buffer_page_t* prev = nullptr;
+    for (size_t i = 0; i < n_pages; i++) {
+        buffer_page_t* page = buffer_pool_new_page(h->pool, h->file, &h->dir_pages[i]);
+        if (!page) {
+            if (prev) buffer_pool_unpin(h->pool, prev, true);
+            return SPEEDSQL_NOMEM;
+        }
+
+        size_t first = i * per_page;
+        size_t n = h->meta.nlist - first < per_page ? h->meta.nlist - first : per_page;
+        page_init(h, page, IVF_PAGE_DIRECTORY);
+        ((page_header_t*)page->data)->free_start =
+            (uint32_t)(IVF_PAGE_DATA + n * sizeof(ivf_list_t));
+        memcpy(page->data + IVF_PAGE_DATA, &h->lists[first], n * sizeof(ivf_list_t));
+
+        if (prev) {
+            ((page_header_t*)prev->data)->right_ptr = h->dir_pages[i];
+            buffer_pool_unpin(h->pool, prev, true);
+        }
+        prev = page;
+    }
+
+    if (prev) buffer_pool_unpin(h->pool, prev, true);
+    h->meta.directory_page = h->dir_pages[0];
+    return SPEEDSQL_OK;
+}
+
+static int directory_read(ivf_t* h) {
+    size_t per_page = chain_per_page(h) / sizeof(ivf_list_t);
+    size_t n_pages = (h->meta.nlist + per_page - 1) / per_page;
+    h->dir_pages = (page_id_t*)sdb_calloc(n_pages, sizeof(page_id_t));
+    if (!h->dir_pages) return SPEEDSQL_NOMEM;
+
+    page_id_t page_id = h->meta.directory_page;
+    for (size_t i = 0; i < n_pages; i++) {
+        if (page_id == INVALID_PAGE_ID) return SPEEDSQL_CORRUPT;
+        buffer_page_t* page = buffer_pool_get(h->pool, h->file, page_id);
+        if (!page) return SPEEDSQL_IOERR;
+
+        page_header_t* hdr = (page_header_t*)page->data;
+        size_t first = i * per_page;
+        size_t n = h->meta.nlist - first < per_page ? h->meta.nlist - first : per_page;
+        if (hdr->flags != IVF_PAGE_DIRECTORY ||
+            hdr->free_start != IVF_PAGE_DATA + n * sizeof(ivf_list_t)) {
+            buffer_pool_unpin(h->pool, page, false);
+            return SPEEDSQL_CORRUPT;
+        }
+        memcpy(&h->lists[first], page->data + IVF_PAGE_DATA, n * sizeof(ivf_list_t));
+        h->dir_pages[i] = page_id;
+        page_id = hdr->right_ptr;
+        buffer_pool_unpin(h->pool, page, false);
+    }
+    return SPEEDSQL_OK;
+}
+
+static inline int64_t* list_rowids(buffer_page_t* page) {
+    return (int64_t*)(page->data + IVF_PAGE_DATA);
+}
+
+static inline float* list_vectors(const ivf_t* h, buffer_page_t* page) {
+    return (float*)(page->data + IVF_PAGE_DATA + (size_t)h->capacity * sizeof(int64_t));
+}
+
+static void set_capacity(ivf_t* h) {
+    size_t entry = sizeof(int64_t) + (size_t)h->meta.dimensions * sizeof(float);
+    size_t capacity = h->meta.dimensions ? chain_per_page(h) / entry : 0;
+    h->capacity = capacity > 0xFFFF ? 0xFFFF : (uint32_t)capacity;
+}
+
+/* Append a vector to a list, starting a new page when the tail is full */
+static int list_append(ivf_t* h, uint32_t list, int64_t rowid, const float* vec, uint64_t* ref) {
+    ivf_list_t* l = &h->lists[list];
+    buffer_page_t* page = nullptr;
+
+    if (l->tail != INVALID_PAGE_ID) {
+        page = buffer_pool_get(h->pool, h->file, l->tail);
+        if (!page) return SPEEDSQL_IOERR;
+        if (((page_header_t*)page->data)->cell_count >= h->capacity) {
+            buffer_pool_unpin(h->pool, page, false);
+            page = nullptr;
+        }
+    }
+
+    if (!page) {
+        page_id_t page_id;
+        page = buffer_pool_new_page(h->pool, h->file, &page_id);
+        if (!page) return SPEEDSQL_NOMEM;
+        page_init(h, page, IVF_PAGE_LIST);
+
+        if (l->tail != INVALID_PAGE_ID) {
+            buffer_page_t* prev = buffer_pool_get(h->pool, h->file, l->tail);
+            if (!prev) {
+                buffer_pool_unpin(h->pool, page, true);
+                return SPEEDSQL_IOERR;
+            }
+            ((page_header_t*)prev->data)->right_ptr = page_id;
+            buffer_pool_unpin(h->pool, prev, true);
+        } else {
+            l->head = page_id;
+        }
+        l->tail = page_id;
+    }
+
+    page_header_t* hdr = (page_header_t*)page->data;
+    uint32_t slot = hdr->cell_count++;
+    list_rowids(page)[slot] = rowid;
+    memcpy(list_vectors(h, page) + (size_t)slot * h->meta.dimensions, vec,
+           h->meta.dimensions * sizeof(float));
+    *ref = ivf_ref(l->tail, slot);
+    buffer_pool_unpin(h->pool, page, true);
+
+    l->entries++;
+    return directory_write(h, list);
+}
+
+/* Nearest centroid to vec */
+static int nearest_list(const ivf_t* h, const float* vec, uint32_t* list) {
+    float* dist = (float*)sdb_malloc(h->meta.nlist * sizeof(float));
+    if (!dist) return SPEEDSQL_NOMEM;
+
+    vector_distances(VECTOR_L2, vec, h->centroids, h->meta.dimensions, h->meta.nlist, dist);
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < h->meta.nlist; i++) {
+        if (dist[i] < dist[best]) best = i;
+    }
+    sdb_free(dist);
+    *list = best;
+    return SPEEDSQL_OK;
+}
+
+/* Tombstone the entry indexed for rowid and forget the mapping */
+static int forget_rowid(ivf_t* h, btree_t* rowids, int64_t rowid) {
+    value_t key, ref;
+    btree_int_key(&key, rowid);
+    value_init_null(&ref);
+
+    int rc = btree_find(rowids, &key, &ref);
+    uint64_t entry = rc == SPEEDSQL_OK ? (uint64_t)btree_key_int(&ref) : 0;
+    value_free(&ref);
+
+    buffer_page_t* page = entry ? buffer_pool_get(h->pool, h->file, entry >> 16) : nullptr;
+    uint32_t slot = (uint32_t)(entry & 0xFFFF);
+    if (page && slot < ((page_header_t*)page->data)->cell_count) {
+        list_rowids(page)[slot] = IVF_TOMBSTONE;
+        buffer_pool_unpin(h->pool, page, true);
+        btree_delete(rowids, &key);
+        if (h->meta.count > 0) h->meta.count--;
+        rc = SPEEDSQL_OK;
+    } else {
+        if (page) buffer_pool_unpin(h->pool, page, false);
+        rc = entry == 0 ? SPEEDSQL_NOTFOUND : SPEEDSQL_CORRUPT;
+    }
+
+    value_free(&key);
+    return rc;
+}
+
+/* ============================================================================
+ * Probing
+ * ============================================================================ */
+
+/* One thread's share of a search: lists taken from a shared counter */
+typedef struct {
+    ivf_t* h;
+    const float* query;
+    const uint32_t* probes;      /* Lists to scan, nearest first */
+    uint32_t nprobe;
+    std::atomic<uint32_t>* next;
+    ivf_heap_t heap;
+    float* dist;                 /* Scratch for one page */
+    int rc;
+} ivf_worker_t;
+
+static int scan_list(ivf_worker_t* w, uint32_t list) {
+    ivf_t* h = w->h;
+    page_id_t page_id = h->lists[list].head;
+
+    while (page_id != INVALID_PAGE_ID) {
+        buffer_page_t* page = buffer_pool_get(h->pool, h->file, page_id);
+        if (!page) return SPEEDSQL_IOERR;
+
+        page_header_t* hdr = (page_header_t*)page->data;
+        uint32_t used = hdr->cell_count;
+        if (hdr->flags != IVF_PAGE_LIST || used > h->capacity) {
+            buffer_pool_unpin(h->pool, page, false);
+            return SPEEDSQL_CORRUPT;
+        }
+
+        const int64_t* rowids = list_rowids(page);
+        vector_distances(VECTOR_L2, w->query, list_vectors(h, page), h->meta.dimensions, used,
+                         w->dist);
+        for (uint32_t i = 0; i < used; i++) {
+            if (rowids[i] != IVF_TOMBSTONE) heap_offer(&w->heap, w->dist[i], rowids[i]);
+        }
+
+        page_id = hdr->right_ptr;
+        buffer_pool_unpin(h->pool, page, false);
+    }
+    return SPEEDSQL_OK;
+}
+
+static void* probe_worker_main(void* arg) {
+    ivf_worker_t* w = (ivf_worker_t*)arg;
+    while (w->rc == SPEEDSQL_OK) {
+        uint32_t i = w->next->fetch_add(1, std::memory_order_relaxed);
+        if (i >= w->nprobe) break;
+        w->rc = scan_list(w, w->probes[i]);
+    }
+    return nullptr;
+}
+
+/* The nprobe lists with the nearest centroids, nearest first */
+static int choose_probes(const ivf_t* h, const float* query, uint32_t nprobe, uint32_t* probes) {
+    ivf_hit_t* order = (ivf_hit_t*)sdb_malloc(h->meta.nlist * sizeof(ivf_hit_t));
+    float* dist = (float*)sdb_malloc(h->meta.nlist * sizeof(float));
+    if (!order || !dist) {
+        sdb_free(order);
+        sdb_free(dist);
+        return SPEEDSQL_NOMEM;
+    }
+
+    vector_distances(VECTOR_L2, query, h->centroids, h->meta.dimensions, h->meta.nlist, dist);
+    for (uint32_t i = 0; i < h->meta.nlist; i++) {
+        order[i].dist = dist[i];
+        order[i].rowid = i;
+    }
+    qsort(order, h->meta.nlist, sizeof(ivf_hit_t), hit_compare);
+    for (uint32_t i = 0; i < nprobe; i++) probes[i] = (uint32_t)order[i].rowid;
+
+    sdb_free(order);
+    sdb_free(dist);
+    return SPEEDSQL_OK;
+}
+
+/* ============================================================================
+ * Public Interface
+ * ============================================================================ */
+
+int ivf_create(buffer_pool_t* pool, file_t* file, uint32_t nlist, uint32_t nprobe,
+               page_id_t* meta_page) {
+    if (!pool || !meta_page) return SPEEDSQL_MISUSE;
+    if (nlist > IVF_MAX_LISTS || nprobe > IVF_MAX_LISTS) return SPEEDSQL_RANGE;
+
+    btree_t rowids;
+    int rc = btree_create(&rowids, pool, file, value_compare);
+    if (rc != SPEEDSQL_OK) return rc;
+    page_id_t rowid_root = rowids.root_page;
+    btree_close(&rowids);
+
+    page_id_t page_id;
+    buffer_page_t* page = buffer_pool_new_page(pool, file, &page_id);
+    if (!page) return SPEEDSQL_NOMEM;
+
+    memset(page->data, 0, pool->usable_size);
+    page_header_t* hdr = (page_header_t*)page->data;
+    hdr->page_type = PAGE_TYPE_IVF;
+    hdr->flags = IVF_PAGE_META;
+    hdr->free_start = IVF_PAGE_DATA + sizeof(ivf_meta_t);
+    hdr->free_end = (uint32_t)pool->usable_size;
+    hdr->right_ptr = INVALID_PAGE_ID;
+
+    ivf_meta_t meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.magic = IVF_MAGIC;
+    meta.nlist = nlist;
+    meta.nprobe = nprobe ? nprobe : IVF_DEFAULT_NPROBE;
+    meta.centroid_page = INVALID_PAGE_ID;
+    meta.directory_page = INVALID_PAGE_ID;
+    meta.rowid_root = rowid_root;
+    memcpy(page->data + IVF_PAGE_DATA, &meta, sizeof(meta));
+
+    buffer_pool_unpin(pool, page, true);
+    *meta_page = page_id;
+    return SPEEDSQL_OK;
+}
+
+int ivf_open(ivf_t** out, buffer_pool_t* pool, file_t* file, page_id_t meta_page) {
+    if (!out || !pool) return SPEEDSQL_MISUSE;
+    *out = nullptr;
+
+    ivf_t* h = (ivf_t*)sdb_calloc(1, sizeof(ivf_t));
+    if (!h) return SPEEDSQL_NOMEM;
+    h->pool = pool;
+    h->file = file;
+    h->meta_page = meta_page;
+
+    int rc = SPEEDSQL_OK;
+    buffer_page_t* page = buffer_pool_get(pool, file, meta_page);
+    if (page) {
+        memcpy(&h->meta, page->data + IVF_PAGE_DATA, sizeof(h->meta));
+        buffer_pool_unpin(pool, page, false);
+    } else {
+        rc = SPEEDSQL_IOERR;
+    }
+    if (rc == SPEEDSQL_OK && (h->meta.magic != IVF_MAGIC || h->meta.nlist > IVF_MAX_LISTS)) {
+        rc = SPEEDSQL_CORRUPT;
+    }
+
+    /* A trained index brings its centroids and directory into memory */
+    if (rc == SPEEDSQL_OK && h->meta.dimensions > 0) {
+        size_t bytes = (size_t)h->meta.nlist * h->meta.dimensions * sizeof(float);
+        set_capacity(h);
+        h->centroids = (float*)sdb_malloc(bytes);
+        h->lists = (ivf_list_t*)sdb_calloc(h->meta.nlist, sizeof(ivf_list_t));
+        rc = h->centroids && h->lists ? SPEEDSQL_OK : SPEEDSQL_NOMEM;
+        if (rc == SPEEDSQL_OK) {
+            rc = chain_read(h, IVF_PAGE_CENTROIDS, h->meta.centroid_page, h->centroids, bytes,
+                            nullptr);
+        }
+        if (rc == SPEEDSQL_OK) rc = directory_read(h);
+        if (rc == SPEEDSQL_OK && h->capacity == 0) rc = SPEEDSQL_CORRUPT;
+    }
+
+    if (rc != SPEEDSQL_OK) {
+        sdb_free(h->centroids);
+        sdb_free(h->lists);
+        sdb_free(h->dir_pages);
+        sdb_free(h);
+        return rc;
+    }
+
+    rwlock_init(&h->lock);
+    *out = h;
+    return SPEEDSQL_OK;
+}
+
+void ivf_close(ivf_t* h) {
+    if (!h) return;
+    rwlock_destroy(&h->lock);
+    sdb_free(h->centroids);
+    sdb_free(h->lists);
+    sdb_free(h->dir_pages);
+    sdb_free(h);
+}
+
+int ivf_train(ivf_t* h, const float* samples, size_t count, uint32_t dimensions) {
+    if (!h || !samples || count == 0 || dimensions == 0) return SPEEDSQL_MISUSE;
+
+    rwlock_wrlock(&h->lock);
+    if (h->meta.dimensions != 0) {
+        rwlock_unlock(&h->lock);
+        return SPEEDSQL_MISUSE;  /* Trained once, at creation */
+    }
+
+    uint32_t nlist = h->meta.nlist;
+    if (nlist == 0) nlist = (uint32_t)sqrt((double)count);
+    if (nlist == 0) nlist = 1;
+
+    ivf_meta_t saved = h->meta;
+    h->meta.dimensions = dimensions;
+    set_capacity(h);
+
+    int rc = h->capacity == 0 ? SPEEDSQL_RANGE : SPEEDSQL_OK;  /* A vector would not fit */
+    float* centroids = nullptr;
+    if (rc == SPEEDSQL_OK) {
+        centroids = (float*)sdb_malloc((size_t)nlist * dimensions * sizeof(float));
+        rc = centroids ? SPEEDSQL_OK : SPEEDSQL_NOMEM;
+    }
+    if (rc == SPEEDSQL_OK) {
+        nlist = vector_kmeans(samples, count, dimensions, dimensions, nlist,
+                              IVF_TRAIN_ITERATIONS, centroids);
+        rc = nlist ? SPEEDSQL_OK : SPEEDSQL_NOMEM;
+    }
+
+    size_t bytes = (size_t)nlist * dimensions * sizeof(float);
+    page_id_t* pages = nullptr;
+    if (rc == SPEEDSQL_OK) {
+        h->meta.nlist = nlist;
+        pages = (page_id_t*)sdb_calloc(chain_pages(h, bytes), sizeof(page_id_t));
+        h->lists = (ivf_list_t*)sdb_calloc(nlist, sizeof(ivf_list_t));
+        rc = pages && h->lists ? SPEEDSQL_OK : SPEEDSQL_NOMEM;
+    }
+    if (rc == SPEEDSQL_OK) rc = chain_write(h, IVF_PAGE_CENTROIDS, centroids, bytes, pages);
+    if (rc == SPEEDSQL_OK) {
+        h->meta.centroid_page = pages[0];
+        for (uint32_t i = 0; i < nlist; i++) {
+            h->lists[i].head = INVALID_PAGE_ID;
+            h->lists[i].tail = INVALID_PAGE_ID;
+        }
+        rc = directory_create(h);
+    }
+    if (rc == SPEEDSQL_OK) rc = meta_write(h);
+    sdb_free(pages);
+
+    if (rc == SPEEDSQL_OK) {
+        h->centroids = centroids;
+    } else {
+        sdb_free(centroids);
+        sdb_free(h->lists);
+        sdb_free(h->dir_pages);
+        h->lists = nullptr;
+        h->dir_pages = nullptr;
+        h->meta = saved;
+        h->capacity = 0;
+    }
+
+    rwlock_unlock(&h->lock);
+    return rc;
+}
+
+int ivf_insert(ivf_t* h, int64_t rowid, const float* vec, uint32_t dimensions) {
+    if (!h || !vec || dimensions == 0 || rowid == IVF_TOMBSTONE) return SPEEDSQL_MISUSE;
+
+    rwlock_wrlock(&h->lock);
+    int rc = SPEEDSQL_OK;
+    if (h->meta.dimensions == 0) {
+        rc = SPEEDSQL_MISUSE;  /* Not trained */
+    } else if (h->meta.dimensions != dimensions) {
+        rc = SPEEDSQL_MISMATCH;
+    }
+    if (rc != SPEEDSQL_OK) {
+        rwlock_unlock(&h->lock);
+        return rc;
+    }
+
+    btree_t rowids;
+    btree_open(&rowids, h->pool, h->file, h->meta.rowid_root, value_compare);
+
+    /* Re-indexing a row (UPDATE) retires its old entry */
+    forget_rowid(h, &rowids, rowid);
+
+    uint32_t list;
+    uint64_t ref = 0;
+    rc = nearest_list(h, vec, &list);
+    if (rc == SPEEDSQL_OK) rc = list_append(h, list, rowid, vec, &ref);
+
+    if (rc == SPEEDSQL_OK) {
+        value_t key, value;
+        btree_int_key(&key, rowid);
+        btree_int_key(&value, (int64_t)ref);
+        rc = btree_insert(&rowids, &key, &value);
+        value_free(&key);
+        value_free(&value);
+        h->meta.count++;
+    }
+
+    h->meta.rowid_root = rowids.root_page;
+    btree_close(&rowids);
+
+    int meta_rc = meta_write(h);
+    rwlock_unlock(&h->lock);
+    return rc != SPEEDSQL_OK ? rc : meta_rc;
+}
+
+int ivf_delete(ivf_t* h, int64_t rowid) {
+    if (!h) return SPEEDSQL_MISUSE;
+
+    rwlock_wrlock(&h->lock);
+
+    btree_t rowids;
+    btree_open(&rowids, h->pool, h->file, h->meta.rowid_root, value_compare);
+    int rc = forget_rowid(h, &rowids, rowid);
+    h->meta.rowid_root = rowids.root_page;
+    btree_close(&rowids);
+
+    if (rc == SPEEDSQL_OK) rc = meta_write(h);
+
+    rwlock_unlock(&h->lock);
+    return rc;
+}
+
+int ivf_search(ivf_t* h, const float* query, uint32_t dimensions, uint32_t k, uint32_t nprobe,
+               int64_t* rowids, float* distances, uint32_t* found) {
+    if (!h || !query || !rowids || !found) return SPEEDSQL_MISUSE;
+    *found = 0;
+    if (k == 0) return SPEEDSQL_OK;
+
+    rwlock_rdlock(&h->lock);
+    if (h->meta.dimensions == 0 || h->meta.count == 0) {
+        rwlock_unlock(&h->lock);
+        return SPEEDSQL_OK;
+    }
+    if (h->meta.dimensions != dimensions) {
+        rwlock_unlock(&h->lock);
+        return SPEEDSQL_MISMATCH;
+    }
+
+    if (nprobe == 0) nprobe = h->meta.nprobe;
+    if (nprobe > h->meta.nlist) nprobe = h->meta.nlist;
+
+    uint32_t* probes = (uint32_t*)sdb_malloc(nprobe * sizeof(uint32_t));
+    int rc = probes ? choose_probes(h, query, nprobe, probes) : SPEEDSQL_NOMEM;
+
+    /* One thread per IVF_PARALLEL_SHARE vectors probed, once the probe is
+     * large enough to be worth it */
+    uint64_t scanned = 0;
+    for (uint32_t i = 0; i < nprobe && rc == SPEEDSQL_OK; i++) {
+        scanned += h->lists[probes[i]].entries;
+    }
+    uint32_t threads = 1;
+    if (scanned >= IVF_PARALLEL_MIN) {
+        uint64_t share = scanned / IVF_PARALLEL_SHARE;
+        threads = cpu_count();
+        if (threads > share) threads = (uint32_t)share;
+        if (threads > nprobe) threads = nprobe;
+        if (threads > IVF_MAX_THREADS) threads = IVF_MAX_THREADS;
+        if (threads == 0) threads = 1;
+    }
+
+    std::atomic<uint32_t> next(0);
+    ivf_worker_t* workers = nullptr;
+    thread_t* handles = nullptr;
+    bool* started = nullptr;
+    if (rc == SPEEDSQL_OK) {
+        workers = (ivf_worker_t*)sdb_calloc(threads, sizeof(ivf_worker_t));
+        handles = (thread_t*)sdb_calloc(threads, sizeof(thread_t));
+        started = (bool*)sdb_calloc(threads, sizeof(bool));
+        rc = workers && handles && started ? SPEEDSQL_OK : SPEEDSQL_NOMEM;
+    }
+    for (uint32_t t = 0; t < threads && rc == SPEEDSQL_OK; t++) {
+        ivf_worker_t* w = &workers[t];
+        w->h = h;
+        w->query = query;
+        w->probes = probes;
+        w->nprobe = nprobe;
+        w->next = &next;
+        w->heap.k = k;
+        w->heap.items = (ivf_hit_t*)sdb_malloc(k * sizeof(ivf_hit_t));
+        w->dist = (float*)sdb_malloc(h->capacity * sizeof(float));
+        if (!w->heap.items || !w->dist) rc = SPEEDSQL_NOMEM;
+    }
+
+    if (rc == SPEEDSQL_OK) {
+        /* Thread 0 is the caller */
+        for (uint32_t t = 1; t < threads; t++) {
+            started[t] = thread_create(&handles[t], probe_worker_main, &workers[t]) == SPEEDSQL_OK;
+        }
+        probe_worker_main(&workers[0]);
+        for (uint32_t t = 1; t < threads; t++) {
+            if (started[t]) thread_join(handles[t]);
+        }
+
+        /* Merge the per-thread heaps */
+        ivf_heap_t* best = &workers[0].heap;
+        rc = workers[0].rc;
+        for (uint32_t t = 1; t < threads && rc == SPEEDSQL_OK; t++) {
+            rc = workers[t].rc;
+            for (uint32_t i = 0; i < workers[t].heap.count; i++) {
+                heap_offer(best, workers[t].heap.items[i].dist, workers[t].heap.items[i].rowid);
+            }
+        }
+
+        if (rc == SPEEDSQL_OK) {
+            qsort(best->items, best->count, sizeof(ivf_hit_t), hit_compare);
+            for (uint32_t i = 0; i < best->count; i++) {
+                rowids[i] = best->items[i].rowid;
+                if (distances) distances[i] = best->items[i].dist;
+            }
+            *found = best->count;
+        }
+    }
+
+    for (uint32_t t = 0; workers && t < threads; t++) {
+        sdb_free(workers[t].heap.items);
+        sdb_free(workers[t].dist);
+    }
+    sdb_free(workers);
+    sdb_free(handles);
+    sdb_free(started);
+    sdb_free(probes);
+    rwlock_unlock(&h->lock);
+    return rc;
+}
+
+uint64_t ivf_count(ivf_t* h) {
+    if (!h) return 0;
+
+    rwlock_rdlock(&h->lock);
+    uint64_t count = h->meta.count;
+    rwlock_unlock(&h->lock);
+    return count;
+}
@@ -40,6 +40,7 @@ static const keyword_t keywords[] = {
     {"LEFT", TOK_LEFT},
     {"LIKE", TOK_LIKE},
     {"LIMIT", TOK_LIMIT},
+    {"MATCH", TOK_MATCH},
     {"NOT", TOK_NOT},
     {"NULL", TOK_NULL},
     {"OFFSET", TOK_OFFSET},
@@ -5,12 +5,14 @@
  */
 
 #include "speedsql_internal.h"
+#include <ctype.h>
 
 void parser_init(parser_t* parser, speedsql* db, const char* sql) {
     lexer_init(&parser->lexer, sql);
     parser->db = db;
     parser->error[0] = '\0';
     parser->had_error = false;
+    parser->param_count = 0;
     parser->current = lexer_next(&parser->lexer);
     parser->previous = parser->current;
 }
@@ -49,6 +51,25 @@ static void consume(parser_t* parser, token_type_t type, const char* message) {
     parser_error(parser, message);
 }
 
+/* Case-insensitive match of an identifier token against a word */
+static bool token_is(const token_t* token, const char* word) {
+    size_t len = strlen(word);
+    if ((size_t)token->length != len) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (tolower((unsigned char)token->start[i]) != tolower((unsigned char)word[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Words that are only keywords in one place (USING, WITH) lex as identifiers */
+static bool match_word(parser_t* parser, const char* word) {
+    if (!check(parser, TOK_IDENT) || !token_is(&parser->current, word)) return false;
+    advance(parser);
+    return true;
+}
+
 /* Forward declarations */
 static expr_t* parse_expression(parser_t* parser);
 static expr_t* parse_or(parser_t* parser);
@@ -63,6 +84,14 @@ static char* copy_identifier(token_t* token) {
     return str;
 }
 
+/* Source text from start to the end of the last token consumed */
+static char* copy_source(parser_t* parser, const char* start) {
+    token_t text = parser->previous;
+    text.start = start;
+    text.length = (int)(parser->previous.start + parser->previous.length - start);
+    return copy_identifier(&text);
+}
+
 /* Expression parsing */
 static expr_t* create_expr(expr_type_t type) {
     expr_t* expr = (expr_t*)sdb_calloc(1, sizeof(expr_t));
@@ -115,10 +144,9 @@ static expr_t* parse_primary(parser_t* parser) {
     }
 
     if (match(parser, TOK_PARAM)) {
-        static int param_count = 0;
         expr_t* expr = create_expr(EXPR_PARAMETER);
         if (expr) {
-            expr->data.param_index = param_count++;
+            expr->data.param_index = ++parser->param_count;
         }
         return expr;
     }
@@ -283,12 +311,13 @@ static expr_t* parse_comparison(parser_t* parser) {
         return expr;
     }
 
-    /* Handle LIKE */
-    if (match(parser, TOK_LIKE)) {
+    /* Handle LIKE and full-text MATCH */
+    if (match(parser, TOK_LIKE) || match(parser, TOK_MATCH)) {
+        token_type_t op = parser->previous.type;
         expr_t* right = parse_term(parser);
         expr_t* expr = create_expr(EXPR_BINARY_OP);
         if (expr) {
-            expr->data.binary.op = TOK_LIKE;
+            expr->data.binary.op = op;
             expr->data.binary.left = left;
             expr->data.binary.right = right;
         }
@@ -591,12 +620,15 @@ static parsed_stmt_t* parse_insert(parser_t* parser) {
     /* Parse value lists */
     int row_capacity = 8;
     stmt->insert_values = (value_t**)sdb_malloc(row_capacity * sizeof(value_t*));
+    stmt->insert_params = (int**)sdb_malloc(row_capacity * sizeof(int*));
 
     do {
         if (stmt->insert_row_count >= row_capacity) {
             row_capacity *= 2;
             stmt->insert_values = (value_t**)sdb_realloc(stmt->insert_values,
                 row_capacity * sizeof(value_t*));
+            stmt->insert_params = (int**)sdb_realloc(stmt->insert_params,
+                row_capacity * sizeof(int*));
         }
 
         consume(parser, TOK_LPAREN, "Expected '(' before values");
@@ -604,12 +636,18 @@ static parsed_stmt_t* parse_insert(parser_t* parser) {
         int col_count = stmt->insert_column_count > 0 ?
             stmt->insert_column_count : 16;  /* Guess if no column list */
         value_t* row = (value_t*)sdb_calloc(col_count, sizeof(value_t));
+        int* params = (int*)sdb_calloc(col_count, sizeof(int));
         int value_idx = 0;
 
         do {
             expr_t* expr = parse_expression(parser);
-            if (expr && expr->type == EXPR_LITERAL) {
+            if (value_idx >= col_count) {
+                parser_error(parser, "Too many values");
+            } else if (expr && expr->type == EXPR_LITERAL) {
                 row[value_idx++] = expr->data.literal;
+            } else if (expr && expr->type == EXPR_PARAMETER) {
+                /* Bound at execution; NULL until then */
+                params[value_idx++] = expr->data.param_index;
             }
             sdb_free(expr);
         } while (match(parser, TOK_COMMA));
@@ -619,6 +657,7 @@ static parsed_stmt_t* parse_insert(parser_t* parser) {
             stmt->insert_column_count = value_idx;
         }
 
+        stmt->insert_params[stmt->insert_row_count] = params;
         stmt->insert_values[stmt->insert_row_count++] = row;
 
         consume(parser, TOK_RPAREN, "Expected ')' after values");
@@ -729,8 +768,10 @@ static parsed_stmt_t* parse_create_table(parser_t* parser) {
 
         /* Parse type */
         consume(parser, TOK_IDENT, "Expected column type");
-        /* For now, store type as generic - later parse specific types */
-        col->type = SPEEDSQL_TYPE_TEXT;  /* Default */
+        /* For now, store type as generic - later parse specific types.
+         * JSON columns keep text written to them as binary documents */
+        col->type = token_is(&parser->previous, "JSON") ? SPEEDSQL_TYPE_JSON
+                                                         : SPEEDSQL_TYPE_TEXT;
 
         /* Parse constraints */
         while (!check(parser, TOK_COMMA) && !check(parser, TOK_RPAREN)) {
@@ -781,50 +822,224 @@ static parsed_stmt_t* parse_create_index(parser_t* parser, bool is_unique) {
     consume(parser, TOK_IDENT, "Expected table name");
     stmt->new_index->table_name = copy_identifier(&parser->previous);
 
+    /* Index method: B+tree unless USING HNSW, IVF or FTS */
+    if (match_word(parser, "USING")) {
+        consume(parser, TOK_IDENT, "Expected index method after USING");
+        if (token_is(&parser->previous, "HNSW")) {
+            stmt->new_index->flags |= IDX_FLAG_HNSW;
+        } else if (token_is(&parser->previous, "IVF")) {
+            stmt->new_index->flags |= IDX_FLAG_IVF;
+        } else if (token_is(&parser->previous, "FTS")) {
+            stmt->new_index->flags |= IDX_FLAG_FTS;
+        } else if (!token_is(&parser->previous, "BTREE")) {
+            parser_error(parser, "Unknown index method");
+        }
+    }
+
     /* Parse column list */
     consume(parser, TOK_LPAREN, "Expected '(' after table name");
 
+    /* Columns resolve against the table when it exists; CREATE INDEX on a
+     * missing table is reported when the statement runs */
+    table_def_t* table = nullptr;
+    if (parser->db) {
+        for (uint32_t i = 0; i < parser->db->table_count; i++) {
+            if (strcmp(parser->db->tables[i].name, stmt->new_index->table_name) == 0) {
+                table = &parser->db->tables[i];
+                break;
+            }
+        }
+    }
+
     int capacity = 8;
     stmt->new_index->column_indices = (uint32_t*)sdb_malloc(capacity * sizeof(uint32_t));
-
-    /* For now, store column names temporarily and resolve indices later */
-    /* We'll store the column count and use column_indices as placeholder */
-    char** column_names = (char**)sdb_malloc(capacity * sizeof(char*));
     int col_count = 0;
 
     do {
         if (col_count >= capacity) {
             capacity *= 2;
-            column_names = (char**)sdb_realloc(column_names, capacity * sizeof(char*));
             stmt->new_index->column_indices = (uint32_t*)sdb_realloc(
                 stmt->new_index->column_indices, capacity * sizeof(uint32_t));
         }
 
-        consume(parser, TOK_IDENT, "Expected column name");
-        column_names[col_count] = copy_identifier(&parser->previous);
+        /* A key is a column or, alone in the list, an expression whose
+         * source text is kept to be evaluated for every row */
+        const char* key_start = parser->current.start;
+        int params = parser->param_count;
+        expr_t* key = parse_expression(parser);
+        if (!key || parser->had_error) {
+            expr_free(key);
+            break;
+        }
+
+        bool is_column = key->type == EXPR_COLUMN && !key->data.column_ref.table;
+        if (!is_column) {
+            if (parser->param_count != params) {
+                parser_error(parser, "Parameters are not allowed in an index expression");
+            } else if (col_count > 0 || stmt->new_index->key_sql) {
+                parser_error(parser, "An index expression must be the only key");
+            } else {
+                stmt->new_index->key_sql = copy_source(parser, key_start);
+                stmt->new_index->flags |= IDX_FLAG_EXPR;
+            }
+        }
 
-        /* Check for ASC/DESC (ignore for now) */
-        if (match(parser, TOK_IDENT)) {
-            /* Skip ASC/DESC keyword */
+        /* ASC/DESC is accepted and ignored */
+        if (!match(parser, TOK_ASC)) match(parser, TOK_DESC);
+
+        if (!is_column) {
+            expr_free(key);
+            continue;
+        }
+        if (stmt->new_index->key_sql) {
+            parser_error(parser, "An index expression must be the only key");
         }
 
-        stmt->new_index->column_indices[col_count] = col_count;  /* Placeholder */
+        const char* column = key->data.column_ref.column;
+        uint32_t index = (uint32_t)col_count;
+        if (table) {
+            index = table->column_count;
+            for (uint32_t i = 0; i < table->column_count; i++) {
+                if (strcmp(table->columns[i].name, column) == 0) {
+                    index = i;
+                    break;
+                }
+            }
+            if (index == table->column_count) {
+                parser_error(parser, "Unknown column in index");
+            }
+        }
+        expr_free(key);
+
+        stmt->new_index->column_indices[col_count] = index;
         col_count++;
     } while (match(parser, TOK_COMMA));
 
     stmt->new_index->column_count = col_count;
 
-    /* Free temporary column names (in real impl, resolve to indices) */
-    for (int i = 0; i < col_count; i++) {
-        sdb_free(column_names[i]);
+    consume(parser, TOK_RPAREN, "Expected ')' after column list");
+
+    if ((stmt->new_index->flags & IDX_FLAG_EXPR) &&
+        (stmt->new_index->flags & (IDX_FLAG_VECTOR | IDX_FLAG_FTS))) {
+        parser_error(parser, "Vector and full-text indexes take a column, not an expression");
+    }
+    if ((stmt->new_index->flags & IDX_FLAG_VECTOR) && col_count != 1) {
+        parser_error(parser, "Vector index takes one column");
+    }
+    if ((stmt->new_index->flags & IDX_FLAG_FTS) && col_count != 1) {
+        parser_error(parser, "Full-text index takes one column");
     }
-    sdb_free(column_names);
 
-    consume(parser, TOK_RPAREN, "Expected ')' after column list");
+    /* HNSW: WITH (m = 16, ef_construction = 200, ef_search = 64,
+     *             quantization = sq8 | pq, pq_m = 96, rerank = 4)
+     * IVF:  WITH (lists = 1024, nprobe = 8)
+     * FTS:  WITH (tokenizer = simple) */
+    if (match_word(parser, "WITH")) {
+        consume(parser, TOK_LPAREN, "Expected '(' after WITH");
+        do {
+            consume(parser, TOK_IDENT, "Expected index option");
+            token_t option = parser->previous;
+            consume(parser, TOK_EQ, "Expected '=' after index option");
+
+            if (token_is(&option, "tokenizer")) {
+                if (!(stmt->new_index->flags & IDX_FLAG_FTS)) {
+                    parser_error(parser, "Unknown index option");
+                    break;
+                }
+                /* A bare name or a string; the tokenizer is looked up when
+                 * the index is created */
+                if (match(parser, TOK_STRING)) {
+                    token_t name = parser->previous;
+                    name.start++;
+                    name.length -= 2;
+                    sdb_free(stmt->new_index->tokenizer);
+                    stmt->new_index->tokenizer = copy_identifier(&name);
+                } else {
+                    consume(parser, TOK_IDENT, "Expected tokenizer name");
+                    sdb_free(stmt->new_index->tokenizer);
+                    stmt->new_index->tokenizer = copy_identifier(&parser->previous);
+                }
+                continue;
+            }
+
+            int64_t value = 0;
+            int slot = -1;
+            if (token_is(&option, "quantization")) {
+                slot = IDX_PARAM_QUANTIZE;
+                if (match_word(parser, "none")) {
+                    value = IDX_QUANT_NONE;
+                } else if (match_word(parser, "sq8")) {
+                    value = IDX_QUANT_SQ8;
+                } else if (match_word(parser, "pq")) {
+                    value = IDX_QUANT_PQ;
+                } else {
+                    parser_error(parser, "Expected none, sq8 or pq");
+                    break;
+                }
+            } else {
+                consume(parser, TOK_INTEGER, "Expected integer option value");
+                value = parser->previous.value.int_val;
+            }
+
+            if (token_is(&option, "m")) slot = IDX_PARAM_M;
+            else if (token_is(&option, "ef_construction")) slot = IDX_PARAM_EF_CONSTRUCTION;
+            else if (token_is(&option, "ef_search")) slot = IDX_PARAM_EF_SEARCH;
+            else if (token_is(&option, "pq_m")) slot = IDX_PARAM_PQ_M;
+            else if (token_is(&option, "rerank")) slot = IDX_PARAM_RERANK;
+
+            /* Each method takes its own options */
+            bool ivf_option = slot < 0 && (token_is(&option, "lists") || token_is(&option, "nprobe"));
+            if (ivf_option) {
+                slot = token_is(&option, "lists") ? IDX_PARAM_LISTS : IDX_PARAM_NPROBE;
+            }
+            uint8_t method = ivf_option ? IDX_FLAG_IVF : IDX_FLAG_HNSW;
+
+            if (slot < 0 || !(stmt->new_index->flags & method)) {
+                parser_error(parser, "Unknown index option");
+            } else if (value < (slot == IDX_PARAM_QUANTIZE ? 0 : 1) || value > 65536) {
+                parser_error(parser, "Index option out of range");
+            } else {
+                stmt->new_index->params[slot] = (uint32_t)value;
+            }
+        } while (match(parser, TOK_COMMA));
+        consume(parser, TOK_RPAREN, "Expected ')' after index options");
+    }
+
+    /* Partial index: WHERE predicate on the table's rows */
+    if (match(parser, TOK_WHERE)) {
+        const char* where_start = parser->current.start;
+        int params = parser->param_count;
+        expr_t* where = parse_expression(parser);
+        if (where && !parser->had_error) {
+            if (stmt->new_index->flags & (IDX_FLAG_VECTOR | IDX_FLAG_FTS)) {
+                parser_error(parser, "Vector and full-text indexes cannot be partial");
+            } else if (parser->param_count != params) {
+                parser_error(parser, "Parameters are not allowed in an index predicate");
+            } else {
+                stmt->new_index->where_sql = copy_source(parser, where_start);
+                stmt->new_index->flags |= IDX_FLAG_PARTIAL;
+            }
+        }
+        expr_free(where);
+    }
 
     return stmt;
 }
 
+/* A whole source text as one expression, such as the stored key of an
+ * expression index; nullptr with parser->error set when it is not one */
+expr_t* parser_parse_expr(parser_t* parser) {
+    expr_t* expr = parse_expression(parser);
+    if (!parser->had_error && !check(parser, TOK_EOF)) {
+        parser_error(parser, "Unexpected text after expression");
+    }
+    if (parser->had_error) {
+        expr_free(expr);
+        return nullptr;
+    }
+    return expr;
+}
+
 parsed_stmt_t* parser_parse(parser_t* parser) {
     if (match(parser, TOK_SELECT)) {
         return parse_select(parser);
@@ -947,7 +1162,7 @@ parsed_stmt_t* parser_parse(parser_t* parser) {
 }
 
 /* Free expression tree */
-static void expr_free(expr_t* expr) {
+void expr_free(expr_t* expr) {
     if (!expr) return;
 
     switch (expr->type) {
@@ -1041,11 +1256,21 @@ void parsed_stmt_free(parsed_stmt_t* stmt) {
 
     if (stmt->insert_values) {
         for (int i = 0; i < stmt->insert_row_count; i++) {
+            for (int c = 0; c < stmt->insert_column_count; c++) {
+                value_free(&stmt->insert_values[i][c]);
+            }
             sdb_free(stmt->insert_values[i]);
         }
         sdb_free(stmt->insert_values);
     }
 
+    if (stmt->insert_params) {
+        for (int i = 0; i < stmt->insert_row_count; i++) {
+            sdb_free(stmt->insert_params[i]);
+        }
+        sdb_free(stmt->insert_params);
+    }
+
     if (stmt->update_columns) {
         for (int i = 0; i < stmt->update_count; i++) {
             sdb_free(stmt->update_columns[i]);
@@ -1072,6 +1297,9 @@ void parsed_stmt_free(parsed_stmt_t* stmt) {
         sdb_free(stmt->new_index->name);
         sdb_free(stmt->new_index->table_name);
         sdb_free(stmt->new_index->column_indices);
+        sdb_free(stmt->new_index->tokenizer);
+        sdb_free(stmt->new_index->key_sql);
+        sdb_free(stmt->new_index->where_sql);
         sdb_free(stmt->new_index);
     }
 
@@ -3,6 +3,10 @@
  *
  * High-performance page cache using LRU eviction and concurrent access.
  * This is critical for performance - SQLite's cache is often a bottleneck.
+ *
+ * The pool lock only guards metadata. Page reads, write-backs and the
+ * cipher work on them run unlocked, with the page marked BUF_IO so other
+ * threads wait for it instead of racing the disk.
  */
 
 #include "speedsql_internal.h"
@@ -13,10 +17,22 @@ static int encrypt_page(buffer_pool_t* pool, page_id_t page_id,
                         const uint8_t* plaintext, uint8_t* ciphertext);
 static int decrypt_page(buffer_pool_t* pool, page_id_t page_id,
                         const uint8_t* ciphertext, uint8_t* plaintext);
+static int fresh_nonce_base(buffer_pool_t* pool);
 static int read_page_encrypted(buffer_pool_t* pool, file_t* file,
                                page_id_t page_id, uint8_t* data);
 static int write_page_encrypted(buffer_pool_t* pool, file_t* file,
                                 page_id_t page_id, const uint8_t* data);
+static int store_page_image(buffer_pool_t* pool, file_t* file, page_id_t page_id,
+                            const uint8_t* image, size_t size);
+static void prepare_write_back(buffer_pool_t* pool, page_id_t page_id, uint8_t* data);
+static void track_write(buffer_pool_t* pool, page_id_t page_id);
+static int write_back_page(buffer_pool_t* pool, file_t* file,
+                           page_id_t page_id, uint8_t* data);
+static void crypt_workers_stop(struct crypt_workers* w);
+static struct crypt_workers* crypt_workers_start(buffer_pool_t* pool, int threads);
+
+/* Helper threads for flush encryption, besides the flushing thread */
+#define CRYPT_MAX_WORKERS 7
 
 /* Hash function for page IDs */
 static inline size_t page_hash(page_id_t page_id, size_t size) {
@@ -30,8 +46,15 @@ int buffer_pool_init(buffer_pool_t* pool, size_t cache_size, uint32_t page_size)
     }
 
     memset(pool, 0, sizeof(*pool));
+    mutex_init(&pool->lock);
+    mutex_init(&pool->flush_lock);
+    mutex_init(&pool->nonce_lock);
+    mutex_init(&pool->rekey_lock);
+    rwlock_init(&pool->rekey_rw);
+    cond_init(&pool->io_cond);
 
     pool->page_size = page_size;
+    pool->usable_size = page_size;
     pool->page_count = cache_size / page_size;
     if (pool->page_count < 16) {
         pool->page_count = 16;  /* Minimum cache size */
@@ -76,7 +99,36 @@ int buffer_pool_init(buffer_pool_t* pool, size_t cache_size, uint32_t page_size)
         pool->free_list = page;
     }
 
+    return SPEEDSQL_OK;
+}
+
+/* Initialize a pool backed entirely by an in-memory page store */
+int buffer_pool_init_memory(buffer_pool_t* pool, uint32_t page_size) {
+    if (!pool || page_size == 0) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    memset(pool, 0, sizeof(*pool));
     mutex_init(&pool->lock);
+    mutex_init(&pool->flush_lock);
+    mutex_init(&pool->nonce_lock);
+    mutex_init(&pool->rekey_lock);
+    rwlock_init(&pool->rekey_rw);
+    cond_init(&pool->io_cond);
+    pool->page_size = page_size;
+    pool->usable_size = page_size;
+
+    pool->mem = (mem_store_t*)sdb_malloc(sizeof(mem_store_t));
+    if (!pool->mem) {
+        return SPEEDSQL_NOMEM;
+    }
+
+    int rc = mem_store_init(pool->mem, page_size);
+    if (rc != SPEEDSQL_OK) {
+        sdb_free(pool->mem);
+        pool->mem = nullptr;
+        return rc;
+    }
 
     return SPEEDSQL_OK;
 }
@@ -84,6 +136,15 @@ int buffer_pool_init(buffer_pool_t* pool, size_t cache_size, uint32_t page_size)
 void buffer_pool_destroy(buffer_pool_t* pool) {
     if (!pool) return;
 
+    crypt_workers_stop(pool->workers);
+    pool->workers = nullptr;
+
+    if (pool->mem) {
+        mem_store_destroy(pool->mem);
+        sdb_free(pool->mem);
+        pool->mem = nullptr;
+    }
+
     /* Pages are in either:
      * 1. Free list (not in use)
      * 2. Hash table + LRU list (in use)
@@ -113,12 +174,16 @@ void buffer_pool_destroy(buffer_pool_t* pool) {
         sdb_free(pool->hash_table);
     }
 
-    /* Free encryption buffer if allocated */
-    if (pool->crypt_buffer) {
-        sdb_free(pool->crypt_buffer);
-        pool->crypt_buffer = nullptr;
-    }
+    sdb_free(pool->track_bits);
+    pool->track_bits = nullptr;
+    sdb_free(pool->rekey_bits);
+    pool->rekey_bits = nullptr;
 
+    cond_destroy(&pool->io_cond);
+    rwlock_destroy(&pool->rekey_rw);
+    mutex_destroy(&pool->rekey_lock);
+    mutex_destroy(&pool->nonce_lock);
+    mutex_destroy(&pool->flush_lock);
     mutex_destroy(&pool->lock);
 }
 
@@ -191,8 +256,23 @@ static void lru_insert_front(buffer_pool_t* pool, buffer_page_t* page) {
     pool->lru_head = page;
 }
 
-/* Get a victim page for eviction */
-static buffer_page_t* get_victim(buffer_pool_t* pool, file_t* file) {
+/* Return an unused page to the free list */
+static void free_list_push(buffer_pool_t* pool, buffer_page_t* page) {
+    page->page_id = INVALID_PAGE_ID;
+    page->state = BUF_INVALID;
+    page->pin_count = 0;
+    page->lru_prev = nullptr;
+    page->lru_next = pool->free_list;
+    if (pool->free_list) {
+        pool->free_list->lru_prev = page;
+    }
+    pool->free_list = page;
+}
+
+/* Get a victim page for eviction. Caller holds pool->lock; it is dropped
+ * while a dirty victim is written back, and *relocked tells the caller to
+ * revalidate anything it looked up before. */
+static buffer_page_t* get_victim(buffer_pool_t* pool, file_t* file, bool* relocked) {
     /* First try free list */
     if (pool->free_list) {
         buffer_page_t* page = pool->free_list;
@@ -207,15 +287,33 @@ static buffer_page_t* get_victim(buffer_pool_t* pool, file_t* file) {
     buffer_page_t* page = pool->lru_tail;
     while (page) {
         if (page->pin_count == 0) {
+            /* Write back if dirty; the page stays findable as BUF_IO so a
+             * reader waits for the write instead of reading stale data */
+            if (page->state == BUF_DIRTY && file) {
+                prepare_write_back(pool, page->page_id, page->data);
+                page->state = BUF_IO;
+                page->pin_count = 1;
+                pool->io_writes++;
+                mutex_unlock(&pool->lock);
+
+                int rc = write_page_encrypted(pool, file, page->page_id, page->data);
+
+                mutex_lock(&pool->lock);
+                pool->io_writes--;
+                page->pin_count = 0;
+                *relocked = true;
+                cond_broadcast(&pool->io_cond);
+
+                if (rc != SPEEDSQL_OK) {
+                    page->state = BUF_DIRTY;
+                    return nullptr;
+                }
+            }
+
             /* Found victim - remove from LRU and hash */
             lru_remove(pool, page);
             hash_remove(pool, page);
 
-            /* Write back if dirty */
-            if (page->state == BUF_DIRTY && file) {
-                write_page_encrypted(pool, file, page->page_id, page->data);
-            }
-
             pool->used_count--;
             return page;
         }
@@ -229,66 +327,93 @@ static buffer_page_t* get_victim(buffer_pool_t* pool, file_t* file) {
 buffer_page_t* buffer_pool_get(buffer_pool_t* pool, file_t* file, page_id_t page_id) {
     if (!pool || !file) return nullptr;
 
-    mutex_lock(&pool->lock);
+    /* In-memory pages are always resident */
+    if (pool->mem) {
+        buffer_page_t* page = mem_store_get(pool->mem, page_id);
+        if (page && __atomic_load_n(&pool->mem->undo_armed, __ATOMIC_RELAXED)) {
+            mem_store_undo_save(pool->mem, page);
+        }
+        return page;
+    }
 
-    /* Check if already in cache */
-    buffer_page_t* page = hash_find(pool, page_id);
-    if (page) {
-        /* Cache hit */
-        pool->hits++;
-        page->pin_count++;
-        page->last_access = get_timestamp_us();
+    mutex_lock(&pool->lock);
 
-        /* Move to front of LRU if not pinned by others */
-        if (page->pin_count == 1) {
-            lru_remove(pool, page);
-            lru_insert_front(pool, page);
+    buffer_page_t* page;
+    for (;;) {
+        /* Check if already in cache */
+        page = hash_find(pool, page_id);
+        if (page && page->state == BUF_IO) {
+            /* Being read or written back by another thread */
+            cond_wait(&pool->io_cond, &pool->lock);
+            continue;
         }
 
-        mutex_unlock(&pool->lock);
-        return page;
-    }
+        if (page) {
+            /* Cache hit */
+            pool->hits++;
+            page->pin_count++;
+            page->last_access = get_timestamp_us();
 
-    /* Cache miss */
-    pool->misses++;
+            /* Move to front of LRU if not pinned by others */
+            if (page->pin_count == 1) {
+                lru_remove(pool, page);
+                lru_insert_front(pool, page);
+            }
 
-    /* Get a page to use */
-    page = get_victim(pool, file);
-    if (!page) {
-        mutex_unlock(&pool->lock);
-        return nullptr;  /* No pages available */
-    }
+            mutex_unlock(&pool->lock);
+            return page;
+        }
 
-    /* Read page from disk (with decryption if enabled) */
-    page->page_id = page_id;
-    int rc = read_page_encrypted(pool, file, page_id, page->data);
-    if (rc != SPEEDSQL_OK) {
-        /* Read failed - put page back on free list */
-        page->page_id = INVALID_PAGE_ID;
-        page->lru_next = pool->free_list;
-        if (pool->free_list) {
-            pool->free_list->lru_prev = page;
+        /* Get a page to use */
+        bool relocked = false;
+        page = get_victim(pool, file, &relocked);
+        if (!page) {
+            mutex_unlock(&pool->lock);
+            return nullptr;  /* No pages available */
         }
-        pool->free_list = page;
-        mutex_unlock(&pool->lock);
-        return nullptr;
+
+        /* Another thread may have loaded it while the lock was dropped */
+        if (relocked && hash_find(pool, page_id)) {
+            free_list_push(pool, page);
+            continue;
+        }
+        break;
     }
 
-    page->state = BUF_CLEAN;
+    /* Cache miss: publish the page as BUF_IO, then read and decrypt it
+     * without the lock */
+    pool->misses++;
+    page->page_id = page_id;
+    page->state = BUF_IO;
     page->pin_count = 1;
-    page->last_access = get_timestamp_us();
-
-    /* Add to hash and LRU */
     hash_insert(pool, page);
     lru_insert_front(pool, page);
     pool->used_count++;
+    mutex_unlock(&pool->lock);
+
+    int rc = read_page_encrypted(pool, file, page_id, page->data);
 
+    mutex_lock(&pool->lock);
+    if (rc != SPEEDSQL_OK) {
+        /* Read failed - put page back on free list */
+        hash_remove(pool, page);
+        lru_remove(pool, page);
+        pool->used_count--;
+        free_list_push(pool, page);
+        page = nullptr;
+    } else {
+        page->state = BUF_CLEAN;
+        page->last_access = get_timestamp_us();
+    }
+    cond_broadcast(&pool->io_cond);
     mutex_unlock(&pool->lock);
+
     return page;
 }
 
 void buffer_pool_unpin(buffer_pool_t* pool, buffer_page_t* page, bool dirty) {
     if (!pool || !page) return;
+    if (pool->mem) return;  /* Nothing to pin or write back */
 
     mutex_lock(&pool->lock);
 
@@ -303,52 +428,149 @@ void buffer_pool_unpin(buffer_pool_t* pool, buffer_page_t* page, bool dirty) {
     mutex_unlock(&pool->lock);
 }
 
+/* Dirty pages claimed per flush round */
+#define FLUSH_BATCH 64
+
+typedef struct {
+    page_id_t page_id;
+    const uint8_t* plaintext;
+    uint8_t* ciphertext;
+    uint8_t* opened;             /* Set: decrypt ciphertext into it instead */
+    int rc;
+} crypt_job_t;
+
+static void crypt_run(buffer_pool_t* pool, crypt_job_t* jobs, size_t count);
+
+/* Write claimed pages in order; an encrypted batch is sealed by the crypto
+ * workers first. *written counts the pages that reached the file. */
+static int write_batch(buffer_pool_t* pool, file_t* file, buffer_page_t** batch,
+                       size_t count, uint8_t* images, size_t stride, size_t* written) {
+    *written = 0;
+
+    if (!images) {
+        for (size_t i = 0; i < count; i++) {
+            int rc = store_page_image(pool, file, batch[i]->page_id, batch[i]->data,
+                                      pool->page_size);
+            if (rc != SPEEDSQL_OK) return rc;
+            (*written)++;
+        }
+        return SPEEDSQL_OK;
+    }
+
+    crypt_job_t jobs[FLUSH_BATCH];
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].page_id = batch[i]->page_id;
+        jobs[i].plaintext = batch[i]->data;
+        jobs[i].ciphertext = images + i * stride;
+        jobs[i].opened = nullptr;
+        jobs[i].rc = SPEEDSQL_OK;
+    }
+    crypt_run(pool, jobs, count);
+
+    for (size_t i = 0; i < count; i++) {
+        if (jobs[i].rc != SPEEDSQL_OK) return jobs[i].rc;
+        int rc = store_page_image(pool, file, jobs[i].page_id, jobs[i].ciphertext, stride);
+        if (rc != SPEEDSQL_OK) return rc;
+        (*written)++;
+    }
+    return SPEEDSQL_OK;
+}
+
 int buffer_pool_flush(buffer_pool_t* pool, file_t* file) {
     if (!pool || !file) return SPEEDSQL_MISUSE;
+    if (pool->mem) return SPEEDSQL_OK;
 
-    mutex_lock(&pool->lock);
+    mutex_lock(&pool->flush_lock);
 
-    int rc = SPEEDSQL_OK;
+    /* Ciphertext for one batch */
+    size_t stride = (size_t)buffer_pool_disk_page_size(pool);
+    uint8_t* images = nullptr;
+    if (pool->cipher_ctx) {
+        images = (uint8_t*)sdb_malloc(FLUSH_BATCH * stride);
+        if (!images) {
+            mutex_unlock(&pool->flush_lock);
+            return SPEEDSQL_NOMEM;
+        }
+    }
 
-    /* Iterate through all pages in hash table */
-    for (size_t i = 0; i < pool->hash_size && rc == SPEEDSQL_OK; i++) {
-        buffer_page_t* page = pool->hash_table[i];
-        while (page) {
-            if (page->state == BUF_DIRTY) {
-                rc = write_page_encrypted(pool, file, page->page_id, page->data);
-                if (rc == SPEEDSQL_OK) {
+    int rc = SPEEDSQL_OK;
+    size_t bucket = 0;
+
+    while (rc == SPEEDSQL_OK) {
+        buffer_page_t* batch[FLUSH_BATCH];
+        size_t count = 0;
+
+        /* Claim dirty pages: pinned so they stay resident, clean so a write
+         * during the flush marks them dirty again */
+        mutex_lock(&pool->lock);
+        while (bucket < pool->hash_size && count < FLUSH_BATCH) {
+            buffer_page_t* page = pool->hash_table[bucket];
+            for (; page && count < FLUSH_BATCH; page = page->hash_next) {
+                if (page->state == BUF_DIRTY) {
+                    prepare_write_back(pool, page->page_id, page->data);
                     page->state = BUF_CLEAN;
+                    page->pin_count++;
+                    batch[count++] = page;
                 }
             }
-            page = page->hash_next;
+            if (count < FLUSH_BATCH) bucket++;
         }
+        mutex_unlock(&pool->lock);
+
+        if (count == 0) break;
+
+        size_t written = 0;
+        rc = write_batch(pool, file, batch, count, images, stride, &written);
+
+        mutex_lock(&pool->lock);
+        for (size_t i = 0; i < count; i++) {
+            batch[i]->pin_count--;
+            if (i >= written) {
+                batch[i]->state = BUF_DIRTY;
+            }
+        }
+        mutex_unlock(&pool->lock);
+    }
+
+    /* Evictions still writing back must land before the sync */
+    mutex_lock(&pool->lock);
+    while (pool->io_writes > 0) {
+        cond_wait(&pool->io_cond, &pool->lock);
     }
+    mutex_unlock(&pool->lock);
 
     if (rc == SPEEDSQL_OK) {
         rc = file_sync(file);
     }
 
-    mutex_unlock(&pool->lock);
+    sdb_free(images);
+    mutex_unlock(&pool->flush_lock);
     return rc;
 }
 
 buffer_page_t* buffer_pool_new_page(buffer_pool_t* pool, file_t* file, page_id_t* page_id_out) {
     if (!pool || !file || !page_id_out) return nullptr;
 
-    mutex_lock(&pool->lock);
+    if (pool->mem) {
+        return mem_store_new_page(pool->mem, page_id_out);
+    }
 
-    /* Calculate new page ID */
-    uint64_t current_file_size;
-    file_size(file, &current_file_size);
-    page_id_t new_page_id = current_file_size / pool->page_size;
+    mutex_lock(&pool->lock);
 
-    /* Get a page from free list or evict */
-    buffer_page_t* page = get_victim(pool, file);
+    /* Get a page from free list or evict (may drop the lock, so the new
+     * page ID is only taken afterwards) */
+    bool relocked = false;
+    buffer_page_t* page = get_victim(pool, file, &relocked);
     if (!page) {
         mutex_unlock(&pool->lock);
         return nullptr;
     }
 
+    /* Calculate new page ID */
+    uint64_t current_file_size;
+    file_size(file, &current_file_size);
+    page_id_t new_page_id = current_file_size / pool->page_size;
+
     /* Initialize new page */
     page->page_id = new_page_id;
     memset(page->data, 0, pool->page_size);
@@ -357,15 +579,9 @@ buffer_page_t* buffer_pool_new_page(buffer_pool_t* pool, file_t* file, page_id_t
     page->last_access = get_timestamp_us();
 
     /* Extend file (with encryption if enabled) */
-    int rc = write_page_encrypted(pool, file, new_page_id, page->data);
+    int rc = write_back_page(pool, file, new_page_id, page->data);
     if (rc != SPEEDSQL_OK) {
-        page->page_id = INVALID_PAGE_ID;
-        page->state = BUF_INVALID;
-        page->lru_next = pool->free_list;
-        if (pool->free_list) {
-            pool->free_list->lru_prev = page;
-        }
-        pool->free_list = page;
+        free_list_push(pool, page);
         mutex_unlock(&pool->lock);
         return nullptr;
     }
@@ -381,12 +597,8 @@ buffer_page_t* buffer_pool_new_page(buffer_pool_t* pool, file_t* file, page_id_t
     return page;
 }
 
-/* Invalidate all dirty pages (for rollback) */
-int buffer_pool_invalidate_dirty(buffer_pool_t* pool, file_t* file) {
-    if (!pool || !file) return SPEEDSQL_MISUSE;
-
-    mutex_lock(&pool->lock);
-
+/* Drop cached pages so the next access rereads them. Caller holds pool->lock. */
+static void drop_pages(buffer_pool_t* pool, bool dirty_only) {
     /* Iterate through all pages in hash table */
     for (size_t i = 0; i < pool->hash_size; i++) {
         buffer_page_t* page = pool->hash_table[i];
@@ -395,7 +607,8 @@ int buffer_pool_invalidate_dirty(buffer_pool_t* pool, file_t* file) {
         while (page) {
             buffer_page_t* next = page->hash_next;
 
-            if (page->state == BUF_DIRTY) {
+            bool drop = dirty_only ? page->state == BUF_DIRTY : page->pin_count == 0;
+            if (drop) {
                 /* Remove from hash table */
                 if (prev) {
                     prev->hash_next = next;
@@ -435,11 +648,51 @@ int buffer_pool_invalidate_dirty(buffer_pool_t* pool, file_t* file) {
             page = next;
         }
     }
+}
+
+/* Invalidate all dirty pages (for rollback) */
+int buffer_pool_invalidate_dirty(buffer_pool_t* pool, file_t* file) {
+    if (!pool || !file) return SPEEDSQL_MISUSE;
 
+    /* In-memory pages go back to the images the transaction saved */
+    if (pool->mem) return mem_store_undo_restore(pool->mem);
+
+    mutex_lock(&pool->lock);
+    drop_pages(pool, true);
     mutex_unlock(&pool->lock);
     return SPEEDSQL_OK;
 }
 
+/* Discard every unpinned page (the file changed underneath the pool) */
+int buffer_pool_discard(buffer_pool_t* pool) {
+    if (!pool) return SPEEDSQL_MISUSE;
+    if (pool->mem) return SPEEDSQL_OK;
+
+    mutex_lock(&pool->lock);
+    drop_pages(pool, false);
+    mutex_unlock(&pool->lock);
+    return SPEEDSQL_OK;
+}
+
+/* A transaction begins: in-memory pages start keeping before-images for
+ * rollback. File pages need nothing, as the file holds the last commit. */
+int buffer_pool_txn_begin(buffer_pool_t* pool) {
+    if (!pool) return SPEEDSQL_MISUSE;
+    return pool->mem ? mem_store_undo_begin(pool->mem) : SPEEDSQL_OK;
+}
+
+/* Save before-images only while a writing statement runs, so reads in a
+ * transaction copy nothing */
+void buffer_pool_txn_arm(buffer_pool_t* pool, bool writing) {
+    if (!pool || !pool->mem || !pool->mem->undo_active) return;
+    __atomic_store_n(&pool->mem->undo_armed, writing, __ATOMIC_RELAXED);
+}
+
+/* The transaction committed or rolled back */
+void buffer_pool_txn_end(buffer_pool_t* pool) {
+    if (pool && pool->mem) mem_store_undo_end(pool->mem);
+}
+
 /* ============================================================================
  * Page-Level Encryption Support
  * ============================================================================ */
@@ -447,28 +700,113 @@ int buffer_pool_invalidate_dirty(buffer_pool_t* pool, file_t* file) {
 int buffer_pool_set_encryption(buffer_pool_t* pool, struct speedsql_cipher_ctx* ctx, speedsql_cipher_t cipher_id) {
     if (!pool) return SPEEDSQL_MISUSE;
 
-    mutex_lock(&pool->lock);
+    /* No flush is sealing pages with the old context */
+    mutex_lock(&pool->flush_lock);
+
+    /* Fresh nonce base per key: aligned pages never reuse a nonce */
+    if (ctx) {
+        int rc = fresh_nonce_base(pool);
+        if (rc != SPEEDSQL_OK) {
+            mutex_unlock(&pool->flush_lock);
+            return rc;
+        }
+    }
 
+    mutex_lock(&pool->lock);
     pool->cipher_ctx = ctx;
     pool->cipher_id = cipher_id;
+    mutex_unlock(&pool->lock);
 
-    /* Allocate encryption buffer if needed */
-    if (ctx && !pool->crypt_buffer) {
-        /* Allocate buffer for encryption: page + IV + tag */
-        pool->crypt_buffer = (uint8_t*)sdb_malloc(pool->page_size + 32 + 16);
-        if (!pool->crypt_buffer) {
-            mutex_unlock(&pool->lock);
-            return SPEEDSQL_NOMEM;
+    /* One helper per spare core; the flushing thread is the last one */
+    if (ctx && !pool->workers && !pool->mem) {
+        uint32_t spare = cpu_count() - 1;
+        if (spare > CRYPT_MAX_WORKERS) spare = CRYPT_MAX_WORKERS;
+        if (spare > 0) {
+            pool->workers = crypt_workers_start(pool, (int)spare);
         }
+    } else if (!ctx) {
+        crypt_workers_stop(pool->workers);
+        pool->workers = nullptr;
+    }
+
+    mutex_unlock(&pool->flush_lock);
+    return SPEEDSQL_OK;
+}
+
+/* Reserve the tail of every page for nonce and tag (0: legacy layout
+ * with the tag appended after a full page) */
+int buffer_pool_set_page_reserve(buffer_pool_t* pool, uint32_t reserve) {
+    if (!pool || reserve >= pool->page_size / 2 || (reserve & 15)) {
+        return SPEEDSQL_MISUSE;
     }
 
+    mutex_lock(&pool->flush_lock);
+    mutex_lock(&pool->lock);
+    pool->page_reserve = reserve;
+    pool->usable_size = pool->page_size - reserve;
     mutex_unlock(&pool->lock);
+    mutex_unlock(&pool->flush_lock);
     return SPEEDSQL_OK;
 }
 
-/* Encrypt a page before writing to disk */
-static int encrypt_page(buffer_pool_t* pool, page_id_t page_id,
-                        const uint8_t* plaintext, uint8_t* ciphertext) {
+/* Tail bytes a cipher needs in the aligned layout: nonce + tag, rounded
+ * so the encrypted span stays a whole number of cipher blocks */
+uint32_t buffer_pool_reserve_for(speedsql_cipher_t cipher_id) {
+    const speedsql_cipher_provider_t* provider = speedsql_get_cipher(cipher_id);
+    if (!provider || cipher_id == SPEEDSQL_CIPHER_NONE) return 0;
+    return (uint32_t)((provider->iv_size + provider->tag_size + 15) & ~(size_t)15);
+}
+
+/* Draw a new nonce base, for a new key */
+static int fresh_nonce_base(buffer_pool_t* pool) {
+    uint8_t base[sizeof(pool->nonce_base)];
+    int rc = speedsql_random_key(base, sizeof(base));
+    if (rc != SPEEDSQL_OK) return rc;
+
+    mutex_lock(&pool->nonce_lock);
+    memcpy(pool->nonce_base, base, sizeof(base));
+    pool->nonce_seq = 0;
+    mutex_unlock(&pool->nonce_lock);
+    speedsql_secure_zero(base, sizeof(base));
+    return SPEEDSQL_OK;
+}
+
+/* Next write nonce: the per-key random base plus a counter, so no two
+ * writes under one key share a nonce */
+static void next_nonce(buffer_pool_t* pool, size_t len, uint8_t* nonce) {
+    mutex_lock(&pool->nonce_lock);
+    uint64_t seq = pool->nonce_seq++;
+    memcpy(nonce, pool->nonce_base, len);
+    mutex_unlock(&pool->nonce_lock);
+
+    uint64_t low;
+    memcpy(&low, nonce, sizeof(low));
+    low += seq;
+    memcpy(nonce, &low, sizeof(low));
+}
+
+/* Ciphertext scratch for single-page reads and writes, one per thread so
+ * concurrent I/O never shares a buffer */
+static uint8_t* crypt_scratch(size_t size) {
+    struct scratch_t {
+        uint8_t* buf;
+        size_t size;
+        ~scratch_t() { sdb_free(buf); }
+    };
+    static thread_local scratch_t scratch = {nullptr, 0};
+
+    if (scratch.size < size) {
+        uint8_t* buf = (uint8_t*)sdb_realloc(scratch.buf, size);
+        if (!buf) return nullptr;
+        scratch.buf = buf;
+        scratch.size = size;
+    }
+    return scratch.buf;
+}
+
+/* Seal a page with the current key */
+static int seal_page(buffer_pool_t* pool, page_id_t page_id,
+                     const uint8_t* plaintext, uint8_t* ciphertext) {
     if (!pool->cipher_ctx) {
         /* No encryption - just copy */
         memcpy(ciphertext, plaintext, pool->page_size);
@@ -480,9 +818,28 @@ static int encrypt_page(buffer_pool_t* pool, page_id_t page_id,
         return SPEEDSQL_ERROR;
     }
 
+    uint64_t page_id_64 = page_id;
+
+    /* Aligned layout: [ciphertext][nonce][tag][zero pad] in page_size bytes */
+    if (pool->page_reserve) {
+        size_t usable = (size_t)pool->usable_size;
+        uint8_t* nonce = ciphertext + usable;
+        uint8_t tag[16] = {0};
+
+        memset(nonce, 0, pool->page_size - usable);
+        next_nonce(pool, provider->iv_size, nonce);
+
+        int rc = provider->encrypt(pool->cipher_ctx, plaintext, usable, nonce,
+                                   (const uint8_t*)&page_id_64, sizeof(page_id_64),
+                                   ciphertext, tag);
+        if (rc != SPEEDSQL_OK) return rc;
+
+        memcpy(nonce + provider->iv_size, tag, provider->tag_size);
+        return SPEEDSQL_OK;
+    }
+
     /* Generate IV from page ID (deterministic for same page, ensures unique IV) */
     uint8_t iv[24] = {0};  /* Max IV size */
-    uint64_t page_id_64 = page_id;
     memcpy(iv, &page_id_64, sizeof(page_id_64));
     /* Add some entropy to the IV */
     iv[8] = 0x53;  /* 'S' for SpeedSQL */
@@ -518,23 +875,39 @@ static int encrypt_page(buffer_pool_t* pool, page_id_t page_id,
     return SPEEDSQL_OK;
 }
 
-/* Decrypt a page after reading from disk */
-static int decrypt_page(buffer_pool_t* pool, page_id_t page_id,
-                        const uint8_t* ciphertext, uint8_t* plaintext) {
-    if (!pool->cipher_ctx) {
+/* Open a page sealed with the given key */
+static int open_page(buffer_pool_t* pool, struct speedsql_cipher_ctx* ctx,
+                     speedsql_cipher_t cipher_id, page_id_t page_id,
+                     const uint8_t* ciphertext, uint8_t* plaintext) {
+    if (!ctx) {
         /* No encryption - just copy */
         memcpy(plaintext, ciphertext, pool->page_size);
         return SPEEDSQL_OK;
     }
 
-    const speedsql_cipher_provider_t* provider = speedsql_get_cipher(pool->cipher_id);
+    const speedsql_cipher_provider_t* provider = speedsql_get_cipher(cipher_id);
     if (!provider || !provider->decrypt) {
         return SPEEDSQL_ERROR;
     }
 
+    uint64_t page_id_64 = page_id;
+
+    /* Aligned layout: nonce and tag sit in the page tail */
+    if (pool->page_reserve) {
+        size_t usable = (size_t)pool->usable_size;
+        const uint8_t* nonce = ciphertext + usable;
+
+        int rc = provider->decrypt(ctx, ciphertext, usable, nonce,
+                                   (const uint8_t*)&page_id_64, sizeof(page_id_64),
+                                   nonce + provider->iv_size, plaintext);
+        if (rc != SPEEDSQL_OK) return rc;
+
+        memset(plaintext + usable, 0, pool->page_size - usable);
+        return SPEEDSQL_OK;
+    }
+
     /* Reconstruct IV from page ID */
     uint8_t iv[24] = {0};
-    uint64_t page_id_64 = page_id;
     memcpy(iv, &page_id_64, sizeof(page_id_64));
     iv[8] = 0x53;
     iv[9] = 0x51;
@@ -549,7 +922,7 @@ static int decrypt_page(buffer_pool_t* pool, page_id_t page_id,
 
     /* Decrypt the page */
     int rc = provider->decrypt(
-        pool->cipher_ctx,
+        ctx,
         ciphertext,
         pool->page_size,
         iv,
@@ -562,6 +935,63 @@ static int decrypt_page(buffer_pool_t* pool, page_id_t page_id,
     return rc;
 }
 
+/* Record that a page is now sealed with the current key */
+static void rekey_mark(buffer_pool_t* pool, page_id_t page_id) {
+    mutex_lock(&pool->rekey_lock);
+    if (pool->rekey_bits && page_id < pool->rekey_pages) {
+        pool->rekey_bits[page_id / 8] |= (uint8_t)(1u << (page_id % 8));
+    }
+    mutex_unlock(&pool->rekey_lock);
+}
+
+/* Whether a page is known to be sealed with the current key */
+static bool rekey_current(buffer_pool_t* pool, page_id_t page_id) {
+    mutex_lock(&pool->rekey_lock);
+    bool current = !pool->rekey_bits || page_id >= pool->rekey_pages ||
+                   ((pool->rekey_bits[page_id / 8] >> (page_id % 8)) & 1);
+    mutex_unlock(&pool->rekey_lock);
+    return current;
+}
+
+/* Encrypt a page before writing to disk */
+static int encrypt_page(buffer_pool_t* pool, page_id_t page_id,
+                        const uint8_t* plaintext, uint8_t* ciphertext) {
+    int rc = seal_page(pool, page_id, plaintext, ciphertext);
+    if (rc == SPEEDSQL_OK) {
+        rekey_mark(pool, page_id);
+    }
+    return rc;
+}
+
+/* Decrypt a page after reading from disk. While a rekey runs a page may be
+ * under either key; the likelier one is tried first. */
+static int decrypt_page(buffer_pool_t* pool, page_id_t page_id,
+                        const uint8_t* ciphertext, uint8_t* plaintext) {
+    /* The old key stays alive until this read is done with it */
+    rwlock_rdlock(&pool->rekey_rw);
+
+    struct speedsql_cipher_ctx* old_ctx = pool->old_cipher_ctx;
+    speedsql_cipher_t old_id = pool->old_cipher_id;
+    int rc;
+
+    if (!old_ctx) {
+        rc = open_page(pool, pool->cipher_ctx, pool->cipher_id, page_id, ciphertext, plaintext);
+    } else if (rekey_current(pool, page_id)) {
+        rc = open_page(pool, pool->cipher_ctx, pool->cipher_id, page_id, ciphertext, plaintext);
+        if (rc != SPEEDSQL_OK) {
+            rc = open_page(pool, old_ctx, old_id, page_id, ciphertext, plaintext);
+        }
+    } else {
+        rc = open_page(pool, old_ctx, old_id, page_id, ciphertext, plaintext);
+        if (rc != SPEEDSQL_OK) {
+            rc = open_page(pool, pool->cipher_ctx, pool->cipher_id, page_id, ciphertext, plaintext);
+        }
+    }
+
+    rwlock_unlock(&pool->rekey_rw);
+    return rc;
+}
+
 /* Read page from disk with decryption */
 static int read_page_encrypted(buffer_pool_t* pool, file_t* file,
                                page_id_t page_id, uint8_t* data) {
@@ -570,20 +1000,19 @@ static int read_page_encrypted(buffer_pool_t* pool, file_t* file,
         return file_read(file, page_id * pool->page_size, data, pool->page_size);
     }
 
-    const speedsql_cipher_provider_t* provider = speedsql_get_cipher(pool->cipher_id);
-    size_t encrypted_size = pool->page_size;
-    if (provider && provider->tag_size > 0) {
-        encrypted_size += provider->tag_size;
-    }
+    size_t encrypted_size = (size_t)buffer_pool_disk_page_size(pool);
+
+    uint8_t* scratch = crypt_scratch(encrypted_size);
+    if (!scratch) return SPEEDSQL_NOMEM;
 
     /* Read encrypted page into temp buffer */
-    int rc = file_read(file, page_id * encrypted_size, pool->crypt_buffer, encrypted_size);
+    int rc = file_read(file, page_id * encrypted_size, scratch, encrypted_size);
     if (rc != SPEEDSQL_OK) {
         return rc;
     }
 
     /* Decrypt into destination */
-    return decrypt_page(pool, page_id, pool->crypt_buffer, data);
+    return decrypt_page(pool, page_id, scratch, data);
 }
 
 /* Write page to disk with encryption */
@@ -591,21 +1020,543 @@ static int write_page_encrypted(buffer_pool_t* pool, file_t* file,
                                 page_id_t page_id, const uint8_t* data) {
     if (!pool->cipher_ctx) {
         /* No encryption - direct write */
-        return file_write(file, page_id * pool->page_size, data, pool->page_size);
+        return store_page_image(pool, file, page_id, data, pool->page_size);
     }
 
-    const speedsql_cipher_provider_t* provider = speedsql_get_cipher(pool->cipher_id);
-    size_t encrypted_size = pool->page_size;
-    if (provider && provider->tag_size > 0) {
-        encrypted_size += provider->tag_size;
-    }
+    size_t encrypted_size = (size_t)buffer_pool_disk_page_size(pool);
+
+    uint8_t* scratch = crypt_scratch(encrypted_size);
+    if (!scratch) return SPEEDSQL_NOMEM;
 
     /* Encrypt into temp buffer */
-    int rc = encrypt_page(pool, page_id, data, pool->crypt_buffer);
+    int rc = encrypt_page(pool, page_id, data, scratch);
     if (rc != SPEEDSQL_OK) {
         return rc;
     }
 
-    /* Write encrypted page */
-    return file_write(file, page_id * encrypted_size, pool->crypt_buffer, encrypted_size);
+    return store_page_image(pool, file, page_id, scratch, encrypted_size);
+}
+
+/* Write an on-disk page image at its slot. The write-back hook sees it
+ * first, so with encryption a replica gets the ciphertext and stays
+ * byte-identical. */
+static int store_page_image(buffer_pool_t* pool, file_t* file, page_id_t page_id,
+                            const uint8_t* image, size_t size) {
+    if (pool->on_write_back) {
+        int rc = pool->on_write_back(pool->on_write_back_arg, page_id, image, size);
+        if (rc != SPEEDSQL_OK) return rc;
+    }
+    return file_write(file, page_id * size, image, size);
+}
+
+/* ============================================================================
+ * Crypto Workers
+ *
+ * Flush and checkpoint seal dirty pages in batches, and a rekey opens and
+ * reseals pages the same way. A batch is shared by a few helper threads
+ * and the calling thread, which claim pages from a common cursor; the
+ * file writes that follow stay sequential.
+ * ============================================================================ */
+
+struct crypt_workers {
+    buffer_pool_t* pool;
+    thread_t* threads;
+    int count;
+    mutex_t lock;
+    cond_t wake;                 /* A batch was posted, or stop was set */
+    cond_t done;                 /* The last helper finished the batch */
+    uint64_t generation;         /* Bumped for every batch */
+    int active;                  /* Helpers still on the current batch */
+    bool stop;
+    crypt_job_t* jobs;           /* Current batch */
+    size_t job_count;
+    size_t next;                 /* Next unclaimed job */
+};
+
+static void crypt_job_run(buffer_pool_t* pool, crypt_job_t* job) {
+    if (job->opened) {
+        job->rc = decrypt_page(pool, job->page_id, job->ciphertext, job->opened);
+    } else {
+        job->rc = encrypt_page(pool, job->page_id, job->plaintext, job->ciphertext);
+    }
+}
+
+/* Claim and run jobs until the batch is exhausted */
+static void crypt_drain(struct crypt_workers* w) {
+    for (;;) {
+        mutex_lock(&w->lock);
+        size_t i = w->next < w->job_count ? w->next++ : w->job_count;
+        crypt_job_t* job = i < w->job_count ? &w->jobs[i] : nullptr;
+        mutex_unlock(&w->lock);
+
+        if (!job) return;
+        crypt_job_run(w->pool, job);
+    }
+}
+
+static void* crypt_worker_main(void* arg) {
+    struct crypt_workers* w = (struct crypt_workers*)arg;
+    uint64_t seen = 0;
+
+    mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->stop && w->generation == seen) {
+            cond_wait(&w->wake, &w->lock);
+        }
+        if (w->stop) break;
+        seen = w->generation;
+        mutex_unlock(&w->lock);
+
+        crypt_drain(w);
+
+        mutex_lock(&w->lock);
+        if (--w->active == 0) {
+            cond_signal(&w->done);
+        }
+    }
+    mutex_unlock(&w->lock);
+    return nullptr;
+}
+
+static struct crypt_workers* crypt_workers_start(buffer_pool_t* pool, int threads) {
+    struct crypt_workers* w = (struct crypt_workers*)sdb_calloc(1, sizeof(*w));
+    if (!w) return nullptr;
+
+    w->threads = (thread_t*)sdb_calloc((size_t)threads, sizeof(thread_t));
+    if (!w->threads) {
+        sdb_free(w);
+        return nullptr;
+    }
+
+    w->pool = pool;
+    mutex_init(&w->lock);
+    cond_init(&w->wake);
+    cond_init(&w->done);
+
+    for (int i = 0; i < threads; i++) {
+        if (thread_create(&w->threads[w->count], crypt_worker_main, w) != SPEEDSQL_OK) {
+            break;
+        }
+        w->count++;
+    }
+
+    if (w->count == 0) {
+        crypt_workers_stop(w);
+        return nullptr;
+    }
+    return w;
+}
+
+static void crypt_workers_stop(struct crypt_workers* w) {
+    if (!w) return;
+
+    mutex_lock(&w->lock);
+    w->stop = true;
+    cond_broadcast(&w->wake);
+    mutex_unlock(&w->lock);
+
+    for (int i = 0; i < w->count; i++) {
+        thread_join(w->threads[i]);
+    }
+
+    cond_destroy(&w->done);
+    cond_destroy(&w->wake);
+    mutex_destroy(&w->lock);
+    sdb_free(w->threads);
+    sdb_free(w);
+}
+
+/* Run a batch, in parallel when helpers are running */
+static void crypt_run(buffer_pool_t* pool, crypt_job_t* jobs, size_t count) {
+    struct crypt_workers* w = pool->workers;
+
+    if (!w || count < 2) {
+        for (size_t i = 0; i < count; i++) {
+            crypt_job_run(pool, &jobs[i]);
+        }
+        return;
+    }
+
+    mutex_lock(&w->lock);
+    w->jobs = jobs;
+    w->job_count = count;
+    w->next = 0;
+    w->active = w->count;
+    w->generation++;
+    cond_broadcast(&w->wake);
+    mutex_unlock(&w->lock);
+
+    crypt_drain(w);
+
+    mutex_lock(&w->lock);
+    while (w->active > 0) {
+        cond_wait(&w->done, &w->lock);
+    }
+    w->jobs = nullptr;
+    w->job_count = 0;
+    mutex_unlock(&w->lock);
+}
+
+/* Replace the helpers with `threads` new ones (0: the flushing thread only) */
+int buffer_pool_set_crypt_threads(buffer_pool_t* pool, int threads) {
+    if (!pool || threads < 0) return SPEEDSQL_MISUSE;
+
+    mutex_lock(&pool->flush_lock);
+
+    crypt_workers_stop(pool->workers);
+    pool->workers = nullptr;
+
+    int rc = SPEEDSQL_OK;
+    if (threads > 0) {
+        pool->workers = crypt_workers_start(pool, threads);
+        if (!pool->workers) rc = SPEEDSQL_NOMEM;
+    }
+
+    mutex_unlock(&pool->flush_lock);
+    return rc;
+}
+
+/* ============================================================================
+ * Change Tracking
+ *
+ * Every page leaving the pool is stamped with the current transaction ID
+ * in its header, which lets incremental backups find pages changed since
+ * a given transaction. While tracking is on, written page IDs are also
+ * recorded in a bitmap so an online backup can recopy pages that changed
+ * underneath it.
+ * ============================================================================ */
+
+/* Stamp and track a page about to be written back. Caller holds pool->lock. */
+static void prepare_write_back(buffer_pool_t* pool, page_id_t page_id, uint8_t* data) {
+    if (pool->stamp_txn) {
+        ((page_header_t*)data)->txn_id = pool->stamp_txn;
+    }
+    track_write(pool, page_id);
+}
+
+/* Record a page write for an online backup. Caller holds pool->lock. */
+static void track_write(buffer_pool_t* pool, page_id_t page_id) {
+    if (pool->tracking) {
+        size_t byte = (size_t)(page_id / 8);
+        if (byte >= pool->track_bytes) {
+            size_t new_bytes = pool->track_bytes ? pool->track_bytes : 1024;
+            while (new_bytes <= byte) {
+                new_bytes *= 2;
+            }
+
+            uint8_t* bits = (uint8_t*)sdb_realloc(pool->track_bits, new_bytes);
+            if (bits) {
+                memset(bits + pool->track_bytes, 0, new_bytes - pool->track_bytes);
+                pool->track_bits = bits;
+                pool->track_bytes = new_bytes;
+            } else {
+                pool->track_lost = true;
+            }
+        }
+
+        if (byte < pool->track_bytes) {
+            pool->track_bits[byte] |= (uint8_t)(1u << (page_id % 8));
+        }
+    }
+}
+
+/* Write a page back to disk, stamping and tracking it. Caller holds pool->lock. */
+static int write_back_page(buffer_pool_t* pool, file_t* file,
+                           page_id_t page_id, uint8_t* data) {
+    prepare_write_back(pool, page_id, data);
+    return write_page_encrypted(pool, file, page_id, data);
+}
+
+/* Bytes each page occupies on disk (page + tag when encrypted, unless the
+ * tag lives in the reserved page tail) */
+uint64_t buffer_pool_disk_page_size(buffer_pool_t* pool) {
+    if (!pool) return 0;
+
+    uint64_t size = pool->page_size;
+    if (pool->cipher_ctx && !pool->page_reserve) {
+        const speedsql_cipher_provider_t* provider = speedsql_get_cipher(pool->cipher_id);
+        if (provider && provider->tag_size > 0) {
+            size += provider->tag_size;
+        }
+    }
+    return size;
+}
+
+/* Start recording written pages */
+int buffer_pool_track_begin(buffer_pool_t* pool) {
+    if (!pool) return SPEEDSQL_MISUSE;
+
+    mutex_lock(&pool->lock);
+
+    if (pool->tracking) {
+        mutex_unlock(&pool->lock);
+        return SPEEDSQL_BUSY;
+    }
+
+    if (pool->track_bits) {
+        memset(pool->track_bits, 0, pool->track_bytes);
+    }
+    pool->tracking = true;
+    pool->track_lost = false;
+
+    mutex_unlock(&pool->lock);
+    return SPEEDSQL_OK;
+}
+
+/* Stop recording and hand the bitmap to the caller (who frees it) */
+int buffer_pool_track_end(buffer_pool_t* pool, uint8_t** bits, size_t* bytes) {
+    if (!pool || !bits || !bytes) return SPEEDSQL_MISUSE;
+
+    mutex_lock(&pool->lock);
+
+    int rc = pool->track_lost ? SPEEDSQL_NOMEM : SPEEDSQL_OK;
+
+    *bits = pool->track_bits;
+    *bytes = pool->track_bytes;
+    pool->track_bits = nullptr;
+    pool->track_bytes = 0;
+    pool->tracking = false;
+    pool->track_lost = false;
+
+    mutex_unlock(&pool->lock);
+    return rc;
+}
+
+/* ============================================================================
+ * Online Rekey
+ *
+ * A rekey installs the new key at once and keeps the old one until every
+ * page has been resealed. rekey_bits marks the pages known to be under
+ * the new key: every write sets its bit, and reads try the likelier key
+ * first and fall back to the other. The rekey job (rekey.cpp) walks the
+ * file in batches to reseal the remaining pages while the pool stays in
+ * use.
+ * ============================================================================ */
+
+/* Install a new key, keeping the current one for pages not yet resealed.
+ * Pages below first_page are not pool pages and are never resealed. */
+int buffer_pool_rekey_begin(buffer_pool_t* pool, file_t* file, struct speedsql_cipher_ctx* ctx,
+                            speedsql_cipher_t cipher_id, page_id_t first_page, page_id_t* page_count) {
+    if (!pool || !file || !ctx || !page_count || pool->mem) return SPEEDSQL_MISUSE;
+
+    mutex_lock(&pool->flush_lock);
+
+    if (!pool->cipher_ctx || pool->old_cipher_ctx) {
+        mutex_unlock(&pool->flush_lock);
+        return pool->old_cipher_ctx ? SPEEDSQL_BUSY : SPEEDSQL_MISUSE;
+    }
+
+    uint64_t size = 0;
+    file_size(file, &size);
+    page_id_t pages = size / buffer_pool_disk_page_size(pool);
+
+    uint8_t* bits = (uint8_t*)sdb_calloc((size_t)(pages / 8 + 1), 1);
+    if (!bits) {
+        mutex_unlock(&pool->flush_lock);
+        return SPEEDSQL_NOMEM;
+    }
+    for (page_id_t id = 0; id < first_page && id < pages; id++) {
+        bits[id / 8] |= (uint8_t)(1u << (id % 8));
+    }
+
+    int rc = fresh_nonce_base(pool);
+    if (rc != SPEEDSQL_OK) {
+        sdb_free(bits);
+        mutex_unlock(&pool->flush_lock);
+        return rc;
+    }
+
+    rwlock_wrlock(&pool->rekey_rw);
+    mutex_lock(&pool->lock);
+    mutex_lock(&pool->rekey_lock);
+    pool->old_cipher_ctx = pool->cipher_ctx;
+    pool->old_cipher_id = pool->cipher_id;
+    pool->cipher_ctx = ctx;
+    pool->cipher_id = cipher_id;
+    pool->rekey_bits = bits;
+    pool->rekey_pages = pages;
+    mutex_unlock(&pool->rekey_lock);
+    mutex_unlock(&pool->lock);
+    rwlock_unlock(&pool->rekey_rw);
+
+    mutex_unlock(&pool->flush_lock);
+
+    *page_count = pages;
+    return SPEEDSQL_OK;
+}
+
+/* Never-written slots (file holes) have nothing to reseal */
+static bool page_is_hole(const uint8_t* image, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (image[i]) return false;
+    }
+    return true;
+}
+
+/* Reseal the pages in [first, first + count) still under the old key,
+ * from their on-disk images. Uncached pages are claimed with a BUF_IO
+ * placeholder so readers wait for the new image; clean cached pages are
+ * pinned so no eviction writes them meanwhile. Dirty pages are left to
+ * their own write-back. Caller holds the connection lock. */
+int buffer_pool_rekey_pages(buffer_pool_t* pool, file_t* file, page_id_t first, size_t count,
+                            uint64_t* resealed) {
+    if (!pool || !file || !resealed) return SPEEDSQL_MISUSE;
+    *resealed = 0;
+    if (count > FLUSH_BATCH) count = FLUSH_BATCH;
+
+    mutex_lock(&pool->flush_lock);
+
+    mutex_lock(&pool->rekey_lock);
+    bool active = pool->rekey_bits != nullptr;
+    if (first >= pool->rekey_pages) {
+        count = 0;
+    } else if (first + count > pool->rekey_pages) {
+        count = (size_t)(pool->rekey_pages - first);
+    }
+    mutex_unlock(&pool->rekey_lock);
+
+    if (!active || count == 0) {
+        mutex_unlock(&pool->flush_lock);
+        return active ? SPEEDSQL_OK : SPEEDSQL_MISUSE;
+    }
+
+    size_t stride = (size_t)buffer_pool_disk_page_size(pool);
+    uint8_t* images = (uint8_t*)sdb_malloc(count * stride);
+    uint8_t* plain = (uint8_t*)sdb_malloc(count * pool->page_size);
+    if (!images || !plain) {
+        sdb_free(images);
+        sdb_free(plain);
+        mutex_unlock(&pool->flush_lock);
+        return SPEEDSQL_NOMEM;
+    }
+
+    buffer_page_t holders[FLUSH_BATCH];
+    buffer_page_t* claimed[FLUSH_BATCH];
+    size_t slot[FLUSH_BATCH];
+    size_t claim_count = 0;
+
+    mutex_lock(&pool->lock);
+    for (size_t i = 0; i < count; i++) {
+        page_id_t id = first + i;
+        if (rekey_current(pool, id)) continue;
+
+        buffer_page_t* page = hash_find(pool, id);
+        if (page) {
+            if (page->state != BUF_CLEAN) continue;
+            page->pin_count++;
+        } else {
+            page = &holders[claim_count];
+            memset(page, 0, sizeof(*page));
+            page->page_id = id;
+            page->state = BUF_IO;
+            page->pin_count = 1;
+            hash_insert(pool, page);
+        }
+        claimed[claim_count] = page;
+        slot[claim_count] = i;
+        claim_count++;
+    }
+    mutex_unlock(&pool->lock);
+
+    int rc = SPEEDSQL_OK;
+    if (claim_count > 0) {
+        rc = file_read(file, first * stride, images, count * stride);
+    }
+
+    /* Open with whichever key sealed each page */
+    crypt_job_t jobs[FLUSH_BATCH];
+    size_t job_count = 0;
+    for (size_t c = 0; c < claim_count && rc == SPEEDSQL_OK; c++) {
+        uint8_t* image = images + slot[c] * stride;
+        if (page_is_hole(image, stride)) {
+            rekey_mark(pool, claimed[c]->page_id);
+            continue;
+        }
+
+        crypt_job_t* job = &jobs[job_count++];
+        job->page_id = claimed[c]->page_id;
+        job->plaintext = plain + slot[c] * pool->page_size;
+        job->ciphertext = image;
+        job->opened = plain + slot[c] * pool->page_size;
+        job->rc = SPEEDSQL_OK;
+    }
+    if (rc == SPEEDSQL_OK) {
+        crypt_run(pool, jobs, job_count);
+        for (size_t j = 0; j < job_count && rc == SPEEDSQL_OK; j++) {
+            rc = jobs[j].rc;
+        }
+    }
+
+    /* Seal with the current key and write back in file order */
+    if (rc == SPEEDSQL_OK) {
+        mutex_lock(&pool->lock);
+        for (size_t j = 0; j < job_count; j++) {
+            track_write(pool, jobs[j].page_id);
+            jobs[j].opened = nullptr;
+        }
+        mutex_unlock(&pool->lock);
+
+        crypt_run(pool, jobs, job_count);
+        for (size_t j = 0; j < job_count && rc == SPEEDSQL_OK; j++) {
+            rc = jobs[j].rc;
+            if (rc == SPEEDSQL_OK) {
+                rc = store_page_image(pool, file, jobs[j].page_id, jobs[j].ciphertext, stride);
+            }
+            if (rc == SPEEDSQL_OK) {
+                (*resealed)++;
+            }
+        }
+    }
+
+    /* Release the claims */
+    mutex_lock(&pool->lock);
+    for (size_t c = 0; c < claim_count; c++) {
+        if (claimed[c] == &holders[c]) {
+            hash_remove(pool, claimed[c]);
+        } else {
+            claimed[c]->pin_count--;
+        }
+    }
+    cond_broadcast(&pool->io_cond);
+    mutex_unlock(&pool->lock);
+
+    sdb_free(images);
+    sdb_free(plain);
+    mutex_unlock(&pool->flush_lock);
+    return rc;
+}
+
+/* Pages still to reseal */
+uint64_t buffer_pool_rekey_pending(buffer_pool_t* pool) {
+    if (!pool) return 0;
+
+    mutex_lock(&pool->rekey_lock);
+    uint64_t pending = 0;
+    for (page_id_t id = 0; pool->rekey_bits && id < pool->rekey_pages; id++) {
+        if (!((pool->rekey_bits[id / 8] >> (id % 8)) & 1)) pending++;
+    }
+    mutex_unlock(&pool->rekey_lock);
+    return pending;
+}
+
+/* Forget the previous key and hand it back for the caller to destroy */
+struct speedsql_cipher_ctx* buffer_pool_rekey_end(buffer_pool_t* pool, speedsql_cipher_t* old_id) {
+    if (!pool) return nullptr;
+
+    mutex_lock(&pool->flush_lock);
+    rwlock_wrlock(&pool->rekey_rw);
+    mutex_lock(&pool->rekey_lock);
+
+    struct speedsql_cipher_ctx* old_ctx = pool->old_cipher_ctx;
+    if (old_id) *old_id = pool->old_cipher_id;
+    pool->old_cipher_ctx = nullptr;
+    pool->old_cipher_id = SPEEDSQL_CIPHER_NONE;
+    sdb_free(pool->rekey_bits);
+    pool->rekey_bits = nullptr;
+    pool->rekey_pages = 0;
+
+    mutex_unlock(&pool->rekey_lock);
+    rwlock_unlock(&pool->rekey_rw);
+    mutex_unlock(&pool->flush_lock);
+    return old_ctx;
 }
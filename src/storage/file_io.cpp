@@ -1,5 +1,7 @@
 /*
  * SpeedSQL - Cross-platform file I/O
+ *
+ * Thread primitives and the native VFS backend
  */
 
 #include "speedsql_internal.h"
@@ -44,33 +46,109 @@ void rwlock_unlock(rwlock_t* rw) {
     ReleaseSRWLockExclusive(rw);
 }
 
-int file_open(file_t* f, const char* path, int flags) {
-    if (!f || !path) return SPEEDSQL_MISUSE;
+void cond_init(cond_t* c) {
+    InitializeConditionVariable(c);
+}
+
+void cond_destroy(cond_t* c) {
+    (void)c;  /* Condition variables don't need destruction */
+}
+
+void cond_wait(cond_t* c, mutex_t* m) {
+    SleepConditionVariableCS(c, m, INFINITE);
+}
+
+void cond_signal(cond_t* c) {
+    WakeConditionVariable(c);
+}
 
-    memset(f, 0, sizeof(*f));
-    f->path = sdb_strdup(path);
-    if (!f->path) return SPEEDSQL_NOMEM;
+void cond_broadcast(cond_t* c) {
+    WakeAllConditionVariable(c);
+}
+
+static BOOL CALLBACK once_trampoline(PINIT_ONCE once, PVOID param, PVOID* ctx) {
+    (void)once;
+    (void)ctx;
+    ((void (*)(void))param)();
+    return TRUE;
+}
+
+void once_run(once_t* once, void (*fn)(void)) {
+    InitOnceExecuteOnce(once, once_trampoline, (PVOID)fn, NULL);
+}
+
+typedef struct {
+    void* (*fn)(void*);
+    void* arg;
+} thread_start_t;
+
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+    thread_start_t start = *(thread_start_t*)param;
+    sdb_free(param);
+    start.fn(start.arg);
+    return 0;
+}
 
-    rwlock_init(&f->lock);
+int thread_create(thread_t* t, void* (*fn)(void*), void* arg) {
+    thread_start_t* start = (thread_start_t*)sdb_malloc(sizeof(thread_start_t));
+    if (!start) return SPEEDSQL_NOMEM;
+    start->fn = fn;
+    start->arg = arg;
+
+    *t = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (!*t) {
+        sdb_free(start);
+        return SPEEDSQL_ERROR;
+    }
+    return SPEEDSQL_OK;
+}
+
+void thread_join(thread_t t) {
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+
+void thread_sleep_ms(uint32_t ms) {
+    Sleep(ms);
+}
+
+/* Native VFS backend (Win32) */
+typedef struct {
+    HANDLE handle;
+    uint64_t size;
+    bool readonly;
+    int lock_level;
+    rwlock_t lock;
+} native_file_t;
+
+/* Lock byte range well past any real data so locks never block I/O */
+#define NATIVE_LOCK_OFFSET_HIGH 0x7FFFFFFF
+
+static int native_open(speedsql_vfs* vfs, const char* path, int flags,
+                       speedsql_vfs_file** file_out) {
+    (void)vfs;
+
+    native_file_t* nf = (native_file_t*)sdb_calloc(1, sizeof(native_file_t));
+    if (!nf) return SPEEDSQL_NOMEM;
 
     DWORD access = 0;
-    DWORD share = FILE_SHARE_READ;
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE;
     DWORD creation = 0;
 
-    if (flags & 1) {  /* Read-write */
+    if (flags & SPEEDSQL_VFS_OPEN_READWRITE) {
         access = GENERIC_READ | GENERIC_WRITE;
     } else {
         access = GENERIC_READ;
-        f->readonly = true;
+        nf->readonly = true;
     }
 
-    if (flags & 2) {  /* Create */
+    if (flags & SPEEDSQL_VFS_OPEN_CREATE) {
         creation = OPEN_ALWAYS;
     } else {
         creation = OPEN_EXISTING;
     }
 
-    f->handle = CreateFileA(
+    nf->handle = CreateFileA(
         path,
         access,
         share,
@@ -80,60 +158,44 @@ int file_open(file_t* f, const char* path, int flags) {
         NULL
     );
 
-    if (f->handle == INVALID_HANDLE_VALUE) {
-        sdb_free(f->path);
-        f->path = nullptr;
+    if (nf->handle == INVALID_HANDLE_VALUE) {
+        sdb_free(nf);
         return SPEEDSQL_CANTOPEN;
     }
 
     /* Get file size */
     LARGE_INTEGER size;
-    if (GetFileSizeEx(f->handle, &size)) {
-        f->size = size.QuadPart;
+    if (GetFileSizeEx(nf->handle, &size)) {
+        nf->size = size.QuadPart;
     }
 
+    rwlock_init(&nf->lock);
+    *file_out = (speedsql_vfs_file*)nf;
     return SPEEDSQL_OK;
 }
 
-int file_close(file_t* f) {
-    if (!f) return SPEEDSQL_MISUSE;
-
-    if (f->handle != INVALID_HANDLE_VALUE) {
-        CloseHandle(f->handle);
-        f->handle = INVALID_HANDLE_VALUE;
-    }
-
-    if (f->path) {
-        sdb_free(f->path);
-        f->path = nullptr;
-    }
+static int native_close(speedsql_vfs_file* file) {
+    native_file_t* nf = (native_file_t*)file;
 
-    rwlock_destroy(&f->lock);
+    CloseHandle(nf->handle);
+    rwlock_destroy(&nf->lock);
+    sdb_free(nf);
     return SPEEDSQL_OK;
 }
 
-int file_read(file_t* f, uint64_t offset, void* buf, size_t len) {
-    if (!f) return SPEEDSQL_MISUSE;
-
-    /* In-memory database: return zeros (data is in buffer pool) */
-    if (f->handle == INVALID_HANDLE_VALUE) {
-        if (f->path && strcmp(f->path, ":memory:") == 0) {
-            memset(buf, 0, len);
-            return SPEEDSQL_OK;
-        }
-        return SPEEDSQL_MISUSE;
-    }
+static int native_read(speedsql_vfs_file* file, uint64_t offset, void* buf, size_t len) {
+    native_file_t* nf = (native_file_t*)file;
 
-    rwlock_rdlock(&f->lock);
+    rwlock_rdlock(&nf->lock);
 
     OVERLAPPED ov = {0};
     ov.Offset = (DWORD)(offset & 0xFFFFFFFF);
     ov.OffsetHigh = (DWORD)(offset >> 32);
 
     DWORD read = 0;
-    BOOL ok = ReadFile(f->handle, buf, (DWORD)len, &read, &ov);
+    BOOL ok = ReadFile(nf->handle, buf, (DWORD)len, &read, &ov);
 
-    rwlock_unlock(&f->lock);
+    rwlock_unlock(&nf->lock);
 
     if (!ok || read != len) {
         return SPEEDSQL_IOERR;
@@ -142,36 +204,25 @@ int file_read(file_t* f, uint64_t offset, void* buf, size_t len) {
     return SPEEDSQL_OK;
 }
 
-int file_write(file_t* f, uint64_t offset, const void* buf, size_t len) {
-    if (!f) return SPEEDSQL_MISUSE;
+static int native_write(speedsql_vfs_file* file, uint64_t offset, const void* buf, size_t len) {
+    native_file_t* nf = (native_file_t*)file;
 
-    /* In-memory database: update size only, no actual I/O */
-    if (f->handle == INVALID_HANDLE_VALUE) {
-        if (f->path && strcmp(f->path, ":memory:") == 0) {
-            if (offset + len > f->size) {
-                f->size = offset + len;
-            }
-            return SPEEDSQL_OK;
-        }
-        return SPEEDSQL_MISUSE;
-    }
-
-    if (f->readonly) return SPEEDSQL_READONLY;
+    if (nf->readonly) return SPEEDSQL_READONLY;
 
-    rwlock_wrlock(&f->lock);
+    rwlock_wrlock(&nf->lock);
 
     OVERLAPPED ov = {0};
     ov.Offset = (DWORD)(offset & 0xFFFFFFFF);
     ov.OffsetHigh = (DWORD)(offset >> 32);
 
     DWORD written = 0;
-    BOOL ok = WriteFile(f->handle, buf, (DWORD)len, &written, &ov);
+    BOOL ok = WriteFile(nf->handle, buf, (DWORD)len, &written, &ov);
 
-    if (ok && offset + len > f->size) {
-        f->size = offset + len;
+    if (ok && offset + len > nf->size) {
+        nf->size = offset + len;
     }
 
-    rwlock_unlock(&f->lock);
+    rwlock_unlock(&nf->lock);
 
     if (!ok || written != len) {
         return SPEEDSQL_IOERR;
@@ -180,59 +231,112 @@ int file_write(file_t* f, uint64_t offset, const void* buf, size_t len) {
     return SPEEDSQL_OK;
 }
 
-int file_sync(file_t* f) {
-    if (!f) return SPEEDSQL_MISUSE;
-
-    /* In-memory database: no-op */
-    if (f->handle == INVALID_HANDLE_VALUE) {
-        if (f->path && strcmp(f->path, ":memory:") == 0) {
-            return SPEEDSQL_OK;
-        }
-        return SPEEDSQL_MISUSE;
-    }
+static int native_sync(speedsql_vfs_file* file) {
+    native_file_t* nf = (native_file_t*)file;
 
-    if (!FlushFileBuffers(f->handle)) {
+    if (!FlushFileBuffers(nf->handle)) {
         return SPEEDSQL_IOERR;
     }
 
     return SPEEDSQL_OK;
 }
 
-int file_truncate(file_t* f, uint64_t size) {
-    if (!f) return SPEEDSQL_MISUSE;
+static int native_truncate(speedsql_vfs_file* file, uint64_t size) {
+    native_file_t* nf = (native_file_t*)file;
 
-    /* In-memory database: just update size */
-    if (f->handle == INVALID_HANDLE_VALUE) {
-        if (f->path && strcmp(f->path, ":memory:") == 0) {
-            f->size = size;
-            return SPEEDSQL_OK;
-        }
-        return SPEEDSQL_MISUSE;
-    }
-
-    if (f->readonly) return SPEEDSQL_READONLY;
+    if (nf->readonly) return SPEEDSQL_READONLY;
 
     LARGE_INTEGER li;
     li.QuadPart = size;
 
-    if (!SetFilePointerEx(f->handle, li, NULL, FILE_BEGIN)) {
+    if (!SetFilePointerEx(nf->handle, li, NULL, FILE_BEGIN)) {
         return SPEEDSQL_IOERR;
     }
 
-    if (!SetEndOfFile(f->handle)) {
+    if (!SetEndOfFile(nf->handle)) {
         return SPEEDSQL_IOERR;
     }
 
-    f->size = size;
+    nf->size = size;
     return SPEEDSQL_OK;
 }
 
-int file_size(file_t* f, uint64_t* size) {
-    if (!f || !size) return SPEEDSQL_MISUSE;
-    *size = f->size;
+static int native_file_size(speedsql_vfs_file* file, uint64_t* size) {
+    native_file_t* nf = (native_file_t*)file;
+    *size = nf->size;
     return SPEEDSQL_OK;
 }
 
+static int native_lock(speedsql_vfs_file* file, int level) {
+    native_file_t* nf = (native_file_t*)file;
+
+    if (level == nf->lock_level) return SPEEDSQL_OK;
+
+    /* Windows cannot convert a lock in place: release, then reacquire */
+    if (nf->lock_level != SPEEDSQL_LOCK_NONE) {
+        OVERLAPPED ov = {0};
+        ov.OffsetHigh = NATIVE_LOCK_OFFSET_HIGH;
+        UnlockFileEx(nf->handle, 0, 1, 0, &ov);
+        nf->lock_level = SPEEDSQL_LOCK_NONE;
+    }
+
+    if (level == SPEEDSQL_LOCK_NONE) return SPEEDSQL_OK;
+
+    DWORD lock_flags = LOCKFILE_FAIL_IMMEDIATELY;
+    if (level == SPEEDSQL_LOCK_EXCLUSIVE) {
+        lock_flags |= LOCKFILE_EXCLUSIVE_LOCK;
+    }
+
+    OVERLAPPED ov = {0};
+    ov.OffsetHigh = NATIVE_LOCK_OFFSET_HIGH;
+    if (!LockFileEx(nf->handle, lock_flags, 0, 1, 0, &ov)) {
+        return SPEEDSQL_BUSY;
+    }
+
+    nf->lock_level = level;
+    return SPEEDSQL_OK;
+}
+
+static int native_mmap(speedsql_vfs_file* file, uint64_t offset, size_t len, void** addr) {
+    native_file_t* nf = (native_file_t*)file;
+
+    HANDLE mapping = CreateFileMappingA(nf->handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) return SPEEDSQL_IOERR;
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ,
+                               (DWORD)(offset >> 32), (DWORD)(offset & 0xFFFFFFFF), len);
+
+    /* The view keeps the mapping object alive */
+    CloseHandle(mapping);
+
+    if (!view) return SPEEDSQL_IOERR;
+
+    *addr = view;
+    return SPEEDSQL_OK;
+}
+
+static int native_munmap(speedsql_vfs_file* file, void* addr, size_t len) {
+    (void)file;
+    (void)len;
+    return UnmapViewOfFile(addr) ? SPEEDSQL_OK : SPEEDSQL_IOERR;
+}
+
+speedsql_vfs g_vfs_native = {
+    "win32",
+    nullptr,
+    native_open,
+    native_close,
+    native_read,
+    native_write,
+    native_sync,
+    native_truncate,
+    native_file_size,
+    native_lock,
+    native_mmap,
+    native_munmap,
+    nullptr                      /* No reflink support */
+};
+
 uint64_t get_timestamp_us(void) {
     LARGE_INTEGER freq, counter;
     QueryPerformanceFrequency(&freq);
@@ -245,9 +349,19 @@ uint64_t get_timestamp_us(void) {
 /* POSIX implementation */
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/file.h>
 #include <errno.h>
 #include <time.h>
 
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/fs.h>)
+        #include <linux/fs.h>
+        #include <sys/ioctl.h>
+    #endif
+#elif defined(__APPLE__)
+    #include <sys/clonefile.h>
+#endif
+
 void mutex_init(mutex_t* m) {
     pthread_mutex_init(m, NULL);
 }
@@ -284,77 +398,107 @@ void rwlock_unlock(rwlock_t* rw) {
     pthread_rwlock_unlock(rw);
 }
 
-int file_open(file_t* f, const char* path, int flags) {
-    if (!f || !path) return SPEEDSQL_MISUSE;
+void cond_init(cond_t* c) {
+    pthread_cond_init(c, NULL);
+}
 
-    memset(f, 0, sizeof(*f));
-    f->path = sdb_strdup(path);
-    if (!f->path) return SPEEDSQL_NOMEM;
+void cond_destroy(cond_t* c) {
+    pthread_cond_destroy(c);
+}
 
-    rwlock_init(&f->lock);
+void cond_wait(cond_t* c, mutex_t* m) {
+    pthread_cond_wait(c, m);
+}
+
+void cond_signal(cond_t* c) {
+    pthread_cond_signal(c);
+}
+
+void cond_broadcast(cond_t* c) {
+    pthread_cond_broadcast(c);
+}
+
+void once_run(once_t* once, void (*fn)(void)) {
+    pthread_once(once, fn);
+}
+
+int thread_create(thread_t* t, void* (*fn)(void*), void* arg) {
+    return pthread_create(t, NULL, fn, arg) == 0 ? SPEEDSQL_OK : SPEEDSQL_ERROR;
+}
+
+void thread_join(thread_t t) {
+    pthread_join(t, NULL);
+}
+
+void thread_sleep_ms(uint32_t ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+/* Native VFS backend (POSIX) */
+typedef struct {
+    int fd;
+    uint64_t size;
+    bool readonly;
+    rwlock_t lock;
+} native_file_t;
+
+static int native_open(speedsql_vfs* vfs, const char* path, int flags,
+                       speedsql_vfs_file** file_out) {
+    (void)vfs;
+
+    native_file_t* nf = (native_file_t*)sdb_calloc(1, sizeof(native_file_t));
+    if (!nf) return SPEEDSQL_NOMEM;
 
     int oflags = 0;
-    if (flags & 1) {
+    if (flags & SPEEDSQL_VFS_OPEN_READWRITE) {
         oflags = O_RDWR;
     } else {
         oflags = O_RDONLY;
-        f->readonly = true;
+        nf->readonly = true;
     }
 
-    if (flags & 2) {
+    if (flags & SPEEDSQL_VFS_OPEN_CREATE) {
         oflags |= O_CREAT;
     }
 
-    f->handle = open(path, oflags, 0644);
-    if (f->handle == INVALID_FILE_HANDLE) {
-        sdb_free(f->path);
-        f->path = nullptr;
+    nf->fd = open(path, oflags, 0644);
+    if (nf->fd == INVALID_FILE_HANDLE) {
+        sdb_free(nf);
         return SPEEDSQL_CANTOPEN;
     }
 
     /* Get file size */
     struct stat st;
-    if (fstat(f->handle, &st) == 0) {
-        f->size = st.st_size;
+    if (fstat(nf->fd, &st) == 0) {
+        nf->size = st.st_size;
     }
 
+    rwlock_init(&nf->lock);
+    *file_out = (speedsql_vfs_file*)nf;
     return SPEEDSQL_OK;
 }
 
-int file_close(file_t* f) {
-    if (!f) return SPEEDSQL_MISUSE;
-
-    if (f->handle != INVALID_FILE_HANDLE) {
-        close(f->handle);
-        f->handle = INVALID_FILE_HANDLE;
-    }
-
-    if (f->path) {
-        sdb_free(f->path);
-        f->path = nullptr;
-    }
+static int native_close(speedsql_vfs_file* file) {
+    native_file_t* nf = (native_file_t*)file;
 
-    rwlock_destroy(&f->lock);
+    close(nf->fd);
+    rwlock_destroy(&nf->lock);
+    sdb_free(nf);
     return SPEEDSQL_OK;
 }
 
-int file_read(file_t* f, uint64_t offset, void* buf, size_t len) {
-    if (!f) return SPEEDSQL_MISUSE;
+static int native_read(speedsql_vfs_file* file, uint64_t offset, void* buf, size_t len) {
+    native_file_t* nf = (native_file_t*)file;
 
-    /* In-memory database: return zeros (data is in buffer pool) */
-    if (f->handle == INVALID_FILE_HANDLE) {
-        if (f->path && strcmp(f->path, ":memory:") == 0) {
-            memset(buf, 0, len);
-            return SPEEDSQL_OK;
-        }
-        return SPEEDSQL_MISUSE;
-    }
-
-    rwlock_rdlock(&f->lock);
+    rwlock_rdlock(&nf->lock);
 
-    ssize_t n = pread(f->handle, buf, len, offset);
+    ssize_t n = pread(nf->fd, buf, len, offset);
 
-    rwlock_unlock(&f->lock);
+    rwlock_unlock(&nf->lock);
 
     if (n != (ssize_t)len) {
         return SPEEDSQL_IOERR;
@@ -363,31 +507,20 @@ int file_read(file_t* f, uint64_t offset, void* buf, size_t len) {
     return SPEEDSQL_OK;
 }
 
-int file_write(file_t* f, uint64_t offset, const void* buf, size_t len) {
-    if (!f) return SPEEDSQL_MISUSE;
-
-    /* In-memory database: update size only, no actual I/O */
-    if (f->handle == INVALID_FILE_HANDLE) {
-        if (f->path && strcmp(f->path, ":memory:") == 0) {
-            if (offset + len > f->size) {
-                f->size = offset + len;
-            }
-            return SPEEDSQL_OK;
-        }
-        return SPEEDSQL_MISUSE;
-    }
+static int native_write(speedsql_vfs_file* file, uint64_t offset, const void* buf, size_t len) {
+    native_file_t* nf = (native_file_t*)file;
 
-    if (f->readonly) return SPEEDSQL_READONLY;
+    if (nf->readonly) return SPEEDSQL_READONLY;
 
-    rwlock_wrlock(&f->lock);
+    rwlock_wrlock(&nf->lock);
 
-    ssize_t n = pwrite(f->handle, buf, len, offset);
+    ssize_t n = pwrite(nf->fd, buf, len, offset);
 
-    if (n > 0 && offset + len > f->size) {
-        f->size = offset + len;
+    if (n > 0 && offset + len > nf->size) {
+        nf->size = offset + len;
     }
 
-    rwlock_unlock(&f->lock);
+    rwlock_unlock(&nf->lock);
 
     if (n != (ssize_t)len) {
         return SPEEDSQL_IOERR;
@@ -396,52 +529,113 @@ int file_write(file_t* f, uint64_t offset, const void* buf, size_t len) {
     return SPEEDSQL_OK;
 }
 
-int file_sync(file_t* f) {
-    if (!f) return SPEEDSQL_MISUSE;
+static int native_sync(speedsql_vfs_file* file) {
+    native_file_t* nf = (native_file_t*)file;
 
-    /* In-memory database: no-op */
-    if (f->handle == INVALID_FILE_HANDLE) {
-        if (f->path && strcmp(f->path, ":memory:") == 0) {
-            return SPEEDSQL_OK;
-        }
-        return SPEEDSQL_MISUSE;
+    if (fsync(nf->fd) != 0) {
+        return SPEEDSQL_IOERR;
     }
 
-    if (fsync(f->handle) != 0) {
+    return SPEEDSQL_OK;
+}
+
+static int native_truncate(speedsql_vfs_file* file, uint64_t size) {
+    native_file_t* nf = (native_file_t*)file;
+
+    if (nf->readonly) return SPEEDSQL_READONLY;
+
+    if (ftruncate(nf->fd, size) != 0) {
         return SPEEDSQL_IOERR;
     }
 
+    nf->size = size;
     return SPEEDSQL_OK;
 }
 
-int file_truncate(file_t* f, uint64_t size) {
-    if (!f) return SPEEDSQL_MISUSE;
+static int native_file_size(speedsql_vfs_file* file, uint64_t* size) {
+    native_file_t* nf = (native_file_t*)file;
+    *size = nf->size;
+    return SPEEDSQL_OK;
+}
 
-    /* In-memory database: just update size */
-    if (f->handle == INVALID_FILE_HANDLE) {
-        if (f->path && strcmp(f->path, ":memory:") == 0) {
-            f->size = size;
-            return SPEEDSQL_OK;
-        }
-        return SPEEDSQL_MISUSE;
-    }
+static int native_lock(speedsql_vfs_file* file, int level) {
+    native_file_t* nf = (native_file_t*)file;
 
-    if (f->readonly) return SPEEDSQL_READONLY;
+    /* flock locks belong to the open file description, so two connections
+     * in one process see each other's locks (fcntl locks would not) */
+    int op = LOCK_UN;
+    if (level == SPEEDSQL_LOCK_SHARED) {
+        op = LOCK_SH | LOCK_NB;
+    } else if (level == SPEEDSQL_LOCK_EXCLUSIVE) {
+        op = LOCK_EX | LOCK_NB;
+    }
 
-    if (ftruncate(f->handle, size) != 0) {
-        return SPEEDSQL_IOERR;
+    if (flock(nf->fd, op) != 0) {
+        return (errno == EWOULDBLOCK) ? SPEEDSQL_BUSY : SPEEDSQL_IOERR;
     }
 
-    f->size = size;
     return SPEEDSQL_OK;
 }
 
-int file_size(file_t* f, uint64_t* size) {
-    if (!f || !size) return SPEEDSQL_MISUSE;
-    *size = f->size;
+static int native_mmap(speedsql_vfs_file* file, uint64_t offset, size_t len, void** addr) {
+    native_file_t* nf = (native_file_t*)file;
+
+    void* p = mmap(NULL, len, PROT_READ, MAP_SHARED, nf->fd, (off_t)offset);
+    if (p == MAP_FAILED) return SPEEDSQL_IOERR;
+
+    *addr = p;
+    return SPEEDSQL_OK;
+}
+
+static int native_munmap(speedsql_vfs_file* file, void* addr, size_t len) {
+    (void)file;
+    return munmap(addr, len) == 0 ? SPEEDSQL_OK : SPEEDSQL_IOERR;
+}
+
+/* Share extents with a new file; only filesystems with reflinks (btrfs,
+ * XFS, APFS) support this, everyone else gets SPEEDSQL_NOTFOUND */
+int file_reflink_fd(int src_fd, const char* dest_path) {
+#if defined(FICLONE)
+    int fd = open(dest_path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) return SPEEDSQL_CANTOPEN;
+
+    if (ioctl(fd, FICLONE, src_fd) != 0) {
+        close(fd);
+        unlink(dest_path);
+        return SPEEDSQL_NOTFOUND;
+    }
+
+    close(fd);
     return SPEEDSQL_OK;
+#elif defined(__APPLE__)
+    return fclonefileat(src_fd, AT_FDCWD, dest_path, 0) == 0 ? SPEEDSQL_OK : SPEEDSQL_NOTFOUND;
+#else
+    (void)src_fd;
+    (void)dest_path;
+    return SPEEDSQL_NOTFOUND;
+#endif
 }
 
+static int native_clone(speedsql_vfs_file* file, const char* dest_path) {
+    return file_reflink_fd(((native_file_t*)file)->fd, dest_path);
+}
+
+speedsql_vfs g_vfs_native = {
+    "unix",
+    nullptr,
+    native_open,
+    native_close,
+    native_read,
+    native_write,
+    native_sync,
+    native_truncate,
+    native_file_size,
+    native_lock,
+    native_mmap,
+    native_munmap,
+    native_clone
+};
+
 uint64_t get_timestamp_us(void) {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
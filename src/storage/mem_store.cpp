@@ -0,0 +1,227 @@
+/*
+ * SpeedSQL - In-Memory Page Store
+ *
+ * Backing store for :memory: databases. Pages live in a two-level page
+ * table indexed directly by page ID, so lookups are two array loads with
+ * no hashing, pinning, LRU maintenance or eviction. Pages are allocated
+ * on demand instead of pre-allocating a full frame pool.
+ */
+
+#include "speedsql_internal.h"
+
+/* Page table geometry: MEM_STORE_DIR_SIZE chunks of MEM_STORE_CHUNK_SIZE
+ * page slots each. The directory never moves, so readers need no lock:
+ * chunks and pages are published with release stores and read with
+ * acquire loads. */
+#define MEM_STORE_CHUNK_BITS 10
+#define MEM_STORE_CHUNK_SIZE (1u << MEM_STORE_CHUNK_BITS)
+#define MEM_STORE_DIR_SIZE 4096
+
+/* Pages 0 and 1 are reserved for the header and schema so that a
+ * snapshot has the same layout as a file database */
+#define MEM_STORE_FIRST_PAGE 2
+
+int mem_store_init(mem_store_t* store, uint32_t page_size) {
+    if (!store || page_size == 0) return SPEEDSQL_MISUSE;
+
+    memset(store, 0, sizeof(*store));
+    store->page_size = page_size;
+    store->next_page = MEM_STORE_FIRST_PAGE;
+
+    store->dir = (buffer_page_t***)sdb_calloc(MEM_STORE_DIR_SIZE, sizeof(buffer_page_t**));
+    if (!store->dir) return SPEEDSQL_NOMEM;
+
+    mutex_init(&store->lock);
+    return SPEEDSQL_OK;
+}
+
+void mem_store_destroy(mem_store_t* store) {
+    if (!store || !store->dir) return;
+
+    mem_store_undo_end(store);
+
+    for (size_t d = 0; d < MEM_STORE_DIR_SIZE; d++) {
+        buffer_page_t** chunk = store->dir[d];
+        if (!chunk) continue;
+
+        for (size_t i = 0; i < MEM_STORE_CHUNK_SIZE; i++) {
+            if (chunk[i]) {
+                sdb_free(chunk[i]->data);
+                sdb_free(chunk[i]);
+            }
+        }
+        sdb_free(chunk);
+    }
+
+    sdb_free(store->dir);
+    store->dir = nullptr;
+    mutex_destroy(&store->lock);
+}
+
+buffer_page_t* mem_store_get(mem_store_t* store, page_id_t page_id) {
+    size_t d = (size_t)(page_id >> MEM_STORE_CHUNK_BITS);
+    if (d >= MEM_STORE_DIR_SIZE) return nullptr;
+
+    buffer_page_t** chunk = __atomic_load_n(&store->dir[d], __ATOMIC_ACQUIRE);
+    if (!chunk) return nullptr;
+
+    return __atomic_load_n(&chunk[page_id & (MEM_STORE_CHUNK_SIZE - 1)], __ATOMIC_ACQUIRE);
+}
+
+buffer_page_t* mem_store_new_page(mem_store_t* store, page_id_t* page_id_out) {
+    if (!store || !page_id_out) return nullptr;
+
+    mutex_lock(&store->lock);
+
+    page_id_t page_id = store->next_page;
+    size_t d = (size_t)(page_id >> MEM_STORE_CHUNK_BITS);
+    if (d >= MEM_STORE_DIR_SIZE) {
+        mutex_unlock(&store->lock);
+        return nullptr;
+    }
+
+    buffer_page_t** chunk = store->dir[d];
+    if (!chunk) {
+        chunk = (buffer_page_t**)sdb_calloc(MEM_STORE_CHUNK_SIZE, sizeof(buffer_page_t*));
+        if (!chunk) {
+            mutex_unlock(&store->lock);
+            return nullptr;
+        }
+        __atomic_store_n(&store->dir[d], chunk, __ATOMIC_RELEASE);
+    }
+
+    buffer_page_t* page = (buffer_page_t*)sdb_calloc(1, sizeof(buffer_page_t));
+    if (!page) {
+        mutex_unlock(&store->lock);
+        return nullptr;
+    }
+
+    page->data = (uint8_t*)sdb_calloc(1, store->page_size);
+    if (!page->data) {
+        sdb_free(page);
+        mutex_unlock(&store->lock);
+        return nullptr;
+    }
+
+    page->page_id = page_id;
+    page->state = BUF_CLEAN;
+
+    __atomic_store_n(&chunk[page_id & (MEM_STORE_CHUNK_SIZE - 1)], page, __ATOMIC_RELEASE);
+    store->next_page++;
+    store->page_count++;
+
+    *page_id_out = page_id;
+
+    mutex_unlock(&store->lock);
+    return page;
+}
+
+/* Write every page to file at its natural offset */
+int mem_store_snapshot(mem_store_t* store, file_t* file) {
+    if (!store || !file) return SPEEDSQL_MISUSE;
+
+    mutex_lock(&store->lock);
+
+    int rc = SPEEDSQL_OK;
+    for (page_id_t id = MEM_STORE_FIRST_PAGE; id < store->next_page && rc == SPEEDSQL_OK; id++) {
+        buffer_page_t* page = mem_store_get(store, id);
+        if (!page) continue;
+        rc = file_write(file, id * store->page_size, page->data, store->page_size);
+    }
+
+    mutex_unlock(&store->lock);
+    return rc;
+}
+
+/* ============================================================================
+ * Transaction Undo
+ * ============================================================================ */
+
+/* Pages have no copy elsewhere to fall back to, so a transaction keeps
+ * the image each existing page had when it began. Pages allocated by the
+ * transaction need none. */
+int mem_store_undo_begin(mem_store_t* store) {
+    if (!store) return SPEEDSQL_MISUSE;
+
+    mutex_lock(&store->lock);
+    store->undo_active = true;
+    __atomic_store_n(&store->undo_armed, false, __ATOMIC_RELAXED);
+    store->undo_lost = false;
+    store->undo_pages = store->next_page;
+    mutex_unlock(&store->lock);
+    return SPEEDSQL_OK;
+}
+
+/* Save a page's image unless the transaction already holds one */
+void mem_store_undo_save(mem_store_t* store, buffer_page_t* page) {
+    page_id_t id = page->page_id;
+    if (id >= store->undo_pages) return;
+
+    uint8_t** images = __atomic_load_n(&store->undo_images, __ATOMIC_ACQUIRE);
+    if (images && __atomic_load_n(&images[id], __ATOMIC_ACQUIRE)) return;
+
+    mutex_lock(&store->lock);
+    if (!store->undo_active) {
+        mutex_unlock(&store->lock);
+        return;
+    }
+
+    images = store->undo_images;
+    if (!images) {
+        images = (uint8_t**)sdb_calloc(store->undo_pages, sizeof(uint8_t*));
+        if (!images) {
+            store->undo_lost = true;
+            mutex_unlock(&store->lock);
+            return;
+        }
+        __atomic_store_n(&store->undo_images, images, __ATOMIC_RELEASE);
+    }
+
+    if (!images[id]) {
+        uint8_t* image = (uint8_t*)sdb_malloc(store->page_size);
+        if (image) {
+            memcpy(image, page->data, store->page_size);
+            __atomic_store_n(&images[id], image, __ATOMIC_RELEASE);
+        } else {
+            store->undo_lost = true;
+        }
+    }
+    mutex_unlock(&store->lock);
+}
+
+/* Put every saved page back as the transaction found it. The images are
+ * kept, so the transaction can go on and be rolled back again. */
+int mem_store_undo_restore(mem_store_t* store) {
+    if (!store) return SPEEDSQL_MISUSE;
+
+    mutex_lock(&store->lock);
+    if (store->undo_images) {
+        for (page_id_t id = 0; id < store->undo_pages; id++) {
+            uint8_t* image = store->undo_images[id];
+            buffer_page_t* page = image ? mem_store_get(store, id) : nullptr;
+            if (page) memcpy(page->data, image, store->page_size);
+        }
+    }
+    int rc = store->undo_lost ? SPEEDSQL_NOMEM : SPEEDSQL_OK;
+    mutex_unlock(&store->lock);
+    return rc;
+}
+
+/* Drop the saved images when the transaction ends */
+void mem_store_undo_end(mem_store_t* store) {
+    if (!store) return;
+
+    mutex_lock(&store->lock);
+    if (store->undo_images) {
+        for (page_id_t id = 0; id < store->undo_pages; id++) {
+            sdb_free(store->undo_images[id]);
+        }
+        sdb_free(store->undo_images);
+        __atomic_store_n(&store->undo_images, (uint8_t**)nullptr, __ATOMIC_RELEASE);
+    }
+    store->undo_active = false;
+    __atomic_store_n(&store->undo_armed, false, __ATOMIC_RELAXED);
+    store->undo_lost = false;
+    store->undo_pages = 0;
+    mutex_unlock(&store->lock);
+}
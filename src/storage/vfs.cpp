@@ -0,0 +1,277 @@
+/*
+ * SpeedSQL - VFS Registry
+ *
+ * Routes file_* calls to the VFS that opened the file and manages
+ * registration of built-in and custom backends
+ */
+
+#include "speedsql_internal.h"
+
+/* Maximum number of registered VFS backends */
+#define MAX_VFS 16
+
+/* VFS registry */
+static struct {
+    speedsql_vfs* vfs[MAX_VFS];
+    int count;
+    int builtin_count;
+    speedsql_vfs* default_vfs;
+    mutex_t lock;
+} g_vfs_registry = {};
+
+static once_t g_vfs_registry_once = ONCE_INIT;
+
+static void vfs_registry_setup(void) {
+    mutex_init(&g_vfs_registry.lock);
+    g_vfs_registry.count = 0;
+
+    /* Register built-in backends */
+    g_vfs_registry.vfs[g_vfs_registry.count++] = &g_vfs_native;
+#ifdef SPEEDSQL_HAVE_IO_URING
+    g_vfs_registry.vfs[g_vfs_registry.count++] = &g_vfs_io_uring;
+#endif
+    g_vfs_registry.vfs[g_vfs_registry.count++] = &g_vfs_memory;
+
+    g_vfs_registry.builtin_count = g_vfs_registry.count;
+    g_vfs_registry.default_vfs = &g_vfs_native;
+}
+
+/* Initialize VFS registry (safe to race: the first caller sets it up) */
+static void vfs_registry_init(void) {
+    once_run(&g_vfs_registry_once, vfs_registry_setup);
+}
+
+/* Register a VFS */
+SPEEDSQL_API int speedsql_vfs_register(speedsql_vfs* vfs, int make_default) {
+    if (!vfs || !vfs->name || !vfs->open || !vfs->close || !vfs->read ||
+        !vfs->write || !vfs->sync || !vfs->truncate || !vfs->file_size) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    vfs_registry_init();
+    mutex_lock(&g_vfs_registry.lock);
+
+    /* Check for duplicate name */
+    for (int i = 0; i < g_vfs_registry.count; i++) {
+        if (g_vfs_registry.vfs[i] == vfs) {
+            /* Re-registering only changes the default */
+            if (make_default) g_vfs_registry.default_vfs = vfs;
+            mutex_unlock(&g_vfs_registry.lock);
+            return SPEEDSQL_OK;
+        }
+        if (strcmp(g_vfs_registry.vfs[i]->name, vfs->name) == 0) {
+            mutex_unlock(&g_vfs_registry.lock);
+            return SPEEDSQL_CONSTRAINT;  /* Name already taken */
+        }
+    }
+
+    if (g_vfs_registry.count >= MAX_VFS) {
+        mutex_unlock(&g_vfs_registry.lock);
+        return SPEEDSQL_FULL;
+    }
+
+    g_vfs_registry.vfs[g_vfs_registry.count++] = vfs;
+    if (make_default) g_vfs_registry.default_vfs = vfs;
+
+    mutex_unlock(&g_vfs_registry.lock);
+    return SPEEDSQL_OK;
+}
+
+/* Unregister a custom VFS (built-in backends stay registered) */
+SPEEDSQL_API int speedsql_vfs_unregister(speedsql_vfs* vfs) {
+    if (!vfs) return SPEEDSQL_MISUSE;
+
+    vfs_registry_init();
+    mutex_lock(&g_vfs_registry.lock);
+
+    for (int i = 0; i < g_vfs_registry.count; i++) {
+        if (g_vfs_registry.vfs[i] != vfs) continue;
+
+        if (i < g_vfs_registry.builtin_count) {
+            mutex_unlock(&g_vfs_registry.lock);
+            return SPEEDSQL_MISUSE;
+        }
+
+        /* Shift remaining entries */
+        for (int j = i; j < g_vfs_registry.count - 1; j++) {
+            g_vfs_registry.vfs[j] = g_vfs_registry.vfs[j + 1];
+        }
+        g_vfs_registry.count--;
+
+        if (g_vfs_registry.default_vfs == vfs) {
+            g_vfs_registry.default_vfs = &g_vfs_native;
+        }
+
+        mutex_unlock(&g_vfs_registry.lock);
+        return SPEEDSQL_OK;
+    }
+
+    mutex_unlock(&g_vfs_registry.lock);
+    return SPEEDSQL_NOTFOUND;
+}
+
+/* Find a VFS by name */
+SPEEDSQL_API speedsql_vfs* speedsql_vfs_find(const char* name) {
+    vfs_registry_init();
+    mutex_lock(&g_vfs_registry.lock);
+
+    speedsql_vfs* found = nullptr;
+    if (!name) {
+        found = g_vfs_registry.default_vfs;
+    } else {
+        for (int i = 0; i < g_vfs_registry.count; i++) {
+            if (strcmp(g_vfs_registry.vfs[i]->name, name) == 0) {
+                found = g_vfs_registry.vfs[i];
+                break;
+            }
+        }
+    }
+
+    mutex_unlock(&g_vfs_registry.lock);
+    return found;
+}
+
+/* ============================================================================
+ * File operations
+ *
+ * A file_t with no VFS is detached: it belongs to a :memory: database whose
+ * pages live in the buffer pool, so I/O on it is a no-op.
+ * ============================================================================ */
+
+int file_open(file_t* f, const char* path, int flags) {
+    return file_open_vfs(f, nullptr, path, flags);
+}
+
+int file_open_vfs(file_t* f, speedsql_vfs* vfs, const char* path, int flags) {
+    if (!f || !path) return SPEEDSQL_MISUSE;
+
+    memset(f, 0, sizeof(*f));
+
+    if (!vfs) vfs = speedsql_vfs_find(nullptr);
+    if (!vfs) return SPEEDSQL_CANTOPEN;
+
+    f->path = sdb_strdup(path);
+    if (!f->path) return SPEEDSQL_NOMEM;
+
+    int rc = vfs->open(vfs, path, flags, &f->handle);
+    if (rc != SPEEDSQL_OK) {
+        sdb_free(f->path);
+        f->path = nullptr;
+        return rc;
+    }
+
+    f->vfs = vfs;
+    f->readonly = !(flags & SPEEDSQL_VFS_OPEN_READWRITE);
+    return SPEEDSQL_OK;
+}
+
+int file_close(file_t* f) {
+    if (!f) return SPEEDSQL_MISUSE;
+
+    if (f->vfs && f->handle) {
+        f->vfs->close(f->handle);
+    }
+    f->vfs = nullptr;
+    f->handle = nullptr;
+
+    if (f->path) {
+        sdb_free(f->path);
+        f->path = nullptr;
+    }
+
+    return SPEEDSQL_OK;
+}
+
+int file_read(file_t* f, uint64_t offset, void* buf, size_t len) {
+    if (!f) return SPEEDSQL_MISUSE;
+
+    /* Detached file: no stored data */
+    if (!f->vfs) {
+        memset(buf, 0, len);
+        return SPEEDSQL_OK;
+    }
+
+    return f->vfs->read(f->handle, offset, buf, len);
+}
+
+int file_write(file_t* f, uint64_t offset, const void* buf, size_t len) {
+    if (!f) return SPEEDSQL_MISUSE;
+    if (!f->vfs) return SPEEDSQL_OK;
+    if (f->readonly) return SPEEDSQL_READONLY;
+
+    if (f->before_write) {
+        int rc = f->before_write(f->before_write_arg, offset, len);
+        if (rc != SPEEDSQL_OK) return rc;
+    }
+
+    return f->vfs->write(f->handle, offset, buf, len);
+}
+
+int file_sync(file_t* f) {
+    if (!f) return SPEEDSQL_MISUSE;
+    if (!f->vfs) return SPEEDSQL_OK;
+
+    return f->vfs->sync(f->handle);
+}
+
+int file_truncate(file_t* f, uint64_t size) {
+    if (!f) return SPEEDSQL_MISUSE;
+    if (!f->vfs) return SPEEDSQL_OK;
+    if (f->readonly) return SPEEDSQL_READONLY;
+
+    if (f->before_write) {
+        uint64_t old_size = 0;
+        f->vfs->file_size(f->handle, &old_size);
+        if (old_size > size) {
+            int rc = f->before_write(f->before_write_arg, size, old_size - size);
+            if (rc != SPEEDSQL_OK) return rc;
+        }
+    }
+
+    return f->vfs->truncate(f->handle, size);
+}
+
+int file_size(file_t* f, uint64_t* size) {
+    if (!f || !size) return SPEEDSQL_MISUSE;
+
+    if (!f->vfs) {
+        *size = 0;
+        return SPEEDSQL_OK;
+    }
+
+    return f->vfs->file_size(f->handle, size);
+}
+
+int file_lock(file_t* f, int level) {
+    if (!f) return SPEEDSQL_MISUSE;
+
+    /* Backends without locking behave as single-process stores */
+    if (!f->vfs || !f->vfs->lock) return SPEEDSQL_OK;
+
+    return f->vfs->lock(f->handle, level);
+}
+
+int file_mmap(file_t* f, uint64_t offset, size_t len, void** addr) {
+    if (!f || !addr) return SPEEDSQL_MISUSE;
+
+    /* Callers fall back to file_read when mapping is unavailable */
+    if (!f->vfs || !f->vfs->mmap) return SPEEDSQL_NOTFOUND;
+
+    return f->vfs->mmap(f->handle, offset, len, addr);
+}
+
+int file_munmap(file_t* f, void* addr, size_t len) {
+    if (!f || !addr) return SPEEDSQL_MISUSE;
+    if (!f->vfs || !f->vfs->munmap) return SPEEDSQL_MISUSE;
+
+    return f->vfs->munmap(f->handle, addr, len);
+}
+
+int file_clone(file_t* f, const char* dest_path) {
+    if (!f || !dest_path) return SPEEDSQL_MISUSE;
+
+    /* Callers fall back to copying when the backend cannot reflink */
+    if (!f->vfs || !f->vfs->clone) return SPEEDSQL_NOTFOUND;
+
+    return f->vfs->clone(f->handle, dest_path);
+}
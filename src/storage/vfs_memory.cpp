@@ -0,0 +1,297 @@
+/*
+ * SpeedSQL - In-Memory VFS
+ *
+ * Process-local files held in RAM, addressed by path. A file lives until
+ * its last handle is closed, so a database and its WAL can be opened,
+ * used and discarded without touching the disk.
+ */
+
+#include "speedsql_internal.h"
+
+/* Shared file contents */
+typedef struct mem_vfs_node {
+    char* path;
+    uint8_t* data;
+    uint64_t size;
+    uint64_t capacity;
+    int refs;                    /* Open handles */
+    int shared_locks;            /* Holders of SPEEDSQL_LOCK_SHARED */
+    bool exclusive;              /* SPEEDSQL_LOCK_EXCLUSIVE held */
+    int map_count;               /* Live mmap views (pin data in place) */
+    rwlock_t lock;
+    struct mem_vfs_node* next;
+} mem_vfs_node_t;
+
+/* Per-open handle */
+typedef struct {
+    mem_vfs_node_t* node;
+    bool readonly;
+    int lock_level;
+} mem_vfs_file_t;
+
+static struct {
+    mem_vfs_node_t* head;
+    mutex_t lock;
+} g_mem_vfs = {};
+
+static once_t g_mem_vfs_once = ONCE_INIT;
+
+static void mem_vfs_setup(void) {
+    mutex_init(&g_mem_vfs.lock);
+}
+
+static void mem_vfs_init(void) {
+    once_run(&g_mem_vfs_once, mem_vfs_setup);
+}
+
+static int mem_vfs_open(speedsql_vfs* vfs, const char* path, int flags,
+                        speedsql_vfs_file** file_out) {
+    (void)vfs;
+    mem_vfs_init();
+
+    mem_vfs_file_t* mf = (mem_vfs_file_t*)sdb_calloc(1, sizeof(mem_vfs_file_t));
+    if (!mf) return SPEEDSQL_NOMEM;
+
+    mutex_lock(&g_mem_vfs.lock);
+
+    mem_vfs_node_t* node = g_mem_vfs.head;
+    while (node && strcmp(node->path, path) != 0) {
+        node = node->next;
+    }
+
+    if (!node) {
+        if (!(flags & SPEEDSQL_VFS_OPEN_CREATE)) {
+            mutex_unlock(&g_mem_vfs.lock);
+            sdb_free(mf);
+            return SPEEDSQL_CANTOPEN;
+        }
+
+        node = (mem_vfs_node_t*)sdb_calloc(1, sizeof(mem_vfs_node_t));
+        if (node) node->path = sdb_strdup(path);
+        if (!node || !node->path) {
+            sdb_free(node);
+            mutex_unlock(&g_mem_vfs.lock);
+            sdb_free(mf);
+            return SPEEDSQL_NOMEM;
+        }
+
+        rwlock_init(&node->lock);
+        node->next = g_mem_vfs.head;
+        g_mem_vfs.head = node;
+    }
+
+    node->refs++;
+    mutex_unlock(&g_mem_vfs.lock);
+
+    mf->node = node;
+    mf->readonly = !(flags & SPEEDSQL_VFS_OPEN_READWRITE);
+    *file_out = (speedsql_vfs_file*)mf;
+    return SPEEDSQL_OK;
+}
+
+static int mem_vfs_lock(speedsql_vfs_file* file, int level);
+
+static int mem_vfs_close(speedsql_vfs_file* file) {
+    mem_vfs_file_t* mf = (mem_vfs_file_t*)file;
+    mem_vfs_node_t* node = mf->node;
+
+    mem_vfs_lock(file, SPEEDSQL_LOCK_NONE);
+
+    mutex_lock(&g_mem_vfs.lock);
+
+    if (--node->refs == 0) {
+        /* Unlink and free the last reference */
+        mem_vfs_node_t** link = &g_mem_vfs.head;
+        while (*link != node) {
+            link = &(*link)->next;
+        }
+        *link = node->next;
+
+        rwlock_destroy(&node->lock);
+        sdb_free(node->data);
+        sdb_free(node->path);
+        sdb_free(node);
+    }
+
+    mutex_unlock(&g_mem_vfs.lock);
+
+    sdb_free(mf);
+    return SPEEDSQL_OK;
+}
+
+static int mem_vfs_read(speedsql_vfs_file* file, uint64_t offset, void* buf, size_t len) {
+    mem_vfs_node_t* node = ((mem_vfs_file_t*)file)->node;
+
+    rwlock_rdlock(&node->lock);
+
+    /* Short reads fail like pread past EOF */
+    if (offset + len > node->size) {
+        rwlock_unlock(&node->lock);
+        return SPEEDSQL_IOERR;
+    }
+
+    memcpy(buf, node->data + offset, len);
+
+    rwlock_unlock(&node->lock);
+    return SPEEDSQL_OK;
+}
+
+static int mem_vfs_write(speedsql_vfs_file* file, uint64_t offset, const void* buf, size_t len) {
+    mem_vfs_file_t* mf = (mem_vfs_file_t*)file;
+    mem_vfs_node_t* node = mf->node;
+
+    if (mf->readonly) return SPEEDSQL_READONLY;
+
+    rwlock_wrlock(&node->lock);
+
+    uint64_t end = offset + len;
+    if (end > node->capacity) {
+        /* Growing would move data out from under live mappings */
+        if (node->map_count > 0) {
+            rwlock_unlock(&node->lock);
+            return SPEEDSQL_BUSY;
+        }
+
+        uint64_t new_capacity = node->capacity ? node->capacity : SPEEDSQL_PAGE_SIZE;
+        while (new_capacity < end) {
+            new_capacity *= 2;
+        }
+
+        uint8_t* new_data = (uint8_t*)sdb_realloc(node->data, (size_t)new_capacity);
+        if (!new_data) {
+            rwlock_unlock(&node->lock);
+            return SPEEDSQL_NOMEM;
+        }
+
+        node->data = new_data;
+        node->capacity = new_capacity;
+    }
+
+    /* Zero any gap left by writing past EOF */
+    if (offset > node->size) {
+        memset(node->data + node->size, 0, (size_t)(offset - node->size));
+    }
+
+    memcpy(node->data + offset, buf, len);
+    if (end > node->size) {
+        node->size = end;
+    }
+
+    rwlock_unlock(&node->lock);
+    return SPEEDSQL_OK;
+}
+
+static int mem_vfs_sync(speedsql_vfs_file* file) {
+    (void)file;
+    return SPEEDSQL_OK;
+}
+
+static int mem_vfs_truncate(speedsql_vfs_file* file, uint64_t size) {
+    mem_vfs_file_t* mf = (mem_vfs_file_t*)file;
+    mem_vfs_node_t* node = mf->node;
+
+    if (mf->readonly) return SPEEDSQL_READONLY;
+
+    rwlock_wrlock(&node->lock);
+
+    if (size > node->size) {
+        rwlock_unlock(&node->lock);
+
+        /* Extend with zeros through the write path */
+        uint8_t zero = 0;
+        return mem_vfs_write(file, size - 1, &zero, 1);
+    }
+
+    node->size = size;
+
+    rwlock_unlock(&node->lock);
+    return SPEEDSQL_OK;
+}
+
+static int mem_vfs_file_size(speedsql_vfs_file* file, uint64_t* size) {
+    mem_vfs_node_t* node = ((mem_vfs_file_t*)file)->node;
+
+    rwlock_rdlock(&node->lock);
+    *size = node->size;
+    rwlock_unlock(&node->lock);
+
+    return SPEEDSQL_OK;
+}
+
+static int mem_vfs_lock(speedsql_vfs_file* file, int level) {
+    mem_vfs_file_t* mf = (mem_vfs_file_t*)file;
+    mem_vfs_node_t* node = mf->node;
+
+    if (level == mf->lock_level) return SPEEDSQL_OK;
+
+    mutex_lock(&g_mem_vfs.lock);
+
+    /* Drop what this handle holds, then take the new level */
+    int others_shared = node->shared_locks -
+                        (mf->lock_level == SPEEDSQL_LOCK_SHARED ? 1 : 0);
+    bool others_exclusive = node->exclusive &&
+                            mf->lock_level != SPEEDSQL_LOCK_EXCLUSIVE;
+
+    if ((level == SPEEDSQL_LOCK_SHARED && others_exclusive) ||
+        (level == SPEEDSQL_LOCK_EXCLUSIVE && (others_exclusive || others_shared > 0))) {
+        mutex_unlock(&g_mem_vfs.lock);
+        return SPEEDSQL_BUSY;
+    }
+
+    if (mf->lock_level == SPEEDSQL_LOCK_SHARED) node->shared_locks--;
+    if (mf->lock_level == SPEEDSQL_LOCK_EXCLUSIVE) node->exclusive = false;
+
+    if (level == SPEEDSQL_LOCK_SHARED) node->shared_locks++;
+    if (level == SPEEDSQL_LOCK_EXCLUSIVE) node->exclusive = true;
+
+    mf->lock_level = level;
+
+    mutex_unlock(&g_mem_vfs.lock);
+    return SPEEDSQL_OK;
+}
+
+/* Views point straight into the file buffer; it cannot grow while mapped */
+static int mem_vfs_mmap(speedsql_vfs_file* file, uint64_t offset, size_t len, void** addr) {
+    mem_vfs_node_t* node = ((mem_vfs_file_t*)file)->node;
+
+    rwlock_wrlock(&node->lock);
+
+    if (offset + len > node->size) {
+        rwlock_unlock(&node->lock);
+        return SPEEDSQL_RANGE;
+    }
+
+    node->map_count++;
+    *addr = node->data + offset;
+
+    rwlock_unlock(&node->lock);
+    return SPEEDSQL_OK;
+}
+
+static int mem_vfs_munmap(speedsql_vfs_file* file, void* addr, size_t len) {
+    (void)addr;
+    (void)len;
+    mem_vfs_node_t* node = ((mem_vfs_file_t*)file)->node;
+
+    rwlock_wrlock(&node->lock);
+    if (node->map_count > 0) node->map_count--;
+    rwlock_unlock(&node->lock);
+
+    return SPEEDSQL_OK;
+}
+
+speedsql_vfs g_vfs_memory = {
+    "memory",
+    nullptr,
+    mem_vfs_open,
+    mem_vfs_close,
+    mem_vfs_read,
+    mem_vfs_write,
+    mem_vfs_sync,
+    mem_vfs_truncate,
+    mem_vfs_file_size,
+    mem_vfs_lock,
+    mem_vfs_mmap,
+    mem_vfs_munmap,
+    nullptr                      /* Snapshots use page retention */
+};
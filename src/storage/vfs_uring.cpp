@@ -0,0 +1,342 @@
+/*
+ * SpeedSQL - io_uring VFS (Linux)
+ *
+ * Submits reads, writes and fsyncs through a per-file io_uring using the
+ * raw syscalls (no liburing dependency). When the kernel refuses to set up
+ * a ring (old kernel, seccomp policy) the file falls back to pread/pwrite,
+ * so opening with this VFS always works. Each file has one request in
+ * flight at a time, under its lock.
+ */
+
+#include "speedsql_internal.h"
+
+#ifdef SPEEDSQL_HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <errno.h>
+
+/* Submission queue depth per file */
+#define URING_ENTRIES 64
+
+typedef struct {
+    int ring_fd;
+
+    /* Submission queue */
+    uint32_t* sq_head;
+    uint32_t* sq_tail;
+    uint32_t* sq_mask;
+    uint32_t* sq_array;
+    struct io_uring_sqe* sqes;
+
+    /* Completion queue */
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    /* Mappings */
+    void* sq_ptr;
+    size_t sq_len;
+    void* cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+} uring_t;
+
+typedef struct {
+    int fd;
+    uint64_t size;
+    bool readonly;
+    bool has_ring;               /* false: pread/pwrite fallback */
+    uring_t ring;
+    mutex_t lock;                /* One request in flight per ring */
+} uring_file_t;
+
+static int uring_setup(uring_t* ring) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0) return SPEEDSQL_ERROR;
+
+    ring->ring_fd = fd;
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+        if (ring->sq_ptr != MAP_FAILED) munmap(ring->sq_ptr, ring->sq_len);
+        if (ring->cq_ptr != MAP_FAILED) munmap(ring->cq_ptr, ring->cq_len);
+        if (sqes != MAP_FAILED) munmap(sqes, ring->sqes_len);
+        close(fd);
+        return SPEEDSQL_ERROR;
+    }
+
+    uint8_t* sq = (uint8_t*)ring->sq_ptr;
+    ring->sq_head = (uint32_t*)(sq + p.sq_off.head);
+    ring->sq_tail = (uint32_t*)(sq + p.sq_off.tail);
+    ring->sq_mask = (uint32_t*)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (uint32_t*)(sq + p.sq_off.array);
+    ring->sqes = (struct io_uring_sqe*)sqes;
+
+    uint8_t* cq = (uint8_t*)ring->cq_ptr;
+    ring->cq_head = (uint32_t*)(cq + p.cq_off.head);
+    ring->cq_tail = (uint32_t*)(cq + p.cq_off.tail);
+    ring->cq_mask = (uint32_t*)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    return SPEEDSQL_OK;
+}
+
+static void uring_teardown(uring_t* ring) {
+    munmap(ring->sqes, ring->sqes_len);
+    munmap(ring->cq_ptr, ring->cq_len);
+    munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->ring_fd);
+}
+
+/* Submit one SQE and wait for its completion; returns the CQE result */
+static int uring_submit_wait(uring_t* ring, const struct io_uring_sqe* req) {
+    uint32_t tail = *ring->sq_tail;
+    uint32_t index = tail & *ring->sq_mask;
+
+    ring->sqes[index] = *req;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    for (;;) {
+        int n = (int)syscall(__NR_io_uring_enter, ring->ring_fd, 1, 1,
+                             IORING_ENTER_GETEVENTS, NULL, 0);
+        if (n >= 0) break;
+        if (errno != EINTR) return -errno;
+    }
+
+    uint32_t head = *ring->cq_head;
+    while (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        /* Completion not visible yet: wait without submitting */
+        syscall(__NR_io_uring_enter, ring->ring_fd, 0, 1,
+                IORING_ENTER_GETEVENTS, NULL, 0);
+    }
+
+    int res = ring->cqes[head & *ring->cq_mask].res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return res;
+}
+
+/* Vectored read/write of a full range, resubmitting short transfers */
+static int uring_rw(uring_file_t* uf, uint8_t opcode, uint64_t offset, void* buf, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n;
+
+        if (uf->has_ring) {
+            struct iovec iov;
+            iov.iov_base = (uint8_t*)buf + done;
+            iov.iov_len = len - done;
+
+            struct io_uring_sqe sqe;
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = opcode;
+            sqe.fd = uf->fd;
+            sqe.off = offset + done;
+            sqe.addr = (uint64_t)(uintptr_t)&iov;
+            sqe.len = 1;
+
+            n = uring_submit_wait(&uf->ring, &sqe);
+        } else if (opcode == IORING_OP_READV) {
+            n = pread(uf->fd, (uint8_t*)buf + done, len - done, offset + done);
+        } else {
+            n = pwrite(uf->fd, (uint8_t*)buf + done, len - done, offset + done);
+        }
+
+        if (n <= 0) return SPEEDSQL_IOERR;  /* Error or EOF */
+        done += (size_t)n;
+    }
+
+    return SPEEDSQL_OK;
+}
+
+static int uring_open(speedsql_vfs* vfs, const char* path, int flags,
+                      speedsql_vfs_file** file_out) {
+    (void)vfs;
+
+    uring_file_t* uf = (uring_file_t*)sdb_calloc(1, sizeof(uring_file_t));
+    if (!uf) return SPEEDSQL_NOMEM;
+
+    int oflags = 0;
+    if (flags & SPEEDSQL_VFS_OPEN_READWRITE) {
+        oflags = O_RDWR;
+    } else {
+        oflags = O_RDONLY;
+        uf->readonly = true;
+    }
+
+    if (flags & SPEEDSQL_VFS_OPEN_CREATE) {
+        oflags |= O_CREAT;
+    }
+
+    uf->fd = open(path, oflags, 0644);
+    if (uf->fd < 0) {
+        sdb_free(uf);
+        return SPEEDSQL_CANTOPEN;
+    }
+
+    struct stat st;
+    if (fstat(uf->fd, &st) == 0) {
+        uf->size = st.st_size;
+    }
+
+    uf->has_ring = (uring_setup(&uf->ring) == SPEEDSQL_OK);
+    mutex_init(&uf->lock);
+
+    *file_out = (speedsql_vfs_file*)uf;
+    return SPEEDSQL_OK;
+}
+
+static int uring_close(speedsql_vfs_file* file) {
+    uring_file_t* uf = (uring_file_t*)file;
+
+    if (uf->has_ring) uring_teardown(&uf->ring);
+    close(uf->fd);
+    mutex_destroy(&uf->lock);
+    sdb_free(uf);
+    return SPEEDSQL_OK;
+}
+
+static int uring_read(speedsql_vfs_file* file, uint64_t offset, void* buf, size_t len) {
+    uring_file_t* uf = (uring_file_t*)file;
+
+    mutex_lock(&uf->lock);
+    int rc = uring_rw(uf, IORING_OP_READV, offset, buf, len);
+    mutex_unlock(&uf->lock);
+
+    return rc;
+}
+
+static int uring_write(speedsql_vfs_file* file, uint64_t offset, const void* buf, size_t len) {
+    uring_file_t* uf = (uring_file_t*)file;
+
+    if (uf->readonly) return SPEEDSQL_READONLY;
+
+    mutex_lock(&uf->lock);
+
+    int rc = uring_rw(uf, IORING_OP_WRITEV, offset, (void*)buf, len);
+    if (rc == SPEEDSQL_OK && offset + len > uf->size) {
+        uf->size = offset + len;
+    }
+
+    mutex_unlock(&uf->lock);
+    return rc;
+}
+
+static int uring_sync(speedsql_vfs_file* file) {
+    uring_file_t* uf = (uring_file_t*)file;
+
+    mutex_lock(&uf->lock);
+
+    int res;
+    if (uf->has_ring) {
+        struct io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_FSYNC;
+        sqe.fd = uf->fd;
+        res = uring_submit_wait(&uf->ring, &sqe);
+    } else {
+        res = fsync(uf->fd);
+    }
+
+    mutex_unlock(&uf->lock);
+    return res == 0 ? SPEEDSQL_OK : SPEEDSQL_IOERR;
+}
+
+static int uring_truncate(speedsql_vfs_file* file, uint64_t size) {
+    uring_file_t* uf = (uring_file_t*)file;
+
+    if (uf->readonly) return SPEEDSQL_READONLY;
+
+    mutex_lock(&uf->lock);
+
+    int rc = SPEEDSQL_OK;
+    if (ftruncate(uf->fd, size) != 0) {
+        rc = SPEEDSQL_IOERR;
+    } else {
+        uf->size = size;
+    }
+
+    mutex_unlock(&uf->lock);
+    return rc;
+}
+
+static int uring_file_size(speedsql_vfs_file* file, uint64_t* size) {
+    uring_file_t* uf = (uring_file_t*)file;
+    mutex_lock(&uf->lock);
+    *size = uf->size;
+    mutex_unlock(&uf->lock);
+    return SPEEDSQL_OK;
+}
+
+static int uring_lock(speedsql_vfs_file* file, int level) {
+    uring_file_t* uf = (uring_file_t*)file;
+
+    int op = LOCK_UN;
+    if (level == SPEEDSQL_LOCK_SHARED) {
+        op = LOCK_SH | LOCK_NB;
+    } else if (level == SPEEDSQL_LOCK_EXCLUSIVE) {
+        op = LOCK_EX | LOCK_NB;
+    }
+
+    if (flock(uf->fd, op) != 0) {
+        return (errno == EWOULDBLOCK) ? SPEEDSQL_BUSY : SPEEDSQL_IOERR;
+    }
+
+    return SPEEDSQL_OK;
+}
+
+static int uring_mmap(speedsql_vfs_file* file, uint64_t offset, size_t len, void** addr) {
+    uring_file_t* uf = (uring_file_t*)file;
+
+    void* p = mmap(NULL, len, PROT_READ, MAP_SHARED, uf->fd, (off_t)offset);
+    if (p == MAP_FAILED) return SPEEDSQL_IOERR;
+
+    *addr = p;
+    return SPEEDSQL_OK;
+}
+
+static int uring_munmap(speedsql_vfs_file* file, void* addr, size_t len) {
+    (void)file;
+    return munmap(addr, len) == 0 ? SPEEDSQL_OK : SPEEDSQL_IOERR;
+}
+
+static int uring_clone(speedsql_vfs_file* file, const char* dest_path) {
+    return file_reflink_fd(((uring_file_t*)file)->fd, dest_path);
+}
+
+speedsql_vfs g_vfs_io_uring = {
+    "io_uring",
+    nullptr,
+    uring_open,
+    uring_close,
+    uring_read,
+    uring_write,
+    uring_sync,
+    uring_truncate,
+    uring_file_size,
+    uring_lock,
+    uring_mmap,
+    uring_munmap,
+    uring_clone
+};
+
+#endif /* SPEEDSQL_HAVE_IO_URING */
@@ -18,6 +18,21 @@
  *   [Before Image: variable]
  *   [After Image: variable]
  *   [Checksum: 4 bytes]
+ *
+ * Page image records are redo-only and carry just the after image: the
+ * bytes written to the database file at page_id * data_len. Shipped
+ * segments use the same format, so a follower redoes a segment exactly
+ * like the live log.
+ *
+ * Sealed WAL (encrypted databases, header version 2):
+ *   [Header: 64 bytes, naming the cipher]
+ *   [Frame header: 32 bytes][Ciphertext: length bytes][Tag]*
+ *
+ * Each buffer flush is sealed as one frame with the connection's cipher,
+ * under a nonce built from a random per-open base and a frame counter.
+ * The frame header and the frame's file offset are authenticated, so a
+ * frame cannot be altered, moved or replayed elsewhere in the log.
+ * Records never span frames, and readers open a whole frame at a time.
  */
 
 #include "speedsql_internal.h"
@@ -25,8 +40,15 @@
 /* WAL magic number */
 static const uint32_t WAL_MAGIC = 0x57414C31;  /* "WAL1" */
 static const uint32_t WAL_VERSION = 1;
+static const uint32_t WAL_VERSION_SEALED = 2;
 static const size_t WAL_HEADER_SIZE = 64;
 static const size_t WAL_BUFFER_SIZE = 64 * 1024;  /* 64KB buffer */
+static const uint64_t WAL_CHECKPOINT_SIZE = 4 * 1024 * 1024;  /* Restart the log past 4MB */
+
+/* Sealed frames */
+static const uint32_t WAL_FRAME_MAGIC = 0x57414C46;  /* "WALF" */
+static const size_t WAL_FRAME_MAX = WAL_BUFFER_SIZE * 2;  /* A flush or an exported batch */
+static const size_t WAL_TAG_MAX = 32;
 
 /* Log record types */
 typedef enum {
@@ -37,9 +59,13 @@ typedef enum {
     WAL_RECORD_CHECKPOINT = 5,
     WAL_RECORD_SAVEPOINT = 6,
     WAL_RECORD_RELEASE = 7,
-    WAL_RECORD_ROLLBACK_TO = 8
+    WAL_RECORD_ROLLBACK_TO = 8,
+    WAL_RECORD_PAGE_IMAGE = 9
 } wal_record_type_t;
 
+/* Largest image a record may carry (page plus cipher tag) */
+static const uint32_t WAL_MAX_IMAGE = SPEEDSQL_PAGE_SIZE * 2;
+
 /* WAL file header */
 typedef struct {
     uint32_t magic;
@@ -48,7 +74,10 @@ typedef struct {
     uint64_t checkpoint_lsn;    /* Last checkpoint LSN */
     uint32_t page_size;
     uint32_t checksum;
-    uint8_t reserved[32];
+    uint32_t cipher;            /* Cipher sealing the frames (version 2) */
+    uint32_t reserved0;
+    uint64_t base_lsn;          /* Last commit dropped by a checkpoint */
+    uint8_t reserved[16];
 } wal_header_t;
 
 /* Log record header */
@@ -61,9 +90,24 @@ typedef struct {
     uint32_t data_len;
 } wal_record_header_t;
 
+/* Sealed frame header */
+typedef struct {
+    uint32_t magic;
+    uint32_t length;            /* Plaintext bytes */
+    uint64_t seq;               /* Frame counter */
+    uint8_t nonce[16];          /* iv_size bytes used */
+} wal_frame_header_t;
+
 /* Calculate header checksum */
 static uint32_t wal_header_checksum(const wal_header_t* hdr) {
-    return crc32(hdr, offsetof(wal_header_t, checksum));
+    uint32_t crc = crc32(hdr, offsetof(wal_header_t, checksum));
+    if (hdr->version >= WAL_VERSION_SEALED) {
+        crc ^= crc32(&hdr->cipher, sizeof(hdr->cipher));
+    }
+    if (hdr->base_lsn) {
+        crc ^= crc32(&hdr->base_lsn, sizeof(hdr->base_lsn));
+    }
+    return crc;
 }
 
 /* Calculate record checksum */
@@ -79,6 +123,75 @@ static uint32_t wal_record_checksum(const wal_record_header_t* hdr,
     return crc;
 }
 
+/* Bytes of data following a record header (excluding the checksum) */
+static size_t wal_record_data_size(const wal_record_header_t* hdr) {
+    if (hdr->type == WAL_RECORD_PAGE) return (size_t)hdr->data_len * 2;
+    if (hdr->type == WAL_RECORD_PAGE_IMAGE) return hdr->data_len;
+    return 0;
+}
+
+/* Frames need an AEAD mode: a 96-bit nonce, ciphertext as long as the
+ * plaintext, and a tag. The CBC modes pad their output and are refused. */
+static const speedsql_cipher_provider_t* wal_sealer(speedsql_cipher_t cipher_id) {
+    const speedsql_cipher_provider_t* provider = speedsql_get_cipher(cipher_id);
+    if (!provider || !provider->encrypt || !provider->decrypt) return nullptr;
+    if (provider->iv_size < 8 || provider->iv_size > 12) return nullptr;
+    if (provider->tag_size == 0 || provider->tag_size > WAL_TAG_MAX) return nullptr;
+    return provider;
+}
+
+/* Authenticated data of a frame: its header and where it sits */
+static void wal_frame_aad(const wal_frame_header_t* fh, uint64_t pos, uint8_t* aad) {
+    memcpy(aad, fh, sizeof(*fh));
+    memcpy(aad + sizeof(*fh), &pos, sizeof(pos));
+}
+
+/* Size of a frame buffer: header, largest payload and tag */
+static size_t wal_frame_buffer_size(void) {
+    return sizeof(wal_frame_header_t) + WAL_FRAME_MAX + WAL_TAG_MAX;
+}
+
+/* Seal len bytes of records as one frame and write it at pos */
+static int wal_write_frame(wal_t* wal, file_t* f, uint64_t pos,
+                           const uint8_t* data, size_t len, size_t* written) {
+    const speedsql_cipher_provider_t* provider = wal_sealer(wal->cipher_id);
+    if (!provider || !wal->cipher_ctx || len > WAL_FRAME_MAX) {
+        return SPEEDSQL_MISUSE;  /* Sealed log without its key */
+    }
+
+    if (!wal->sealed) {
+        wal->sealed = (uint8_t*)sdb_malloc(wal_frame_buffer_size());
+        if (!wal->sealed) return SPEEDSQL_NOMEM;
+    }
+
+    wal_frame_header_t fh = {};
+    fh.magic = WAL_FRAME_MAGIC;
+    fh.length = (uint32_t)len;
+    fh.seq = ++wal->frame_seq;
+
+    /* Counter nonce: the base with the frame counter folded into its tail */
+    memcpy(fh.nonce, wal->nonce_base, provider->iv_size);
+    for (size_t i = 0; i < 8; i++) {
+        fh.nonce[provider->iv_size - 8 + i] ^= (uint8_t)(fh.seq >> (8 * i));
+    }
+
+    uint8_t aad[sizeof(wal_frame_header_t) + sizeof(uint64_t)];
+    wal_frame_aad(&fh, pos, aad);
+
+    memcpy(wal->sealed, &fh, sizeof(fh));
+    uint8_t* body = wal->sealed + sizeof(fh);
+    int rc = provider->encrypt(wal->cipher_ctx, data, len, fh.nonce, aad, sizeof(aad),
+                               body, body + len);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    size_t total = sizeof(fh) + len + provider->tag_size;
+    rc = file_write(f, pos, wal->sealed, total);
+    if (rc == SPEEDSQL_OK) {
+        *written = total;
+    }
+    return rc;
+}
+
 /* Flush WAL buffer to disk */
 static int wal_flush_buffer(wal_t* wal) {
     if (wal->buffer_pos == 0) {
@@ -94,7 +207,14 @@ static int wal_flush_buffer(wal_t* wal) {
         write_pos = WAL_HEADER_SIZE;
     }
 
-    int rc = file_write(&wal->file, write_pos, wal->buffer, wal->buffer_pos);
+    /* A sealed log takes the whole flush as one frame */
+    int rc;
+    if (wal->cipher_id != SPEEDSQL_CIPHER_NONE) {
+        size_t written = 0;
+        rc = wal_write_frame(wal, &wal->file, write_pos, wal->buffer, wal->buffer_pos, &written);
+    } else {
+        rc = file_write(&wal->file, write_pos, wal->buffer, wal->buffer_pos);
+    }
     if (rc != SPEEDSQL_OK) {
         return rc;
     }
@@ -112,10 +232,12 @@ static int wal_flush_buffer(wal_t* wal) {
 static int wal_write_header(wal_t* wal) {
     wal_header_t hdr = {0};
     hdr.magic = WAL_MAGIC;
-    hdr.version = WAL_VERSION;
+    hdr.version = wal->cipher_id != SPEEDSQL_CIPHER_NONE ? WAL_VERSION_SEALED : WAL_VERSION;
     hdr.lsn = wal->current_lsn;
     hdr.checkpoint_lsn = wal->checkpoint_lsn;
     hdr.page_size = SPEEDSQL_PAGE_SIZE;
+    hdr.cipher = wal->cipher_id;
+    hdr.base_lsn = wal->base_lsn;
     hdr.checksum = wal_header_checksum(&hdr);
 
     uint8_t header_buf[WAL_HEADER_SIZE] = {0};
@@ -146,7 +268,7 @@ static int wal_read_header(wal_t* wal) {
     }
 
     /* Validate version */
-    if (hdr->version > WAL_VERSION) {
+    if (hdr->version > WAL_VERSION_SEALED) {
         return SPEEDSQL_CORRUPT;
     }
 
@@ -157,6 +279,11 @@ static int wal_read_header(wal_t* wal) {
 
     wal->current_lsn = hdr->lsn;
     wal->checkpoint_lsn = hdr->checkpoint_lsn;
+    wal->base_lsn = hdr->base_lsn;
+
+    /* A sealed log stays unreadable until the key is installed */
+    wal->cipher_id = hdr->version >= WAL_VERSION_SEALED ? (speedsql_cipher_t)hdr->cipher
+                                                         : SPEEDSQL_CIPHER_NONE;
 
     return SPEEDSQL_OK;
 }
@@ -164,12 +291,7 @@ static int wal_read_header(wal_t* wal) {
 /* Append record to buffer (with auto-flush if needed) */
 static int wal_append_record(wal_t* wal, const wal_record_header_t* hdr,
                              const void* before, const void* after, size_t data_size) {
-    size_t record_size = sizeof(*hdr);
-    if (hdr->type == WAL_RECORD_PAGE) {
-        record_size += data_size * 2 + sizeof(uint32_t);  /* before + after + checksum */
-    } else {
-        record_size += sizeof(uint32_t);  /* just checksum */
-    }
+    size_t record_size = sizeof(*hdr) + wal_record_data_size(hdr) + sizeof(uint32_t);
 
     /* Flush if record won't fit */
     if (wal->buffer_pos + record_size > wal->buffer_size) {
@@ -198,6 +320,9 @@ static int wal_append_record(wal_t* wal, const wal_record_header_t* hdr,
             memset(wal->buffer + wal->buffer_pos, 0, data_size);
         }
         wal->buffer_pos += data_size;
+    } else if (hdr->type == WAL_RECORD_PAGE_IMAGE && data_size > 0) {
+        memcpy(wal->buffer + wal->buffer_pos, after, data_size);
+        wal->buffer_pos += data_size;
     }
 
     /* Write checksum */
@@ -212,7 +337,7 @@ static int wal_append_record(wal_t* wal, const wal_record_header_t* hdr,
  * Public API
  * ============================================================================ */
 
-int wal_init(wal_t* wal, const char* path) {
+int wal_init(wal_t* wal, speedsql_vfs* vfs, const char* path) {
     if (!wal || !path) {
         return SPEEDSQL_MISUSE;
     }
@@ -228,9 +353,11 @@ int wal_init(wal_t* wal, const char* path) {
         return SPEEDSQL_NOMEM;
     }
     wal->buffer_pos = 0;
+    wal->checkpoint_size = WAL_CHECKPOINT_SIZE;
+    speedsql_random_key(wal->nonce_base, sizeof(wal->nonce_base));
 
     /* Open or create WAL file */
-    int rc = file_open(&wal->file, path, 1 | 2);  /* Read-write, create */
+    int rc = file_open_vfs(&wal->file, vfs, path, 1 | 2);  /* Read-write, create */
     if (rc != SPEEDSQL_OK) {
         sdb_free(wal->buffer);
         mutex_destroy(&wal->lock);
@@ -288,11 +415,13 @@ void wal_close(wal_t* wal) {
     /* Close file */
     file_close(&wal->file);
 
-    /* Free buffer */
+    /* Free buffers */
     if (wal->buffer) {
         sdb_free(wal->buffer);
         wal->buffer = nullptr;
     }
+    sdb_free(wal->sealed);
+    wal->sealed = nullptr;
 
     mutex_unlock(&wal->lock);
     mutex_destroy(&wal->lock);
@@ -442,6 +571,278 @@ int wal_rollback_to_savepoint(wal_t* wal, txn_id_t txn, uint64_t savepoint_lsn)
     return rc;
 }
 
+int wal_log_page(wal_t* wal, txn_id_t txn, page_id_t page, const void* data, size_t size) {
+    if (!wal || !data || size == 0 || size > WAL_MAX_IMAGE) return SPEEDSQL_MISUSE;
+
+    mutex_lock(&wal->lock);
+
+    /* Create redo-only page image record */
+    wal_record_header_t hdr = {};
+    hdr.lsn = wal->current_lsn++;
+    hdr.txn_id = txn;
+    hdr.type = WAL_RECORD_PAGE_IMAGE;
+    hdr.page_id = page;
+    hdr.data_len = (uint32_t)size;
+
+    int rc = wal_append_record(wal, &hdr, nullptr, data, size);
+
+    mutex_unlock(&wal->lock);
+    return rc;
+}
+
+/* ============================================================================
+ * Log Reading
+ *
+ * Recovery, export and redo read records through a reader that hides the
+ * log's format: a plain log is read record by record, a sealed one a
+ * frame at a time, with the frame decrypted in one call.
+ * ============================================================================ */
+
+/* Validate a log file header and return the cipher sealing it, with the
+ * checkpoint that last restarted the log and the last commit it dropped */
+static int wal_check_header(file_t* f, speedsql_cipher_t* cipher_id,
+                            uint64_t* checkpoint_lsn, uint64_t* base_lsn) {
+    uint8_t header_buf[WAL_HEADER_SIZE];
+
+    int rc = file_read(f, 0, header_buf, WAL_HEADER_SIZE);
+    if (rc != SPEEDSQL_OK) return SPEEDSQL_CORRUPT;
+
+    const wal_header_t* hdr = (const wal_header_t*)header_buf;
+    if (hdr->magic != WAL_MAGIC || hdr->version > WAL_VERSION_SEALED ||
+        hdr->checksum != wal_header_checksum(hdr)) {
+        return SPEEDSQL_CORRUPT;
+    }
+
+    *cipher_id = hdr->version >= WAL_VERSION_SEALED ? (speedsql_cipher_t)hdr->cipher
+                                                     : SPEEDSQL_CIPHER_NONE;
+    *checkpoint_lsn = hdr->checkpoint_lsn;
+    *base_lsn = hdr->base_lsn;
+    return SPEEDSQL_OK;
+}
+
+/* Plausible record header */
+static bool wal_record_sane(const wal_record_header_t* hdr) {
+    return hdr->lsn != 0 && hdr->type >= WAL_RECORD_BEGIN &&
+           hdr->type <= WAL_RECORD_PAGE_IMAGE && hdr->data_len <= WAL_MAX_IMAGE;
+}
+
+/* Verify the checksum of a complete record in buf */
+static bool wal_record_intact(const uint8_t* buf) {
+    const wal_record_header_t* hdr = (const wal_record_header_t*)buf;
+    const uint8_t* data = buf + sizeof(*hdr);
+    size_t data_size = wal_record_data_size(hdr);
+
+    uint32_t expected;
+    if (hdr->type == WAL_RECORD_PAGE) {
+        expected = wal_record_checksum(hdr, data, data + hdr->data_len, hdr->data_len);
+    } else if (hdr->type == WAL_RECORD_PAGE_IMAGE) {
+        expected = wal_record_checksum(hdr, nullptr, data, hdr->data_len);
+    } else {
+        expected = wal_record_checksum(hdr, nullptr, nullptr, 0);
+    }
+
+    uint32_t stored;
+    memcpy(&stored, data + data_size, sizeof(stored));
+    return stored == expected;
+}
+
+/* Read one complete record at pos into buf (header, data, checksum).
+ * Returns SPEEDSQL_DONE at the end of valid records, including a torn tail. */
+static int wal_read_record(file_t* f, uint64_t pos, uint64_t size,
+                           uint8_t* buf, size_t* record_size) {
+    if (pos + sizeof(wal_record_header_t) > size) return SPEEDSQL_DONE;
+
+    wal_record_header_t* hdr = (wal_record_header_t*)buf;
+    if (file_read(f, pos, hdr, sizeof(*hdr)) != SPEEDSQL_OK) return SPEEDSQL_DONE;
+    if (!wal_record_sane(hdr)) return SPEEDSQL_DONE;
+
+    size_t data_size = wal_record_data_size(hdr);
+    size_t total = sizeof(*hdr) + data_size + sizeof(uint32_t);
+    if (pos + total > size) return SPEEDSQL_DONE;
+
+    uint8_t* data = buf + sizeof(*hdr);
+    if (file_read(f, pos + sizeof(*hdr), data, data_size + sizeof(uint32_t)) != SPEEDSQL_OK) {
+        return SPEEDSQL_DONE;
+    }
+    if (!wal_record_intact(buf)) return SPEEDSQL_DONE;
+
+    *record_size = total;
+    return SPEEDSQL_OK;
+}
+
+/* Copy one complete record out of an opened frame. The frame was
+ * authenticated, so anything malformed in it is corruption. */
+static int wal_parse_record(const uint8_t* src, size_t avail,
+                            uint8_t* buf, size_t* record_size) {
+    wal_record_header_t* hdr = (wal_record_header_t*)buf;
+    if (avail < sizeof(*hdr)) return SPEEDSQL_CORRUPT;
+
+    memcpy(hdr, src, sizeof(*hdr));
+    if (!wal_record_sane(hdr)) return SPEEDSQL_CORRUPT;
+
+    size_t total = sizeof(*hdr) + wal_record_data_size(hdr) + sizeof(uint32_t);
+    if (total > avail) return SPEEDSQL_CORRUPT;
+
+    memcpy(buf + sizeof(*hdr), src + sizeof(*hdr), total - sizeof(*hdr));
+    if (!wal_record_intact(buf)) return SPEEDSQL_CORRUPT;
+
+    *record_size = total;
+    return SPEEDSQL_OK;
+}
+
+/* Room for the largest record: header, two images and a checksum */
+static size_t wal_record_buffer_size(void) {
+    return sizeof(wal_record_header_t) + (size_t)WAL_MAX_IMAGE * 2 + sizeof(uint32_t);
+}
+
+typedef struct {
+    file_t* file;
+    uint64_t size;
+    const speedsql_cipher_provider_t* provider;  /* Sealed logs only */
+    struct speedsql_cipher_ctx* ctx;
+    uint8_t* frame;              /* Opened frame: plaintext records */
+    uint8_t* sealed;             /* Frame as read from the file */
+    uint64_t frame_pos;          /* File offset of the opened frame */
+    size_t frame_len;
+    uint64_t frame_end;          /* File offset after it */
+    uint64_t pos;                /* Next record, or the frame holding it */
+    size_t offset;               /* Next record within that frame */
+} wal_reader_t;
+
+/* Where a record was read, to read it again */
+typedef struct {
+    uint64_t pos;
+    size_t offset;
+} wal_mark_t;
+
+static int wal_reader_open(wal_reader_t* r, file_t* f, speedsql_cipher_t cipher_id,
+                           struct speedsql_cipher_ctx* ctx, uint64_t start) {
+    memset(r, 0, sizeof(*r));
+    r->file = f;
+    r->frame_pos = UINT64_MAX;
+    r->pos = start < WAL_HEADER_SIZE ? WAL_HEADER_SIZE : start;
+    file_size(f, &r->size);
+
+    if (cipher_id == SPEEDSQL_CIPHER_NONE) return SPEEDSQL_OK;
+
+    r->provider = wal_sealer(cipher_id);
+    r->ctx = ctx;
+    if (!r->provider || !ctx) {
+        return SPEEDSQL_MISUSE;  /* Sealed with a cipher this connection lacks */
+    }
+
+    r->frame = (uint8_t*)sdb_malloc(WAL_FRAME_MAX);
+    r->sealed = (uint8_t*)sdb_malloc(wal_frame_buffer_size());
+    if (!r->frame || !r->sealed) {
+        sdb_free(r->frame);
+        sdb_free(r->sealed);
+        r->frame = r->sealed = nullptr;
+        return SPEEDSQL_NOMEM;
+    }
+    return SPEEDSQL_OK;
+}
+
+static void wal_reader_close(wal_reader_t* r) {
+    sdb_free(r->frame);
+    sdb_free(r->sealed);
+    r->frame = r->sealed = nullptr;
+}
+
+/* Open the frame at pos. A short or torn frame ends the log; a complete
+ * frame that fails authentication was altered or sealed with another key. */
+static int wal_reader_load(wal_reader_t* r, uint64_t pos) {
+    if (r->frame_pos == pos) return SPEEDSQL_OK;
+
+    wal_frame_header_t fh;
+    if (pos + sizeof(fh) > r->size) return SPEEDSQL_DONE;
+    if (file_read(r->file, pos, &fh, sizeof(fh)) != SPEEDSQL_OK) return SPEEDSQL_DONE;
+    if (fh.magic != WAL_FRAME_MAGIC || fh.length == 0 || fh.length > WAL_FRAME_MAX) {
+        return SPEEDSQL_DONE;
+    }
+
+    size_t body = fh.length + r->provider->tag_size;
+    if (pos + sizeof(fh) + body > r->size) return SPEEDSQL_DONE;
+
+    /* Ciphertext and tag in one read */
+    if (file_read(r->file, pos + sizeof(fh), r->sealed, body) != SPEEDSQL_OK) {
+        return SPEEDSQL_DONE;
+    }
+
+    uint8_t aad[sizeof(wal_frame_header_t) + sizeof(uint64_t)];
+    wal_frame_aad(&fh, pos, aad);
+
+    r->frame_pos = UINT64_MAX;
+    int rc = r->provider->decrypt(r->ctx, r->sealed, fh.length, fh.nonce, aad, sizeof(aad),
+                                  r->sealed + fh.length, r->frame);
+    if (rc != SPEEDSQL_OK) return SPEEDSQL_CORRUPT;
+
+    r->frame_pos = pos;
+    r->frame_len = fh.length;
+    r->frame_end = pos + sizeof(fh) + body;
+    return SPEEDSQL_OK;
+}
+
+/* Read the next record into buf. Returns SPEEDSQL_DONE at the end of the log. */
+static int wal_reader_next(wal_reader_t* r, uint8_t* buf, size_t* record_size,
+                           wal_mark_t* mark) {
+    if (!r->provider) {
+        int rc = wal_read_record(r->file, r->pos, r->size, buf, record_size);
+        if (rc != SPEEDSQL_OK) return rc;
+        if (mark) {
+            mark->pos = r->pos;
+            mark->offset = 0;
+        }
+        r->pos += *record_size;
+        return SPEEDSQL_OK;
+    }
+
+    for (;;) {
+        int rc = wal_reader_load(r, r->pos);
+        if (rc != SPEEDSQL_OK) return rc;
+        if (r->offset < r->frame_len) break;
+        r->pos = r->frame_end;
+        r->offset = 0;
+    }
+
+    int rc = wal_parse_record(r->frame + r->offset, r->frame_len - r->offset, buf, record_size);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    if (mark) {
+        mark->pos = r->pos;
+        mark->offset = r->offset;
+    }
+    r->offset += *record_size;
+    return SPEEDSQL_OK;
+}
+
+/* Read a record again */
+static int wal_reader_at(wal_reader_t* r, const wal_mark_t* mark,
+                         uint8_t* buf, size_t* record_size) {
+    if (!r->provider) {
+        return wal_read_record(r->file, mark->pos, r->size, buf, record_size);
+    }
+
+    int rc = wal_reader_load(r, mark->pos);
+    if (rc != SPEEDSQL_OK) return rc;
+    if (mark->offset >= r->frame_len) return SPEEDSQL_CORRUPT;
+    return wal_parse_record(r->frame + mark->offset, r->frame_len - mark->offset,
+                            buf, record_size);
+}
+
+/* Where to resume after the last record read: the next record, or for a
+ * sealed log the start of the frame holding it (records are filtered by
+ * LSN, so rereading the start of a frame is harmless) */
+static uint64_t wal_reader_tell(const wal_reader_t* r) {
+    if (r->provider && r->frame_pos == r->pos && r->offset >= r->frame_len) {
+        return r->frame_end;
+    }
+    return r->pos;
+}
+
+/* ============================================================================
+ * Recovery and Checkpoints
+ * ============================================================================ */
+
 /* Transaction state tracking for recovery */
 typedef struct {
     txn_id_t txn_id;
@@ -493,102 +894,94 @@ int wal_recover(wal_t* wal, buffer_pool_t* pool, file_t* db_file) {
         return SPEEDSQL_OK;
     }
 
-    /* Track transaction states */
-    txn_status_t* txns = nullptr;
-    size_t txn_count = 0;
-    size_t txn_capacity = 0;
-
-    /* First pass: determine committed transactions */
-    uint64_t pos = WAL_HEADER_SIZE;
-    uint8_t* record_buf = (uint8_t*)sdb_malloc(SPEEDSQL_PAGE_SIZE * 2 + 64);
+    uint8_t* record_buf = (uint8_t*)sdb_malloc(wal_record_buffer_size());
     if (!record_buf) {
         mutex_unlock(&wal->lock);
         return SPEEDSQL_NOMEM;
     }
 
-    while (pos < wal_file_size) {
-        wal_record_header_t hdr;
-        int rc = file_read(&wal->file, pos, &hdr, sizeof(hdr));
-        if (rc != SPEEDSQL_OK) {
-            break;  /* End of valid records */
-        }
+    wal_reader_t reader;
+    int rc = wal_reader_open(&reader, &wal->file, wal->cipher_id, wal->cipher_ctx,
+                             WAL_HEADER_SIZE);
+    if (rc != SPEEDSQL_OK) {
+        sdb_free(record_buf);
+        mutex_unlock(&wal->lock);
+        return rc;
+    }
+
+    /* Track transaction states */
+    txn_status_t* txns = nullptr;
+    size_t txn_count = 0;
+    size_t txn_capacity = 0;
+    const wal_record_header_t* hdr = (const wal_record_header_t*)record_buf;
+    size_t record_size = 0;
 
+    /* First pass: determine committed transactions */
+    while ((rc = wal_reader_next(&reader, record_buf, &record_size, nullptr)) == SPEEDSQL_OK) {
         /* Check for valid record (LSN should be reasonable) */
-        if (hdr.lsn == 0 || hdr.lsn > wal->current_lsn) {
+        if (hdr->lsn > wal->current_lsn) {
             break;
         }
 
-        txn_status_t* status = find_or_add_txn(&txns, &txn_count, &txn_capacity, hdr.txn_id);
+        txn_status_t* status = find_or_add_txn(&txns, &txn_count, &txn_capacity, hdr->txn_id);
         if (!status) {
-            sdb_free(record_buf);
-            sdb_free(txns);
-            mutex_unlock(&wal->lock);
-            return SPEEDSQL_NOMEM;
+            rc = SPEEDSQL_NOMEM;
+            break;
         }
 
-        if (hdr.type == WAL_RECORD_COMMIT) {
+        if (hdr->type == WAL_RECORD_COMMIT) {
             status->committed = true;
-        } else if (hdr.type == WAL_RECORD_ROLLBACK) {
+        } else if (hdr->type == WAL_RECORD_ROLLBACK) {
             status->rolled_back = true;
         }
-
-        /* Calculate record size and skip to next */
-        size_t record_size = sizeof(hdr) + sizeof(uint32_t);  /* Header + checksum */
-        if (hdr.type == WAL_RECORD_PAGE) {
-            record_size += hdr.data_len * 2;  /* Before + after images */
-        }
-        pos += record_size;
     }
 
     /* Second pass: apply committed transactions */
-    pos = WAL_HEADER_SIZE;
-    while (pos < wal_file_size) {
-        wal_record_header_t hdr;
-        int rc = file_read(&wal->file, pos, &hdr, sizeof(hdr));
-        if (rc != SPEEDSQL_OK) {
-            break;
-        }
-
-        if (hdr.lsn == 0 || hdr.lsn > wal->current_lsn) {
-            break;
-        }
-
-        /* Check if this transaction was committed */
-        bool should_apply = false;
-        for (size_t i = 0; i < txn_count; i++) {
-            if (txns[i].txn_id == hdr.txn_id && txns[i].committed) {
-                should_apply = true;
+    if (rc == SPEEDSQL_OK || rc == SPEEDSQL_DONE) {
+        reader.pos = WAL_HEADER_SIZE;
+        reader.offset = 0;
+        while ((rc = wal_reader_next(&reader, record_buf, &record_size, nullptr)) == SPEEDSQL_OK) {
+            if (hdr->lsn > wal->current_lsn) {
                 break;
             }
-        }
 
-        if (hdr.type == WAL_RECORD_PAGE && should_apply) {
-            /* Read before and after images */
-            size_t data_offset = pos + sizeof(hdr);
+            /* Check if this transaction was committed */
+            bool should_apply = false;
+            for (size_t i = 0; i < txn_count; i++) {
+                if (txns[i].txn_id == hdr->txn_id && txns[i].committed) {
+                    should_apply = true;
+                    break;
+                }
+            }
+            if (!should_apply || hdr->page_id == INVALID_PAGE_ID) {
+                continue;
+            }
 
-            /* Skip before image, read after image */
-            uint8_t* after_image = record_buf;
-            rc = file_read(&wal->file, data_offset + hdr.data_len, after_image, hdr.data_len);
-            if (rc == SPEEDSQL_OK && hdr.page_id != INVALID_PAGE_ID) {
-                /* Apply after image to database */
-                file_write(db_file, hdr.page_id * pool->page_size, after_image, hdr.data_len);
+            const uint8_t* data = record_buf + sizeof(*hdr);
+            if (hdr->type == WAL_RECORD_PAGE) {
+                /* Skip before image, apply after image */
+                file_write(db_file, hdr->page_id * pool->page_size,
+                           data + hdr->data_len, hdr->data_len);
+            } else if (hdr->type == WAL_RECORD_PAGE_IMAGE) {
+                /* On-disk image, written at its own stride */
+                file_write(db_file, (uint64_t)hdr->page_id * hdr->data_len, data, hdr->data_len);
             }
         }
+    }
 
-        /* Skip to next record */
-        size_t record_size = sizeof(hdr) + sizeof(uint32_t);
-        if (hdr.type == WAL_RECORD_PAGE) {
-            record_size += hdr.data_len * 2;
-        }
-        pos += record_size;
+    wal_reader_close(&reader);
+    sdb_free(record_buf);
+    sdb_free(txns);
+
+    /* A sealed frame that fails to open stops recovery */
+    if (rc != SPEEDSQL_OK && rc != SPEEDSQL_DONE) {
+        mutex_unlock(&wal->lock);
+        return rc;
     }
 
     /* Sync database file */
     file_sync(db_file);
 
-    sdb_free(record_buf);
-    sdb_free(txns);
-
     /* Update checkpoint LSN */
     wal->checkpoint_lsn = wal->current_lsn;
     wal_write_header(wal);
@@ -597,62 +990,469 @@ int wal_recover(wal_t* wal, buffer_pool_t* pool, file_t* db_file) {
     return SPEEDSQL_OK;
 }
 
-int wal_checkpoint(wal_t* wal, buffer_pool_t* pool, file_t* db_file) {
-    if (!wal || !pool || !db_file) {
-        return SPEEDSQL_MISUSE;
-    }
+/* Records a restarted log keeps: every transaction committed in the second
+ * half of the log, and anything logged after the last commit, so followers
+ * some way behind can still catch up. Returns in *dropped the last commit
+ * not kept, or 0 when nothing can go. */
+static int wal_checkpoint_tail(wal_t* wal, uint8_t** kept, size_t* kept_len,
+                               uint64_t* dropped) {
+    *kept = nullptr;
+    *kept_len = 0;
+    *dropped = 0;
+
+    uint8_t* buf = (uint8_t*)sdb_malloc(wal_record_buffer_size());
+    if (!buf) return SPEEDSQL_NOMEM;
+
+    wal_reader_t reader;
+    int rc = wal_reader_open(&reader, &wal->file, wal->cipher_id, wal->cipher_ctx,
+                             WAL_HEADER_SIZE);
+    uint64_t half = WAL_HEADER_SIZE + (reader.size - WAL_HEADER_SIZE) / 2;
+
+    uint8_t* tail = nullptr;
+    size_t len = 0;
+    size_t capacity = 0;
+    while (rc == SPEEDSQL_OK) {
+        size_t record_size = 0;
+        int next_rc = wal_reader_next(&reader, buf, &record_size, nullptr);
+        if (next_rc != SPEEDSQL_OK) {
+            if (next_rc != SPEEDSQL_DONE) rc = next_rc;
+            break;
+        }
 
-    mutex_lock(&wal->lock);
+        const wal_record_header_t* hdr = (const wal_record_header_t*)buf;
+        if (hdr->type == WAL_RECORD_COMMIT && wal_reader_tell(&reader) <= half) {
+            *dropped = hdr->lsn;
+            len = 0;
+            continue;
+        }
 
-    /* Flush WAL buffer first */
-    int rc = wal_flush_buffer(wal);
+        if (len + record_size > capacity) {
+            size_t new_cap = capacity ? capacity * 2 : WAL_BUFFER_SIZE;
+            while (new_cap < len + record_size) new_cap *= 2;
+            uint8_t* grown = (uint8_t*)sdb_realloc(tail, new_cap);
+            if (!grown) {
+                rc = SPEEDSQL_NOMEM;
+                break;
+            }
+            tail = grown;
+            capacity = new_cap;
+        }
+        memcpy(tail + len, buf, record_size);
+        len += record_size;
+    }
+
+    wal_reader_close(&reader);
+    sdb_free(buf);
     if (rc != SPEEDSQL_OK) {
-        mutex_unlock(&wal->lock);
+        sdb_free(tail);
+        *dropped = 0;
         return rc;
     }
 
-    /* Flush all dirty pages from buffer pool */
-    rc = buffer_pool_flush(pool, db_file);
+    *kept = tail;
+    *kept_len = len;
+    return SPEEDSQL_OK;
+}
+
+int wal_checkpoint(wal_t* wal, buffer_pool_t* pool, file_t* db_file) {
+    if (!wal || !pool || !db_file) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    /* Flush all dirty pages from buffer pool (the write-back hook may log
+     * them, so this runs before taking the WAL lock), and make them durable
+     * before the log that also holds them goes */
+    int rc = buffer_pool_flush(pool, db_file);
+    if (rc == SPEEDSQL_OK) {
+        rc = file_sync(db_file);
+    }
     if (rc != SPEEDSQL_OK) {
-        mutex_unlock(&wal->lock);
         return rc;
     }
 
-    /* Write checkpoint record */
-    wal_record_header_t hdr = {0};
-    hdr.lsn = wal->current_lsn++;
-    hdr.txn_id = 0;
-    hdr.type = WAL_RECORD_CHECKPOINT;
-    hdr.page_id = INVALID_PAGE_ID;
-    hdr.data_len = 0;
+    mutex_lock(&wal->lock);
 
-    rc = wal_append_record(wal, &hdr, nullptr, nullptr, 0);
+    /* Flush WAL buffer */
+    rc = wal_flush_buffer(wal);
     if (rc != SPEEDSQL_OK) {
         mutex_unlock(&wal->lock);
         return rc;
     }
 
-    rc = wal_flush_buffer(wal);
-    if (rc != SPEEDSQL_OK) {
+    uint8_t* kept = nullptr;
+    size_t kept_len = 0;
+    uint64_t dropped = 0;
+    rc = wal_checkpoint_tail(wal, &kept, &kept_len, &dropped);
+    if (rc != SPEEDSQL_OK || !dropped) {
+        sdb_free(kept);
         mutex_unlock(&wal->lock);
         return rc;
     }
 
-    /* Update checkpoint LSN in header */
-    wal->checkpoint_lsn = hdr.lsn;
+    /* Readers that find the checkpoint LSN above the last commit they
+     * applied know the log restarted. Until the kept records are logged
+     * again the header claims every commit was dropped, so a crash in
+     * between sends followers to reseed rather than skip transactions. */
+    uint64_t base_lsn = dropped > wal->base_lsn ? dropped : wal->base_lsn;
+    wal->checkpoint_lsn = wal->current_lsn++;
+    wal->base_lsn = wal->checkpoint_lsn;
     rc = wal_write_header(wal);
-    if (rc != SPEEDSQL_OK) {
+
+    /* Restart the log after the header and log the kept records again,
+     * with their own LSNs */
+    if (rc == SPEEDSQL_OK) {
+        rc = file_truncate(&wal->file, WAL_HEADER_SIZE);
+    }
+    if (rc == SPEEDSQL_OK) {
+        wal->export_lsn = 0;
+        wal->export_pos = 0;
+    }
+    size_t pos = 0;
+    while (rc == SPEEDSQL_OK && pos < kept_len) {
+        const wal_record_header_t* hdr = (const wal_record_header_t*)(kept + pos);
+        const uint8_t* data = kept + pos + sizeof(*hdr);
+        if (hdr->type == WAL_RECORD_PAGE) {
+            rc = wal_append_record(wal, hdr, data, data + hdr->data_len, hdr->data_len);
+        } else if (hdr->type == WAL_RECORD_PAGE_IMAGE) {
+            rc = wal_append_record(wal, hdr, nullptr, data, hdr->data_len);
+        } else {
+            rc = wal_append_record(wal, hdr, nullptr, nullptr, 0);
+        }
+        pos += sizeof(*hdr) + wal_record_data_size(hdr) + sizeof(uint32_t);
+    }
+    if (rc == SPEEDSQL_OK) {
+        rc = wal_flush_buffer(wal);
+    }
+    if (rc == SPEEDSQL_OK) {
+        wal->base_lsn = base_lsn;
+        rc = wal_write_header(wal);
+    }
+
+    sdb_free(kept);
+    mutex_unlock(&wal->lock);
+    return rc;
+}
+
+/* The log has outgrown its checkpoint size */
+bool wal_checkpoint_due(wal_t* wal) {
+    if (!wal || wal->checkpoint_size == 0) return false;
+
+    mutex_lock(&wal->lock);
+    uint64_t size = 0;
+    file_size(&wal->file, &size);
+    bool due = size + wal->buffer_pos >= wal->checkpoint_size;
+    mutex_unlock(&wal->lock);
+    return due;
+}
+
+/* ============================================================================
+ * Encryption
+ * ============================================================================ */
+
+bool wal_can_seal(speedsql_cipher_t cipher_id) {
+    return wal_sealer(cipher_id) != nullptr;
+}
+
+int wal_set_cipher(wal_t* wal, struct speedsql_cipher_ctx* ctx, speedsql_cipher_t cipher_id,
+                   bool new_key) {
+    if (!wal) return SPEEDSQL_MISUSE;
+    if (!ctx) {
+        cipher_id = SPEEDSQL_CIPHER_NONE;
+    } else if (!wal_sealer(cipher_id)) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    mutex_lock(&wal->lock);
+
+    /* The key of a log already sealed with this cipher just unlocks it */
+    if (!new_key && cipher_id == wal->cipher_id) {
+        wal->cipher_ctx = ctx;
         mutex_unlock(&wal->lock);
-        return rc;
+        return SPEEDSQL_OK;
     }
 
-    /* Truncate WAL file (optional - removes old log records) */
-    rc = file_truncate(&wal->file, WAL_HEADER_SIZE);
+    /* Otherwise the log starts over, as after a checkpoint: its records
+     * were written to the database file before they were logged, and
+     * nothing sealed the old way is left for the new key to misread.
+     * LSNs keep counting, so followers filter records as before. */
+    wal->buffer_pos = 0;
+    wal->cipher_ctx = ctx;
+    wal->cipher_id = cipher_id;
+
+    int rc = file_truncate(&wal->file, WAL_HEADER_SIZE);
     if (rc == SPEEDSQL_OK) {
-        wal->current_lsn = wal->checkpoint_lsn + 1;
-        wal_write_header(wal);
+        rc = wal_write_header(wal);
     }
 
     mutex_unlock(&wal->lock);
-    return SPEEDSQL_OK;
+    return rc;
+}
+
+/* ============================================================================
+ * Log Shipping
+ *
+ * A primary exports committed records as standalone segments in the WAL
+ * file format; a follower redoes page images from a segment (or straight
+ * from the primary's live log) one committed transaction at a time.
+ * ============================================================================ */
+
+/* Append a batch of records to a segment: as-is, or as one sealed frame */
+static int wal_emit(wal_t* wal, file_t* out, uint64_t* out_pos,
+                    const uint8_t* batch, size_t len) {
+    if (len == 0) return SPEEDSQL_OK;
+
+    size_t written = len;
+    int rc;
+    if (wal->cipher_id != SPEEDSQL_CIPHER_NONE) {
+        rc = wal_write_frame(wal, out, *out_pos, batch, len, &written);
+    } else {
+        rc = file_write(out, *out_pos, batch, len);
+    }
+    if (rc == SPEEDSQL_OK) {
+        *out_pos += written;
+    }
+    return rc;
+}
+
+int wal_export(wal_t* wal, uint64_t from_lsn, file_t* out, uint64_t* next_lsn) {
+    if (!wal || !out) return SPEEDSQL_MISUSE;
+
+    uint8_t* buf = (uint8_t*)sdb_malloc(wal_record_buffer_size());
+    uint8_t* batch = (uint8_t*)sdb_malloc(WAL_FRAME_MAX);
+    if (!buf || !batch) {
+        sdb_free(buf);
+        sdb_free(batch);
+        return SPEEDSQL_NOMEM;
+    }
+
+    mutex_lock(&wal->lock);
+
+    int rc = wal_flush_buffer(wal);
+    speedsql_cipher_t cipher_id = wal->cipher_id;
+
+    /* A checkpoint dropped commits the caller has not had */
+    if (rc == SPEEDSQL_OK && from_lsn > 0 && from_lsn <= wal->base_lsn) {
+        rc = SPEEDSQL_NOTFOUND;
+    }
+
+    /* Continuing the last export resumes where it stopped reading */
+    uint64_t start = WAL_HEADER_SIZE;
+    if (from_lsn > 0 && from_lsn == wal->export_lsn && wal->export_pos > WAL_HEADER_SIZE) {
+        start = wal->export_pos;
+    }
+
+    wal_reader_t reader;
+    bool opened = false;
+    if (rc == SPEEDSQL_OK) {
+        rc = wal_reader_open(&reader, &wal->file, wal->cipher_id, wal->cipher_ctx, start);
+        opened = true;
+    }
+
+    /* Segment header: lsn is where the next export resumes */
+    uint64_t out_pos = WAL_HEADER_SIZE;
+    uint64_t out_committed = WAL_HEADER_SIZE;
+    uint64_t resume_lsn = from_lsn;
+    uint64_t resume_pos = start;
+    size_t batch_len = 0;
+
+    while (rc == SPEEDSQL_OK) {
+        size_t record_size = 0;
+        int next_rc = wal_reader_next(&reader, buf, &record_size, nullptr);
+        if (next_rc != SPEEDSQL_OK) {
+            if (next_rc != SPEEDSQL_DONE) rc = next_rc;
+            break;
+        }
+
+        const wal_record_header_t* hdr = (const wal_record_header_t*)buf;
+        if (hdr->lsn < from_lsn) continue;
+
+        /* Records go out in batches, each one frame of a sealed segment */
+        if (batch_len > 0 && batch_len + record_size > WAL_BUFFER_SIZE) {
+            rc = wal_emit(wal, out, &out_pos, batch, batch_len);
+            batch_len = 0;
+            if (rc != SPEEDSQL_OK) break;
+        }
+        memcpy(batch + batch_len, buf, record_size);
+        batch_len += record_size;
+
+        /* Only whole transactions are shipped */
+        if (hdr->type == WAL_RECORD_COMMIT) {
+            rc = wal_emit(wal, out, &out_pos, batch, batch_len);
+            batch_len = 0;
+            out_committed = out_pos;
+            resume_lsn = hdr->lsn + 1;
+            resume_pos = wal_reader_tell(&reader);
+        }
+    }
+
+    if (opened) {
+        wal_reader_close(&reader);
+    }
+    if (rc == SPEEDSQL_OK) {
+        wal->export_lsn = resume_lsn;
+        wal->export_pos = resume_pos;
+    }
+    mutex_unlock(&wal->lock);
+    sdb_free(batch);
+    sdb_free(buf);
+
+    if (rc == SPEEDSQL_OK) {
+        rc = file_truncate(out, out_committed);
+    }
+    if (rc == SPEEDSQL_OK) {
+        wal_header_t hdr = {};
+        hdr.magic = WAL_MAGIC;
+        hdr.version = cipher_id != SPEEDSQL_CIPHER_NONE ? WAL_VERSION_SEALED : WAL_VERSION;
+        hdr.lsn = resume_lsn;
+        hdr.page_size = SPEEDSQL_PAGE_SIZE;
+        hdr.cipher = cipher_id;
+        hdr.checksum = wal_header_checksum(&hdr);
+
+        uint8_t header_buf[WAL_HEADER_SIZE] = {};
+        memcpy(header_buf, &hdr, sizeof(hdr));
+        rc = file_write(out, 0, header_buf, WAL_HEADER_SIZE);
+    }
+    if (rc == SPEEDSQL_OK) {
+        rc = file_sync(out);
+    }
+
+    if (rc == SPEEDSQL_OK && next_lsn) {
+        *next_lsn = resume_lsn;
+    }
+    return rc;
+}
+
+/* Pending page image awaiting its commit record */
+typedef struct {
+    wal_mark_t mark;
+    txn_id_t txn_id;
+} wal_pending_t;
+
+int wal_redo(file_t* log, file_t* db_file, struct speedsql_cipher_ctx* ctx,
+             speedsql_cipher_t cipher_id, uint64_t* pos, uint64_t* applied_lsn) {
+    if (!log || !db_file || !pos || !applied_lsn) return SPEEDSQL_MISUSE;
+
+    speedsql_cipher_t log_cipher = SPEEDSQL_CIPHER_NONE;
+    uint64_t checkpoint_lsn = 0;
+    uint64_t base_lsn = 0;
+    int rc = wal_check_header(log, &log_cipher, &checkpoint_lsn, &base_lsn);
+    if (rc != SPEEDSQL_OK) return rc;
+
+    /* The log restarted past commits this follower never applied. A follower
+     * that has applied nothing yet starts from wherever the log does. */
+    if (*applied_lsn > 0 && *applied_lsn < base_lsn) return SPEEDSQL_NOTFOUND;
+
+    /* A sealed log opens only with the cipher and key that sealed it */
+    if (log_cipher != SPEEDSQL_CIPHER_NONE && log_cipher != cipher_id) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    uint64_t size = 0;
+    file_size(log, &size);
+
+    /* A log checkpointed since the last applied commit was restarted, and
+     * the saved offset points into the old one; LSNs filter what was applied */
+    uint64_t scan = *pos;
+    if (scan < WAL_HEADER_SIZE || scan > size || checkpoint_lsn > *applied_lsn) {
+        scan = WAL_HEADER_SIZE;
+    }
+
+    uint8_t* buf = (uint8_t*)sdb_malloc(wal_record_buffer_size());
+    if (!buf) return SPEEDSQL_NOMEM;
+
+    wal_reader_t reader;
+    rc = wal_reader_open(&reader, log, log_cipher, ctx, scan);
+    if (rc != SPEEDSQL_OK) {
+        wal_reader_close(&reader);
+        sdb_free(buf);
+        return rc;
+    }
+
+    wal_pending_t* pending = nullptr;
+    size_t pending_count = 0;
+    size_t pending_capacity = 0;
+    uint64_t committed_pos = scan;
+    bool wrote = false;
+
+    while (rc == SPEEDSQL_OK) {
+        size_t record_size = 0;
+        wal_mark_t mark;
+        int next_rc = wal_reader_next(&reader, buf, &record_size, &mark);
+        if (next_rc != SPEEDSQL_OK) {
+            /* End of log or torn tail; a frame that fails to open is not */
+            if (next_rc != SPEEDSQL_DONE) rc = next_rc;
+            break;
+        }
+
+        const wal_record_header_t* hdr = (const wal_record_header_t*)buf;
+        uint64_t after = wal_reader_tell(&reader);
+
+        if (hdr->lsn <= *applied_lsn) {
+            if (hdr->type == WAL_RECORD_COMMIT) {
+                pending_count = 0;
+                committed_pos = after;
+            }
+            continue;
+        }
+
+        if (hdr->type == WAL_RECORD_PAGE_IMAGE) {
+            if (pending_count >= pending_capacity) {
+                size_t new_cap = pending_capacity ? pending_capacity * 2 : 64;
+                wal_pending_t* grown = (wal_pending_t*)sdb_realloc(
+                    pending, new_cap * sizeof(wal_pending_t));
+                if (!grown) {
+                    rc = SPEEDSQL_NOMEM;
+                    break;
+                }
+                pending = grown;
+                pending_capacity = new_cap;
+            }
+            pending[pending_count].mark = mark;
+            pending[pending_count].txn_id = hdr->txn_id;
+            pending_count++;
+        } else if (hdr->type == WAL_RECORD_ROLLBACK) {
+            /* Drop the rolled back transaction's images */
+            txn_id_t txn = hdr->txn_id;
+            size_t kept = 0;
+            for (size_t i = 0; i < pending_count; i++) {
+                if (pending[i].txn_id != txn) pending[kept++] = pending[i];
+            }
+            pending_count = kept;
+        } else if (hdr->type == WAL_RECORD_COMMIT) {
+            uint64_t commit_lsn = hdr->lsn;
+
+            /* Redo every image logged since the previous commit */
+            for (size_t i = 0; i < pending_count && rc == SPEEDSQL_OK; i++) {
+                size_t image_size = 0;
+                rc = wal_reader_at(&reader, &pending[i].mark, buf, &image_size);
+                if (rc != SPEEDSQL_OK) {
+                    rc = SPEEDSQL_CORRUPT;
+                    break;
+                }
+
+                const wal_record_header_t* img = (const wal_record_header_t*)buf;
+                rc = file_write(db_file, (uint64_t)img->page_id * img->data_len,
+                                buf + sizeof(*img), img->data_len);
+                wrote = true;
+            }
+
+            if (rc == SPEEDSQL_OK) {
+                pending_count = 0;
+                committed_pos = after;
+                *applied_lsn = commit_lsn;
+            }
+        }
+    }
+
+    if (rc == SPEEDSQL_OK && wrote) {
+        rc = file_sync(db_file);
+    }
+
+    /* Resume after the last applied commit; pending images are re-read */
+    *pos = committed_pos;
+
+    wal_reader_close(&reader);
+    sdb_free(pending);
+    sdb_free(buf);
+    return rc;
 }
@@ -0,0 +1,125 @@
+/*
+ * SpeedSQL - CPU feature detection
+ *
+ * SIMD code paths are compiled with per-function target attributes and
+ * selected at runtime, so one binary runs everywhere and still uses the
+ * instructions the machine has.
+ */
+
+#include "speedsql_internal.h"
+#include <atomic>
+#include <thread>
+
+#if SPEEDSQL_X86
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
+#if defined(__aarch64__) && defined(__linux__)
+    #include <sys/auxv.h>
+#endif
+
+/* Features callers are allowed to use (tests force the portable paths) */
+static std::atomic<uint32_t> g_cpu_mask{0xFFFFFFFFu};
+
+#if SPEEDSQL_X86
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++) regs[i] = (uint32_t)r[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/* Register state the OS saves on context switch (XCR0) */
+static uint64_t os_saved_state(void) {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+static uint32_t cpu_detect(void) {
+    uint32_t regs[4];
+    uint32_t features = 0;
+
+    cpuid(0, 0, regs);
+    uint32_t max_leaf = regs[0];
+    if (max_leaf < 1) return 0;
+
+    cpuid(1, 0, regs);
+    uint32_t ecx1 = regs[2];
+    uint32_t edx1 = regs[3];
+    if (edx1 & (1u << 26)) features |= CPU_FEATURE_SSE2;
+    if (ecx1 & (1u << 9))  features |= CPU_FEATURE_SSSE3;
+    if (ecx1 & (1u << 19)) features |= CPU_FEATURE_SSE41;
+    if (ecx1 & (1u << 25)) features |= CPU_FEATURE_AESNI;
+    if (ecx1 & (1u << 1))  features |= CPU_FEATURE_PCLMUL;
+
+    /* AVX state must be enabled by the OS before any YMM/ZMM use */
+    bool osxsave = (ecx1 & (1u << 27)) != 0;
+    uint64_t xcr0 = osxsave ? os_saved_state() : 0;
+    bool avx_state = (ecx1 & (1u << 28)) && (xcr0 & 0x6) == 0x6;
+    bool avx512_state = avx_state && (xcr0 & 0xE0) == 0xE0;
+
+    if (max_leaf >= 7) {
+        cpuid(7, 0, regs);
+        uint32_t ebx7 = regs[1];
+        uint32_t ecx7 = regs[2];
+
+        if (ebx7 & (1u << 29)) features |= CPU_FEATURE_SHA;
+        if (avx_state) {
+            if (ebx7 & (1u << 5))  features |= CPU_FEATURE_AVX2;
+            if (ecx1 & (1u << 12)) features |= CPU_FEATURE_FMA;
+            if (ecx7 & (1u << 9))  features |= CPU_FEATURE_VAES;
+            if (ecx7 & (1u << 10)) features |= CPU_FEATURE_VPCLMUL;
+        }
+        if (avx512_state && (ebx7 & (1u << 16))) {
+            features |= CPU_FEATURE_AVX512F;
+        }
+    }
+
+    return features;
+}
+
+#else
+
+static uint32_t cpu_detect(void) {
+    uint32_t features = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    features |= CPU_FEATURE_NEON;  /* Baseline wherever the compiler targets it */
+#endif
+#if defined(__aarch64__) && defined(__APPLE__)
+    features |= CPU_FEATURE_SHA;   /* Every Apple arm64 core has SHA-256 */
+#elif defined(__aarch64__) && defined(__linux__)
+    if (getauxval(AT_HWCAP) & (1u << 6)) {  /* HWCAP_SHA2 */
+        features |= CPU_FEATURE_SHA;
+    }
+#endif
+    return features;
+}
+
+#endif
+
+uint32_t cpu_features(void) {
+    static const uint32_t detected = cpu_detect();
+    return detected & g_cpu_mask.load(std::memory_order_relaxed);
+}
+
+void cpu_features_mask(uint32_t mask) {
+    g_cpu_mask.store(mask, std::memory_order_relaxed);
+}
+
+uint32_t cpu_count(void) {
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? (uint32_t)n : 1;
+}
@@ -0,0 +1,1416 @@
+/*
+ * SpeedSQL - Binary JSON
+ *
+ * JSON values are stored parsed, in a form that is navigated in place:
+ *
+ *   document   version byte, then the root value
+ *   value      tag byte, then by tag:
+ *     null, false, true   nothing
+ *     int                 int64
+ *     float               double
+ *     string              u32 length, UTF-8 bytes with escapes resolved
+ *     array               u32 count, u32 size, u32 offset per element,
+ *                         the elements
+ *     object              u32 count, u32 size, u32 offset per key, u32
+ *                         offset per value, then each key (u32 length,
+ *                         bytes) followed by its value
+ *
+ * Offsets count from the container's tag byte, and size covers what
+ * follows the size field, so a whole value is skipped in one step.
+ * Object keys are sorted bytewise and unique (the last duplicate in the
+ * text wins): a key is a binary search over the offset table and an
+ * array element a single lookup, with nothing parsed. Text is rendered
+ * back only when asked for, compact and with keys in sorted order.
+ *
+ * Text is parsed in two stages, as simdjson does: a SIMD pass finds every
+ * structural byte, then a walk over those positions builds the document,
+ * or, for a path into text, skips straight to the one value wanted.
+ */
+
+#include "speedsql_internal.h"
+#include <errno.h>
+#include <math.h>
+
+#if SPEEDSQL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+    #define JSON_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#define JSONB_VERSION   1
+#define JSON_MAX_DEPTH  512
+
+/* Container header: tag, count, size */
+#define JSONB_HEADER    9
+
+/* ============================================================================
+ * Buffers
+ * ============================================================================ */
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} json_buf_t;
+
+static bool jbuf_reserve(json_buf_t* b, size_t extra) {
+    if (b->failed) return false;
+    if (b->len + extra <= b->cap) return true;
+
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + extra) cap *= 2;
+    uint8_t* grown = (uint8_t*)sdb_realloc(b->data, cap);
+    if (!grown) {
+        b->failed = true;
+        return false;
+    }
+    b->data = grown;
+    b->cap = cap;
+    return true;
+}
+
+static void jbuf_put(json_buf_t* b, const void* data, size_t n) {
+    if (n == 0 || !jbuf_reserve(b, n)) return;
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+}
+
+static inline void jbuf_byte(json_buf_t* b, uint8_t c) {
+    jbuf_put(b, &c, 1);
+}
+
+static inline void jbuf_u32(json_buf_t* b, uint32_t v) {
+    jbuf_put(b, &v, sizeof(v));
+}
+
+static inline void jbuf_set_u32(json_buf_t* b, size_t at, uint32_t v) {
+    if (!b->failed) memcpy(b->data + at, &v, sizeof(v));
+}
+
+static inline uint32_t read_u32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* ============================================================================
+ * Stage 1: Structural Index
+ *
+ * Text is classified 64 bytes at a time into bitmasks of quotes,
+ * backslashes, operators ({}[]:,), whitespace and control bytes, with
+ * SSE2, AVX2 or NEON compares where the CPU has them. Escaped quotes are
+ * dropped with carry-propagating arithmetic on the backslash mask, and a
+ * prefix XOR over the quote mask marks what lies inside strings. What is
+ * left is the position of every quote, every operator outside a string
+ * and the first byte of every other token, in order.
+ * ============================================================================ */
+
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;
+    uint64_t space;
+    uint64_t ctrl;
+} json_block_t;
+
+typedef void (*json_classify_fn)(const uint8_t* in, json_block_t* out);
+
+typedef struct {
+    const char* text;
+    size_t len;
+    uint32_t* pos;               /* Structural byte offsets, ascending */
+    uint32_t count;
+} json_index_t;
+
+static void classify_portable(const uint8_t* in, json_block_t* out) {
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < 64; i++) {
+        uint64_t bit = 1ULL << i;
+        switch (in[i]) {
+            case '"':  out->quote |= bit; break;
+            case '\\': out->backslash |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                out->op |= bit;
+                break;
+            case ' ': case '\t': case '\n': case '\r':
+                out->space |= bit;
+                break;
+            default:
+                break;
+        }
+        if (in[i] < 0x20) out->ctrl |= bit;
+    }
+}
+
+#if SPEEDSQL_X86
+
+/* '[' and ']' differ from '{' and '}' only in bit 5, so OR-ing 0x20 in
+ * folds the brackets onto the braces */
+SPEEDSQL_TARGET("sse2")
+static void classify_sse2(const uint8_t* in, json_block_t* out) {
+    const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+    const __m128i open = _mm_set1_epi8('{'), close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':'), comma = _mm_set1_epi8(',');
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    const __m128i fold = _mm_set1_epi8(0x20), ctrl = _mm_set1_epi8(0x1F);
+
+    memset(out, 0, sizeof(*out));
+    for (int k = 0; k < 4; k++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + 16 * k));
+        __m128i folded = _mm_or_si128(v, fold);
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        int shift = 16 * k;
+        out->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << shift;
+        out->backslash |=
+            (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << shift;
+        out->op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << shift;
+        out->space |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << shift;
+        out->ctrl |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl)) << shift;
+    }
+}
+
+SPEEDSQL_TARGET("avx2")
+static void classify_avx2(const uint8_t* in, json_block_t* out) {
+    const __m256i quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\');
+    const __m256i open = _mm256_set1_epi8('{'), close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':'), comma = _mm256_set1_epi8(',');
+    const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+    const __m256i fold = _mm256_set1_epi8(0x20), ctrl = _mm256_set1_epi8(0x1F);
+
+    memset(out, 0, sizeof(*out));
+    for (int k = 0; k < 2; k++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in + 32 * k));
+        __m256i folded = _mm256_or_si256(v, fold);
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+        __m256i ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+        int shift = 32 * k;
+        out->quote |=
+            (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << shift;
+        out->backslash |=
+            (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << shift;
+        out->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << shift;
+        out->space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << shift;
+        out->ctrl |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctrl), ctrl)) << shift;
+    }
+}
+
+#endif /* SPEEDSQL_X86 */
+
+#ifdef JSON_NEON
+
+/* Four compare results (0x00/0xFF bytes) to one bit per byte */
+static inline uint64_t neon_bits(uint8x16_t m0, uint8x16_t m1, uint8x16_t m2, uint8x16_t m3) {
+    const uint8x16_t weight = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t s0 = vpaddq_u8(vandq_u8(m0, weight), vandq_u8(m1, weight));
+    uint8x16_t s1 = vpaddq_u8(vandq_u8(m2, weight), vandq_u8(m3, weight));
+    s0 = vpaddq_u8(s0, s1);
+    s0 = vpaddq_u8(s0, s0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+}
+
+static void classify_neon(const uint8_t* in, json_block_t* out) {
+    uint8x16_t v[4], quote[4], backslash[4], op[4], ws[4], ctrl[4];
+    for (int k = 0; k < 4; k++) {
+        v[k] = vld1q_u8(in + 16 * k);
+        uint8x16_t folded = vorrq_u8(v[k], vdupq_n_u8(0x20));
+        quote[k] = vceqq_u8(v[k], vdupq_n_u8('"'));
+        backslash[k] = vceqq_u8(v[k], vdupq_n_u8('\\'));
+        op[k] = vorrq_u8(vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')),
+                                  vceqq_u8(folded, vdupq_n_u8('}'))),
+                         vorrq_u8(vceqq_u8(v[k], vdupq_n_u8(':')),
+                                  vceqq_u8(v[k], vdupq_n_u8(','))));
+        ws[k] = vorrq_u8(vorrq_u8(vceqq_u8(v[k], vdupq_n_u8(' ')),
+                                  vceqq_u8(v[k], vdupq_n_u8('\t'))),
+                         vorrq_u8(vceqq_u8(v[k], vdupq_n_u8('\n')),
+                                  vceqq_u8(v[k], vdupq_n_u8('\r'))));
+        ctrl[k] = vcltq_u8(v[k], vdupq_n_u8(0x20));
+    }
+    out->quote = neon_bits(quote[0], quote[1], quote[2], quote[3]);
+    out->backslash = neon_bits(backslash[0], backslash[1], backslash[2], backslash[3]);
+    out->op = neon_bits(op[0], op[1], op[2], op[3]);
+    out->space = neon_bits(ws[0], ws[1], ws[2], ws[3]);
+    out->ctrl = neon_bits(ctrl[0], ctrl[1], ctrl[2], ctrl[3]);
+}
+
+#endif /* JSON_NEON */
+
+static json_classify_fn json_classifier(void) {
+    uint32_t features = cpu_features();
+#if SPEEDSQL_X86
+    if (features & CPU_FEATURE_AVX2) return classify_avx2;
+    if (features & CPU_FEATURE_SSE2) return classify_sse2;
+#elif defined(JSON_NEON)
+    if (features & CPU_FEATURE_NEON) return classify_neon;
+#endif
+    (void)features;
+    return classify_portable;
+}
+
+static inline int ctz64(uint64_t x) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+/* Bit i set when an odd number of bits at or below i are set */
+static inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/* Bytes preceded by an odd run of backslashes. A run that starts on an
+ * odd bit and is added to itself carries out on the even bit past its
+ * end, and the other way round; carry tracks a run ending a block */
+static inline uint64_t escaped_bits(uint64_t backslash, uint64_t* carry) {
+    const uint64_t even = 0x5555555555555555ULL;
+    if (backslash == 0) {
+        uint64_t escaped = *carry;
+        *carry = 0;
+        return escaped;
+    }
+    backslash &= ~*carry;
+    uint64_t follows = (backslash << 1) | *carry;
+    uint64_t odd_starts = backslash & ~even & ~follows;
+    uint64_t even_ends = odd_starts + backslash;
+    *carry = even_ends < odd_starts ? 1 : 0;
+    return (even ^ (even_ends << 1)) & follows;
+}
+
+static int json_index_build(const char* text, size_t len, json_index_t* ix) {
+    memset(ix, 0, sizeof(*ix));
+    if (len >= UINT32_MAX) return SPEEDSQL_RANGE;
+    ix->text = text;
+    ix->len = len;
+    ix->pos = (uint32_t*)sdb_malloc((len + 1) * sizeof(uint32_t));
+    if (!ix->pos) return SPEEDSQL_NOMEM;
+
+    json_classify_fn classify = json_classifier();
+    uint64_t escape_carry = 0, in_string_carry = 0, scalar_carry = 0;
+    uint8_t tail[64];
+
+    for (size_t base = 0; base < len; base += 64) {
+        const uint8_t* block = (const uint8_t*)text + base;
+        if (len - base < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, len - base);
+            block = tail;
+        }
+
+        json_block_t b;
+        classify(block, &b);
+
+        uint64_t quote = b.quote & ~escaped_bits(b.backslash, &escape_carry);
+        /* Opening quotes and string bodies; closing quotes are outside */
+        uint64_t in_string = prefix_xor(quote) ^ in_string_carry;
+        in_string_carry = 0ULL - (in_string >> 63);
+        if (b.ctrl & in_string) return SPEEDSQL_MISMATCH;
+
+        uint64_t outside = ~in_string & ~quote;
+        uint64_t scalar = outside & ~(b.op | b.space);
+        uint64_t structural = (b.op & outside) | quote |
+                              (scalar & ~((scalar << 1) | scalar_carry));
+        scalar_carry = scalar >> 63;
+
+        while (structural) {
+            ix->pos[ix->count++] = (uint32_t)(base + (size_t)ctz64(structural));
+            structural &= structural - 1;
+        }
+    }
+
+    /* A string still open at the end */
+    return in_string_carry ? SPEEDSQL_MISMATCH : SPEEDSQL_OK;
+}
+
+/* ============================================================================
+ * Stage 2: Building
+ *
+ * A walk over the structural index with an explicit stack builds a tree
+ * of nodes for the encoder; strings are unescaped into one arena and
+ * nodes refer to them by offset. Strings end at the next structural
+ * (their closing quote), so one without escapes is a single copy.
+ * ============================================================================ */
+
+typedef struct {
+    uint8_t tag;
+    uint32_t key_off;            /* Member of an object: its key in the arena */
+    uint32_t key_len;
+    uint32_t str_off;            /* String */
+    uint32_t str_len;
+    int64_t i;
+    double f;
+    uint32_t first;              /* Children, as node index + 1; 0 for none */
+    uint32_t last;
+    uint32_t next;               /* Next sibling, as index + 1 */
+    uint32_t count;
+} json_node_t;
+
+typedef struct {
+    const json_index_t* ix;
+    json_node_t* nodes;
+    uint32_t node_count;
+    uint32_t node_cap;
+    json_buf_t arena;
+} json_parser_t;
+
+static uint32_t parse_node(json_parser_t* jp, uint8_t tag) {
+    if (jp->node_count == jp->node_cap) {
+        uint32_t cap = jp->node_cap ? jp->node_cap * 2 : 64;
+        json_node_t* grown = (json_node_t*)sdb_realloc(jp->nodes, cap * sizeof(json_node_t));
+        if (!grown) return 0;
+        jp->nodes = grown;
+        jp->node_cap = cap;
+    }
+    json_node_t* n = &jp->nodes[jp->node_count];
+    memset(n, 0, sizeof(*n));
+    n->tag = tag;
+    return ++jp->node_count;
+}
+
+static void utf8_put(json_buf_t* b, uint32_t cp) {
+    uint8_t out[4];
+    size_t n;
+    if (cp < 0x80) {
+        out[0] = (uint8_t)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        out[0] = (uint8_t)(0xC0 | (cp >> 6));
+        out[1] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        out[0] = (uint8_t)(0xE0 | (cp >> 12));
+        out[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        out[0] = (uint8_t)(0xF0 | (cp >> 18));
+        out[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    jbuf_put(b, out, n);
+}
+
+static bool parse_hex4(const char* p, const char* end, uint32_t* out) {
+    if (end - p < 4) return false;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') {
+            v |= (uint32_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            v |= (uint32_t)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            v |= (uint32_t)(c - 'A' + 10);
+        } else {
+            return false;
+        }
+    }
+    *out = v;
+    return true;
+}
+
+/* Unescape the body of a string, p to end, onto out */
+static bool unescape(const char* p, const char* end, json_buf_t* out) {
+    while (p < end) {
+        const char* slash = (const char*)memchr(p, '\\', (size_t)(end - p));
+        if (!slash) {
+            jbuf_put(out, p, (size_t)(end - p));
+            return true;
+        }
+        jbuf_put(out, p, (size_t)(slash - p));
+        p = slash + 1;
+        if (p >= end) return false;
+
+        switch (*p++) {
+            case '"':  jbuf_byte(out, '"'); break;
+            case '\\': jbuf_byte(out, '\\'); break;
+            case '/':  jbuf_byte(out, '/'); break;
+            case 'b':  jbuf_byte(out, '\b'); break;
+            case 'f':  jbuf_byte(out, '\f'); break;
+            case 'n':  jbuf_byte(out, '\n'); break;
+            case 'r':  jbuf_byte(out, '\r'); break;
+            case 't':  jbuf_byte(out, '\t'); break;
+            case 'u': {
+                uint32_t cp, low;
+                if (!parse_hex4(p, end, &cp)) return false;
+                p += 4;
+                /* A high surrogate pairs with the low one after it */
+                if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' &&
+                    p[1] == 'u' && parse_hex4(p + 2, end, &low) &&
+                    low >= 0xDC00 && low <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                if (cp >= 0xD800 && cp <= 0xDFFF) cp = 0xFFFD;  /* Lone surrogate */
+                utf8_put(out, cp);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+/* The string opening at structural i, onto the arena */
+static bool parse_string(json_parser_t* jp, uint32_t i, uint32_t end,
+                         uint32_t* off, uint32_t* len) {
+    const json_index_t* ix = jp->ix;
+    if (i + 1 >= end || ix->text[ix->pos[i + 1]] != '"') return false;
+
+    size_t start = jp->arena.len;
+    if (!unescape(ix->text + ix->pos[i] + 1, ix->text + ix->pos[i + 1], &jp->arena) ||
+        jp->arena.failed || jp->arena.len - start > UINT32_MAX) {
+        return false;
+    }
+    *off = (uint32_t)start;
+    *len = (uint32_t)(jp->arena.len - start);
+    return true;
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/* An integer when it has no fraction or exponent and fits, else a float;
+ * the token has to end where the number does */
+static bool parse_number(const char* p, const char* end, json_node_t* n) {
+    const char* start = p;
+    bool integral = true;
+
+    if (p < end && *p == '-') p++;
+    if (p >= end || !is_digit(*p)) return false;
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < end && is_digit(*p)) p++;
+    }
+    if (p < end && *p == '.') {
+        integral = false;
+        p++;
+        if (p >= end || !is_digit(*p)) return false;
+        while (p < end && is_digit(*p)) p++;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        integral = false;
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) p++;
+        if (p >= end || !is_digit(*p)) return false;
+        while (p < end && is_digit(*p)) p++;
+    }
+    if (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' &&
+        !strchr("{}[]:,\"", *p)) {
+        return false;
+    }
+
+    /* Up to 18 digits cannot overflow; longer goes through strtoll */
+    size_t len = (size_t)(p - start);
+    bool negative = *start == '-';
+    if (integral && len - negative <= 18) {
+        int64_t v = 0;
+        for (const char* d = start + negative; d < p; d++) v = v * 10 + (*d - '0');
+        n->tag = JSONB_INT;
+        n->i = negative ? -v : v;
+        return true;
+    }
+
+    /* strtod and strtoll want a terminated copy */
+    char small[64];
+    char* copy = len < sizeof(small) ? small : (char*)sdb_malloc(len + 1);
+    if (!copy) return false;
+    memcpy(copy, start, len);
+    copy[len] = '\0';
+
+    if (integral) {
+        errno = 0;
+        long long v = strtoll(copy, nullptr, 10);
+        if (errno == ERANGE) {
+            integral = false;
+        } else {
+            n->tag = JSONB_INT;
+            n->i = v;
+        }
+    }
+    if (!integral) {
+        n->tag = JSONB_FLOAT;
+        n->f = strtod(copy, nullptr);
+    }
+    if (copy != small) sdb_free(copy);
+    return true;
+}
+
+static bool parse_literal(const char* p, const char* end, const char* word) {
+    size_t n = strlen(word);
+    if ((size_t)(end - p) < n || memcmp(p, word, n) != 0) return false;
+    p += n;
+    return p == end || *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' ||
+           strchr("{}[]:,\"", *p) != nullptr;
+}
+
+static void add_child(json_parser_t* jp, uint32_t parent, uint32_t child) {
+    json_node_t* p = &jp->nodes[parent - 1];
+    if (p->last) {
+        jp->nodes[p->last - 1].next = child;
+    } else {
+        p->first = child;
+    }
+    p->last = child;
+    p->count++;
+}
+
+/* A scalar token at structural i */
+static bool parse_scalar(json_parser_t* jp, uint32_t i, uint32_t end, uint32_t id) {
+    const json_index_t* ix = jp->ix;
+    const char* p = ix->text + ix->pos[i];
+    const char* stop = ix->text + ix->len;
+    json_node_t* n = &jp->nodes[id - 1];
+
+    if (*p == '"') {
+        uint32_t off, len;
+        if (!parse_string(jp, i, end, &off, &len)) return false;
+        n = &jp->nodes[id - 1];
+        n->tag = JSONB_STRING;
+        n->str_off = off;
+        n->str_len = len;
+        return true;
+    }
+    if (*p == '-' || is_digit(*p)) return parse_number(p, stop, n);
+    if (parse_literal(p, stop, "true")) {
+        n->tag = JSONB_TRUE;
+        return true;
+    }
+    if (parse_literal(p, stop, "false")) {
+        n->tag = JSONB_FALSE;
+        return true;
+    }
+    return parse_literal(p, stop, "null");
+}
+
+typedef enum { BUILD_VALUE, BUILD_KEY, BUILD_NEXT } json_build_state_t;
+
+/* Exactly one value over structurals [i, end); its node index + 1 */
+static int json_build(json_parser_t* jp, uint32_t i, uint32_t end, uint32_t* root) {
+    const json_index_t* ix = jp->ix;
+    const char* text = ix->text;
+    uint32_t stack[JSON_MAX_DEPTH];
+    int depth = 0;
+    uint32_t key_off = 0, key_len = 0;
+    json_build_state_t state = BUILD_VALUE;
+    *root = 0;
+
+    for (;;) {
+        if (state == BUILD_VALUE) {
+            if (i >= end) return SPEEDSQL_MISMATCH;
+            char c = text[ix->pos[i]];
+            bool open = c == '{' || c == '[';
+            if (!open && (c == '}' || c == ']' || c == ':' || c == ',')) return SPEEDSQL_MISMATCH;
+            if (open && depth == JSON_MAX_DEPTH) return SPEEDSQL_MISMATCH;
+
+            uint32_t id = parse_node(jp, c == '{' ? JSONB_OBJECT : c == '[' ? JSONB_ARRAY
+                                                                          : JSONB_NULL);
+            if (!id) return SPEEDSQL_NOMEM;
+            if (depth == 0) {
+                *root = id;
+            } else {
+                jp->nodes[id - 1].key_off = key_off;
+                jp->nodes[id - 1].key_len = key_len;
+                add_child(jp, stack[depth - 1], id);
+            }
+
+            if (!open) {
+                if (!parse_scalar(jp, i, end, id)) {
+                    return jp->arena.failed ? SPEEDSQL_NOMEM : SPEEDSQL_MISMATCH;
+                }
+                i += c == '"' ? 2 : 1;
+                state = BUILD_NEXT;
+                continue;
+            }
+
+            stack[depth++] = id;
+            i++;
+            if (i < end && text[ix->pos[i]] == (c == '{' ? '}' : ']')) {
+                i++;
+                depth--;
+                state = BUILD_NEXT;
+            } else {
+                state = c == '{' ? BUILD_KEY : BUILD_VALUE;
+            }
+        } else if (state == BUILD_KEY) {
+            if (i >= end || text[ix->pos[i]] != '"' ||
+                !parse_string(jp, i, end, &key_off, &key_len)) {
+                return jp->arena.failed ? SPEEDSQL_NOMEM : SPEEDSQL_MISMATCH;
+            }
+            i += 2;
+            if (i >= end || text[ix->pos[i]] != ':') return SPEEDSQL_MISMATCH;
+            i++;
+            state = BUILD_VALUE;
+        } else {
+            if (depth == 0) return i == end ? SPEEDSQL_OK : SPEEDSQL_MISMATCH;
+            if (i >= end) return SPEEDSQL_MISMATCH;
+
+            char c = text[ix->pos[i++]];
+            bool object = jp->nodes[stack[depth - 1] - 1].tag == JSONB_OBJECT;
+            if (c == ',') {
+                state = object ? BUILD_KEY : BUILD_VALUE;
+            } else if (c == (object ? '}' : ']')) {
+                depth--;
+            } else {
+                return SPEEDSQL_MISMATCH;
+            }
+        }
+    }
+}
+
+/* ============================================================================
+ * Encoder
+ * ============================================================================ */
+
+typedef struct {
+    const uint8_t* key;
+    uint32_t len;
+    uint32_t node;
+    uint32_t order;              /* Position in the text */
+} json_member_t;
+
+static int member_compare(const void* a, const void* b) {
+    const json_member_t* x = (const json_member_t*)a;
+    const json_member_t* y = (const json_member_t*)b;
+    int cmp = memcmp(x->key, y->key, x->len < y->len ? x->len : y->len);
+    if (cmp != 0) return cmp;
+    if (x->len != y->len) return x->len < y->len ? -1 : 1;
+    return x->order < y->order ? -1 : (x->order > y->order ? 1 : 0);
+}
+
+static void encode_node(json_parser_t* jp, uint32_t id, json_buf_t* out) {
+    const json_node_t* n = &jp->nodes[id - 1];
+    size_t at = out->len;
+    jbuf_byte(out, n->tag);
+
+    switch (n->tag) {
+        case JSONB_INT:
+            jbuf_put(out, &n->i, sizeof(n->i));
+            return;
+        case JSONB_FLOAT:
+            jbuf_put(out, &n->f, sizeof(n->f));
+            return;
+        case JSONB_STRING:
+            jbuf_u32(out, n->str_len);
+            jbuf_put(out, jp->arena.data + n->str_off, n->str_len);
+            return;
+        case JSONB_ARRAY: {
+            uint32_t count = n->count;
+            jbuf_u32(out, count);
+            jbuf_u32(out, 0);
+            size_t table = out->len;
+            if (!jbuf_reserve(out, (size_t)count * sizeof(uint32_t))) return;
+            out->len += (size_t)count * sizeof(uint32_t);
+
+            uint32_t i = 0;
+            for (uint32_t child = n->first; child; child = jp->nodes[child - 1].next, i++) {
+                jbuf_set_u32(out, table + i * sizeof(uint32_t), (uint32_t)(out->len - at));
+                encode_node(jp, child, out);
+            }
+            jbuf_set_u32(out, at + 5, (uint32_t)(out->len - at - JSONB_HEADER));
+            return;
+        }
+        case JSONB_OBJECT: {
+            json_member_t* members = nullptr;
+            uint32_t count = 0;
+            if (n->count > 0) {
+                members = (json_member_t*)sdb_malloc(n->count * sizeof(json_member_t));
+                if (!members) {
+                    out->failed = true;
+                    return;
+                }
+                for (uint32_t child = n->first; child; child = jp->nodes[child - 1].next) {
+                    const json_node_t* c = &jp->nodes[child - 1];
+                    members[count].key = jp->arena.data + c->key_off;
+                    members[count].len = c->key_len;
+                    members[count].node = child;
+                    members[count].order = count;
+                    count++;
+                }
+                qsort(members, count, sizeof(json_member_t), member_compare);
+
+                /* Of equal keys the last one in the text stays */
+                uint32_t kept = 0;
+                for (uint32_t i = 0; i < count; i++) {
+                    bool dup = i + 1 < count && members[i + 1].len == members[i].len &&
+                               memcmp(members[i + 1].key, members[i].key, members[i].len) == 0;
+                    if (!dup) members[kept++] = members[i];
+                }
+                count = kept;
+            }
+
+            jbuf_u32(out, count);
+            jbuf_u32(out, 0);
+            size_t table = out->len;
+            if (!jbuf_reserve(out, (size_t)count * 2 * sizeof(uint32_t))) {
+                sdb_free(members);
+                return;
+            }
+            out->len += (size_t)count * 2 * sizeof(uint32_t);
+
+            for (uint32_t i = 0; i < count; i++) {
+                jbuf_set_u32(out, table + i * sizeof(uint32_t), (uint32_t)(out->len - at));
+                jbuf_u32(out, members[i].len);
+                jbuf_put(out, members[i].key, members[i].len);
+                jbuf_set_u32(out, table + (count + i) * sizeof(uint32_t),
+                             (uint32_t)(out->len - at));
+                encode_node(jp, members[i].node, out);
+            }
+            jbuf_set_u32(out, at + 5, (uint32_t)(out->len - at - JSONB_HEADER));
+            sdb_free(members);
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+/* Encode the value over structurals [from, to) as a document */
+static int json_encode_range(const json_index_t* ix, uint32_t from, uint32_t to,
+                             uint8_t** out, uint32_t* out_len) {
+    json_parser_t jp;
+    memset(&jp, 0, sizeof(jp));
+    jp.ix = ix;
+
+    uint32_t root;
+    int rc = json_build(&jp, from, to, &root);
+
+    json_buf_t doc = {};
+    if (rc == SPEEDSQL_OK) {
+        jbuf_byte(&doc, JSONB_VERSION);
+        encode_node(&jp, root, &doc);
+        if (doc.failed) rc = SPEEDSQL_NOMEM;
+        else if (doc.len > UINT32_MAX / 2) rc = SPEEDSQL_RANGE;
+    }
+
+    sdb_free(jp.nodes);
+    sdb_free(jp.arena.data);
+    if (rc != SPEEDSQL_OK) {
+        sdb_free(doc.data);
+        return rc;
+    }
+    *out = doc.data;
+    *out_len = (uint32_t)doc.len;
+    return SPEEDSQL_OK;
+}
+
+int jsonb_from_text(const char* text, size_t len, uint8_t** out, uint32_t* out_len) {
+    if (!out || !out_len || (!text && len > 0)) return SPEEDSQL_MISUSE;
+    *out = nullptr;
+    *out_len = 0;
+
+    json_index_t ix;
+    int rc = json_index_build(text, len, &ix);
+    if (rc == SPEEDSQL_OK) rc = json_encode_range(&ix, 0, ix.count, out, out_len);
+    sdb_free(ix.pos);
+    return rc;
+}
+
+/* ============================================================================
+ * Paths
+ *
+ * $ then any of .key, ."quoted key" and [index].
+ * ============================================================================ */
+
+typedef struct {
+    const char* key;
+    uint32_t key_len;
+    uint32_t index;
+    bool is_index;
+} json_step_t;
+
+/* The step at *cursor: SPEEDSQL_ROW with one, SPEEDSQL_DONE at the end,
+ * SPEEDSQL_ERROR when malformed, SPEEDSQL_RANGE for an index past 2^32 */
+static int path_next(const char** cursor, json_step_t* step) {
+    const char* p = *cursor;
+    if (*p == '\0') return SPEEDSQL_DONE;
+
+    if (*p == '.') {
+        p++;
+        const char* key = p;
+        size_t len;
+        if (*p == '"') {
+            key = ++p;
+            while (*p && *p != '"') p++;
+            if (*p != '"') return SPEEDSQL_ERROR;
+            len = (size_t)(p - key);
+            p++;
+        } else {
+            while (*p && *p != '.' && *p != '[') p++;
+            len = (size_t)(p - key);
+            if (len == 0) return SPEEDSQL_ERROR;
+        }
+        if (len > UINT32_MAX) return SPEEDSQL_RANGE;
+        step->key = key;
+        step->key_len = (uint32_t)len;
+        step->is_index = false;
+    } else if (*p == '[') {
+        p++;
+        if (!is_digit(*p)) return SPEEDSQL_ERROR;
+        uint64_t index = 0;
+        while (is_digit(*p)) {
+            index = index * 10 + (uint64_t)(*p++ - '0');
+            if (index > UINT32_MAX) return SPEEDSQL_RANGE;
+        }
+        if (*p++ != ']') return SPEEDSQL_ERROR;
+        step->index = (uint32_t)index;
+        step->is_index = true;
+    } else {
+        return SPEEDSQL_ERROR;
+    }
+    *cursor = p;
+    return SPEEDSQL_ROW;
+}
+
+/* Whether a path is well formed, before it meets a document */
+static bool path_valid(const char* path) {
+    if (!path || path[0] != '$') return false;
+    const char* p = path + 1;
+    json_step_t step;
+    int rc;
+    do {
+        rc = path_next(&p, &step);
+    } while (rc == SPEEDSQL_ROW);
+    return rc == SPEEDSQL_DONE || rc == SPEEDSQL_RANGE;
+}
+
+/* ============================================================================
+ * On-Demand Extraction
+ *
+ * A path over JSON text follows the structural index directly: members
+ * and elements that are not on the path are skipped by bracket counting
+ * over their structurals, without being parsed. The structurals must
+ * form one balanced, well-ordered value with nothing after it; only the
+ * value found is built, so only its scalars are checked.
+ * ============================================================================ */
+
+static inline char od_char(const json_index_t* ix, uint32_t i) {
+    return i < ix->count ? ix->text[ix->pos[i]] : '\0';
+}
+
+/* The structural just past the value at i */
+static uint32_t od_skip(const json_index_t* ix, uint32_t i) {
+    char c = od_char(ix, i);
+    if (c == '"') return i + 2;
+    if (c != '{' && c != '[') return i + 1;
+
+    uint32_t depth = 0;
+    for (; i < ix->count; i++) {
+        c = ix->text[ix->pos[i]];
+        if (c == '"') {
+            i++;
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return ix->count;
+}
+
+/* Whether the structurals form exactly one value: brackets balanced and
+ * matched, keys, colons and commas where the grammar puts them, and no
+ * trailing tokens. Scalars are not parsed. */
+static bool od_well_formed(const json_index_t* ix) {
+    bool object[JSON_MAX_DEPTH];
+    int depth = 0;
+    uint32_t i = 0;
+    json_build_state_t state = BUILD_VALUE;
+
+    for (;;) {
+        if (state == BUILD_VALUE) {
+            char c = od_char(ix, i);
+            if (c == '{' || c == '[') {
+                if (depth == JSON_MAX_DEPTH) return false;
+                object[depth++] = c == '{';
+                i++;
+                if (od_char(ix, i) == (c == '{' ? '}' : ']')) {
+                    i++;
+                    depth--;
+                    state = BUILD_NEXT;
+                } else {
+                    state = c == '{' ? BUILD_KEY : BUILD_VALUE;
+                }
+            } else if (c == '"') {
+                if (od_char(ix, i + 1) != '"') return false;
+                i += 2;
+                state = BUILD_NEXT;
+            } else {
+                if (c == '\0' || c == '}' || c == ']' || c == ':' || c == ',') return false;
+                i++;
+                state = BUILD_NEXT;
+            }
+        } else if (state == BUILD_KEY) {
+            if (od_char(ix, i) != '"' || od_char(ix, i + 1) != '"' || od_char(ix, i + 2) != ':') {
+                return false;
+            }
+            i += 3;
+            state = BUILD_VALUE;
+        } else {
+            if (depth == 0) return i == ix->count;
+
+            char c = od_char(ix, i++);
+            if (c == ',') {
+                state = object[depth - 1] ? BUILD_KEY : BUILD_VALUE;
+            } else if (c == (object[depth - 1] ? '}' : ']')) {
+                depth--;
+            } else {
+                return false;
+            }
+        }
+    }
+}
+
+/* Whether the string at structural i spells key */
+static bool od_key_equals(const json_index_t* ix, uint32_t i, const char* key, uint32_t len,
+                          json_buf_t* scratch) {
+    const char* p = ix->text + ix->pos[i] + 1;
+    const char* end = ix->text + ix->pos[i + 1];
+    if (!memchr(p, '\\', (size_t)(end - p))) {
+        return (size_t)(end - p) == len && memcmp(p, key, len) == 0;
+    }
+    scratch->len = 0;
+    return unescape(p, end, scratch) && !scratch->failed && scratch->len == len &&
+           memcmp(scratch->data, key, len) == 0;
+}
+
+/* The member of the object at *i named by step; of duplicates the last,
+ * as in the binary form */
+static int od_member(const json_index_t* ix, uint32_t* i, const json_step_t* step,
+                     json_buf_t* scratch) {
+    uint32_t at = *i + 1;
+    uint32_t found = UINT32_MAX;
+    if (od_char(ix, at) == '}') return SPEEDSQL_NOTFOUND;
+
+    for (;;) {
+        if (od_char(ix, at) != '"' || od_char(ix, at + 1) != '"' || od_char(ix, at + 2) != ':') {
+            return SPEEDSQL_MISMATCH;
+        }
+        bool match = od_key_equals(ix, at, step->key, step->key_len, scratch);
+        at += 3;
+        if (match) found = at;
+        at = od_skip(ix, at);
+
+        char c = od_char(ix, at++);
+        if (c == '}') break;
+        if (c != ',') return SPEEDSQL_MISMATCH;
+    }
+    if (found == UINT32_MAX) return SPEEDSQL_NOTFOUND;
+    *i = found;
+    return SPEEDSQL_OK;
+}
+
+static int od_element(const json_index_t* ix, uint32_t* i, uint32_t index) {
+    uint32_t at = *i + 1;
+    if (od_char(ix, at) == ']') return SPEEDSQL_NOTFOUND;
+
+    for (uint32_t n = 0;; n++) {
+        if (n == index) {
+            *i = at;
+            return SPEEDSQL_OK;
+        }
+        at = od_skip(ix, at);
+        char c = od_char(ix, at++);
+        if (c == ']') return SPEEDSQL_NOTFOUND;
+        if (c != ',') return SPEEDSQL_MISMATCH;
+    }
+}
+
+int json_extract_text(const char* text, size_t len, const char* path,
+                      uint8_t** out, uint32_t* out_len) {
+    if (!out || !out_len || (!text && len > 0)) return SPEEDSQL_MISUSE;
+    *out = nullptr;
+    *out_len = 0;
+    if (!path_valid(path)) return SPEEDSQL_ERROR;
+
+    json_index_t ix;
+    int rc = json_index_build(text, len, &ix);
+    if (rc == SPEEDSQL_OK && !od_well_formed(&ix)) rc = SPEEDSQL_MISMATCH;
+
+    json_buf_t scratch = {};
+    uint32_t at = 0;
+    const char* p = path + 1;
+    json_step_t step;
+    while (rc == SPEEDSQL_OK) {
+        int step_rc = path_next(&p, &step);
+        if (step_rc == SPEEDSQL_DONE) break;
+        if (step_rc != SPEEDSQL_ROW) {
+            rc = SPEEDSQL_NOTFOUND;
+        } else if (od_char(&ix, at) != (step.is_index ? '[' : '{')) {
+            rc = SPEEDSQL_NOTFOUND;
+        } else if (step.is_index) {
+            rc = od_element(&ix, &at, step.index);
+        } else {
+            rc = od_member(&ix, &at, &step, &scratch);
+        }
+    }
+
+    if (rc == SPEEDSQL_OK) rc = json_encode_range(&ix, at, od_skip(&ix, at), out, out_len);
+    sdb_free(scratch.data);
+    sdb_free(ix.pos);
+    return rc;
+}
+
+/* ============================================================================
+ * Navigation
+ *
+ * Every read is checked against the bytes the value may use, so a
+ * damaged document fails a lookup instead of reading past its end.
+ * ============================================================================ */
+
+bool jsonb_root(const uint8_t* doc, uint32_t len, jsonb_t* out) {
+    if (!doc || len < 2 || doc[0] != JSONB_VERSION) return false;
+    out->p = doc + 1;
+    out->end = doc + len;
+    return true;
+}
+
+int jsonb_type(const jsonb_t* v) {
+    if (!v || v->p >= v->end) return -1;
+    uint8_t tag = v->p[0];
+    size_t room = (size_t)(v->end - v->p);
+    switch (tag) {
+        case JSONB_NULL:
+        case JSONB_FALSE:
+        case JSONB_TRUE:
+            return tag;
+        case JSONB_INT:
+        case JSONB_FLOAT:
+            return room >= 1 + 8 ? tag : -1;
+        case JSONB_STRING:
+            return room >= 5 && read_u32(v->p + 1) <= room - 5 ? tag : -1;
+        case JSONB_ARRAY:
+        case JSONB_OBJECT:
+            return room >= JSONB_HEADER && read_u32(v->p + 5) <= room - JSONB_HEADER ? tag : -1;
+        default:
+            return -1;
+    }
+}
+
+/* Bytes the container's children may use; 0 counts when damaged */
+static uint32_t container(const jsonb_t* v, uint8_t tag, const uint8_t** end) {
+    if (jsonb_type(v) != tag) return 0;
+    uint32_t count = read_u32(v->p + 1);
+    uint32_t size = read_u32(v->p + 5);
+    size_t table = (size_t)count * sizeof(uint32_t) * (tag == JSONB_OBJECT ? 2 : 1);
+    if (table > size) return 0;
+    *end = v->p + JSONB_HEADER + size;
+    return count;
+}
+
+uint32_t jsonb_count(const jsonb_t* v) {
+    const uint8_t* end;
+    if (jsonb_type(v) == JSONB_ARRAY) return container(v, JSONB_ARRAY, &end);
+    return container(v, JSONB_OBJECT, &end);
+}
+
+/* The value at an offset from the container, or false past its end */
+static bool child_at(const jsonb_t* v, const uint8_t* end, uint32_t off, jsonb_t* out) {
+    if (off < JSONB_HEADER || off >= (size_t)(end - v->p)) return false;
+    out->p = v->p + off;
+    out->end = end;
+    return true;
+}
+
+bool jsonb_array_get(const jsonb_t* v, uint32_t i, jsonb_t* out) {
+    const uint8_t* end;
+    uint32_t count = container(v, JSONB_ARRAY, &end);
+    if (i >= count) return false;
+    return child_at(v, end, read_u32(v->p + JSONB_HEADER + i * sizeof(uint32_t)), out);
+}
+
+bool jsonb_object_entry(const jsonb_t* v, uint32_t i, const char** key, uint32_t* key_len,
+                        jsonb_t* value) {
+    const uint8_t* end;
+    uint32_t count = container(v, JSONB_OBJECT, &end);
+    if (i >= count) return false;
+
+    const uint8_t* table = v->p + JSONB_HEADER;
+    jsonb_t k;
+    if (!child_at(v, end, read_u32(table + i * sizeof(uint32_t)), &k) || end - k.p < 4) {
+        return false;
+    }
+    uint32_t len = read_u32(k.p);
+    if (len > (size_t)(end - k.p) - 4) return false;
+    *key = (const char*)k.p + 4;
+    *key_len = len;
+    return child_at(v, end, read_u32(table + (count + i) * sizeof(uint32_t)), value);
+}
+
+bool jsonb_object_get(const jsonb_t* v, const char* key, uint32_t len, jsonb_t* out) {
+    uint32_t lo = 0, hi = jsonb_type(v) == JSONB_OBJECT ? jsonb_count(v) : 0;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const char* k;
+        uint32_t klen;
+        jsonb_t value;
+        if (!jsonb_object_entry(v, mid, &k, &klen, &value)) return false;
+
+        int cmp = memcmp(key, k, len < klen ? len : klen);
+        if (cmp == 0) cmp = len < klen ? -1 : (len > klen ? 1 : 0);
+        if (cmp == 0) {
+            *out = value;
+            return true;
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return false;
+}
+
+int64_t jsonb_int(const jsonb_t* v) {
+    int64_t i = 0;
+    if (jsonb_type(v) == JSONB_INT) memcpy(&i, v->p + 1, sizeof(i));
+    return i;
+}
+
+double jsonb_float(const jsonb_t* v) {
+    double f = 0;
+    if (jsonb_type(v) == JSONB_FLOAT) memcpy(&f, v->p + 1, sizeof(f));
+    return f;
+}
+
+const char* jsonb_string(const jsonb_t* v, uint32_t* len) {
+    if (jsonb_type(v) != JSONB_STRING) {
+        *len = 0;
+        return nullptr;
+    }
+    *len = read_u32(v->p + 1);
+    return (const char*)v->p + 5;
+}
+
+int jsonb_path(const jsonb_t* root, const char* path, jsonb_t* out) {
+    if (!root || !path || !out) return SPEEDSQL_MISUSE;
+    if (!path_valid(path)) return SPEEDSQL_ERROR;
+
+    jsonb_t at = *root;
+    const char* p = path + 1;
+    json_step_t step;
+    int rc;
+    while ((rc = path_next(&p, &step)) == SPEEDSQL_ROW) {
+        bool found = step.is_index ? jsonb_array_get(&at, step.index, &at)
+                                   : jsonb_object_get(&at, step.key, step.key_len, &at);
+        if (!found) return SPEEDSQL_NOTFOUND;
+    }
+    if (rc != SPEEDSQL_DONE) return SPEEDSQL_NOTFOUND;
+    *out = at;
+    return SPEEDSQL_OK;
+}
+
+/* Bytes a (checked) value spans */
+static size_t value_span(const jsonb_t* v) {
+    switch (v->p[0]) {
+        case JSONB_INT:
+        case JSONB_FLOAT:  return 1 + 8;
+        case JSONB_STRING: return 5 + (size_t)read_u32(v->p + 1);
+        case JSONB_ARRAY:
+        case JSONB_OBJECT: return JSONB_HEADER + (size_t)read_u32(v->p + 5);
+        default:           return 1;
+    }
+}
+
+int jsonb_to_value(const jsonb_t* v, value_t* out) {
+    int type = jsonb_type(v);
+    switch (type) {
+        case JSONB_NULL:
+            value_init_null(out);
+            return SPEEDSQL_OK;
+        case JSONB_FALSE:
+        case JSONB_TRUE:
+            value_init_int(out, type == JSONB_TRUE);
+            return SPEEDSQL_OK;
+        case JSONB_INT:
+            value_init_int(out, jsonb_int(v));
+            return SPEEDSQL_OK;
+        case JSONB_FLOAT:
+            value_init_float(out, jsonb_float(v));
+            return SPEEDSQL_OK;
+        case JSONB_STRING: {
+            uint32_t len;
+            const char* s = jsonb_string(v, &len);
+            value_init_text(out, s, (int)len);
+            return SPEEDSQL_OK;
+        }
+        case JSONB_ARRAY:
+        case JSONB_OBJECT: {
+            /* Offsets are relative to the container, so its bytes stand
+             * alone as a document behind a version byte */
+            size_t span = value_span(v);
+            memset(out, 0, sizeof(*out));
+            out->type = SPEEDSQL_TYPE_JSON;
+            out->data.text.data = (char*)sdb_malloc(span + 2);
+            if (!out->data.text.data) return SPEEDSQL_NOMEM;
+            out->data.text.data[0] = JSONB_VERSION;
+            memcpy(out->data.text.data + 1, v->p, span);
+            out->data.text.data[span + 1] = '\0';
+            out->data.text.len = (uint32_t)(span + 1);
+            out->size = (uint32_t)(span + 1);
+            return SPEEDSQL_OK;
+        }
+        default:
+            value_init_null(out);
+            return SPEEDSQL_CORRUPT;
+    }
+}
+
+/* ============================================================================
+ * Rendering
+ * ============================================================================ */
+
+static void render_string(json_buf_t* out, const char* s, uint32_t len) {
+    static const char hex[] = "0123456789abcdef";
+    jbuf_byte(out, '"');
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        jbuf_put(out, s + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"':  jbuf_put(out, "\\\"", 2); break;
+            case '\\': jbuf_put(out, "\\\\", 2); break;
+            case '\n': jbuf_put(out, "\\n", 2); break;
+            case '\r': jbuf_put(out, "\\r", 2); break;
+            case '\t': jbuf_put(out, "\\t", 2); break;
+            case '\b': jbuf_put(out, "\\b", 2); break;
+            case '\f': jbuf_put(out, "\\f", 2); break;
+            default: {
+                char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                jbuf_put(out, esc, sizeof(esc));
+                break;
+            }
+        }
+    }
+    jbuf_put(out, s + run, len - run);
+    jbuf_byte(out, '"');
+}
+
+/* Shortest of %.15g and %.17g that reads back the same, kept a float */
+static void render_float(json_buf_t* out, double f) {
+    char tmp[40];
+    if (isinf(f)) {
+        jbuf_put(out, f < 0 ? "-9e999" : "9e999", f < 0 ? 6 : 5);
+        return;
+    }
+    if (isnan(f)) {
+        jbuf_put(out, "null", 4);
+        return;
+    }
+    int n = snprintf(tmp, sizeof(tmp), "%.15g", f);
+    if (strtod(tmp, nullptr) != f) n = snprintf(tmp, sizeof(tmp), "%.17g", f);
+    jbuf_put(out, tmp, (size_t)n);
+    if (!strpbrk(tmp, ".eE")) jbuf_put(out, ".0", 2);
+}
+
+static bool render_value(json_buf_t* out, const jsonb_t* v, int depth) {
+    if (depth > JSON_MAX_DEPTH) return false;
+    char tmp[32];
+
+    switch (jsonb_type(v)) {
+        case JSONB_NULL:
+            jbuf_put(out, "null", 4);
+            return true;
+        case JSONB_FALSE:
+            jbuf_put(out, "false", 5);
+            return true;
+        case JSONB_TRUE:
+            jbuf_put(out, "true", 4);
+            return true;
+        case JSONB_INT: {
+            int n = snprintf(tmp, sizeof(tmp), "%lld", (long long)jsonb_int(v));
+            jbuf_put(out, tmp, (size_t)n);
+            return true;
+        }
+        case JSONB_FLOAT:
+            render_float(out, jsonb_float(v));
+            return true;
+        case JSONB_STRING: {
+            uint32_t len;
+            const char* s = jsonb_string(v, &len);
+            render_string(out, s, len);
+            return true;
+        }
+        case JSONB_ARRAY: {
+            uint32_t count = jsonb_count(v);
+            jbuf_byte(out, '[');
+            for (uint32_t i = 0; i < count; i++) {
+                jsonb_t item;
+                if (i > 0) jbuf_byte(out, ',');
+                if (!jsonb_array_get(v, i, &item) || !render_value(out, &item, depth + 1)) {
+                    return false;
+                }
+            }
+            jbuf_byte(out, ']');
+            return true;
+        }
+        case JSONB_OBJECT: {
+            uint32_t count = jsonb_count(v);
+            jbuf_byte(out, '{');
+            for (uint32_t i = 0; i < count; i++) {
+                const char* key;
+                uint32_t len;
+                jsonb_t value;
+                if (i > 0) jbuf_byte(out, ',');
+                if (!jsonb_object_entry(v, i, &key, &len, &value)) return false;
+                render_string(out, key, len);
+                jbuf_byte(out, ':');
+                if (!render_value(out, &value, depth + 1)) return false;
+            }
+            jbuf_byte(out, '}');
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+int jsonb_to_text(const jsonb_t* v, char** out, size_t* out_len) {
+    if (!v || !out) return SPEEDSQL_MISUSE;
+    *out = nullptr;
+
+    json_buf_t text = {};
+    bool ok = render_value(&text, v, 0);
+    jbuf_byte(&text, '\0');
+    if (!ok || text.failed) {
+        sdb_free(text.data);
+        return ok ? SPEEDSQL_NOMEM : SPEEDSQL_CORRUPT;
+    }
+    *out = (char*)text.data;
+    if (out_len) *out_len = text.len - 1;
+    return SPEEDSQL_OK;
+}
@@ -0,0 +1,411 @@
+/*
+ * SpeedSQL - Vector Quantization
+ *
+ * Compact encodings of float vectors for the vector indexes:
+ *
+ *   SQ8  one byte per dimension plus a per-vector offset and step (4x)
+ *   PQ   one byte per subspace, naming a k-means centroid (up to 32x
+ *        and beyond, set by the subspace count)
+ *
+ * Both are searched asymmetrically: the query stays in floats and is
+ * compared with the codes directly, so nothing is decoded on the search
+ * path. SQ8 expands bytes to floats in registers; PQ precomputes a table
+ * of query-to-centroid distances once per query and sums m lookups per
+ * vector, with gathers on AVX2 and AVX-512. The distances are estimates;
+ * callers that need exact order re-rank the best candidates against the
+ * full vectors.
+ *
+ * The k-means here also trains the coarse centroids of IVF indexes.
+ */
+
+#include "speedsql_internal.h"
+#include <math.h>
+
+#if SPEEDSQL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define QUANT_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#define QUANT_AVX2_FEATURES (CPU_FEATURE_AVX2 | CPU_FEATURE_FMA)
+
+/* k-means passes when training PQ codebooks */
+#define PQ_TRAIN_ITERATIONS 10
+
+/* ============================================================================
+ * SQ8: Encoding
+ * ============================================================================ */
+
+void vector_sq8_encode(const float* v, uint32_t n, uint8_t* code) {
+    float lo = n > 0 ? v[0] : 0, hi = lo;
+    for (uint32_t i = 1; i < n; i++) {
+        if (v[i] < lo) lo = v[i];
+        if (v[i] > hi) hi = v[i];
+    }
+
+    float step = (hi - lo) / 255.0f;
+    memcpy(code, &lo, sizeof(float));
+    memcpy(code + 4, &step, sizeof(float));
+
+    uint8_t* q = code + VECTOR_SQ8_HEADER;
+    float inv = step > 0 ? 1.0f / step : 0;
+    for (uint32_t i = 0; i < n; i++) {
+        float x = (v[i] - lo) * inv + 0.5f;
+        q[i] = x <= 0 ? 0 : (x >= 255.0f ? 255 : (uint8_t)x);
+    }
+}
+
+void vector_sq8_decode(const uint8_t* code, uint32_t n, float* out) {
+    float lo, step;
+    memcpy(&lo, code, sizeof(float));
+    memcpy(&step, code + 4, sizeof(float));
+
+    const uint8_t* q = code + VECTOR_SQ8_HEADER;
+    for (uint32_t i = 0; i < n; i++) out[i] = lo + step * q[i];
+}
+
+/* ============================================================================
+ * SQ8: Asymmetric Distance
+ * ============================================================================ */
+
+static float sq8_portable(const float* q, const uint8_t* c, uint32_t n, float lo, float step,
+                          uint32_t from) {
+    float s = 0;
+    for (uint32_t i = from; i < n; i++) {
+        float d = q[i] - (lo + step * c[i]);
+        s += d * d;
+    }
+    return s;
+}
+
+#if SPEEDSQL_X86
+
+SPEEDSQL_TARGET("avx2,fma")
+static float sq8_avx2(const float* q, const uint8_t* c, uint32_t n, float lo, float step) {
+    __m256 vlo = _mm256_set1_ps(lo), vstep = _mm256_set1_ps(step);
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(c + i));
+        __m256 x0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+        __m256 x1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(q + i), _mm256_fmadd_ps(x0, vstep, vlo));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(q + i + 8), _mm256_fmadd_ps(x1, vstep, vlo));
+        s0 = _mm256_fmadd_ps(d0, d0, s0);
+        s1 = _mm256_fmadd_ps(d1, d1, s1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(c + i))));
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(q + i), _mm256_fmadd_ps(x, vstep, vlo));
+        s0 = _mm256_fmadd_ps(d, d, s0);
+    }
+
+    __m256 v = _mm256_add_ps(s0, s1);
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_add_ss(h, _mm_movehdup_ps(h));
+    return _mm_cvtss_f32(h) + sq8_portable(q, c, n, lo, step, i);
+}
+
+/* Through memory: GCC 12's 512-to-256 bit extracts trip -Wuninitialized */
+SPEEDSQL_TARGET("avx512f")
+static inline float hsum_avx512(__m512 v) {
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, v);
+    __m256 w = _mm256_add_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8));
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(w), _mm256_extractf128_ps(w, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_add_ss(h, _mm_movehdup_ps(h));
+    return _mm_cvtss_f32(h);
+}
+
+/* 16 code bytes to floats; the zero-masked forms, as the plain ones
+ * trip GCC 12's -Wuninitialized */
+SPEEDSQL_TARGET("avx512f")
+static inline __m512 sq8_widen_avx512(__m128i bytes) {
+    return _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu8_epi32(0xFFFF, bytes));
+}
+
+SPEEDSQL_TARGET("avx512f")
+static float sq8_avx512(const float* q, const uint8_t* c, uint32_t n, float lo, float step) {
+    __m512 vlo = _mm512_set1_ps(lo), vstep = _mm512_set1_ps(step);
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 x0 = sq8_widen_avx512(_mm_loadu_si128((const __m128i*)(c + i)));
+        __m512 x1 = sq8_widen_avx512(_mm_loadu_si128((const __m128i*)(c + i + 16)));
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(q + i), _mm512_fmadd_ps(x0, vstep, vlo));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(q + i + 16), _mm512_fmadd_ps(x1, vstep, vlo));
+        s0 = _mm512_fmadd_ps(d0, d0, s0);
+        s1 = _mm512_fmadd_ps(d1, d1, s1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 x = sq8_widen_avx512(_mm_loadu_si128((const __m128i*)(c + i)));
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(q + i), _mm512_fmadd_ps(x, vstep, vlo));
+        s0 = _mm512_fmadd_ps(d, d, s0);
+    }
+
+    return hsum_avx512(_mm512_add_ps(s0, s1)) + sq8_portable(q, c, n, lo, step, i);
+}
+
+#endif /* SPEEDSQL_X86 */
+
+#ifdef QUANT_NEON
+
+static float sq8_neon(const float* q, const uint8_t* c, uint32_t n, float lo, float step) {
+    float32x4_t vlo = vdupq_n_f32(lo), s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t c16 = vmovl_u8(vld1_u8(c + i));
+        float32x4_t x0 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(c16)));
+        float32x4_t x1 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(c16)));
+        float32x4_t d0 = vsubq_f32(vld1q_f32(q + i), vmlaq_n_f32(vlo, x0, step));
+        float32x4_t d1 = vsubq_f32(vld1q_f32(q + i + 4), vmlaq_n_f32(vlo, x1, step));
+        s0 = vmlaq_f32(s0, d0, d0);
+        s1 = vmlaq_f32(s1, d1, d1);
+    }
+    float32x4_t v = vaddq_f32(s0, s1);
+#if defined(__aarch64__)
+    float s = vaddvq_f32(v);
+#else
+    float32x2_t p = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    float s = vget_lane_f32(vpadd_f32(p, p), 0);
+#endif
+    return s + sq8_portable(q, c, n, lo, step, i);
+}
+
+#endif /* QUANT_NEON */
+
+float vector_sq8_l2_sq(const float* q, const uint8_t* code, uint32_t n) {
+    float lo, step;
+    memcpy(&lo, code, sizeof(float));
+    memcpy(&step, code + 4, sizeof(float));
+    const uint8_t* c = code + VECTOR_SQ8_HEADER;
+
+    uint32_t features = cpu_features();
+#if SPEEDSQL_X86
+    if (features & CPU_FEATURE_AVX512F) return sq8_avx512(q, c, n, lo, step);
+    if ((features & QUANT_AVX2_FEATURES) == QUANT_AVX2_FEATURES) return sq8_avx2(q, c, n, lo, step);
+#elif defined(QUANT_NEON)
+    if (features & CPU_FEATURE_NEON) return sq8_neon(q, c, n, lo, step);
+#endif
+    (void)features;
+    return sq8_portable(q, c, n, lo, step, 0);
+}
+
+/* ============================================================================
+ * k-means
+ * ============================================================================ */
+
+/* Nearest of k centroids stored back to back; dist is scratch for k floats */
+static uint32_t kmeans_nearest(const float* centroids, uint32_t k, const float* x, uint32_t n,
+                               float* dist) {
+    vector_distances(VECTOR_L2, x, centroids, n, k, dist);
+    uint32_t best = 0;
+    for (uint32_t c = 1; c < k; c++) {
+        if (dist[c] < dist[best]) best = c;
+    }
+    return best;
+}
+
+uint32_t vector_kmeans(const float* samples, size_t count, size_t stride, uint32_t n,
+                       uint32_t k, uint32_t iterations, float* centroids) {
+    if (!samples || !centroids || count == 0 || n == 0 || k == 0) return 0;
+    if (k > count) k = (uint32_t)count;
+
+    uint32_t* assign = (uint32_t*)sdb_calloc(count, sizeof(uint32_t));
+    double* sums = (double*)sdb_malloc((size_t)k * n * sizeof(double));
+    uint32_t* members = (uint32_t*)sdb_malloc(k * sizeof(uint32_t));
+    float* dist = (float*)sdb_malloc(k * sizeof(float));
+    if (!assign || !sums || !members || !dist) {
+        k = 0;
+        iterations = 0;
+    }
+
+    /* Seed with samples spread over the set */
+    for (uint32_t c = 0; c < k; c++) {
+        memcpy(centroids + (size_t)c * n, samples + ((size_t)c * count / k) * stride,
+               n * sizeof(float));
+    }
+
+    for (uint32_t iter = 0; iter < iterations; iter++) {
+        bool moved = iter == 0;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t c = kmeans_nearest(centroids, k, samples + i * stride, n, dist);
+            if (c != assign[i]) moved = true;
+            assign[i] = c;
+        }
+        if (!moved) break;
+
+        memset(sums, 0, (size_t)k * n * sizeof(double));
+        memset(members, 0, k * sizeof(uint32_t));
+        for (size_t i = 0; i < count; i++) {
+            const float* x = samples + i * stride;
+            double* sum = sums + (size_t)assign[i] * n;
+            for (uint32_t d = 0; d < n; d++) sum[d] += x[d];
+            members[assign[i]]++;
+        }
+
+        /* An empty cluster keeps its old centroid */
+        for (uint32_t c = 0; c < k; c++) {
+            if (members[c] == 0) continue;
+            float* centroid = centroids + (size_t)c * n;
+            for (uint32_t d = 0; d < n; d++) {
+                centroid[d] = (float)(sums[(size_t)c * n + d] / members[c]);
+            }
+        }
+    }
+
+    sdb_free(assign);
+    sdb_free(sums);
+    sdb_free(members);
+    sdb_free(dist);
+    return k;
+}
+
+/* ============================================================================
+ * PQ: Training and Encoding
+ * ============================================================================ */
+
+static inline const float* pq_centroid(const vector_pq_t* pq, uint32_t sub, uint32_t c) {
+    uint32_t width = pq->dimensions / pq->m;
+    return pq->codebook + ((size_t)sub * VECTOR_PQ_CENTROIDS + c) * width;
+}
+
+/* Nearest trained centroid of one subspace to x */
+static uint32_t pq_nearest(const vector_pq_t* pq, uint32_t sub, const float* x) {
+    uint32_t width = pq->dimensions / pq->m;
+    uint32_t best = 0;
+    float best_dist = 0;
+    for (uint32_t c = 0; c < pq->centroids; c++) {
+        float d = vector_l2_sq(x, pq_centroid(pq, sub, c), width);
+        if (c == 0 || d < best_dist) {
+            best = c;
+            best_dist = d;
+        }
+    }
+    return best;
+}
+
+int vector_pq_train(vector_pq_t* pq, const float* samples, size_t count, uint32_t n, uint32_t m) {
+    if (!pq || !samples || count == 0 || n == 0 || m == 0 || n % m != 0) {
+        return SPEEDSQL_MISUSE;
+    }
+
+    uint32_t width = n / m;
+    pq->dimensions = n;
+    pq->m = m;
+    pq->codebook = (float*)sdb_calloc((size_t)m * VECTOR_PQ_CENTROIDS * width, sizeof(float));
+    if (!pq->codebook) return SPEEDSQL_NOMEM;
+
+    for (uint32_t sub = 0; sub < m; sub++) {
+        pq->centroids = vector_kmeans(samples + sub * width, count, n, width, VECTOR_PQ_CENTROIDS,
+                                      PQ_TRAIN_ITERATIONS, (float*)pq_centroid(pq, sub, 0));
+        if (pq->centroids == 0) {
+            vector_pq_free(pq);
+            return SPEEDSQL_NOMEM;
+        }
+    }
+    return SPEEDSQL_OK;
+}
+
+void vector_pq_free(vector_pq_t* pq) {
+    if (!pq) return;
+    sdb_free(pq->codebook);
+    memset(pq, 0, sizeof(*pq));
+}
+
+void vector_pq_encode(const vector_pq_t* pq, const float* v, uint8_t* code) {
+    uint32_t width = pq->dimensions / pq->m;
+    for (uint32_t sub = 0; sub < pq->m; sub++) {
+        code[sub] = (uint8_t)pq_nearest(pq, sub, v + sub * width);
+    }
+}
+
+void vector_pq_decode(const vector_pq_t* pq, const uint8_t* code, float* out) {
+    uint32_t width = pq->dimensions / pq->m;
+    for (uint32_t sub = 0; sub < pq->m; sub++) {
+        memcpy(out + sub * width, pq_centroid(pq, sub, code[sub]), width * sizeof(float));
+    }
+}
+
+/* ============================================================================
+ * PQ: Asymmetric Distance
+ * ============================================================================ */
+
+void vector_pq_table(const vector_pq_t* pq, const float* q, float* table) {
+    uint32_t width = pq->dimensions / pq->m;
+    for (uint32_t sub = 0; sub < pq->m; sub++) {
+        float* row = table + (size_t)sub * VECTOR_PQ_CENTROIDS;
+        for (uint32_t c = 0; c < pq->centroids; c++) {
+            row[c] = vector_l2_sq(q + sub * width, pq_centroid(pq, sub, c), width);
+        }
+        for (uint32_t c = pq->centroids; c < VECTOR_PQ_CENTROIDS; c++) row[c] = 0;
+    }
+}
+
+static float pq_portable(const float* table, const uint8_t* code, uint32_t m, uint32_t from) {
+    float s = 0;
+    for (uint32_t sub = from; sub < m; sub++) {
+        s += table[(size_t)sub * VECTOR_PQ_CENTROIDS + code[sub]];
+    }
+    return s;
+}
+
+#if SPEEDSQL_X86
+
+/* Eight subspaces per gather: lane j reads table[(sub + j) * 256 + code] */
+SPEEDSQL_TARGET("avx2,fma")
+static float pq_avx2(const float* table, const uint8_t* code, uint32_t m) {
+    const __m256i rows = _mm256_setr_epi32(0, 256, 512, 768, 1024, 1280, 1536, 1792);
+    __m256 s = _mm256_setzero_ps();
+    uint32_t sub = 0;
+    for (; sub + 8 <= m; sub += 8) {
+        __m256i idx = _mm256_add_epi32(
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(code + sub))), rows);
+        s = _mm256_add_ps(s, _mm256_i32gather_ps(table + (size_t)sub * VECTOR_PQ_CENTROIDS, idx, 4));
+    }
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_add_ss(h, _mm_movehdup_ps(h));
+    return _mm_cvtss_f32(h) + pq_portable(table, code, m, sub);
+}
+
+SPEEDSQL_TARGET("avx512f")
+static float pq_avx512(const float* table, const uint8_t* code, uint32_t m) {
+    const __m512i rows = _mm512_mullo_epi32(
+        _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+        _mm512_set1_epi32(VECTOR_PQ_CENTROIDS));
+    __m512 s = _mm512_setzero_ps();
+    uint32_t sub = 0;
+    for (; sub + 16 <= m; sub += 16) {
+        __m512i idx = _mm512_add_epi32(
+            _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128((const __m128i*)(code + sub))), rows);
+        s = _mm512_add_ps(s, _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xFFFF, idx,
+                                                     table + (size_t)sub * VECTOR_PQ_CENTROIDS, 4));
+    }
+    return hsum_avx512(s) + pq_portable(table, code, m, sub);
+}
+
+#endif /* SPEEDSQL_X86 */
+
+float vector_pq_l2_sq(const float* table, const uint8_t* code, uint32_t m) {
+#if SPEEDSQL_X86
+    uint32_t features = cpu_features();
+    if (m >= 16 && (features & CPU_FEATURE_AVX512F)) return pq_avx512(table, code, m);
+    if (m >= 8 && (features & QUANT_AVX2_FEATURES) == QUANT_AVX2_FEATURES) {
+        return pq_avx2(table, code, m);
+    }
+#endif
+    return pq_portable(table, code, m, 0);
+}
+
+void vector_pq_scan(const float* table, const uint8_t* codes, uint32_t m,
+                    size_t count, float* out) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = vector_pq_l2_sq(table, codes + i * m, m);
+    }
+}
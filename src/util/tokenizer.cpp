@@ -0,0 +1,149 @@
+/*
+ * SpeedSQL - Full-Text Tokenizers
+ *
+ * Registry of the tokenizers full-text indexes split text with, and the
+ * built-in "simple" tokenizer
+ */
+
+#include "speedsql_internal.h"
+
+/* Maximum number of registered tokenizers */
+#define MAX_TOKENIZERS 16
+
+/* Longest token "simple" emits; longer runs are cut */
+#define SIMPLE_MAX_TOKEN 64
+
+/* ============================================================================
+ * Built-in "simple" Tokenizer
+ * ============================================================================ */
+
+/* ASCII letters and digits, lowercased, and any byte of a UTF-8 sequence */
+static inline bool simple_token_byte(uint8_t c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           c >= 0x80;
+}
+
+static int simple_tokenize(speedsql_tokenizer* tok, const char* text, int len,
+                           speedsql_token_fn emit, void* ctx) {
+    (void)tok;
+    char token[SIMPLE_MAX_TOKEN];
+    int position = 0;
+    int i = 0;
+
+    while (i < len) {
+        while (i < len && !simple_token_byte((uint8_t)text[i])) i++;
+
+        int n = 0;
+        while (i < len && simple_token_byte((uint8_t)text[i])) {
+            char c = text[i++];
+            if (n < SIMPLE_MAX_TOKEN) token[n++] = (c >= 'A' && c <= 'Z') ? (char)(c + 32) : c;
+        }
+        if (n > 0) {
+            int rc = emit(ctx, token, n, position++);
+            if (rc != SPEEDSQL_OK) return rc;
+        }
+    }
+    return SPEEDSQL_OK;
+}
+
+static speedsql_tokenizer g_tokenizer_simple = {
+    "simple",
+    nullptr,
+    simple_tokenize
+};
+
+/* ============================================================================
+ * Registry
+ * ============================================================================ */
+
+static struct {
+    speedsql_tokenizer* tokenizers[MAX_TOKENIZERS];
+    int count;
+    int builtin_count;
+    mutex_t lock;
+} g_tokenizer_registry = {};
+
+static once_t g_tokenizer_registry_once = ONCE_INIT;
+
+static void tokenizer_registry_setup(void) {
+    mutex_init(&g_tokenizer_registry.lock);
+    g_tokenizer_registry.count = 0;
+    g_tokenizer_registry.tokenizers[g_tokenizer_registry.count++] = &g_tokenizer_simple;
+    g_tokenizer_registry.builtin_count = g_tokenizer_registry.count;
+}
+
+static void tokenizer_registry_init(void) {
+    once_run(&g_tokenizer_registry_once, tokenizer_registry_setup);
+}
+
+SPEEDSQL_API int speedsql_tokenizer_register(speedsql_tokenizer* tok) {
+    if (!tok || !tok->name || !tok->tokenize) return SPEEDSQL_MISUSE;
+
+    tokenizer_registry_init();
+    mutex_lock(&g_tokenizer_registry.lock);
+
+    for (int i = 0; i < g_tokenizer_registry.count; i++) {
+        if (g_tokenizer_registry.tokenizers[i] == tok) {
+            mutex_unlock(&g_tokenizer_registry.lock);
+            return SPEEDSQL_OK;
+        }
+        if (strcmp(g_tokenizer_registry.tokenizers[i]->name, tok->name) == 0) {
+            mutex_unlock(&g_tokenizer_registry.lock);
+            return SPEEDSQL_CONSTRAINT;  /* Name already taken */
+        }
+    }
+
+    if (g_tokenizer_registry.count >= MAX_TOKENIZERS) {
+        mutex_unlock(&g_tokenizer_registry.lock);
+        return SPEEDSQL_FULL;
+    }
+
+    g_tokenizer_registry.tokenizers[g_tokenizer_registry.count++] = tok;
+    mutex_unlock(&g_tokenizer_registry.lock);
+    return SPEEDSQL_OK;
+}
+
+/* Built-in tokenizers stay registered */
+SPEEDSQL_API int speedsql_tokenizer_unregister(speedsql_tokenizer* tok) {
+    if (!tok) return SPEEDSQL_MISUSE;
+
+    tokenizer_registry_init();
+    mutex_lock(&g_tokenizer_registry.lock);
+
+    for (int i = 0; i < g_tokenizer_registry.count; i++) {
+        if (g_tokenizer_registry.tokenizers[i] != tok) continue;
+
+        if (i < g_tokenizer_registry.builtin_count) {
+            mutex_unlock(&g_tokenizer_registry.lock);
+            return SPEEDSQL_MISUSE;
+        }
+        for (int j = i; j < g_tokenizer_registry.count - 1; j++) {
+            g_tokenizer_registry.tokenizers[j] = g_tokenizer_registry.tokenizers[j + 1];
+        }
+        g_tokenizer_registry.count--;
+
+        mutex_unlock(&g_tokenizer_registry.lock);
+        return SPEEDSQL_OK;
+    }
+
+    mutex_unlock(&g_tokenizer_registry.lock);
+    return SPEEDSQL_NOTFOUND;
+}
+
+SPEEDSQL_API speedsql_tokenizer* speedsql_tokenizer_find(const char* name) {
+    if (!name) return &g_tokenizer_simple;
+
+    tokenizer_registry_init();
+    mutex_lock(&g_tokenizer_registry.lock);
+
+    speedsql_tokenizer* found = nullptr;
+    for (int i = 0; i < g_tokenizer_registry.count; i++) {
+        if (strcmp(g_tokenizer_registry.tokenizers[i]->name, name) == 0) {
+            found = g_tokenizer_registry.tokenizers[i];
+            break;
+        }
+    }
+
+    mutex_unlock(&g_tokenizer_registry.lock);
+    return found;
+}
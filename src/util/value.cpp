@@ -60,6 +60,38 @@ void value_init_blob(value_t* v, const void* data, int len) {
     }
 }
 
+void value_init_vector(value_t* v, const float* data, uint32_t dimensions) {
+    if (!v) return;
+    memset(v, 0, sizeof(*v));
+    v->type = SPEEDSQL_TYPE_VECTOR;
+
+    if (data && dimensions > 0) {
+        size_t size = dimensions * sizeof(float);
+        v->data.vec.data = (float*)sdb_malloc(size);
+        if (v->data.vec.data) {
+            memcpy(v->data.vec.data, data, size);
+            v->data.vec.dimensions = dimensions;
+            v->size = (uint32_t)size;
+        }
+    }
+}
+
+void value_init_json(value_t* v, const void* data, int len) {
+    if (!v) return;
+    memset(v, 0, sizeof(*v));
+    v->type = SPEEDSQL_TYPE_JSON;
+
+    if (data && len > 0) {
+        v->data.text.data = (char*)sdb_malloc(len + 1);
+        if (v->data.text.data) {
+            memcpy(v->data.text.data, data, len);
+            v->data.text.data[len] = '\0';
+            v->data.text.len = len;
+            v->size = len;
+        }
+    }
+}
+
 void value_copy(value_t* dst, const value_t* src) {
     if (!dst || !src) return;
 
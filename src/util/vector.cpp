@@ -0,0 +1,511 @@
+/*
+ * SpeedSQL - Vector Distance Functions
+ *
+ * L2, inner product and cosine over float vectors, shared by the SQL
+ * vector functions and the vector indexes. Each has a portable version
+ * and AVX2/FMA, AVX-512 and NEON kernels picked at runtime. Distance
+ * work streams both vectors once, so the kernels keep several
+ * independent accumulators in flight and leave the horizontal sum to the
+ * end; the one-to-many variant scores four rows per pass over the query.
+ */
+
+#include "speedsql_internal.h"
+#include <math.h>
+
+#if SPEEDSQL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define VECTOR_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#define VECTOR_AVX2_FEATURES (CPU_FEATURE_AVX2 | CPU_FEATURE_FMA)
+
+/* Sums for cosine: a.b, |a|^2, |b|^2 */
+typedef struct {
+    float dot;
+    float aa;
+    float bb;
+} vector_cos_t;
+
+/* ============================================================================
+ * Portable
+ * ============================================================================ */
+
+static float l2_portable(const float* a, const float* b, uint32_t n) {
+    /* Four accumulators break the add dependency chain */
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float d0 = a[i] - b[i], d1 = a[i + 1] - b[i + 1];
+        float d2 = a[i + 2] - b[i + 2], d3 = a[i + 3] - b[i + 3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    for (; i < n; i++) {
+        float d = a[i] - b[i];
+        s0 += d * d;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+static float dot_portable(const float* a, const float* b, uint32_t n) {
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; i++) s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+static vector_cos_t cos_portable(const float* a, const float* b, uint32_t n) {
+    vector_cos_t r = {0, 0, 0};
+    for (uint32_t i = 0; i < n; i++) {
+        r.dot += a[i] * b[i];
+        r.aa += a[i] * a[i];
+        r.bb += b[i] * b[i];
+    }
+    return r;
+}
+
+/* ============================================================================
+ * AVX2 + FMA: 8 floats per register, two accumulators
+ * ============================================================================ */
+
+#if SPEEDSQL_X86
+
+SPEEDSQL_TARGET("avx2,fma")
+static inline float hsum_avx2(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+SPEEDSQL_TARGET("avx2,fma")
+static float l2_avx2(const float* a, const float* b, uint32_t n) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        s0 = _mm256_fmadd_ps(d0, d0, s0);
+        s1 = _mm256_fmadd_ps(d1, d1, s1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        s0 = _mm256_fmadd_ps(d, d, s0);
+    }
+    float s = hsum_avx2(_mm256_add_ps(s0, s1));
+    for (; i < n; i++) {
+        float d = a[i] - b[i];
+        s += d * d;
+    }
+    return s;
+}
+
+SPEEDSQL_TARGET("avx2,fma")
+static float dot_avx2(const float* a, const float* b, uint32_t n) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+    }
+    float s = hsum_avx2(_mm256_add_ps(s0, s1));
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+SPEEDSQL_TARGET("avx2,fma")
+static vector_cos_t cos_avx2(const float* a, const float* b, uint32_t n) {
+    __m256 ab = _mm256_setzero_ps(), aa = _mm256_setzero_ps(), bb = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 va = _mm256_loadu_ps(a + i), vb = _mm256_loadu_ps(b + i);
+        ab = _mm256_fmadd_ps(va, vb, ab);
+        aa = _mm256_fmadd_ps(va, va, aa);
+        bb = _mm256_fmadd_ps(vb, vb, bb);
+    }
+    vector_cos_t r = {hsum_avx2(ab), hsum_avx2(aa), hsum_avx2(bb)};
+    for (; i < n; i++) {
+        r.dot += a[i] * b[i];
+        r.aa += a[i] * a[i];
+        r.bb += b[i] * b[i];
+    }
+    return r;
+}
+
+/* Four rows per pass: each query register is loaded once for all four */
+SPEEDSQL_TARGET("avx2,fma")
+static void l2_x4_avx2(const float* q, const float* r, uint32_t n, float* out) {
+    const float* r0 = r;
+    const float* r1 = r + n;
+    const float* r2 = r + 2 * (size_t)n;
+    const float* r3 = r + 3 * (size_t)n;
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vq = _mm256_loadu_ps(q + i);
+        __m256 d0 = _mm256_sub_ps(vq, _mm256_loadu_ps(r0 + i));
+        __m256 d1 = _mm256_sub_ps(vq, _mm256_loadu_ps(r1 + i));
+        __m256 d2 = _mm256_sub_ps(vq, _mm256_loadu_ps(r2 + i));
+        __m256 d3 = _mm256_sub_ps(vq, _mm256_loadu_ps(r3 + i));
+        s0 = _mm256_fmadd_ps(d0, d0, s0);
+        s1 = _mm256_fmadd_ps(d1, d1, s1);
+        s2 = _mm256_fmadd_ps(d2, d2, s2);
+        s3 = _mm256_fmadd_ps(d3, d3, s3);
+    }
+    out[0] = hsum_avx2(s0);
+    out[1] = hsum_avx2(s1);
+    out[2] = hsum_avx2(s2);
+    out[3] = hsum_avx2(s3);
+    for (; i < n; i++) {
+        float d0 = q[i] - r0[i], d1 = q[i] - r1[i], d2 = q[i] - r2[i], d3 = q[i] - r3[i];
+        out[0] += d0 * d0;
+        out[1] += d1 * d1;
+        out[2] += d2 * d2;
+        out[3] += d3 * d3;
+    }
+}
+
+SPEEDSQL_TARGET("avx2,fma")
+static void dot_x4_avx2(const float* q, const float* r, uint32_t n, float* out) {
+    const float* r0 = r;
+    const float* r1 = r + n;
+    const float* r2 = r + 2 * (size_t)n;
+    const float* r3 = r + 3 * (size_t)n;
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vq = _mm256_loadu_ps(q + i);
+        s0 = _mm256_fmadd_ps(vq, _mm256_loadu_ps(r0 + i), s0);
+        s1 = _mm256_fmadd_ps(vq, _mm256_loadu_ps(r1 + i), s1);
+        s2 = _mm256_fmadd_ps(vq, _mm256_loadu_ps(r2 + i), s2);
+        s3 = _mm256_fmadd_ps(vq, _mm256_loadu_ps(r3 + i), s3);
+    }
+    out[0] = hsum_avx2(s0);
+    out[1] = hsum_avx2(s1);
+    out[2] = hsum_avx2(s2);
+    out[3] = hsum_avx2(s3);
+    for (; i < n; i++) {
+        out[0] += q[i] * r0[i];
+        out[1] += q[i] * r1[i];
+        out[2] += q[i] * r2[i];
+        out[3] += q[i] * r3[i];
+    }
+}
+
+/* ============================================================================
+ * AVX-512: 16 floats per register, masked tail
+ * ============================================================================ */
+
+/* Own reduction, through memory: GCC 12's _mm512_reduce_add_ps and the
+ * 512-to-256 bit extracts trip -Wuninitialized */
+SPEEDSQL_TARGET("avx512f")
+static inline float hsum_avx512(__m512 v) {
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, v);
+    __m256 s8 = _mm256_add_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8));
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(s8), _mm256_extractf128_ps(s8, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+SPEEDSQL_TARGET("avx512f")
+static float l2_avx512(const float* a, const float* b, uint32_t n) {
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        s0 = _mm512_fmadd_ps(d0, d0, s0);
+        s1 = _mm512_fmadd_ps(d1, d1, s1);
+    }
+    for (; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i));
+        s0 = _mm512_fmadd_ps(d, d, s0);
+    }
+    return hsum_avx512(_mm512_add_ps(s0, s1));
+}
+
+SPEEDSQL_TARGET("avx512f")
+static float dot_avx512(const float* a, const float* b, uint32_t n) {
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+        s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), s1);
+    }
+    for (; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        s0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), s0);
+    }
+    return hsum_avx512(_mm512_add_ps(s0, s1));
+}
+
+SPEEDSQL_TARGET("avx512f")
+static vector_cos_t cos_avx512(const float* a, const float* b, uint32_t n) {
+    __m512 ab = _mm512_setzero_ps(), aa = _mm512_setzero_ps(), bb = _mm512_setzero_ps();
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        __m512 va = _mm512_maskz_loadu_ps(m, a + i), vb = _mm512_maskz_loadu_ps(m, b + i);
+        ab = _mm512_fmadd_ps(va, vb, ab);
+        aa = _mm512_fmadd_ps(va, va, aa);
+        bb = _mm512_fmadd_ps(vb, vb, bb);
+    }
+    vector_cos_t r = {hsum_avx512(ab), hsum_avx512(aa), hsum_avx512(bb)};
+    return r;
+}
+
+SPEEDSQL_TARGET("avx512f")
+static void l2_x4_avx512(const float* q, const float* r, uint32_t n, float* out) {
+    const float* r0 = r;
+    const float* r1 = r + n;
+    const float* r2 = r + 2 * (size_t)n;
+    const float* r3 = r + 3 * (size_t)n;
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    __m512 s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        __m512 vq = _mm512_maskz_loadu_ps(m, q + i);
+        __m512 d0 = _mm512_sub_ps(vq, _mm512_maskz_loadu_ps(m, r0 + i));
+        __m512 d1 = _mm512_sub_ps(vq, _mm512_maskz_loadu_ps(m, r1 + i));
+        __m512 d2 = _mm512_sub_ps(vq, _mm512_maskz_loadu_ps(m, r2 + i));
+        __m512 d3 = _mm512_sub_ps(vq, _mm512_maskz_loadu_ps(m, r3 + i));
+        s0 = _mm512_fmadd_ps(d0, d0, s0);
+        s1 = _mm512_fmadd_ps(d1, d1, s1);
+        s2 = _mm512_fmadd_ps(d2, d2, s2);
+        s3 = _mm512_fmadd_ps(d3, d3, s3);
+    }
+    out[0] = hsum_avx512(s0);
+    out[1] = hsum_avx512(s1);
+    out[2] = hsum_avx512(s2);
+    out[3] = hsum_avx512(s3);
+}
+
+SPEEDSQL_TARGET("avx512f")
+static void dot_x4_avx512(const float* q, const float* r, uint32_t n, float* out) {
+    const float* r0 = r;
+    const float* r1 = r + n;
+    const float* r2 = r + 2 * (size_t)n;
+    const float* r3 = r + 3 * (size_t)n;
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    __m512 s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+    for (uint32_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - i)) - 1);
+        __m512 vq = _mm512_maskz_loadu_ps(m, q + i);
+        s0 = _mm512_fmadd_ps(vq, _mm512_maskz_loadu_ps(m, r0 + i), s0);
+        s1 = _mm512_fmadd_ps(vq, _mm512_maskz_loadu_ps(m, r1 + i), s1);
+        s2 = _mm512_fmadd_ps(vq, _mm512_maskz_loadu_ps(m, r2 + i), s2);
+        s3 = _mm512_fmadd_ps(vq, _mm512_maskz_loadu_ps(m, r3 + i), s3);
+    }
+    out[0] = hsum_avx512(s0);
+    out[1] = hsum_avx512(s1);
+    out[2] = hsum_avx512(s2);
+    out[3] = hsum_avx512(s3);
+}
+
+#endif /* SPEEDSQL_X86 */
+
+/* ============================================================================
+ * NEON: 4 floats per register, four accumulators
+ * ============================================================================ */
+
+#ifdef VECTOR_NEON
+
+static inline float hsum_neon(float32x4_t v) {
+#if defined(__aarch64__)
+    return vaddvq_f32(v);
+#else
+    float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+#endif
+}
+
+static float l2_neon(const float* a, const float* b, uint32_t n) {
+    float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+    float32x4_t s2 = vdupq_n_f32(0), s3 = vdupq_n_f32(0);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        float32x4_t d0 = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        float32x4_t d1 = vsubq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        float32x4_t d2 = vsubq_f32(vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+        float32x4_t d3 = vsubq_f32(vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+        s0 = vmlaq_f32(s0, d0, d0);
+        s1 = vmlaq_f32(s1, d1, d1);
+        s2 = vmlaq_f32(s2, d2, d2);
+        s3 = vmlaq_f32(s3, d3, d3);
+    }
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t d = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        s0 = vmlaq_f32(s0, d, d);
+    }
+    float s = hsum_neon(vaddq_f32(vaddq_f32(s0, s1), vaddq_f32(s2, s3)));
+    for (; i < n; i++) {
+        float d = a[i] - b[i];
+        s += d * d;
+    }
+    return s;
+}
+
+static float dot_neon(const float* a, const float* b, uint32_t n) {
+    float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+    float32x4_t s2 = vdupq_n_f32(0), s3 = vdupq_n_f32(0);
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+        s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        s2 = vmlaq_f32(s2, vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+        s3 = vmlaq_f32(s3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+    }
+    for (; i + 4 <= n; i += 4) {
+        s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    float s = hsum_neon(vaddq_f32(vaddq_f32(s0, s1), vaddq_f32(s2, s3)));
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+static vector_cos_t cos_neon(const float* a, const float* b, uint32_t n) {
+    float32x4_t ab = vdupq_n_f32(0), aa = vdupq_n_f32(0), bb = vdupq_n_f32(0);
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t va = vld1q_f32(a + i), vb = vld1q_f32(b + i);
+        ab = vmlaq_f32(ab, va, vb);
+        aa = vmlaq_f32(aa, va, va);
+        bb = vmlaq_f32(bb, vb, vb);
+    }
+    vector_cos_t r = {hsum_neon(ab), hsum_neon(aa), hsum_neon(bb)};
+    for (; i < n; i++) {
+        r.dot += a[i] * b[i];
+        r.aa += a[i] * a[i];
+        r.bb += b[i] * b[i];
+    }
+    return r;
+}
+
+#endif /* VECTOR_NEON */
+
+/* ============================================================================
+ * Dispatch
+ * ============================================================================ */
+
+float vector_l2_sq(const float* a, const float* b, uint32_t n) {
+    uint32_t features = cpu_features();
+#if SPEEDSQL_X86
+    if (features & CPU_FEATURE_AVX512F) return l2_avx512(a, b, n);
+    if ((features & VECTOR_AVX2_FEATURES) == VECTOR_AVX2_FEATURES) return l2_avx2(a, b, n);
+#elif defined(VECTOR_NEON)
+    if (features & CPU_FEATURE_NEON) return l2_neon(a, b, n);
+#endif
+    (void)features;
+    return l2_portable(a, b, n);
+}
+
+float vector_dot(const float* a, const float* b, uint32_t n) {
+    uint32_t features = cpu_features();
+#if SPEEDSQL_X86
+    if (features & CPU_FEATURE_AVX512F) return dot_avx512(a, b, n);
+    if ((features & VECTOR_AVX2_FEATURES) == VECTOR_AVX2_FEATURES) return dot_avx2(a, b, n);
+#elif defined(VECTOR_NEON)
+    if (features & CPU_FEATURE_NEON) return dot_neon(a, b, n);
+#endif
+    (void)features;
+    return dot_portable(a, b, n);
+}
+
+static vector_cos_t cos_sums(const float* a, const float* b, uint32_t n) {
+    uint32_t features = cpu_features();
+#if SPEEDSQL_X86
+    if (features & CPU_FEATURE_AVX512F) return cos_avx512(a, b, n);
+    if ((features & VECTOR_AVX2_FEATURES) == VECTOR_AVX2_FEATURES) return cos_avx2(a, b, n);
+#elif defined(VECTOR_NEON)
+    if (features & CPU_FEATURE_NEON) return cos_neon(a, b, n);
+#endif
+    (void)features;
+    return cos_portable(a, b, n);
+}
+
+/* A zero vector has no direction; call it orthogonal to everything */
+static float cos_distance(vector_cos_t s) {
+    if (s.aa <= 0 || s.bb <= 0) return 1.0f;
+    return 1.0f - (float)(s.dot / sqrt((double)s.aa * (double)s.bb));
+}
+
+float vector_cosine_distance(const float* a, const float* b, uint32_t n) {
+    return cos_distance(cos_sums(a, b, n));
+}
+
+float vector_distance(vector_metric_t metric, const float* a, const float* b, uint32_t n) {
+    switch (metric) {
+        case VECTOR_L2:     return sqrtf(vector_l2_sq(a, b, n));
+        case VECTOR_DOT:    return vector_dot(a, b, n);
+        case VECTOR_COSINE: return vector_cosine_distance(a, b, n);
+    }
+    return 0;
+}
+
+/* Four rows at a time when a kernel has a one-to-four form */
+typedef void (*vector_x4_fn)(const float* q, const float* r, uint32_t n, float* out);
+
+static vector_x4_fn x4_kernel(vector_metric_t metric) {
+#if SPEEDSQL_X86
+    uint32_t features = cpu_features();
+    bool dot = metric != VECTOR_L2;
+    if (features & CPU_FEATURE_AVX512F) return dot ? dot_x4_avx512 : l2_x4_avx512;
+    if ((features & VECTOR_AVX2_FEATURES) == VECTOR_AVX2_FEATURES) {
+        return dot ? dot_x4_avx2 : l2_x4_avx2;
+    }
+#endif
+    (void)metric;
+    return nullptr;
+}
+
+void vector_distances(vector_metric_t metric, const float* query, const float* base,
+                      uint32_t n, size_t count, float* out) {
+    vector_x4_fn x4 = x4_kernel(metric);
+    size_t i = 0;
+
+    if (x4) {
+        for (; i + 4 <= count; i += 4) {
+            x4(query, base + i * n, n, out + i);
+        }
+    }
+    for (; i < count; i++) {
+        const float* row = base + i * n;
+        switch (metric) {
+            case VECTOR_L2:     out[i] = vector_l2_sq(query, row, n); break;
+            case VECTOR_DOT:    out[i] = vector_dot(query, row, n); break;
+            case VECTOR_COSINE: out[i] = vector_cosine_distance(query, row, n); break;
+        }
+    }
+
+    /* The four-row kernels leave raw sums: squared L2, or dot products */
+    if (metric == VECTOR_L2) {
+        for (size_t j = 0; j < count; j++) out[j] = sqrtf(out[j]);
+    } else if (metric == VECTOR_COSINE) {
+        float qq = vector_dot(query, query, n);
+        size_t done = x4 ? count & ~(size_t)3 : 0;
+        for (size_t j = 0; j < done; j++) {
+            const float* row = base + j * n;
+            vector_cos_t s = {out[j], qq, vector_dot(row, row, n)};
+            out[j] = cos_distance(s);
+        }
+    }
+}
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #define TEST(name) static void test_##name()
 #define RUN_TEST(name) do { \
@@ -468,6 +469,62 @@ TEST(db_transaction) {
     speedsql_close(db);
 }
 
+TEST(db_memory_many_rows) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER, v INTEGER)",
+        nullptr, nullptr, nullptr);
+
+    char sql[128];
+    for (int i = 0; i < 2000; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO t VALUES (%d, %d)", i, i * 2);
+        int rc = speedsql_exec(db, sql, nullptr, nullptr, nullptr);
+        ASSERT_EQ(rc, SPEEDSQL_OK);
+    }
+
+    speedsql_stmt* stmt = nullptr;
+    speedsql_prepare(db, "SELECT COUNT(*) FROM t", -1, &stmt, nullptr);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_int(stmt, 0), 2000);
+    speedsql_finalize(stmt);
+
+    speedsql_close(db);
+}
+
+TEST(db_memory_snapshot) {
+    const char* path = "test_memory_snapshot.db";
+    remove(path);
+
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (1)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (2)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (3)", nullptr, nullptr, nullptr);
+
+    int rc = speedsql_memory_snapshot(db, path);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    speedsql_close(db);
+
+    rc = speedsql_open(path, &db);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+
+    speedsql_stmt* stmt = nullptr;
+    rc = speedsql_prepare(db, "SELECT COUNT(*) FROM t", -1, &stmt, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_int(stmt, 0), 3);
+    speedsql_finalize(stmt);
+
+    /* Snapshots are only defined for in-memory databases */
+    ASSERT_EQ(speedsql_memory_snapshot(db, path), SPEEDSQL_MISUSE);
+
+    speedsql_close(db);
+    remove(path);
+}
+
 
 /* ============================================================================
  * Savepoint Tests
@@ -572,6 +629,56 @@ TEST(index_unique) {
         nullptr, nullptr, nullptr);
     ASSERT_EQ(rc, SPEEDSQL_OK);
 
+    /* A duplicate value is refused and leaves no row behind */
+    rc = speedsql_exec(db, "INSERT INTO emails VALUES (2, 'test@example.com')",
+        nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_CONSTRAINT);
+
+    /* Values sharing the key prefix differ in full, NULLs never collide */
+    rc = speedsql_exec(db,
+        "INSERT INTO emails VALUES (3, 'a.very.long.mailbox.name@example.com')",
+        nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    rc = speedsql_exec(db,
+        "INSERT INTO emails VALUES (4, 'a.very.long.mailbox.name@example.org')",
+        nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    rc = speedsql_exec(db,
+        "INSERT INTO emails VALUES (5, 'a.very.long.mailbox.name@example.org')",
+        nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_CONSTRAINT);
+    rc = speedsql_exec(db, "INSERT INTO emails VALUES (6, NULL), (7, NULL)",
+        nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+
+    /* Updating a row onto another's value is refused; onto its own is not */
+    rc = speedsql_exec(db,
+        "UPDATE emails SET email = 'test@example.com' WHERE id = 3",
+        nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_CONSTRAINT);
+    rc = speedsql_exec(db,
+        "UPDATE emails SET email = 'test@example.com' WHERE id = 1",
+        nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+
+    speedsql_stmt* stmt = nullptr;
+    rc = speedsql_prepare(db, "SELECT id FROM emails WHERE email = 'test@example.com'",
+        -1, &stmt, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    int count = 0;
+    while (speedsql_step(stmt) == SPEEDSQL_ROW) count++;
+    speedsql_finalize(stmt);
+    ASSERT_EQ(count, 1);
+
+    /* Existing duplicates keep a unique index from being built */
+    rc = speedsql_exec(db, "CREATE TABLE tags (name TEXT)", nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    rc = speedsql_exec(db, "INSERT INTO tags VALUES ('x'), ('x')", nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    rc = speedsql_exec(db, "CREATE UNIQUE INDEX idx_tag ON tags (name)",
+        nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_CONSTRAINT);
+
     speedsql_close(db);
 }
 
@@ -842,6 +949,3381 @@ TEST(integration_transaction_rollback) {
     speedsql_close(db);
 }
 
+TEST(integration_rollback_memory) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER, name TEXT)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "CREATE INDEX idx_name ON t (name)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (1, 'one'), (2, 'two')",
+        nullptr, nullptr, nullptr);
+
+    /* Pages hold nothing but memory: rollback has to put them back */
+    ASSERT_EQ(speedsql_exec(db, "BEGIN", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    speedsql_exec(db, "INSERT INTO t VALUES (3, 'three'), (4, 'four'), (5, 'five')",
+        nullptr, nullptr, nullptr);
+    speedsql_exec(db, "UPDATE t SET name = 'uno' WHERE id = 1", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "DELETE FROM t WHERE id = 2", nullptr, nullptr, nullptr);
+    ASSERT_EQ(count_rows(db, "t"), 4);
+    ASSERT_EQ(speedsql_exec(db, "ROLLBACK", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(count_rows(db, "t"), 2);
+
+    /* Enough rows to split the roots; the trees go back to their old roots */
+    speedsql_begin(db);
+    speedsql_stmt* ins = nullptr;
+    ASSERT_EQ(speedsql_prepare(db, "INSERT INTO t VALUES (?, ?)", -1, &ins, nullptr),
+              SPEEDSQL_OK);
+    for (int i = 0; i < 2000; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "row-%d", i);
+        speedsql_bind_int(ins, 1, 100 + i);
+        speedsql_bind_text(ins, 2, name, -1, nullptr);
+        ASSERT_EQ(speedsql_step(ins), SPEEDSQL_DONE);
+        speedsql_reset(ins);
+    }
+    speedsql_finalize(ins);
+    ASSERT_EQ(count_rows(db, "t"), 2002);
+    ASSERT_EQ(speedsql_rollback(db), SPEEDSQL_OK);
+    ASSERT_EQ(count_rows(db, "t"), 2);
+
+    speedsql_stmt* stmt = nullptr;
+    ASSERT_EQ(speedsql_prepare(db, "SELECT id FROM t WHERE name = 'one'", -1, &stmt, nullptr),
+              SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_int(stmt, 0), 1);
+    speedsql_finalize(stmt);
+
+    /* Committed work stays */
+    speedsql_begin(db);
+    speedsql_exec(db, "INSERT INTO t VALUES (6, 'six')", nullptr, nullptr, nullptr);
+    ASSERT_EQ(speedsql_commit(db), SPEEDSQL_OK);
+    ASSERT_EQ(count_rows(db, "t"), 3);
+
+    speedsql_close(db);
+}
+
+
+/* ============================================================================
+ * VFS Tests
+ * ============================================================================ */
+
+TEST(vfs_find) {
+    speedsql_vfs* vfs = speedsql_vfs_find(nullptr);
+    ASSERT_NE(vfs, nullptr);
+    ASSERT_NE(speedsql_vfs_find("memory"), nullptr);
+    ASSERT_EQ(speedsql_vfs_find("no-such-vfs"), nullptr);
+
+    /* Built-in backends cannot be removed */
+    ASSERT_EQ(speedsql_vfs_unregister(vfs), SPEEDSQL_MISUSE);
+
+    speedsql* db = nullptr;
+    int rc = speedsql_open_v2("test_vfs_missing.db", &db,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE, "no-such-vfs");
+    ASSERT_EQ(rc, SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(db, nullptr);
+}
+
+TEST(vfs_memory_backend) {
+    const char* path = "test_vfs_memory.db";
+    remove(path);
+
+    speedsql* db = nullptr;
+    int rc = speedsql_open_v2(path, &db,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE, "memory");
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (1)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (2)", nullptr, nullptr, nullptr);
+    ASSERT_EQ(count_rows(db, "t"), 2);
+
+    /* Nothing reaches the real filesystem */
+    FILE* f = fopen(path, "rb");
+    ASSERT_EQ(f, nullptr);
+
+    speedsql_close(db);
+}
+
+/* Pass-through VFS that counts writes to the default backend */
+static speedsql_vfs* g_counting_base = nullptr;
+static int g_counting_writes = 0;
+
+static int counting_write(speedsql_vfs_file* file, uint64_t offset,
+                          const void* buf, size_t len) {
+    g_counting_writes++;
+    return g_counting_base->write(file, offset, buf, len);
+}
+
+TEST(vfs_custom_register) {
+    const char* path = "test_vfs_custom.db";
+    remove(path);
+
+    g_counting_base = speedsql_vfs_find(nullptr);
+    speedsql_vfs counting = *g_counting_base;
+    counting.name = "counting";
+    counting.write = counting_write;
+
+    ASSERT_EQ(speedsql_vfs_register(&counting, 0), SPEEDSQL_OK);
+
+    /* Names are unique */
+    speedsql_vfs duplicate = counting;
+    ASSERT_EQ(speedsql_vfs_register(&duplicate, 0), SPEEDSQL_CONSTRAINT);
+
+    g_counting_writes = 0;
+    speedsql* db = nullptr;
+    int rc = speedsql_open_v2(path, &db,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE, "counting");
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (1)", nullptr, nullptr, nullptr);
+    speedsql_close(db);
+
+    ASSERT_TRUE(g_counting_writes > 0);
+    ASSERT_EQ(speedsql_vfs_unregister(&counting), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_vfs_unregister(&counting), SPEEDSQL_NOTFOUND);
+
+    remove(path);
+}
+
+/* Pass-through VFS that counts lock and mmap calls on the default backend */
+static int g_locking_exclusive = 0;
+static int g_locking_maps = 0;
+
+static int locking_lock(speedsql_vfs_file* file, int level) {
+    if (level == SPEEDSQL_LOCK_EXCLUSIVE) g_locking_exclusive++;
+    return g_counting_base->lock(file, level);
+}
+
+static int locking_mmap(speedsql_vfs_file* file, uint64_t offset, size_t len, void** addr) {
+    g_locking_maps++;
+    return g_counting_base->mmap(file, offset, len, addr);
+}
+
+TEST(vfs_locks_and_mmap) {
+    const char* path = "test_vfs_locks.db";
+    const char* backup_path = "test_vfs_locks_backup.db";
+    remove(path);
+    remove(backup_path);
+
+    g_counting_base = speedsql_vfs_find(nullptr);
+    speedsql_vfs locking = *g_counting_base;
+    locking.name = "locking";
+    locking.lock = locking_lock;
+    locking.mmap = locking_mmap;
+    ASSERT_EQ(speedsql_vfs_register(&locking, 0), SPEEDSQL_OK);
+
+    g_locking_exclusive = 0;
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open_v2(path, &db,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE, "locking"), SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    for (int i = 0; i < 3; i++) {
+        speedsql_exec(db, "INSERT INTO t VALUES (1)", nullptr, nullptr, nullptr);
+    }
+    speedsql_close(db);
+    ASSERT_TRUE(g_locking_exclusive > 0);
+
+    speedsql* reader = nullptr;
+    speedsql* writer = nullptr;
+    ASSERT_EQ(speedsql_open_v2(path, &reader, SPEEDSQL_OPEN_READWRITE, "locking"), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_open_v2(path, &writer, SPEEDSQL_OPEN_READWRITE, "locking"), SPEEDSQL_OK);
+    writer->busy_timeout_ms = 0;
+
+    /* A statement still reading keeps other connections from writing */
+    speedsql_stmt* stmt = nullptr;
+    ASSERT_EQ(speedsql_prepare(reader, "SELECT id FROM t", -1, &stmt, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_exec(writer, "INSERT INTO t VALUES (2)", nullptr, nullptr, nullptr),
+              SPEEDSQL_BUSY);
+
+    /* Readers share the file */
+    ASSERT_EQ(count_rows(writer, "t"), 3);
+
+    speedsql_finalize(stmt);
+    ASSERT_EQ(speedsql_exec(writer, "INSERT INTO t VALUES (2)", nullptr, nullptr, nullptr),
+              SPEEDSQL_OK);
+    speedsql_close(reader);
+
+    /* Backups read the source through the VFS mapping */
+    g_locking_maps = 0;
+    speedsql_backup* backup = nullptr;
+    ASSERT_EQ(speedsql_backup_init(writer, backup_path, 0, &backup), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_backup_step(backup, 0), SPEEDSQL_DONE);
+    ASSERT_EQ(speedsql_backup_finish(backup, nullptr), SPEEDSQL_OK);
+    ASSERT_TRUE(g_locking_maps > 0);
+    speedsql_close(writer);
+
+    speedsql* copy = nullptr;
+    ASSERT_EQ(speedsql_open(backup_path, &copy), SPEEDSQL_OK);
+    ASSERT_EQ(count_rows(copy, "t"), 4);
+    speedsql_close(copy);
+
+    ASSERT_EQ(speedsql_vfs_unregister(&locking), SPEEDSQL_OK);
+    remove(path);
+    remove(backup_path);
+}
+
+#ifdef SPEEDSQL_HAVE_IO_URING
+TEST(vfs_io_uring) {
+    const char* path = "test_vfs_uring.db";
+    remove(path);
+
+    speedsql* db = nullptr;
+    int rc = speedsql_open_v2(path, &db,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE, "io_uring");
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (1)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (2)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (3)", nullptr, nullptr, nullptr);
+    speedsql_close(db);
+
+    /* Pages written through io_uring read back through the native VFS */
+    rc = speedsql_open(path, &db);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    ASSERT_EQ(count_rows(db, "t"), 3);
+    speedsql_close(db);
+
+    remove(path);
+}
+#endif
+
+/* ============================================================================
+ * Backup Tests
+ * ============================================================================ */
+
+static int count_query(speedsql* db, const char* sql) {
+    speedsql_stmt* stmt = nullptr;
+    if (speedsql_prepare(db, sql, -1, &stmt, nullptr) != SPEEDSQL_OK) return -1;
+    int n = (speedsql_step(stmt) == SPEEDSQL_ROW) ? speedsql_column_int(stmt, 0) : -1;
+    speedsql_finalize(stmt);
+    return n;
+}
+
+TEST(backup_online) {
+    const char* src_path = "test_backup_src.db";
+    const char* dst_path = "test_backup_dst.db";
+    remove(src_path);
+    remove(dst_path);
+
+    speedsql* db = nullptr;
+    speedsql_open(src_path, &db);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    for (int i = 0; i < 500; i++) {
+        speedsql_exec(db, "INSERT INTO t VALUES (1)", nullptr, nullptr, nullptr);
+    }
+    speedsql_commit(db);
+
+    speedsql_backup* backup = nullptr;
+    int rc = speedsql_backup_init(db, dst_path, 0, &backup);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+
+    /* A second backup cannot run concurrently */
+    speedsql_backup* other = nullptr;
+    ASSERT_EQ(speedsql_backup_init(db, "test_backup_other.db", 0, &other), SPEEDSQL_BUSY);
+    remove("test_backup_other.db");
+
+    /* Writers keep going between steps */
+    while ((rc = speedsql_backup_step(backup, 2)) == SPEEDSQL_OK) {
+        speedsql_exec(db, "INSERT INTO t VALUES (2)", nullptr, nullptr, nullptr);
+    }
+    ASSERT_EQ(rc, SPEEDSQL_DONE);
+    ASSERT_EQ(speedsql_backup_remaining(backup), 0);
+
+    uint64_t txn = 0;
+    ASSERT_EQ(speedsql_backup_finish(backup, &txn), SPEEDSQL_OK);
+    ASSERT_TRUE(txn > 0);
+
+    int expected = count_query(db, "SELECT COUNT(*) FROM t");
+    ASSERT_TRUE(expected > 500);
+    speedsql_close(db);
+
+    speedsql* copy = nullptr;
+    ASSERT_EQ(speedsql_open(dst_path, &copy), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(copy, "SELECT COUNT(*) FROM t"), expected);
+    speedsql_close(copy);
+
+    remove(src_path);
+    remove(dst_path);
+}
+
+TEST(backup_incremental) {
+    const char* src_path = "test_backup_inc_src.db";
+    const char* dst_path = "test_backup_inc_dst.db";
+    remove(src_path);
+    remove(dst_path);
+
+    speedsql* db = nullptr;
+    speedsql_open(src_path, &db);
+    speedsql_exec(db, "CREATE TABLE a (id INTEGER)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "CREATE TABLE b (id INTEGER)", nullptr, nullptr, nullptr);
+    for (int i = 0; i < 2000; i++) {
+        speedsql_exec(db, "INSERT INTO a VALUES (1)", nullptr, nullptr, nullptr);
+    }
+
+    speedsql_backup* backup = nullptr;
+    uint64_t full_txn = 0;
+    ASSERT_EQ(speedsql_backup_init(db, dst_path, 0, &backup), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_backup_finish(backup, &full_txn), SPEEDSQL_OK);
+
+    /* Touch only table b, and reopen so its pages reach disk stamped */
+    speedsql_exec(db, "INSERT INTO b VALUES (7)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO b VALUES (8)", nullptr, nullptr, nullptr);
+    speedsql_close(db);
+    speedsql_open(src_path, &db);
+
+    /* since_txn must name the backup being updated */
+    ASSERT_EQ(speedsql_backup_init(db, dst_path, full_txn + 100, &backup), SPEEDSQL_MISMATCH);
+
+    uint64_t inc_txn = 0;
+    ASSERT_EQ(speedsql_backup_init(db, dst_path, full_txn, &backup), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_backup_step(backup, -1), SPEEDSQL_DONE);
+
+    /* Only the changed leaf of b is newer than the full backup */
+    ASSERT_TRUE(speedsql_backup_copied(backup) >= 1);
+    ASSERT_TRUE(speedsql_backup_copied(backup) < 4);
+    ASSERT_EQ(speedsql_backup_finish(backup, &inc_txn), SPEEDSQL_OK);
+    ASSERT_TRUE(inc_txn > full_txn);
+    speedsql_close(db);
+
+    speedsql* copy = nullptr;
+    ASSERT_EQ(speedsql_open(dst_path, &copy), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(copy, "SELECT COUNT(*) FROM a"), 2000);
+    ASSERT_EQ(count_query(copy, "SELECT COUNT(*) FROM b"), 2);
+    speedsql_close(copy);
+
+    remove(src_path);
+    remove(dst_path);
+}
+
+/* ============================================================================
+ * Replication Tests
+ * ============================================================================ */
+
+static void insert_rows(speedsql* db, const char* sql, int n) {
+    speedsql_begin(db);
+    for (int i = 0; i < n; i++) {
+        speedsql_exec(db, sql, nullptr, nullptr, nullptr);
+    }
+    speedsql_commit(db);
+}
+
+TEST(wal_follower_segments) {
+    const char* primary_path = "test_repl_primary.db";
+    const char* follower_path = "test_repl_follower.db";
+    remove(primary_path);
+    remove("test_repl_primary.db-wal");
+    remove(follower_path);
+
+    speedsql* primary = nullptr;
+    int rc = speedsql_open_v2(primary_path, &primary,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE | SPEEDSQL_OPEN_WAL, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    speedsql_exec(primary, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    insert_rows(primary, "INSERT INTO t VALUES (1)", 300);
+
+    uint64_t next_lsn = 0;
+    ASSERT_EQ(speedsql_wal_export(primary, 0, "test_repl_seg1.wal", &next_lsn), SPEEDSQL_OK);
+    ASSERT_TRUE(next_lsn > 1);
+
+    speedsql* follower = nullptr;
+    ASSERT_EQ(speedsql_follower_open(follower_path, &follower), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_follower_apply(follower, "test_repl_seg1.wal"), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM t"), 300);
+
+    /* Followers serve reads only */
+    rc = speedsql_exec(follower, "INSERT INTO t VALUES (2)", nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_READONLY);
+
+    /* The next segment carries only the new transaction */
+    insert_rows(primary, "INSERT INTO t VALUES (2)", 50);
+    ASSERT_EQ(speedsql_wal_export(primary, next_lsn, "test_repl_seg2.wal", &next_lsn), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_follower_apply(follower, "test_repl_seg2.wal"), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM t"), 350);
+
+    /* Reapplying an old segment is a no-op */
+    ASSERT_EQ(speedsql_follower_apply(follower, "test_repl_seg1.wal"), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM t"), 350);
+
+    speedsql_close(follower);
+    speedsql_close(primary);
+
+    remove(primary_path);
+    remove("test_repl_primary.db-wal");
+    remove(follower_path);
+    remove("test_repl_seg1.wal");
+    remove("test_repl_seg2.wal");
+}
+
+TEST(wal_follower_tail) {
+    const char* primary_path = "test_repl_tail_primary.db";
+    const char* wal_path = "test_repl_tail_primary.db-wal";
+    const char* follower_path = "test_repl_tail_follower.db";
+    remove(primary_path);
+    remove(wal_path);
+    remove(follower_path);
+
+    speedsql* primary = nullptr;
+    speedsql_open_v2(primary_path, &primary,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE | SPEEDSQL_OPEN_WAL, nullptr);
+    speedsql_exec(primary, "CREATE TABLE a (id INTEGER)", nullptr, nullptr, nullptr);
+    insert_rows(primary, "INSERT INTO a VALUES (1)", 10);
+
+    speedsql* follower = nullptr;
+    ASSERT_EQ(speedsql_follower_open(follower_path, &follower), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_follower_apply(follower, wal_path), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM a"), 10);
+
+    /* Uncommitted work is not visible until its commit is logged */
+    speedsql_begin(primary);
+    speedsql_exec(primary, "CREATE TABLE b (id INTEGER)", nullptr, nullptr, nullptr);
+    speedsql_exec(primary, "INSERT INTO b VALUES (1)", nullptr, nullptr, nullptr);
+    ASSERT_EQ(speedsql_follower_apply(follower, wal_path), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM a"), 10);
+
+    speedsql_commit(primary);
+    ASSERT_EQ(speedsql_follower_apply(follower, wal_path), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM b"), 1);
+
+    speedsql_close(follower);
+    speedsql_close(primary);
+
+    remove(primary_path);
+    remove(wal_path);
+    remove(follower_path);
+}
+
+static long file_length(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+TEST(wal_checkpoint_restarts_log) {
+    const char* primary_path = "test_repl_ckpt_primary.db";
+    const char* wal_path = "test_repl_ckpt_primary.db-wal";
+    const char* follower_path = "test_repl_ckpt_follower.db";
+    const char* lagging_path = "test_repl_ckpt_lagging.db";
+    const char* segment_path = "test_repl_ckpt_seg.wal";
+    remove(primary_path);
+    remove(wal_path);
+    remove(follower_path);
+    remove(lagging_path);
+
+    speedsql* primary = nullptr;
+    ASSERT_EQ(speedsql_open_v2(primary_path, &primary,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE | SPEEDSQL_OPEN_WAL, nullptr), SPEEDSQL_OK);
+    primary->wal->checkpoint_size = 256 * 1024;
+    speedsql_exec(primary, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    insert_rows(primary, "INSERT INTO t VALUES (1)", 10);
+
+    speedsql* follower = nullptr;
+    speedsql* lagging = nullptr;
+    ASSERT_EQ(speedsql_follower_open(follower_path, &follower), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_follower_open(lagging_path, &lagging), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_follower_apply(follower, wal_path), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_follower_apply(lagging, wal_path), SPEEDSQL_OK);
+    uint64_t next_lsn = 0;
+    ASSERT_EQ(speedsql_wal_export(primary, 0, segment_path, &next_lsn), SPEEDSQL_OK);
+    uint64_t first_lsn = next_lsn;
+
+    /* Commits past the size restart the log; a follower keeping up
+     * notices the restart and rereads it from the start */
+    for (int i = 0; i < 40; i++) {
+        insert_rows(primary, "INSERT INTO t VALUES (2)", 25);
+        ASSERT_TRUE(file_length(wal_path) < 256 * 1024 + 64 * 1024);
+        ASSERT_EQ(speedsql_follower_apply(follower, wal_path), SPEEDSQL_OK);
+        ASSERT_EQ(speedsql_wal_export(primary, next_lsn, segment_path, &next_lsn), SPEEDSQL_OK);
+    }
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM t"), 1010);
+    ASSERT_TRUE(primary->wal->base_lsn > first_lsn);
+
+    /* Behind a checkpoint there is nothing left to catch up from */
+    ASSERT_EQ(speedsql_follower_apply(lagging, wal_path), SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(count_query(lagging, "SELECT COUNT(*) FROM t"), 10);
+    ASSERT_EQ(speedsql_wal_export(primary, first_lsn, segment_path, nullptr), SPEEDSQL_NOTFOUND);
+
+    /* Closing checkpoints too, keeping only the recent transactions */
+    long before_close = file_length(wal_path);
+    speedsql_close(primary);
+    ASSERT_TRUE(file_length(wal_path) < before_close);
+    ASSERT_EQ(speedsql_follower_apply(follower, wal_path), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM t"), 1010);
+
+    speedsql_close(lagging);
+    speedsql_close(follower);
+    remove(primary_path);
+    remove(wal_path);
+    remove(follower_path);
+    remove(lagging_path);
+    remove(segment_path);
+}
+
+/* ============================================================================
+ * Snapshot Tests
+ * ============================================================================ */
+
+TEST(snapshot_point_in_time) {
+    const char* path = "test_snapshot.db";
+    remove(path);
+    remove("test_snapshot.db-wal");
+
+    speedsql* db = nullptr;
+    speedsql_open_v2(path, &db,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE | SPEEDSQL_OPEN_WAL, nullptr);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    insert_rows(db, "INSERT INTO t VALUES (1)", 200);
+
+    speedsql* snap = nullptr;
+    ASSERT_EQ(speedsql_snapshot_open(db, &snap), SPEEDSQL_OK);
+
+    /* The writer keeps committing; the snapshot does not move */
+    insert_rows(db, "INSERT INTO t VALUES (2)", 300);
+    ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 500);
+    ASSERT_EQ(count_query(snap, "SELECT COUNT(*) FROM t"), 200);
+
+    int rc = speedsql_exec(snap, "INSERT INTO t VALUES (3)", nullptr, nullptr, nullptr);
+    ASSERT_EQ(rc, SPEEDSQL_READONLY);
+
+    /* Not while the writer has a transaction open */
+    speedsql* other = nullptr;
+    speedsql_begin(db);
+    ASSERT_EQ(speedsql_snapshot_open(db, &other), SPEEDSQL_BUSY);
+    speedsql_rollback(db);
+
+    speedsql_close(snap);
+    speedsql_close(db);
+    remove(path);
+    remove("test_snapshot.db-wal");
+}
+
+TEST(snapshot_outlives_writer) {
+    const char* path = "test_snapshot_close.db";
+    remove(path);
+
+    speedsql* db = nullptr;
+    speedsql_open(path, &db);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    for (int i = 0; i < 100; i++) {
+        speedsql_exec(db, "INSERT INTO t VALUES (1)", nullptr, nullptr, nullptr);
+    }
+
+    speedsql* snap = nullptr;
+    ASSERT_EQ(speedsql_snapshot_open(db, &snap), SPEEDSQL_OK);
+
+    /* Closing the writer flushes new pages over the snapshot's */
+    speedsql_exec(db, "CREATE TABLE u (id INTEGER)", nullptr, nullptr, nullptr);
+    for (int i = 0; i < 100; i++) {
+        speedsql_exec(db, "INSERT INTO t VALUES (2)", nullptr, nullptr, nullptr);
+    }
+    speedsql_close(db);
+
+    ASSERT_EQ(count_query(snap, "SELECT COUNT(*) FROM t"), 100);
+    speedsql_close(snap);
+
+    speedsql* reopened = nullptr;
+    speedsql_open(path, &reopened);
+    ASSERT_EQ(count_query(reopened, "SELECT COUNT(*) FROM t"), 200);
+    speedsql_close(reopened);
+    remove(path);
+}
+
+/* ============================================================================
+ * Cipher Acceleration Tests
+ * ============================================================================ */
+
+/* Encrypt one page-sized buffer with the given CPU features enabled */
+static int gcm_encrypt_with(uint32_t features, const uint8_t* key, const uint8_t* iv,
+                            const uint8_t* aad, size_t aad_len,
+                            const uint8_t* in, uint8_t* out, size_t len, uint8_t* tag) {
+    const speedsql_cipher_provider_t* p = speedsql_get_cipher(SPEEDSQL_CIPHER_AES_256_GCM);
+    if (!p) return SPEEDSQL_NOTFOUND;
+
+    cpu_features_mask(features);
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    int rc = p->init(&ctx, key, 32);
+    if (rc == SPEEDSQL_OK) {
+        rc = p->encrypt(ctx, in, len, iv, aad, aad_len, out, tag);
+        p->destroy(ctx);
+    }
+    cpu_features_mask(0xFFFFFFFFu);
+    return rc;
+}
+
+TEST(aes_gcm_hw_matches_portable) {
+    /* A 16KB page plus a partial block, with AAD that is not block aligned */
+    const size_t len = 16384 + 37;
+    uint8_t key[32], iv[12], aad[24];
+    for (int i = 0; i < 32; i++) key[i] = (uint8_t)(i * 7 + 1);
+    for (int i = 0; i < 12; i++) iv[i] = (uint8_t)(0xf0 + i);
+    for (int i = 0; i < 24; i++) aad[i] = (uint8_t)(i * 13);
+
+    uint8_t* page = (uint8_t*)malloc(len);
+    uint8_t* ct_fast = (uint8_t*)malloc(len);
+    uint8_t* ct_ref = (uint8_t*)malloc(len);
+    uint8_t* back = (uint8_t*)malloc(len);
+    for (size_t i = 0; i < len; i++) page[i] = (uint8_t)(i * 31 + (i >> 8));
+
+    uint8_t tag_fast[16], tag_ref[16];
+    ASSERT_EQ(gcm_encrypt_with(0, key, iv, aad, sizeof(aad), page, ct_ref, len, tag_ref),
+              SPEEDSQL_OK);
+
+    /* AES-NI without VAES, then everything the CPU has */
+    const uint32_t masks[2] = {
+        CPU_FEATURE_AESNI | CPU_FEATURE_PCLMUL | CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE41,
+        0xFFFFFFFFu
+    };
+    for (int m = 0; m < 2; m++) {
+        ASSERT_EQ(gcm_encrypt_with(masks[m], key, iv, aad, sizeof(aad), page, ct_fast, len,
+                                   tag_fast), SPEEDSQL_OK);
+        ASSERT_EQ(memcmp(ct_fast, ct_ref, len), 0);
+        ASSERT_EQ(memcmp(tag_fast, tag_ref, 16), 0);
+    }
+
+    /* Accelerated ciphertext decrypts on the accelerated path */
+    const speedsql_cipher_provider_t* p = speedsql_get_cipher(SPEEDSQL_CIPHER_AES_256_GCM);
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    ASSERT_EQ(p->init(&ctx, key, 32), SPEEDSQL_OK);
+    ASSERT_EQ(p->decrypt(ctx, ct_fast, len, iv, aad, sizeof(aad), tag_fast, back), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(back, page, len), 0);
+
+    /* A flipped bit deep in the page fails authentication */
+    ct_fast[9000] ^= 0x04;
+    ASSERT_EQ(p->decrypt(ctx, ct_fast, len, iv, aad, sizeof(aad), tag_fast, back),
+              SPEEDSQL_CORRUPT);
+    p->destroy(ctx);
+
+    free(page);
+    free(ct_fast);
+    free(ct_ref);
+    free(back);
+}
+
+TEST(aes_gcm_self_test_both_paths) {
+    ASSERT_EQ(speedsql_crypto_self_test(), SPEEDSQL_OK);
+
+    cpu_features_mask(0);
+    int rc = speedsql_crypto_self_test();
+    cpu_features_mask(0xFFFFFFFFu);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+
+    /* Encrypted database round trip on the accelerated path */
+    const char* path = "test_aes_gcm_hw.db";
+    remove(path);
+
+    speedsql* db = nullptr;
+    speedsql_open(path, &db);
+    speedsql_crypto_config_t config; memset(&config, 0, sizeof(config));
+    config.cipher = SPEEDSQL_CIPHER_AES_256_GCM;
+    config.kdf = SPEEDSQL_KDF_PBKDF2_SHA256;
+    config.kdf_iterations = 1000;
+    ASSERT_EQ(speedsql_key_v2(db, "page-key", 8, &config), SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER, name TEXT)", nullptr, nullptr, nullptr);
+    for (int i = 0; i < 200; i++) {
+        speedsql_exec(db, "INSERT INTO t VALUES (1, 'encrypted row')", nullptr, nullptr, nullptr);
+    }
+    speedsql_close(db);
+
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key_v2(db, "page-key", 8, &config), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 200);
+    speedsql_close(db);
+    remove(path);
+}
+
+/* Encrypt, tamper, rekey: the per-key GHASH tables must follow the key */
+static void gcm_table_roundtrip(speedsql_cipher_t cipher_id) {
+    const speedsql_cipher_provider_t* p = speedsql_get_cipher(cipher_id);
+    ASSERT_TRUE(p != nullptr);
+
+    const size_t len = 4096 + 5;
+    uint8_t key[32], key2[32], iv[12] = {1, 2, 3}, aad[8] = {9, 9, 9};
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t)i;
+        key2[i] = (uint8_t)(0xa5 ^ i);
+    }
+
+    uint8_t* page = (uint8_t*)malloc(len);
+    uint8_t* ct = (uint8_t*)malloc(len);
+    uint8_t* back = (uint8_t*)malloc(len);
+    for (size_t i = 0; i < len; i++) page[i] = (uint8_t)(i ^ (i >> 7));
+
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    ASSERT_EQ(p->init(&ctx, key, 32), SPEEDSQL_OK);
+
+    uint8_t tag[16], zero[16] = {0};
+    ASSERT_EQ(p->encrypt(ctx, page, len, iv, aad, sizeof(aad), ct, tag), SPEEDSQL_OK);
+    ASSERT_NE(memcmp(tag, zero, 16), 0);
+    ASSERT_EQ(p->decrypt(ctx, ct, len, iv, aad, sizeof(aad), tag, back), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(back, page, len), 0);
+
+    /* Wrong AAD (another page number) and flipped ciphertext are rejected */
+    aad[0] ^= 1;
+    ASSERT_EQ(p->decrypt(ctx, ct, len, iv, aad, sizeof(aad), tag, back), SPEEDSQL_CORRUPT);
+    aad[0] ^= 1;
+    ct[len - 1] ^= 0x80;
+    ASSERT_EQ(p->decrypt(ctx, ct, len, iv, aad, sizeof(aad), tag, back), SPEEDSQL_CORRUPT);
+    ct[len - 1] ^= 0x80;
+
+    /* After rekey the old tag no longer verifies; new pages round trip */
+    ASSERT_EQ(p->rekey(ctx, key2, 32), SPEEDSQL_OK);
+    ASSERT_EQ(p->decrypt(ctx, ct, len, iv, aad, sizeof(aad), tag, back), SPEEDSQL_CORRUPT);
+    ASSERT_EQ(p->encrypt(ctx, page, len, iv, aad, sizeof(aad), ct, tag), SPEEDSQL_OK);
+    ASSERT_EQ(p->decrypt(ctx, ct, len, iv, aad, sizeof(aad), tag, back), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(back, page, len), 0);
+
+    p->destroy(ctx);
+    free(page);
+    free(ct);
+    free(back);
+}
+
+TEST(aes_gcm_portable_tables) {
+    cpu_features_mask(0);
+    gcm_table_roundtrip(SPEEDSQL_CIPHER_AES_256_GCM);
+    cpu_features_mask(0xFFFFFFFFu);
+}
+
+TEST(aria_gcm_authenticates) {
+    gcm_table_roundtrip(SPEEDSQL_CIPHER_ARIA_256_GCM);
+}
+
+TEST(chacha20_simd_matches_portable) {
+    const speedsql_cipher_provider_t* p = speedsql_get_cipher(SPEEDSQL_CIPHER_CHACHA20_POLY1305);
+    ASSERT_TRUE(p != nullptr);
+
+    uint8_t key[32], nonce[12], aad[20];
+    for (int i = 0; i < 32; i++) key[i] = (uint8_t)(i * 5 + 3);
+    for (int i = 0; i < 12; i++) nonce[i] = (uint8_t)(0x30 + i);
+    for (int i = 0; i < 20; i++) aad[i] = (uint8_t)(i * 11);
+
+    const size_t max_len = 16384 + 37;
+    uint8_t* page = (uint8_t*)malloc(max_len);
+    uint8_t* ct_fast = (uint8_t*)malloc(max_len);
+    uint8_t* ct_ref = (uint8_t*)malloc(max_len);
+    for (size_t i = 0; i < max_len; i++) page[i] = (uint8_t)(i * 29 + (i >> 9));
+
+    /* Lengths that end inside every kernel width and the Poly1305 groups */
+    const size_t lens[5] = {100, 300, 700, 1500, max_len};
+    const uint32_t masks[3] = {
+        CPU_FEATURE_SSE2 | CPU_FEATURE_NEON,
+        CPU_FEATURE_SSE2 | CPU_FEATURE_AVX2,
+        0xFFFFFFFFu
+    };
+
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    ASSERT_EQ(p->init(&ctx, key, 32), SPEEDSQL_OK);
+    for (int l = 0; l < 5; l++) {
+        uint8_t tag_ref[16], tag_fast[16];
+        cpu_features_mask(0);
+        int rc = p->encrypt(ctx, page, lens[l], nonce, aad, sizeof(aad), ct_ref, tag_ref);
+        cpu_features_mask(0xFFFFFFFFu);
+        ASSERT_EQ(rc, SPEEDSQL_OK);
+
+        for (int m = 0; m < 3; m++) {
+            cpu_features_mask(masks[m]);
+            rc = p->encrypt(ctx, page, lens[l], nonce, aad, sizeof(aad), ct_fast, tag_fast);
+            cpu_features_mask(0xFFFFFFFFu);
+            ASSERT_EQ(rc, SPEEDSQL_OK);
+            ASSERT_EQ(memcmp(ct_fast, ct_ref, lens[l]), 0);
+            ASSERT_EQ(memcmp(tag_fast, tag_ref, 16), 0);
+        }
+    }
+    p->destroy(ctx);
+
+    free(page);
+    free(ct_fast);
+    free(ct_ref);
+}
+
+TEST(chacha20_poly1305_authenticates) {
+    /* Self-test is the RFC 8439 AEAD vector; run it on both paths */
+    cpu_features_mask(0);
+    int rc = speedsql_get_cipher(SPEEDSQL_CIPHER_CHACHA20_POLY1305)->self_test();
+    cpu_features_mask(0xFFFFFFFFu);
+    ASSERT_EQ(rc, SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_get_cipher(SPEEDSQL_CIPHER_CHACHA20_POLY1305)->self_test(), SPEEDSQL_OK);
+
+    gcm_table_roundtrip(SPEEDSQL_CIPHER_CHACHA20_POLY1305);
+}
+
+/* ============================================================================
+ * Parallel Crypto Tests
+ * ============================================================================ */
+
+TEST(parallel_flush_encrypted) {
+    const char* path = "test_parallel_flush.db";
+    remove(path);
+
+    speedsql_crypto_config_t config; memset(&config, 0, sizeof(config));
+    config.cipher = SPEEDSQL_CIPHER_AES_256_GCM;
+    config.kdf = SPEEDSQL_KDF_PBKDF2_SHA256;
+    config.kdf_iterations = 1000;
+
+    /* Three helpers seal the flush batches even on a single core */
+    speedsql* db = nullptr;
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key_v2(db, "flush-key", 9, &config), SPEEDSQL_OK);
+    ASSERT_EQ(buffer_pool_set_crypt_threads(db->buffer_pool, 3), SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER, name TEXT)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "BEGIN", nullptr, nullptr, nullptr);
+    for (int i = 0; i < 3000; i++) {
+        char sql[160];
+        snprintf(sql, sizeof(sql),
+                 "INSERT INTO t VALUES (%d, 'row %d padded out to fill pages quickly')", i, i);
+        speedsql_exec(db, sql, nullptr, nullptr, nullptr);
+    }
+    ASSERT_EQ(speedsql_exec(db, "COMMIT", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    speedsql_close(db);
+
+    /* Pages sealed in parallel read back on the serial path */
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key_v2(db, "flush-key", 9, &config), SPEEDSQL_OK);
+    ASSERT_EQ(buffer_pool_set_crypt_threads(db->buffer_pool, 0), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 3000);
+    speedsql_close(db);
+    remove(path);
+}
+
+typedef struct {
+    buffer_pool_t* pool;
+    file_t* file;
+    const page_id_t* ids;
+    int page_count;
+    int seed;
+    int errors;
+} pool_reader_t;
+
+/* Read pages in a scrambled order, dirtying some to force write-backs */
+static void* pool_reader_main(void* arg) {
+    pool_reader_t* r = (pool_reader_t*)arg;
+    uint32_t x = (uint32_t)r->seed;
+    for (int i = 0; i < 400; i++) {
+        x = x * 1103515245u + 12345u;
+        int k = (int)((x >> 8) % (uint32_t)r->page_count);
+        buffer_page_t* page = buffer_pool_get(r->pool, r->file, r->ids[k]);
+        if (!page) {
+            r->errors++;
+            continue;
+        }
+        uint64_t marker;
+        memcpy(&marker, page->data + 64, sizeof(marker));
+        if (marker != r->ids[k] * 7919) r->errors++;
+        buffer_pool_unpin(r->pool, page, (i % 5) == 0);
+    }
+    return nullptr;
+}
+
+TEST(concurrent_encrypted_page_io) {
+    const char* path = "test_concurrent_pool.db";
+    remove(path);
+
+    file_t file;
+    ASSERT_EQ(file_open(&file, path, SPEEDSQL_VFS_OPEN_READWRITE | SPEEDSQL_VFS_OPEN_CREATE),
+              SPEEDSQL_OK);
+
+    const speedsql_cipher_provider_t* p = speedsql_get_cipher(SPEEDSQL_CIPHER_CHACHA20_POLY1305);
+    uint8_t key[32];
+    for (int i = 0; i < 32; i++) key[i] = (uint8_t)(i * 3);
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    ASSERT_EQ(p->init(&ctx, key, 32), SPEEDSQL_OK);
+
+    /* 16 frames for 48 pages: readers keep evicting each other */
+    buffer_pool_t pool;
+    ASSERT_EQ(buffer_pool_init(&pool, 16 * 4096, 4096), SPEEDSQL_OK);
+    ASSERT_EQ(buffer_pool_set_encryption(&pool, ctx, SPEEDSQL_CIPHER_CHACHA20_POLY1305),
+              SPEEDSQL_OK);
+    ASSERT_EQ(buffer_pool_set_crypt_threads(&pool, 2), SPEEDSQL_OK);
+
+    page_id_t ids[48];
+    for (int i = 0; i < 48; i++) {
+        buffer_page_t* page = buffer_pool_new_page(&pool, &file, &ids[i]);
+        ASSERT_TRUE(page != nullptr);
+        uint64_t marker = ids[i] * 7919;
+        memcpy(page->data + 64, &marker, sizeof(marker));
+        buffer_pool_unpin(&pool, page, true);
+    }
+    ASSERT_EQ(buffer_pool_flush(&pool, &file), SPEEDSQL_OK);
+
+    pool_reader_t readers[4];
+    thread_t threads[4];
+    for (int t = 0; t < 4; t++) {
+        readers[t].pool = &pool;
+        readers[t].file = &file;
+        readers[t].ids = ids;
+        readers[t].page_count = 48;
+        readers[t].seed = t * 7 + 1;
+        readers[t].errors = 0;
+        ASSERT_EQ(thread_create(&threads[t], pool_reader_main, &readers[t]), SPEEDSQL_OK);
+    }
+    for (int t = 0; t < 4; t++) {
+        thread_join(threads[t]);
+        ASSERT_EQ(readers[t].errors, 0);
+    }
+
+    /* Everything written back, evicted or flushed, still authenticates */
+    ASSERT_EQ(buffer_pool_flush(&pool, &file), SPEEDSQL_OK);
+    ASSERT_EQ(buffer_pool_discard(&pool), SPEEDSQL_OK);
+    for (int i = 0; i < 48; i++) {
+        buffer_page_t* page = buffer_pool_get(&pool, &file, ids[i]);
+        ASSERT_TRUE(page != nullptr);
+        uint64_t marker;
+        memcpy(&marker, page->data + 64, sizeof(marker));
+        ASSERT_EQ(marker, ids[i] * 7919);
+        buffer_pool_unpin(&pool, page, false);
+    }
+
+    buffer_pool_destroy(&pool);
+    p->destroy(ctx);
+    file_close(&file);
+    remove(path);
+}
+
+/* ============================================================================
+ * Aligned Page Layout Tests
+ * ============================================================================ */
+
+TEST(aligned_encrypted_database) {
+    const char* path = "test_aligned_pages.db";
+    remove(path);
+
+    speedsql_crypto_config_t config; memset(&config, 0, sizeof(config));
+    config.cipher = SPEEDSQL_CIPHER_CHACHA20_POLY1305;
+    config.kdf = SPEEDSQL_KDF_PBKDF2_SHA256;
+    config.kdf_iterations = 1000;
+    config.aligned_pages = true;
+
+    speedsql* db = nullptr;
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key_v2(db, "aligned-key", 11, &config), SPEEDSQL_OK);
+    ASSERT_EQ(db->buffer_pool->page_reserve, 32u);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER, name TEXT)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "BEGIN", nullptr, nullptr, nullptr);
+    for (int i = 0; i < 1500; i++) {
+        char sql[160];
+        snprintf(sql, sizeof(sql),
+                 "INSERT INTO t VALUES (%d, 'row %d padded out to fill pages quickly')", i, i);
+        speedsql_exec(db, sql, nullptr, nullptr, nullptr);
+    }
+    ASSERT_EQ(speedsql_exec(db, "COMMIT", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    speedsql_close(db);
+
+    /* Every page, header and schema included, sits on a page boundary */
+    FILE* f = fopen(path, "rb");
+    ASSERT_TRUE(f != nullptr);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    ASSERT_TRUE(size > 2 * SPEEDSQL_PAGE_SIZE);
+    ASSERT_EQ(size % SPEEDSQL_PAGE_SIZE, 0);
+
+    /* The layout comes from the header; the flag is not needed again */
+    config.aligned_pages = false;
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key_v2(db, "aligned-key", 11, &config), SPEEDSQL_OK);
+    ASSERT_EQ(buffer_pool_disk_page_size(db->buffer_pool), (uint64_t)SPEEDSQL_PAGE_SIZE);
+    ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 1500);
+    speedsql_close(db);
+    remove(path);
+}
+
+TEST(aligned_page_nonce_and_tamper) {
+    const char* path = "test_aligned_nonce.db";
+    remove(path);
+
+    file_t file;
+    ASSERT_EQ(file_open(&file, path, SPEEDSQL_VFS_OPEN_READWRITE | SPEEDSQL_VFS_OPEN_CREATE),
+              SPEEDSQL_OK);
+
+    const speedsql_cipher_provider_t* p = speedsql_get_cipher(SPEEDSQL_CIPHER_AES_256_GCM);
+    uint8_t key[32];
+    for (int i = 0; i < 32; i++) key[i] = (uint8_t)(i * 5 + 1);
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    ASSERT_EQ(p->init(&ctx, key, 32), SPEEDSQL_OK);
+
+    buffer_pool_t pool;
+    ASSERT_EQ(buffer_pool_init(&pool, 16 * 4096, 4096), SPEEDSQL_OK);
+    uint32_t reserve = buffer_pool_reserve_for(SPEEDSQL_CIPHER_AES_256_GCM);
+    ASSERT_EQ(reserve, 32u);
+    ASSERT_EQ(buffer_pool_set_page_reserve(&pool, reserve), SPEEDSQL_OK);
+    ASSERT_EQ(pool.usable_size, (uint64_t)(4096 - 32));
+    ASSERT_EQ(buffer_pool_set_encryption(&pool, ctx, SPEEDSQL_CIPHER_AES_256_GCM), SPEEDSQL_OK);
+
+    page_id_t id;
+    buffer_page_t* page = buffer_pool_new_page(&pool, &file, &id);
+    ASSERT_TRUE(page != nullptr);
+    memset(page->data + 64, 0xA5, 256);
+    buffer_pool_unpin(&pool, page, true);
+    ASSERT_EQ(buffer_pool_flush(&pool, &file), SPEEDSQL_OK);
+
+    uint8_t first[4096], second[4096];
+    ASSERT_EQ(file_read(&file, id * 4096, first, sizeof(first)), SPEEDSQL_OK);
+
+    /* Rewriting identical contents draws a fresh nonce */
+    page = buffer_pool_get(&pool, &file, id);
+    ASSERT_TRUE(page != nullptr);
+    buffer_pool_unpin(&pool, page, true);
+    ASSERT_EQ(buffer_pool_flush(&pool, &file), SPEEDSQL_OK);
+    ASSERT_EQ(file_read(&file, id * 4096, second, sizeof(second)), SPEEDSQL_OK);
+    ASSERT_TRUE(memcmp(first, second, 4096 - 32) != 0);
+    ASSERT_TRUE(memcmp(first + 4096 - 32, second + 4096 - 32, 12) != 0);
+
+    /* A flipped ciphertext bit fails authentication on the next read */
+    second[100] ^= 0x01;
+    ASSERT_EQ(file_write(&file, id * 4096, second, sizeof(second)), SPEEDSQL_OK);
+    ASSERT_EQ(buffer_pool_discard(&pool), SPEEDSQL_OK);
+    ASSERT_TRUE(buffer_pool_get(&pool, &file, id) == nullptr);
+
+    buffer_pool_destroy(&pool);
+    p->destroy(ctx);
+    file_close(&file);
+    remove(path);
+}
+
+/* ============================================================================
+ * Online Rekey Tests
+ * ============================================================================ */
+
+static void fill_rows(speedsql* db, int first, int count) {
+    speedsql_exec(db, "BEGIN", nullptr, nullptr, nullptr);
+    for (int i = first; i < first + count; i++) {
+        char sql[160];
+        snprintf(sql, sizeof(sql),
+                 "INSERT INTO t VALUES (%d, 'row %d padded out to fill pages quickly')", i, i);
+        speedsql_exec(db, sql, nullptr, nullptr, nullptr);
+    }
+    speedsql_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+}
+
+TEST(online_rekey_reseals_pages) {
+    const char* path = "test_online_rekey.db";
+    remove(path);
+
+    speedsql_crypto_config_t old_config; memset(&old_config, 0, sizeof(old_config));
+    old_config.cipher = SPEEDSQL_CIPHER_AES_256_GCM;
+    old_config.kdf = SPEEDSQL_KDF_PBKDF2_SHA256;
+    old_config.kdf_iterations = 1000;
+    speedsql_crypto_config_t new_config = old_config;
+    new_config.salt[0] = 0x5A;
+
+    speedsql* db = nullptr;
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key_v2(db, "old-key", 7, &old_config), SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER, name TEXT)", nullptr, nullptr, nullptr);
+    fill_rows(db, 0, 1500);
+
+    /* CBC-HMAC has a 32-byte tag, so it cannot reseal GCM page slots in place */
+    speedsql_crypto_config_t cbc = new_config;
+    cbc.cipher = SPEEDSQL_CIPHER_AES_256_CBC;
+    ASSERT_EQ(speedsql_rekey_v2(db, "new-key", 7, &cbc), SPEEDSQL_MISUSE);
+
+    /* Small slow batches: the database is read under both keys meanwhile */
+    ASSERT_EQ(speedsql_rekey_throttle(db, 4, 1), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_rekey_v2(db, "new-key", 7, &new_config), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_rekey_v2(db, "other-key", 9, &new_config), SPEEDSQL_BUSY);
+    ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 1500);
+
+    ASSERT_EQ(speedsql_rekey_wait(db), SPEEDSQL_OK);
+    uint64_t resealed = 0, total = 0;
+    ASSERT_EQ(speedsql_rekey_status(db, &resealed, &total), SPEEDSQL_OK);
+    ASSERT_TRUE(total > 0);
+    ASSERT_EQ(resealed, total);
+    speedsql_close(db);
+
+    /* Every page now opens with the new key alone */
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key_v2(db, "new-key", 7, &new_config), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 1500);
+    speedsql_close(db);
+    remove(path);
+}
+
+TEST(online_rekey_password_reopens) {
+    const char* path = "test_online_rekey_password.db";
+    remove(path);
+    remove("test_online_rekey_password.db-wal");
+
+    speedsql* db = nullptr;
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key(db, "old-password", 12), SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER, name TEXT)", nullptr, nullptr, nullptr);
+    fill_rows(db, 0, 500);
+
+    /* The new salt goes into the header as the key switches */
+    ASSERT_EQ(speedsql_rekey(db, "new-password", 12), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_rekey_wait(db), SPEEDSQL_OK);
+    speedsql_close(db);
+
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key(db, "new-password", 12), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 500);
+    speedsql_close(db);
+
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key(db, "old-password", 12), SPEEDSQL_OK);
+    ASSERT_NE(count_query(db, "SELECT COUNT(*) FROM t"), 500);
+    speedsql_close(db);
+
+    remove(path);
+    remove("test_online_rekey_password.db-wal");
+}
+
+TEST(online_rekey_cipher_change_with_writes) {
+    const char* path = "test_online_rekey_cipher.db";
+    remove(path);
+
+    speedsql_crypto_config_t old_config; memset(&old_config, 0, sizeof(old_config));
+    old_config.cipher = SPEEDSQL_CIPHER_CHACHA20_POLY1305;
+    old_config.kdf = SPEEDSQL_KDF_PBKDF2_SHA256;
+    old_config.kdf_iterations = 1000;
+    old_config.aligned_pages = true;
+    speedsql_crypto_config_t new_config = old_config;
+    new_config.cipher = SPEEDSQL_CIPHER_AES_256_GCM;
+    new_config.aligned_pages = false;
+
+    speedsql* db = nullptr;
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key_v2(db, "chacha-key", 10, &old_config), SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER, name TEXT)", nullptr, nullptr, nullptr);
+    fill_rows(db, 0, 1000);
+
+    /* Writes keep landing while pages move from ChaCha20 to AES-GCM */
+    ASSERT_EQ(speedsql_rekey_throttle(db, 8, 1), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_rekey_v2(db, "gcm-key", 7, &new_config), SPEEDSQL_OK);
+    fill_rows(db, 1000, 500);
+    ASSERT_EQ(speedsql_rekey_wait(db), SPEEDSQL_OK);
+
+    speedsql_cipher_t cipher;
+    bool encrypted = false;
+    speedsql_crypto_status(db, &cipher, &encrypted);
+    ASSERT_EQ(cipher, SPEEDSQL_CIPHER_AES_256_GCM);
+    ASSERT_TRUE(encrypted);
+    speedsql_close(db);
+
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key_v2(db, "gcm-key", 7, &new_config), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 1500);
+    speedsql_close(db);
+    remove(path);
+}
+
+/* ============================================================================
+ * WAL Encryption Tests
+ * ============================================================================ */
+
+static speedsql_crypto_config_t wal_key_config(void) {
+    speedsql_crypto_config_t config; memset(&config, 0, sizeof(config));
+    config.cipher = SPEEDSQL_CIPHER_AES_256_GCM;
+    config.kdf = SPEEDSQL_KDF_NONE;
+    return config;
+}
+
+static const char* WAL_TEST_KEY = "0123456789abcdef0123456789abcdef";
+
+/* Whole file contents, or nullptr */
+static uint8_t* read_file(const char* path, long* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return nullptr;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* data = (uint8_t*)malloc(*size > 0 ? *size : 1);
+    if (data && fread(data, 1, *size, f) != (size_t)*size) {
+        free(data);
+        data = nullptr;
+    }
+    fclose(f);
+    return data;
+}
+
+static bool contains_bytes(const uint8_t* data, long size, const char* needle) {
+    size_t n = strlen(needle);
+    for (long i = 0; i + (long)n <= size; i++) {
+        if (memcmp(data + i, needle, n) == 0) return true;
+    }
+    return false;
+}
+
+TEST(wal_sealed_frames_ship_to_keyed_follower) {
+    const char* primary_path = "test_wal_sealed.db";
+    const char* wal_path = "test_wal_sealed.db-wal";
+    const char* follower_path = "test_wal_sealed_follower.db";
+    remove(primary_path);
+    remove(wal_path);
+    remove(follower_path);
+
+    speedsql_crypto_config_t config = wal_key_config();
+    speedsql* primary = nullptr;
+    ASSERT_EQ(speedsql_open_v2(primary_path, &primary,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE | SPEEDSQL_OPEN_WAL, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_key_v2(primary, WAL_TEST_KEY, 32, &config), SPEEDSQL_OK);
+    speedsql_exec(primary, "CREATE TABLE wal_secret_table (id INTEGER)", nullptr, nullptr, nullptr);
+    insert_rows(primary, "INSERT INTO wal_secret_table VALUES (7)", 200);
+
+    /* The schema page names the table; in the log it is sealed */
+    long size = 0;
+    uint8_t* log = read_file(wal_path, &size);
+    ASSERT_TRUE(log != nullptr);
+    ASSERT_TRUE(size > 64);
+    uint32_t version = 0;
+    memcpy(&version, log + 4, sizeof(version));
+    ASSERT_EQ(version, 2u);
+    ASSERT_FALSE(contains_bytes(log, size, "wal_secret_table"));
+    free(log);
+
+    /* A follower without the key cannot open the frames */
+    speedsql* follower = nullptr;
+    ASSERT_EQ(speedsql_follower_open(follower_path, &follower), SPEEDSQL_OK);
+    ASSERT_TRUE(speedsql_follower_apply(follower, wal_path) != SPEEDSQL_OK);
+    speedsql_close(follower);
+    remove(follower_path);
+
+    ASSERT_EQ(speedsql_follower_open(follower_path, &follower), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_key_v2(follower, WAL_TEST_KEY, 32, &config), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_follower_apply(follower, wal_path), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM wal_secret_table"), 200);
+
+    /* Tailing resumes at a frame boundary */
+    insert_rows(primary, "INSERT INTO wal_secret_table VALUES (8)", 50);
+    ASSERT_EQ(speedsql_follower_apply(follower, wal_path), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM wal_secret_table"), 250);
+
+    speedsql_close(follower);
+    speedsql_close(primary);
+    remove(primary_path);
+    remove(wal_path);
+    remove(follower_path);
+}
+
+TEST(wal_sealed_segment_rejects_tampering) {
+    const char* primary_path = "test_wal_tamper.db";
+    const char* segment_path = "test_wal_tamper_seg.wal";
+    const char* follower_path = "test_wal_tamper_follower.db";
+    remove(primary_path);
+    remove("test_wal_tamper.db-wal");
+    remove(segment_path);
+    remove(follower_path);
+
+    speedsql_crypto_config_t config = wal_key_config();
+    speedsql* primary = nullptr;
+    speedsql_open_v2(primary_path, &primary,
+        SPEEDSQL_OPEN_READWRITE | SPEEDSQL_OPEN_CREATE | SPEEDSQL_OPEN_WAL, nullptr);
+    ASSERT_EQ(speedsql_key_v2(primary, WAL_TEST_KEY, 32, &config), SPEEDSQL_OK);
+    speedsql_exec(primary, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    insert_rows(primary, "INSERT INTO t VALUES (1)", 100);
+
+    uint64_t next_lsn = 0;
+    ASSERT_EQ(speedsql_wal_export(primary, 0, segment_path, &next_lsn), SPEEDSQL_OK);
+    speedsql_close(primary);
+
+    /* Flip one ciphertext byte of the first frame */
+    long size = 0;
+    uint8_t* segment = read_file(segment_path, &size);
+    ASSERT_TRUE(segment != nullptr);
+    ASSERT_TRUE(size > 64 + 32 + 16);
+    segment[64 + 32 + 5] ^= 0x01;
+    FILE* f = fopen(segment_path, "wb");
+    fwrite(segment, 1, size, f);
+    fclose(f);
+
+    speedsql* follower = nullptr;
+    ASSERT_EQ(speedsql_follower_open(follower_path, &follower), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_key_v2(follower, WAL_TEST_KEY, 32, &config), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_follower_apply(follower, segment_path), SPEEDSQL_CORRUPT);
+
+    /* The intact segment applies */
+    segment[64 + 32 + 5] ^= 0x01;
+    f = fopen(segment_path, "wb");
+    fwrite(segment, 1, size, f);
+    fclose(f);
+    free(segment);
+    ASSERT_EQ(speedsql_follower_apply(follower, segment_path), SPEEDSQL_OK);
+    ASSERT_EQ(count_query(follower, "SELECT COUNT(*) FROM t"), 100);
+
+    speedsql_close(follower);
+    remove(primary_path);
+    remove("test_wal_tamper.db-wal");
+    remove(segment_path);
+    remove(follower_path);
+}
+
+/* ============================================================================
+ * Block Cipher Table Tests
+ * ============================================================================ */
+
+/* Key, IV and page contents the reference checksums were taken with */
+static void table_cipher_inputs(uint8_t key[32], uint8_t iv[16], uint8_t* page, size_t len) {
+    for (int i = 0; i < 32; i++) key[i] = (uint8_t)(i * 7 + 1);
+    for (int i = 0; i < 16; i++) iv[i] = (uint8_t)(0xA0 + i);
+    for (size_t i = 0; i < len; i++) page[i] = (uint8_t)(i * 31 + 5);
+}
+
+TEST(aria_ttables_match_bytewise_output) {
+    uint8_t key[32], iv[16], tag[32];
+    static uint8_t page[4112], ct[4112], back[4112];
+    table_cipher_inputs(key, iv, page, sizeof(page));
+
+    /* Checksums of the byte-wise implementation's output */
+    const speedsql_cipher_provider_t* gcm = speedsql_get_cipher(SPEEDSQL_CIPHER_ARIA_256_GCM);
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    ASSERT_EQ(gcm->init(&ctx, key, 32), SPEEDSQL_OK);
+    ASSERT_EQ(gcm->encrypt(ctx, page, 4099, iv, (const uint8_t*)"aad", 3, ct, tag), SPEEDSQL_OK);
+    ASSERT_EQ(crc32(ct, 4099), 0xcd5e1b3eu);
+    ASSERT_EQ(crc32(tag, 16), 0x08c82353u);
+    gcm->destroy(ctx);
+
+    const speedsql_cipher_provider_t* cbc = speedsql_get_cipher(SPEEDSQL_CIPHER_ARIA_256_CBC);
+    ASSERT_EQ(cbc->init(&ctx, key, 32), SPEEDSQL_OK);
+    ASSERT_EQ(cbc->encrypt(ctx, page, 4096, iv, nullptr, 0, ct, tag), SPEEDSQL_OK);
+    ASSERT_EQ(crc32(ct, 4112), 0x63a79310u);
+
+    /* 257 blocks leave a one-block batch; decrypting in place must chain too */
+    ASSERT_EQ(cbc->decrypt(ctx, ct, 4112, iv, nullptr, 0, tag, back), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(back, page, 4096), 0);
+    ASSERT_EQ(cbc->decrypt(ctx, ct, 4112, iv, nullptr, 0, tag, ct), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(ct, page, 4096), 0);
+    cbc->destroy(ctx);
+}
+
+TEST(seed_cbc_round_trip) {
+    uint8_t key[32], iv[16];
+    static uint8_t page[4096], ct[4096], back[4096];
+    table_cipher_inputs(key, iv, page, sizeof(page));
+
+    const speedsql_cipher_provider_t* p = speedsql_get_cipher(SPEEDSQL_CIPHER_SEED_CBC);
+    ASSERT_EQ(p->self_test(), SPEEDSQL_OK);
+
+    speedsql_cipher_ctx_t* ctx = nullptr;
+    ASSERT_EQ(p->init(&ctx, key, 16), SPEEDSQL_OK);
+    ASSERT_EQ(p->encrypt(ctx, page, sizeof(page), iv, nullptr, 0, ct, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(crc32(ct, sizeof(ct)), 0x639e6f37u);
+
+    ASSERT_EQ(p->decrypt(ctx, ct, sizeof(ct), iv, nullptr, 0, nullptr, back), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(back, page, sizeof(page)), 0);
+
+    /* A partial batch, decrypted in place */
+    ASSERT_EQ(p->decrypt(ctx, ct, 80, iv, nullptr, 0, nullptr, ct), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(ct, page, 80), 0);
+    ASSERT_EQ(p->decrypt(ctx, ct, 17, iv, nullptr, 0, nullptr, back), SPEEDSQL_CORRUPT);
+    p->destroy(ctx);
+}
+
+/* ============================================================================
+ * Key Derivation Tests
+ * ============================================================================ */
+
+static const uint8_t PBKDF2_4096[32] = {
+    0xc5, 0xe4, 0x78, 0xd5, 0x92, 0x88, 0xc8, 0x41, 0xaa, 0x53, 0x0d, 0xb6, 0x84, 0x5c, 0x4c, 0x8d,
+    0x96, 0x28, 0x93, 0xa0, 0x01, 0xce, 0x4e, 0x11, 0xa4, 0x96, 0x38, 0x73, 0xaa, 0x98, 0x13, 0x4a
+};
+
+TEST(pbkdf2_sha256_both_paths) {
+    const uint8_t abc[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+    /* 40 bytes: the second block and a partial copy */
+    const uint8_t long_out[40] = {
+        0x34, 0x8c, 0x89, 0xdb, 0xcb, 0xd3, 0x2b, 0x2f, 0x32, 0xd8, 0x14, 0xb8, 0x11, 0x6e, 0x84, 0xcf,
+        0x2b, 0x17, 0x34, 0x7e, 0xbc, 0x18, 0x00, 0x18, 0x1c, 0x4e, 0x2a, 0x1f, 0xb8, 0xdd, 0x53, 0xe1,
+        0xc6, 0x35, 0x51, 0x8c, 0x7d, 0xac, 0x47, 0xe9
+    };
+
+    /* SHA extensions where present, then the portable rounds */
+    const uint32_t masks[2] = {0xFFFFFFFFu, 0};
+    for (int m = 0; m < 2; m++) {
+        cpu_features_mask(masks[m]);
+        uint8_t out[40];
+
+        sha256("abc", 3, out);
+        ASSERT_EQ(memcmp(out, abc, 32), 0);
+
+        ASSERT_EQ(speedsql_derive_key("password", 8, (const uint8_t*)"salt", 4,
+                                      SPEEDSQL_KDF_PBKDF2_SHA256, 4096, out, 32), SPEEDSQL_OK);
+        ASSERT_EQ(memcmp(out, PBKDF2_4096, 32), 0);
+
+        pbkdf2_hmac_sha256((const uint8_t*)"passwordPASSWORDpassword", 24,
+                           (const uint8_t*)"saltSALTsaltSALTsaltSALTsaltSALTsalt", 36,
+                           4096, out, sizeof(out));
+        ASSERT_EQ(memcmp(out, long_out, sizeof(out)), 0);
+    }
+    cpu_features_mask(0xFFFFFFFFu);
+}
+
+TEST(pbkdf2_sha512_vectors) {
+    const uint8_t abc[64] = {
+        0xdd, 0xaf, 0x35, 0xa1, 0x93, 0x61, 0x7a, 0xba, 0xcc, 0x41, 0x73, 0x49, 0xae, 0x20, 0x41, 0x31,
+        0x12, 0xe6, 0xfa, 0x4e, 0x89, 0xa9, 0x7e, 0xa2, 0x0a, 0x9e, 0xee, 0xe6, 0x4b, 0x55, 0xd3, 0x9a,
+        0x21, 0x92, 0x99, 0x2a, 0x27, 0x4f, 0xc1, 0xa8, 0x36, 0xba, 0x3c, 0x23, 0xa3, 0xfe, 0xeb, 0xbd,
+        0x45, 0x4d, 0x44, 0x23, 0x64, 0x3c, 0xe8, 0x0e, 0x2a, 0x9a, 0xc9, 0x4f, 0xa5, 0x4c, 0xa4, 0x9f
+    };
+    const uint8_t pbkdf2_4096[64] = {
+        0xd1, 0x97, 0xb1, 0xb3, 0x3d, 0xb0, 0x14, 0x3e, 0x01, 0x8b, 0x12, 0xf3, 0xd1, 0xd1, 0x47, 0x9e,
+        0x6c, 0xde, 0xbd, 0xcc, 0x97, 0xc5, 0xc0, 0xf8, 0x7f, 0x69, 0x02, 0xe0, 0x72, 0xf4, 0x57, 0xb5,
+        0x14, 0x3f, 0x30, 0x60, 0x26, 0x41, 0xb3, 0xd5, 0x5c, 0xd3, 0x35, 0x98, 0x8c, 0xb3, 0x6b, 0x84,
+        0x37, 0x60, 0x60, 0xec, 0xd5, 0x32, 0xe0, 0x39, 0xb7, 0x42, 0xa2, 0x39, 0x43, 0x4a, 0xf2, 0xd5
+    };
+    /* 80 bytes: the second block and a partial copy */
+    const uint8_t long_out[80] = {
+        0x8c, 0x05, 0x11, 0xf4, 0xc6, 0xe5, 0x97, 0xc6, 0xac, 0x63, 0x15, 0xd8, 0xf0, 0x36, 0x2e, 0x22,
+        0x5f, 0x3c, 0x50, 0x14, 0x95, 0xba, 0x23, 0xb8, 0x68, 0xc0, 0x05, 0x17, 0x4d, 0xc4, 0xee, 0x71,
+        0x11, 0x5b, 0x59, 0xf9, 0xe6, 0x0c, 0xd9, 0x53, 0x2f, 0xa3, 0x3e, 0x0f, 0x75, 0xae, 0xfe, 0x30,
+        0x22, 0x5c, 0x58, 0x3a, 0x18, 0x6c, 0xd8, 0x2b, 0xd4, 0xda, 0xea, 0x97, 0x24, 0xa3, 0xd3, 0xb8,
+        0x04, 0xf7, 0x5b, 0xdd, 0x41, 0x49, 0x4f, 0xa3, 0x24, 0xca, 0xb2, 0x4b, 0xcc, 0x68, 0x0f, 0xb3
+    };
+    uint8_t out[80];
+
+    sha512("abc", 3, out);
+    ASSERT_EQ(memcmp(out, abc, 64), 0);
+
+    ASSERT_EQ(speedsql_derive_key("password", 8, (const uint8_t*)"salt", 4,
+                                  SPEEDSQL_KDF_PBKDF2_SHA512, 4096, out, 64), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(out, pbkdf2_4096, 64), 0);
+
+    pbkdf2_hmac_sha512((const uint8_t*)"passwordPASSWORDpassword", 24,
+                       (const uint8_t*)"saltSALTsaltSALTsaltSALTsaltSALTsalt", 36,
+                       4096, out, sizeof(out));
+    ASSERT_EQ(memcmp(out, long_out, sizeof(out)), 0);
+}
+
+TEST(argon2id_lanes_on_threads) {
+    /* RFC 9106 section 5.3: four lanes, secret and associated data */
+    const uint8_t expected[32] = {
+        0x0d, 0x64, 0x0d, 0xf5, 0x8d, 0x78, 0x76, 0x6c, 0x08, 0xc0, 0x37, 0xa3, 0x4a, 0x8b, 0x53, 0xc9,
+        0xd0, 0x1e, 0xf0, 0x45, 0x2d, 0x75, 0xb6, 0x5e, 0xb5, 0x25, 0x20, 0xe9, 0x6b, 0x01, 0xe6, 0x59
+    };
+    uint8_t password[32], salt[16], secret[8], ad[12], tag[32];
+    memset(password, 0x01, sizeof(password));
+    memset(salt, 0x02, sizeof(salt));
+    memset(secret, 0x03, sizeof(secret));
+    memset(ad, 0x04, sizeof(ad));
+
+    argon2_params_t params;
+    memset(&params, 0, sizeof(params));
+    params.passes = 3;
+    params.memory_kb = 32;
+    params.lanes = 4;
+    params.secret = secret;
+    params.secret_len = sizeof(secret);
+    params.ad = ad;
+    params.ad_len = sizeof(ad);
+    ASSERT_EQ(argon2id_hash(password, sizeof(password), salt, sizeof(salt), &params,
+                            tag, sizeof(tag)), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(tag, expected, sizeof(tag)), 0);
+
+    /* Through the configuration: parallelism is part of the result */
+    speedsql_crypto_config_t config; memset(&config, 0, sizeof(config));
+    config.kdf = SPEEDSQL_KDF_ARGON2ID;
+    config.kdf_iterations = 1;
+    config.kdf_memory = 256;
+    config.kdf_parallelism = 4;
+    memset(config.salt, 0x5a, sizeof(config.salt));
+
+    uint8_t four[32], again[32], one[32];
+    ASSERT_EQ(speedsql_derive_key_v2("pw", 2, &config, four, 32), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_derive_key_v2("pw", 2, &config, again, 32), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(four, again, 32), 0);
+    config.kdf_parallelism = 1;
+    ASSERT_EQ(speedsql_derive_key_v2("pw", 2, &config, one, 32), SPEEDSQL_OK);
+    ASSERT_NE(memcmp(four, one, 32), 0);
+
+    params.lanes = 0;
+    ASSERT_EQ(argon2id_hash(password, sizeof(password), salt, sizeof(salt), &params,
+                            tag, sizeof(tag)), SPEEDSQL_MISUSE);
+}
+
+TEST(kdf_cache_reuses_derived_keys) {
+    const char* path = "test_kdf_cache.db";
+    remove(path);
+
+    speedsql_crypto_config_t config; memset(&config, 0, sizeof(config));
+    config.cipher = SPEEDSQL_CIPHER_AES_256_GCM;
+    config.kdf = SPEEDSQL_KDF_PBKDF2_SHA256;
+    config.kdf_iterations = 4096;
+    memcpy(config.salt, "salt", 4);
+
+    ASSERT_EQ(speedsql_kdf_cache(8), SPEEDSQL_OK);
+
+    /* A pool reopening the same file derives its key once */
+    for (int i = 0; i < 3; i++) {
+        speedsql* db = nullptr;
+        ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+        ASSERT_EQ(speedsql_key_v2(db, "pool-key", 8, &config), SPEEDSQL_OK);
+        if (i == 0) {
+            speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+            speedsql_exec(db, "INSERT INTO t VALUES (1)", nullptr, nullptr, nullptr);
+        }
+        ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 1);
+        speedsql_close(db);
+    }
+
+    uint64_t hits = 0, misses = 0;
+    speedsql_kdf_cache_stats(&hits, &misses);
+    ASSERT_EQ(hits, 2u);
+    ASSERT_EQ(misses, 1u);
+
+    /* Another password or salt is not a hit; a hit matches the KDF */
+    uint8_t key[32];
+    ASSERT_EQ(speedsql_derive_key_v2("other-key", 9, &config, key, 32), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_derive_key("password", 8, (const uint8_t*)"salt", 4,
+                                  SPEEDSQL_KDF_PBKDF2_SHA256, 4096, key, 32), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_derive_key("password", 8, (const uint8_t*)"salt", 4,
+                                  SPEEDSQL_KDF_PBKDF2_SHA256, 4096, key, 32), SPEEDSQL_OK);
+    ASSERT_EQ(memcmp(key, PBKDF2_4096, 32), 0);
+    speedsql_kdf_cache_stats(&hits, &misses);
+    ASSERT_EQ(hits, 3u);
+    ASSERT_EQ(misses, 3u);
+
+    /* Disabling wipes it */
+    ASSERT_EQ(speedsql_kdf_cache(0), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_derive_key_v2("pool-key", 8, &config, key, 32), SPEEDSQL_OK);
+    speedsql_kdf_cache_stats(&hits, &misses);
+    ASSERT_EQ(hits, 0u);
+    ASSERT_EQ(misses, 0u);
+    ASSERT_EQ(speedsql_kdf_cache(100000), SPEEDSQL_MISUSE);
+
+    remove(path);
+    remove("test_kdf_cache.db-wal");
+}
+
+TEST(key_salt_kept_in_header) {
+    const char* path = "test_key_salt.db";
+    remove(path);
+    remove("test_key_salt.db-wal");
+
+    ASSERT_EQ(speedsql_kdf_cache(8), SPEEDSQL_OK);
+
+    /* The first key picks a salt at random */
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_key(db, "hunter2", 7), SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    speedsql_exec(db, "INSERT INTO t VALUES (1), (2)", nullptr, nullptr, nullptr);
+    speedsql_close(db);
+
+    /* Later opens read it back, so the password gives the same key */
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+        ASSERT_EQ(speedsql_key(db, "hunter2", 7), SPEEDSQL_OK);
+        ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 2);
+        speedsql_close(db);
+    }
+
+    uint64_t hits = 0, misses = 0;
+    speedsql_kdf_cache_stats(&hits, &misses);
+    ASSERT_EQ(hits, 2u);
+    ASSERT_EQ(misses, 1u);
+    ASSERT_EQ(speedsql_kdf_cache(0), SPEEDSQL_OK);
+
+    /* Another password still reads nothing */
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_key(db, "hunter3", 7), SPEEDSQL_OK);
+    ASSERT_NE(count_query(db, "SELECT COUNT(*) FROM t"), 2);
+    speedsql_close(db);
+
+    remove(path);
+    remove("test_key_salt.db-wal");
+}
+
+/* ============================================================================
+ * Crypto Benchmark Tests
+ * ============================================================================ */
+
+/* Stand-in custom AEAD: XOR with a key byte, tag of the ciphertext sum */
+static uint8_t g_xor_key;
+static int g_xor_self_test_rc = SPEEDSQL_OK;
+
+static int xor_init(speedsql_cipher_ctx_t** ctx, const uint8_t* key, size_t key_len) {
+    if (key_len != 32) return SPEEDSQL_MISUSE;
+    g_xor_key = key[0] | 1;
+    *ctx = (speedsql_cipher_ctx_t*)&g_xor_key;
+    return SPEEDSQL_OK;
+}
+
+static void xor_destroy(speedsql_cipher_ctx_t* ctx) {
+    (void)ctx;
+}
+
+static void xor_tag(const uint8_t* ct, size_t len, uint8_t* tag) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < len; i++) sum += ct[i];
+    memset(tag, 0, 16);
+    memcpy(tag, &sum, sizeof(sum));
+}
+
+static int xor_encrypt(speedsql_cipher_ctx_t* ctx, const uint8_t* pt, size_t len,
+                       const uint8_t* iv, const uint8_t* aad, size_t aad_len,
+                       uint8_t* ct, uint8_t* tag) {
+    (void)iv; (void)aad; (void)aad_len;
+    uint8_t k = *(const uint8_t*)ctx;
+    for (size_t i = 0; i < len; i++) ct[i] = pt[i] ^ k;
+    xor_tag(ct, len, tag);
+    return SPEEDSQL_OK;
+}
+
+static int xor_decrypt(speedsql_cipher_ctx_t* ctx, const uint8_t* ct, size_t len,
+                       const uint8_t* iv, const uint8_t* aad, size_t aad_len,
+                       const uint8_t* tag, uint8_t* pt) {
+    (void)iv; (void)aad; (void)aad_len;
+    uint8_t expected[16];
+    xor_tag(ct, len, expected);
+    if (memcmp(expected, tag, 16) != 0) return SPEEDSQL_CORRUPT;
+    uint8_t k = *(const uint8_t*)ctx;
+    for (size_t i = 0; i < len; i++) pt[i] = ct[i] ^ k;
+    return SPEEDSQL_OK;
+}
+
+static int xor_self_test(void) {
+    return g_xor_self_test_rc;
+}
+
+static speedsql_cipher_provider_t xor_provider(void) {
+    speedsql_cipher_provider_t p; memset(&p, 0, sizeof(p));
+    p.name = "XOR-TEST";
+    p.version = "1.0.0";
+    p.cipher_id = SPEEDSQL_CIPHER_CUSTOM;
+    p.key_size = 32;
+    p.iv_size = 12;
+    p.tag_size = 16;
+    p.block_size = 1;
+    p.init = xor_init;
+    p.destroy = xor_destroy;
+    p.encrypt = xor_encrypt;
+    p.decrypt = xor_decrypt;
+    p.self_test = xor_self_test;
+    return p;
+}
+
+TEST(crypto_benchmark_covers_custom_providers) {
+    static const speedsql_cipher_provider_t provider = xor_provider();
+    ASSERT_EQ(speedsql_register_cipher(&provider), SPEEDSQL_OK);
+
+    speedsql_crypto_bench_t results[16];
+    int count = 16;
+    ASSERT_EQ(speedsql_crypto_benchmark(4096, 2, 5, results, &count), SPEEDSQL_OK);
+
+    /* Built-ins (padded CBC included) and the custom provider, none skipped */
+    bool saw_gcm = false, saw_cbc = false, saw_custom = false;
+    for (int i = 0; i < count; i++) {
+        ASSERT_TRUE(results[i].seal_mbps > 0);
+        ASSERT_TRUE(results[i].open_mbps > 0);
+        ASSERT_EQ(results[i].threads, 2u);
+        ASSERT_EQ(results[i].page_size, 4096u);
+        if (results[i].cipher == SPEEDSQL_CIPHER_AES_256_GCM) saw_gcm = true;
+        if (results[i].cipher == SPEEDSQL_CIPHER_AES_256_CBC) saw_cbc = true;
+        if (results[i].cipher == SPEEDSQL_CIPHER_CUSTOM) {
+            saw_custom = true;
+            ASSERT_EQ(strcmp(results[i].name, "XOR-TEST"), 0);
+        }
+    }
+    ASSERT_TRUE(saw_gcm);
+    ASSERT_TRUE(saw_cbc);
+    ASSERT_TRUE(saw_custom);
+    ASSERT_EQ(count, 7);
+
+    /* Capacity is respected */
+    count = 2;
+    ASSERT_EQ(speedsql_crypto_benchmark(65536, 1, 2, results, &count), SPEEDSQL_OK);
+    ASSERT_EQ(count, 2);
+    ASSERT_EQ(speedsql_crypto_benchmark(0, 1, 2, results, &count), SPEEDSQL_MISUSE);
+
+    speedsql_unregister_cipher(SPEEDSQL_CIPHER_CUSTOM);
+}
+
+TEST(crypto_fastest_picks_compliant_aead) {
+    /* A custom AEAD far faster than the rest, but failing its self-test */
+    static const speedsql_cipher_provider_t provider = xor_provider();
+    g_xor_self_test_rc = SPEEDSQL_ERROR;
+    ASSERT_EQ(speedsql_register_cipher(&provider), SPEEDSQL_OK);
+
+    speedsql_cipher_t fastest = SPEEDSQL_CIPHER_NONE;
+    ASSERT_EQ(speedsql_crypto_fastest(4096, &fastest), SPEEDSQL_OK);
+    ASSERT_NE(fastest, SPEEDSQL_CIPHER_CUSTOM);
+    ASSERT_TRUE(wal_can_seal(fastest));
+
+    /* The choice works for a new database */
+    const char* path = "test_fastest_cipher.db";
+    remove(path);
+    speedsql_crypto_config_t config; memset(&config, 0, sizeof(config));
+    config.cipher = fastest;
+    config.kdf = SPEEDSQL_KDF_NONE;
+    config.aligned_pages = true;
+
+    speedsql* db = nullptr;
+    speedsql_open(path, &db);
+    ASSERT_EQ(speedsql_key_v2(db, WAL_TEST_KEY, 32, &config), SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (id INTEGER)", nullptr, nullptr, nullptr);
+    insert_rows(db, "INSERT INTO t VALUES (1)", 50);
+    ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM t"), 50);
+    speedsql_close(db);
+
+    speedsql_unregister_cipher(SPEEDSQL_CIPHER_CUSTOM);
+    g_xor_self_test_rc = SPEEDSQL_OK;
+    ASSERT_EQ(speedsql_crypto_fastest(4096, nullptr), SPEEDSQL_MISUSE);
+    remove(path);
+}
+
+/* ============================================================================
+ * Vector Index Tests
+ * ============================================================================ */
+
+#define VEC_DIMS 16
+#define VEC_COUNT 500
+
+static float vec_random(uint64_t* state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (float)((*state >> 40) & 0xFFFF) / 65536.0f;
+}
+
+/* Rowids (1-based) of the k nearest of count vectors, by brute force */
+static void vec_brute_force(const float* vecs, int count, const float* q, int k, int64_t* out) {
+    float best[16];
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        float d = vector_l2_sq(&vecs[i * VEC_DIMS], q, VEC_DIMS);
+        int pos = n < k ? n++ : k;
+        while (pos > 0 && best[pos - 1] > d) {
+            if (pos < k) {
+                best[pos] = best[pos - 1];
+                out[pos] = out[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < k) {
+            best[pos] = d;
+            out[pos] = i + 1;
+        }
+    }
+}
+
+TEST(hnsw_recall_against_brute_force) {
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(":memory:", &db), SPEEDSQL_OK);
+
+    page_id_t meta = INVALID_PAGE_ID;
+    hnsw_t* h = nullptr;
+    ASSERT_EQ(hnsw_create(db->buffer_pool, &db->db_file, 12, 100, 64, &meta), SPEEDSQL_OK);
+    ASSERT_EQ(hnsw_open(&h, db->buffer_pool, &db->db_file, meta), SPEEDSQL_OK);
+
+    static float vecs[VEC_COUNT * VEC_DIMS];
+    uint64_t seed = 42;
+    for (int i = 0; i < VEC_COUNT * VEC_DIMS; i++) vecs[i] = vec_random(&seed);
+    for (int i = 0; i < VEC_COUNT; i++) {
+        ASSERT_EQ(hnsw_insert(h, i + 1, &vecs[i * VEC_DIMS], VEC_DIMS), SPEEDSQL_OK);
+    }
+    ASSERT_EQ(hnsw_count(h), (uint64_t)VEC_COUNT);
+    ASSERT_EQ(hnsw_insert(h, 9999, vecs, VEC_DIMS - 1), SPEEDSQL_MISMATCH);
+
+    /* Top-10 recall over 20 queries */
+    int hits = 0;
+    float q[VEC_DIMS];
+    int64_t expect[10], got[10];
+    float dist[10];
+    uint32_t found = 0;
+    for (int t = 0; t < 20; t++) {
+        for (int d = 0; d < VEC_DIMS; d++) q[d] = vec_random(&seed);
+        vec_brute_force(vecs, VEC_COUNT, q, 10, expect);
+        ASSERT_EQ(hnsw_search(h, q, VEC_DIMS, 10, 0, got, dist, &found), SPEEDSQL_OK);
+        ASSERT_EQ(found, 10u);
+        for (int i = 1; i < 10; i++) ASSERT_TRUE(dist[i - 1] <= dist[i]);
+        for (int i = 0; i < 10; i++) {
+            for (int j = 0; j < 10; j++) {
+                if (got[i] == expect[j]) hits++;
+            }
+        }
+    }
+    ASSERT_TRUE(hits >= 180);
+
+    /* A deleted row no longer comes back, even as its own nearest */
+    ASSERT_EQ(hnsw_delete(h, 7), SPEEDSQL_OK);
+    ASSERT_EQ(hnsw_delete(h, 7), SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(hnsw_count(h), (uint64_t)VEC_COUNT - 1);
+    ASSERT_EQ(hnsw_search(h, &vecs[6 * VEC_DIMS], VEC_DIMS, 5, 0, got, dist, &found), SPEEDSQL_OK);
+    ASSERT_EQ(found, 5u);
+    for (uint32_t i = 0; i < found; i++) ASSERT_NE(got[i], 7);
+
+    /* Re-inserting a rowid moves it */
+    ASSERT_EQ(hnsw_insert(h, 7, &vecs[8 * VEC_DIMS], VEC_DIMS), SPEEDSQL_OK);
+    ASSERT_EQ(hnsw_search(h, &vecs[8 * VEC_DIMS], VEC_DIMS, 2, 0, got, dist, &found), SPEEDSQL_OK);
+    ASSERT_EQ(found, 2u);
+    ASSERT_TRUE((got[0] == 7 && got[1] == 9) || (got[0] == 9 && got[1] == 7));
+
+    hnsw_close(h);
+    speedsql_close(db);
+}
+
+/* Points on a line: row id i sits at (i, 0, 0, 0) */
+static int vec_insert_points(speedsql* db, int from, int to) {
+    speedsql_stmt* stmt = nullptr;
+    int rc = speedsql_prepare(db, "INSERT INTO docs VALUES (?, ?)", -1, &stmt, nullptr);
+    for (int i = from; i <= to && rc == SPEEDSQL_OK; i++) {
+        float v[4] = {(float)i, 0, 0, 0};
+        speedsql_reset(stmt);
+        speedsql_bind_int(stmt, 1, i);
+        speedsql_bind_vector(stmt, 2, v, 4);
+        rc = speedsql_step(stmt) == SPEEDSQL_DONE ? SPEEDSQL_OK : SPEEDSQL_ERROR;
+    }
+    speedsql_finalize(stmt);
+    return rc;
+}
+
+/* ids of the nearest rows to x, through ORDER BY vec_distance LIMIT k */
+static int vec_nearest_ids(speedsql* db, float x, int k, int* ids, double* dists) {
+    char sql[160];
+    snprintf(sql, sizeof(sql),
+             "SELECT id, vec_distance(embedding, ?) FROM docs "
+             "ORDER BY vec_distance(embedding, ?) LIMIT %d", k);
+    speedsql_stmt* stmt = nullptr;
+    if (speedsql_prepare(db, sql, -1, &stmt, nullptr) != SPEEDSQL_OK) return -1;
+
+    float q[4] = {x, 0, 0, 0};
+    speedsql_bind_vector(stmt, 1, q, 4);
+    speedsql_bind_vector(stmt, 2, q, 4);
+    int n = 0;
+    while (speedsql_step(stmt) == SPEEDSQL_ROW) {
+        ids[n] = speedsql_column_int(stmt, 0);
+        dists[n++] = speedsql_column_double(stmt, 1);
+    }
+    speedsql_finalize(stmt);
+    return n;
+}
+
+TEST(hnsw_sql_order_by_vec_distance) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE docs (id INTEGER, embedding VECTOR)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    /* Rows before the index are indexed by CREATE INDEX, later ones on insert */
+    ASSERT_EQ(vec_insert_points(db, 1, 100), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX docs_vec ON docs USING HNSW (embedding) "
+                                "WITH (m = 8, ef_construction = 64, ef_search = 32)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(vec_insert_points(db, 101, 200), SPEEDSQL_OK);
+
+    int ids[8];
+    double dists[8];
+    ASSERT_EQ(vec_nearest_ids(db, 150.2f, 5, ids, dists), 5);
+    int expect[5] = {150, 151, 149, 152, 148};
+    for (int i = 0; i < 5; i++) ASSERT_EQ(ids[i], expect[i]);
+    ASSERT_TRUE(dists[0] > 0.19 && dists[0] < 0.21);
+
+    ASSERT_EQ(vec_nearest_ids(db, 3.0f, 3, ids, dists), 3);
+    ASSERT_EQ(ids[0], 3);
+
+    /* Deleted rows drop out of the index */
+    ASSERT_EQ(speedsql_exec(db, "DELETE FROM docs WHERE id = 150", nullptr, nullptr, nullptr),
+              SPEEDSQL_OK);
+    ASSERT_EQ(vec_nearest_ids(db, 150.2f, 2, ids, dists), 2);
+    ASSERT_EQ(ids[0], 151);
+    ASSERT_EQ(ids[1], 149);
+
+    /* The C API returns (rowid, distance) nearest first */
+    float q[4] = {42.0f, 0, 0, 0};
+    speedsql_stmt* result = nullptr;
+    ASSERT_EQ(speedsql_vector_search(db, "docs", "embedding", q, 4, 3, &result), SPEEDSQL_OK);
+    ASSERT_STR_EQ(speedsql_column_name(result, 1), "distance");
+    int rows = 0;
+    double last = -1;
+    while (speedsql_step(result) == SPEEDSQL_ROW) {
+        ASSERT_TRUE(speedsql_column_double(result, 1) >= last);
+        last = speedsql_column_double(result, 1);
+        if (rows == 0) ASSERT_EQ(speedsql_column_int64(result, 0), 42);
+        rows++;
+    }
+    ASSERT_EQ(rows, 3);
+    speedsql_finalize(result);
+
+    ASSERT_EQ(speedsql_vector_search(db, "docs", "id", q, 4, 3, &result), SPEEDSQL_MISMATCH);
+    ASSERT_EQ(result, nullptr);
+    ASSERT_EQ(speedsql_vector_search(db, "docs", "embedding", q, 3, 3, &result),
+              SPEEDSQL_MISMATCH);
+
+    speedsql_close(db);
+}
+
+/* ============================================================================
+ * Vector Distance Tests
+ * ============================================================================ */
+
+static bool vec_close(float a, float b) {
+    float diff = a > b ? a - b : b - a;
+    float scale = (a < 0 ? -a : a) + 1.0f;
+    return diff <= 1e-4f * scale;
+}
+
+TEST(vector_kernels_match_portable) {
+    static const vector_metric_t metrics[3] = {VECTOR_L2, VECTOR_DOT, VECTOR_COSINE};
+    float a[67], b[67], base[9 * 67], out[9];
+    uint64_t seed = 7;
+    for (int i = 0; i < 67; i++) {
+        a[i] = vec_random(&seed) - 0.5f;
+        b[i] = vec_random(&seed) - 0.5f;
+    }
+    for (int i = 0; i < 9 * 67; i++) base[i] = vec_random(&seed) - 0.5f;
+
+    /* Every length up to a few registers, so each tail path runs */
+    for (uint32_t n = 1; n <= 67; n++) {
+        for (int m = 0; m < 3; m++) {
+            cpu_features_mask(0);
+            float expect = vector_distance(metrics[m], a, b, n);
+            cpu_features_mask(0xFFFFFFFFu);
+            ASSERT_TRUE(vec_close(vector_distance(metrics[m], a, b, n), expect));
+        }
+    }
+
+    /* One query against many matches one at a time, for every batch remainder */
+    for (size_t count = 1; count <= 9; count++) {
+        for (int m = 0; m < 3; m++) {
+            vector_distances(metrics[m], a, base, 67, count, out);
+            for (size_t i = 0; i < count; i++) {
+                ASSERT_TRUE(vec_close(out[i], vector_distance(metrics[m], a, base + i * 67, 67)));
+            }
+        }
+    }
+
+    float zero[4] = {0, 0, 0, 0};
+    ASSERT_TRUE(vec_close(vector_cosine_distance(a, zero, 4), 1.0f));
+    ASSERT_TRUE(vec_close(vector_cosine_distance(a, a, 67), 0.0f));
+}
+
+TEST(vector_sql_functions_and_exact_search) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE docs (id INTEGER, embedding VECTOR)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(vec_insert_points(db, 1, 40), SPEEDSQL_OK);
+
+    speedsql_stmt* stmt = nullptr;
+    ASSERT_EQ(speedsql_prepare(db, "SELECT vec_l2(embedding, ?), vec_dot(embedding, ?), "
+                                   "vec_cosine(embedding, ?), vec_l2(embedding, id) "
+                                   "FROM docs WHERE id = 3", -1, &stmt, nullptr), SPEEDSQL_OK);
+    float q[4] = {0, 4, 0, 0};
+    for (int i = 1; i <= 3; i++) speedsql_bind_vector(stmt, i, q, 4);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_TRUE(vec_close((float)speedsql_column_double(stmt, 0), 5.0f));
+    ASSERT_TRUE(vec_close((float)speedsql_column_double(stmt, 1), 0.0f));
+    ASSERT_TRUE(vec_close((float)speedsql_column_double(stmt, 2), 1.0f));
+    ASSERT_EQ(speedsql_column_type(stmt, 3), SPEEDSQL_TYPE_NULL);
+    speedsql_finalize(stmt);
+
+    /* No index on the column: speedsql_vector_search scans it exactly */
+    float near[4] = {17.4f, 0, 0, 0};
+    speedsql_stmt* result = nullptr;
+    ASSERT_EQ(speedsql_vector_search(db, "docs", "embedding", near, 4, 3, &result), SPEEDSQL_OK);
+    int64_t expect[3] = {17, 18, 16};
+    int rows = 0;
+    while (speedsql_step(result) == SPEEDSQL_ROW) {
+        ASSERT_EQ(speedsql_column_int64(result, 0), expect[rows]);
+        rows++;
+    }
+    ASSERT_EQ(rows, 3);
+    speedsql_finalize(result);
+
+    ASSERT_EQ(speedsql_vector_search(db, "docs", "embedding", near, 3, 3, &result),
+              SPEEDSQL_MISMATCH);
+    ASSERT_EQ(speedsql_vector_search(db, "docs", "missing", near, 4, 3, &result),
+              SPEEDSQL_NOTFOUND);
+
+    speedsql_close(db);
+}
+
+/* ============================================================================
+ * Vector Quantization Tests
+ * ============================================================================ */
+
+TEST(vector_quantization_codecs) {
+    static float vecs[VEC_COUNT * VEC_DIMS];
+    uint64_t seed = 11;
+    for (int i = 0; i < VEC_COUNT * VEC_DIMS; i++) vecs[i] = vec_random(&seed) - 0.5f;
+
+    /* SQ8: within half a step per dimension, and the asymmetric distance
+     * agrees with decoding first on every path */
+    float q[67], v[67], back[67];
+    uint8_t code[vector_sq8_size(67)];
+    for (int i = 0; i < 67; i++) {
+        q[i] = vec_random(&seed);
+        v[i] = vec_random(&seed) * 4.0f - 2.0f;
+    }
+    vector_sq8_encode(v, 67, code);
+    vector_sq8_decode(code, 67, back);
+    for (int i = 0; i < 67; i++) ASSERT_TRUE(fabsf(back[i] - v[i]) <= 4.0f / 255.0f);
+    for (uint32_t n = 1; n <= 67; n += 11) {
+        vector_sq8_encode(v, n, code);
+        vector_sq8_decode(code, n, back);
+        float expect = vector_l2_sq(q, back, n);
+        cpu_features_mask(0);
+        ASSERT_TRUE(vec_close(vector_sq8_l2_sq(q, code, n), expect));
+        cpu_features_mask(0xFFFFFFFFu);
+        ASSERT_TRUE(vec_close(vector_sq8_l2_sq(q, code, n), expect));
+    }
+
+    /* PQ: table lookups equal the distance to the decoded vector, with
+     * 16 subspaces for the gathers and 8 for the scalar tail */
+    static const uint32_t subspaces[2] = {16, 8};
+    for (int t = 0; t < 2; t++) {
+        vector_pq_t pq;
+        ASSERT_EQ(vector_pq_train(&pq, vecs, VEC_COUNT, VEC_DIMS, subspaces[t]), SPEEDSQL_OK);
+        ASSERT_EQ(pq.centroids, 256u);
+
+        float table[16 * VECTOR_PQ_CENTROIDS];
+        uint8_t codes[4 * 16];
+        float scanned[4];
+        vector_pq_table(&pq, q, table);
+        for (int i = 0; i < 4; i++) vector_pq_encode(&pq, &vecs[i * VEC_DIMS], codes + i * pq.m);
+        vector_pq_scan(table, codes, pq.m, 4, scanned);
+
+        for (int i = 0; i < 4; i++) {
+            vector_pq_decode(&pq, codes + i * pq.m, back);
+            float expect = vector_l2_sq(q, back, VEC_DIMS);
+            cpu_features_mask(0);
+            ASSERT_TRUE(vec_close(vector_pq_l2_sq(table, codes + i * pq.m, pq.m), expect));
+            cpu_features_mask(0xFFFFFFFFu);
+            ASSERT_TRUE(vec_close(scanned[i], expect));
+
+            /* Trained centroids land near the data they code */
+            ASSERT_TRUE(vector_l2_sq(back, &vecs[i * VEC_DIMS], VEC_DIMS) < 0.5f);
+        }
+        vector_pq_free(&pq);
+    }
+    ASSERT_EQ(vector_pq_train(nullptr, vecs, VEC_COUNT, VEC_DIMS, 5), SPEEDSQL_MISUSE);
+}
+
+/* True top-10 rows found among got[0..count) */
+static int vec_recall_hits(const float* vecs, const float* q, const int64_t* got, uint32_t count) {
+    int64_t expect[10];
+    vec_brute_force(vecs, VEC_COUNT, q, 10, expect);
+    int hits = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        for (int j = 0; j < 10; j++) {
+            if (got[i] == expect[j]) hits++;
+        }
+    }
+    return hits;
+}
+
+TEST(hnsw_quantized_search_reranks) {
+    static float vecs[VEC_COUNT * VEC_DIMS];
+    uint64_t seed = 23;
+    for (int i = 0; i < VEC_COUNT * VEC_DIMS; i++) vecs[i] = vec_random(&seed);
+
+    /* PQ graph: the codebook survives closing and reopening the index,
+     * and the true top 10 sit among its 40 best estimates */
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(":memory:", &db), SPEEDSQL_OK);
+    page_id_t meta = INVALID_PAGE_ID;
+    hnsw_t* h = nullptr;
+    ASSERT_EQ(hnsw_create(db->buffer_pool, &db->db_file, 12, 100, 64, &meta), SPEEDSQL_OK);
+    ASSERT_EQ(hnsw_open(&h, db->buffer_pool, &db->db_file, meta), SPEEDSQL_OK);
+    ASSERT_EQ(hnsw_quantize(h, IDX_QUANT_PQ, 8, 0, vecs, VEC_COUNT, VEC_DIMS), SPEEDSQL_OK);
+    ASSERT_EQ(hnsw_quantize(h, IDX_QUANT_SQ8, 0, 0, nullptr, 0, 0), SPEEDSQL_MISUSE);
+    ASSERT_EQ(hnsw_rerank(h), 4u);
+    for (int i = 0; i < VEC_COUNT; i++) {
+        ASSERT_EQ(hnsw_insert(h, i + 1, &vecs[i * VEC_DIMS], VEC_DIMS), SPEEDSQL_OK);
+    }
+    hnsw_close(h);
+    ASSERT_EQ(hnsw_open(&h, db->buffer_pool, &db->db_file, meta), SPEEDSQL_OK);
+
+    int hits = 0;
+    float q[VEC_DIMS];
+    int64_t got[40];
+    uint32_t found = 0;
+    for (int t = 0; t < 10; t++) {
+        for (int d = 0; d < VEC_DIMS; d++) q[d] = vec_random(&seed);
+        ASSERT_EQ(hnsw_search(h, q, VEC_DIMS, 40, 0, got, nullptr, &found), SPEEDSQL_OK);
+        ASSERT_EQ(found, 40u);
+        hits += vec_recall_hits(vecs, q, got, found);
+    }
+    ASSERT_TRUE(hits >= 90);
+    hnsw_close(h);
+    speedsql_close(db);
+
+    /* SQ8 through SQL: results come back re-ranked with exact distances */
+    speedsql_open(":memory:", &db);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE docs (id INTEGER, embedding VECTOR)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX docs_pq ON docs USING HNSW (embedding) "
+                                "WITH (quantization = pq)", nullptr, nullptr, nullptr),
+              SPEEDSQL_ERROR);
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX docs_sq8 ON docs USING HNSW (embedding) "
+                                "WITH (quantization = sq8, rerank = 3)", nullptr, nullptr, nullptr),
+              SPEEDSQL_OK);
+
+    speedsql_stmt* stmt = nullptr;
+    ASSERT_EQ(speedsql_prepare(db, "INSERT INTO docs VALUES (?, ?)", -1, &stmt, nullptr),
+              SPEEDSQL_OK);
+    for (int i = 0; i < VEC_COUNT; i++) {
+        speedsql_reset(stmt);
+        speedsql_bind_int(stmt, 1, i + 1);
+        speedsql_bind_vector(stmt, 2, &vecs[i * VEC_DIMS], VEC_DIMS);
+        ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+    }
+    speedsql_finalize(stmt);
+
+    hits = 0;
+    for (int t = 0; t < 10; t++) {
+        for (int d = 0; d < VEC_DIMS; d++) q[d] = vec_random(&seed);
+        speedsql_stmt* result = nullptr;
+        ASSERT_EQ(speedsql_vector_search(db, "docs", "embedding", q, VEC_DIMS, 10, &result),
+                  SPEEDSQL_OK);
+        uint32_t n = 0;
+        while (speedsql_step(result) == SPEEDSQL_ROW) {
+            got[n] = speedsql_column_int64(result, 0);
+            double exact = sqrt(vector_l2_sq(q, &vecs[(got[n] - 1) * VEC_DIMS], VEC_DIMS));
+            ASSERT_TRUE(fabs(speedsql_column_double(result, 1) - exact) < 1e-4);
+            n++;
+        }
+        speedsql_finalize(result);
+        ASSERT_EQ(n, 10u);
+        hits += vec_recall_hits(vecs, q, got, n);
+    }
+    ASSERT_TRUE(hits >= 90);
+
+    speedsql_close(db);
+}
+
+/* ============================================================================
+ * IVF Index Tests
+ * ============================================================================ */
+
+#define IVF_BIG_COUNT 20000
+
+TEST(ivf_recall_against_brute_force) {
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(":memory:", &db), SPEEDSQL_OK);
+
+    static float vecs[VEC_COUNT * VEC_DIMS];
+    uint64_t seed = 77;
+    for (int i = 0; i < VEC_COUNT * VEC_DIMS; i++) vecs[i] = vec_random(&seed);
+
+    page_id_t meta = INVALID_PAGE_ID;
+    ivf_t* f = nullptr;
+    ASSERT_EQ(ivf_create(db->buffer_pool, &db->db_file, 16, 4, &meta), SPEEDSQL_OK);
+    ASSERT_EQ(ivf_open(&f, db->buffer_pool, &db->db_file, meta), SPEEDSQL_OK);
+    ASSERT_EQ(ivf_insert(f, 1, vecs, VEC_DIMS), SPEEDSQL_MISUSE);
+    ASSERT_EQ(ivf_train(f, vecs, VEC_COUNT, VEC_DIMS), SPEEDSQL_OK);
+    ASSERT_EQ(ivf_train(f, vecs, VEC_COUNT, VEC_DIMS), SPEEDSQL_MISUSE);
+    for (int i = 0; i < VEC_COUNT; i++) {
+        ASSERT_EQ(ivf_insert(f, i + 1, &vecs[i * VEC_DIMS], VEC_DIMS), SPEEDSQL_OK);
+    }
+    ASSERT_EQ(ivf_insert(f, 9999, vecs, VEC_DIMS - 1), SPEEDSQL_MISMATCH);
+
+    /* Lists and centroids survive closing and reopening */
+    ivf_close(f);
+    ASSERT_EQ(ivf_open(&f, db->buffer_pool, &db->db_file, meta), SPEEDSQL_OK);
+    ASSERT_EQ(ivf_count(f), (uint64_t)VEC_COUNT);
+
+    /* Probing every list is exact; the default 4 of 16 finds most */
+    int hits = 0;
+    float q[VEC_DIMS];
+    int64_t expect[10], got[10];
+    float dist[10];
+    uint32_t found = 0;
+    for (int t = 0; t < 20; t++) {
+        for (int d = 0; d < VEC_DIMS; d++) q[d] = vec_random(&seed);
+        vec_brute_force(vecs, VEC_COUNT, q, 10, expect);
+        ASSERT_EQ(ivf_search(f, q, VEC_DIMS, 10, 16, got, dist, &found), SPEEDSQL_OK);
+        ASSERT_EQ(found, 10u);
+        for (int i = 0; i < 10; i++) ASSERT_EQ(got[i], expect[i]);
+        ASSERT_TRUE(vec_close(dist[0], sqrtf(vector_l2_sq(q, &vecs[(got[0] - 1) * VEC_DIMS],
+                                                          VEC_DIMS))));
+
+        ASSERT_EQ(ivf_search(f, q, VEC_DIMS, 10, 0, got, dist, &found), SPEEDSQL_OK);
+        hits += vec_recall_hits(vecs, q, got, found);
+    }
+    ASSERT_TRUE(hits >= 120);
+
+    /* Deletes and re-inserts, as for HNSW */
+    ASSERT_EQ(ivf_delete(f, 7), SPEEDSQL_OK);
+    ASSERT_EQ(ivf_delete(f, 7), SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(ivf_count(f), (uint64_t)VEC_COUNT - 1);
+    ASSERT_EQ(ivf_search(f, &vecs[6 * VEC_DIMS], VEC_DIMS, 5, 16, got, dist, &found), SPEEDSQL_OK);
+    for (uint32_t i = 0; i < found; i++) ASSERT_NE(got[i], 7);
+    ASSERT_EQ(ivf_insert(f, 7, &vecs[8 * VEC_DIMS], VEC_DIMS), SPEEDSQL_OK);
+    ASSERT_EQ(ivf_search(f, &vecs[8 * VEC_DIMS], VEC_DIMS, 2, 16, got, dist, &found), SPEEDSQL_OK);
+    ASSERT_EQ(found, 2u);
+    ASSERT_TRUE((got[0] == 7 && got[1] == 9) || (got[0] == 9 && got[1] == 7));
+    ivf_close(f);
+
+    /* A probe large enough to be split over threads merges to the same
+     * exact answer */
+    float* big = (float*)malloc((size_t)IVF_BIG_COUNT * VEC_DIMS * sizeof(float));
+    ASSERT_TRUE(big != nullptr);
+    for (int i = 0; i < IVF_BIG_COUNT * VEC_DIMS; i++) big[i] = vec_random(&seed);
+    ASSERT_EQ(ivf_create(db->buffer_pool, &db->db_file, 8, 8, &meta), SPEEDSQL_OK);
+    ASSERT_EQ(ivf_open(&f, db->buffer_pool, &db->db_file, meta), SPEEDSQL_OK);
+    ASSERT_EQ(ivf_train(f, big, 2000, VEC_DIMS), SPEEDSQL_OK);
+    for (int i = 0; i < IVF_BIG_COUNT; i++) {
+        ASSERT_EQ(ivf_insert(f, i + 1, &big[i * VEC_DIMS], VEC_DIMS), SPEEDSQL_OK);
+    }
+    for (int t = 0; t < 5; t++) {
+        for (int d = 0; d < VEC_DIMS; d++) q[d] = vec_random(&seed);
+        vec_brute_force(big, IVF_BIG_COUNT, q, 10, expect);
+        ASSERT_EQ(ivf_search(f, q, VEC_DIMS, 10, 0, got, dist, &found), SPEEDSQL_OK);
+        ASSERT_EQ(found, 10u);
+        for (int i = 0; i < 10; i++) ASSERT_EQ(got[i], expect[i]);
+    }
+    ivf_close(f);
+    free(big);
+    speedsql_close(db);
+}
+
+TEST(ivf_sql_order_by_vec_distance) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE docs (id INTEGER, embedding VECTOR)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    /* Centroids are trained on the rows already there */
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX docs_ivf ON docs USING IVF (embedding)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_ERROR);
+    ASSERT_EQ(vec_insert_points(db, 1, 200), SPEEDSQL_OK);
+    ASSERT_NE(speedsql_exec(db, "CREATE INDEX docs_ivf ON docs USING IVF (embedding) "
+                                "WITH (m = 8)", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_NE(speedsql_exec(db, "CREATE INDEX docs_hnsw ON docs USING HNSW (embedding) "
+                                "WITH (nprobe = 8)", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX docs_ivf ON docs USING IVF (embedding) "
+                                "WITH (lists = 8, nprobe = 8)", nullptr, nullptr, nullptr),
+              SPEEDSQL_OK);
+    ASSERT_EQ(vec_insert_points(db, 201, 300), SPEEDSQL_OK);
+
+    int ids[8];
+    double dists[8];
+    ASSERT_EQ(vec_nearest_ids(db, 250.2f, 5, ids, dists), 5);
+    int expect[5] = {250, 251, 249, 252, 248};
+    for (int i = 0; i < 5; i++) ASSERT_EQ(ids[i], expect[i]);
+    ASSERT_TRUE(dists[0] > 0.19 && dists[0] < 0.21);
+
+    ASSERT_EQ(speedsql_exec(db, "DELETE FROM docs WHERE id = 250", nullptr, nullptr, nullptr),
+              SPEEDSQL_OK);
+    ASSERT_EQ(vec_nearest_ids(db, 250.2f, 2, ids, dists), 2);
+    ASSERT_EQ(ids[0], 251);
+    ASSERT_EQ(ids[1], 249);
+
+    float q[4] = {42.0f, 0, 0, 0};
+    speedsql_stmt* result = nullptr;
+    ASSERT_EQ(speedsql_vector_search(db, "docs", "embedding", q, 4, 3, &result), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(result), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_int64(result, 0), 42);
+    speedsql_finalize(result);
+    ASSERT_EQ(speedsql_vector_search(db, "docs", "embedding", q, 3, 3, &result),
+              SPEEDSQL_MISMATCH);
+
+    ASSERT_EQ(speedsql_exec(db, "DROP INDEX docs_ivf", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    speedsql_close(db);
+}
+
+/* ============================================================================
+ * FTS Index Tests
+ * ============================================================================ */
+
+#define FTS_DOC_COUNT 8000
+
+static void fts_doc_text(int i, char* text, size_t size) {
+    snprintf(text, size, "a%d b%d %s filler%d lorem ipsum dolor sit amet", i % 7, i % 11,
+             i % 5 == 0 ? "alpha beta" : "beta alpha", i % 13);
+}
+
+/* Rowids fts_search finds equal those of live docs the predicate holds for */
+static bool fts_same_hits(fts_t* f, const char* query, bool (*pred)(int), const bool* live) {
+    int64_t* rowids = nullptr;
+    size_t count = 0;
+    if (fts_search(f, query, &rowids, &count) != SPEEDSQL_OK) return false;
+
+    size_t n = 0;
+    bool same = true;
+    for (int i = 1; i <= FTS_DOC_COUNT && same; i++) {
+        if (!live[i] || !pred(i)) continue;
+        same = n < count && rowids[n] == i;
+        n++;
+    }
+    same = same && n == count;
+    sdb_free(rowids);
+    return same;
+}
+
+static bool fts_pred_a3(int i) { return i % 7 == 3; }
+static bool fts_pred_a3_b5(int i) { return i % 7 == 3 && i % 11 == 5; }
+static bool fts_pred_a3_or_b5(int i) { return i % 7 == 3 || i % 11 == 5; }
+static bool fts_pred_phrase(int i) { return i % 5 == 0; }
+static bool fts_pred_group(int i) { return (i % 7 == 1 || i % 7 == 2) && i % 11 == 0; }
+static bool fts_pred_all(int i) { (void)i; return true; }
+
+static bool fts_check_queries(fts_t* f, const bool* live) {
+    return fts_same_hits(f, "a3", fts_pred_a3, live) &&
+           fts_same_hits(f, "a3 b5", fts_pred_a3_b5, live) &&
+           fts_same_hits(f, "A3 AND b5", fts_pred_a3_b5, live) &&
+           fts_same_hits(f, "a3 OR b5", fts_pred_a3_or_b5, live) &&
+           fts_same_hits(f, "\"alpha beta\"", fts_pred_phrase, live) &&
+           fts_same_hits(f, "alpha-beta", fts_pred_phrase, live) &&
+           fts_same_hits(f, "(a1 OR a2) b0", fts_pred_group, live) &&
+           fts_same_hits(f, "beta alpha", fts_pred_all, live);
+}
+
+/* Splits on commas only, keeping case */
+static int comma_tokenize(speedsql_tokenizer* tok, const char* text, int len,
+                          speedsql_token_fn emit, void* ctx) {
+    (void)tok;
+    int start = 0, position = 0;
+    for (int i = 0; i <= len; i++) {
+        if (i < len && text[i] != ',') continue;
+        if (i > start) {
+            int rc = emit(ctx, text + start, i - start, position++);
+            if (rc != SPEEDSQL_OK) return rc;
+        }
+        start = i + 1;
+    }
+    return SPEEDSQL_OK;
+}
+
+TEST(fts_boolean_phrase_queries_and_merge) {
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(":memory:", &db), SPEEDSQL_OK);
+
+    page_id_t meta = INVALID_PAGE_ID;
+    fts_t* f = nullptr;
+    ASSERT_EQ(fts_create(db->buffer_pool, &db->db_file, "nope", &meta), SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(fts_create(db->buffer_pool, &db->db_file, nullptr, &meta), SPEEDSQL_OK);
+    ASSERT_EQ(fts_open(&f, db->buffer_pool, &db->db_file, meta), SPEEDSQL_OK);
+
+    /* Enough text for several flushed segments and a background merge */
+    static bool live[FTS_DOC_COUNT + 1];
+    char text[128];
+    for (int i = 1; i <= FTS_DOC_COUNT; i++) {
+        fts_doc_text(i, text, sizeof(text));
+        ASSERT_EQ(fts_insert(f, i, text, strlen(text)), SPEEDSQL_OK);
+        live[i] = true;
+    }
+    ASSERT_EQ(fts_count(f), (uint64_t)FTS_DOC_COUNT);
+    ASSERT_TRUE(fts_check_queries(f, live));
+
+    int64_t* rowids = nullptr;
+    size_t count = 0;
+    ASSERT_EQ(fts_search(f, "missing", &rowids, &count), SPEEDSQL_OK);
+    ASSERT_EQ(count, 0u);
+    ASSERT_EQ(fts_search(f, "  ( ) \"\" ", &rowids, &count), SPEEDSQL_OK);
+    ASSERT_EQ(count, 0u);
+
+    /* Deleted rows vanish; a re-inserted row matches its new text only */
+    for (int i = 3; i <= FTS_DOC_COUNT; i += 3) {
+        ASSERT_EQ(fts_delete(f, i), SPEEDSQL_OK);
+        live[i] = false;
+    }
+    ASSERT_EQ(fts_delete(f, 3), SPEEDSQL_NOTFOUND);
+    ASSERT_TRUE(fts_check_queries(f, live));
+    ASSERT_EQ(fts_insert(f, 10, "zebra crossing", 14), SPEEDSQL_OK);
+    live[10] = false;
+    ASSERT_EQ(fts_search(f, "zebra", &rowids, &count), SPEEDSQL_OK);
+    ASSERT_EQ(count, 1u);
+    ASSERT_EQ(rowids[0], 10);
+    sdb_free(rowids);
+    ASSERT_TRUE(fts_check_queries(f, live));
+
+    /* Everything survives reopening, and optimizing leaves one segment */
+    fts_close(f);
+    ASSERT_EQ(fts_open(&f, db->buffer_pool, &db->db_file, meta), SPEEDSQL_OK);
+    ASSERT_TRUE(fts_check_queries(f, live));
+    ASSERT_TRUE(fts_segment_count(f) > 0);
+    ASSERT_EQ(fts_optimize(f), SPEEDSQL_OK);
+    ASSERT_EQ(fts_segment_count(f), 1u);
+    ASSERT_TRUE(fts_check_queries(f, live));
+    ASSERT_EQ(fts_search(f, "zebra", &rowids, &count), SPEEDSQL_OK);
+    ASSERT_EQ(count, 1u);
+    sdb_free(rowids);
+    fts_close(f);
+
+    /* A custom tokenizer decides what a term is */
+    static speedsql_tokenizer comma = {"comma", nullptr, comma_tokenize};
+    ASSERT_EQ(speedsql_tokenizer_register(&comma), SPEEDSQL_OK);
+    static speedsql_tokenizer dup = {"simple", nullptr, comma_tokenize};
+    ASSERT_EQ(speedsql_tokenizer_register(&dup), SPEEDSQL_CONSTRAINT);
+    ASSERT_EQ(speedsql_tokenizer_unregister(speedsql_tokenizer_find("simple")), SPEEDSQL_MISUSE);
+
+    bool match = false;
+    const char* cities = "new york,Boston";
+    ASSERT_EQ(fts_match_text(&comma, cities, strlen(cities), "\"new york\"", &match),
+              SPEEDSQL_OK);
+    ASSERT_TRUE(match);
+    ASSERT_EQ(fts_match_text(&comma, cities, strlen(cities), "york", &match), SPEEDSQL_OK);
+    ASSERT_FALSE(match);
+    ASSERT_EQ(fts_match_text(speedsql_tokenizer_find(nullptr), cities, strlen(cities),
+                             "york boston", &match), SPEEDSQL_OK);
+    ASSERT_TRUE(match);
+
+    ASSERT_EQ(fts_create(db->buffer_pool, &db->db_file, "comma", &meta), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_tokenizer_unregister(&comma), SPEEDSQL_OK);
+    ASSERT_EQ(fts_open(&f, db->buffer_pool, &db->db_file, meta), SPEEDSQL_NOTFOUND);
+    speedsql_close(db);
+}
+
+/* The ids a query returns, in order */
+static int fts_query_ids(speedsql* db, const char* sql, const char* param, int* ids, int max) {
+    speedsql_stmt* stmt = nullptr;
+    if (speedsql_prepare(db, sql, -1, &stmt, nullptr) != SPEEDSQL_OK) return -1;
+    if (param) speedsql_bind_text(stmt, 1, param, -1, nullptr);
+
+    int n = 0;
+    while (speedsql_step(stmt) == SPEEDSQL_ROW && n < max) {
+        ids[n++] = speedsql_column_int(stmt, 0);
+    }
+    speedsql_finalize(stmt);
+    return n;
+}
+
+TEST(fts_sql_match_operator) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE notes (id INTEGER, body TEXT)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO notes VALUES (1, 'the quick brown fox')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO notes VALUES (2, 'quick brown dogs')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO notes VALUES (3, 'lazy fox sleeps')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO notes VALUES (4, NULL)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    /* MATCH works without an index too, row by row */
+    int ids[8];
+    ASSERT_EQ(fts_query_ids(db, "SELECT id FROM notes WHERE body MATCH 'brown fox'",
+                            nullptr, ids, 8), 1);
+    ASSERT_EQ(ids[0], 1);
+
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX notes_fts ON notes USING FTS (body) "
+                                "WITH (tokenizer = nope)", nullptr, nullptr, nullptr),
+              SPEEDSQL_ERROR);
+    ASSERT_NE(speedsql_exec(db, "CREATE INDEX notes_fts ON notes USING FTS (id, body)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_NE(speedsql_exec(db, "CREATE INDEX notes_ivf ON notes USING IVF (body) "
+                                "WITH (tokenizer = simple)", nullptr, nullptr, nullptr),
+              SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX notes_fts ON notes USING FTS (body) "
+                                "WITH (tokenizer = simple)", nullptr, nullptr, nullptr),
+              SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO notes VALUES (5, 'Brown Fox jumps')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    ASSERT_EQ(fts_query_ids(db, "SELECT id FROM notes WHERE body MATCH 'brown fox' "
+                                "ORDER BY id", nullptr, ids, 8), 2);
+    ASSERT_EQ(ids[0], 1);
+    ASSERT_EQ(ids[1], 5);
+    ASSERT_EQ(fts_query_ids(db, "SELECT id FROM notes WHERE body MATCH '\"quick brown\"' "
+                                "ORDER BY id", nullptr, ids, 8), 2);
+    ASSERT_EQ(ids[0], 1);
+    ASSERT_EQ(ids[1], 2);
+    ASSERT_EQ(fts_query_ids(db, "SELECT id FROM notes WHERE id > 2 AND body MATCH 'fox' "
+                                "ORDER BY id", nullptr, ids, 8), 2);
+    ASSERT_EQ(ids[0], 3);
+    ASSERT_EQ(ids[1], 5);
+    ASSERT_EQ(fts_query_ids(db, "SELECT id FROM notes WHERE body MATCH 'fox' "
+                                "ORDER BY id DESC LIMIT 1", nullptr, ids, 8), 1);
+    ASSERT_EQ(ids[0], 5);
+    ASSERT_EQ(fts_query_ids(db, "SELECT id FROM notes WHERE body MATCH ? ORDER BY id",
+                            "dogs OR lazy", ids, 8), 2);
+    ASSERT_EQ(ids[0], 2);
+    ASSERT_EQ(ids[1], 3);
+
+    /* Writes keep the index current */
+    ASSERT_EQ(speedsql_exec(db, "UPDATE notes SET body = 'red fox' WHERE id = 2",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "DELETE FROM notes WHERE id = 1",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(fts_query_ids(db, "SELECT id FROM notes WHERE body MATCH 'dogs'",
+                            nullptr, ids, 8), 0);
+    ASSERT_EQ(fts_query_ids(db, "SELECT id FROM notes WHERE body MATCH 'fox' ORDER BY id",
+                            nullptr, ids, 8), 3);
+    ASSERT_EQ(ids[0], 2);
+    ASSERT_EQ(ids[1], 3);
+    ASSERT_EQ(ids[2], 5);
+
+    speedsql_stmt* result = nullptr;
+    ASSERT_EQ(speedsql_fts_search(db, "notes", "fox -", &result), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_column_count(result), 2);
+    int rows = 0;
+    while (speedsql_step(result) == SPEEDSQL_ROW) rows++;
+    ASSERT_EQ(rows, 3);
+    speedsql_finalize(result);
+
+    ASSERT_EQ(speedsql_exec(db, "DROP INDEX notes_fts", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_fts_search(db, "notes", "fox", &result), SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(fts_query_ids(db, "SELECT id FROM notes WHERE body MATCH 'fox'",
+                            nullptr, ids, 8), 3);
+    speedsql_close(db);
+}
+
+/* ============================================================================
+ * BM25 Ranking Tests
+ * ============================================================================ */
+
+static double bm25_expect(double docs, double df, double tf, double len, double avg_len) {
+    double idf = log(1.0 + (docs - df + 0.5) / (df + 0.5));
+    return idf * tf * 2.2 / (tf + 1.2 * (0.25 + 0.75 * len / avg_len));
+}
+
+/* Varied term frequencies and lengths so blocks have different bounds */
+static void bm25_doc_text(int i, char* text, size_t size) {
+    uint32_t x = (uint32_t)i * 2654435761u;
+    int n = snprintf(text, size, "common");
+    for (uint32_t r = x % 4; r > 0; r--) n += snprintf(text + n, size - n, " common");
+    if (i % 5 == 0) n += snprintf(text + n, size - n, " mid");
+    if (i % 97 == 0) n += snprintf(text + n, size - n, " rare rare");
+    for (uint32_t r = (x >> 8) % 9; r > 0; r--) n += snprintf(text + n, size - n, " pad");
+}
+
+/* The pruned top k are the head of the full ranking */
+static bool bm25_topk_exact(fts_t* f, const char* query, size_t k) {
+    int64_t *all = nullptr, *top = nullptr;
+    float *all_scores = nullptr, *top_scores = nullptr;
+    size_t all_count = 0, top_count = 0;
+    bool same = fts_rank(f, query, 0, &all, &all_scores, &all_count) == SPEEDSQL_OK &&
+                fts_rank(f, query, k, &top, &top_scores, &top_count) == SPEEDSQL_OK;
+    same = same && top_count == (all_count < k ? all_count : k) && top_count > 0;
+    for (size_t i = 0; same && i < top_count; i++) {
+        same = top[i] == all[i] && top_scores[i] == all_scores[i];
+        if (i > 0) same = same && top_scores[i] <= top_scores[i - 1];
+    }
+    sdb_free(all);
+    sdb_free(all_scores);
+    sdb_free(top);
+    sdb_free(top_scores);
+    return same;
+}
+
+TEST(fts_bm25_ranking_and_block_max_topk) {
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(":memory:", &db), SPEEDSQL_OK);
+
+    page_id_t meta = INVALID_PAGE_ID;
+    fts_t* f = nullptr;
+    ASSERT_EQ(fts_create(db->buffer_pool, &db->db_file, nullptr, &meta), SPEEDSQL_OK);
+    ASSERT_EQ(fts_open(&f, db->buffer_pool, &db->db_file, meta), SPEEDSQL_OK);
+
+    /* Scores follow the formula: 4 docs of 2, 3, 1 and 4 tokens */
+    const char* docs[4] = {"apple banana", "apple apple cherry", "banana",
+                           "cherry cherry cherry date"};
+    for (int i = 0; i < 4; i++) {
+        ASSERT_EQ(fts_insert(f, i + 1, docs[i], strlen(docs[i])), SPEEDSQL_OK);
+    }
+    int64_t* rowids = nullptr;
+    float* scores = nullptr;
+    size_t count = 0;
+    ASSERT_EQ(fts_rank(f, "apple", 0, &rowids, &scores, &count), SPEEDSQL_OK);
+    ASSERT_EQ(count, 2u);
+    ASSERT_EQ(rowids[0], 2);
+    ASSERT_EQ(rowids[1], 1);
+    ASSERT_TRUE(fabs(scores[0] - bm25_expect(4, 2, 2, 3, 2.5)) < 1e-5);
+    ASSERT_TRUE(fabs(scores[1] - bm25_expect(4, 2, 1, 2, 2.5)) < 1e-5);
+    sdb_free(rowids);
+    sdb_free(scores);
+
+    /* An OR sums the terms each row matched on */
+    ASSERT_EQ(fts_rank(f, "banana OR date", 0, &rowids, &scores, &count), SPEEDSQL_OK);
+    ASSERT_EQ(count, 3u);
+    ASSERT_EQ(rowids[0], 4);
+    ASSERT_EQ(rowids[1], 3);
+    ASSERT_TRUE(fabs(scores[0] - bm25_expect(4, 1, 1, 4, 2.5)) < 1e-5);
+    ASSERT_TRUE(fabs(scores[1] - bm25_expect(4, 2, 1, 1, 2.5)) < 1e-5);
+    sdb_free(rowids);
+    sdb_free(scores);
+
+    /* Deleting a row changes the statistics */
+    ASSERT_EQ(fts_delete(f, 4), SPEEDSQL_OK);
+    ASSERT_EQ(fts_rank(f, "apple", 1, &rowids, &scores, &count), SPEEDSQL_OK);
+    ASSERT_EQ(count, 1u);
+    ASSERT_EQ(rowids[0], 2);
+    ASSERT_TRUE(fabs(scores[0] - bm25_expect(3, 2, 2, 3, 2.0)) < 1e-5);
+    sdb_free(rowids);
+    sdb_free(scores);
+    for (int i = 1; i <= 3; i++) ASSERT_EQ(fts_delete(f, i), SPEEDSQL_OK);
+
+    /* Pruned top-k over segments, the pending log and a reopen */
+    char text[128];
+    for (int i = 1; i <= FTS_DOC_COUNT; i++) {
+        bm25_doc_text(i, text, sizeof(text));
+        ASSERT_EQ(fts_insert(f, i, text, strlen(text)), SPEEDSQL_OK);
+    }
+    ASSERT_TRUE(bm25_topk_exact(f, "common", 10));
+    ASSERT_TRUE(bm25_topk_exact(f, "common OR rare", 10));
+    ASSERT_TRUE(bm25_topk_exact(f, "common OR mid OR rare", 25));
+    ASSERT_TRUE(bm25_topk_exact(f, "common mid", 10));
+    ASSERT_TRUE(bm25_topk_exact(f, "(mid OR rare) common", 5));
+
+    /* The rare term outranks every common-only row */
+    ASSERT_EQ(fts_rank(f, "common OR rare", 10, &rowids, &scores, &count), SPEEDSQL_OK);
+    ASSERT_EQ(count, 10u);
+    for (size_t i = 0; i < count; i++) ASSERT_EQ(rowids[i] % 97, 0);
+    sdb_free(rowids);
+    sdb_free(scores);
+
+    fts_close(f);
+    ASSERT_EQ(fts_open(&f, db->buffer_pool, &db->db_file, meta), SPEEDSQL_OK);
+    ASSERT_TRUE(bm25_topk_exact(f, "common OR rare", 10));
+    ASSERT_EQ(fts_optimize(f), SPEEDSQL_OK);
+    ASSERT_TRUE(bm25_topk_exact(f, "common OR mid OR rare", 10));
+    ASSERT_TRUE(bm25_topk_exact(f, "common", 1));
+    fts_close(f);
+    speedsql_close(db);
+}
+
+TEST(fts_search_scores_and_topk) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE posts (id INTEGER, title TEXT, body TEXT)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX posts_title ON posts USING FTS (title)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO posts VALUES (1, 'fox', 'a long story about a dog')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO posts VALUES (2, 'dog days', 'fox fox fox')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO posts VALUES (3, 'the fox and the hound', 'x')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO posts VALUES (4, 'cats', 'y')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    /* Best first: the one-word title beats the longer one */
+    speedsql_stmt* result = nullptr;
+    ASSERT_EQ(speedsql_fts_search(db, "posts", "fox", &result), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_column_count(result), 2);
+    ASSERT_STR_EQ(speedsql_column_name(result, 1), "score");
+    ASSERT_EQ(speedsql_step(result), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_int64(result, 0), 1);
+    double first = speedsql_column_double(result, 1);
+    ASSERT_EQ(speedsql_step(result), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_int64(result, 0), 3);
+    ASSERT_TRUE(speedsql_column_double(result, 1) < first);
+    ASSERT_EQ(speedsql_step(result), SPEEDSQL_DONE);
+    speedsql_finalize(result);
+
+    /* A second index: row 2 now matches through its body, best score kept */
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX posts_body ON posts USING FTS (body)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_fts_search_topk(db, "posts", "fox", 2, &result), SPEEDSQL_OK);
+    int rows = 0;
+    int64_t seen[2] = {0, 0};
+    while (speedsql_step(result) == SPEEDSQL_ROW && rows < 2) {
+        seen[rows++] = speedsql_column_int64(result, 0);
+    }
+    speedsql_finalize(result);
+    ASSERT_EQ(rows, 2);
+    ASSERT_EQ(seen[0], 2);
+    ASSERT_EQ(seen[1], 1);
+
+    ASSERT_EQ(speedsql_fts_search_topk(db, "posts", "fox", 0, &result), SPEEDSQL_MISUSE);
+    ASSERT_EQ(speedsql_fts_search_topk(db, "nope", "fox", 3, &result), SPEEDSQL_ERROR);
+    ASSERT_EQ(speedsql_fts_search_topk(db, "posts", "missing", 3, &result), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(result), SPEEDSQL_DONE);
+    speedsql_finalize(result);
+    speedsql_close(db);
+}
+
+/* ============================================================================
+ * JSON Tests
+ * ============================================================================ */
+
+/* Render the value a path leads to; empty when there is none */
+static void json_path_text(const uint8_t* doc, uint32_t len, const char* path,
+                           char* out, size_t size) {
+    jsonb_t root, at;
+    char* text = nullptr;
+    out[0] = '\0';
+    if (!jsonb_root(doc, len, &root) || jsonb_path(&root, path, &at) != SPEEDSQL_OK) return;
+    if (jsonb_to_text(&at, &text, nullptr) != SPEEDSQL_OK) return;
+    snprintf(out, size, "%s", text);
+    sdb_free(text);
+}
+
+TEST(jsonb_sorted_keys_and_path_navigation) {
+    const char* text =
+        " { \"name\" : \"Ann \\\"A\\\"\\n\", \"id\": 42, \"tags\": [\"x\", 1.5, true, null, []],"
+        "   \"addr\": {\"zip\": \"10001\", \"city\": \"NYC\"}, \"id\": 7,"
+        "   \"uni\": \"\\u00e9\\ud83d\\ude00\", \"big\": 123456789012345678901234, \"neg\": -0.25e1 }";
+    uint8_t* doc = nullptr;
+    uint32_t len = 0;
+    ASSERT_EQ(jsonb_from_text(text, strlen(text), &doc, &len), SPEEDSQL_OK);
+
+    /* Keys come back sorted, the later duplicate kept */
+    jsonb_t root;
+    ASSERT_TRUE(jsonb_root(doc, len, &root));
+    ASSERT_EQ(jsonb_type(&root), JSONB_OBJECT);
+    ASSERT_EQ(jsonb_count(&root), 7u);
+    char* rendered = nullptr;
+    ASSERT_EQ(jsonb_to_text(&root, &rendered, nullptr), SPEEDSQL_OK);
+    ASSERT_STR_EQ(rendered,
+        "{\"addr\":{\"city\":\"NYC\",\"zip\":\"10001\"},\"big\":1.2345678901234569e+23,"
+        "\"id\":7,\"name\":\"Ann \\\"A\\\"\\n\",\"neg\":-2.5,"
+        "\"tags\":[\"x\",1.5,true,null,[]],\"uni\":\"\xc3\xa9\xf0\x9f\x98\x80\"}");
+
+    /* Rendered text parses back to the same bytes */
+    uint8_t* again = nullptr;
+    uint32_t again_len = 0;
+    ASSERT_EQ(jsonb_from_text(rendered, strlen(rendered), &again, &again_len), SPEEDSQL_OK);
+    ASSERT_EQ(again_len, len);
+    ASSERT_EQ(memcmp(again, doc, len), 0);
+    sdb_free(again);
+    sdb_free(rendered);
+
+    char out[128];
+    json_path_text(doc, len, "$.addr.city", out, sizeof(out));
+    ASSERT_STR_EQ(out, "\"NYC\"");
+    json_path_text(doc, len, "$.tags[1]", out, sizeof(out));
+    ASSERT_STR_EQ(out, "1.5");
+    json_path_text(doc, len, "$.\"id\"", out, sizeof(out));
+    ASSERT_STR_EQ(out, "7");
+
+    jsonb_t at;
+    ASSERT_EQ(jsonb_path(&root, "$.tags[0]", &at), SPEEDSQL_OK);
+    uint32_t slen = 0;
+    const char* s = jsonb_string(&at, &slen);
+    ASSERT_EQ(slen, 1u);
+    ASSERT_EQ(s[0], 'x');
+    ASSERT_EQ(jsonb_path(&root, "$.id", &at), SPEEDSQL_OK);
+    ASSERT_EQ(jsonb_int(&at), 7);
+    ASSERT_EQ(jsonb_path(&root, "$.tags[5]", &at), SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(jsonb_path(&root, "$.addr.street", &at), SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(jsonb_path(&root, "$.id.x", &at), SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(jsonb_path(&root, "$.tags[", &at), SPEEDSQL_ERROR);
+    ASSERT_EQ(jsonb_path(&root, "addr", &at), SPEEDSQL_ERROR);
+
+    /* A truncated document fails lookups instead of overrunning */
+    jsonb_t cut;
+    ASSERT_TRUE(jsonb_root(doc, len / 2, &cut));
+    ASSERT_NE(jsonb_path(&cut, "$.uni", &at), SPEEDSQL_OK);
+    sdb_free(doc);
+
+    /* A wide object: every key found by binary search */
+    char wide[8192];
+    size_t pos = (size_t)snprintf(wide, sizeof(wide), "{");
+    for (int i = 499; i >= 0; i--) {
+        pos += (size_t)snprintf(wide + pos, sizeof(wide) - pos, "%s\"k%d\":%d",
+                                i == 499 ? "" : ",", i, i * 3);
+    }
+    snprintf(wide + pos, sizeof(wide) - pos, "}");
+    ASSERT_EQ(jsonb_from_text(wide, strlen(wide), &doc, &len), SPEEDSQL_OK);
+    ASSERT_TRUE(jsonb_root(doc, len, &root));
+    for (int i = 0; i < 500; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "k%d", i);
+        ASSERT_TRUE(jsonb_object_get(&root, key, (uint32_t)strlen(key), &at));
+        ASSERT_EQ(jsonb_int(&at), i * 3);
+    }
+    ASSERT_TRUE(!jsonb_object_get(&root, "k500", 4, &at));
+    sdb_free(doc);
+
+    const char* bad[] = {"", "{", "[1,]", "{\"a\" 1}", "01", "1.", "\"\\x\"", "tru",
+                         "{} x", "[\"a\nb\"]", "{1:2}"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        ASSERT_EQ(jsonb_from_text(bad[i], strlen(bad[i]), &doc, &len), SPEEDSQL_MISMATCH);
+    }
+}
+
+TEST(json_column_binary_storage) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE events (id INTEGER, payload JSON)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    speedsql_stmt* stmt = nullptr;
+    ASSERT_EQ(speedsql_prepare(db, "INSERT INTO events VALUES (?, ?)", -1, &stmt, nullptr),
+              SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_bind_int(stmt, 1, 1), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_bind_json(stmt, 2, "{\"user\": {\"id\": 9}, \"kind\": \"click\"}", -1),
+              SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+
+    /* Invalid JSON is refused at bind time */
+    speedsql_reset(stmt);
+    ASSERT_EQ(speedsql_bind_json(stmt, 2, "{\"user\": ", -1), SPEEDSQL_MISMATCH);
+    ASSERT_EQ(speedsql_bind_json(stmt, 3, "{}", -1), SPEEDSQL_RANGE);
+    speedsql_finalize(stmt);
+
+    ASSERT_EQ(speedsql_prepare(db, "SELECT payload FROM events", -1, &stmt, nullptr),
+              SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_type(stmt, 0), SPEEDSQL_TYPE_JSON);
+    const char* text = speedsql_column_json(stmt, 0);
+    ASSERT_TRUE(text != nullptr);
+    ASSERT_STR_EQ(text, "{\"kind\":\"click\",\"user\":{\"id\":9}}");
+    ASSERT_EQ(speedsql_column_bytes(stmt, 0), (int)strlen(text));
+    ASSERT_EQ((const char*)speedsql_column_text(stmt, 0), text);
+
+    /* The stored value is the binary document, navigable in place */
+    value_t* v = &stmt->current_row[0];
+    jsonb_t root, at;
+    ASSERT_TRUE(jsonb_root((const uint8_t*)v->data.text.data, v->data.text.len, &root));
+    ASSERT_EQ(jsonb_path(&root, "$.user.id", &at), SPEEDSQL_OK);
+    ASSERT_EQ(jsonb_int(&at), 9);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+    speedsql_finalize(stmt);
+    speedsql_close(db);
+}
+
+TEST(json_column_stored_inline) {
+    const char* path = "test_json_inline.db";
+    remove(path);
+
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE docs (id INTEGER, doc JSON, note TEXT)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO docs VALUES (1, '{\"a\": {\"b\": 42}}', 'hello')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    speedsql_close(db);
+
+    /* The record holds the document and text, with offsets for pointers */
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    btree_cursor_t cursor;
+    btree_cursor_init(&cursor, (btree_t*)db->tables[0].data_tree);
+    btree_cursor_first(&cursor);
+    ASSERT_TRUE(cursor.valid);
+    value_t record;
+    value_init_null(&record);
+    ASSERT_EQ(btree_cursor_value(&cursor, &record), SPEEDSQL_OK);
+    const value_t* stored = (const value_t*)(record.data.blob.data + sizeof(int));
+    ASSERT_EQ(*(int*)record.data.blob.data, 3);
+    ASSERT_TRUE((uintptr_t)stored[1].data.text.data < record.data.blob.len);
+    ASSERT_TRUE((uintptr_t)stored[2].data.text.data < record.data.blob.len);
+    ASSERT_STR_EQ((const char*)record.data.blob.data + (uintptr_t)stored[2].data.text.data,
+                  "hello");
+    value_free(&record);
+    btree_cursor_close(&cursor);
+
+    speedsql_stmt* stmt = nullptr;
+    ASSERT_EQ(speedsql_prepare(db, "SELECT json_extract(doc, '$.a.b'), note FROM docs",
+                               -1, &stmt, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_int64(stmt, 0), 42);
+    ASSERT_STR_EQ((const char*)speedsql_column_text(stmt, 1), "hello");
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+    speedsql_finalize(stmt);
+    speedsql_close(db);
+    remove(path);
+}
+
+TEST(row_overflow_pages) {
+    const char* path = "test_row_overflow.db";
+    remove(path);
+    remove("test_row_overflow.db-wal");
+
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE items (id INTEGER, emb VECTOR, body TEXT)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    /* A 1536-dim vector and 20000 characters: more than a page */
+    static float vec[1536];
+    for (int i = 0; i < 1536; i++) vec[i] = (float)i * 0.5f;
+    static char body[40001];
+    for (int i = 0; i < 40000; i++) body[i] = (char)('a' + i % 26);
+    body[20000] = '\0';
+
+    speedsql_stmt* stmt = nullptr;
+    ASSERT_EQ(speedsql_prepare(db, "INSERT INTO items VALUES (?, ?, ?)", -1, &stmt, nullptr),
+              SPEEDSQL_OK);
+    for (int id = 1; id <= 3; id++) {
+        speedsql_bind_int(stmt, 1, id);
+        speedsql_bind_vector(stmt, 2, vec, 1536);
+        speedsql_bind_text(stmt, 3, id == 2 ? "short" : body, -1, nullptr);
+        ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+        speedsql_reset(stmt);
+    }
+    speedsql_finalize(stmt);
+
+    /* The tree keeps a stub; the record lives in a chain of overflow pages */
+    btree_cursor_t cursor;
+    btree_cursor_init(&cursor, (btree_t*)db->tables[0].data_tree);
+    btree_cursor_first(&cursor);
+    value_t record;
+    value_init_null(&record);
+    ASSERT_EQ(btree_cursor_value(&cursor, &record), SPEEDSQL_OK);
+    ASSERT_TRUE(record.data.blob.len < 64);
+    value_free(&record);
+    btree_cursor_close(&cursor);
+
+    /* Growing a spilled row rewrites its chain and adds pages */
+    body[20000] = 'x';
+    body[40000] = '\0';
+    ASSERT_EQ(speedsql_prepare(db, "UPDATE items SET body = ? WHERE id = 3", -1, &stmt, nullptr),
+              SPEEDSQL_OK);
+    speedsql_bind_text(stmt, 1, body, -1, nullptr);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+    speedsql_finalize(stmt);
+    speedsql_close(db);
+
+    /* Read back after reopening */
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_prepare(db, "SELECT id, emb, body FROM items", -1, &stmt, nullptr),
+              SPEEDSQL_OK);
+    for (int id = 1; id <= 3; id++) {
+        ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+        ASSERT_EQ(speedsql_column_int(stmt, 0), id);
+        int dims = 0;
+        const float* got = speedsql_column_vector(stmt, 1, &dims);
+        ASSERT_EQ(dims, 1536);
+        ASSERT_EQ(memcmp(got, vec, sizeof(vec)), 0);
+        const char* text = (const char*)speedsql_column_text(stmt, 2);
+        size_t want = id == 1 ? 20000 : id == 2 ? 5 : 40000;
+        ASSERT_EQ(strlen(text), want);
+        if (id != 2) ASSERT_EQ(memcmp(text, body, want - 1), 0);
+    }
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+    speedsql_finalize(stmt);
+
+    ASSERT_EQ(speedsql_exec(db, "DELETE FROM items WHERE id = 1", nullptr, nullptr, nullptr),
+              SPEEDSQL_OK);
+    ASSERT_EQ(count_query(db, "SELECT COUNT(*) FROM items"), 2);
+    speedsql_close(db);
+
+    /* In memory the same way */
+    ASSERT_EQ(speedsql_open(":memory:", &db), SPEEDSQL_OK);
+    speedsql_exec(db, "CREATE TABLE t (body TEXT)", nullptr, nullptr, nullptr);
+    ASSERT_EQ(speedsql_prepare(db, "INSERT INTO t VALUES (?)", -1, &stmt, nullptr), SPEEDSQL_OK);
+    speedsql_bind_text(stmt, 1, body, -1, nullptr);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+    speedsql_finalize(stmt);
+    ASSERT_EQ(speedsql_prepare(db, "SELECT body FROM t", -1, &stmt, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_bytes(stmt, 0), 40000);
+    speedsql_finalize(stmt);
+    speedsql_close(db);
+
+    remove(path);
+    remove("test_row_overflow.db-wal");
+}
+
+/* ============================================================================
+ * JSON Parser Tests
+ * ============================================================================ */
+
+/* Parse with the CPU's classifier and the portable one; both must agree */
+static int json_parse_both(const char* text, size_t len, uint8_t** doc, uint32_t* doc_len) {
+    uint8_t* portable = nullptr;
+    uint32_t portable_len = 0;
+    int rc = jsonb_from_text(text, len, doc, doc_len);
+    cpu_features_mask(0);
+    int portable_rc = jsonb_from_text(text, len, &portable, &portable_len);
+    cpu_features_mask(~0u);
+
+    if (rc != portable_rc ||
+        (rc == SPEEDSQL_OK && (portable_len != *doc_len || memcmp(portable, *doc, *doc_len)))) {
+        rc = -1;
+    }
+    sdb_free(portable);
+    return rc;
+}
+
+TEST(json_two_stage_parser_and_extract) {
+    /* Strings, escapes and backslash runs straddling 64-byte blocks */
+    for (int pad = 0; pad < 70; pad++) {
+        char text[512];
+        int n = snprintf(text, sizeof(text), "{\"pad\":\"%*s\",\"s\":\"a\\\\\\\\\\\"b\\\\\","
+                         "\"n\":[1,-2.5e3,true,false,null,{\"k\":\"}]\"}],\"t\":\"\\u0041\"}",
+                         pad, "");
+        uint8_t* doc = nullptr;
+        uint32_t len = 0;
+        ASSERT_EQ(json_parse_both(text, (size_t)n, &doc, &len), SPEEDSQL_OK);
+
+        jsonb_t root, at;
+        ASSERT_TRUE(jsonb_root(doc, len, &root));
+        ASSERT_EQ(jsonb_path(&root, "$.s", &at), SPEEDSQL_OK);
+        uint32_t slen;
+        const char* str = jsonb_string(&at, &slen);
+        ASSERT_EQ(slen, 6u);
+        ASSERT_EQ(memcmp(str, "a\\\\\"b\\", 6), 0);
+        ASSERT_EQ(jsonb_path(&root, "$.n[5].k", &at), SPEEDSQL_OK);
+        str = jsonb_string(&at, &slen);
+        ASSERT_EQ(slen, 2u);
+        ASSERT_EQ(jsonb_path(&root, "$.t", &at), SPEEDSQL_OK);
+        ASSERT_EQ(jsonb_string(&at, &slen)[0], 'A');
+        sdb_free(doc);
+
+        /* Cut anywhere, the text is refused the same way by both */
+        for (int cut = n - 1; cut > 0; cut -= 7) {
+            ASSERT_EQ(json_parse_both(text, (size_t)cut, &doc, &len), SPEEDSQL_MISMATCH);
+        }
+    }
+
+    const char* bad[] = {"\"a\tb\"", "[\"\\\"]", "{\"a\":1,}", "[1 2]", "\"a\"\"b\"",
+                         "[1]x", "{\"a\":tru}", "[-]", "[1e]", "nul"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        uint8_t* doc = nullptr;
+        uint32_t len = 0;
+        ASSERT_EQ(json_parse_both(bad[i], strlen(bad[i]), &doc, &len), SPEEDSQL_MISMATCH);
+    }
+
+    /* On demand: off-path values are skipped, the last duplicate wins */
+    const char* event = "{\"skip\": [{\"x\": \"]}\"}, [[]]], \"user\": {\"id\": 1, \"tags\": "
+                        "[\"a\", {\"b\": [10, 20]}]}, \"name\": \"\\u00e9t\\u00e9\", \"user\": "
+                        "{\"id\": 42, \"tags\": [\"z\", {\"b\": [30, 40]}]}, \"n\": null}";
+    char* out = nullptr;
+    ASSERT_EQ(speedsql_json_extract(nullptr, event, "$.user.id", &out), SPEEDSQL_OK);
+    ASSERT_STR_EQ(out, "42");
+    speedsql_free(out);
+    ASSERT_EQ(speedsql_json_extract(nullptr, event, "$.user.tags[1].b[1]", &out), SPEEDSQL_OK);
+    ASSERT_STR_EQ(out, "40");
+    speedsql_free(out);
+    ASSERT_EQ(speedsql_json_extract(nullptr, event, "$.name", &out), SPEEDSQL_OK);
+    ASSERT_STR_EQ(out, "\xc3\xa9t\xc3\xa9");
+    speedsql_free(out);
+    ASSERT_EQ(speedsql_json_extract(nullptr, event, "$.user.tags", &out), SPEEDSQL_OK);
+    ASSERT_STR_EQ(out, "[\"z\",{\"b\":[30,40]}]");
+    speedsql_free(out);
+    ASSERT_EQ(speedsql_json_extract(nullptr, event, "$.n", &out), SPEEDSQL_OK);
+    ASSERT_TRUE(out == nullptr);
+    ASSERT_EQ(speedsql_json_extract(nullptr, event, "$.user.tags[2]", &out), SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(speedsql_json_extract(nullptr, event, "$.name.x", &out), SPEEDSQL_NOTFOUND);
+    ASSERT_EQ(speedsql_json_extract(nullptr, event, "$.user.", &out), SPEEDSQL_ERROR);
+    ASSERT_EQ(speedsql_json_extract(nullptr, "{\"a\": [1, 2", "$.a", &out), SPEEDSQL_MISMATCH);
+
+    /* The whole document's structure is checked, and the value returned
+     * is parsed in full */
+    ASSERT_EQ(speedsql_json_extract(nullptr, "{\"a\": 1, \"b\": [}", "$.a", &out),
+              SPEEDSQL_MISMATCH);
+    ASSERT_EQ(speedsql_json_extract(nullptr, "[1,2", "$[0]", &out), SPEEDSQL_MISMATCH);
+    ASSERT_EQ(speedsql_json_extract(nullptr, "{\"a\":1}x", "$.a", &out), SPEEDSQL_MISMATCH);
+    ASSERT_EQ(speedsql_json_extract(nullptr, "{\"a\":1} {}", "$.a", &out), SPEEDSQL_MISMATCH);
+    ASSERT_EQ(speedsql_json_extract(nullptr, "{\"a\" 1}", "$.a", &out), SPEEDSQL_MISMATCH);
+    ASSERT_EQ(speedsql_json_extract(nullptr, "{\"a\": [1, }, \"b\": 2}", "$.a", &out),
+              SPEEDSQL_MISMATCH);
+}
+
+TEST(json_extract_sql_and_insert_conversion) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE events (id INTEGER, payload JSON, raw TEXT)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO events VALUES (1, "
+                            "'{\"kind\": \"click\", \"user\": {\"id\": 7}, \"ms\": 1.5}', "
+                            "'{\"kind\": \"click\"}')", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO events VALUES (2, "
+                            "'{\"kind\": \"view\", \"user\": {\"id\": 8}, \"tags\": [\"a\"]}', "
+                            "'{\"kind\": \"view\"}')", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO events VALUES (3, '{\"kind\": ', 'x')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_MISMATCH);
+
+    /* Text written to a JSON column is stored binary */
+    speedsql_stmt* stmt = nullptr;
+    ASSERT_EQ(speedsql_prepare(db, "SELECT payload, json_extract(payload, '$.user.id'), "
+                               "json_extract(payload, '$.ms'), json_extract(raw, '$.kind'), "
+                               "json_extract(payload, '$.tags') FROM events WHERE id = 2",
+                               -1, &stmt, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_type(stmt, 0), SPEEDSQL_TYPE_JSON);
+    ASSERT_EQ(speedsql_column_type(stmt, 1), SPEEDSQL_TYPE_INT);
+    ASSERT_EQ(speedsql_column_int64(stmt, 1), 8);
+    ASSERT_EQ(speedsql_column_type(stmt, 2), SPEEDSQL_TYPE_NULL);
+    ASSERT_STR_EQ((const char*)speedsql_column_text(stmt, 3), "view");
+    ASSERT_EQ(speedsql_column_type(stmt, 4), SPEEDSQL_TYPE_JSON);
+    ASSERT_STR_EQ(speedsql_column_json(stmt, 4), "[\"a\"]");
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+    speedsql_finalize(stmt);
+
+    ASSERT_EQ(speedsql_prepare(db, "SELECT id FROM events "
+                               "WHERE json_extract(payload, '$.kind') = 'click'",
+                               -1, &stmt, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_int64(stmt, 0), 1);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+    speedsql_finalize(stmt);
+
+    /* An UPDATE to invalid JSON changes nothing */
+    ASSERT_EQ(speedsql_exec(db, "UPDATE events SET payload = '[1,' WHERE id = 1",
+                            nullptr, nullptr, nullptr), SPEEDSQL_MISMATCH);
+    ASSERT_EQ(speedsql_exec(db, "UPDATE events SET payload = '{\"kind\": \"buy\"}' WHERE id = 1",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_prepare(db, "SELECT json_extract(payload, '$.kind') FROM events "
+                               "WHERE id = 1", -1, &stmt, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_STR_EQ((const char*)speedsql_column_text(stmt, 0), "buy");
+    speedsql_finalize(stmt);
+    speedsql_close(db);
+}
+
+/* ============================================================================
+ * Expression Index Tests
+ * ============================================================================ */
+
+/* Rows of a one-parameter query, and whether it ran as an index scan */
+static int expr_index_rows(speedsql* db, const char* sql, const char* arg, bool* indexed) {
+    speedsql_stmt* stmt = nullptr;
+    if (speedsql_prepare(db, sql, -1, &stmt, nullptr) != SPEEDSQL_OK) return -1;
+    if (arg) speedsql_bind_text(stmt, 1, arg, -1, nullptr);
+
+    int rows = 0;
+    while (speedsql_step(stmt) == SPEEDSQL_ROW) rows++;
+    *indexed = stmt->plan && stmt->plan->type == PLAN_INDEX_SCAN;
+    speedsql_finalize(stmt);
+    return rows;
+}
+
+TEST(expression_index_json_path_maintained) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE events (id INTEGER, payload JSON)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    /* Rows before the index are indexed by CREATE INDEX, rows after by INSERT */
+    char sql[160];
+    for (int i = 0; i < 400; i++) {
+        if (i == 250) {
+            ASSERT_EQ(speedsql_exec(db, "CREATE INDEX events_user ON events "
+                                    "(json_extract(payload, '$.user_id'))",
+                                    nullptr, nullptr, nullptr), SPEEDSQL_OK);
+        }
+        snprintf(sql, sizeof(sql), "INSERT INTO events VALUES (%d, "
+                 "'{\"user_id\": %d, \"kind\": \"k%d\"}')", i, i % 10, i % 3);
+        ASSERT_EQ(speedsql_exec(db, sql, nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    }
+
+    bool indexed = false;
+    const char* by_user = "SELECT id FROM events WHERE json_extract(payload, '$.user_id') = 7";
+    ASSERT_EQ(expr_index_rows(db, by_user, nullptr, &indexed), 40);
+    ASSERT_TRUE(indexed);
+
+    /* Any conjunct can pick the index; the others are checked per row */
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM events WHERE id < 100 AND "
+                              "json_extract(payload, '$.user_id') = 7", nullptr, &indexed), 10);
+    ASSERT_TRUE(indexed);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM events WHERE json_extract(payload, '$.kind') = ?",
+                              "k1", &indexed), 133);
+    ASSERT_FALSE(indexed);
+
+    /* UPDATE moves a row's key and DELETE drops it */
+    ASSERT_EQ(speedsql_exec(db, "UPDATE events SET payload = '{\"user_id\": 70}' WHERE id = 17",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "DELETE FROM events WHERE id = 27 OR id = 397",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(expr_index_rows(db, by_user, nullptr, &indexed), 37);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM events WHERE "
+                              "json_extract(payload, '$.user_id') = 70", nullptr, &indexed), 1);
+    ASSERT_TRUE(indexed);
+
+    /* Column indexes are kept current the same way */
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX events_id ON events (id)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO events VALUES (27, '{}')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(expr_index_rows(db, "SELECT payload FROM events WHERE id = 27", nullptr, &indexed), 1);
+    ASSERT_TRUE(indexed);
+    speedsql_close(db);
+}
+
+TEST(expression_index_lower_and_reopen) {
+    const char* path = "test_expression_index.db";
+    remove(path);
+
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE users (id INTEGER, email TEXT)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX users_email ON users (LOWER(email))",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    /* Keys hold a prefix of long text; the WHERE tells these apart */
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO users VALUES "
+                            "(1, 'Someone.With.A.Long.Name.1@Example.com'), "
+                            "(2, 'Someone.With.A.Long.Name.2@Example.com'), (3, 'ann@x.org')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    /* The key has to be an expression on the table, alone in its index */
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX bad ON users (lower(mail))",
+                            nullptr, nullptr, nullptr), SPEEDSQL_ERROR);
+    ASSERT_NE(speedsql_exec(db, "CREATE INDEX bad ON users (id, lower(email))",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    bool indexed = false;
+    const char* by_email = "SELECT id, upper(email) FROM users WHERE lower(email) = ?";
+    ASSERT_EQ(expr_index_rows(db, by_email, "someone.with.a.long.name.2@example.com", &indexed), 1);
+    ASSERT_TRUE(indexed);
+    ASSERT_EQ(expr_index_rows(db, by_email, "Ann@X.org", &indexed), 0);
+    speedsql_close(db);
+
+    /* The key expression is kept with the schema */
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO users VALUES (4, 'ANN@X.ORG')",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(expr_index_rows(db, by_email, "ann@x.org", &indexed), 2);
+    ASSERT_TRUE(indexed);
+
+    speedsql_stmt* stmt = nullptr;
+    ASSERT_EQ(speedsql_prepare(db, by_email, -1, &stmt, nullptr), SPEEDSQL_OK);
+    speedsql_bind_text(stmt, 1, "someone.with.a.long.name.1@example.com", -1, nullptr);
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_ROW);
+    ASSERT_EQ(speedsql_column_int64(stmt, 0), 1);
+    ASSERT_STR_EQ((const char*)speedsql_column_text(stmt, 1),
+                  "SOMEONE.WITH.A.LONG.NAME.1@EXAMPLE.COM");
+    ASSERT_EQ(speedsql_step(stmt), SPEEDSQL_DONE);
+    speedsql_finalize(stmt);
+    speedsql_close(db);
+    remove(path);
+}
+
+TEST(expression_index_large_table_reopen) {
+    const char* path = "test_expression_index_large.db";
+    remove(path);
+
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE t (id INTEGER, v INTEGER)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX t_v ON t (v)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+
+    /* Enough rows to split the table's root page */
+    char sql[96];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO t VALUES (%d, %d)", i, i % 7);
+        ASSERT_EQ(speedsql_exec(db, sql, nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    }
+    speedsql_close(db);
+
+    /* Index lookups, DELETE and UPDATE all start from the saved root */
+    bool indexed = false;
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM t WHERE v = 0", nullptr, &indexed), 143);
+    ASSERT_TRUE(indexed);
+    ASSERT_EQ(speedsql_exec(db, "DELETE FROM t WHERE v = 3",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "UPDATE t SET v = 40 WHERE v = 4",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM t", nullptr, &indexed), 857);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM t WHERE v = 40", nullptr, &indexed), 143);
+    ASSERT_TRUE(indexed);
+    speedsql_close(db);
+
+    /* The writes above moved the root again; it is saved once more */
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM t", nullptr, &indexed), 857);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM t WHERE v = 3", nullptr, &indexed), 0);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM t WHERE v = 40", nullptr, &indexed), 143);
+    speedsql_close(db);
+    remove(path);
+}
+
+/* ============================================================================
+ * Partial Index Tests
+ * ============================================================================ */
+
+/* Entries in the B+tree of a named index */
+static int partial_index_entries(speedsql* db, const char* name) {
+    for (size_t i = 0; i < db->index_count; i++) {
+        if (strcmp(db->indices[i].name, name) != 0) continue;
+
+        btree_t tree;
+        btree_open(&tree, db->buffer_pool, &db->db_file, db->indices[i].root_page, value_compare);
+        btree_cursor_t cursor;
+        btree_cursor_init(&cursor, &tree);
+        btree_cursor_first(&cursor);
+        int entries = 0;
+        while (cursor.valid && !cursor.at_end) {
+            entries++;
+            btree_cursor_next(&cursor);
+        }
+        btree_cursor_close(&cursor);
+        btree_close(&tree);
+        return entries;
+    }
+    return -1;
+}
+
+TEST(partial_index_maintained_on_writes) {
+    speedsql* db = nullptr;
+    speedsql_open(":memory:", &db);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE jobs (id INTEGER, status TEXT, owner INTEGER)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    char sql[128];
+    for (int i = 0; i < 300; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO jobs VALUES (%d, '%s', %d)",
+                 i, i % 50 == 0 ? "pending" : "done", i % 4);
+        ASSERT_EQ(speedsql_exec(db, sql, nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    }
+
+    /* Only the hot rows are indexed, by CREATE INDEX and every write after */
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX jobs_pending ON jobs (owner) "
+                            "WHERE status = 'pending'", nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(partial_index_entries(db, "jobs_pending"), 6);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO jobs VALUES (300, 'pending', 1), (301, 'done', 1)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(partial_index_entries(db, "jobs_pending"), 7);
+    ASSERT_EQ(speedsql_exec(db, "UPDATE jobs SET status = 'done' WHERE id = 50",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(partial_index_entries(db, "jobs_pending"), 6);
+    ASSERT_EQ(speedsql_exec(db, "UPDATE jobs SET status = 'pending' WHERE id = 7 OR id = 8",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(partial_index_entries(db, "jobs_pending"), 8);
+    ASSERT_EQ(speedsql_exec(db, "UPDATE jobs SET owner = 9 WHERE id = 8",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "DELETE FROM jobs WHERE id = 0 OR id = 1",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(partial_index_entries(db, "jobs_pending"), 7);
+
+    /* The index finds the moved key and none of the rows that left it */
+    bool indexed = false;
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM jobs WHERE status = 'pending' AND owner = 9",
+                              nullptr, &indexed), 1);
+    ASSERT_TRUE(indexed);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM jobs WHERE status = 'pending'",
+                              nullptr, &indexed), 7);
+    ASSERT_TRUE(indexed);
+
+    /* The predicate has to be on the table's columns, and only B+trees
+     * can be partial */
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX bad ON jobs (owner) WHERE state = 'x'",
+                            nullptr, nullptr, nullptr), SPEEDSQL_ERROR);
+    ASSERT_NE(speedsql_exec(db, "CREATE INDEX bad ON jobs USING FTS (status) WHERE owner = 1",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(partial_index_entries(db, "bad"), -1);
+    speedsql_close(db);
+}
+
+TEST(partial_index_used_when_implied) {
+    const char* path = "test_partial_index.db";
+    remove(path);
+
+    speedsql* db = nullptr;
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE TABLE jobs (id INTEGER, status TEXT, owner INTEGER)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "CREATE INDEX jobs_hot ON jobs (id) "
+                            "WHERE status = 'pending' AND owner > 1", nullptr, nullptr, nullptr),
+              SPEEDSQL_OK);
+    ASSERT_EQ(speedsql_exec(db, "INSERT INTO jobs VALUES (1, 'pending', 1), (2, 'pending', 2), "
+                            "(3, 'pending', 3), (4, 'done', 3), (5, 'pending', 3)",
+                            nullptr, nullptr, nullptr), SPEEDSQL_OK);
+    speedsql_close(db);
+
+    /* The predicate is kept with the schema */
+    ASSERT_EQ(speedsql_open(path, &db), SPEEDSQL_OK);
+    ASSERT_EQ(partial_index_entries(db, "jobs_hot"), 3);
+
+    /* Used when every conjunct of the predicate is one of the query's, in
+     * either order and either way round */
+    bool indexed = false;
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM jobs WHERE owner > 1 AND "
+                              "'pending' = status", nullptr, &indexed), 3);
+    ASSERT_TRUE(indexed);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM jobs WHERE status = 'pending' AND "
+                              "owner > 1 AND id = 3", nullptr, &indexed), 1);
+    ASSERT_TRUE(indexed);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM jobs WHERE status = 'pending' AND "
+                              "owner > 1 AND owner < 3", nullptr, &indexed), 1);
+    ASSERT_TRUE(indexed);
+
+    /* Not when the query may want rows the index leaves out */
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM jobs WHERE status = 'pending'",
+                              nullptr, &indexed), 4);
+    ASSERT_FALSE(indexed);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM jobs WHERE id = 1", nullptr, &indexed), 1);
+    ASSERT_FALSE(indexed);
+    ASSERT_EQ(expr_index_rows(db, "SELECT id FROM jobs WHERE status = 'pending' OR owner > 1",
+                              nullptr, &indexed), 5);
+    ASSERT_FALSE(indexed);
+    speedsql_close(db);
+    remove(path);
+}
 
 /* ============================================================================
  * Main
@@ -894,6 +4376,8 @@ int main() {
     RUN_TEST(db_exec_insert_select);
     RUN_TEST(db_prepared_stmt);
     RUN_TEST(db_transaction);
+    RUN_TEST(db_memory_many_rows);
+    RUN_TEST(db_memory_snapshot);
 
     /* Savepoint tests */
     printf("\nSavepoint Tests:\n");
@@ -923,6 +4407,134 @@ int main() {
     RUN_TEST(integration_drop_table);
     RUN_TEST(integration_transaction_commit);
     RUN_TEST(integration_transaction_rollback);
+    RUN_TEST(integration_rollback_memory);
+
+    /* VFS tests */
+    printf("\nVFS Tests:\n");
+    RUN_TEST(vfs_find);
+    RUN_TEST(vfs_memory_backend);
+    RUN_TEST(vfs_custom_register);
+    RUN_TEST(vfs_locks_and_mmap);
+#ifdef SPEEDSQL_HAVE_IO_URING
+    RUN_TEST(vfs_io_uring);
+#endif
+
+    /* Backup tests */
+    printf("\nBackup Tests:\n");
+    RUN_TEST(backup_online);
+    RUN_TEST(backup_incremental);
+
+    /* Replication tests */
+    printf("\nReplication Tests:\n");
+    RUN_TEST(wal_follower_segments);
+    RUN_TEST(wal_follower_tail);
+    RUN_TEST(wal_checkpoint_restarts_log);
+
+    /* Snapshot tests */
+    printf("\nSnapshot Tests:\n");
+    RUN_TEST(snapshot_point_in_time);
+    RUN_TEST(snapshot_outlives_writer);
+
+    /* Cipher acceleration tests */
+    printf("\nCipher Acceleration Tests:\n");
+    RUN_TEST(aes_gcm_hw_matches_portable);
+    RUN_TEST(aes_gcm_self_test_both_paths);
+    RUN_TEST(aes_gcm_portable_tables);
+    RUN_TEST(aria_gcm_authenticates);
+    RUN_TEST(chacha20_simd_matches_portable);
+    RUN_TEST(chacha20_poly1305_authenticates);
+
+    /* Parallel crypto tests */
+    printf("\nParallel Crypto Tests:\n");
+    RUN_TEST(parallel_flush_encrypted);
+    RUN_TEST(concurrent_encrypted_page_io);
+
+    /* Aligned page layout tests */
+    printf("\nAligned Page Layout Tests:\n");
+    RUN_TEST(aligned_encrypted_database);
+    RUN_TEST(aligned_page_nonce_and_tamper);
+
+    /* Online rekey tests */
+    printf("\nOnline Rekey Tests:\n");
+    RUN_TEST(online_rekey_reseals_pages);
+    RUN_TEST(online_rekey_password_reopens);
+    RUN_TEST(online_rekey_cipher_change_with_writes);
+
+    /* WAL encryption tests */
+    printf("\nWAL Encryption Tests:\n");
+    RUN_TEST(wal_sealed_frames_ship_to_keyed_follower);
+    RUN_TEST(wal_sealed_segment_rejects_tampering);
+
+    /* Block cipher table tests */
+    printf("\nBlock Cipher Table Tests:\n");
+    RUN_TEST(aria_ttables_match_bytewise_output);
+    RUN_TEST(seed_cbc_round_trip);
+
+    /* Key derivation tests */
+    printf("\nKey Derivation Tests:\n");
+    RUN_TEST(pbkdf2_sha256_both_paths);
+    RUN_TEST(pbkdf2_sha512_vectors);
+    RUN_TEST(argon2id_lanes_on_threads);
+    RUN_TEST(kdf_cache_reuses_derived_keys);
+    RUN_TEST(key_salt_kept_in_header);
+
+    /* Crypto benchmark tests */
+    printf("\nCrypto Benchmark Tests:\n");
+    RUN_TEST(crypto_benchmark_covers_custom_providers);
+    RUN_TEST(crypto_fastest_picks_compliant_aead);
+
+    /* Vector index tests */
+    printf("\nVector Index Tests:\n");
+    RUN_TEST(hnsw_recall_against_brute_force);
+    RUN_TEST(hnsw_sql_order_by_vec_distance);
+
+    /* Vector distance tests */
+    printf("\nVector Distance Tests:\n");
+    RUN_TEST(vector_kernels_match_portable);
+    RUN_TEST(vector_sql_functions_and_exact_search);
+
+    /* Vector quantization tests */
+    printf("\nVector Quantization Tests:\n");
+    RUN_TEST(vector_quantization_codecs);
+    RUN_TEST(hnsw_quantized_search_reranks);
+
+    /* IVF index tests */
+    printf("\nIVF Index Tests:\n");
+    RUN_TEST(ivf_recall_against_brute_force);
+    RUN_TEST(ivf_sql_order_by_vec_distance);
+
+    /* FTS index tests */
+    printf("\nFTS Index Tests:\n");
+    RUN_TEST(fts_boolean_phrase_queries_and_merge);
+    RUN_TEST(fts_sql_match_operator);
+
+    /* BM25 ranking tests */
+    printf("\nBM25 Ranking Tests:\n");
+    RUN_TEST(fts_bm25_ranking_and_block_max_topk);
+    RUN_TEST(fts_search_scores_and_topk);
+
+    /* JSON tests */
+    printf("\nJSON Tests:\n");
+    RUN_TEST(jsonb_sorted_keys_and_path_navigation);
+    RUN_TEST(json_column_binary_storage);
+    RUN_TEST(json_column_stored_inline);
+    RUN_TEST(row_overflow_pages);
+
+    /* JSON parser tests */
+    printf("\nJSON Parser Tests:\n");
+    RUN_TEST(json_two_stage_parser_and_extract);
+    RUN_TEST(json_extract_sql_and_insert_conversion);
+
+    /* Expression index tests */
+    printf("\nExpression Index Tests:\n");
+    RUN_TEST(expression_index_json_path_maintained);
+    RUN_TEST(expression_index_lower_and_reopen);
+    RUN_TEST(expression_index_large_table_reopen);
+
+    /* Partial index tests */
+    printf("\nPartial Index Tests:\n");
+    RUN_TEST(partial_index_maintained_on_writes);
+    RUN_TEST(partial_index_used_when_implied);
 
     printf("\n===================\n");
     printf("Results: %d passed, %d failed\n", passed, failed);